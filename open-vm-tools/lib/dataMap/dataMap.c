@@ -69,8 +69,17 @@ typedef union {
    } strList;
 } DMFieldValue;
 
+/*
+ * Entry flags. Entries decoded by DataMap_DeserializeArena live in the map
+ * arena, and so does their payload until the entry is replaced by a setter.
+ */
+#define DMENTRY_ARENA           0x1
+#define DMENTRY_ARENA_PAYLOAD   0x2
+
 typedef struct {
    DMFieldType type;
+   uint32 flags;
+   uint64 encodedLen;   /* cached serialized size of this entry */
    DMFieldValue value;
 } DataMapEntry;
 
@@ -90,8 +99,137 @@ typedef struct {
    uint32 fieldIdListLen; /* fieldIdList size */
 } ClientData;
 
+/* carves DataMap_DeserializeArena allocations out of the map arena */
+typedef struct {
+   uint64 numEntries;
+   uint64 numNumbers;
+   uint64 numStrings;
+   uint64 numLengths;
+
+   DataMapEntry *entries;
+   int64 *numbers;
+   char **strings;
+   int32 *lengths;
+} ArenaCursor;
+
 static const uint64 magic_cookie = 0x4d41474943ULL;   /* 'MAGIC' */
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * EntryEncodedLen --
+ *
+ *      - calculate how much space is needed to encode an entry
+ *
+ * Result:
+ *      The encoded size in bytes.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+EntryEncodedLen(const DataMapEntry *entry)    // IN
+{
+   uint64 len = sizeof(int32) + sizeof(DMKeyType);    /* type, fieldId */
+
+   switch(entry->type) {
+      case DMFIELDTYPE_INT64:
+         len += sizeof(int64);
+         break;
+      case DMFIELDTYPE_STRING:
+         len += sizeof(int32) + entry->value.string.length;
+         break;
+      case DMFIELDTYPE_INT64LIST:
+         len += sizeof(int32) +
+                sizeof(int64) * (uint64)entry->value.numList.length;
+         break;
+      case DMFIELDTYPE_STRINGLIST:
+         {
+            char **strPtr = entry->value.strList.strings;
+            int32 *lenPtr = entry->value.strList.lengths;
+
+            len += sizeof(int32);        /* list size */
+            for (; *strPtr != NULL; strPtr++, lenPtr++) {
+               len += sizeof(int32) + *lenPtr;
+            }
+            break;
+         }
+      default:
+         ASSERT(0);    /*  we do not expect this to happen */
+   }
+
+   return len;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * UpdateEncodedLen --
+ *
+ *      - refresh the cached encoded size of an entry that was just added
+ *        or modified, and the map total along with it.
+ *
+ * Result:
+ *      None
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+UpdateEncodedLen(DataMap *that,         // IN/OUT
+                 DataMapEntry *entry)   // IN/OUT
+{
+   that->encodedLen -= entry->encodedLen;
+   entry->encodedLen = EntryEncodedLen(entry);
+   that->encodedLen += entry->encodedLen;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * PutEntry --
+ *
+ *      - low level helper function to insert a new entry into the map.
+ *        On failure a heap allocated entry structure is freed, the payload
+ *        is left to the caller.
+ *
+ * Result:
+ *      0 on success
+ *      error code otherwise
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static ErrorCode
+PutEntry(DataMap *that,         // IN/OUT
+         DMKeyType key,         // IN
+         DataMapEntry *entry)   // IN
+{
+   if (!HashMap_Put(that->map, &key, &entry)) {
+      if ((entry->flags & DMENTRY_ARENA) == 0) {
+         free(entry);
+      }
+      return DMERR_INSUFFICIENT_MEM;
+   }
+
+   entry->encodedLen = 0;
+   UpdateEncodedLen(that, entry);
+
+   return DMERR_SUCCESS;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -120,11 +258,10 @@ AddEntry_Int64(DataMap *that,      // IN/OUT
       return DMERR_INSUFFICIENT_MEM;
    }
    entry->type = DMFIELDTYPE_INT64;
+   entry->flags = 0;
    entry->value.number.val = value;
-   if (!HashMap_Put(that->map, &key, &entry)) {
-      return DMERR_INSUFFICIENT_MEM;
-   }
-   return DMERR_SUCCESS;
+
+   return PutEntry(that, key, entry);
 }
 
 
@@ -158,13 +295,11 @@ AddEntry_String(DataMap *that,      // IN/OUT
       return DMERR_INSUFFICIENT_MEM;
    }
    entry->type = DMFIELDTYPE_STRING;
+   entry->flags = 0;
    entry->value.string.str = str;
    entry->value.string.length = strLen;
 
-   if (!HashMap_Put(that->map, &key, &entry)) {
-      return DMERR_INSUFFICIENT_MEM;
-   }
-   return DMERR_SUCCESS;
+   return PutEntry(that, key, entry);
 }
 
 
@@ -199,13 +334,11 @@ AddEntry_Int64List(DataMap *that,            // IN/OUT
       return DMERR_INSUFFICIENT_MEM;
    }
    entry->type = DMFIELDTYPE_INT64LIST;
+   entry->flags = 0;
    entry->value.numList.numbers = numbers;
    entry->value.numList.length = listLen;
 
-   if (!HashMap_Put(that->map, &key, &entry)) {
-      return DMERR_INSUFFICIENT_MEM;
-   }
-   return DMERR_SUCCESS;
+   return PutEntry(that, key, entry);
 }
 
 
@@ -245,13 +378,11 @@ AddEntry_StringList(DataMap *that,            // IN/OUT
       return DMERR_INSUFFICIENT_MEM;
    }
    entry->type = DMFIELDTYPE_STRINGLIST;
+   entry->flags = 0;
    entry->value.strList.strings = strList;
    entry->value.strList.lengths = strLens;
 
-   if (!HashMap_Put(that->map, &key, &entry)) {
-      return DMERR_INSUFFICIENT_MEM;
-   }
-   return DMERR_SUCCESS;
+   return PutEntry(that, key, entry);
 }
 
 
@@ -310,6 +441,12 @@ FreeEntryPayload(DataMapEntry *entry)    // IN
       return;
    }
 
+   if (entry->flags & DMENTRY_ARENA_PAYLOAD) {
+      /* owned by the map arena */
+      entry->flags &= ~DMENTRY_ARENA_PAYLOAD;
+      return;
+   }
+
    switch(entry->type) {
       case DMFIELDTYPE_INT64:
          break;
@@ -652,7 +789,9 @@ static void
 FreeEntry(DataMapEntry *entry)    // IN
 {
    FreeEntryPayload(entry);
-   free(entry);
+   if ((entry->flags & DMENTRY_ARENA) == 0) {
+      free(entry);
+   }
 }
 
 
@@ -755,6 +894,8 @@ DataMap_Create(DataMap *that)    // IN/OUT
 
    if (that->map != NULL) {
       that->cookie = magic_cookie;
+      that->encodedLen = 0;
+      that->arena = NULL;
       return DMERR_SUCCESS;
    }
 
@@ -1239,95 +1380,6 @@ HashMapToStringEntryCb(void *key,            // IN
 }
 
 
-/*
- *-----------------------------------------------------------------------------
- *
- * HashMapCalcEntrySizeCb --
- *
- *      - calculate how much space is needed to encode an entry
- *
- * Result:
- *      None
- *
- * Side-effects:
- *      None
- *
- *-----------------------------------------------------------------------------
- */
-
-static void
-HashMapCalcEntrySizeCb(void *key,            // IN
-                       void *data,           // IN
-                       void *userData)       // IN/OUT
-{
-   DataMapEntry *entry = *((DataMapEntry **)data);
-   ClientData *clientData = (ClientData *)userData;
-   uint32 oldLen = clientData->buffLen;
-   uint32 *buffLen = &(clientData->buffLen);
-
-   if (clientData->result != DMERR_SUCCESS) {
-      /* a previous error has occurred, so stop. */
-      return;
-   }
-
-   switch(entry->type) {
-      case DMFIELDTYPE_INT64:
-         {
-            *buffLen += sizeof(int32);        /* type */
-            *buffLen += sizeof(DMKeyType);    /* fieldId */
-            *buffLen += sizeof(int64);        /* int value */
-            break;
-         }
-      case DMFIELDTYPE_STRING:
-         {
-            *buffLen += sizeof(int32);        /* type */
-            *buffLen += sizeof(DMKeyType);    /* fieldId */
-            *buffLen += sizeof(int32);        /* string length */
-            *buffLen += entry->value.string.length; /* string payload */
-            break;
-         }
-      case DMFIELDTYPE_INT64LIST:
-         {
-            *buffLen += sizeof(int32);        /* type */
-            *buffLen += sizeof(DMKeyType);    /* fieldId */
-            *buffLen += sizeof(int32);        /* list size */
-            *buffLen += sizeof(int64) * entry->value.numList.length;
-            break;
-         }
-      case DMFIELDTYPE_STRINGLIST:
-         {
-            char **strPtr = entry->value.strList.strings;
-            int32 *lenPtr = entry->value.strList.lengths;
-
-            *buffLen += sizeof(int32);        /* type */
-            *buffLen += sizeof(DMKeyType);    /* fieldId */
-            *buffLen += sizeof(int32);        /* list size */
-
-            for (; *strPtr != NULL; strPtr++, lenPtr++) {
-               if (*buffLen < oldLen) {
-                  clientData->result = DMERR_INTEGER_OVERFLOW;
-                  return;
-               }
-
-               *buffLen += sizeof(int32);   /* string length */
-               *buffLen += *lenPtr;        /* string payload */
-            }
-            break;
-         }
-      default:
-         {
-            clientData->result = DMERR_UNKNOWN_TYPE;
-            return;
-         }
-   }
-
-   if (*buffLen < oldLen) {
-      clientData->result = DMERR_INTEGER_OVERFLOW;
-      return;
-   }
-}
-
-
 /*
  *-----------------------------------------------------------------------------
  *
@@ -1354,6 +1406,8 @@ HashMapSerializeEntryCb(void *key,            // IN
    char **buffPtr = &(clientData->buffer);
    char *buffPtrOrig = clientData->buffer;
 
+   ASSERT(entry->encodedLen <= clientData->buffLen);
+
    EncodeInt32(buffPtr, entry->type);   /* encode type */
    EncodeInt32(buffPtr, *((DMKeyType *)key));   /* encode field id*/
 
@@ -1393,6 +1447,7 @@ HashMapSerializeEntryCb(void *key,            // IN
    }
 
    /* Update left buffer size so we can do a sanity check at the end */
+   ASSERT(clientData->buffer - buffPtrOrig == entry->encodedLen);
    clientData->buffLen -= (clientData->buffer - buffPtrOrig);
 }
 
@@ -1663,8 +1718,11 @@ DataMap_Destroy(DataMap *that)    // IN/OUT
    HashMap_Iterate(that->map, HashMapFreeEntryCb, TRUE, NULL);
 
    HashMap_DestroyMap(that->map);
+   free(that->arena);
 
    that->map = NULL;
+   that->arena = NULL;
+   that->encodedLen = 0;
    that->cookie = 0;
 
    return DMERR_SUCCESS;
@@ -1723,6 +1781,46 @@ DataMap_Copy(const DataMap *src,  // IN
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * SerializeEntries --
+ *
+ *     Encode the packet length and every entry into 'buf', which must hold
+ *     that->encodedLen plus four bytes. The per entry sizes are kept up to
+ *     date as the map is modified, so this is the only pass over the map.
+ *
+ * Result:
+ *     None
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+SerializeEntries(const DataMap *that,   // IN
+                 char *buf)             // OUT
+{
+   ClientData clientData;
+
+   memset(&clientData, 0, sizeof clientData);
+   clientData.map = (DataMap *)that;
+   clientData.result = DMERR_SUCCESS;
+   clientData.buffer = buf;
+   clientData.buffLen = (uint32)that->encodedLen;
+
+   /* Encode the payload size */
+   EncodeInt32(&(clientData.buffer), clientData.buffLen);
+
+   HashMap_Iterate(that->map, HashMapSerializeEntryCb, FALSE, &clientData);
+
+   /* sanity check, make sure the buffer size is just used up*/
+   ASSERT(clientData.buffLen == 0);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -1749,26 +1847,17 @@ DataMap_Serialize(const DataMap *that,     // IN
                   char **buf,              // OUT
                   uint32 *bufLen)          // OUT
 {
-   ClientData clientData;
-
    if (that == NULL || buf == NULL || bufLen == NULL) {
       return DMERR_INVALID_ARGS;
    }
 
    ASSERT(that->cookie == magic_cookie);
 
-   /* get the buffer size first */
-   memset(&clientData, 0, sizeof clientData);
-   HashMap_Iterate(that->map, HashMapCalcEntrySizeCb, FALSE, &clientData);
-   if (clientData.result != DMERR_SUCCESS) {
-      return clientData.result;
-   }
-
    /* 4 bytes is payload length */
-   *bufLen = clientData.buffLen + sizeof(uint32);
-   if (*bufLen < clientData.buffLen) {
+   if (that->encodedLen > MAX_UINT32 - sizeof(uint32)) {
       return DMERR_INTEGER_OVERFLOW;
    }
+   *bufLen = (uint32)that->encodedLen + sizeof(uint32);
 
    *buf = (char *)malloc(*bufLen);
 
@@ -1776,25 +1865,64 @@ DataMap_Serialize(const DataMap *that,     // IN
       return DMERR_INSUFFICIENT_MEM;
    }
 
-   /* now serialize the map into the buffer */
-   clientData.map = (DataMap *)that;
-   clientData.result = DMERR_SUCCESS;
-   clientData.buffer = *buf;
+   SerializeEntries(that, *buf);
 
-   /* Encode the payload size */
-   EncodeInt32(&(clientData.buffer), clientData.buffLen);
+   return DMERR_SUCCESS;
+}
 
-   HashMap_Iterate(that->map, HashMapSerializeEntryCb, FALSE, &clientData);
 
-   /* sanity check, make sure the buffer size is just used up*/
-   ASSERT(clientData.buffLen == 0);
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DataMap_SerializeToDynBuf --
+ *
+ *     Serialize a DataMap, appending the packet to a DynBuf.
+ *     - 'buf': an initialized DynBuf. The buffer is grown at most once, so a
+ *       DynBuf reused across packets settles at the largest packet size and
+ *       stops allocating.
+ *
+ * Result:
+ *     0 on success
+ *     error code on failures, 'buf' is left unchanged.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
 
-   if (clientData.result != DMERR_SUCCESS) {
-      free(*buf);
-      *buf = NULL;
-      *bufLen = 0;
+ErrorCode
+DataMap_SerializeToDynBuf(const DataMap *that,  // IN
+                          DynBuf *buf)          // IN/OUT
+{
+   size_t oldSize;
+   size_t newSize;
+
+   if (that == NULL || buf == NULL) {
+      return DMERR_INVALID_ARGS;
    }
-   return clientData.result;
+
+   ASSERT(that->cookie == magic_cookie);
+
+   if (that->encodedLen > MAX_UINT32 - sizeof(uint32)) {
+      return DMERR_INTEGER_OVERFLOW;
+   }
+
+   oldSize = DynBuf_GetSize(buf);
+   newSize = oldSize + (size_t)that->encodedLen + sizeof(uint32);
+   if (newSize < oldSize) {
+      return DMERR_INTEGER_OVERFLOW;
+   }
+
+   if (newSize > DynBuf_GetAllocatedSize(buf) &&
+       !DynBuf_Enlarge(buf, newSize)) {
+      return DMERR_INSUFFICIENT_MEM;
+   }
+
+   SerializeEntries(that, (char *)DynBuf_Get(buf) + oldSize);
+   DynBuf_SetSize(buf, newSize);
+
+   return DMERR_SUCCESS;
 }
 
 
@@ -1963,6 +2091,325 @@ out:
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * SkipBytes --
+ *
+ *      - low level helper function to skip over 'len' bytes of a buffer
+ *        being decoded.
+ *
+ * Result:
+ *      0 on success
+ *      DMERR_TRUNCATED_DATA if 'len' is negative or runs past the end.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static ErrorCode
+SkipBytes(char **buf,    // IN/OUT
+          int32 *left,   // IN/OUT
+          int32 len)     // IN
+{
+   if (len < 0 || len > *left) {
+      return DMERR_TRUNCATED_DATA;
+   }
+
+   *buf += len;
+   *left -= len;
+
+   return DMERR_SUCCESS;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ScanContent --
+ *
+ *      Validate the content of a data map buffer without decoding it, and
+ *      count what DataMap_DeserializeArena needs to carve out of its arena.
+ *
+ * Result:
+ *      0 on success
+ *      error code otherwise
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static ErrorCode
+ScanContent(const char *content,      // IN
+            int32 contentLen,         // IN
+            ArenaCursor *counts)      // OUT: counts, not pointers
+{
+   char *buf = (char *)content;
+   int32 left = contentLen;
+   ErrorCode res = DMERR_SUCCESS;
+
+   memset(counts, 0, sizeof *counts);
+
+   while ((left > 0) && (res == DMERR_SUCCESS)) {
+      int32 type;
+      DMKeyType fieldId;
+      int32 count;
+      int32 len;
+      int32 i;
+
+      res = DecodeInt32(&buf, &left, &type);
+      if (res == DMERR_SUCCESS) {
+         res = DecodeInt32(&buf, &left, &fieldId);
+      }
+      if (res != DMERR_SUCCESS) {
+         break;
+      }
+
+      counts->numEntries++;
+
+      switch(type) {
+         case DMFIELDTYPE_INT64:
+            res = SkipBytes(&buf, &left, sizeof(int64));
+            break;
+         case DMFIELDTYPE_STRING:
+            res = DecodeInt32(&buf, &left, &len);
+            if (res == DMERR_SUCCESS) {
+               res = SkipBytes(&buf, &left, len);
+            }
+            break;
+         case DMFIELDTYPE_INT64LIST:
+            res = DecodeInt32(&buf, &left, &count);
+            if (res != DMERR_SUCCESS) {
+               break;
+            }
+            if (count < 0 || count > left / sizeof(int64)) {
+               res = DMERR_TRUNCATED_DATA;
+               break;
+            }
+            res = SkipBytes(&buf, &left, count * sizeof(int64));
+            counts->numNumbers += count;
+            break;
+         case DMFIELDTYPE_STRINGLIST:
+            res = DecodeInt32(&buf, &left, &count);
+            if (res != DMERR_SUCCESS) {
+               break;
+            }
+            if (count < 0 || count > left / sizeof(int32)) {
+               res = DMERR_TRUNCATED_DATA;
+               break;
+            }
+            for (i = 0; i < count && res == DMERR_SUCCESS; i++) {
+               res = DecodeInt32(&buf, &left, &len);
+               if (res == DMERR_SUCCESS) {
+                  res = SkipBytes(&buf, &left, len);
+               }
+            }
+            counts->numStrings += (uint64)count + 1;  /* NULL terminated */
+            counts->numLengths += count;
+            break;
+         default:
+            res = DMERR_UNKNOWN_TYPE;
+            break;
+      }
+   }
+
+   return res;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DecodeContentArena --
+ *
+ *      Decode the content of a data map buffer, already validated by
+ *      ScanContent, into entries carved from the map arena. Strings are
+ *      not copied, they point into 'content'.
+ *
+ * Result:
+ *      0 on success
+ *      error code otherwise
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static ErrorCode
+DecodeContentArena(char *content,         // IN
+                   int32 contentLen,      // IN
+                   ArenaCursor *cursor,   // IN/OUT
+                   DataMap *that)         // IN/OUT
+{
+   char *buf = content;
+   int32 left = contentLen;
+   ErrorCode res = DMERR_SUCCESS;
+
+   /* ScanContent has checked all the lengths, so decoding cannot fail. */
+   while ((left > 0) && (res == DMERR_SUCCESS)) {
+      DataMapEntry *entry = cursor->entries++;
+      int32 type;
+      DMKeyType fieldId;
+      int32 count;
+      int32 i;
+
+      DecodeInt32(&buf, &left, &type);
+      DecodeInt32(&buf, &left, &fieldId);
+
+      if (LookupEntry(that, fieldId) != NULL) {
+         return DMERR_DUPLICATED_FIELD_IDS;
+      }
+
+      entry->type = (DMFieldType)type;
+      entry->flags = DMENTRY_ARENA | DMENTRY_ARENA_PAYLOAD;
+
+      switch(entry->type) {
+         case DMFIELDTYPE_INT64:
+            DecodeInt64(&buf, &left, &entry->value.number.val);
+            break;
+         case DMFIELDTYPE_STRING:
+            DecodeInt32(&buf, &left, &entry->value.string.length);
+            entry->value.string.str = buf;
+            SkipBytes(&buf, &left, entry->value.string.length);
+            break;
+         case DMFIELDTYPE_INT64LIST:
+            DecodeInt32(&buf, &left, &count);
+            entry->value.numList.length = count;
+            entry->value.numList.numbers = cursor->numbers;
+            for (i = 0; i < count; i++) {
+               DecodeInt64(&buf, &left, cursor->numbers++);
+            }
+            break;
+         case DMFIELDTYPE_STRINGLIST:
+            DecodeInt32(&buf, &left, &count);
+            entry->value.strList.strings = cursor->strings;
+            entry->value.strList.lengths = cursor->lengths;
+            for (i = 0; i < count; i++) {
+               DecodeInt32(&buf, &left, cursor->lengths);
+               *cursor->strings++ = buf;
+               SkipBytes(&buf, &left, *cursor->lengths++);
+            }
+            *cursor->strings++ = NULL;
+            break;
+         default:
+            NOT_REACHED();
+      }
+
+      res = PutEntry(that, fieldId, entry);
+   }
+
+   return res;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DataMap_DeserializeArena --
+ *
+ *      Same as DataMap_Deserialize, but with a single allocation for the
+ *      whole map: the buffer is validated and sized in one pass, then the
+ *      entries, lists and (unless borrowed) the string bytes are decoded
+ *      into one arena owned by the map.
+ *      - 'borrowInput': when TRUE, decoded strings point into 'bufIn'
+ *        instead of a copy. 'bufIn' must then stay valid and unmodified
+ *        until the map is destroyed.
+ *      - 'that': the given map should *NOT* be initialized by the caller.
+ *        On success, the caller needs to call DataMap_Destroy on 'that'.
+ *
+ *      The map can be modified as usual; replaced entries get heap payloads.
+ *
+ * Result:
+ *      - 0 on success
+ *      - error code on failures.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+ErrorCode
+DataMap_DeserializeArena(const char *bufIn,     // IN
+                         const int32 bufLen,    // IN
+                         Bool borrowInput,      // IN
+                         DataMap *that)         // OUT
+{
+   ErrorCode res;
+   int32 left = bufLen;   /* number of bytes undecoded */
+   int32 len;
+   char *buf = (char *)bufIn;
+   ArenaCursor cursor;
+   uint64 arenaLen;
+
+   if (that == NULL || bufIn == NULL || bufLen < 0) {
+      return DMERR_INVALID_ARGS;
+   }
+
+   /* decode the encoded buffer length */
+   res = DecodeInt32(&buf, &left, &len);
+   if (res != DMERR_SUCCESS) {
+      return res;
+   }
+
+   if (len > bufLen - sizeof(int32)) {
+      return DMERR_TRUNCATED_DATA;
+   }
+
+   res = ScanContent(buf, len, &cursor);
+   if (res != DMERR_SUCCESS) {
+      return res;
+   }
+
+   /* Largest alignment first, so that every array stays aligned. */
+   arenaLen = cursor.numEntries * sizeof(DataMapEntry) +
+              cursor.numNumbers * sizeof(int64) +
+              cursor.numStrings * sizeof(char *) +
+              cursor.numLengths * sizeof(int32) +
+              (borrowInput ? 0 : len);
+   if ((size_t)arenaLen != arenaLen) {
+      return DMERR_INTEGER_OVERFLOW;
+   }
+
+   res = DataMap_Create(that);
+   if (res != DMERR_SUCCESS) {
+      return res;
+   }
+
+   if (arenaLen > 0) {
+      that->arena = (char *)malloc((size_t)arenaLen);
+      if (that->arena == NULL) {
+         DataMap_Destroy(that);
+         return DMERR_INSUFFICIENT_MEM;
+      }
+   }
+
+   cursor.entries = (DataMapEntry *)that->arena;
+   cursor.numbers = (int64 *)(cursor.entries + cursor.numEntries);
+   cursor.strings = (char **)(cursor.numbers + cursor.numNumbers);
+   cursor.lengths = (int32 *)(cursor.strings + cursor.numStrings);
+
+   if (!borrowInput && len > 0) {
+      char *copy = (char *)(cursor.lengths + cursor.numLengths);
+
+      memcpy(copy, buf, len);
+      buf = copy;
+   }
+
+   res = DecodeContentArena(buf, len, &cursor, that);
+   if (res != DMERR_SUCCESS) {
+      DataMap_Destroy(that);
+   }
+
+   return res;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -2007,6 +2454,7 @@ DataMap_SetInt64(DataMap *that,      // IN/OUT
       if ((entry->type != DMFIELDTYPE_INT64)) {
          FreeEntryPayload(entry);
          entry->type = DMFIELDTYPE_INT64;
+         UpdateEncodedLen(that, entry);
       }
 
       /* simple update */
@@ -2069,6 +2517,7 @@ DataMap_SetString(DataMap *that,       // IN/OUT
       entry->type = DMFIELDTYPE_STRING;
       entry->value.string.str = str;
       entry->value.string.length = strLen;
+      UpdateEncodedLen(that, entry);
 
       return DMERR_SUCCESS;
    }
@@ -2124,6 +2573,7 @@ DataMap_SetInt64List(DataMap *that,        // IN/OUT
       entry->type = DMFIELDTYPE_INT64LIST;
       entry->value.numList.numbers = numList;
       entry->value.numList.length = listLen;
+      UpdateEncodedLen(that, entry);
 
       return DMERR_SUCCESS;
    }
@@ -2184,6 +2634,7 @@ DataMap_SetStringList(DataMap *that,          // IN/OUT
       entry->type = DMFIELDTYPE_STRINGLIST;
       entry->value.strList.strings = strList;
       entry->value.strList.lengths = strLens;
+      UpdateEncodedLen(that, entry);
 
       return DMERR_SUCCESS;
    }
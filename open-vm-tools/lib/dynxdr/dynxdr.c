@@ -32,12 +32,14 @@
 /*
  * dynxdr.c --
  *
- *    Implements an XDR stream backed by a DynBuf.
+ *    Implements an XDR stream backed by a DynBuf, either its own or one
+ *    owned by the caller, which can then keep it between encodes.
  */
 
 
 typedef struct DynXdrData {
    DynBuf   data;
+   DynBuf  *buf;      // &data, or the caller's buffer
    Bool     freeMe;
 } DynXdrData;
 
@@ -110,7 +112,7 @@ DynXdrPutBytes(XDR *xdrs,                 // IN/OUT
                DYNXDR_SIZE_T len)         // IN
 {
    DynXdrData *priv = (DynXdrData *) xdrs->x_private;
-   return DynBuf_Append(&priv->data, data, len);
+   return DynBuf_Append(priv->buf, data, len);
 }
 
 
@@ -137,7 +139,7 @@ static u_int
 DynXdrGetPos(DYNXDR_GETPOS_CONST XDR *xdrs) // IN
 {
    DynXdrData *priv = (DynXdrData *) xdrs->x_private;
-   return (u_int) DynBuf_GetSize(&priv->data);
+   return (u_int) DynBuf_GetSize(priv->buf);
 }
 
 
@@ -163,8 +165,8 @@ DynXdrSetPos(XDR *xdrs, // IN
              u_int pos) // IN
 {
    DynXdrData *priv = (DynXdrData *) xdrs->x_private;
-   if (pos <= DynBuf_GetAllocatedSize(&priv->data)) {
-      DynBuf_SetSize(&priv->data, (size_t) pos);
+   if (pos <= DynBuf_GetAllocatedSize(priv->buf)) {
+      DynBuf_SetSize(priv->buf, (size_t) pos);
       return TRUE;
    }
    return FALSE;
@@ -201,7 +203,7 @@ DynXdrPutInt32(XDR *xdrs,                       // IN/OUT
 {
    int32_t out = htonl(*ip);
    DynXdrData *priv = (DynXdrData *) xdrs->x_private;
-   return DynBuf_Append(&priv->data, &out, sizeof out);
+   return DynBuf_Append(priv->buf, &out, sizeof out);
 }
 #endif
 
@@ -234,7 +236,7 @@ DynXdrPutLong(XDR *xdrs,                    // IN/OUT
    ASSERT_ON_COMPILE(sizeof *lp <= sizeof (int32));
 #endif
    out = htonl((int32)*lp);
-   return DynBuf_Append(&priv->data, &out, sizeof out);
+   return DynBuf_Append(priv->buf, &out, sizeof out);
 }
 
 
@@ -261,7 +263,7 @@ DynXdrInline(XDR *xdrs,                 // IN/OUT
              DYNXDR_INLINE_LEN_T len)   // IN
 {
    DynXdrData *priv = (DynXdrData *)xdrs->x_private;
-   DynBuf *buf = &priv->data;
+   DynBuf *buf = priv->buf;
    DYNXDR_INLINE_T *retAddr;
 
    ASSERT(len >= 0);
@@ -288,11 +290,11 @@ DynXdrInline(XDR *xdrs,                 // IN/OUT
 /*
  *-----------------------------------------------------------------------------
  *
- * DynXdr_Create --
+ * DynXdrCreate --
  *
- *    Creates a new XDR struct backed by a DynBuf. The XDR stream is created
- *    in XDR_ENCODE mode. The "in" argument is optional - if NULL, a new XDR
- *    structure will be allocated.
+ *    Creates a new XDR struct in XDR_ENCODE mode, backed by "buf" if given,
+ *    or by its own DynBuf of at least "sizeHint" bytes otherwise. The "in"
+ *    argument is optional - if NULL, a new XDR structure will be allocated.
  *
  * Results:
  *    The XDR struct, or NULL on failure.
@@ -303,8 +305,10 @@ DynXdrInline(XDR *xdrs,                 // IN/OUT
  *-----------------------------------------------------------------------------
  */
 
-XDR *
-DynXdr_Create(XDR *in)  // IN
+static XDR *
+DynXdrCreate(XDR *in,          // IN
+             DynBuf *buf,      // IN/OPT
+             size_t sizeHint)  // IN
 {
    static struct xdr_ops dynXdrOps = {
       /*
@@ -352,6 +356,13 @@ DynXdr_Create(XDR *in)  // IN
 
    priv->freeMe = (in == NULL);
    DynBuf_Init(&priv->data);
+   priv->buf = buf != NULL ? buf : &priv->data;
+
+   if (sizeHint > 0 && buf == NULL &&
+       !DynBuf_Enlarge(&priv->data, sizeHint)) {
+      free(priv);
+      goto error;
+   }
 
    ret->x_op = XDR_ENCODE;
    ret->x_public = NULL;
@@ -369,6 +380,86 @@ error:
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DynXdr_Create --
+ *
+ *    Creates a new XDR struct backed by a DynBuf. The XDR stream is created
+ *    in XDR_ENCODE mode. The "in" argument is optional - if NULL, a new XDR
+ *    structure will be allocated.
+ *
+ * Results:
+ *    The XDR struct, or NULL on failure.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+XDR *
+DynXdr_Create(XDR *in)  // IN
+{
+   return DynXdrCreate(in, NULL, 0);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DynXdr_CreateSized --
+ *
+ *    DynXdr_Create, with room for "sizeHint" bytes from the start, so that
+ *    a stream whose size is known, or estimated with DynXdr_SizeOf, is
+ *    encoded without growing the buffer.
+ *
+ * Results:
+ *    The XDR struct, or NULL on failure.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+XDR *
+DynXdr_CreateSized(XDR *in,          // IN
+                   size_t sizeHint)  // IN
+{
+   return DynXdrCreate(in, NULL, sizeHint);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DynXdr_CreateWithBuf --
+ *
+ *    Creates a new XDR struct that appends to the caller's DynBuf, so that
+ *    a buffer can be kept and reused from one encode to the next: reset
+ *    it with DynBuf_SetSize(buf, 0), and it keeps the room it grew to.
+ *    The buffer belongs to the caller, DynXdr_Destroy() never frees it.
+ *
+ * Results:
+ *    The XDR struct, or NULL on failure.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+XDR *
+DynXdr_CreateWithBuf(XDR *in,      // IN
+                     DynBuf *buf)  // IN
+{
+   ASSERT(buf != NULL);
+
+   return DynXdrCreate(in, buf, 0);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -393,7 +484,7 @@ DynXdr_AppendRaw(XDR *xdrs,         // IN
                  const void *buf,   // IN
                  size_t len)        // IN
 {
-   DynBuf *intbuf = &((DynXdrData *) xdrs->x_private)->data;
+   DynBuf *intbuf = ((DynXdrData *) xdrs->x_private)->buf;
    return DynBuf_Append(intbuf, buf, len);
 }
 
@@ -419,7 +510,7 @@ DynXdr_AppendRaw(XDR *xdrs,         // IN
 void *
 DynXdr_AllocGet(XDR *xdrs) // IN
 {
-   DynBuf *buf = &((DynXdrData *) xdrs->x_private)->data;
+   DynBuf *buf = ((DynXdrData *) xdrs->x_private)->buf;
    return DynBuf_AllocGet(buf);
 }
 
@@ -443,7 +534,7 @@ DynXdr_AllocGet(XDR *xdrs) // IN
 void *
 DynXdr_Get(XDR *xdrs)  // IN
 {
-   DynBuf *buf = &((DynXdrData *) xdrs->x_private)->data;
+   DynBuf *buf = ((DynXdrData *) xdrs->x_private)->buf;
    return DynBuf_Get(buf);
 }
 
@@ -455,7 +546,8 @@ DynXdr_Get(XDR *xdrs)  // IN
  *
  *    Frees data in the XDR stream, optionally destroying the underlying
  *    DynBuf (if "release" is TRUE). If the XDR stream was dynamically
- *    allocated by DynXdr_Create(), it will be freed.
+ *    allocated by DynXdr_Create(), it will be freed. The buffer passed to
+ *    DynXdr_CreateWithBuf() is left to the caller either way.
  *
  * Results:
  *    None.
@@ -472,7 +564,7 @@ DynXdr_Destroy(XDR *xdrs,     // IN
 {
    if (xdrs) {
       DynXdrData *priv = (DynXdrData *) xdrs->x_private;
-      if (release) {
+      if (release && priv->buf == &priv->data) {
          DynBuf_Destroy(&priv->data);
       }
       if (priv->freeMe) {
@@ -482,3 +574,164 @@ DynXdr_Destroy(XDR *xdrs,     // IN
    }
 }
 
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DynXdrCountBytes --
+ * DynXdrCountLong --
+ * DynXdrCountInt32 --
+ *
+ *    Operations of the XDR stream used by DynXdr_SizeOf(): only count the
+ *    bytes they are given, in x_handy.
+ *
+ * Results:
+ *    TRUE.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static bool_t
+DynXdrCountBytes(XDR *xdrs,                 // IN/OUT
+                 DYNXDR_CONST char *data,   // IN
+                 DYNXDR_SIZE_T len)         // IN
+{
+   xdrs->x_handy += len;
+   return TRUE;
+}
+
+
+static bool_t
+DynXdrCountLong(XDR *xdrs,                    // IN/OUT
+                DYNXDR_CONST DYNXDR_LONG *lp) // IN
+{
+   xdrs->x_handy += 4;
+   return TRUE;
+}
+
+
+#if defined(__GLIBC__) || (defined(sun) && (defined(_LP64) || defined(_KERNEL)))
+static bool_t
+DynXdrCountInt32(XDR *xdrs,                       // IN/OUT
+                 DYNXDR_CONST int32_t *ip)        // IN
+{
+   xdrs->x_handy += 4;
+   return TRUE;
+}
+#endif
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DynXdrCountGetPos --
+ *
+ *    Returns the number of bytes counted so far.
+ *
+ * Results:
+ *    The size of the stream.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static u_int
+DynXdrCountGetPos(DYNXDR_GETPOS_CONST XDR *xdrs) // IN
+{
+   return (u_int) xdrs->x_handy;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DynXdrCountInline --
+ *
+ *    There is no buffer to write to: XDR routines fall back to writing
+ *    each member when x_inline fails.
+ *
+ * Results:
+ *    NULL.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static DYNXDR_INLINE_T *
+DynXdrCountInline(XDR *xdrs,                 // IN
+                  DYNXDR_INLINE_LEN_T len)   // IN
+{
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DynXdr_SizeOf --
+ *
+ *    Computes the size of the XDR encoding of "data" by "xdrProc", without
+ *    encoding it, e.g. to give DynXdr_CreateSized() its size hint.
+ *
+ * Results:
+ *    The size in bytes, 0 if "xdrProc" failed.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+size_t
+DynXdr_SizeOf(void *xdrProc,  // IN
+              void *data)     // IN
+{
+   static struct xdr_ops countXdrOps = {
+#if !defined(sun) || (defined(sun) && !defined(_KERNEL))
+      NULL,                /* x_getlong */
+      DynXdrCountLong,     /* x_putlong */
+#endif
+      NULL,                /* x_getbytes */
+      DynXdrCountBytes,    /* x_putbytes */
+      DynXdrCountGetPos,   /* x_getpostn */
+      NULL,                /* x_setpostn */
+      DynXdrCountInline,   /* x_inline */
+      NULL,                /* x_destroy */
+#if defined(__GLIBC__)
+      NULL,                /* x_getint32 */
+      DynXdrCountInt32,    /* x_putint32 */
+#elif defined(__APPLE__)
+      NULL,                /* x_control */
+#elif defined(sun) && (defined(_LP64) || defined(_KERNEL))
+      NULL,                /* x_control */
+      NULL,                /* x_getint32 */
+      DynXdrCountInt32,    /* x_putint32 */
+#endif
+   };
+
+   xdrproc_t proc = xdrProc;
+   XDR xdrs;
+
+   ASSERT(xdrProc != NULL);
+
+   xdrs.x_op = XDR_ENCODE;
+   xdrs.x_public = NULL;
+   xdrs.x_private = NULL;
+   xdrs.x_base = 0;
+   xdrs.x_handy = 0;
+   xdrs.x_ops = &countXdrOps;
+
+   if (!proc(&xdrs, data, 0)) {
+      return 0;
+   }
+
+   return xdrs.x_handy;
+}
@@ -70,6 +70,67 @@ XdrUtil_ArrayAppend(void **array,      // IN/OUT
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * XdrUtil_ArrayAppendGeometric --
+ *
+ *    XdrUtil_ArrayAppend for arrays that grow one element at a time: the
+ *    array is allocated in powers of 2 of elements, so that appending n
+ *    elements reallocates it log2(n) times rather than n times.
+ *
+ *    XDR arrays do not record what is allocated: the room left is derived
+ *    from the length. The array must have been allocated by this function
+ *    only, or to a power of 2 of elements.
+ *
+ * Results:
+ *    NULL on allocation failure, pointer to the first new element otherwise.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void *
+XdrUtil_ArrayAppendGeometric(void **array,      // IN/OUT
+                             u_int *arrayLen,   // IN/OUT
+                             size_t elemSz,     // IN
+                             u_int elemCnt)     // IN
+{
+   u_int newLen = *arrayLen + elemCnt;
+   size_t allocated = 0;
+   void *ret;
+
+   if (newLen < *arrayLen) {
+      return NULL;
+   }
+
+   if (*arrayLen > 0) {
+      for (allocated = 1; allocated < *arrayLen; allocated <<= 1) {
+      }
+   }
+
+   if (newLen > allocated) {
+      void *newarray;
+
+      for (allocated = 1; allocated < newLen; allocated <<= 1) {
+      }
+      newarray = realloc(*array, allocated * elemSz);
+      if (newarray == NULL) {
+         return NULL;
+      }
+      *array = newarray;
+   }
+
+   ret = &((char *)*array)[*arrayLen * elemSz];
+   memset(ret, 0, elemSz * elemCnt);
+   *arrayLen = newLen;
+
+   return ret;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -20,20 +20,58 @@
  * @file fileLogger.c
  *
  * Logger that uses file streams and provides optional log rotation.
+ *
+ * An async logger doesn't write on the logging thread. Messages are copied
+ * into a bounded lock-free queue, and a writer thread (started with the
+ * first message) writes them out in batches, waking up only when there is
+ * something to write. Fatal messages are written synchronously, after
+ * anything still queued, since the process is about to go away. If the
+ * queue is full, messages are dropped and counted rather than blocking the
+ * caller; the count is written to the log when there's room again.
+ *
+ * While log IO is suspended (see GlibLogger::suspend) messages are still
+ * queued, but nothing is written until IO resumes.
+ *
+ * On fork(), the child drops what the parent had queued (the parent writes
+ * it) and logs synchronously from then on.
  */
 
 #include "glibUtils.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <glib/gstdio.h>
 #if defined(G_PLATFORM_WIN32)
 #  include <process.h>
 #  include <windows.h>
 #else
+#  include <errno.h>
 #  include <fcntl.h>
+#  include <pthread.h>
 #  include <unistd.h>
+#  include <sys/uio.h>
 #endif
 
+/** Number of queued messages; must be a power of 2. */
+#define FILE_LOGGER_QUEUE_SIZE      1024
+/** Messages up to this size are copied into the queue without allocating. */
+#define FILE_LOGGER_INLINE_SIZE     256
+/** Maximum number of messages written at once. */
+#define FILE_LOGGER_MAX_BATCH       64
+/** How long the writer waits for a batch to fill up. */
+#ifndef FILE_LOGGER_BATCH_MS
+#define FILE_LOGGER_BATCH_MS        50
+#endif
+
+#define FILE_LOGGER_IS_FATAL(level) \
+   (((level) & (G_LOG_FLAG_FATAL | G_LOG_LEVEL_ERROR)) != 0)
+
+typedef struct FileLoggerSlot {
+   volatile gint  seq;
+   gsize          len;
+   gchar         *heapMsg;      /* Messages that don't fit in msg. */
+   gchar          msg[FILE_LOGGER_INLINE_SIZE];
+} FileLoggerSlot;
 
 typedef struct FileLogger {
    GlibLogger     handler;
@@ -44,10 +82,42 @@ typedef struct FileLogger {
    guint          maxFiles;
    gboolean       append;
    gboolean       error;
-   GStaticMutex   lock;
+   GStaticMutex   lock;         /* Protects the file, and dequeueing. */
+
+   /* The async queue; NULL for a synchronous logger. */
+   FileLoggerSlot *queue;
+   volatile gint  enqueuePos;
+   volatile gint  dequeuePos;
+   volatile gint  dropped;
+   volatile gint  suspended;    /* No writes while set, but for fatal messages. */
+
+   /* The writer thread. */
+   GThread       *writer;
+   gint           writerPid;
+   GMutex        *wakeLock;
+   GCond         *wakeCond;
+   volatile gint  writerAsleep;
+   volatile gint  halfFull;     /* The writer was told the queue is half full. */
+   gboolean       stopWriter;
 } FileLogger;
 
 
+/* Async loggers, so that they can be flushed at exit. */
+static GSList *gAsyncLoggers = NULL;
+static GStaticMutex gAsyncLoggersLock = G_STATIC_MUTEX_INIT;
+static gboolean gFlushAtExit = FALSE;
+
+/*
+ * Pid of this process, read once and refreshed in the child of a fork(), so
+ * that logging does not take a getpid() call per message.
+ */
+static volatile gint gLoggerPid = 0;
+
+#define FILE_LOGGER_BACKLOG(logger) \
+   ((guint) g_atomic_int_get(&(logger)->enqueuePos) - \
+    (guint) g_atomic_int_get(&(logger)->dequeuePos))
+
+
 #if !defined(_WIN32)
 /*
  *******************************************************************************
@@ -309,6 +379,394 @@ FileLoggerOpen(FileLogger *data)
 }
 
 
+/*
+ *******************************************************************************
+ * FileLoggerWrite --                                                     */ /**
+ *
+ * Writes messages to the log file, opening it first if needed, and does log
+ * rotation accounting.
+ *
+ * @note Make sure this function is called with the write lock held.
+ *
+ * @param[in] logger    File logger.
+ * @param[in] msgs      Messages to write.
+ * @param[in] lens      Length of each message.
+ * @param[in] count     Number of messages.
+ *
+ *******************************************************************************
+ */
+
+static void
+FileLoggerWrite(FileLogger *logger,
+                const gchar **msgs,
+                const gsize *lens,
+                guint count)
+{
+   gsize written = 0;
+   guint i;
+
+   if (logger->error) {
+      return;
+   }
+
+   if (logger->file == NULL) {
+      logger->file = FileLoggerOpen(logger);
+      if (logger->file == NULL) {
+         logger->error = TRUE;
+         return;
+      }
+   }
+
+   if (!FileLoggerIsValid(logger)) {
+      logger->error = TRUE;
+      return;
+   }
+
+#if defined(_WIN32)
+   for (i = 0; i < count; i++) {
+      gsize len;
+
+      if (g_io_channel_write_chars(logger->file, msgs[i], lens[i], &len,
+                                   NULL) != G_IO_STATUS_NORMAL) {
+         break;
+      }
+      written += len;
+   }
+   g_io_channel_flush(logger->file, NULL);
+#else
+   {
+      /*
+       * Nothing is ever written through the channel, so its buffer is
+       * always empty and the fd can be written directly.
+       */
+      struct iovec iov[FILE_LOGGER_MAX_BATCH + 1];
+      int fd = g_io_channel_unix_get_fd(logger->file);
+
+      g_assert(count <= G_N_ELEMENTS(iov));
+      for (i = 0; i < count; i++) {
+         iov[i].iov_base = (gchar *) msgs[i];
+         iov[i].iov_len = lens[i];
+      }
+
+      i = 0;
+      while (i < count) {
+         ssize_t n = writev(fd, iov + i, count - i);
+
+         if (n < 0) {
+            if (errno == EINTR) {
+               continue;
+            }
+            break;
+         }
+         written += n;
+
+         /* Skip what was written, in case of a short write. */
+         while (i < count && (size_t) n >= iov[i].iov_len) {
+            n -= iov[i].iov_len;
+            i++;
+         }
+         if (i < count) {
+            iov[i].iov_base = (gchar *) iov[i].iov_base + n;
+            iov[i].iov_len -= n;
+         }
+      }
+   }
+#endif
+
+   if (logger->maxSize > 0) {
+      logger->logSize += (gint) written;
+      if (logger->logSize >= logger->maxSize) {
+         g_io_channel_unref(logger->file);
+         logger->append = FALSE;
+         logger->file = FileLoggerOpen(logger);
+      }
+   }
+}
+
+
+/*
+ *******************************************************************************
+ * FileLoggerEnqueue --                                                   */ /**
+ *
+ * Copies a message into the queue of an async logger. Safe to call from any
+ * number of threads without locking.
+ *
+ * @param[in] logger    File logger.
+ * @param[in] message   Message to queue.
+ * @param[in] len       Length of the message.
+ *
+ * @return FALSE if the queue is full.
+ *
+ *******************************************************************************
+ */
+
+static gboolean
+FileLoggerEnqueue(FileLogger *logger,
+                  const gchar *message,
+                  gsize len)
+{
+   FileLoggerSlot *slot;
+   guint pos = (guint) g_atomic_int_get(&logger->enqueuePos);
+
+   /*
+    * A slot is free for position 'pos' when its sequence number is 'pos';
+    * it holds the message for 'pos' once that is 'pos + 1'.
+    */
+   for (;;) {
+      gint diff;
+
+      slot = &logger->queue[pos & (FILE_LOGGER_QUEUE_SIZE - 1)];
+      diff = (gint) ((guint) g_atomic_int_get(&slot->seq) - pos);
+      if (diff == 0) {
+         if (g_atomic_int_compare_and_exchange(&logger->enqueuePos,
+                                               (gint) pos,
+                                               (gint) (pos + 1))) {
+            break;
+         }
+      } else if (diff < 0) {
+         return FALSE;
+      }
+      pos = (guint) g_atomic_int_get(&logger->enqueuePos);
+   }
+
+   if (len <= sizeof slot->msg) {
+      memcpy(slot->msg, message, len);
+      slot->heapMsg = NULL;
+   } else {
+      slot->heapMsg = g_malloc(len);
+      memcpy(slot->heapMsg, message, len);
+   }
+   slot->len = len;
+   g_atomic_int_set(&slot->seq, (gint) (pos + 1));
+
+   return TRUE;
+}
+
+
+/*
+ *******************************************************************************
+ * FileLoggerDrain --                                                     */ /**
+ *
+ * Writes out everything in the queue of an async logger, in batches, unless
+ * log IO is suspended.
+ *
+ * @note Make sure this function is called with the write lock held.
+ *
+ * @param[in] logger    File logger.
+ *
+ *******************************************************************************
+ */
+
+static void
+FileLoggerDrain(FileLogger *logger)
+{
+   const gchar *msgs[FILE_LOGGER_MAX_BATCH + 1];
+   gsize lens[FILE_LOGGER_MAX_BATCH + 1];
+   gchar droppedMsg[64];
+   guint count;
+
+   if (g_atomic_int_get(&logger->suspended)) {
+      return;
+   }
+
+   do {
+      guint pos = (guint) logger->dequeuePos;
+      guint total;
+      guint i;
+
+      for (count = 0; count < FILE_LOGGER_MAX_BATCH; count++) {
+         FileLoggerSlot *slot =
+            &logger->queue[(pos + count) & (FILE_LOGGER_QUEUE_SIZE - 1)];
+
+         if ((gint) ((guint) g_atomic_int_get(&slot->seq) -
+                     (pos + count + 1)) < 0) {
+            break;
+         }
+         msgs[count] = (slot->heapMsg != NULL) ? slot->heapMsg : slot->msg;
+         lens[count] = slot->len;
+      }
+      total = count;
+
+      /* Once the queue is empty, report anything that was dropped. */
+      if (count < FILE_LOGGER_MAX_BATCH) {
+         gint dropped = g_atomic_int_get(&logger->dropped);
+
+         if (dropped > 0) {
+            g_atomic_int_add(&logger->dropped, -dropped);
+            g_snprintf(droppedMsg, sizeof droppedMsg,
+                       "[dropped %d log messages: queue full]\n", dropped);
+            msgs[total] = droppedMsg;
+            lens[total] = strlen(droppedMsg);
+            total++;
+         }
+      }
+
+      if (total > 0) {
+         FileLoggerWrite(logger, msgs, lens, total);
+      }
+
+      for (i = 0; i < count; i++) {
+         FileLoggerSlot *slot =
+            &logger->queue[(pos + i) & (FILE_LOGGER_QUEUE_SIZE - 1)];
+
+         g_free(slot->heapMsg);
+         slot->heapMsg = NULL;
+         g_atomic_int_set(&slot->seq, (gint) (pos + i + FILE_LOGGER_QUEUE_SIZE));
+      }
+      g_atomic_int_set(&logger->dequeuePos, (gint) (pos + count));
+   } while (count == FILE_LOGGER_MAX_BATCH);
+}
+
+
+/*
+ *******************************************************************************
+ * FileLoggerWakeWriter --                                                */ /**
+ *
+ * Wakes up the writer thread if it is waiting for messages, or always if
+ * 'force' is set.
+ *
+ * @param[in] logger    File logger.
+ * @param[in] force     Whether to wake it up even if it is busy.
+ *
+ *******************************************************************************
+ */
+
+static void
+FileLoggerWakeWriter(FileLogger *logger,
+                     gboolean force)
+{
+   if (force ||
+       (g_atomic_int_get(&logger->writerAsleep) &&
+        g_atomic_int_compare_and_exchange(&logger->writerAsleep, TRUE, FALSE))) {
+      g_mutex_lock(logger->wakeLock);
+      g_cond_signal(logger->wakeCond);
+      g_mutex_unlock(logger->wakeLock);
+   }
+}
+
+
+/*
+ *******************************************************************************
+ * FileLoggerWriterThread --                                              */ /**
+ *
+ * The writer thread of an async logger. Sleeps until there are messages
+ * and log IO isn't suspended, waits a little for more to arrive (unless
+ * the queue is half full), and writes them out.
+ *
+ * @param[in] data      File logger.
+ *
+ * @return NULL.
+ *
+ *******************************************************************************
+ */
+
+static gpointer
+FileLoggerWriterThread(gpointer data)
+{
+   FileLogger *logger = data;
+
+   g_mutex_lock(logger->wakeLock);
+   while (!logger->stopWriter) {
+      GTimeVal deadline;
+
+      g_atomic_int_set(&logger->writerAsleep, TRUE);
+      if (FILE_LOGGER_BACKLOG(logger) == 0 ||
+          g_atomic_int_get(&logger->suspended)) {
+         g_cond_wait(logger->wakeCond, logger->wakeLock);
+         continue;
+      }
+      g_atomic_int_set(&logger->writerAsleep, FALSE);
+
+      if (!g_atomic_int_get(&logger->halfFull)) {
+         g_get_current_time(&deadline);
+         g_time_val_add(&deadline, FILE_LOGGER_BATCH_MS * 1000);
+         g_cond_timed_wait(logger->wakeCond, logger->wakeLock, &deadline);
+      }
+      g_mutex_unlock(logger->wakeLock);
+
+      g_static_mutex_lock(&logger->lock);
+      g_atomic_int_set(&logger->halfFull, FALSE);
+      FileLoggerDrain(logger);
+      g_static_mutex_unlock(&logger->lock);
+
+      g_mutex_lock(logger->wakeLock);
+   }
+   g_mutex_unlock(logger->wakeLock);
+
+   return NULL;
+}
+
+
+/*
+ *******************************************************************************
+ * FileLoggerGetPid --                                                    */ /**
+ *
+ * Gets the pid of this process, without a system call but for the first
+ * time. FileLoggerAtForkChild() updates it in the child of a fork().
+ *
+ * @return The pid.
+ *
+ *******************************************************************************
+ */
+
+static gint
+FileLoggerGetPid(void)
+{
+   gint pid = g_atomic_int_get(&gLoggerPid);
+
+   if (pid == 0) {
+      pid = (gint) getpid();
+      g_atomic_int_set(&gLoggerPid, pid);
+   }
+   return pid;
+}
+
+
+/*
+ *******************************************************************************
+ * FileLoggerStartWriter --                                               */ /**
+ *
+ * Starts the writer thread of an async logger if it isn't running yet. In
+ * the child of a fork() there is none, see FileLoggerAtForkChild().
+ *
+ * @param[in] logger    File logger.
+ *
+ * @return Whether there is a writer thread.
+ *
+ *******************************************************************************
+ */
+
+static gboolean
+FileLoggerStartWriter(FileLogger *logger)
+{
+   gint pid = FileLoggerGetPid();
+   gboolean ret;
+
+   if (g_atomic_int_get(&logger->writerPid) == pid) {
+      return logger->writer != NULL;
+   }
+
+   if (!g_thread_supported()) {
+      return FALSE;
+   }
+
+   g_static_mutex_lock(&logger->lock);
+   if (logger->writerPid != pid) {
+      logger->wakeLock = g_mutex_new();
+      logger->wakeCond = g_cond_new();
+      logger->stopWriter = FALSE;
+      logger->writerAsleep = FALSE;
+      logger->writer = g_thread_create(FileLoggerWriterThread, logger, TRUE,
+                                       NULL);
+      g_atomic_int_set(&logger->writerPid, pid);
+   }
+   ret = logger->writer != NULL;
+   g_static_mutex_unlock(&logger->lock);
+
+   return ret;
+}
+
+
 /*
  *******************************************************************************
  * FileLoggerLog --                                                       */ /**
@@ -316,6 +774,8 @@ FileLoggerOpen(FileLogger *data)
  * Logs a message to the configured destination file. Also opens the file for
  * writing if it hasn't been done yet.
  *
+ * An async logger only queues the message, unless it's fatal.
+ *
  * @param[in] domain    Log domain.
  * @param[in] level     Log level.
  * @param[in] message   Message to log.
@@ -331,51 +791,212 @@ FileLoggerLog(const gchar *domain,
               gpointer data)
 {
    FileLogger *logger = data;
-   gsize written;
+   gsize len = strlen(message);
 
-   g_static_mutex_lock(&logger->lock);
+   if (logger->queue != NULL &&
+       !FILE_LOGGER_IS_FATAL(level) &&
+       FileLoggerStartWriter(logger)) {
+      if (FileLoggerEnqueue(logger, message, len)) {
+         /*
+          * Don't let the writer wait for a batch once half the queue is
+          * used; tell it once, not on every message until it drains.
+          */
+         gboolean halfFull =
+            FILE_LOGGER_BACKLOG(logger) >= FILE_LOGGER_QUEUE_SIZE / 2 &&
+            !g_atomic_int_get(&logger->halfFull) &&
+            g_atomic_int_compare_and_exchange(&logger->halfFull, FALSE, TRUE);
 
-   if (logger->error) {
-      goto exit;
+         FileLoggerWakeWriter(logger, halfFull);
+      } else {
+         g_atomic_int_inc(&logger->dropped);
+      }
+      return;
    }
 
-   if (logger->file == NULL) {
-      if (logger->file == NULL) {
-         logger->file = FileLoggerOpen(data);
-      }
-      if (logger->file == NULL) {
-         logger->error = TRUE;
-         goto exit;
-      }
+   g_static_mutex_lock(&logger->lock);
+   if (logger->queue != NULL) {
+      /* Keep the order: write out what was queued first. */
+      FileLoggerDrain(logger);
    }
+   FileLoggerWrite(logger, &message, &len, 1);
+   g_static_mutex_unlock(&logger->lock);
+}
 
-   if (!FileLoggerIsValid(logger)) {
-      logger->error = TRUE;
-      goto exit;
-   }
-
-   /* Write the log file and do log rotation accounting. */
-   if (g_io_channel_write_chars(logger->file, message, -1, &written, NULL) ==
-       G_IO_STATUS_NORMAL) {
-      if (logger->maxSize > 0) {
-         logger->logSize += (gint) written;
-         if (logger->logSize >= logger->maxSize) {
-            g_io_channel_unref(logger->file);
-            logger->append = FALSE;
-            logger->file = FileLoggerOpen(logger);
-         } else {
-            g_io_channel_flush(logger->file, NULL);
-         }
-      } else {
-         g_io_channel_flush(logger->file, NULL);
-      }
+
+/*
+ ******************************************************************************
+ * FileLoggerFlush --                                                 */ /**
+ *
+ * Writes out the messages queued by an async logger.
+ *
+ * @param[in] data      File logger.
+ *
+ ******************************************************************************
+ */
+
+static void
+FileLoggerFlush(gpointer data)
+{
+   FileLogger *logger = data;
+
+   if (logger->queue != NULL) {
+      g_static_mutex_lock(&logger->lock);
+      FileLoggerDrain(logger);
+      g_static_mutex_unlock(&logger->lock);
+   }
+}
+
+
+/*
+ ******************************************************************************
+ * FileLoggerSuspend --                                               */ /**
+ *
+ * Suspends or resumes writing. When suspending, what is queued is written
+ * out first; messages queued while suspended are written on resume.
+ *
+ * @param[in] data      File logger.
+ * @param[in] suspend   Whether to suspend or resume.
+ *
+ ******************************************************************************
+ */
+
+static void
+FileLoggerSuspend(gpointer data,
+                  gboolean suspend)
+{
+   FileLogger *logger = data;
+
+   if (logger->queue == NULL) {
+      return;
    }
 
-exit:
+   g_static_mutex_lock(&logger->lock);
+   if (suspend) {
+      FileLoggerDrain(logger);
+   }
+   g_atomic_int_set(&logger->suspended, suspend);
    g_static_mutex_unlock(&logger->lock);
+
+   if (!suspend && logger->writer != NULL &&
+       logger->writerPid == FileLoggerGetPid()) {
+      FileLoggerWakeWriter(logger, TRUE);
+   }
 }
 
 
+/*
+ ******************************************************************************
+ * FileLoggerFlushAll --                                              */ /**
+ *
+ * atexit() handler that writes out the messages queued by all async loggers.
+ *
+ ******************************************************************************
+ */
+
+static void
+FileLoggerFlushAll(void)
+{
+   g_static_mutex_lock(&gAsyncLoggersLock);
+   g_slist_foreach(gAsyncLoggers, (GFunc) FileLoggerFlush, NULL);
+   g_static_mutex_unlock(&gAsyncLoggersLock);
+}
+
+
+#if !defined(_WIN32)
+/*
+ ******************************************************************************
+ * FileLoggerAtForkPrepare --                                         */ /**
+ *
+ * pthread_atfork() handler run before fork(): takes the locks of all async
+ * loggers, so that the child doesn't inherit one held by a writer thread
+ * in the middle of a write.
+ *
+ ******************************************************************************
+ */
+
+static void
+FileLoggerAtForkPrepare(void)
+{
+   GSList *l;
+
+   g_static_mutex_lock(&gAsyncLoggersLock);
+   for (l = gAsyncLoggers; l != NULL; l = l->next) {
+      g_static_mutex_lock(&((FileLogger *) l->data)->lock);
+   }
+}
+
+
+/*
+ ******************************************************************************
+ * FileLoggerAtForkParent --                                          */ /**
+ *
+ * pthread_atfork() handler run in the parent after fork(): releases the
+ * locks taken by FileLoggerAtForkPrepare().
+ *
+ ******************************************************************************
+ */
+
+static void
+FileLoggerAtForkParent(void)
+{
+   GSList *l;
+
+   for (l = gAsyncLoggers; l != NULL; l = l->next) {
+      g_static_mutex_unlock(&((FileLogger *) l->data)->lock);
+   }
+   g_static_mutex_unlock(&gAsyncLoggersLock);
+}
+
+
+/*
+ ******************************************************************************
+ * FileLoggerAtForkChild --                                           */ /**
+ *
+ * pthread_atfork() handler run in the child after fork(). The writer thread
+ * is gone, and so are threads that may have been in the middle of queueing
+ * a message; what is queued is the parent's to write. So the queue is
+ * emptied, and the child logs synchronously: it usually just logs a few
+ * messages before exec() or exit(). The pid FileLoggerGetPid() returns is
+ * refreshed.
+ *
+ * The wake lock and condition may have been held by the writer; they are
+ * leaked rather than reused or freed.
+ *
+ ******************************************************************************
+ */
+
+static void
+FileLoggerAtForkChild(void)
+{
+   GSList *l;
+
+   g_atomic_int_set(&gLoggerPid, (gint) getpid());
+   for (l = gAsyncLoggers; l != NULL; l = l->next) {
+      FileLogger *logger = l->data;
+      guint i;
+
+      for (i = 0; i < FILE_LOGGER_QUEUE_SIZE; i++) {
+         g_free(logger->queue[i].heapMsg);
+         logger->queue[i].heapMsg = NULL;
+         logger->queue[i].seq = i;
+      }
+      logger->enqueuePos = 0;
+      logger->dequeuePos = 0;
+      logger->dropped = 0;
+      logger->halfFull = FALSE;
+      logger->writerAsleep = FALSE;
+      logger->writer = NULL;
+      logger->wakeLock = NULL;
+      logger->wakeCond = NULL;
+      logger->writerPid = gLoggerPid;
+
+      g_static_mutex_unlock(&logger->lock);
+   }
+   g_static_mutex_unlock(&gAsyncLoggersLock);
+}
+#endif
+
+
 /*
  ******************************************************************************
  * FileLoggerDestroy --                                               */ /**
@@ -391,6 +1012,34 @@ static void
 FileLoggerDestroy(gpointer data)
 {
    FileLogger *logger = data;
+
+   if (logger->queue != NULL) {
+      guint i;
+
+      g_static_mutex_lock(&gAsyncLoggersLock);
+      gAsyncLoggers = g_slist_remove(gAsyncLoggers, logger);
+      g_static_mutex_unlock(&gAsyncLoggersLock);
+
+      if (logger->writer != NULL && logger->writerPid == FileLoggerGetPid()) {
+         g_mutex_lock(logger->wakeLock);
+         logger->stopWriter = TRUE;
+         g_cond_signal(logger->wakeCond);
+         g_mutex_unlock(logger->wakeLock);
+         g_thread_join(logger->writer);
+      }
+      FileLoggerFlush(logger);
+
+      if (logger->wakeLock != NULL) {
+         g_mutex_free(logger->wakeLock);
+         g_cond_free(logger->wakeCond);
+      }
+      /* Anything left if destroyed while suspended. */
+      for (i = 0; i < FILE_LOGGER_QUEUE_SIZE; i++) {
+         g_free(logger->queue[i].heapMsg);
+      }
+      g_free(logger->queue);
+   }
+
    if (logger->file != NULL) {
       g_io_channel_unref(logger->file);
    }
@@ -410,6 +1059,7 @@ FileLoggerDestroy(gpointer data)
  * @param[in] append    Whether to append to existing log file.
  * @param[in] maxSize   Maximum log file size (in MB, 0 = no limit).
  * @param[in] maxFiles  Maximum number of old files to be kept.
+ * @param[in] async     Whether to write from a background thread.
  *
  * @return A new logger, or NULL on error.
  *
@@ -420,7 +1070,8 @@ GlibLogger *
 GlibUtils_CreateFileLogger(const char *path,
                            gboolean append,
                            guint maxSize,
-                           guint maxFiles)
+                           guint maxFiles,
+                           gboolean async)
 {
    FileLogger *data = NULL;
 
@@ -431,6 +1082,7 @@ GlibUtils_CreateFileLogger(const char *path,
    data->handler.shared = FALSE;
    data->handler.logfn = FileLoggerLog;
    data->handler.dtor = FileLoggerDestroy;
+   data->handler.suspend = FileLoggerSuspend;
 
    data->path = g_filename_from_utf8(path, -1, NULL, NULL, NULL);
    if (data->path == NULL) {
@@ -443,6 +1095,28 @@ GlibUtils_CreateFileLogger(const char *path,
    data->maxFiles = maxFiles + 1; /* To account for the active log file. */
    g_static_mutex_init(&data->lock);
 
+   if (async) {
+      guint i;
+
+      data->queue = g_new(FileLoggerSlot, FILE_LOGGER_QUEUE_SIZE);
+      for (i = 0; i < FILE_LOGGER_QUEUE_SIZE; i++) {
+         data->queue[i].seq = i;
+         data->queue[i].heapMsg = NULL;
+      }
+
+      g_static_mutex_lock(&gAsyncLoggersLock);
+      if (!gFlushAtExit) {
+         atexit(FileLoggerFlushAll);
+#if !defined(_WIN32)
+         pthread_atfork(FileLoggerAtForkPrepare, FileLoggerAtForkParent,
+                        FileLoggerAtForkChild);
+#endif
+         gFlushAtExit = TRUE;
+      }
+      gAsyncLoggers = g_slist_prepend(gAsyncLoggers, data);
+      g_static_mutex_unlock(&gAsyncLoggersLock);
+   }
+
    return &data->handler;
 }
 
@@ -0,0 +1,1790 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsDirNotifyLinux.c --
+ *
+ *	Directory change notification for Linux, based on inotify.
+ *
+ *	Each subscriber watches a directory of a shared folder, and optionally
+ *	the tree below it. An inotify watch is added for the directory, and
+ *	for recursive subscribers for each directory below it, as they are
+ *	found or created. Watches are indexed by watch descriptor, and each
+ *	watch knows the subscribers it reports to. Subscribers that cannot get
+ *	a watch for a directory are told that they lost events. The paths of
+ *	the watches follow the directories when they are renamed.
+ *
+ *	A thread reads the inotify events. Events that come in a burst are
+ *	coalesced: events for the same subscriber and file are merged, and the
+ *	batch is handed to the main loop once no event came for
+ *	HGFS_NOTIFY_COALESCE_MS, or HGFS_NOTIFY_MAX_DELAY_MS after the first
+ *	one. The notifications are sent from the main loop, as the replies to
+ *	the HGFS requests are, not from the thread.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/poll.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <glib.h>
+
+#include "vmware.h"
+#include "vm_basic_types.h"
+#include "dbllnklst.h"
+#include "hashTable.h"
+#include "str.h"
+#include "util.h"
+#include "userlock.h"
+#include "mutexRankLib.h"
+
+#include "hgfsProto.h"
+#include "hgfsServer.h"
+#include "hgfsUtil.h"
+#include "hgfsDirNotify.h"
+
+#define LOGLEVEL_MODULE hgfs
+#include "loglevel_user.h"
+
+/* How long a burst may pause before its events are delivered. */
+#define HGFS_NOTIFY_COALESCE_MS     20
+/* How long the events of a burst may be held at most. */
+#define HGFS_NOTIFY_MAX_DELAY_MS    100
+/* Events held at most; subscribers that lose events are told so. */
+#define HGFS_NOTIFY_MAX_PENDING     4096
+
+#define HGFS_NOTIFY_READ_SIZE       (64 * 1024)
+#define HGFS_NOTIFY_WATCH_BUCKETS   256
+#define HGFS_NOTIFY_EVENT_BUCKETS   1024
+
+/* Events always watched, to follow the directory tree. */
+#define HGFS_NOTIFY_IN_TREE         (IN_CREATE | IN_DELETE | IN_MOVED_FROM | \
+                                     IN_MOVED_TO | IN_DELETE_SELF |        \
+                                     IN_MOVE_SELF | IN_ONLYDIR)
+
+typedef struct HgfsNotifyShare {
+   DblLnkLst_Links links;
+   HgfsSharedFolderHandle handle;
+   char *path;                         // Shared folder root, no trailing '/'
+   char *shareName;
+} HgfsNotifyShare;
+
+typedef struct HgfsNotifySubscriber {
+   DblLnkLst_Links links;
+   HgfsSubscriberHandle handle;
+   HgfsNotifyShare *share;
+   char *path;                         // Watched directory
+   uint32 eventFilter;
+   Bool recursive;
+   Bool overflow;                      // Events were dropped
+   HgfsNotifyEventReceiveCb *eventCb;
+   struct HgfsSessionInfo *session;
+} HgfsNotifySubscriber;
+
+typedef struct HgfsNotifyWatch {
+   DblLnkLst_Links links;
+   int wd;
+   char *path;
+   uint32 numSubs;
+   HgfsNotifySubscriber **subs;        // Subscribers the watch reports to
+} HgfsNotifyWatch;
+
+typedef struct HgfsNotifyEvent {
+   HgfsNotifySubscriber *sub;          // NULL once the subscriber is gone
+   char *name;                         // Relative to the shared folder
+   uint32 mask;
+} HgfsNotifyEvent;
+
+typedef struct HgfsNotifyState {
+   MXUserRecLock *lock;
+   int fd;
+   int wakeFds[2];
+   pthread_t thread;
+   Bool threadStarted;
+   Bool syncDeactivated;
+   DblLnkLst_Links shares;
+   DblLnkLst_Links subscribers;
+   DblLnkLst_Links watches;
+   HashTable *watchIndex;              // wd -> HgfsNotifyWatch
+   HgfsSharedFolderHandle nextShare;
+   HgfsSubscriberHandle nextSubscriber;
+   HgfsNotifyEvent *pending;
+   uint32 numPending;
+   uint32 pendingSize;
+   HashTable *pendingIndex;            // "subscriber:name" -> index + 1
+   guint flushSource;                  // Main loop source delivering them
+   char *movePath;                     // Directory moved, until IN_MOVED_TO
+   uint32 moveCookie;
+} HgfsNotifyState;
+
+static HgfsNotifyState gNotify = { NULL, -1, { -1, -1 } };
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyTimeMS --
+ *
+ *    Reads the monotonic clock.
+ *
+ * Results:
+ *    Time in milliseconds.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+HgfsNotifyTimeMS(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyInotifyMask --
+ *
+ *    Converts an HGFS event filter to the inotify events to watch.
+ *
+ * Results:
+ *    inotify event mask.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+HgfsNotifyInotifyMask(uint32 eventFilter) // IN: HGFS event filter
+{
+   uint32 mask = HGFS_NOTIFY_IN_TREE;
+
+   if (eventFilter & (HGFS_NOTIFY_ACCESS | HGFS_NOTIFY_ATIME)) {
+      mask |= IN_ACCESS;
+   }
+   if (eventFilter & (HGFS_NOTIFY_ATTRIB | HGFS_NOTIFY_CTIME |
+                      HGFS_NOTIFY_CHANGE_EA | HGFS_NOTIFY_CHANGE_SECURITY)) {
+      mask |= IN_ATTRIB;
+   }
+   if (eventFilter & (HGFS_NOTIFY_MODIFY | HGFS_NOTIFY_SIZE |
+                      HGFS_NOTIFY_MTIME)) {
+      mask |= IN_MODIFY;
+   }
+   if (eventFilter & HGFS_NOTIFY_OPEN) {
+      mask |= IN_OPEN;
+   }
+   if (eventFilter & HGFS_NOTIFY_CLOSE_WRITE) {
+      mask |= IN_CLOSE_WRITE;
+   }
+   if (eventFilter & HGFS_NOTIFY_CLOSE_NOWRITE) {
+      mask |= IN_CLOSE_NOWRITE;
+   }
+   return mask;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyHgfsMask --
+ *
+ *    Converts an inotify event mask to HGFS events.
+ *
+ * Results:
+ *    HGFS event mask.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+HgfsNotifyHgfsMask(uint32 mask) // IN: inotify event mask
+{
+   Bool isDir = (mask & IN_ISDIR) != 0;
+   uint32 result = 0;
+
+   if (mask & IN_ACCESS) {
+      result |= HGFS_NOTIFY_ACCESS | HGFS_NOTIFY_ATIME;
+   }
+   if (mask & IN_ATTRIB) {
+      result |= HGFS_NOTIFY_ATTRIB | HGFS_NOTIFY_CTIME;
+   }
+   if (mask & IN_MODIFY) {
+      result |= HGFS_NOTIFY_MODIFY | HGFS_NOTIFY_SIZE | HGFS_NOTIFY_MTIME;
+   }
+   if (mask & IN_OPEN) {
+      result |= HGFS_NOTIFY_OPEN;
+   }
+   if (mask & IN_CLOSE_WRITE) {
+      result |= HGFS_NOTIFY_CLOSE_WRITE;
+   }
+   if (mask & IN_CLOSE_NOWRITE) {
+      result |= HGFS_NOTIFY_CLOSE_NOWRITE;
+   }
+   if (mask & IN_CREATE) {
+      result |= HGFS_NOTIFY_NAME |
+                (isDir ? HGFS_NOTIFY_CREATE_DIR : HGFS_NOTIFY_CREATE_FILE);
+   }
+   if (mask & IN_DELETE) {
+      result |= HGFS_NOTIFY_NAME |
+                (isDir ? HGFS_NOTIFY_DELETE_DIR : HGFS_NOTIFY_DELETE_FILE);
+   }
+   if (mask & IN_MOVED_FROM) {
+      result |= HGFS_NOTIFY_NAME |
+                (isDir ? HGFS_NOTIFY_OLD_DIR_NAME : HGFS_NOTIFY_OLD_FILE_NAME);
+   }
+   if (mask & IN_MOVED_TO) {
+      result |= HGFS_NOTIFY_NAME |
+                (isDir ? HGFS_NOTIFY_NEW_DIR_NAME : HGFS_NOTIFY_NEW_FILE_NAME);
+   }
+   if (mask & (IN_DELETE_SELF | IN_UNMOUNT)) {
+      result |= HGFS_NOTIFY_DELETE_SELF | HGFS_NOTIFY_WATCH_DELETED;
+   }
+   if (mask & IN_MOVE_SELF) {
+      result |= HGFS_NOTIFY_MOVE_SELF;
+   }
+   return result;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyIsUnder --
+ *
+ *    Checks whether a path is a directory or what is below it.
+ *
+ * Results:
+ *    TRUE if path is dir or below dir.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsNotifyIsUnder(const char *path, // IN:
+                  const char *dir)  // IN:
+{
+   size_t len = strlen(dir);
+
+   return strncmp(path, dir, len) == 0 &&
+          (path[len] == '\0' || path[len] == DIRSEPC);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyRelativeName --
+ *
+ *    Builds the name of a file relative to the subscriber's shared folder.
+ *
+ * Results:
+ *    The name, to be freed by the caller, or NULL if the directory is not in
+ *    the shared folder.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static char *
+HgfsNotifyRelativeName(HgfsNotifySubscriber *sub, // IN: subscriber
+                       const char *dir,           // IN: directory
+                       const char *name)          // IN/OPT: file in dir
+{
+   const char *rel;
+
+   if (!HgfsNotifyIsUnder(dir, sub->share->path)) {
+      return NULL;
+   }
+
+   rel = dir + strlen(sub->share->path);
+   while (*rel == DIRSEPC) {
+      rel++;
+   }
+
+   if (name == NULL || *name == '\0') {
+      return Util_SafeStrdup(rel);
+   } else if (*rel == '\0') {
+      return Util_SafeStrdup(name);
+   }
+   return Str_SafeAsprintf(NULL, "%s%c%s", rel, DIRSEPC, name);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyQueue --
+ *
+ *    Adds an event to the pending batch, merging it with an event of the
+ *    subscriber for the same file.
+ *
+ *    Called with the lock held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Takes ownership of name. Flags the subscriber if the batch is full.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyQueue(HgfsNotifySubscriber *sub, // IN: subscriber
+                char *name,                // IN: relative name
+                uint32 mask)               // IN: HGFS events
+{
+   char *key = Str_SafeAsprintf(NULL, "%"FMT64"x:%s", sub->handle, name);
+   void *index;
+
+   if (HashTable_Lookup(gNotify.pendingIndex, key, &index)) {
+      gNotify.pending[(uintptr_t)index - 1].mask |= mask;
+      free(name);
+   } else if (gNotify.numPending >= HGFS_NOTIFY_MAX_PENDING) {
+      sub->overflow = TRUE;
+      free(name);
+   } else {
+      HgfsNotifyEvent *event;
+
+      if (gNotify.numPending == gNotify.pendingSize) {
+         gNotify.pendingSize = MAX(64, gNotify.pendingSize * 2);
+         gNotify.pending = Util_SafeRealloc(gNotify.pending,
+                                            gNotify.pendingSize *
+                                            sizeof *gNotify.pending);
+      }
+      event = &gNotify.pending[gNotify.numPending++];
+      event->sub = sub;
+      event->name = name;
+      event->mask = mask;
+      HashTable_Insert(gNotify.pendingIndex, key,
+                       (void *)(uintptr_t)gNotify.numPending);
+   }
+   free(key);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyFlush --
+ *
+ *    Delivers the pending batch, then tells subscribers that lost events.
+ *    While the server is synchronizing, events are dropped, and subscribers
+ *    are told when it is done.
+ *
+ *    Called from the main loop with the lock held. The callbacks are called
+ *    with the lock held so that subscribers and sessions stay valid; a
+ *    callback may remove subscribers. The thread only waits for the lock to
+ *    queue more events.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Empties the batch.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyFlush(void)
+{
+   DblLnkLst_Links *l;
+   uint32 delivered = 0;
+   uint32 i;
+
+   if (gNotify.syncDeactivated) {
+      for (i = 0; i < gNotify.numPending; i++) {
+         if (gNotify.pending[i].sub != NULL) {
+            gNotify.pending[i].sub->overflow = TRUE;
+         }
+      }
+   } else {
+      /* Queue the overflow notifications, so a single loop delivers all. */
+      DblLnkLst_ForEach(l, &gNotify.subscribers) {
+         HgfsNotifySubscriber *sub =
+            DblLnkLst_Container(l, HgfsNotifySubscriber, links);
+
+         if (sub->overflow) {
+            HgfsNotifyEvent *event;
+
+            if (gNotify.numPending == gNotify.pendingSize) {
+               gNotify.pendingSize = MAX(64, gNotify.pendingSize * 2);
+               gNotify.pending = Util_SafeRealloc(gNotify.pending,
+                                                  gNotify.pendingSize *
+                                                  sizeof *gNotify.pending);
+            }
+            event = &gNotify.pending[gNotify.numPending++];
+            event->sub = sub;
+            event->name = NULL;
+            event->mask = HGFS_NOTIFY_EVENTS_DROPPED;
+            sub->overflow = FALSE;
+         }
+      }
+
+      for (i = 0; i < gNotify.numPending; i++) {
+         HgfsNotifySubscriber *sub = gNotify.pending[i].sub;
+
+         if (sub != NULL) {
+            sub->eventCb(sub->share->handle, sub->handle,
+                         gNotify.pending[i].name, gNotify.pending[i].mask,
+                         sub->session);
+            delivered++;
+         }
+      }
+      LOG(4, ("%s: delivered %u notifications\n", __FUNCTION__, delivered));
+   }
+
+   for (i = 0; i < gNotify.numPending; i++) {
+      free(gNotify.pending[i].name);
+   }
+   gNotify.numPending = 0;
+   HashTable_Clear(gNotify.pendingIndex);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyFlushCb --
+ *
+ *    Main loop callback delivering the pending batch.
+ *
+ * Results:
+ *    FALSE, to run once.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+HgfsNotifyFlushCb(gpointer data) // IN: unused
+{
+   MXUser_AcquireRecLock(gNotify.lock);
+   gNotify.flushSource = 0;
+   HgfsNotifyFlush();
+   MXUser_ReleaseRecLock(gNotify.lock);
+
+   return FALSE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyScheduleFlush --
+ *
+ *    Has the main loop deliver the pending batch, unless it is already due
+ *    to. Events queued meanwhile go with the batch.
+ *
+ *    Called with the lock held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyScheduleFlush(void)
+{
+   if (gNotify.flushSource == 0) {
+      gNotify.flushSource = g_idle_add(HgfsNotifyFlushCb, NULL);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyWatchMask --
+ *
+ *    Computes the inotify events a watch needs for its subscribers.
+ *
+ * Results:
+ *    inotify event mask.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+HgfsNotifyWatchMask(HgfsNotifyWatch *watch) // IN:
+{
+   uint32 filter = 0;
+   uint32 i;
+
+   for (i = 0; i < watch->numSubs; i++) {
+      filter |= watch->subs[i]->eventFilter;
+   }
+   return HgfsNotifyInotifyMask(filter);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyAddWatch --
+ *
+ *    Watches a directory for a subscriber. The directory may already be
+ *    watched for other subscribers, maybe under another path if it was
+ *    moved.
+ *
+ *    Called with the lock held.
+ *
+ * Results:
+ *    TRUE if the directory is watched, FALSE with errno set otherwise.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsNotifyAddWatch(const char *path,          // IN: directory
+                   HgfsNotifySubscriber *sub) // IN: subscriber
+{
+   HgfsNotifyWatch *watch;
+   void *value;
+   uint32 i;
+   int wd;
+
+   wd = inotify_add_watch(gNotify.fd, path,
+                          HgfsNotifyInotifyMask(sub->eventFilter) |
+                          IN_MASK_ADD);
+   if (wd < 0) {
+      int error = errno;
+
+      LOG(4, ("%s: cannot watch %s: %s\n", __FUNCTION__, path,
+              strerror(error)));
+      errno = error;
+      return FALSE;
+   }
+
+   if (HashTable_Lookup(gNotify.watchIndex, (void *)(uintptr_t)wd, &value)) {
+      watch = value;
+      if (strcmp(watch->path, path) != 0) {
+         free(watch->path);
+         watch->path = Util_SafeStrdup(path);
+      }
+   } else {
+      watch = Util_SafeCalloc(1, sizeof *watch);
+      DblLnkLst_Init(&watch->links);
+      watch->wd = wd;
+      watch->path = Util_SafeStrdup(path);
+      HashTable_Insert(gNotify.watchIndex, (void *)(uintptr_t)wd, watch);
+      DblLnkLst_LinkLast(&gNotify.watches, &watch->links);
+   }
+
+   for (i = 0; i < watch->numSubs; i++) {
+      if (watch->subs[i] == sub) {
+         return TRUE;
+      }
+   }
+   watch->subs = Util_SafeRealloc(watch->subs,
+                                  (watch->numSubs + 1) * sizeof *watch->subs);
+   watch->subs[watch->numSubs++] = sub;
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyMissedTree --
+ *
+ *    A directory of a subscriber could not be watched, so its events are
+ *    lost: the subscriber is told so. A directory that is gone already has
+ *    no events to lose.
+ *
+ *    Called with the lock held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Flags the subscriber.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyMissedTree(const char *path,          // IN: directory
+                     HgfsNotifySubscriber *sub, // IN: subscriber
+                     int error)                 // IN: errno
+{
+   if (error == ENOENT || error == ENOTDIR) {
+      return;
+   }
+
+   if (error == ENOSPC) {
+      Log("%s: no inotify watch left for %s, raise "
+          "fs.inotify.max_user_watches\n", __FUNCTION__, path);
+   } else {
+      Log("%s: cannot watch %s: %s\n", __FUNCTION__, path, strerror(error));
+   }
+   sub->overflow = TRUE;
+   HgfsNotifyScheduleFlush();
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyAddTree --
+ *
+ *    Watches a directory for a subscriber, and if the subscriber is
+ *    recursive the directories below it. Symbolic links are not followed.
+ *
+ *    The tree is walked with a stack of the directories left to read rather
+ *    than by recursion, as it may be deep. Directories that cannot be
+ *    watched flag the subscriber; once inotify is out of watches, the walk
+ *    stops.
+ *
+ *    Called with the lock held.
+ *
+ * Results:
+ *    TRUE if the directory itself is watched, FALSE with errno set
+ *    otherwise.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsNotifyAddTree(const char *path,          // IN: directory
+                  HgfsNotifySubscriber *sub) // IN: subscriber
+{
+   char **stack;
+   size_t depth = 0;
+   size_t stackSize = 16;
+   Bool full = FALSE;
+
+   if (!HgfsNotifyAddWatch(path, sub)) {
+      return FALSE;
+   }
+   if (!sub->recursive) {
+      return TRUE;
+   }
+
+   stack = Util_SafeMalloc(stackSize * sizeof *stack);
+   stack[depth++] = Util_SafeStrdup(path);
+
+   while (depth > 0) {
+      char *dirPath = stack[--depth];
+      struct dirent *entry;
+      DIR *dir;
+
+      if (full || (dir = opendir(dirPath)) == NULL) {
+         free(dirPath);
+         continue;
+      }
+
+      while (!full && (entry = readdir(dir)) != NULL) {
+         char *child;
+         Bool isDir;
+
+         if (strcmp(entry->d_name, ".") == 0 ||
+             strcmp(entry->d_name, "..") == 0) {
+            continue;
+         }
+
+         child = Str_SafeAsprintf(NULL, "%s%c%s", dirPath, DIRSEPC,
+                                  entry->d_name);
+         if (entry->d_type == DT_UNKNOWN) {
+            struct stat st;
+            isDir = lstat(child, &st) == 0 && S_ISDIR(st.st_mode);
+         } else {
+            isDir = entry->d_type == DT_DIR;
+         }
+
+         if (!isDir) {
+            free(child);
+         } else if (HgfsNotifyAddWatch(child, sub)) {
+            if (depth == stackSize) {
+               stackSize *= 2;
+               stack = Util_SafeRealloc(stack, stackSize * sizeof *stack);
+            }
+            stack[depth++] = child;
+         } else {
+            int error = errno;
+
+            HgfsNotifyMissedTree(child, sub, error);
+            full = error == ENOSPC;
+            free(child);
+         }
+      }
+
+      closedir(dir);
+      free(dirPath);
+   }
+
+   free(stack);
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyRenameTree --
+ *
+ *    A directory was renamed: changes the paths of the watches and of the
+ *    subscribers in its tree to the new name. Subscribers are only moved
+ *    within their shared folder.
+ *
+ *    Called with the lock held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyRenameTree(const char *from, // IN: old directory path
+                     const char *to)   // IN: new directory path
+{
+   size_t fromLen = strlen(from);
+   DblLnkLst_Links *l;
+
+   DblLnkLst_ForEach(l, &gNotify.watches) {
+      HgfsNotifyWatch *watch = DblLnkLst_Container(l, HgfsNotifyWatch, links);
+
+      if (HgfsNotifyIsUnder(watch->path, from)) {
+         char *path = Str_SafeAsprintf(NULL, "%s%s", to,
+                                       watch->path + fromLen);
+
+         free(watch->path);
+         watch->path = path;
+      }
+   }
+
+   DblLnkLst_ForEach(l, &gNotify.subscribers) {
+      HgfsNotifySubscriber *sub =
+         DblLnkLst_Container(l, HgfsNotifySubscriber, links);
+
+      if (HgfsNotifyIsUnder(sub->path, from) &&
+          HgfsNotifyIsUnder(to, sub->share->path)) {
+         char *path = Str_SafeAsprintf(NULL, "%s%s", to, sub->path + fromLen);
+
+         LOG(4, ("%s: subscriber %"FMT64"x moved to %s\n", __FUNCTION__,
+                 sub->handle, path));
+         free(sub->path);
+         sub->path = path;
+      }
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyFreeWatch --
+ *
+ *    Forgets a watch, removing it from inotify if it's still there.
+ *
+ *    Called with the lock held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyFreeWatch(HgfsNotifyWatch *watch, // IN:
+                    Bool removeWatch)       // IN: remove the inotify watch
+{
+   if (removeWatch) {
+      inotify_rm_watch(gNotify.fd, watch->wd);
+   }
+   HashTable_Delete(gNotify.watchIndex, (void *)(uintptr_t)watch->wd);
+   DblLnkLst_Unlink1(&watch->links);
+   free(watch->subs);
+   free(watch->path);
+   free(watch);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyDetachWatch --
+ *
+ *    Stops a watch from reporting to a subscriber. The watch is removed if
+ *    it has no subscriber left, or stops watching the events the subscriber
+ *    was the only one to need.
+ *
+ *    Called with the lock held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyDetachWatch(HgfsNotifyWatch *watch,    // IN:
+                      HgfsNotifySubscriber *sub) // IN:
+{
+   uint32 i;
+
+   for (i = 0; i < watch->numSubs; i++) {
+      if (watch->subs[i] == sub) {
+         break;
+      }
+   }
+   if (i == watch->numSubs) {
+      return;
+   }
+
+   watch->subs[i] = watch->subs[--watch->numSubs];
+   if (watch->numSubs == 0) {
+      HgfsNotifyFreeWatch(watch, TRUE);
+   } else {
+      /* Without IN_MASK_ADD, this replaces the mask. */
+      inotify_add_watch(gNotify.fd, watch->path, HgfsNotifyWatchMask(watch));
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyDetachTree --
+ *
+ *    Stops the watches of a directory tree from reporting to the subscribers
+ *    of the tree, except subscribers whose own directory is in the tree.
+ *    Used when a directory is moved, or when a subscriber is removed (dir
+ *    is NULL then).
+ *
+ *    Called with the lock held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyDetachTree(const char *dir,           // IN/OPT: tree root
+                     HgfsNotifySubscriber *sub) // IN/OPT: only this one
+{
+   DblLnkLst_Links *l;
+   DblLnkLst_Links *next;
+
+   for (l = gNotify.watches.next; l != &gNotify.watches; l = next) {
+      HgfsNotifyWatch *watch = DblLnkLst_Container(l, HgfsNotifyWatch, links);
+      uint32 i = 0;
+
+      next = l->next;
+      if (dir != NULL && !HgfsNotifyIsUnder(watch->path, dir)) {
+         continue;
+      }
+
+      /* Detaching may free the watch; it's done once nothing is left. */
+      while (i < watch->numSubs) {
+         HgfsNotifySubscriber *cur = watch->subs[i];
+         uint32 numSubs = watch->numSubs;
+
+         if ((sub != NULL && cur != sub) ||
+             (dir != NULL && HgfsNotifyIsUnder(cur->path, dir))) {
+            i++;
+            continue;
+         }
+         HgfsNotifyDetachWatch(watch, cur);
+         if (numSubs == 1) {
+            break;
+         }
+      }
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyEndMove --
+ *
+ *    A directory was moved out of the watched trees, as no IN_MOVED_TO
+ *    followed its IN_MOVED_FROM: its watches stop reporting to the
+ *    subscribers above it.
+ *
+ *    Called with the lock held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyEndMove(void)
+{
+   if (gNotify.movePath != NULL) {
+      HgfsNotifyDetachTree(gNotify.movePath, NULL);
+      free(gNotify.movePath);
+      gNotify.movePath = NULL;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyHandleEvent --
+ *
+ *    Handles one inotify event: follows changes to the directory tree and
+ *    queues notifications for the subscribers of the watch.
+ *
+ *    The IN_MOVED_FROM and IN_MOVED_TO events of a rename come one after
+ *    the other, with the same cookie. The moved directory is remembered
+ *    from the first, so that the second can rename its watches.
+ *
+ *    Called with the lock held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyHandleEvent(const struct inotify_event *event) // IN:
+{
+   HgfsNotifyWatch *watch;
+   uint32 hgfsMask;
+   void *value;
+   uint32 i;
+
+   if (gNotify.movePath != NULL &&
+       ((event->mask & IN_MOVED_TO) == 0 ||
+        event->cookie != gNotify.moveCookie)) {
+      HgfsNotifyEndMove();
+   }
+
+   if (event->mask & IN_Q_OVERFLOW) {
+      DblLnkLst_Links *l;
+
+      LOG(4, ("%s: inotify queue overflow\n", __FUNCTION__));
+      DblLnkLst_ForEach(l, &gNotify.subscribers) {
+         DblLnkLst_Container(l, HgfsNotifySubscriber, links)->overflow = TRUE;
+      }
+      return;
+   }
+
+   if (!HashTable_Lookup(gNotify.watchIndex, (void *)(uintptr_t)event->wd,
+                         &value)) {
+      return;
+   }
+   watch = value;
+
+   if (event->mask & IN_IGNORED) {
+      HgfsNotifyFreeWatch(watch, FALSE);
+      return;
+   }
+
+   hgfsMask = HgfsNotifyHgfsMask(event->mask);
+
+   if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT)) {
+      /* Only the subscribers of the directory itself care. */
+      for (i = 0; i < watch->numSubs; i++) {
+         HgfsNotifySubscriber *sub = watch->subs[i];
+         char *name;
+
+         if (strcmp(sub->path, watch->path) != 0 ||
+             (hgfsMask & sub->eventFilter) == 0) {
+            continue;
+         }
+         name = HgfsNotifyRelativeName(sub, watch->path, NULL);
+         if (name != NULL) {
+            HgfsNotifyQueue(sub, name, hgfsMask & sub->eventFilter);
+         }
+      }
+      return;
+   }
+
+   if (event->len == 0) {
+      return;
+   }
+
+   for (i = 0; i < watch->numSubs; i++) {
+      HgfsNotifySubscriber *sub = watch->subs[i];
+      char *name;
+
+      if ((hgfsMask & sub->eventFilter) == 0) {
+         continue;
+      }
+      name = HgfsNotifyRelativeName(sub, watch->path, event->name);
+      if (name != NULL) {
+         HgfsNotifyQueue(sub, name, hgfsMask & sub->eventFilter);
+      }
+   }
+
+   if (event->mask & IN_ISDIR) {
+      char *path = Str_SafeAsprintf(NULL, "%s%c%s", watch->path, DIRSEPC,
+                                    event->name);
+
+      if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+         uint32 numSubs;
+         HgfsNotifySubscriber **subs;
+
+         /*
+          * A directory renamed within the watched trees keeps its watches,
+          * under the new name. They report to the subscribers above it at
+          * its new place, which are attached below.
+          */
+         if (gNotify.movePath != NULL) {
+            HgfsNotifyRenameTree(gNotify.movePath, path);
+            free(gNotify.movePath);
+            gNotify.movePath = NULL;
+            HgfsNotifyDetachTree(path, NULL);
+         }
+
+         /*
+          * Copy the list, as watching the new tree may add subscribers to
+          * this watch if the directory was moved from below itself.
+          */
+         numSubs = watch->numSubs;
+         subs = Util_SafeMalloc(numSubs * sizeof *subs);
+         memcpy(subs, watch->subs, numSubs * sizeof *subs);
+         for (i = 0; i < numSubs; i++) {
+            if (subs[i]->recursive && !HgfsNotifyAddTree(path, subs[i])) {
+               HgfsNotifyMissedTree(path, subs[i], errno);
+            }
+         }
+         free(subs);
+      } else if (event->mask & IN_MOVED_FROM) {
+         gNotify.movePath = path;
+         gNotify.moveCookie = event->cookie;
+         path = NULL;
+      }
+      free(path);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyRead --
+ *
+ *    Reads and handles the available inotify events.
+ *
+ * Results:
+ *    Number of events read, -1 on error.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+HgfsNotifyRead(char *buf) // IN: HGFS_NOTIFY_READ_SIZE bytes
+{
+   int count = 0;
+
+   for (;;) {
+      ssize_t len = read(gNotify.fd, buf, HGFS_NOTIFY_READ_SIZE);
+      char *p;
+
+      if (len < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         if (errno != EAGAIN) {
+            return -1;
+         }
+
+         /* No IN_MOVED_TO is coming for a directory moved away. */
+         MXUser_AcquireRecLock(gNotify.lock);
+         HgfsNotifyEndMove();
+         MXUser_ReleaseRecLock(gNotify.lock);
+         return count;
+      }
+
+      MXUser_AcquireRecLock(gNotify.lock);
+      for (p = buf; p < buf + len; ) {
+         struct inotify_event *event = (struct inotify_event *)p;
+
+         HgfsNotifyHandleEvent(event);
+         p += sizeof *event + event->len;
+         count++;
+      }
+      MXUser_ReleaseRecLock(gNotify.lock);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyThread --
+ *
+ *    Reads inotify events and hands them to the main loop in batches, until
+ *    told to stop through the wake up pipe.
+ *
+ * Results:
+ *    NULL.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void *
+HgfsNotifyThread(void *data) // IN: unused
+{
+   char *buf = Util_SafeMalloc(HGFS_NOTIFY_READ_SIZE);
+   uint64 batchStart = 0;
+
+   for (;;) {
+      struct pollfd fds[2];
+      int timeout = -1;
+      int ret;
+
+      if (batchStart != 0) {
+         uint64 held = HgfsNotifyTimeMS() - batchStart;
+         timeout = (held >= HGFS_NOTIFY_MAX_DELAY_MS) ? 0 :
+                   MIN(HGFS_NOTIFY_COALESCE_MS,
+                       HGFS_NOTIFY_MAX_DELAY_MS - (int)held);
+      }
+
+      fds[0].fd = gNotify.fd;
+      fds[0].events = POLLIN;
+      fds[1].fd = gNotify.wakeFds[0];
+      fds[1].events = POLLIN;
+
+      ret = poll(fds, ARRAYSIZE(fds), timeout);
+      if (ret < 0 && errno != EINTR) {
+         Log("%s: poll failed: %s\n", __FUNCTION__, strerror(errno));
+         break;
+      }
+      if (ret > 0 && fds[1].revents != 0) {
+         break;
+      }
+
+      if (ret > 0 && (fds[0].revents & POLLIN)) {
+         if (HgfsNotifyRead(buf) < 0) {
+            Log("%s: read failed: %s\n", __FUNCTION__, strerror(errno));
+            break;
+         }
+         if (batchStart == 0) {
+            batchStart = HgfsNotifyTimeMS();
+         }
+         if (HgfsNotifyTimeMS() - batchStart < HGFS_NOTIFY_MAX_DELAY_MS) {
+            continue;
+         }
+      } else if (ret != 0 || batchStart == 0) {
+         continue;
+      }
+
+      /* The burst is over, or has been held long enough. */
+      MXUser_AcquireRecLock(gNotify.lock);
+      HgfsNotifyScheduleFlush();
+      MXUser_ReleaseRecLock(gNotify.lock);
+      batchStart = 0;
+   }
+
+   free(buf);
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_Init --
+ *
+ *    Initialization for the notification component: creates the inotify
+ *    instance and starts the thread reading its events.
+ *
+ * Results:
+ *    HGFS_ERROR_SUCCESS, or an error if notifications are not available.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsNotify_Init(void)
+{
+   HgfsInternalStatus status;
+
+   gNotify.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+   if (gNotify.fd < 0) {
+      status = errno;
+      LOG(4, ("%s: inotify_init1 failed: %s\n", __FUNCTION__,
+              strerror(status)));
+      return status;
+   }
+
+   if (pipe(gNotify.wakeFds) != 0) {
+      status = errno;
+      close(gNotify.fd);
+      gNotify.fd = -1;
+      return status;
+   }
+
+   gNotify.lock = MXUser_CreateRecLock("hgfsNotifyLock", RANK_hgfsNotifyLock);
+   DblLnkLst_Init(&gNotify.shares);
+   DblLnkLst_Init(&gNotify.subscribers);
+   DblLnkLst_Init(&gNotify.watches);
+   gNotify.watchIndex = HashTable_Alloc(HGFS_NOTIFY_WATCH_BUCKETS,
+                                        HASH_INT_KEY, NULL);
+   gNotify.pendingIndex = HashTable_Alloc(HGFS_NOTIFY_EVENT_BUCKETS,
+                                          HASH_STRING_KEY | HASH_FLAG_COPYKEY,
+                                          NULL);
+   gNotify.nextShare = 0;
+   gNotify.nextSubscriber = 0;
+   gNotify.syncDeactivated = FALSE;
+   gNotify.flushSource = 0;
+
+   status = pthread_create(&gNotify.thread, NULL, HgfsNotifyThread, NULL);
+   if (status != 0) {
+      LOG(4, ("%s: cannot start thread: %s\n", __FUNCTION__, strerror(status)));
+      HgfsNotify_Exit();
+      return status;
+   }
+   gNotify.threadStarted = TRUE;
+
+   return HGFS_ERROR_SUCCESS;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_Exit --
+ *
+ *    Exit for the notification component: stops the thread, and frees all
+ *    shared folders, subscribers and watches.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Pending notifications are dropped.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsNotify_Exit(void)
+{
+   uint32 i;
+
+   if (gNotify.fd < 0) {
+      return;
+   }
+
+   if (gNotify.threadStarted) {
+      char c = 'q';
+
+      while (write(gNotify.wakeFds[1], &c, 1) < 0 && errno == EINTR) {
+      }
+      pthread_join(gNotify.thread, NULL);
+      gNotify.threadStarted = FALSE;
+   }
+
+   if (gNotify.flushSource != 0) {
+      g_source_remove(gNotify.flushSource);
+      gNotify.flushSource = 0;
+   }
+
+   while (DblLnkLst_IsLinked(&gNotify.shares)) {
+      HgfsNotifyShare *share =
+         DblLnkLst_Container(gNotify.shares.next, HgfsNotifyShare, links);
+      HgfsNotify_RemoveSharedFolder(share->handle);
+   }
+
+   for (i = 0; i < gNotify.numPending; i++) {
+      free(gNotify.pending[i].name);
+   }
+   free(gNotify.pending);
+   gNotify.pending = NULL;
+   gNotify.numPending = 0;
+   gNotify.pendingSize = 0;
+
+   free(gNotify.movePath);
+   gNotify.movePath = NULL;
+
+   HashTable_Free(gNotify.pendingIndex);
+   HashTable_Free(gNotify.watchIndex);
+   MXUser_DestroyRecLock(gNotify.lock);
+   gNotify.lock = NULL;
+
+   close(gNotify.wakeFds[0]);
+   close(gNotify.wakeFds[1]);
+   close(gNotify.fd);
+   gNotify.fd = -1;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_Deactivate --
+ *
+ *    Deactivates generating file system change notifications. While the
+ *    server synchronizes, events are dropped; watches are kept, since the
+ *    subscribers are.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsNotify_Deactivate(HgfsNotifyActivateReason reason) // IN: reason
+{
+   if (gNotify.fd < 0 || reason != HGFS_NOTIFY_REASON_SERVER_SYNC) {
+      return;
+   }
+
+   MXUser_AcquireRecLock(gNotify.lock);
+   gNotify.syncDeactivated = TRUE;
+   MXUser_ReleaseRecLock(gNotify.lock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_Activate --
+ *
+ *    Activates generating file system change notifications. Subscribers that
+ *    lost events while the server synchronized are told so.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsNotify_Activate(HgfsNotifyActivateReason reason) // IN: reason
+{
+   if (gNotify.fd < 0 || reason != HGFS_NOTIFY_REASON_SERVER_SYNC) {
+      return;
+   }
+
+   MXUser_AcquireRecLock(gNotify.lock);
+   if (gNotify.syncDeactivated) {
+      gNotify.syncDeactivated = FALSE;
+      HgfsNotifyScheduleFlush();
+   }
+   MXUser_ReleaseRecLock(gNotify.lock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_AddSharedFolder --
+ *
+ *    Allocates memory and initializes new shared folder structure.
+ *
+ * Results:
+ *    Opaque subscriber handle for the new subscriber or HGFS_INVALID_FOLDER_HANDLE
+ *    if adding shared folder fails.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsSharedFolderHandle
+HgfsNotify_AddSharedFolder(const char *path,       // IN: path in the host
+                           const char *shareName)  // IN: name of the shared folder
+{
+   HgfsNotifyShare *share;
+   size_t len;
+
+   if (gNotify.fd < 0) {
+      return HGFS_INVALID_FOLDER_HANDLE;
+   }
+
+   share = Util_SafeCalloc(1, sizeof *share);
+   DblLnkLst_Init(&share->links);
+   share->path = Util_SafeStrdup(path);
+   share->shareName = Util_SafeStrdup(shareName);
+
+   len = strlen(share->path);
+   while (len > 1 && share->path[len - 1] == DIRSEPC) {
+      share->path[--len] = '\0';
+   }
+
+   MXUser_AcquireRecLock(gNotify.lock);
+   share->handle = gNotify.nextShare++;
+   DblLnkLst_LinkLast(&gNotify.shares, &share->links);
+   MXUser_ReleaseRecLock(gNotify.lock);
+
+   LOG(4, ("%s: share %s (%s) handle %u\n", __FUNCTION__, shareName, path,
+           share->handle));
+   return share->handle;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyFindShare --
+ *
+ *    Finds a shared folder by handle.
+ *
+ *    Called with the lock held.
+ *
+ * Results:
+ *    The shared folder or NULL.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsNotifyShare *
+HgfsNotifyFindShare(HgfsSharedFolderHandle handle) // IN:
+{
+   DblLnkLst_Links *l;
+
+   DblLnkLst_ForEach(l, &gNotify.shares) {
+      HgfsNotifyShare *share = DblLnkLst_Container(l, HgfsNotifyShare, links);
+      if (share->handle == handle) {
+         return share;
+      }
+   }
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyFreeSubscriber --
+ *
+ *    Removes a subscriber: detaches it from its watches and drops its
+ *    pending events.
+ *
+ *    Called with the lock held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyFreeSubscriber(HgfsNotifySubscriber *sub) // IN:
+{
+   uint32 i;
+
+   HgfsNotifyDetachTree(NULL, sub);
+
+   for (i = 0; i < gNotify.numPending; i++) {
+      if (gNotify.pending[i].sub == sub) {
+         gNotify.pending[i].sub = NULL;
+      }
+   }
+
+   DblLnkLst_Unlink1(&sub->links);
+   free(sub->path);
+   free(sub);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_AddSubscriber --
+ *
+ *    Allocates memory and initializes new subscriber structure, and watches
+ *    the directory, and for a recursive subscriber the tree below it.
+ *
+ * Results:
+ *    Opaque subscriber handle for the new subscriber or HGFS_INVALID_SUBSCRIBER_HANDLE
+ *    if adding subscriber fails.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsSubscriberHandle
+HgfsNotify_AddSubscriber(HgfsSharedFolderHandle sharedFolder, // IN: shared folder handle
+                         const char *path,                    // IN: relative path
+                         uint32 eventFilter,                  // IN: event filter
+                         uint32 recursive,                    // IN: look in subfolders
+                         HgfsNotifyEventReceiveCb eventCb,    // IN notification callback
+                         struct HgfsSessionInfo *session)     // IN: server context
+{
+   HgfsSubscriberHandle handle = HGFS_INVALID_SUBSCRIBER_HANDLE;
+   HgfsNotifySubscriber *sub;
+   HgfsNotifyShare *share;
+
+   if (gNotify.fd < 0) {
+      return HGFS_INVALID_SUBSCRIBER_HANDLE;
+   }
+
+   MXUser_AcquireRecLock(gNotify.lock);
+
+   share = HgfsNotifyFindShare(sharedFolder);
+   if (share == NULL) {
+      LOG(4, ("%s: no shared folder %u\n", __FUNCTION__, sharedFolder));
+      goto exit;
+   }
+
+   while (*path == DIRSEPC) {
+      path++;
+   }
+
+   sub = Util_SafeCalloc(1, sizeof *sub);
+   DblLnkLst_Init(&sub->links);
+   sub->share = share;
+   sub->path = (*path == '\0') ? Util_SafeStrdup(share->path) :
+               Str_SafeAsprintf(NULL, "%s%c%s", share->path, DIRSEPC, path);
+   sub->eventFilter = eventFilter;
+   sub->recursive = recursive != 0;
+   sub->eventCb = eventCb;
+   sub->session = session;
+   sub->handle = gNotify.nextSubscriber++;
+   DblLnkLst_LinkLast(&gNotify.subscribers, &sub->links);
+
+   if (!HgfsNotifyAddTree(sub->path, sub)) {
+      HgfsNotifyFreeSubscriber(sub);
+      goto exit;
+   }
+   handle = sub->handle;
+
+   LOG(4, ("%s: subscriber %"FMT64"x on %s filter %#x%s\n", __FUNCTION__,
+           handle, sub->path, eventFilter, recursive ? " recursive" : ""));
+
+exit:
+   MXUser_ReleaseRecLock(gNotify.lock);
+   return handle;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_RemoveSharedFolder --
+ *
+ *    Deallcates memory used by shared folder and performs necessary cleanup.
+ *    Also deletes all subscribers that are defined for the shared folder.
+ *
+ * Results:
+ *    TRUE if the shared folder was found.
+ *
+ * Side effects:
+ *    Removes all subscribers that correspond to the shared folder and invalidates
+ *    thier handles.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsNotify_RemoveSharedFolder(HgfsSharedFolderHandle sharedFolder) // IN
+{
+   DblLnkLst_Links *l;
+   DblLnkLst_Links *next;
+   HgfsNotifyShare *share;
+
+   if (gNotify.fd < 0) {
+      return FALSE;
+   }
+
+   MXUser_AcquireRecLock(gNotify.lock);
+
+   share = HgfsNotifyFindShare(sharedFolder);
+   if (share != NULL) {
+      for (l = gNotify.subscribers.next; l != &gNotify.subscribers; l = next) {
+         HgfsNotifySubscriber *sub =
+            DblLnkLst_Container(l, HgfsNotifySubscriber, links);
+
+         next = l->next;
+         if (sub->share == share) {
+            HgfsNotifyFreeSubscriber(sub);
+         }
+      }
+
+      DblLnkLst_Unlink1(&share->links);
+      free(share->path);
+      free(share->shareName);
+      free(share);
+   }
+
+   MXUser_ReleaseRecLock(gNotify.lock);
+   return share != NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_RemoveSubscriber --
+ *
+ *    Deallcates memory used by NotificationSubscriber and performs necessary cleanup.
+ *
+ * Results:
+ *    TRUE if the subscriber was found.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsNotify_RemoveSubscriber(HgfsSubscriberHandle subscriber) // IN
+{
+   DblLnkLst_Links *l;
+   Bool found = FALSE;
+
+   if (gNotify.fd < 0) {
+      return FALSE;
+   }
+
+   MXUser_AcquireRecLock(gNotify.lock);
+
+   DblLnkLst_ForEach(l, &gNotify.subscribers) {
+      HgfsNotifySubscriber *sub =
+         DblLnkLst_Container(l, HgfsNotifySubscriber, links);
+
+      if (sub->handle == subscriber) {
+         HgfsNotifyFreeSubscriber(sub);
+         found = TRUE;
+         break;
+      }
+   }
+
+   MXUser_ReleaseRecLock(gNotify.lock);
+   return found;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_RemoveSessionSubscribers --
+ *
+ *    Removes all entries that are related to a particular session.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsNotify_RemoveSessionSubscribers(struct HgfsSessionInfo *session) // IN
+{
+   DblLnkLst_Links *l;
+   DblLnkLst_Links *next;
+
+   if (gNotify.fd < 0) {
+      return;
+   }
+
+   MXUser_AcquireRecLock(gNotify.lock);
+
+   for (l = gNotify.subscribers.next; l != &gNotify.subscribers; l = next) {
+      HgfsNotifySubscriber *sub =
+         DblLnkLst_Container(l, HgfsNotifySubscriber, links);
+
+      next = l->next;
+      if (sub->session == session) {
+         HgfsNotifyFreeSubscriber(sub);
+      }
+   }
+
+   MXUser_ReleaseRecLock(gNotify.lock);
+}
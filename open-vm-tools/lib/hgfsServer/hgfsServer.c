@@ -46,6 +46,7 @@
 #include "hgfsServer.h"
 #include "hgfsServerParameters.h"
 #include "hgfsServerOplock.h"
+#include "hgfsServerOplockInt.h"
 #include "hgfsDirNotify.h"
 #include "userlock.h"
 #include "poll.h"
@@ -376,6 +377,7 @@ static void HgfsServerRename(HgfsInputParam *input);
 static void HgfsServerQueryVolume(HgfsInputParam *input);
 static void HgfsServerSymlinkCreate(HgfsInputParam *input);
 static void HgfsServerServerLockChange(HgfsInputParam *input);
+static void HgfsServerOplockBreakAckReply(HgfsInputParam *input);
 static void HgfsServerWriteWin32Stream(HgfsInputParam *input);
 static void HgfsServerCreateSession(HgfsInputParam *input);
 static void HgfsServerDestroySession(HgfsInputParam *input);
@@ -401,7 +403,7 @@ static void HgfsServerRemoveDirNotifyWatch(HgfsInputParam *input);
  *----------------------------------------------------------------------------
  */
 
-static void
+void
 HgfsServerSessionGet(HgfsSessionInfo *session)   // IN: session context
 {
    ASSERT(session);
@@ -427,7 +429,7 @@ HgfsServerSessionGet(HgfsSessionInfo *session)   // IN: session context
  *----------------------------------------------------------------------------
  */
 
-static void
+void
 HgfsServerSessionPut(HgfsSessionInfo *session)   // IN: session context
 {
    ASSERT(session);
@@ -1044,7 +1046,9 @@ HgfsHandle2NotifyInfo(HgfsHandle handle,                    // IN: Hgfs file han
       nameSize = existingFileNode->utf8NameLen - existingFileNode->shareInfo.rootDirLen;
       name = Util_SafeMalloc(nameSize + 1);
       *folderHandle = existingFileNode->shareInfo.handle;
-      memcpy(name, existingFileNode->utf8Name, nameSize);
+      memcpy(name,
+             existingFileNode->utf8Name + existingFileNode->shareInfo.rootDirLen,
+             nameSize);
       name[nameSize] = '\0';
       *fileName = name;
       *fileNameSize = nameSize;
@@ -1113,6 +1117,7 @@ HgfsGetNodeCopy(HgfsHandle handle,        // IN: Hgfs file handle
    copy->shareAccess = original->shareAccess;
    copy->flags = original->flags;
    copy->state = original->state;
+   copy->serverLock = original->serverLock;
    copy->handle = original->handle;
    copy->fileCtx = original->fileCtx;
    found = TRUE;
@@ -1293,6 +1298,12 @@ HgfsUpdateNodeServerLock(fileDesc fd,                // IN: OS handle
       existingFileNode = &session->nodeArray[i];
       if (existingFileNode->state != FILENODE_STATE_UNUSED) {
          if (existingFileNode->fileDesc == fd) {
+            /* A cached node that loses its lock no longer counts as locked. */
+            if (existingFileNode->state == FILENODE_STATE_IN_USE_CACHED &&
+                existingFileNode->serverLock != HGFS_LOCK_NONE &&
+                serverLock == HGFS_LOCK_NONE) {
+               session->numCachedLockedNodes--;
+            }
             existingFileNode->serverLock = serverLock;
             updated = TRUE;
             break;
@@ -1887,6 +1898,7 @@ HgfsAddToCacheInternal(HgfsHandle handle,         // IN: HGFS file handle
 
    if (node->serverLock != HGFS_LOCK_NONE) {
       session->numCachedLockedNodes++;
+      HgfsServerOplockAddNode(node->fileDesc, handle);
    }
 
    return TRUE;
@@ -1950,6 +1962,12 @@ HgfsRemoveFromCacheInternal(HgfsHandle handle,        // IN: Hgfs handle to the
        * Instead, we'll just await the lobotomization of the node cache to
        * really fix this.
        */
+      if (node->serverLock != HGFS_LOCK_NONE) {
+         /* Closing the file releases its lease. */
+         HgfsServerOplockRemoveNode(node->fileDesc);
+         node->serverLock = HGFS_LOCK_NONE;
+         session->numCachedLockedNodes--;
+      }
       if (HgfsPlatformCloseFile(node->fileDesc, node->fileCtx)) {
          LOG(4, ("%s: Could not close fd %u\n", __FUNCTION__, node->fileDesc));
 
@@ -2903,6 +2921,18 @@ static struct {
    { HgfsServerRemoveDirNotifyWatch, sizeof (HgfsRequestRemoveWatchV4),            REQ_SYNC},
    { NULL,                       0,                                                REQ_SYNC}, // No Op notify
    { HgfsServerSearchRead,       sizeof (HgfsRequestSearchReadV4),                 REQ_SYNC},
+   { NULL,                       0,                                                REQ_SYNC}, // No Open V4
+   { NULL,                       0,                                                REQ_SYNC}, // No Enumerate streams V4
+   { NULL,                       0,                                                REQ_SYNC}, // No Getattr V4
+   { NULL,                       0,                                                REQ_SYNC}, // No Setattr V4
+   { NULL,                       0,                                                REQ_SYNC}, // No Delete V4
+   { NULL,                       0,                                                REQ_SYNC}, // No Linkmove V4
+   { NULL,                       0,                                                REQ_SYNC}, // No Fsctl V4
+   { NULL,                       0,                                                REQ_SYNC}, // No Access check V4
+   { NULL,                       0,                                                REQ_SYNC}, // No Fsync V4
+   { NULL,                       0,                                                REQ_SYNC}, // No Query volume V4
+   { NULL,                       0,                                                REQ_SYNC}, // No Oplock acquire V4
+   { HgfsServerOplockBreakAckReply, sizeof (HgfsReplyOplockBreakV4),               REQ_SYNC},
 
 };
 
@@ -3515,7 +3545,8 @@ exit:
  *
  * HgfsServerTransportRemoveSessionFromList --
  *
- *   Unlinks the specified session info from the list.
+ *   Unlinks the specified session info from the list, and closes it: its
+ *   oplocks are released, as the client can no longer be sent breaks.
  *
  *   Note: The caller must acquire the sessionArrayLock in transportSession
  *   before calling this function.
@@ -3538,6 +3569,8 @@ HgfsServerTransportRemoveSessionFromList(HgfsTransportSessionInfo *transportSess
 
    DblLnkLst_Unlink1(&session->links);
    transportSession->numSessions--;
+   session->state = HGFS_SESSION_STATE_CLOSED;
+   HgfsServerOplockRemoveSession(session);
    HgfsServerSessionPut(session);
 }
 
@@ -4316,11 +4349,18 @@ HgfsServerAllocateSession(HgfsTransportSessionInfo *transportSession, // IN:
    session->fileIOLock = MXUser_CreateExclLock("HgfsFileIOLock",
                                                RANK_hgfsFileIOLock);
 
-   session->nodeArrayLock = MXUser_CreateExclLock("HgfsNodeArrayLock",
-                                                  RANK_hgfsNodeArrayLock);
+   /*
+    * The node and search arrays are held for very short lookups under heavy
+    * multi-threaded load, so spin briefly before parking.
+    */
+
+   session->nodeArrayLock =
+      MXUser_CreateExclLockEx("HgfsNodeArrayLock", RANK_hgfsNodeArrayLock,
+                              MXUSER_FLAG_ADAPTIVE_SPIN);
 
-   session->searchArrayLock = MXUser_CreateExclLock("HgfsSearchArrayLock",
-                                                    RANK_hgfsSearchArrayLock);
+   session->searchArrayLock =
+      MXUser_CreateExclLockEx("HgfsSearchArrayLock", RANK_hgfsSearchArrayLock,
+                              MXUSER_FLAG_ADAPTIVE_SPIN);
 
    session->sessionId = HgfsGenerateSessionId();
    session->state = HGFS_SESSION_STATE_OPEN;
@@ -7440,6 +7480,46 @@ HgfsServerServerLockChange(HgfsInputParam *input)  // IN: Input params
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerOplockBreakAckReply --
+ *
+ *    Handle the client's acknowledgement of an oplock break: the client now
+ *    holds the lock in the reply, and the server downgrades its lease to
+ *    match, which lets the conflicting open on the host proceed.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerOplockBreakAckReply(HgfsInputParam *input)  // IN: Input params
+{
+   HgfsHandle file;
+   HgfsLockType replyLock;
+   HgfsInternalStatus status = HGFS_ERROR_SUCCESS;
+
+   HGFS_ASSERT_INPUT(input);
+
+   if (HgfsUnpackOplockBreakAckReply(input->payload, input->payloadSize,
+                                     input->op, &file, &replyLock)) {
+      LOG(4, ("%s: client acknowledged break of handle %u to %d\n",
+              __FUNCTION__, file, replyLock));
+      HgfsServerOplockBreakAck(file, input->session, replyLock);
+   } else {
+      status = HGFS_ERROR_PROTOCOL;
+   }
+
+   HgfsServerCompleteRequest(status, 0, input);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -8987,6 +9067,80 @@ exit:
 }
 
 
+#ifdef HGFS_OPLOCKS
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerOplockBreak --
+ *
+ *    Sends an oplock break request to the client: the server must downgrade
+ *    its lock on the file to newLock. The client flushes what it cached,
+ *    then acknowledges with an HGFS_OP_OPLOCK_BREAK_V4 reply.
+ *
+ *    Called from the main loop, like the directory notifications, so the
+ *    transport is only used from the thread that owns it.
+ *
+ * Results:
+ *    TRUE if the request was sent, FALSE otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsServerOplockBreak(HgfsSessionInfo *session,  // IN: session info
+                      HgfsHandle handle,         // IN: Hgfs file handle
+                      HgfsLockType newLock)      // IN: lock to downgrade to
+{
+   HgfsPacket *packet = NULL;
+   HgfsHeader *packetHeader = NULL;
+   size_t sizeNeeded;
+   Bool result = FALSE;
+
+   LOG(4, ("%s: break handle %u to %d\n", __FUNCTION__, handle, newLock));
+
+   if (session->state == HGFS_SESSION_STATE_CLOSED) {
+      LOG(4, ("%s: session has been closed drop the break %"FMT64"x\n",
+              __FUNCTION__, session->sessionId));
+      goto exit;
+   }
+
+   sizeNeeded = HgfsPackGetOplockBreakSize();
+
+   /*
+    * As for notifications, the packet and metapacket share one buffer which
+    * the send complete callback releases.
+    */
+   packet = Util_SafeCalloc(1, sizeof *packet + sizeNeeded);
+   packetHeader = (HgfsHeader *)((char *)packet + sizeof *packet);
+   packet->metaPacketSize = sizeNeeded;
+   packet->metaPacketDataSize = packet->metaPacketSize;
+   packet->metaPacket = packetHeader;
+
+   if (!HgfsPackOplockBreakRequest(packetHeader, handle, newLock,
+                                   session->sessionId, &sizeNeeded)) {
+      LOG(4, ("%s: failed to pack oplock break request\n", __FUNCTION__));
+      goto exit;
+   }
+
+   if (!HgfsPacketSend(packet, session->transportSession, 0)) {
+      LOG(4, ("%s: failed to send oplock break to the host\n", __FUNCTION__));
+      goto exit;
+   }
+
+   /* The transport will call the server send complete callback to release the packets. */
+   packet = NULL;
+   result = TRUE;
+
+exit:
+   free(packet);
+   return result;
+}
+#endif
+
+
 /*
  *-----------------------------------------------------------------------------
  *
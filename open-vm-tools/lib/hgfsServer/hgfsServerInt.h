@@ -570,6 +570,12 @@ HgfsIsCached(HgfsHandle handle,         // IN: Hgfs handle of the node
 Bool
 HgfsIsServerLockAllowed(HgfsSessionInfo *session);  // IN: session info
 
+void
+HgfsServerSessionGet(HgfsSessionInfo *session);     // IN: session context
+
+void
+HgfsServerSessionPut(HgfsSessionInfo *session);     // IN: session context
+
 Bool
 HgfsHandle2FileDesc(HgfsHandle handle,        // IN: Hgfs file handle
                     HgfsSessionInfo *session, // IN: session info
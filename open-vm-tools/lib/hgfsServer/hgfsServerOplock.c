@@ -35,8 +35,17 @@
 #include "cpName.h"
 #include "cpNameLite.h"
 #include "hgfsServerInt.h"
+#include "hgfsServerOplock.h"
 #include "hgfsServerOplockInt.h"
 
+#if !defined(_WIN32)
+/* Host file names are case sensitive. */
+#define stricmp strcmp
+#endif
+
+#define LOGLEVEL_MODULE hgfs
+#include "loglevel_user.h"
+
 
 
 /*
@@ -132,24 +141,16 @@ HgfsHandle2ServerLock(HgfsHandle handle,        // IN: Hgfs file handle
                       HgfsLockType *lock)       // OUT: Server lock
 {
 #ifdef HGFS_OPLOCKS
-   Bool found = FALSE;
-   HgfsFileNode *fileNode = NULL;
+   HgfsFileNode fileNode;
 
    ASSERT(lock);
 
-   MXUser_AcquireExclLock(session->nodeArrayLock);
-   fileNode = HgfsHandle2FileNode(handle, session);
-   if (fileNode == NULL) {
-      goto exit;
+   if (!HgfsGetNodeCopy(handle, session, FALSE, &fileNode)) {
+      return FALSE;
    }
 
-   *lock = fileNode->serverLock;
-   found = TRUE;
-
-exit:
-   MXUser_ReleaseExclLock(session->nodeArrayLock);
-
-   return found;
+   *lock = fileNode.serverLock;
+   return TRUE;
 #else
    *lock = HGFS_LOCK_NONE;
    return TRUE;
@@ -218,160 +219,128 @@ HgfsFileHasServerLock(const char *utf8Name,             // IN: Name in UTF8
 
 
 
-#ifdef HGFS_OPLOCKS
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsServerOplockBreakReply --
+ * HgfsServerOplockAddNode --
+ *
+ *    Tell the oplock code that a file with a server lock is now cached under
+ *    an hgfs handle, so that a break of its lock can be sent to the client.
  *
- *      The client was sent an oplock break request, and responded with this
- *      reply. It contains the oplock status that the client is now in. Since
- *      the break could have actually been a degrade, it is well within the
- *      client's rights to transition to a non-broken state. We need to make
- *      sure that such a transition was legal, acknowledge the brea
- *      appropriately, and update our own state.
+ *    The session's nodeArrayLock may be held by the caller.
  *
  * Results:
- *      None.
+ *    None.
  *
  * Side effects:
- *      None.
+ *    None.
  *
  *-----------------------------------------------------------------------------
  */
 
 void
-HgfsServerOplockBreakReply(const unsigned char *packetIn, // IN: Reply packet
-                           unsigned int packetSize,       // IN: Size of packet
-                           void *clientData)              // IN: From request
+HgfsServerOplockAddNode(fileDesc fileDesc,     // IN: OS handle
+                        HgfsHandle handle)     // IN: Hgfs file handle
 {
-   HgfsReplyServerLockChange *reply;
-   ServerLockData *lockData = clientData;
+#ifdef HGFS_OPLOCKS
+   HgfsPlatformOplockAddNode(fileDesc, handle);
+#endif
+}
 
-   ASSERT(packetIn);
-   ASSERT(clientData);
 
-   if (packetSize < sizeof *reply) {
-      return;
-   }
-   reply = (HgfsReplyServerLockChange *)packetIn;
-
-   /*
-    * XXX: It should be safe to ignore the status and id from the actual
-    * HgfsReply. The only information we need to properly acknowledge the break
-    * is the original fd and the new lease, which, in the case of a degrade,
-    * is double checked in HgfsAckOplockBreak, so we'd be safe from a garbage
-    * value.
-    */
-   HgfsAckOplockBreak(lockData, reply->serverLock);
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerOplockRemoveNode --
+ *
+ *    Tell the oplock code that a file with a server lock is about to be
+ *    closed. Any break in progress for it is dropped.
+ *
+ *    The session's nodeArrayLock may be held by the caller.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsServerOplockRemoveNode(fileDesc fileDesc)  // IN: OS handle
+{
+#ifdef HGFS_OPLOCKS
+   HgfsPlatformOplockRemoveNode(fileDesc);
+#endif
 }
 
 
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsServerOplockBreak --
+ * HgfsServerOplockRemoveSession --
+ *
+ *    Tell the oplock code that a session is closed. The server locks of its
+ *    files are released, and the breaks in progress for them are dropped.
  *
- *      When the host FS needs to break the oplock so that another client
- *      can open the file, it signals the event in the overlapped structure
- *      that we used to request an oplock.
- *      This sets off the following chains of events:
- *      1. Send the oplock break request to the guest.
- *      2. Once the guest acknowledges the oplock break, the completion
- *      routine GuestRpcServerRequestCallback will fire, causing
- *      HgfsServerOplockBreakReply to also fire, which will break the oplock
- *      on the host FS.
+ *    The caller holds a reference on the session.
  *
  * Results:
- *      None.
+ *    None.
  *
  * Side effects:
- *      If successful, allocates memory for the rpc request.
+ *    None.
  *
  *-----------------------------------------------------------------------------
  */
 
 void
-HgfsServerOplockBreak(ServerLockData *lockData)
+HgfsServerOplockRemoveSession(HgfsSessionInfo *session)  // IN: session info
 {
-   HgfsHandle hgfsHandle;
-   char *requestBuffer = NULL;
-   HgfsRequestServerLockChange *request;
-   HgfsLockType lock;
-
-   LOG(4, ("%s: entered\n", __FUNCTION__));
-
-   /*
-    * XXX: Just because the file in not in the cache on the server,
-    * does not mean it was closed on the client. It is possible that
-    * we closed the file on the server because we ran out of space
-    * in cache. That's why for now as long as a file has a lock,
-    * we don't remove it from the node cache. This should be fixed.
-    *
-    * In any case, none of these cache-related failures should cause us to ack
-    * the oplock break locally. That is because if the file wasn't in the
-    * cache, or it had no lock, chances are someone else (maybe the VCPU
-    * thread) broke the oplock and/or closed the file.
-    */
-
-   if (!HgfsFileDesc2Handle(lockData->fileDesc, &hgfsHandle)) {
-      LOG(4, ("%s: file is not in the cache\n", __FUNCTION__));
-      goto free_and_exit;
-   }
+#ifdef HGFS_OPLOCKS
+   HgfsPlatformOplockRemoveSession(session);
+#endif
+}
 
-   if (!HgfsHandle2ServerLock(hgfsHandle, &lock)) {
-      LOG(4, ("%s: could not retrieve node's lock info.\n", __FUNCTION__));
-      goto free_and_exit;
-   }
 
-   if (lock == HGFS_LOCK_NONE) {
-      LOG(4, ("%s: the file does not have a server lock.\n", __FUNCTION__));
-      goto free_and_exit;
-   }
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerOplockBreakAck --
+ *
+ *    The client acknowledged an oplock break, or gave up its oplock, and now
+ *    holds replyLock. Release or downgrade the lock on the host file and
+ *    update the file node.
+ *
+ * Results:
+ *    The lock the server now holds on the file.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
 
-   /*
-    * We need to setup the entire request here. The command prefix will be
-    * added later, so save some space for it.
-    *
-    * XXX: This should probably go into a common allocation function that
-    * other out-of-band requests can use.
-    */
-
-   requestBuffer = malloc(sizeof *request + HGFS_CLIENT_CMD_LEN);
-   if (requestBuffer == NULL) {
-      LOG(4, ("%s: could not allocate memory.\n", __FUNCTION__));
-      goto ack_and_exit;
-   }
+HgfsLockType
+HgfsServerOplockBreakAck(HgfsHandle handle,          // IN: Hgfs file handle
+                         HgfsSessionInfo *session,   // IN: Session info
+                         HgfsLockType replyLock)     // IN: Lock client holds
+{
+#ifdef HGFS_OPLOCKS
+   HgfsLockType newLock;
+   fileDesc fileDesc;
+   void *fileCtx;
 
-   /* Save space for the command prefix. */
-   request = (HgfsRequestServerLockChange *)
-      (requestBuffer + HGFS_CLIENT_CMD_LEN);
-   request->header.op = HGFS_OP_SERVER_LOCK_CHANGE;
-   request->header.id = 0; /* XXX */
-   request->file = hgfsHandle;
-   request->newServerLock = lockData->serverLock;
-
-   /*
-    * Just send the request size for our actual request; our callee will
-    * write in the command prefix and modify the request size appropriately.
-    *
-    * If for some reason we fail, we'll acknowledge the oplock break
-    * immediately.
-    */
-
-   if (HgfsServerManager_SendRequest(requestBuffer, sizeof *request,
-                                     HgfsServerOplockBreakReply, lockData)) {
-      return;
+   if (!HgfsHandle2FileDesc(handle, session, &fileDesc, &fileCtx)) {
+      LOG(4, ("%s: invalid handle %u\n", __FUNCTION__, handle));
+      return HGFS_LOCK_NONE;
    }
-   free(requestBuffer);
-
-  ack_and_exit:
-   HgfsAckOplockBreak(lockData, HGFS_LOCK_NONE);
-
-   return;
 
-  free_and_exit:
-   free(lockData);
-}
+   newLock = HgfsAckOplockBreak(fileDesc, replyLock);
+   HgfsUpdateNodeServerLock(fileDesc, session, newLock);
+   return newLock;
+#else
+   return HGFS_LOCK_NONE;
 #endif
-
+}
@@ -59,6 +59,13 @@ Bool HgfsFileHasServerLock(const char *utf8Name,
 Bool HgfsAcquireServerLock(fileDesc fileDesc,
                            HgfsSessionInfo *session,
                            HgfsLockType *serverLock);
+void HgfsServerOplockAddNode(fileDesc fileDesc,
+                             HgfsHandle handle);
+void HgfsServerOplockRemoveNode(fileDesc fileDesc);
+void HgfsServerOplockRemoveSession(HgfsSessionInfo *session);
+HgfsLockType HgfsServerOplockBreakAck(HgfsHandle handle,
+                                      HgfsSessionInfo *session,
+                                      HgfsLockType replyLock);
 
 
 #endif // ifndef _HGFS_SERVER_OPLOCK_H_
@@ -31,24 +31,22 @@
 
 /*
  * Does this platform have oplock support? We define it here to avoid long
- * ifdefs all over the code. For now, Linux and Windows hosts only.
- *
- * XXX: Just kidding, no oplock support yet.
+ * ifdefs all over the code. For now, Linux only, where oplocks are built on
+ * kernel file leases.
  */
-#if 0
+#if defined(__linux__)
 #define HGFS_OPLOCKS
 #endif
 
 /*
- * XXX describe the data structure
+ * How long the server waits for the client to acknowledge an oplock break
+ * before it breaks the lease itself. It must stay well below the kernel's
+ * lease-break-time (45 seconds by default), after which the kernel breaks
+ * the lease on its own.
  */
-
-/* Server lock related structure */
-typedef struct {
-   fileDesc fileDesc;
-   int32 event;
-   HgfsLockType serverLock;
-} ServerLockData;
+#ifndef HGFS_OPLOCK_BREAK_TIMEOUT_MS
+#define HGFS_OPLOCK_BREAK_TIMEOUT_MS   5000
+#endif
 
 
 /*
@@ -62,13 +60,33 @@ typedef struct {
  */
 
 #ifdef HGFS_OPLOCKS
+/* Implemented by the platform. */
+Bool
+HgfsPlatformOplockInit(void);
+
+void
+HgfsPlatformOplockDestroy(void);
+
+void
+HgfsPlatformOplockAddNode(fileDesc fileDesc,
+                          HgfsHandle handle);
+
 void
-HgfsServerOplockBreak(ServerLockData *data);
+HgfsPlatformOplockRemoveNode(fileDesc fileDesc);
 
 void
-HgfsAckOplockBreak(ServerLockData *lockData,
+HgfsPlatformOplockRemoveSession(HgfsSessionInfo *session);
+
+HgfsLockType
+HgfsAckOplockBreak(fileDesc fileDesc,
                    HgfsLockType replyLock);
 
+/* Implemented by the common server code. */
+Bool
+HgfsServerOplockBreak(HgfsSessionInfo *session,
+                      HgfsHandle handle,
+                      HgfsLockType newLock);
+
 #endif
 
 #endif // ifndef _HGFS_SERVER_OPLOCKINT_H_
@@ -20,8 +20,18 @@
  * hgfsServerOplockLinux.c --
  *
  *      HGFS server opportunistic lock support for the Linux platform.
+ *
+ *      Oplocks are kernel file leases. A break of a lease is signalled with
+ *      HGFS_LEASE_SIGNAL, directed at a dedicated thread which reads it from
+ *      a signalfd, so no signal handler is involved. The leases are indexed
+ *      by file descriptor, and each one holds a reference on its session and
+ *      knows the hgfs handle of its file. The break is sent to the client
+ *      from the main loop, as directory notifications are. If the client
+ *      does not acknowledge it within HGFS_OPLOCK_BREAK_TIMEOUT_MS, the
+ *      server releases the lease itself.
  */
 
+#define _GNU_SOURCE // for F_SETSIG, F_SETOWN_EX
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -30,45 +40,627 @@
 
 #include "vmware.h"
 #include "hgfsServerInt.h"
+#include "hgfsServerOplock.h"
 #include "hgfsServerOplockInt.h"
 
+#define LOGLEVEL_MODULE hgfs
+#include "loglevel_user.h"
+
 #ifdef HGFS_OPLOCKS
+#   include <fcntl.h>
 #   include <signal.h>
-#   include "sig.h"
+#   include <unistd.h>
+#   include <pthread.h>
+#   include <time.h>
+#   include <sys/poll.h>
+#   include <sys/signalfd.h>
+#   include <sys/syscall.h>
+#   include <glib.h>
+#   include "hashTable.h"
+#   include "userlock.h"
+#   include "mutexRankLib.h"
+#   include "util.h"
 #endif
 
 
+#ifdef HGFS_OPLOCKS
 /*
  * Local data
  */
 
-/*
- * Global data
- */
+/* Signal the kernel sends when a lease must be broken. */
+#define HGFS_LEASE_SIGNAL        (SIGRTMIN + 4)
+
+#define HGFS_LEASE_BUCKETS       64
+
+typedef struct HgfsLease {
+   fileDesc fileDesc;
+   uint64 id;                 // Tells apart the leases of a reused fd
+   HgfsSessionInfo *session;  // Referenced
+   HgfsHandle handle;
+   Bool handleValid;          // Node is cached, handle is known
+   HgfsLockType serverLock;   // Lease the server holds
+   HgfsLockType breakLock;    // Lease a pending break downgrades to
+   Bool breaking;             // Break pending
+   Bool breakSent;            // Break sent to the client
+   uint64 breakStart;         // When the kernel asked for the break, in ms
+} HgfsLease;
+
+/* Work found by the lease thread, done by the main loop. */
+typedef struct HgfsLeaseAction {
+   fileDesc fileDesc;
+   uint64 leaseId;
+   HgfsSessionInfo *session;  // Referenced
+   HgfsHandle handle;
+   HgfsLockType lock;
+   Bool sendBreak;            // Send a break, else update the node's lock
+} HgfsLeaseAction;
+
+static struct {
+   MXUserExclLock *lock;
+   HashTable *leases;         // fd -> HgfsLease
+   uint64 nextId;
+   HgfsLeaseAction *actions;  // For the main loop
+   size_t numActions;
+   guint actionSource;
+   int sigFd;
+   int wakeFds[2];
+   pthread_t thread;
+   pid_t threadId;
+   Bool threadStarted;
+   pthread_mutex_t startLock;
+   pthread_cond_t startCond;
+   uint64 numBreaks;
+   uint64 numTimeouts;
+   uint64 totalBreakMs;
+   uint64 maxBreakMs;
+} gOplock = {
+   NULL, NULL, 0, NULL, 0, 0, -1, { -1, -1 }, 0, 0, FALSE,
+   PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+};
 
 
 /*
  * Local functions
  */
 
-#ifdef HGFS_OPLOCKS
-static void HgfsServerSigOplockBreak(int sigNum,
-                                     siginfo_t *info,
-                                     ucontext_t *u,
-                                     void *clientData);
+static void *HgfsOplockThread(void *data);
 #endif
 
 
 
+#ifdef HGFS_OPLOCKS
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsOplockTimeMS --
+ *
+ *      Reads the monotonic clock.
+ *
+ * Results:
+ *      Time in milliseconds.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+HgfsOplockTimeMS(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsOplockWake --
+ *
+ *      Wakes up the lease thread.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsOplockWake(char reason) // IN: 'q' to stop the thread, 's' to scan
+{
+   while (write(gOplock.wakeFds[1], &reason, 1) < 0 && errno == EINTR) {
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsOplockRemoveLocked --
+ *
+ *      Takes the lease of a file out of the index.
+ *
+ *      Called with the lock held.
+ *
+ * Results:
+ *      The lease, to free with HgfsOplockFreeLease() once the lock is
+ *      released; NULL if the file has none.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsLease *
+HgfsOplockRemoveLocked(fileDesc fileDesc) // IN:
+{
+   HgfsLease *lease;
+
+   if (!HashTable_Lookup(gOplock.leases, (void *)(uintptr_t)fileDesc,
+                         (void **)&lease)) {
+      return NULL;
+   }
+   HashTable_Delete(gOplock.leases, (void *)(uintptr_t)fileDesc);
+   return lease;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsOplockFreeLease --
+ *
+ *      Frees a lease taken out of the index, and drops its reference on the
+ *      session, which may tear the session down: must not be called with the
+ *      lock held.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsOplockFreeLease(HgfsLease *lease) // IN:
+{
+   if (lease != NULL) {
+      HgfsServerSessionPut(lease->session);
+      free(lease);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsOplockAckLocked --
+ *
+ *      Downgrades or releases a lease once the client holds replyLock, or
+ *      when the break could not be completed with the client. A lease is
+ *      only downgraded to a read lease if the pending break allows it.
+ *
+ *      Called with the lock held.
+ *
+ * Results:
+ *      The lease the server now holds.
+ *
+ * Side effects:
+ *      Completes the break in the kernel, which lets the conflicting open
+ *      proceed.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsLockType
+HgfsOplockAckLocked(HgfsLease *lease,       // IN/OUT:
+                    HgfsLockType replyLock) // IN: lock the client holds
+{
+   HgfsLockType newLock;
+
+   if (!lease->breaking && replyLock == lease->serverLock) {
+      return lease->serverLock;
+   }
+
+   if (replyLock == HGFS_LOCK_SHARED &&
+       (lease->breaking ? lease->breakLock == HGFS_LOCK_SHARED :
+                          lease->serverLock == HGFS_LOCK_EXCLUSIVE) &&
+       fcntl(lease->fileDesc, F_SETLEASE, F_RDLCK) == 0) {
+      newLock = HGFS_LOCK_SHARED;
+   } else {
+      if (fcntl(lease->fileDesc, F_SETLEASE, F_UNLCK) == -1) {
+         int error = errno;
+         Log("%s: Could not break lease on fd %d: %s\n",
+             __FUNCTION__, lease->fileDesc, strerror(error));
+      }
+      newLock = HGFS_LOCK_NONE;
+   }
+
+   if (lease->breaking) {
+      uint64 elapsed = HgfsOplockTimeMS() - lease->breakStart;
+
+      gOplock.totalBreakMs += elapsed;
+      gOplock.maxBreakMs = MAX(gOplock.maxBreakMs, elapsed);
+      LOG(4, ("%s: break on fd %d done in %"FMT64"u ms (%"FMT64"u breaks, "
+              "%"FMT64"u timed out, avg %"FMT64"u ms, max %"FMT64"u ms)\n",
+              __FUNCTION__, lease->fileDesc, elapsed, gOplock.numBreaks,
+              gOplock.numTimeouts, gOplock.totalBreakMs / gOplock.numBreaks,
+              gOplock.maxBreakMs));
+   }
+
+   lease->serverLock = newLock;
+   lease->breaking = FALSE;
+   lease->breakSent = FALSE;
+   return newLock;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsOplockStartBreak --
+ *
+ *      The kernel asks to break the lease on a file. Find out what the lease
+ *      must be downgraded to and mark the break pending.
+ *
+ *      Called with the lock held.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsOplockStartBreak(HgfsLease *lease) // IN/OUT:
+{
+   int newLease;
+
+   if (lease->breaking) {
+      return;
+   }
+
+   /*
+    * According to locks.c in kernel source, doing F_GETLEASE when a lease
+    * break is pending will return the new lease we should use. It'll be
+    * F_RDLCK if we can downgrade, or F_UNLCK if we should break altogether.
+    */
+   newLease = fcntl(lease->fileDesc, F_GETLEASE);
+   if (newLease == F_UNLCK) {
+      lease->breakLock = HGFS_LOCK_NONE;
+   } else if (newLease == F_RDLCK && lease->serverLock == HGFS_LOCK_EXCLUSIVE) {
+      lease->breakLock = HGFS_LOCK_SHARED;
+   } else {
+      /* No break pending: a stale signal, or a scan after an overflow. */
+      return;
+   }
+
+   LOG(4, ("%s: break of lease on fd %d to %d\n", __FUNCTION__,
+           lease->fileDesc, lease->breakLock));
+   lease->breaking = TRUE;
+   lease->breakSent = FALSE;
+   lease->breakStart = HgfsOplockTimeMS();
+   gOplock.numBreaks++;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsOplockRunActions --
+ *
+ *      Main loop callback: sends the breaks the lease thread found, and
+ *      updates the file nodes of the leases it released. A break is dropped
+ *      if its lease went away meanwhile.
+ *
+ * Results:
+ *      FALSE, to run once.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+HgfsOplockRunActions(gpointer data) // IN: unused
+{
+   HgfsLeaseAction *actions;
+   size_t numActions;
+   size_t i;
+
+   MXUser_AcquireExclLock(gOplock.lock);
+   actions = gOplock.actions;
+   numActions = gOplock.numActions;
+   gOplock.actions = NULL;
+   gOplock.numActions = 0;
+   gOplock.actionSource = 0;
+   MXUser_ReleaseExclLock(gOplock.lock);
+
+   for (i = 0; i < numActions; i++) {
+      HgfsLeaseAction *action = &actions[i];
+      HgfsLease *lease = NULL;
+      Bool current;
+
+      MXUser_AcquireExclLock(gOplock.lock);
+      current = HashTable_Lookup(gOplock.leases,
+                                 (void *)(uintptr_t)action->fileDesc,
+                                 (void **)&lease) &&
+                lease->id == action->leaseId;
+      MXUser_ReleaseExclLock(gOplock.lock);
+
+      if (action->sendBreak) {
+         if (!current) {
+            LOG(4, ("%s: lease on fd %d gone, break not sent\n", __FUNCTION__,
+                    action->fileDesc));
+         } else if (!HgfsServerOplockBreak(action->session, action->handle,
+                                           action->lock)) {
+            LOG(4, ("%s: could not send break for fd %d, breaking locally\n",
+                    __FUNCTION__, action->fileDesc));
+            action->lock = HgfsAckOplockBreak(action->fileDesc,
+                                              HGFS_LOCK_NONE);
+            HgfsUpdateNodeServerLock(action->fileDesc, action->session,
+                                     action->lock);
+         }
+      } else if (current || lease == NULL) {
+         /* Unless the fd was reused for another leased file. */
+         HgfsUpdateNodeServerLock(action->fileDesc, action->session,
+                                  action->lock);
+      }
+      HgfsServerSessionPut(action->session);
+   }
+
+   free(actions);
+   return FALSE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsOplockScan --
+ *
+ *      Goes through the leases: starts the breaks the kernel asks for,
+ *      releases the leases whose break timed out, and has the main loop send
+ *      the pending breaks to the clients and update the file nodes.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsOplockScan(Bool checkAll) // IN: look for breaks on all leases
+{
+   HgfsLease **expired;
+   size_t numExpired = 0;
+   void **leases;
+   size_t numLeases;
+   uint64 now = HgfsOplockTimeMS();
+   size_t i;
+
+   MXUser_AcquireExclLock(gOplock.lock);
+
+   HashTable_ToArray(gOplock.leases, &leases, &numLeases);
+   expired = Util_SafeMalloc((numLeases + 1) * sizeof *expired);
+   gOplock.actions = Util_SafeRealloc(gOplock.actions,
+                                      (gOplock.numActions + numLeases + 1) *
+                                      sizeof *gOplock.actions);
+
+   for (i = 0; i < numLeases; i++) {
+      HgfsLease *lease = leases[i];
+      HgfsLeaseAction *action = &gOplock.actions[gOplock.numActions];
+
+      if (checkAll) {
+         HgfsOplockStartBreak(lease);
+      }
+      if (!lease->breaking) {
+         continue;
+      }
+
+      action->fileDesc = lease->fileDesc;
+      action->leaseId = lease->id;
+      action->session = lease->session;
+      action->handle = lease->handle;
+
+      if (now - lease->breakStart >= HGFS_OPLOCK_BREAK_TIMEOUT_MS) {
+         Log("%s: client did not acknowledge the break on fd %d in %u ms\n",
+             __FUNCTION__, lease->fileDesc, HGFS_OPLOCK_BREAK_TIMEOUT_MS);
+         gOplock.numTimeouts++;
+         action->lock = HgfsOplockAckLocked(lease, HGFS_LOCK_NONE);
+         action->sendBreak = FALSE;
+         expired[numExpired++] = HgfsOplockRemoveLocked(lease->fileDesc);
+      } else if (!lease->breakSent && lease->handleValid) {
+         lease->breakSent = TRUE;
+         action->lock = lease->breakLock;
+         action->sendBreak = TRUE;
+      } else {
+         continue;
+      }
+
+      /* The lease holds a reference: the session is still there. */
+      HgfsServerSessionGet(action->session);
+      gOplock.numActions++;
+   }
+
+   if (gOplock.numActions > 0 && gOplock.actionSource == 0) {
+      gOplock.actionSource = g_idle_add(HgfsOplockRunActions, NULL);
+   }
+
+   MXUser_ReleaseExclLock(gOplock.lock);
+
+   for (i = 0; i < numExpired; i++) {
+      HgfsOplockFreeLease(expired[i]);
+   }
+
+   free(expired);
+   free(leases);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsOplockNextTimeout --
+ *
+ *      Computes how long the lease thread may sleep before a pending break
+ *      times out.
+ *
+ * Results:
+ *      Timeout in ms for poll(), -1 if no break is pending.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+HgfsOplockNextTimeout(void)
+{
+   uint64 now = HgfsOplockTimeMS();
+   void **leases;
+   size_t numLeases;
+   int timeout = -1;
+   size_t i;
+
+   MXUser_AcquireExclLock(gOplock.lock);
+   HashTable_ToArray(gOplock.leases, &leases, &numLeases);
+   for (i = 0; i < numLeases; i++) {
+      HgfsLease *lease = leases[i];
+      uint64 deadline = lease->breakStart + HGFS_OPLOCK_BREAK_TIMEOUT_MS;
+      int left;
+
+      if (!lease->breaking) {
+         continue;
+      }
+      left = (deadline > now) ? (int)(deadline - now) : 0;
+      timeout = (timeout < 0) ? left : MIN(timeout, left);
+   }
+   MXUser_ReleaseExclLock(gOplock.lock);
+
+   free(leases);
+   return timeout;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsOplockThread --
+ *
+ *      Lease thread: reads the lease break signals from the signalfd, and
+ *      times out the breaks the clients do not acknowledge.
+ *
+ *      The kernel sends the signal of each leased file to this thread only,
+ *      which has it blocked. If the queue of realtime signals overflows, the
+ *      kernel sends SIGIO instead, and all leases are checked.
+ *
+ * Results:
+ *      NULL.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void *
+HgfsOplockThread(void *data) // IN: unused
+{
+   pthread_mutex_lock(&gOplock.startLock);
+   gOplock.threadId = syscall(SYS_gettid);
+   pthread_cond_signal(&gOplock.startCond);
+   pthread_mutex_unlock(&gOplock.startLock);
+
+   for (;;) {
+      struct pollfd fds[2];
+      Bool checkAll = FALSE;
+      int ret;
+
+      fds[0].fd = gOplock.sigFd;
+      fds[0].events = POLLIN;
+      fds[1].fd = gOplock.wakeFds[0];
+      fds[1].events = POLLIN;
+
+      ret = poll(fds, ARRAYSIZE(fds), HgfsOplockNextTimeout());
+      if (ret < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         Log("%s: poll failed: %s\n", __FUNCTION__, strerror(errno));
+         break;
+      }
+
+      if (fds[1].revents != 0) {
+         char reasons[16];
+         ssize_t len = read(gOplock.wakeFds[0], reasons, sizeof reasons);
+
+         if (len > 0 && memchr(reasons, 'q', len) != NULL) {
+            break;
+         }
+      }
+
+      if (fds[0].revents != 0) {
+         struct signalfd_siginfo info[16];
+         ssize_t len;
+
+         while ((len = read(gOplock.sigFd, info, sizeof info)) > 0) {
+            size_t n = len / sizeof info[0];
+            size_t i;
+
+            MXUser_AcquireExclLock(gOplock.lock);
+            for (i = 0; i < n; i++) {
+               HgfsLease *lease;
+
+               if (info[i].ssi_signo == SIGIO) {
+                  LOG(4, ("%s: lease signals overflowed\n", __FUNCTION__));
+                  checkAll = TRUE;
+               } else if (HashTable_Lookup(gOplock.leases,
+                                           (void *)(uintptr_t)info[i].ssi_fd,
+                                           (void **)&lease)) {
+                  HgfsOplockStartBreak(lease);
+               }
+            }
+            MXUser_ReleaseExclLock(gOplock.lock);
+         }
+      }
+
+      HgfsOplockScan(checkAll);
+   }
+
+   return NULL;
+}
+#endif
+
+
 /*
  *-----------------------------------------------------------------------------
  *
  * HgfsPlatformOplockInit --
  *
- *      Set up any state needed to start Linux HGFS server oplock support.
+ *      Set up any state needed to start Linux HGFS server oplock support:
+ *      the lease index and the thread that handles lease breaks.
  *
  * Results:
- *      TRUE always.
+ *      TRUE on success, FALSE if the lease thread could not be started.
  *
  * Side effects:
  *      None.
@@ -80,8 +672,46 @@ Bool
 HgfsPlatformOplockInit(void)
 {
 #ifdef HGFS_OPLOCKS
-   /* Register a signal handler to catch oplock break signals. */
-   Sig_Callback(SIGIO, SIG_SAFE, HgfsServerSigOplockBreak, NULL);
+   sigset_t mask;
+   sigset_t oldMask;
+   int error;
+
+   sigemptyset(&mask);
+   sigaddset(&mask, HGFS_LEASE_SIGNAL);
+   sigaddset(&mask, SIGIO);
+
+   gOplock.sigFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+   if (gOplock.sigFd < 0) {
+      Log("%s: signalfd failed: %s\n", __FUNCTION__, strerror(errno));
+      return FALSE;
+   }
+   if (pipe(gOplock.wakeFds) != 0) {
+      Log("%s: pipe failed: %s\n", __FUNCTION__, strerror(errno));
+      close(gOplock.sigFd);
+      gOplock.sigFd = -1;
+      return FALSE;
+   }
+
+   gOplock.lock = MXUser_CreateExclLock("hgfsOplockLock", RANK_hgfsOplockLock);
+   gOplock.leases = HashTable_Alloc(HGFS_LEASE_BUCKETS, HASH_INT_KEY, NULL);
+
+   /* The thread inherits the mask: the signals stay queued for the signalfd. */
+   pthread_sigmask(SIG_BLOCK, &mask, &oldMask);
+   error = pthread_create(&gOplock.thread, NULL, HgfsOplockThread, NULL);
+   pthread_sigmask(SIG_SETMASK, &oldMask, NULL);
+   if (error != 0) {
+      Log("%s: cannot start the lease thread: %s\n", __FUNCTION__,
+          strerror(error));
+      HgfsPlatformOplockDestroy();
+      return FALSE;
+   }
+
+   pthread_mutex_lock(&gOplock.startLock);
+   while (gOplock.threadId == 0) {
+      pthread_cond_wait(&gOplock.startCond, &gOplock.startLock);
+   }
+   pthread_mutex_unlock(&gOplock.startLock);
+   gOplock.threadStarted = TRUE;
 #endif
    return TRUE;
 }
@@ -92,7 +722,9 @@ HgfsPlatformOplockInit(void)
  *
  * HgfsPlatformOplockDestroy --
  *
- *      Tear down any state used for Linux HGFS server.
+ *      Tear down any state used for Linux HGFS server: stop the lease thread,
+ *      drop the work left for the main loop and forget the leases. The files
+ *      are closed by the node cache.
  *
  * Results:
  *      None.
@@ -107,8 +739,49 @@ void
 HgfsPlatformOplockDestroy(void)
 {
 #ifdef HGFS_OPLOCKS
-   /* Tear down oplock state, so we no longer catch signals. */
-   Sig_Callback(SIGIO, SIG_NOHANDLER, NULL, NULL);
+   if (gOplock.threadStarted) {
+      HgfsOplockWake('q');
+      pthread_join(gOplock.thread, NULL);
+      gOplock.threadStarted = FALSE;
+      gOplock.threadId = 0;
+   }
+
+   if (gOplock.actionSource != 0) {
+      g_source_remove(gOplock.actionSource);
+      gOplock.actionSource = 0;
+   }
+   while (gOplock.numActions > 0) {
+      HgfsServerSessionPut(gOplock.actions[--gOplock.numActions].session);
+   }
+   free(gOplock.actions);
+   gOplock.actions = NULL;
+
+   if (gOplock.leases != NULL) {
+      void **leases;
+      size_t numLeases;
+      size_t i;
+
+      HashTable_ToArray(gOplock.leases, &leases, &numLeases);
+      HashTable_Free(gOplock.leases);
+      gOplock.leases = NULL;
+      for (i = 0; i < numLeases; i++) {
+         HgfsOplockFreeLease(leases[i]);
+      }
+      free(leases);
+   }
+   if (gOplock.lock != NULL) {
+      MXUser_DestroyExclLock(gOplock.lock);
+      gOplock.lock = NULL;
+   }
+   if (gOplock.wakeFds[0] >= 0) {
+      close(gOplock.wakeFds[0]);
+      close(gOplock.wakeFds[1]);
+      gOplock.wakeFds[0] = gOplock.wakeFds[1] = -1;
+   }
+   if (gOplock.sigFd >= 0) {
+      close(gOplock.sigFd);
+      gOplock.sigFd = -1;
+   }
 #endif
 }
 
@@ -122,6 +795,10 @@ HgfsPlatformOplockDestroy(void)
  *    lease desired, but if the client asked for HGFS_LOCK_OPPORTUNISTIC, we'll
  *    take the "best" lease we can get.
  *
+ *    Only clients that negotiated oplocks for their session can be sent a
+ *    break, so only they get one. The lease holds a reference on the session
+ *    until it is forgotten, or the session is closed.
+ *
  * Results:
  *    TRUE on success. serverLock contains the type of the lock acquired.
  *    FALSE on failure. serverLock is HGFS_LOCK_NONE.
@@ -141,7 +818,10 @@ HgfsAcquireServerLock(fileDesc fileDesc,            // IN: OS handle
                       HgfsLockType *serverLock)     // IN/OUT: Oplock asked for/granted
 {
 #ifdef HGFS_OPLOCKS
+   struct f_owner_ex owner;
    HgfsLockType desiredLock;
+   HgfsLease *lease;
+   HgfsLease *oldLease;
    int leaseType, error;
 
    ASSERT(serverLock);
@@ -153,21 +833,24 @@ HgfsAcquireServerLock(fileDesc fileDesc,            // IN: OS handle
       return TRUE;
    }
 
-   if (!HgfsIsServerLockAllowed(session)) {
+   if (!gOplock.threadStarted ||
+       (session->flags & HGFS_SESSION_OPLOCK_ENABLED) == 0 ||
+       !HgfsIsServerLockAllowed(session)) {
       return FALSE;
    }
 
    /*
-    * First tell the kernel which signal to send us. SIGIO is already the
-    * default, but if we skip this step, we won't get the siginfo_t when
-    * a lease break occurs.
-    *
-    * XXX: Do I need to do fcntl(fileDesc, F_SETOWN, getpid())?
+    * First tell the kernel which signal to send, and to which thread. With
+    * a realtime signal the siginfo_t carries the fd, and the signals are
+    * queued rather than merged.
     */
-   if (fcntl(fileDesc, F_SETSIG, SIGIO)) {
+   owner.type = F_OWNER_TID;
+   owner.pid = gOplock.threadId;
+   if (fcntl(fileDesc, F_SETSIG, HGFS_LEASE_SIGNAL) ||
+       fcntl(fileDesc, F_SETOWN_EX, &owner)) {
       error = errno;
-      Log("%s: Could not set SIGIO as the desired lease break signal for "
-          "fd %d: %s\n", __FUNCTION__, fileDesc, strerror(error));
+      Log("%s: Could not direct lease break signals for fd %d: %s\n",
+          __FUNCTION__, fileDesc, strerror(error));
 
       return FALSE;
    }
@@ -216,6 +899,32 @@ HgfsAcquireServerLock(fileDesc fileDesc,            // IN: OS handle
    LOG(4, ("%s: Got %s lease for fd %d\n", __FUNCTION__,
            leaseType == F_WRLCK ? "write" : "read", fileDesc));
    *serverLock = leaseType == F_WRLCK ? HGFS_LOCK_EXCLUSIVE : HGFS_LOCK_SHARED;
+
+   /* The handle is known once the file node is cached. */
+   lease = Util_SafeCalloc(1, sizeof *lease);
+   lease->fileDesc = fileDesc;
+   lease->session = session;
+   lease->serverLock = *serverLock;
+
+   /*
+    * A closed session has dropped its leases already, and must not get new
+    * ones: they would keep it from going away.
+    */
+   MXUser_AcquireExclLock(gOplock.lock);
+   if (session->state == HGFS_SESSION_STATE_CLOSED) {
+      MXUser_ReleaseExclLock(gOplock.lock);
+      fcntl(fileDesc, F_SETLEASE, F_UNLCK);
+      free(lease);
+      *serverLock = HGFS_LOCK_NONE;
+      return FALSE;
+   }
+   HgfsServerSessionGet(session);
+   lease->id = ++gOplock.nextId;
+   oldLease = HgfsOplockRemoveLocked(fileDesc);
+   HashTable_Insert(gOplock.leases, (void *)(uintptr_t)fileDesc, lease);
+   MXUser_ReleaseExclLock(gOplock.lock);
+
+   HgfsOplockFreeLease(oldLease);
    return TRUE;
 #else
    return FALSE;
@@ -227,151 +936,186 @@ HgfsAcquireServerLock(fileDesc fileDesc,            // IN: OS handle
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsAckOplockBreak --
- *
- *    Platform-dependent implementation of oplock break acknowledgement.
- *    This function gets called when the oplock break rpc command is completed.
- *    The rpc oplock break command (HgfsServerOplockBreak) is in hgfsServer.c
+ * HgfsPlatformOplockAddNode --
  *
- *    On Linux, we use fcntl() to downgrade the lease. Then we update the node
- *    cache, free the clientData, and call it a day.
+ *    The file node of a leased file is cached under an hgfs handle. A break
+ *    that came before is sent now, by the lease thread.
  *
  * Results:
- *    None
+ *    None.
  *
  * Side effects:
- *    None
+ *    None.
  *
  *-----------------------------------------------------------------------------
  */
 
 void
-HgfsAckOplockBreak(ServerLockData *lockData, // IN: server lock info
-                   HgfsLockType replyLock)   // IN: client has this lock
+HgfsPlatformOplockAddNode(fileDesc fileDesc,  // IN: OS handle
+                          HgfsHandle handle)  // IN: Hgfs file handle
 {
-   int fileDesc, newLock;
-   HgfsLockType actualLock;
+   HgfsLease *lease;
+   Bool wake = FALSE;
 
-   ASSERT(lockData);
-   fileDesc = lockData->fileDesc;
-   LOG(4, ("%s: Acknowledging break on fd %d\n", __FUNCTION__, fileDesc));
+   if (!gOplock.threadStarted) {
+      return;
+   }
 
-   /*
-    * The Linux server supports lock downgrading. We only downgrade to a shared
-    * lock if our previous call to fcntl() said we could, and if the client
-    * wants to downgrade to a shared lock. Otherwise, we break altogether.
-    */
-   if (lockData->serverLock == HGFS_LOCK_SHARED &&
-       replyLock == HGFS_LOCK_SHARED) {
-      newLock = F_RDLCK;
-      actualLock = replyLock;
-   } else {
-      newLock = F_UNLCK;
-      actualLock = HGFS_LOCK_NONE;
+   MXUser_AcquireExclLock(gOplock.lock);
+   if (HashTable_Lookup(gOplock.leases, (void *)(uintptr_t)fileDesc,
+                        (void **)&lease)) {
+      lease->handle = handle;
+      lease->handleValid = TRUE;
+      wake = lease->breaking;
    }
+   MXUser_ReleaseExclLock(gOplock.lock);
 
-   /* Downgrade or acknowledge the break altogether. */
-   if (fcntl(fileDesc, F_SETLEASE, newLock) == -1) {
-      int error = errno;
-      Log("%s: Could not break lease on fd %d: %s\n",
-          __FUNCTION__, fileDesc, strerror(error));
+   if (wake) {
+      HgfsOplockWake('s');
    }
+}
 
-   /* Cleanup. */
-   HgfsUpdateNodeServerLock(fileDesc, actualLock);
-   free(lockData);
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformOplockRemoveNode --
+ *
+ *    The leased file is about to be closed, which releases the lease: forget
+ *    it, and drop its session reference.
+ *
+ *    The caller holds a reference on the session, so it is not the last
+ *    one.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsPlatformOplockRemoveNode(fileDesc fileDesc)  // IN: OS handle
+{
+   HgfsLease *lease;
+
+   if (!gOplock.threadStarted) {
+      return;
+   }
+
+   MXUser_AcquireExclLock(gOplock.lock);
+   lease = HgfsOplockRemoveLocked(fileDesc);
+   MXUser_ReleaseExclLock(gOplock.lock);
+
+   HgfsOplockFreeLease(lease);
 }
 
 
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsServerSigOplockBreak --
+ * HgfsPlatformOplockRemoveSession --
+ *
+ *    A session is closed: release the leases of its files and forget them.
+ *    Breaks in progress complete right away, since the client will not
+ *    acknowledge them. The files themselves are closed when the session
+ *    goes away, which the references of the leases no longer hold up.
  *
- *      Handle a pending oplock break. Called from the VMX poll loop context.
- *      All we really do is set up the state for an oplock break and call
- *      HgfsServerOplockBreak which will do the rest of the work.
+ *    The caller holds a reference on the session.
  *
  * Results:
- *      None.
+ *    None.
  *
  * Side effects:
- *      None.
+ *    None.
  *
  *-----------------------------------------------------------------------------
  */
 
-static void
-HgfsServerSigOplockBreak(int sigNum,       // IN: Signal number
-                         siginfo_t *info,  // IN: Additional info about signal
-                         ucontext_t *u,    // IN: Interrupted context (regs etc)
-                         void *clientData) // IN: Ignored
+void
+HgfsPlatformOplockRemoveSession(HgfsSessionInfo *session)  // IN: session info
 {
-   ServerLockData *lockData;
-   int newLease, fd;
-   HgfsLockType newServerLock;
+   HgfsLease **removed;
+   size_t numRemoved = 0;
+   void **leases;
+   size_t numLeases;
+   size_t i;
 
-   ASSERT(sigNum == SIGIO);
-   ASSERT(info);
-   ASSERT(clientData == NULL);
+   if (!gOplock.threadStarted) {
+      return;
+   }
 
-   fd = info->si_fd;
-   LOG(4, ("%s: Received SIGIO for fd %d\n", __FUNCTION__, fd));
+   MXUser_AcquireExclLock(gOplock.lock);
+   HashTable_ToArray(gOplock.leases, &leases, &numLeases);
+   removed = Util_SafeMalloc((numLeases + 1) * sizeof *removed);
+   for (i = 0; i < numLeases; i++) {
+      HgfsLease *lease = leases[i];
 
-   /*
-    * We've got all we need from the signal handler, let it continue handling
-    * signals of this type.
-    */
-   Sig_Continue(sigNum);
+      if (lease->session == session) {
+         HgfsOplockAckLocked(lease, HGFS_LOCK_NONE);
+         removed[numRemoved++] = HgfsOplockRemoveLocked(lease->fileDesc);
+      }
+   }
+   MXUser_ReleaseExclLock(gOplock.lock);
 
-   /*
-    * According to locks.c in kernel source, doing F_GETLEASE when a lease
-    * break is pending will return the new lease we should use. It'll be
-    * F_RDLCK if we can downgrade, or F_UNLCK if we should break altogether.
-    */
-   newLease = fcntl(fd, F_GETLEASE);
-   if (newLease == F_RDLCK) {
-      newServerLock = HGFS_LOCK_SHARED;
-   } else if (newLease == F_UNLCK) {
-      newServerLock = HGFS_LOCK_NONE;
-   } else if (newLease == -1) {
-      int error = errno;
-      Log("%s: Could not get old lease for fd %d: %s\n", __FUNCTION__,
-          fd, strerror(error));
-      goto error;
-   } else {
-      Log("%s: Unexpected reply to get lease for fd %d: %d\n",
-          __FUNCTION__, fd, newLease);
-      goto error;
+   LOG(4, ("%s: released %"FMTSZ"u leases\n", __FUNCTION__, numRemoved));
+   for (i = 0; i < numRemoved; i++) {
+      HgfsOplockFreeLease(removed[i]);
    }
+   free(removed);
+   free(leases);
+}
 
-   /*
-    * Setup a ServerLockData struct so that we can make use of
-    * HgfsServerOplockBreak which does the heavy lifting of discovering which
-    * HGFS handle we're interested in breaking, sending the break, receiving
-    * the acknowledgement, and firing the platform-specific acknowledgement
-    * function (where we'll downgrade the lease).
-    */
-   lockData = malloc(sizeof *lockData);
-   if (lockData) {
-      lockData->fileDesc = fd;
-      lockData->serverLock = newServerLock;
-      lockData->event = 0; // not needed
 
-      /*
-       * Relinquish control of this data. It'll get freed later, when the RPC
-       * command completes.
-       */
-      HgfsServerOplockBreak(lockData);
-      return;
-   } else {
-      Log("%s: Could not allocate memory for lease break on behalf of fd %d\n",
-          __FUNCTION__, fd);
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsAckOplockBreak --
+ *
+ *    Platform-dependent implementation of oplock break acknowledgement.
+ *    This function gets called when the client acknowledges the oplock
+ *    break, or when the break could not be sent to it.
+ *
+ *    On Linux, we use fcntl() to downgrade the lease. The lease is forgotten
+ *    once it is released, which drops its session reference; the caller
+ *    holds another one.
+ *
+ * Results:
+ *    The lock the server now holds on the file.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsLockType
+HgfsAckOplockBreak(fileDesc fileDesc,       // IN: OS handle
+                   HgfsLockType replyLock)  // IN: client has this lock
+{
+   HgfsLockType newLock = HGFS_LOCK_NONE;
+   HgfsLease *lease;
+   HgfsLease *released = NULL;
+
+   LOG(4, ("%s: Acknowledging break on fd %d\n", __FUNCTION__, fileDesc));
+
+   if (!gOplock.threadStarted) {
+      return HGFS_LOCK_NONE;
+   }
+
+   MXUser_AcquireExclLock(gOplock.lock);
+   if (HashTable_Lookup(gOplock.leases, (void *)(uintptr_t)fileDesc,
+                        (void **)&lease)) {
+      newLock = HgfsOplockAckLocked(lease, replyLock);
+      if (newLock == HGFS_LOCK_NONE) {
+         released = HgfsOplockRemoveLocked(fileDesc);
+      }
    }
+   MXUser_ReleaseExclLock(gOplock.lock);
 
-  error:
-   /* Clean up as best we can. */
-   fcntl(fd, F_SETLEASE, F_UNLCK);
-   HgfsUpdateNodeServerLock(fd, HGFS_LOCK_NONE);
+   HgfsOplockFreeLease(released);
+   return newLock;
 }
 #endif /* HGFS_OPLOCKS */
@@ -185,7 +185,8 @@ HgfsChannelPutServer(HgfsChannelServerData *serverInfo)   // IN/OUT: ref count
  *
  * HgfsChannelInitServer --
  *
- *      Initialize HGFS server and save the state.
+ *      Initialize HGFS server and save the state. Change notification is
+ *      enabled as the first application registering with the server asks.
  *
  * Results:
  *      TRUE if success, FALSE otherwise.
@@ -198,13 +199,20 @@ HgfsChannelPutServer(HgfsChannelServerData *serverInfo)   // IN/OUT: ref count
 
 static Bool
 HgfsChannelInitServer(HgfsServerMgrCallbacks *mgrCb,       // IN: server manager callbacks
+                      Bool notify,                         // IN: enable change notification
                       HgfsChannelServerData *serverInfo)   // IN/OUT: ref count
 {
    Bool result;
 
    ASSERT(NULL == serverInfo->serverCBTable);
 
-   Debug("%s: Initialize Hgfs server.\n", __FUNCTION__);
+   Debug("%s: Initialize Hgfs server, notify %d.\n", __FUNCTION__, notify);
+
+   if (notify) {
+      gHgfsGuestCfgSettings.flags |= HGFS_CONFIG_NOTIFY_ENABLED;
+   } else {
+      gHgfsGuestCfgSettings.flags &= ~HGFS_CONFIG_NOTIFY_ENABLED;
+   }
 
    /* If we have a new connection initialize the server session with default settings. */
    result = HgfsServer_InitState(&serverInfo->serverCBTable, &gHgfsGuestCfgSettings, mgrCb);
@@ -345,6 +353,7 @@ HgfsChannelPutChannel(HgfsChannelData *channel)   // IN/OUT: ref count
 static Bool
 HgfsChannelInitChannel(HgfsChannelData *channel,          // IN/OUT: channel object
                        HgfsServerMgrCallbacks *mgrCb,     // IN: server manager callbacks
+                       Bool notify,                       // IN: enable change notification
                        HgfsChannelServerData *serverInfo) // IN/OUT: server info
 {
    Bool result = TRUE;
@@ -362,7 +371,7 @@ HgfsChannelInitChannel(HgfsChannelData *channel,          // IN/OUT: channel obj
    channel->serverInfo = serverInfo;
    if (0 == serverInfoCount) {
       /* The HGFS server has not been initialized, do it now. */
-      result = HgfsChannelInitServer(mgrCb, channel->serverInfo);
+      result = HgfsChannelInitServer(mgrCb, notify, channel->serverInfo);
       if (!result) {
          Debug("%s: Could not init Hgfs server.\n", __FUNCTION__);
          goto exit;
@@ -619,7 +628,8 @@ HgfsChannelGuest_Init(HgfsServerMgrData *mgrData,    // IN/OUT: server manager d
    if (0 == channelRefCount) {
 
       /* Initialize channels objects. */
-      if (!HgfsChannelInitChannel(channel, mgrCb, &gHgfsChannelServerInfo)) {
+      if (!HgfsChannelInitChannel(channel, mgrCb, mgrData->notify,
+                                  &gHgfsChannelServerInfo)) {
          Debug("%s: Could not init channel.\n", __FUNCTION__);
          goto exit;
       }
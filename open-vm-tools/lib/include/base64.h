@@ -26,6 +26,21 @@
 #ifndef _BASE64_H
 #define _BASE64_H
 
+/*
+ * Implementations of the encoder and decoder. The best one the CPU supports
+ * is picked on first use; the others are there for tests and benchmarks.
+ */
+
+typedef enum Base64Codec {
+   BASE64_CODEC_SCALAR,
+   BASE64_CODEC_SSSE3,
+   BASE64_CODEC_AVX2,
+   BASE64_CODEC_AVX512VBMI,
+} Base64Codec;
+
+Base64Codec Base64_GetCodec(void);
+Bool Base64_SetCodec(Base64Codec codec);
+
 Bool Base64_Encode(uint8 const *src, size_t srcLength,
                    char *target, size_t targSize,
                    size_t *dataLength);
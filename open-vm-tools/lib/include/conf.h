@@ -103,6 +103,29 @@
  */
 #define CONFNAME_GUESTINFO_ENABLESTATLOGGING "enable-stat-logging"
 
+/**
+ * Interfaces to report first when the guest has more than the host accepts.
+ *
+ * @param string   Comma separated glob patterns of interface names.
+ */
+#define CONFNAME_GUESTINFO_PRIMARYNICS "primary-nics"
+
+/**
+ * Interfaces to report last when the guest has more than the host accepts.
+ * Defaults to the usual container and virtual network interfaces (veth*,
+ * cali*, docker*, ...).
+ *
+ * @param string   Comma separated glob patterns of interface names.
+ */
+#define CONFNAME_GUESTINFO_LOWPRIORITYNICS "low-priority-nics"
+
+/**
+ * Interfaces never to report.
+ *
+ * @param string   Comma separated glob patterns of interface names.
+ */
+#define CONFNAME_GUESTINFO_EXCLUDENICS "exclude-nics"
+
 /*
  * END GuestInfo goodies.
  ******************************************************************************
@@ -147,6 +170,59 @@
  */
 
 
+/*
+ ******************************************************************************
+ * BEGIN TimeSync goodies.
+ */
+
+/**
+ * Defines the string used for the TimeSync config file group.
+ */
+#define CONFGROUPNAME_TIMESYNC "timeSync"
+
+/**
+ * How the periodic time sync slews small errors.
+ *
+ * @param string  "slew" (default): slew part of the error each period, then
+ *                hand over to the kernel PLL once calibrated.
+ *                "filtered": median of several samples, driving the clock
+ *                frequency with a PI controller.
+ */
+#define CONFNAME_TIMESYNC_DISCIPLINE "discipline"
+#define CONFVAL_TIMESYNC_DISCIPLINE_SLEW "slew"
+#define CONFVAL_TIMESYNC_DISCIPLINE_FILTERED "filtered"
+
+/*
+ * END TimeSync goodies.
+ ******************************************************************************
+ */
+
+
+/*
+ ******************************************************************************
+ * BEGIN HGFS server goodies.
+ */
+
+/**
+ * Defines the string used for the HGFS server config file group.
+ */
+#define CONFGROUPNAME_HGFSSERVER "hgfsServer"
+
+/**
+ * Lets clients of the guest HGFS server subscribe to directory change
+ * notifications (Linux only, based on inotify). Read when the server starts.
+ *
+ * @param boolean Set to FALSE to disable. TRUE by default.
+ */
+#define CONFNAME_HGFSSERVER_NOTIFY "notify"
+#define CONFVAL_HGFSSERVER_NOTIFY_DEFAULT TRUE
+
+/*
+ * END HGFS server goodies.
+ ******************************************************************************
+ */
+
+
 /** Where to find Tools data in the Win32 registry. */
 #define CONF_VMWARE_TOOLS_REGKEY    "Software\\VMware, Inc.\\VMware Tools"
 
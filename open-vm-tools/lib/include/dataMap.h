@@ -34,6 +34,7 @@
 #define _DATA_MAP_H_
 
 #include "hashMap.h"
+#include "dynbuf.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -73,6 +74,9 @@ typedef enum {
 typedef struct {
    HashMap *map;
    uint64 cookie;   /* so we know the datamap is not some garbage data */
+   uint64 encodedLen; /* serialized size of all entries, excluding the
+                         leading packet length */
+   char *arena;     /* entries decoded by DataMap_DeserializeArena */
 } DataMap;
 
 typedef struct {
@@ -95,9 +99,17 @@ DataMap_Serialize(const DataMap *that,   //IN
                   char **buf,            // OUT
                   uint32 *bufLen);          // OUT
 ErrorCode
+DataMap_SerializeToDynBuf(const DataMap *that,  // IN
+                          DynBuf *buf);         // IN/OUT
+ErrorCode
 DataMap_Deserialize(const char *bufIn,     // IN
                     const int32 bufLen,    // IN
                     DataMap *that);        // OUT
+ErrorCode
+DataMap_DeserializeArena(const char *bufIn,     // IN
+                         const int32 bufLen,    // IN
+                         Bool borrowInput,      // IN
+                         DataMap *that);        // OUT
 
 ErrorCode
 DataMap_DeserializeContent(const char *bufIn,     // IN
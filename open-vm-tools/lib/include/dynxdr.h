@@ -30,6 +30,10 @@
  *    already available in the form of a pre-allocated buffer, in which
  *    case we can use the xdrmem_create() function.
  *
+ *    Code that encodes on a schedule can give each encode its size upfront
+ *    (DynXdr_CreateSized, DynXdr_SizeOf), or keep a DynBuf of its own and
+ *    encode into it (DynXdr_CreateWithBuf).
+ *
  *    Note: xdr_destroy() is a no-op for this stream. Use DynXdr_Destroy()
  *    instead. Also, XDR_SETPOS and XDR_INLINE are not supported.
  */
@@ -37,8 +41,12 @@
 #include <rpc/types.h>
 #include <rpc/xdr.h>
 #include "vm_basic_types.h"
+#include "dynbuf.h"
 
 XDR *DynXdr_Create(XDR *in);
+XDR *DynXdr_CreateSized(XDR *in, size_t sizeHint);
+XDR *DynXdr_CreateWithBuf(XDR *in, DynBuf *buf);
+size_t DynXdr_SizeOf(void *xdrProc, void *data);
 Bool DynXdr_AppendRaw(XDR *xdrs, const void *buf, size_t len);
 void *DynXdr_AllocGet(XDR *xdrs);
 void *DynXdr_Get(XDR *xdrs);
@@ -50,6 +50,8 @@ typedef struct GlibLogger {
    gboolean          addsTimestamp; /**< Output adds timestamp automatically. */
    GLogFunc          logfn;         /**< The function that writes to the output. */
    GDestroyNotify    dtor;          /**< Destructor. */
+   /** Suspends or resumes writing, writing out queued messages (optional). */
+   void            (*suspend)(gpointer logger, gboolean suspend);
 } GlibLogger;
 
 
@@ -57,7 +59,8 @@ GlibLogger *
 GlibUtils_CreateFileLogger(const char *path,
                            gboolean append,
                            guint maxSize,
-                           guint maxFiles);
+                           guint maxFiles,
+                           gboolean async);
 
 GlibLogger *
 GlibUtils_CreateStdLogger(void);
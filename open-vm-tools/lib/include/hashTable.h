@@ -56,6 +56,21 @@ typedef int (*HashTableForEachCallback)(const char *key,
 #define HASH_FLAG_MASK          (~HASH_TYPE_MASK)
 #define HASH_FLAG_ATOMIC        0x08    // thread-safe hash table
 #define HASH_FLAG_COPYKEY       0x10    // copy string key
+#define HASH_FLAG_STRONGHASH    0x20    // mix all the key bits
+#define HASH_FLAG_RESIZE        0x40    // grow, with HASH_FLAG_STRONGHASH
+
+/*
+ * Bucket occupancy, see HashTable_GetStats. probes is the number of key
+ * comparisons it takes to look up every element once.
+ */
+
+typedef struct HashTableStats {
+   size_t numBuckets;
+   size_t usedBuckets;
+   size_t maxChain;
+   size_t numElements;
+   uint64 probes;
+} HashTableStats;
 
 HashTable *
 HashTable_Alloc(uint32               numEntries,  // IN:
@@ -125,6 +140,10 @@ HashTable_KeyArray(const HashTable   *ht,     // IN:
 size_t
 HashTable_GetNumElements(const HashTable *ht);  // IN:
 
+void
+HashTable_GetStats(const HashTable *ht,     // IN:
+                   HashTableStats  *stats); // OUT:
+
 int
 HashTable_ForEach(const HashTable          *ht,           // IN:
                   HashTableForEachCallback  cb,           // IN:
@@ -42,6 +42,7 @@ typedef struct HgfsServerMgrData {
    void        *rpc;             // RpcChannel unused
    void        *rpcCallback;     // RpcChannelCallback unused
    void        *connection;      // Connection object returned on success
+   Bool        notify;           // Enable change notification (first app)
 } HgfsServerMgrData;
 
 
@@ -51,6 +52,7 @@ typedef struct HgfsServerMgrData {
       (mgr)->rpc           = (_rpc);                               \
       (mgr)->rpcCallback   = (_rpcCallback);                       \
       (mgr)->connection    = NULL;                                 \
+      (mgr)->notify        = FALSE;                                \
    } while (0)
 
 Bool HgfsServerManager_Register(HgfsServerMgrData *data);
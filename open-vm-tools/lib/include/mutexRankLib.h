@@ -59,6 +59,7 @@
 #define RANK_hgfsFileIOLock          (RANK_libLockBase + 0x4050)
 #define RANK_hgfsSearchArrayLock     (RANK_libLockBase + 0x4060)
 #define RANK_hgfsNodeArrayLock       (RANK_libLockBase + 0x4070)
+#define RANK_hgfsOplockLock          (RANK_libLockBase + 0x4080)
 
 /*
  * vigor (must be < VMDB range and < disklib, see bug 741290)
@@ -35,6 +35,9 @@ Bool GuestInfo_GetFqdn(int outBufLen, char fqdn[]);
 Bool GuestInfo_GetNicInfo(NicInfoV3 **nicInfo);
 void GuestInfo_FreeNicInfo(NicInfoV3 *nicInfo);
 char *GuestInfo_GetPrimaryIP(void);
+void GuestInfo_SetNicRules(const char *primary, const char *lowPriority,
+                           const char *exclude);
+void GuestInfo_SetNicRulesFromConfig(GKeyFile *config);
 
 /*
  * Comparison routines -- handy for caching, unit testing.
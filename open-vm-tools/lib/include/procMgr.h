@@ -62,6 +62,9 @@ typedef struct ProcMgrProcInfo {
    Bool procDebugged;
 #endif
    time_t procStartTime;
+#if defined(__linux__)
+   uint64 procStartTicks;         // start time in clock ticks since boot
+#endif
 } ProcMgrProcInfo;
 
 DEFINE_DYNARRAY_TYPE(ProcMgrProcInfo);
@@ -134,6 +137,10 @@ typedef int Selectable;
 #endif
 
 ProcMgrProcInfoArray *ProcMgr_ListProcesses(void);
+ProcMgrProcInfoArray *ProcMgr_ListProcessesForPids(size_t numPids,
+                                                   const ProcMgr_Pid *pids);
+ProcMgrProcInfoArray *
+ProcMgr_ListProcessesIncremental(ProcMgrProcInfoArray *prevList);
 void ProcMgr_FreeProcList(ProcMgrProcInfoArray *procList);
 Bool ProcMgr_KillByPid(ProcMgr_Pid procId);
 
@@ -48,9 +48,23 @@ typedef enum {
    SYNCDRIVER_ERROR
 } SyncDriverStatus;
 
+/*
+ * Flags for SyncDriver_FreezeEx().
+ *
+ * SYNCDRIVER_FREEZE_PARALLEL_SYNC: flush all file systems concurrently with
+ * syncfs() before freezing them one by one, so that each freeze has little
+ * left to write.
+ */
+#define SYNCDRIVER_FREEZE_PARALLEL_SYNC   0x1
+
 Bool SyncDriver_Init(void);
 Bool SyncDriver_Freeze(const char *drives, Bool enableNullDriver,
                        SyncDriverHandle *handle);
+#if !defined(_WIN32)
+Bool SyncDriver_FreezeEx(const char *drives, Bool enableNullDriver,
+                         uint32 flags, SyncDriverHandle *handle);
+const char *SyncDriver_GetTimings(const SyncDriverHandle handle);
+#endif
 Bool SyncDriver_Thaw(const SyncDriverHandle handle);
 SyncDriverStatus SyncDriver_QueryStatus(const SyncDriverHandle handle,
                                         int32 timeout);
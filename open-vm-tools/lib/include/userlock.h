@@ -41,6 +41,25 @@ typedef struct MXUserSemaphore  MXUserSemaphore;
 typedef struct MXUserEvent      MXUserEvent;
 typedef struct MXUserBarrier    MXUserBarrier;
 
+/*
+ * Lock creation flags, used with the "Ex" creation routines.
+ *
+ * MXUSER_FLAG_ADAPTIVE_SPIN  Exclusive locks only. A contended acquisition
+ *                            spins for a bounded period, derived from the
+ *                            recent hold times of the lock, before parking
+ *                            in the native lock. Intended for locks with
+ *                            very short critical sections.
+ *
+ * MXUSER_FLAG_READER_BIASED  Read-write locks only. Readers announce
+ *                            themselves in striped counters and do not touch
+ *                            the native lock unless a writer is present.
+ *                            Writers become more expensive; intended for
+ *                            read-mostly data.
+ */
+
+#define MXUSER_FLAG_ADAPTIVE_SPIN  0x0001
+#define MXUSER_FLAG_READER_BIASED  0x0002
+
 /*
  * Exclusive ownership lock
  */
@@ -48,6 +67,10 @@ typedef struct MXUserBarrier    MXUserBarrier;
 MXUserExclLock *MXUser_CreateExclLock(const char *name,
                                       MX_Rank rank);
 
+MXUserExclLock *MXUser_CreateExclLockEx(const char *name,
+                                        MX_Rank rank,
+                                        uint32 flags);
+
 void MXUser_AcquireExclLock(MXUserExclLock *lock);
 Bool MXUser_TryAcquireExclLock(MXUserExclLock *lock);
 void MXUser_ReleaseExclLock(MXUserExclLock *lock);
@@ -137,6 +160,10 @@ Bool MXUser_SetContentionDurationFloorRecLock(MXUserRecLock *lock,
 MXUserRWLock *MXUser_CreateRWLock(const char *name,
                                    MX_Rank rank);
 
+MXUserRWLock *MXUser_CreateRWLockEx(const char *name,
+                                    MX_Rank rank,
+                                    uint32 flags);
+
 void MXUser_AcquireForRead(MXUserRWLock *lock);
 void MXUser_AcquireForWrite(MXUserRWLock *lock);
 void MXUser_ReleaseRWLock(MXUserRWLock *lock);
@@ -56,6 +56,22 @@
 #define VMBACKUP_PROTOCOL_EVENT_SET       VMBACKUP_PROTOCOL_PREFIX"eventSet"
 #define VMBACKUP_PROTOCOL_SNAPSHOT_COMPLETED \
    VMBACKUP_PROTOCOL_PREFIX"snapshotCompleted"
+#define VMBACKUP_PROTOCOL_GET_TIMELINE    VMBACKUP_PROTOCOL_PREFIX"getTimeline"
+
+/*
+ * Guest variable holding the timeline of the last quiesce operation, one
+ * "<op> <offset ms> <duration ms> <phase> [detail]" entry per line.
+ */
+#define VMBACKUP_GUESTINFO_TIMELINE       "guestinfo.vmbackup.timeline"
+
+/*
+ * File where the vmbackup plugin saves the timeline of the last quiesce
+ * operation, in the same format, for vmware-toolbox-cmd to read: in the
+ * state directory of the tools service, unless vmbackup.timelineFile in
+ * tools.conf names another file.
+ */
+#define VMBACKUP_TIMELINE_FILE            "vmbackup.timeline"
+#define VMBACKUP_CONF_TIMELINE_FILE       "timelineFile"
 
 /* These are responses to messages sent to the guest. */
 #define VMBACKUP_PROTOCOL_ERROR           "protocol.error"
@@ -72,6 +88,8 @@
 #define VMBACKUP_EVENT_SNAPSHOT_PREPARE   "prov.snapshotPrepare"
 #define VMBACKUP_EVENT_WRITER_ERROR       "req.writerError"
 #define VMBACKUP_EVENT_KEEP_ALIVE         "req.keepAlive"
+#define VMBACKUP_EVENT_FREEZE_TIMINGS     "req.freezeTimings"
+#define VMBACKUP_EVENT_TIMELINE           "req.timeline"
 
 /* These are the event codes sent with the events */
 typedef enum {
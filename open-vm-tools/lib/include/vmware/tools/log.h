@@ -52,6 +52,9 @@
  *      default, at most 10 backed up log files will be kept. Value should be >= 1.
  *    - maxLogSize: maximum size of each log file, defaults to 10 (MB). A value of
  *      0 disables log rotation.
+ *    - async: whether to write to the file from a background thread, in
+ *      batches, instead of on the logging thread. Fatal messages are always
+ *      written right away. Defaults to true.
  *
  * When using syslog on Unix, the following options are available:
  *
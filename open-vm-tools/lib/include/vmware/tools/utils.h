@@ -163,6 +163,15 @@ VMTools_GetLibdir(void);
 GSource *
 VMTools_CreateTimer(gint timeout);
 
+GSource *
+VMTools_CreateCoalescedTimer(gint timeout,
+                             gint slack);
+
+struct ProcMgr_AsyncProc;
+
+GSource *
+VMTools_NewProcExitSource(struct ProcMgr_AsyncProc *asyncProc);
+
 void
 VMTools_SetGuestSDKMode(void);
 
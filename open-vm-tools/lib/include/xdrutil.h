@@ -75,6 +75,26 @@
                            (cnt))
 #endif
 
+/*
+ * Same as XDRUTIL_ARRAYAPPEND, growing the array geometrically. For arrays
+ * built one element at a time, and only with this macro; see
+ * XdrUtil_ArrayAppendGeometric.
+ */
+#ifdef __GNUC__
+#   define XDRUTIL_ARRAYAPPEND_GEOMETRIC(ptr, field, cnt)                \
+       (typeof ((ptr)->field.field##_val))                               \
+       XdrUtil_ArrayAppendGeometric((void **) &(ptr)->field.field##_val, \
+                                    &(ptr)->field.field##_len,           \
+                                    sizeof *(ptr)->field.field##_val,    \
+                                    (cnt))
+#else
+#   define XDRUTIL_ARRAYAPPEND_GEOMETRIC(ptr, field, cnt)                \
+       XdrUtil_ArrayAppendGeometric((void **) &(ptr)->field.field##_val, \
+                                    &(ptr)->field.field##_len,           \
+                                    sizeof *(ptr)->field.field##_val,    \
+                                    (cnt))
+#endif
+
 /*
  * Macros for assigning to XDR optional strings, opaque fields, and
  * optional opaque fields.
@@ -120,6 +140,10 @@
 void *
 XdrUtil_ArrayAppend(void **array, u_int *arrayLen, size_t elemSz, u_int elemCnt);
 
+void *
+XdrUtil_ArrayAppendGeometric(void **array, u_int *arrayLen, size_t elemSz,
+                             u_int elemCnt);
+
 Bool
 XdrUtil_Deserialize(const void *data, size_t dataLen, void *xdrProc, void *dest);
 
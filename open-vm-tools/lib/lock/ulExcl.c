@@ -17,18 +17,33 @@
  *********************************************************/
 
 #include "vmware.h"
+#include "vm_basic_asm.h"
 #include "str.h"
 #include "util.h"
 #include "userlock.h"
 #include "hostinfo.h"
 #include "ulInt.h"
 
+/*
+ * Adaptive spinning parameters. A contended acquisition spins for up to
+ * twice the average hold time of the lock, bounded below and above. Locks
+ * whose average hold time exceeds the upper bound never spin.
+ */
+
+#define MXUSER_ADAPTIVE_MIN_SPIN_NS   (1 * 1000)    // 1 usec
+#define MXUSER_ADAPTIVE_MAX_SPIN_NS   (25 * 1000)   // 25 usec
+#define MXUSER_ADAPTIVE_AVG_SHIFT     3             // EWMA weight of 1/8
+
 struct MXUserExclLock
 {
    MXUserHeader  header;
    MXRecLock     recursiveLock;
    Atomic_Ptr    heldStatsMem;
    Atomic_Ptr    acquireStatsMem;
+
+   uint32        flags;          // MXUSER_FLAG_*
+   VmTimeType    holdStart;      // Adaptive only; protected by the lock
+   Atomic_uint64 holdAverage;    // Adaptive only; average hold time (ns)
 };
 
 
@@ -306,8 +321,14 @@ MXUserDumpExclLock(MXUserHeader *header)  // IN:
    Warning("\trank 0x%X\n", lock->header.rank);
    Warning("\tserial number %u\n", lock->header.bits.serialNumber);
 
+   Warning("\tflags 0x%X\n", lock->flags);
    Warning("\tlock count %d\n", MXRecLockCount(&lock->recursiveLock));
 
+   if (lock->flags & MXUSER_FLAG_ADAPTIVE_SPIN) {
+      Warning("\taverage hold time %"FMT64"u ns\n",
+              Atomic_Read64(&lock->holdAverage));
+   }
+
    Warning("\taddress of owner data %p\n",
            &lock->recursiveLock.nativeThreadID);
 }
@@ -316,9 +337,145 @@ MXUserDumpExclLock(MXUserHeader *header)  // IN:
 /*
  *-----------------------------------------------------------------------------
  *
- * MXUser_CreateExclLock --
+ * MXUserExclAdaptiveSpin --
  *
- *      Create an exclusive lock.
+ *      Spin on an adaptive exclusive lock, trying to acquire it, for a period
+ *      derived from the recent hold times of the lock.
+ *
+ * Results:
+ *      TRUE    Acquired (locked)
+ *      FALSE   Not acquired; the caller must block on the native lock
+ *
+ * Side effects:
+ *      Burns CPU.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+MXUserExclAdaptiveSpin(MXUserExclLock *lock)  // IN/OUT:
+{
+   uint32 i;
+   VmTimeType deadline;
+   VmTimeType budget = 2 * Atomic_Read64(&lock->holdAverage);
+
+   if (budget > 2 * MXUSER_ADAPTIVE_MAX_SPIN_NS) {
+      return FALSE;  // Long critical sections; spinning is a waste
+   }
+
+   budget = MAX(budget, MXUSER_ADAPTIVE_MIN_SPIN_NS);
+   budget = MIN(budget, MXUSER_ADAPTIVE_MAX_SPIN_NS);
+
+   deadline = Hostinfo_SystemTimerNS() + budget;
+
+   for (i = 1; ; i++) {
+      /*
+       * Only attempt the (cache line bouncing) acquisition when the lock
+       * appears to be free. The racy read is fine; the try is authoritative.
+       */
+
+      if ((*(volatile int *) &lock->recursiveLock.referenceCount == 0) &&
+          MXRecLockTryAcquire(&lock->recursiveLock)) {
+         return TRUE;
+      }
+
+      PAUSE();
+
+      if (((i % 32) == 0) && (Hostinfo_SystemTimerNS() >= deadline)) {
+         return FALSE;
+      }
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUserExclAcquireInternal --
+ *
+ *      Acquire the recursive lock backing an exclusive lock, spinning first
+ *      if the lock is adaptive.
+ *
+ * Results:
+ *      The lock is acquired. The acquisition time is returned if requested.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE void
+MXUserExclAcquireInternal(MXUserExclLock *lock,   // IN/OUT:
+                          VmTimeType *duration)  // OUT/OPT:
+{
+   VmTimeType start;
+
+   if (LIKELY((lock->flags & MXUSER_FLAG_ADAPTIVE_SPIN) == 0)) {
+      MXRecLockAcquire(&lock->recursiveLock, duration);
+
+      return;
+   }
+
+   if (MXRecLockTryAcquire(&lock->recursiveLock)) {
+      if (duration != NULL) {
+         *duration = 0ULL;
+      }
+   } else {
+      start = Hostinfo_SystemTimerNS();
+
+      if (!MXUserExclAdaptiveSpin(lock)) {
+         MXRecLockAcquire(&lock->recursiveLock,
+                          NULL);  // non-stats
+      }
+
+      if (duration != NULL) {
+         *duration = Hostinfo_SystemTimerNS() - start;
+      }
+   }
+
+   lock->holdStart = Hostinfo_SystemTimerNS();
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUserExclUpdateHoldAverage --
+ *
+ *      Fold the hold time of the current acquisition of an adaptive lock
+ *      into its running average. Must be called by the owner of the lock.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE void
+MXUserExclUpdateHoldAverage(MXUserExclLock *lock)  // IN/OUT:
+{
+   int64 held = Hostinfo_SystemTimerNS() - lock->holdStart;
+   int64 average = Atomic_Read64(&lock->holdAverage);
+
+   average += (held - average) >> MXUSER_ADAPTIVE_AVG_SHIFT;
+
+   Atomic_Write64(&lock->holdAverage, MAX(average, 0));
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUser_CreateExclLockEx --
+ *
+ *      Create an exclusive lock with the specified MXUSER_FLAG_* options.
+ *
+ *      MXUSER_FLAG_ADAPTIVE_SPIN is ignored on uniprocessor systems, where
+ *      spinning can only delay the lock holder.
  *
  * Results:
  *      A pointer to an exclusive lock.
@@ -330,13 +487,23 @@ MXUserDumpExclLock(MXUserHeader *header)  // IN:
  */
 
 MXUserExclLock *
-MXUser_CreateExclLock(const char *userName,  // IN:
-                      MX_Rank rank)          // IN:
+MXUser_CreateExclLockEx(const char *userName,  // IN:
+                        MX_Rank rank,          // IN:
+                        uint32 flags)          // IN:
 {
    uint32 statsMode;
    char *properName;
    MXUserExclLock *lock = Util_SafeCalloc(1, sizeof *lock);
 
+   ASSERT((flags & ~MXUSER_FLAG_ADAPTIVE_SPIN) == 0);
+
+   if ((flags & MXUSER_FLAG_ADAPTIVE_SPIN) && (Hostinfo_NumCPUs() == 1)) {
+      flags &= ~MXUSER_FLAG_ADAPTIVE_SPIN;
+   }
+
+   lock->flags = flags;
+   Atomic_Write64(&lock->holdAverage, MXUSER_ADAPTIVE_MIN_SPIN_NS);
+
    if (userName == NULL) {
       properName = Str_SafeAsprintf(NULL, "X-%p", GetReturnAddress());
    } else {
@@ -381,6 +548,30 @@ MXUser_CreateExclLock(const char *userName,  // IN:
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUser_CreateExclLock --
+ *
+ *      Create an exclusive lock.
+ *
+ * Results:
+ *      A pointer to an exclusive lock.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+MXUserExclLock *
+MXUser_CreateExclLock(const char *userName,  // IN:
+                      MX_Rank rank)          // IN:
+{
+   return MXUser_CreateExclLockEx(userName, rank, 0);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -456,8 +647,8 @@ MXUser_AcquireExclLock(MXUserExclLock *lock)  // IN/OUT:
 
       acquireStats = Atomic_ReadPtr(&lock->acquireStatsMem);
 
-      MXRecLockAcquire(&lock->recursiveLock,
-                       (acquireStats == NULL) ? NULL : &value);
+      MXUserExclAcquireInternal(lock,
+                                (acquireStats == NULL) ? NULL : &value);
 
       if (LIKELY(acquireStats != NULL)) {
          MXUserHisto *histo;
@@ -479,8 +670,8 @@ MXUser_AcquireExclLock(MXUserExclLock *lock)  // IN/OUT:
          }
       }
    } else {
-      MXRecLockAcquire(&lock->recursiveLock,
-                       NULL);  // non-stats
+      MXUserExclAcquireInternal(lock,
+                                NULL);  // non-stats
    }
 
    if (vmx86_debug && (MXRecLockCount(&lock->recursiveLock) > 1)) {
@@ -544,6 +735,10 @@ MXUser_ReleaseExclLock(MXUserExclLock *lock)  // IN/OUT:
 
    MXUserReleaseTracking(&lock->header);
 
+   if (lock->flags & MXUSER_FLAG_ADAPTIVE_SPIN) {
+      MXUserExclUpdateHoldAverage(lock);
+   }
+
    MXRecLockRelease(&lock->recursiveLock);
 }
 
@@ -586,6 +781,10 @@ MXUser_TryAcquireExclLock(MXUserExclLock *lock)  // IN/OUT:
    if (success) {
       MXUserAcquisitionTracking(&lock->header, FALSE);
 
+      if (lock->flags & MXUSER_FLAG_ADAPTIVE_SPIN) {
+         lock->holdStart = Hostinfo_SystemTimerNS();
+      }
+
       if (vmx86_debug && (MXRecLockCount(&lock->recursiveLock) > 1)) {
          MXUserDumpAndPanic(&lock->header,
                             "%s: Acquire on an acquired exclusive lock\n",
@@ -736,6 +935,10 @@ MXUser_WaitCondVarExclLock(MXUserExclLock *lock,    // IN:
 
    MXUserWaitCondVar(&lock->header, &lock->recursiveLock, condVar,
                      MXUSER_WAIT_INFINITE);
+
+   if (lock->flags & MXUSER_FLAG_ADAPTIVE_SPIN) {
+      lock->holdStart = Hostinfo_SystemTimerNS();  // don't count the wait
+   }
 }
 
 
@@ -767,4 +970,8 @@ MXUser_TimedWaitCondVarExclLock(MXUserExclLock *lock,    // IN:
    MXUserValidateHeader(&lock->header, MXUSER_TYPE_EXCL);
 
    MXUserWaitCondVar(&lock->header, &lock->recursiveLock, condVar, msecWait);
+
+   if (lock->flags & MXUSER_FLAG_ADAPTIVE_SPIN) {
+      lock->holdStart = Hostinfo_SystemTimerNS();  // don't count the wait
+   }
 }
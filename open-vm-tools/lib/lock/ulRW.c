@@ -236,8 +236,28 @@ typedef enum {
 typedef struct {
    HolderState   state;
    VmTimeType    holdStart;
+   int           readerSlot;  // Reader-biased fast path slot; -1 if none
 } HolderContext;
 
+/*
+ * Reader-biased read-write locks.
+ *
+ * Readers increment a counter in one of several cache line sized slots
+ * (chosen by thread ID) and, unless a writer is present, hold the lock
+ * without touching the native lock at all. A writer acquires the native
+ * lock for write, which excludes other writers and any readers that had to
+ * fall back to the native lock, announces itself and then waits for the
+ * reader slots to drain.
+ */
+
+#define MXUSER_RW_READER_SLOTS      32
+#define MXUSER_RW_CACHE_LINE_SIZE   64
+
+typedef struct {
+   Atomic_uint32   count;
+   uint8           pad[MXUSER_RW_CACHE_LINE_SIZE - sizeof(Atomic_uint32)];
+} ReaderSlot;
+
 struct MXUserRWLock
 {
    MXUserHeader    header;
@@ -251,6 +271,10 @@ struct MXUserRWLock
 
    Atomic_Ptr      heldStatsMem;
    Atomic_Ptr      acquireStatsMem;
+
+   uint32          flags;         // MXUSER_FLAG_*
+   Atomic_uint32   writerActive;  // Reader-biased only
+   ReaderSlot     *readerSlots;   // Reader-biased only
 };
 
 
@@ -361,19 +385,25 @@ MXUserDumpRWLock(MXUserHeader *header)  // IN:
    }
 
    Warning("\tholderCount %d\n", Atomic_Read(&lock->holderCount));
+   Warning("\tflags 0x%X\n", lock->flags);
+
+   if (lock->flags & MXUSER_FLAG_READER_BIASED) {
+      Warning("\twriterActive %d\n", Atomic_Read(&lock->writerActive));
+   }
 }
 
 
 /*
  *-----------------------------------------------------------------------------
  *
- * MXUser_CreateRWLock --
+ * MXUser_CreateRWLockEx --
  *
- *      Create a read/write lock.
+ *      Create a read/write lock with the specified MXUSER_FLAG_* options.
  *
  *      If native read-write locks are not available, a recursive lock will
  *      be used to provide one reader or one writer access... which is
- *      better than nothing.
+ *      better than nothing. MXUSER_FLAG_READER_BIASED is ignored in that
+ *      case.
  *
  * Results:
  *      A pointer to a read/write lock.
@@ -391,14 +421,17 @@ MXUserFreeHashEntry(void *data)  // IN:
 }
 
 MXUserRWLock *
-MXUser_CreateRWLock(const char *userName,  // IN:
-                    MX_Rank rank)          // IN:
+MXUser_CreateRWLockEx(const char *userName,  // IN:
+                      MX_Rank rank,          // IN:
+                      uint32 flags)          // IN:
 {
    Bool lockInited;
    char *properName;
    Bool useNative = MXUserNativeRWSupported();
    MXUserRWLock *lock = Util_SafeCalloc(1, sizeof *lock);
 
+   ASSERT((flags & ~MXUSER_FLAG_READER_BIASED) == 0);
+
    if (userName == NULL) {
       if (LIKELY(useNative)) {
          properName = Str_SafeAsprintf(NULL, "RW-%p", GetReturnAddress());
@@ -424,6 +457,12 @@ MXUser_CreateRWLock(const char *userName,  // IN:
 
    lock->useNative = useNative && MXUserNativeRWInit(&lock->nativeLock);
 
+   if ((flags & MXUSER_FLAG_READER_BIASED) && lock->useNative) {
+      lock->flags = MXUSER_FLAG_READER_BIASED;
+      lock->readerSlots = Util_SafeCalloc(MXUSER_RW_READER_SLOTS,
+                                          sizeof *lock->readerSlots);
+   }
+
    lockInited = MXRecLockInit(&lock->recursiveLock);
 
    if (LIKELY(lockInited)) {
@@ -464,6 +503,30 @@ MXUser_CreateRWLock(const char *userName,  // IN:
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUser_CreateRWLock --
+ *
+ *      Create a read/write lock.
+ *
+ * Results:
+ *      A pointer to a read/write lock.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+MXUserRWLock *
+MXUser_CreateRWLock(const char *userName,  // IN:
+                    MX_Rank rank)          // IN:
+{
+   return MXUser_CreateRWLockEx(userName, rank, 0);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -510,6 +573,7 @@ MXUser_DestroyRWLock(MXUserRWLock *lock)  // IN:
       }
 
       HashTable_FreeUnsafe(lock->holderTable);
+      free(lock->readerSlots);
 
       lock->header.signature = 0;  // just in case...
       free(lock->header.name);
@@ -549,6 +613,7 @@ MXUserGetHolderContext(MXUserRWLock *lock)  // IN:
 
       newContext->holdStart = 0;
       newContext->state = RW_UNLOCKED;
+      newContext->readerSlot = -1;
 
       result = HashTable_LookupOrInsert(lock->holderTable, threadID,
                                         (void *) newContext);
@@ -562,6 +627,165 @@ MXUserGetHolderContext(MXUserRWLock *lock)  // IN:
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUserReaderSlotsBusy --
+ *
+ *      Are any readers of a reader-biased lock in (or entering) the fast
+ *      path?
+ *
+ * Results:
+ *      TRUE   Yes
+ *      FALSE  No
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+MXUserReaderSlotsBusy(MXUserRWLock *lock)  // IN:
+{
+   uint32 i;
+
+   for (i = 0; i < MXUSER_RW_READER_SLOTS; i++) {
+      if (Atomic_Read(&lock->readerSlots[i].count) != 0) {
+         return TRUE;
+      }
+   }
+
+   return FALSE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUserRWAcquireInternal --
+ *
+ *      Acquire the native lock backing a read-write lock, taking the reader
+ *      fast path of a reader-biased lock when no writer is present.
+ *
+ * Results:
+ *      TRUE   The acquisition was contended
+ *      FALSE  The acquisition was not contended
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE Bool
+MXUserRWAcquireInternal(MXUserRWLock *lock,       // IN/OUT:
+                        Bool forRead,             // IN:
+                        HolderContext *context,   // IN/OUT:
+                        int *err)                 // OUT:
+{
+   Bool contended;
+
+   if (LIKELY((lock->flags & MXUSER_FLAG_READER_BIASED) == 0)) {
+      return MXUserNativeRWAcquire(&lock->nativeLock, forRead, err);
+   }
+
+   if (forRead) {
+      uint32 slot = ((uint32) (uintptr_t) MXUserCastedThreadID()) %
+                    MXUSER_RW_READER_SLOTS;
+
+      /*
+       * Announce, then check for a writer. The writer does the opposite
+       * (announce, then check for readers) so at least one side always
+       * sees the other.
+       */
+
+      Atomic_Inc(&lock->readerSlots[slot].count);
+
+      if (LIKELY(Atomic_Read(&lock->writerActive) == 0)) {
+         context->readerSlot = slot;
+         *err = 0;
+
+         return FALSE;
+      }
+
+      Atomic_Dec(&lock->readerSlots[slot].count);
+
+      /* A writer is present; queue behind it on the native lock. */
+      MXUserNativeRWAcquire(&lock->nativeLock, TRUE, err);
+
+      return TRUE;
+   }
+
+   contended = MXUserNativeRWAcquire(&lock->nativeLock, FALSE, err);
+
+   if (UNLIKELY(*err != 0)) {
+      return contended;
+   }
+
+   Atomic_ReadWrite(&lock->writerActive, 1);  // full barrier
+
+   if (MXUserReaderSlotsBusy(lock)) {
+      uint32 loops = 0;
+
+      contended = TRUE;
+
+      do {
+         if ((++loops % 64) == 0) {
+            YIELD();
+         } else {
+            PAUSE();
+         }
+      } while (MXUserReaderSlotsBusy(lock));
+   }
+
+   return contended;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUserRWReleaseInternal --
+ *
+ *      Release the native lock backing a read-write lock (or the reader fast
+ *      path of a reader-biased lock).
+ *
+ * Results:
+ *      0      Success
+ *      !0     Native lock error
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE int
+MXUserRWReleaseInternal(MXUserRWLock *lock,      // IN/OUT:
+                        HolderContext *context)  // IN/OUT:
+{
+   Bool forRead = (context->state == RW_LOCKED_FOR_READ);
+
+   if (LIKELY((lock->flags & MXUSER_FLAG_READER_BIASED) == 0)) {
+      return MXUserNativeRWRelease(&lock->nativeLock, forRead);
+   }
+
+   if (forRead && (context->readerSlot >= 0)) {
+      Atomic_Dec(&lock->readerSlots[context->readerSlot].count);
+      context->readerSlot = -1;
+
+      return 0;
+   }
+
+   if (!forRead) {
+      Atomic_Write(&lock->writerActive, 0);
+   }
+
+   return MXUserNativeRWRelease(&lock->nativeLock, forRead);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -611,7 +835,7 @@ MXUserAcquisition(MXUserRWLock *lock,  // IN/OUT:
          Bool contended;
          VmTimeType begin = Hostinfo_SystemTimerNS();
 
-         contended = MXUserNativeRWAcquire(&lock->nativeLock, forRead, &err);
+         contended = MXUserRWAcquireInternal(lock, forRead, myContext, &err);
 
          value = contended ? Hostinfo_SystemTimerNS() - begin : 0;
 
@@ -664,7 +888,7 @@ MXUserAcquisition(MXUserRWLock *lock,  // IN/OUT:
       if (LIKELY(lock->useNative)) {
          int err = 0;
 
-         MXUserNativeRWAcquire(&lock->nativeLock, forRead, &err);
+         MXUserRWAcquireInternal(lock, forRead, myContext, &err);
 
          if (UNLIKELY(err != 0)) {
             MXUserDumpAndPanic(&lock->header, "%s: Error %d\n",
@@ -846,8 +1070,7 @@ MXUser_ReleaseRWLock(MXUserRWLock *lock)  // IN/OUT:
    Atomic_Dec(&lock->holderCount);
 
    if (LIKELY(lock->useNative)) {
-      int err = MXUserNativeRWRelease(&lock->nativeLock,
-                                      myContext->state == RW_LOCKED_FOR_READ);
+      int err = MXUserRWReleaseInternal(lock, myContext);
 
       if (UNLIKELY(err != 0)) {
          MXUserDumpAndPanic(&lock->header, "%s: Internal error (%d)\n",
@@ -111,6 +111,797 @@ static const signed char base64Reverse[256] = {
    ILLEGAL, ILLEGAL, ILLEGAL, ILLEGAL, ILLEGAL, ILLEGAL, ILLEGAL, ILLEGAL,   /* F0-F7 */
    ILLEGAL, ILLEGAL, ILLEGAL, ILLEGAL, ILLEGAL, ILLEGAL, ILLEGAL, ILLEGAL }; /* F8-FF */
 
+/*
+ * Vector codecs.
+ *
+ * On x86-64, whole blocks of input are encoded, decoded and validated with
+ * SSSE3, AVX2 or AVX-512 VBMI, whichever is the best the CPU supports. The
+ * decoder and the validator only take blocks made of alphabet characters
+ * alone: anything else (whitespace, padding, NUL, illegal characters) is
+ * left to the scalar loops, so every codec gives the same results. The
+ * algorithms are those of W. Mula and D. Lemire, "Faster Base64 Encoding
+ * and Decoding Using AVX2 Instructions" (ACM TWEB, 2018).
+ *
+ * The wider codecs are followed by the narrower ones on what remains, so
+ * that short buffers and the tails of long ones still get some speed up.
+ */
+
+#if defined(VM_X86_64) && !defined(_WIN32) && \
+    (defined(__clang__) || __GNUC__ >= 5)
+#define BASE64_SIMD
+#endif
+
+#ifdef BASE64_SIMD
+#include <immintrin.h>
+#include "cpuid_info.h"
+
+#define BASE64_TARGET_SSSE3      __attribute__((target("ssse3")))
+#define BASE64_TARGET_AVX2       __attribute__((target("avx2")))
+#define BASE64_TARGET_AVX512VBMI \
+   __attribute__((target("avx512f,avx512bw,avx512vbmi")))
+#endif
+
+static int base64Codec = -1;
+static Base64Codec base64BestCodec = BASE64_CODEC_SCALAR;
+
+
+#ifdef BASE64_SIMD
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Base64XGetBV --
+ *
+ *      Reads XCR0, the register state the OS saves and restores.
+ *
+ * Results:
+ *      The low 32 bits of XCR0.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static uint32
+Base64XGetBV(void)
+{
+   uint32 eax;
+   uint32 edx;
+
+   __asm__ __volatile__(".byte 0x0f, 0x01, 0xd0"   /* xgetbv */
+                        : "=a" (eax), "=d" (edx)
+                        : "c" (0));
+
+   return eax;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Base64DetectCodec --
+ *
+ *      Finds the best codec this CPU and the OS support.
+ *
+ * Results:
+ *      The codec.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Base64Codec
+Base64DetectCodec(void)
+{
+   const uint32 ymmState = CPUID_XCR0_MASTER_SSE_MASK |
+                           CPUID_XCR0_MASTER_YMM_H_MASK;
+   const uint32 zmmState = ymmState |
+                           CPUID_XCR0_MASTER_OPMASK_MASK |
+                           CPUID_XCR0_MASTER_ZMM_H_MASK |
+                           CPUID_XCR0_MASTER_HI16_ZMM_MASK;
+   CPUIDRegs regs;
+   uint32 maxLeaf;
+   uint32 xcr0;
+
+   __GET_CPUID(0, &regs);
+   maxLeaf = regs.eax;
+
+   __GET_CPUID(1, &regs);
+   if (!CPUID_ISSET(1, ECX, SSSE3, regs.ecx)) {
+      return BASE64_CODEC_SCALAR;
+   }
+   if (maxLeaf < 7 ||
+       !CPUID_ISSET(1, ECX, OSXSAVE, regs.ecx) ||
+       !CPUID_ISSET(1, ECX, AVX, regs.ecx)) {
+      return BASE64_CODEC_SSSE3;
+   }
+
+   xcr0 = Base64XGetBV();
+   __GET_CPUID2(7, 0, &regs);
+   if ((xcr0 & ymmState) != ymmState ||
+       !CPUID_ISSET(7, EBX, AVX2, regs.ebx)) {
+      return BASE64_CODEC_SSSE3;
+   }
+   if ((xcr0 & zmmState) != zmmState ||
+       !CPUID_ISSET(7, EBX, AVX512F, regs.ebx) ||
+       !CPUID_ISSET(7, EBX, AVX512BW, regs.ebx) ||
+       !CPUID_ISSET(7, ECX, AVX512VBMI, regs.ecx)) {
+      return BASE64_CODEC_AVX2;
+   }
+
+   return BASE64_CODEC_AVX512VBMI;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Base64EncodeSSSE3 --
+ * Base64EncodeAVX2 --
+ * Base64EncodeAVX512VBMI --
+ *
+ *      Encodes blocks of 12, 24 or 48 bytes from src into dst. Stops before
+ *      reading past srcSize: the SSSE3 and AVX2 loops load 4 bytes more
+ *      than they encode.
+ *
+ * Results:
+ *      The number of bytes encoded, a multiple of 3.
+ *
+ * Side effects:
+ *      Writes 4 characters to dst for each 3 bytes encoded.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static BASE64_TARGET_SSSE3 size_t
+Base64EncodeSSSE3(uint8 const *src,  // IN:
+                  size_t srcSize,    // IN:
+                  char *dst)         // OUT:
+{
+   /* Offsets from each 6 bit value to its character, by range. */
+   const __m128i offsets = _mm_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4,
+                                         -4, -4, -4, -4, -19, -16, 0, 0);
+   const __m128i shuffle = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4,
+                                         7, 6, 8, 7, 10, 9, 11, 10);
+   size_t done = 0;
+
+   while (srcSize - done >= 16) {
+      __m128i v = _mm_loadu_si128((const __m128i *)(src + done));
+      __m128i hi;
+      __m128i lo;
+      __m128i range;
+
+      /* Split each 3 bytes into 4 bytes of 6 bits. */
+      v = _mm_shuffle_epi8(v, shuffle);
+      hi = _mm_mulhi_epu16(_mm_and_si128(v, _mm_set1_epi32(0x0fc0fc00)),
+                           _mm_set1_epi32(0x04000040));
+      lo = _mm_mullo_epi16(_mm_and_si128(v, _mm_set1_epi32(0x003f03f0)),
+                           _mm_set1_epi32(0x01000010));
+      v = _mm_or_si128(hi, lo);
+
+      /* 0 for A-Z, 1 for a-z, 2-11 for 0-9, 12 for '+' and 13 for '/'. */
+      range = _mm_subs_epu8(v, _mm_set1_epi8(51));
+      range = _mm_sub_epi8(range, _mm_cmpgt_epi8(v, _mm_set1_epi8(25)));
+      v = _mm_add_epi8(v, _mm_shuffle_epi8(offsets, range));
+
+      _mm_storeu_si128((__m128i *)dst, v);
+      done += 12;
+      dst += 16;
+   }
+
+   return done;
+}
+
+
+static BASE64_TARGET_AVX2 size_t
+Base64EncodeAVX2(uint8 const *src,  // IN:
+                 size_t srcSize,    // IN:
+                 char *dst)         // OUT:
+{
+   const __m256i offsets = _mm256_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4,
+                                            -4, -4, -4, -4, -19, -16, 0, 0,
+                                            65, 71, -4, -4, -4, -4, -4, -4,
+                                            -4, -4, -4, -4, -19, -16, 0, 0);
+   const __m256i shuffle = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4,
+                                            7, 6, 8, 7, 10, 9, 11, 10,
+                                            1, 0, 2, 1, 4, 3, 5, 4,
+                                            7, 6, 8, 7, 10, 9, 11, 10);
+   size_t done = 0;
+
+   while (srcSize - done >= 28) {
+      __m256i v = _mm256_inserti128_si256(
+         _mm256_castsi128_si256(
+            _mm_loadu_si128((const __m128i *)(src + done))),
+         _mm_loadu_si128((const __m128i *)(src + done + 12)), 1);
+      __m256i hi;
+      __m256i lo;
+      __m256i range;
+
+      v = _mm256_shuffle_epi8(v, shuffle);
+      hi = _mm256_mulhi_epu16(_mm256_and_si256(v,
+                                               _mm256_set1_epi32(0x0fc0fc00)),
+                              _mm256_set1_epi32(0x04000040));
+      lo = _mm256_mullo_epi16(_mm256_and_si256(v,
+                                               _mm256_set1_epi32(0x003f03f0)),
+                              _mm256_set1_epi32(0x01000010));
+      v = _mm256_or_si256(hi, lo);
+
+      range = _mm256_subs_epu8(v, _mm256_set1_epi8(51));
+      range = _mm256_sub_epi8(range,
+                              _mm256_cmpgt_epi8(v, _mm256_set1_epi8(25)));
+      v = _mm256_add_epi8(v, _mm256_shuffle_epi8(offsets, range));
+
+      _mm256_storeu_si256((__m256i *)dst, v);
+      done += 24;
+      dst += 32;
+   }
+
+   return done;
+}
+
+
+static BASE64_TARGET_AVX512VBMI size_t
+Base64EncodeAVX512VBMI(uint8 const *src,  // IN:
+                       size_t srcSize,    // IN:
+                       char *dst)         // OUT:
+{
+   const __m512i alphabet = _mm512_loadu_si512(Base64);
+   /* Bytes b a c b of each 3 bytes a b c, in each 32 bits. */
+   const __m512i shuffle = _mm512_setr_epi32(0x01020001, 0x04050304,
+                                             0x07080607, 0x0a0b090a,
+                                             0x0d0e0c0d, 0x10110f10,
+                                             0x13141213, 0x16171516,
+                                             0x191a1819, 0x1c1d1b1c,
+                                             0x1f201e1f, 0x22232122,
+                                             0x25262425, 0x28292728,
+                                             0x2b2c2a2b, 0x2e2f2d2e);
+   /* Where each 6 bit value starts in the 32 bits. */
+   const __m512i shifts = _mm512_set1_epi64(0x3036242a1016040aULL);
+   size_t done = 0;
+
+   while (srcSize - done >= 48) {
+      __m512i v = _mm512_maskz_loadu_epi8(0xffffffffffffULL, src + done);
+
+      v = _mm512_permutexvar_epi8(shuffle, v);
+      v = _mm512_multishift_epi64_epi8(shifts, v);
+      v = _mm512_permutexvar_epi8(v, alphabet);
+
+      _mm512_storeu_si512(dst, v);
+      done += 48;
+      dst += 64;
+   }
+
+   return done;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Base64DecodeSSSE3 --
+ * Base64DecodeAVX2 --
+ * Base64DecodeAVX512VBMI --
+ *
+ *      Decodes blocks of 16, 32 or 64 characters from in into out, as long
+ *      as they are alphabet characters only, and there are at least inSize
+ *      characters and outSize bytes left for a whole block.
+ *
+ *      The SSSE3 loop, which goes last, tells why it stopped in next:
+ *      how far the scalar loop should go before trying again, that is
+ *      just past the first character it did not take, or (size_t)-1 if
+ *      there is not room for another block.
+ *
+ * Results:
+ *      The number of characters decoded, a multiple of 4.
+ *
+ * Side effects:
+ *      Writes 3 bytes to out for each 4 characters decoded.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static BASE64_TARGET_SSSE3 size_t
+Base64DecodeSSSE3(char const *in,   // IN:
+                  size_t inSize,    // IN:
+                  uint8 *out,       // OUT:
+                  size_t outSize,   // IN:
+                  size_t *next)     // OUT:
+{
+   /* Character classes by low and high nibble: alphabet iff no bit common. */
+   const __m128i classLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11,
+                                         0x11, 0x11, 0x11, 0x11,
+                                         0x11, 0x11, 0x13, 0x1a,
+                                         0x1b, 0x1b, 0x1b, 0x1a);
+   const __m128i classHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02,
+                                         0x04, 0x08, 0x04, 0x08,
+                                         0x10, 0x10, 0x10, 0x10,
+                                         0x10, 0x10, 0x10, 0x10);
+   /* Offsets from each character to its value, by high nibble. */
+   const __m128i offsets = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                         0, 0, 0, 0, 0, 0, 0, 0);
+   const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9,
+                                      8, 14, 13, 12, -1, -1, -1, -1);
+   const __m128i slash = _mm_set1_epi8('/');
+   size_t done = 0;
+
+   *next = (size_t)-1;
+
+   while (inSize - done >= 16 && outSize >= 12) {
+      __m128i v = _mm_loadu_si128((const __m128i *)(in + done));
+      __m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(v, 4), slash);
+      __m128i loNibbles = _mm_and_si128(v, slash);
+      __m128i kind = _mm_and_si128(_mm_shuffle_epi8(classLo, loNibbles),
+                                   _mm_shuffle_epi8(classHi, hiNibbles));
+      int other = _mm_movemask_epi8(_mm_cmpgt_epi8(kind,
+                                                   _mm_setzero_si128()));
+      uint32 tail;
+
+      if (other != 0) {
+         *next = __builtin_ctz(other) + 1;
+         break;
+      }
+
+      /* '/' and '+' share a high nibble. */
+      hiNibbles = _mm_add_epi8(hiNibbles, _mm_cmpeq_epi8(v, slash));
+      v = _mm_add_epi8(v, _mm_shuffle_epi8(offsets, hiNibbles));
+
+      /* Join each 4 values of 6 bits into 3 bytes. */
+      v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+      v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+      v = _mm_shuffle_epi8(v, pack);
+
+      _mm_storel_epi64((__m128i *)out, v);
+      tail = _mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+      memcpy(out + 8, &tail, sizeof tail);
+
+      done += 16;
+      out += 12;
+      outSize -= 12;
+   }
+
+   return done;
+}
+
+
+static BASE64_TARGET_AVX2 size_t
+Base64DecodeAVX2(char const *in,   // IN:
+                 size_t inSize,    // IN:
+                 uint8 *out,       // OUT:
+                 size_t outSize)   // IN:
+{
+   const __m256i classLo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1a,
+                                            0x1b, 0x1b, 0x1b, 0x1a,
+                                            0x15, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1a,
+                                            0x1b, 0x1b, 0x1b, 0x1a);
+   const __m256i classHi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02,
+                                            0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10,
+                                            0x10, 0x10, 0x10, 0x10,
+                                            0x10, 0x10, 0x01, 0x02,
+                                            0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10,
+                                            0x10, 0x10, 0x10, 0x10);
+   const __m256i offsets = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                            0, 0, 0, 0, 0, 0, 0, 0,
+                                            0, 16, 19, 4, -65, -65, -71, -71,
+                                            0, 0, 0, 0, 0, 0, 0, 0);
+   const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9,
+                                         8, 14, 13, 12, -1, -1, -1, -1,
+                                         2, 1, 0, 6, 5, 4, 10, 9,
+                                         8, 14, 13, 12, -1, -1, -1, -1);
+   const __m256i slash = _mm256_set1_epi8('/');
+   size_t done = 0;
+
+   while (inSize - done >= 32 && outSize >= 24) {
+      __m256i v = _mm256_loadu_si256((const __m256i *)(in + done));
+      __m256i hiNibbles = _mm256_and_si256(_mm256_srli_epi32(v, 4), slash);
+      __m256i loNibbles = _mm256_and_si256(v, slash);
+      __m256i kind = _mm256_and_si256(
+         _mm256_shuffle_epi8(classLo, loNibbles),
+         _mm256_shuffle_epi8(classHi, hiNibbles));
+
+      if (_mm256_movemask_epi8(_mm256_cmpgt_epi8(kind,
+                                                 _mm256_setzero_si256()))) {
+         break;
+      }
+
+      hiNibbles = _mm256_add_epi8(hiNibbles, _mm256_cmpeq_epi8(v, slash));
+      v = _mm256_add_epi8(v, _mm256_shuffle_epi8(offsets, hiNibbles));
+
+      v = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+      v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));
+      v = _mm256_shuffle_epi8(v, pack);
+      /* Each lane holds 12 bytes: make them 24 in a row. */
+      v = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 1, 2, 4,
+                                                           5, 6, 7, 7));
+
+      _mm_storeu_si128((__m128i *)out, _mm256_castsi256_si128(v));
+      _mm_storel_epi64((__m128i *)(out + 16), _mm256_extracti128_si256(v, 1));
+
+      done += 32;
+      out += 24;
+      outSize -= 24;
+   }
+
+   return done;
+}
+
+
+static BASE64_TARGET_AVX512VBMI size_t
+Base64DecodeAVX512VBMI(char const *in,   // IN:
+                       size_t inSize,    // IN:
+                       uint8 *out,       // OUT:
+                       size_t outSize)   // IN:
+{
+   /* The specials are negative: their high bit flags them, as for >= 0x80. */
+   const __m512i reverseLo = _mm512_loadu_si512(base64Reverse);
+   const __m512i reverseHi = _mm512_loadu_si512(base64Reverse + 64);
+   /* Bytes 2 1 0 of each 32 bits, in a row. */
+   const __m512i pack = _mm512_setr_epi32(0x06000102, 0x090a0405,
+                                          0x0c0d0e08, 0x16101112,
+                                          0x191a1415, 0x1c1d1e18,
+                                          0x26202122, 0x292a2425,
+                                          0x2c2d2e28, 0x36303132,
+                                          0x393a3435, 0x3c3d3e38,
+                                          0, 0, 0, 0);
+   size_t done = 0;
+
+   while (inSize - done >= 64 && outSize >= 48) {
+      __m512i v = _mm512_loadu_si512(in + done);
+      __m512i values = _mm512_permutex2var_epi8(reverseLo, v, reverseHi);
+
+      if (_mm512_movepi8_mask(_mm512_or_si512(values, v)) != 0) {
+         break;
+      }
+
+      v = _mm512_maddubs_epi16(values, _mm512_set1_epi32(0x01400140));
+      v = _mm512_madd_epi16(v, _mm512_set1_epi32(0x00011000));
+      v = _mm512_permutexvar_epi8(pack, v);
+
+      _mm512_mask_storeu_epi8(out, 0xffffffffffffULL, v);
+      done += 64;
+      out += 48;
+      outSize -= 48;
+   }
+
+   return done;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Base64ValidSSSE3 --
+ * Base64ValidAVX2 --
+ * Base64ValidAVX512VBMI --
+ *
+ *      Checks blocks of 16, 32 or 64 characters from src, as long as they
+ *      are alphabet characters or '='.
+ *
+ * Results:
+ *      The number of characters checked.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static BASE64_TARGET_SSSE3 size_t
+Base64ValidSSSE3(char const *src,   // IN:
+                 size_t srcLength)  // IN:
+{
+   const __m128i classLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11,
+                                         0x11, 0x11, 0x11, 0x11,
+                                         0x11, 0x11, 0x13, 0x1a,
+                                         0x1b, 0x1b, 0x1b, 0x1a);
+   const __m128i classHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02,
+                                         0x04, 0x08, 0x04, 0x08,
+                                         0x10, 0x10, 0x10, 0x10,
+                                         0x10, 0x10, 0x10, 0x10);
+   const __m128i nibble = _mm_set1_epi8(0x0f);
+   size_t done = 0;
+
+   while (srcLength - done >= 16) {
+      __m128i v = _mm_loadu_si128((const __m128i *)(src + done));
+      __m128i kind = _mm_and_si128(
+         _mm_shuffle_epi8(classLo, _mm_and_si128(v, nibble)),
+         _mm_shuffle_epi8(classHi,
+                          _mm_and_si128(_mm_srli_epi32(v, 4), nibble)));
+      __m128i other = _mm_andnot_si128(
+         _mm_cmpeq_epi8(v, _mm_set1_epi8(Pad64)),
+         _mm_cmpgt_epi8(kind, _mm_setzero_si128()));
+
+      if (_mm_movemask_epi8(other) != 0) {
+         break;
+      }
+      done += 16;
+   }
+
+   return done;
+}
+
+
+static BASE64_TARGET_AVX2 size_t
+Base64ValidAVX2(char const *src,   // IN:
+                size_t srcLength)  // IN:
+{
+   const __m256i classLo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1a,
+                                            0x1b, 0x1b, 0x1b, 0x1a,
+                                            0x15, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1a,
+                                            0x1b, 0x1b, 0x1b, 0x1a);
+   const __m256i classHi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02,
+                                            0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10,
+                                            0x10, 0x10, 0x10, 0x10,
+                                            0x10, 0x10, 0x01, 0x02,
+                                            0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10,
+                                            0x10, 0x10, 0x10, 0x10);
+   const __m256i nibble = _mm256_set1_epi8(0x0f);
+   size_t done = 0;
+
+   while (srcLength - done >= 32) {
+      __m256i v = _mm256_loadu_si256((const __m256i *)(src + done));
+      __m256i kind = _mm256_and_si256(
+         _mm256_shuffle_epi8(classLo, _mm256_and_si256(v, nibble)),
+         _mm256_shuffle_epi8(classHi,
+                             _mm256_and_si256(_mm256_srli_epi32(v, 4),
+                                              nibble)));
+      __m256i other = _mm256_andnot_si256(
+         _mm256_cmpeq_epi8(v, _mm256_set1_epi8(Pad64)),
+         _mm256_cmpgt_epi8(kind, _mm256_setzero_si256()));
+
+      if (_mm256_movemask_epi8(other) != 0) {
+         break;
+      }
+      done += 32;
+   }
+
+   return done;
+}
+
+
+static BASE64_TARGET_AVX512VBMI size_t
+Base64ValidAVX512VBMI(char const *src,   // IN:
+                      size_t srcLength)  // IN:
+{
+   const __m512i reverseLo = _mm512_loadu_si512(base64Reverse);
+   const __m512i reverseHi = _mm512_loadu_si512(base64Reverse + 64);
+   const __m512i pad = _mm512_set1_epi8(Pad64);
+   size_t done = 0;
+
+   while (srcLength - done >= 64) {
+      __m512i v = _mm512_loadu_si512(src + done);
+      __m512i values = _mm512_permutex2var_epi8(reverseLo, v, reverseHi);
+
+      if ((_mm512_movepi8_mask(_mm512_or_si512(values, v)) &
+           ~_mm512_cmpeq_epi8_mask(v, pad)) != 0) {
+         break;
+      }
+      done += 64;
+   }
+
+   return done;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Base64EncodeSIMD --
+ * Base64DecodeSIMD --
+ * Base64ValidSIMD --
+ *
+ *      Runs the loops of a codec, from the widest down to SSSE3, over what
+ *      the vector code can take of the input. The scalar code does the rest.
+ *
+ * Results:
+ *      As the loops: the number of bytes encoded, characters decoded or
+ *      characters checked.
+ *
+ * Side effects:
+ *      As the loops.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static size_t
+Base64EncodeSIMD(Base64Codec codec,  // IN:
+                 uint8 const *src,   // IN:
+                 size_t srcSize,     // IN:
+                 char *dst)          // OUT:
+{
+   size_t done = 0;
+
+   switch (codec) {
+   case BASE64_CODEC_AVX512VBMI:
+      done += Base64EncodeAVX512VBMI(src, srcSize, dst);
+      /* fall through */
+   case BASE64_CODEC_AVX2:
+      done += Base64EncodeAVX2(src + done, srcSize - done, dst + done / 3 * 4);
+      /* fall through */
+   case BASE64_CODEC_SSSE3:
+      done += Base64EncodeSSSE3(src + done, srcSize - done,
+                                dst + done / 3 * 4);
+      break;
+   default:
+      break;
+   }
+
+   return done;
+}
+
+
+static size_t
+Base64DecodeSIMD(Base64Codec codec,  // IN:
+                 char const *in,     // IN:
+                 size_t inSize,      // IN:
+                 uint8 *out,         // OUT:
+                 size_t outSize,     // IN:
+                 size_t *next)       // OUT:
+{
+   size_t done = 0;
+
+   *next = (size_t)-1;
+
+   switch (codec) {
+   case BASE64_CODEC_AVX512VBMI:
+      done += Base64DecodeAVX512VBMI(in, inSize, out, outSize);
+      /* fall through */
+   case BASE64_CODEC_AVX2:
+      done += Base64DecodeAVX2(in + done, inSize - done, out + done / 4 * 3,
+                               outSize - done / 4 * 3);
+      /* fall through */
+   case BASE64_CODEC_SSSE3:
+      done += Base64DecodeSSSE3(in + done, inSize - done, out + done / 4 * 3,
+                                outSize - done / 4 * 3, next);
+      break;
+   default:
+      break;
+   }
+
+   return done;
+}
+
+
+static size_t
+Base64ValidSIMD(Base64Codec codec,  // IN:
+                char const *src,    // IN:
+                size_t srcLength)   // IN:
+{
+   size_t done = 0;
+
+   switch (codec) {
+   case BASE64_CODEC_AVX512VBMI:
+      done += Base64ValidAVX512VBMI(src, srcLength);
+      /* fall through */
+   case BASE64_CODEC_AVX2:
+      done += Base64ValidAVX2(src + done, srcLength - done);
+      /* fall through */
+   case BASE64_CODEC_SSSE3:
+      done += Base64ValidSSSE3(src + done, srcLength - done);
+      break;
+   default:
+      break;
+   }
+
+   return done;
+}
+
+#else
+
+static Base64Codec
+Base64DetectCodec(void)
+{
+   return BASE64_CODEC_SCALAR;
+}
+
+
+static size_t
+Base64EncodeSIMD(Base64Codec codec,  // IN:
+                 uint8 const *src,   // IN:
+                 size_t srcSize,     // IN:
+                 char *dst)          // OUT:
+{
+   return 0;
+}
+
+
+static size_t
+Base64DecodeSIMD(Base64Codec codec,  // IN:
+                 char const *in,     // IN:
+                 size_t inSize,      // IN:
+                 uint8 *out,         // OUT:
+                 size_t outSize,     // IN:
+                 size_t *next)       // OUT:
+{
+   *next = (size_t)-1;
+
+   return 0;
+}
+
+
+static size_t
+Base64ValidSIMD(Base64Codec codec,  // IN:
+                char const *src,    // IN:
+                size_t srcLength)   // IN:
+{
+   return 0;
+}
+#endif
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Base64_GetCodec --
+ *
+ *      Returns the codec in use, the best one the CPU supports unless
+ *      Base64_SetCodec said otherwise.
+ *
+ * Results:
+ *      The codec.
+ *
+ * Side effects:
+ *      Detects the CPU features on first use.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+Base64Codec
+Base64_GetCodec(void)
+{
+   if (UNLIKELY(base64Codec == -1)) {
+      base64BestCodec = Base64DetectCodec();
+      base64Codec = base64BestCodec;
+   }
+
+   return base64Codec;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Base64_SetCodec --
+ *
+ *      Selects the codec used from now on by all threads. Meant for tests
+ *      and benchmarks.
+ *
+ * Results:
+ *      TRUE on success, FALSE if the CPU does not support the codec.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+Bool
+Base64_SetCodec(Base64Codec codec)  // IN:
+{
+   Base64_GetCodec();
+
+   if (codec > base64BestCodec) {
+      return FALSE;
+   }
+   base64Codec = codec;
+
+   return TRUE;
+}
+
+
 /* (From RFC1521 and draft-ietf-dnssec-secext-03.txt)
    The following encoding technique is taken from RFC 1521 by Borenstein
    and Freed.  It is reproduced here in a slightly edited form for
@@ -201,6 +992,7 @@ Base64_Encode(uint8 const *src,  // IN:
 {
    char *dst0 = dst;
    Bool retval = TRUE;
+   size_t done;
 
    ASSERT(src || srcSize == 0);
    ASSERT(dst);
@@ -213,6 +1005,11 @@ Base64_Encode(uint8 const *src,  // IN:
       goto exit;
    }
 
+   done = Base64EncodeSIMD(Base64_GetCodec(), src, srcSize, dst);
+   src += done;
+   srcSize -= done;
+   dst += done / 3 * 4;
+
    while (LIKELY(srcSize > 2)) {
       dst[0] = Base64[src[0] >> 2];
       dst[1] = Base64[(src[0] & 0x03) << 4 | src[1] >> 4];
@@ -385,6 +1182,9 @@ Base64_ChunkDecode(char const *in,      // IN:
    int n = 0;
    uintptr_t i = 0;
    size_t inputIndex = 0;
+   Base64Codec codec = Base64_GetCodec();
+   size_t simdSize = 0;   // how much input the vector code may read
+   size_t simdNext = 0;   // where it may try again
 
    ASSERT(in);
    ASSERT(out || outSize == 0);
@@ -392,9 +1192,31 @@ Base64_ChunkDecode(char const *in,      // IN:
    ASSERT((inSize == -1) || (inSize % 4) == 0);
    *dataLength = 0;
 
+   if (codec != BASE64_CODEC_SCALAR) {
+      simdSize = inSize == -1 ? strlen(in) : inSize;
+   }
+
    i = 0;
    for (;inputIndex < inSize;) {
-      int p = base64Reverse[(unsigned char)in[inputIndex]];
+      int p;
+
+      /*
+       * Hand whole quanta to the vector code; it gives back what it does not
+       * take, and the scalar loop goes past that before it tries again.
+       */
+      if (n == 0 && inputIndex >= simdNext && inputIndex < simdSize) {
+         size_t next;
+         size_t done = Base64DecodeSIMD(codec, in + inputIndex,
+                                        simdSize - inputIndex, out + i,
+                                        outSize - i, &next);
+
+         inputIndex += done;
+         i += done / 4 * 3;
+         simdNext = next == (size_t)-1 ? next : inputIndex + next;
+         continue;
+      }
+
+      p = base64Reverse[(unsigned char)in[inputIndex]];
 
       if (UNLIKELY(p < 0)) {
          switch (p) {
@@ -446,11 +1268,21 @@ Bool
 Base64_ValidEncoding(char const *src,   // IN:
                      size_t srcLength)  // IN:
 {
+   Base64Codec codec = Base64_GetCodec();
    size_t i;
 
    ASSERT(src);
    for (i = 0; i < srcLength; i++) {
-      uint8 c = src[i]; /* MSVC CRT will die on negative arguments to is* */
+      uint8 c;
+
+      if (codec != BASE64_CODEC_SCALAR) {
+         i += Base64ValidSIMD(codec, src + i, srcLength - i);
+         if (i == srcLength) {
+            break;
+         }
+      }
+
+      c = src[i]; /* MSVC CRT will die on negative arguments to is* */
 
       if (!isalpha(c) && !isdigit(c) &&
           c != '+' && c != '=' && c != '/') {
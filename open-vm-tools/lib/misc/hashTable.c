@@ -21,6 +21,17 @@
  *
  *      An implementation of hashtable with no removals.
  *      For string keys.
+ *
+ *      Tables allocated with HASH_FLAG_RESIZE double their buckets when
+ *      they hold more than HASH_MAX_LOAD elements per bucket. The old
+ *      buckets are moved to the new array a few at a time, by each insert
+ *      or delete, so no single call pays for the whole table. Meanwhile,
+ *      keys are looked up in whichever array their bucket is in.
+ *
+ *      Atomic tables cannot move entries under lock-free readers: resizable
+ *      atomic tables take one of a set of spin locks, picked by hash, around
+ *      every operation instead. The buckets of a stripe stay in that stripe
+ *      as the table grows, so moving them only needs the stripe's lock.
  */
 
 #include <stdio.h>
@@ -41,6 +52,20 @@
 
 #define HASH_ROTATE     5
 
+/*
+ * The stronger hash (HASH_FLAG_STRONGHASH, HASH_FLAG_RESIZE) folds keys
+ * 8 bytes at a time with a multiply and a shift, then goes through the
+ * MurmurHash3 finalizer, so that every bit of the key affects the low
+ * bits of the hash, which index the buckets.
+ */
+
+#define HASH_SEED       CONST64U(0x9e3779b97f4a7c15)
+#define HASH_MULTIPLIER CONST64U(0xa0761d6478bd642f)
+
+#define HASH_MAX_LOAD     1     // elements per bucket before doubling
+#define HASH_MOVE_STEP    4     // old buckets moved per insert or delete
+#define HASH_MAX_STRIPES  64    // locks of a resizable atomic table
+
 
 /*
  * Pointer to hash table entry
@@ -71,8 +96,21 @@ typedef struct HashTableEntry {
    HashTableLink     next;
    const void       *keyStr;
    Atomic_Ptr        clientData;
+   uint32            hash;
 } HashTableEntry;
 
+/*
+ * A stripe of a resizable table: the buckets whose index has the same low
+ * bits, with their lock if the table is atomic. Padded to a cache line.
+ */
+
+typedef struct HashTableStripe {
+   Atomic_uint32     lock;
+   uint32            moved;          // old buckets moved to the new array
+   size_t            numElements;    // atomic tables
+   uint8             pad[64 - 2 * sizeof(uint32) - sizeof(size_t)];
+} HashTableStripe;
+
 /*
  * The hashtable structure.
  */
@@ -83,10 +121,23 @@ struct HashTable {
    int                    keyType;
    Bool                   atomic;
    Bool                   copyKey;
+   Bool                   strongHash;
+   Bool                   resize;
    HashTableFreeEntryFn   freeEntryFn;
    HashTableLink         *buckets;
 
    size_t                 numElements;
+
+   /*
+    * Resizable tables. While the table grows, oldBuckets holds the
+    * numEntries / 2 buckets not all moved to buckets yet.
+    */
+
+   HashTableLink         *oldBuckets;
+   uint32                 numStripes;    // power of 2, 1 unless atomic
+   uint32                 stripeBits;
+   HashTableStripe       *stripes;
+   Atomic_uint32          stripesMoved;  // stripes done moving
 };
 
 
@@ -102,9 +153,38 @@ HashTableEntry *HashTableLookupOrInsert(HashTable *ht,
 /*
  *-----------------------------------------------------------------------------
  *
- * HashTableComputeHash --
+ * HashTableMix --
  *
- *      Compute hash value based on key type and hash size.
+ *      MurmurHash3's 64 bit finalizer.
+ *
+ * Results:
+ *      The mixed value.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE uint64
+HashTableMix(uint64 h)  // IN:
+{
+   h ^= h >> 33;
+   h *= CONST64U(0xff51afd7ed558ccd);
+   h ^= h >> 33;
+   h *= CONST64U(0xc4ceb9fe1a85ec53);
+   h ^= h >> 33;
+
+   return h;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HashTableStrongHash --
+ *
+ *      Compute the stronger hash of a key.
  *
  * Results:
  *      The hash value.
@@ -115,12 +195,74 @@ HashTableEntry *HashTableLookupOrInsert(HashTable *ht,
  *-----------------------------------------------------------------------------
  */
 
+static uint32
+HashTableStrongHash(const HashTable *ht,  // IN: hash table
+                    const void *s)        // IN: key to hash
+{
+   const unsigned char *keyPtr = s;
+   uint64 h;
+   size_t len;
+
+   if (ht->keyType == HASH_INT_KEY) {
+      return (uint32) HashTableMix((uint64) (uintptr_t) s);
+   }
+
+   len = strlen(s);
+   h = HASH_SEED ^ (len * HASH_MULTIPLIER);
+
+   while (len != 0) {
+      uint64 word = 0;
+      size_t n = MIN(len, 8);
+      size_t i;
+
+      if (ht->keyType == HASH_ISTRING_KEY) {
+         for (i = 0; i < n; i++) {
+            word |= (uint64) tolower(keyPtr[i]) << (8 * i);
+         }
+      } else if (n == 8) {
+         memcpy(&word, keyPtr, 8);
+      } else {
+         for (i = 0; i < n; i++) {
+            word |= (uint64) keyPtr[i] << (8 * i);
+         }
+      }
+
+      h = (h ^ word) * HASH_MULTIPLIER;
+      h ^= h >> 29;
+      keyPtr += n;
+      len -= n;
+   }
+
+   return (uint32) HashTableMix(h);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HashTableComputeHash --
+ *
+ *      Compute hash value based on key type.
+ *
+ * Results:
+ *      The hash value, from which HashTableIndex picks a bucket.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
 static uint32
 HashTableComputeHash(const HashTable *ht,  // IN: hash table
                      const void *s)        // IN: string to hash
 {
    uint32 h = 0;
 
+   if (ht->strongHash) {
+      return HashTableStrongHash(ht, s);
+   }
+
    switch (ht->keyType) {
    case HASH_STRING_KEY: {
          int c;
@@ -156,20 +298,112 @@ HashTableComputeHash(const HashTable *ht,  // IN: hash table
       NOT_REACHED();
    }
 
-   {
-      int numBits = ht->numBits;
-      uint32 mask = MASK(numBits);
+   return h;
+}
 
-      for (; h > mask; h = (h & mask) ^ (h >> numBits)) {
-      }
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HashTableIndex --
+ *
+ *      Compute the index of a hash in an array of 2^numBits buckets. The
+ *      stronger hash is good in its low bits; the others are folded.
+ *
+ * Results:
+ *      The bucket index.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE uint32
+HashTableIndex(const HashTable *ht,  // IN: hash table
+               uint32 h,             // IN: hash value
+               uint32 numBits)       // IN: size of the bucket array
+{
+   uint32 mask = MASK(numBits);
+
+   if (ht->strongHash) {
+      return h & mask;
    }
 
-   ASSERT(h < ht->numEntries);
+   for (; h > mask; h = (h & mask) ^ (h >> numBits)) {
+   }
 
    return h;
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HashTableBucket --
+ *
+ *      Find the bucket of a hash: in the old array of a growing table if
+ *      it has not been moved yet, in the current one otherwise.
+ *
+ * Results:
+ *      The bucket.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE HashTableLink *
+HashTableBucket(const HashTable *ht,  // IN: hash table
+                uint32 hash)          // IN: hash value
+{
+   if (UNLIKELY(ht->oldBuckets != NULL)) {
+      uint32 i = HashTableIndex(ht, hash, ht->numBits - 1);
+      const HashTableStripe *stripe = &ht->stripes[i & (ht->numStripes - 1)];
+
+      if ((i >> ht->stripeBits) >= stripe->moved) {
+         return &ht->oldBuckets[i];
+      }
+   }
+
+   return &ht->buckets[HashTableIndex(ht, hash, ht->numBits)];
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HashTableNumLinks --
+ * HashTableLinkAt --
+ *
+ *      Walk all the buckets of a table, the current and the old ones.
+ *
+ * Results:
+ *      The number of buckets; the bucket at an index below that.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE uint32
+HashTableNumLinks(const HashTable *ht)  // IN: hash table
+{
+   return ht->numEntries + (ht->oldBuckets == NULL ? 0 : ht->numEntries / 2);
+}
+
+
+static INLINE HashTableLink *
+HashTableLinkAt(const HashTable *ht,  // IN: hash table
+                uint32 i)             // IN: index
+{
+   return i < ht->numEntries ? &ht->buckets[i] :
+                               &ht->oldBuckets[i - ht->numEntries];
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -204,6 +438,282 @@ HashTableEqualKeys(const HashTable *ht,  // IN: hash table
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HashTableLock --
+ *
+ *      Find the stripe of a hash in a resizable table and, if the table
+ *      is atomic, lock it.
+ *
+ * Results:
+ *      The stripe, NULL if the table is not resizable.
+ *
+ * Side effects:
+ *      May spin.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static HashTableStripe *
+HashTableLock(const HashTable *ht,  // IN:
+              uint32 hash)          // IN:
+{
+   HashTableStripe *stripe;
+
+   if (!ht->resize) {
+      return NULL;
+   }
+
+   stripe = &ht->stripes[hash & (ht->numStripes - 1)];
+
+   if (ht->atomic) {
+      while (Atomic_ReadWrite32(&stripe->lock, 1) != 0) {
+         while (Atomic_Read32(&stripe->lock) != 0) {
+            PAUSE();
+         }
+      }
+   }
+
+   return stripe;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HashTableUnlock --
+ *
+ *      Unlock a stripe locked by HashTableLock.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HashTableUnlock(const HashTable *ht,      // IN:
+                HashTableStripe *stripe)  // IN/OPT:
+{
+   if (stripe != NULL && ht->atomic) {
+      Atomic_ReadWrite32(&stripe->lock, 0);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HashTableLockAll --
+ * HashTableUnlockAll --
+ *
+ *      Lock, unlock all the stripes of a resizable atomic table, in order.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      May spin.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HashTableLockAll(HashTable *ht)  // IN/OUT:
+{
+   uint32 i;
+
+   for (i = 0; i < ht->numStripes; i++) {
+      HashTableLock(ht, i);
+   }
+}
+
+
+static void
+HashTableUnlockAll(HashTable *ht)  // IN/OUT:
+{
+   uint32 i;
+
+   for (i = 0; i < ht->numStripes; i++) {
+      HashTableUnlock(ht, &ht->stripes[i]);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HashTableOverloaded --
+ *
+ *      Whether a resizable table, or a stripe of an atomic one, holds more
+ *      than HASH_MAX_LOAD elements per bucket.
+ *
+ * Results:
+ *      TRUE if the table should grow.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+HashTableOverloaded(const HashTable *ht,            // IN:
+                    const HashTableStripe *stripe)  // IN:
+{
+   if (ht->atomic) {
+      return stripe->numElements >
+             (size_t) (ht->numEntries >> ht->stripeBits) * HASH_MAX_LOAD;
+   }
+
+   return ht->numElements > (size_t) ht->numEntries * HASH_MAX_LOAD;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HashTableMove --
+ *
+ *      Called by inserts and deletes on resizable tables, with the stripe
+ *      locked: moves the next HASH_MOVE_STEP old buckets of the stripe,
+ *      if the table is growing.
+ *
+ * Results:
+ *      TRUE if HashTableGrow should be called, once the stripe is
+ *      unlocked: to start growing the table, or to free the old buckets
+ *      now that they have all been moved.
+ *
+ * Side effects:
+ *      Moves entries.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+HashTableMove(HashTable *ht,            // IN/OUT:
+              HashTableStripe *stripe)  // IN/OUT:
+{
+   uint32 perStripe = (ht->numEntries / 2) >> ht->stripeBits;
+   uint32 s = stripe - ht->stripes;
+   uint32 n;
+
+   if (ht->oldBuckets == NULL) {
+      return ht->numBits < 30 && HashTableOverloaded(ht, stripe);
+   }
+   if (stripe->moved == perStripe) {
+      return FALSE;
+   }
+
+   for (n = 0; n < HASH_MOVE_STEP && stripe->moved < perStripe; n++) {
+      uint32 i = (stripe->moved << ht->stripeBits) | s;
+      HashTableEntry *entry;
+
+      while ((entry = ENTRY(ht->oldBuckets[i])) != NULL) {
+         HashTableLink *bucket =
+            &ht->buckets[HashTableIndex(ht, entry->hash, ht->numBits)];
+
+         SETENTRY(ht->oldBuckets[i], ENTRY(entry->next));
+         SETENTRY(entry->next, ENTRY(*bucket));
+         SETENTRY(*bucket, entry);
+      }
+      stripe->moved++;
+   }
+
+   return stripe->moved == perStripe &&
+          Atomic_ReadInc32(&ht->stripesMoved) + 1 == ht->numStripes;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HashTableGrow --
+ *
+ *      Frees the old buckets of a resizable table if they have all been
+ *      moved, then starts doubling the buckets if the table, or the given
+ *      stripe of an atomic table, is still overloaded.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Locks all the stripes of an atomic table for the time being.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HashTableGrow(HashTable *ht,                  // IN/OUT:
+              const HashTableStripe *stripe)  // IN:
+{
+   HashTableLockAll(ht);
+
+   if (ht->oldBuckets != NULL &&
+       Atomic_Read32(&ht->stripesMoved) == ht->numStripes) {
+      free(ht->oldBuckets);
+      ht->oldBuckets = NULL;
+   }
+
+   if (ht->oldBuckets == NULL && HashTableOverloaded(ht, stripe) &&
+       ht->numBits < 30) {
+      uint32 i;
+
+      ht->oldBuckets = ht->buckets;
+      ht->buckets = Util_SafeCalloc(2 * ht->numEntries, sizeof *ht->buckets);
+      ht->numEntries *= 2;
+      ht->numBits++;
+
+      for (i = 0; i < ht->numStripes; i++) {
+         ht->stripes[i].moved = 0;
+      }
+      Atomic_Write32(&ht->stripesMoved, 0);
+   }
+
+   HashTableUnlockAll(ht);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HashTableNewEntry --
+ *
+ *      Allocate an entry.
+ *
+ * Results:
+ *      The new entry.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static HashTableEntry *
+HashTableNewEntry(const HashTable *ht,  // IN:
+                  const void *keyStr,   // IN:
+                  void *clientData,     // IN/OPT:
+                  uint32 hash)          // IN:
+{
+   HashTableEntry *entry = Util_SafeMalloc(sizeof *entry);
+
+   if (ht->copyKey) {
+      entry->keyStr = Util_SafeStrdup(keyStr);
+   } else {
+      entry->keyStr = keyStr;
+   }
+   Atomic_WritePtr(&entry->clientData, clientData);
+   entry->hash = hash;
+
+   return entry;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -228,6 +738,7 @@ HashTable_Alloc(uint32 numEntries,        // IN: must be a power of 2
    HashTable *ht;
 
    ASSERT(numEntries > 0);
+   ASSERT((keyType & HASH_FLAG_RESIZE) == 0 || numEntries < (1 << 30));
    if ((numEntries & (numEntries - 1)) != 0) {
       Panic("%s only takes powers of 2 \n", __FUNCTION__);
    }
@@ -245,10 +756,24 @@ HashTable_Alloc(uint32 numEntries,        // IN: must be a power of 2
    ht->keyType = keyType & HASH_TYPE_MASK;
    ht->atomic = (keyType & HASH_FLAG_ATOMIC) != 0;
    ht->copyKey = (keyType & HASH_FLAG_COPYKEY) != 0;
+   ht->resize = (keyType & HASH_FLAG_RESIZE) != 0;
+   ht->strongHash = ht->resize || (keyType & HASH_FLAG_STRONGHASH) != 0;
    ht->freeEntryFn = fn;
    ht->buckets = Util_SafeCalloc(ht->numEntries, sizeof *ht->buckets);
    ht->numElements = 0;
 
+   ht->oldBuckets = NULL;
+   ht->numStripes = 1;
+   ht->stripes = NULL;
+   if (ht->resize) {
+      if (ht->atomic) {
+         ht->numStripes = MIN(numEntries, HASH_MAX_STRIPES);
+      }
+      ht->stripes = Util_SafeCalloc(ht->numStripes, sizeof *ht->stripes);
+   }
+   ht->stripeBits = lssb32_0(ht->numStripes);
+   Atomic_Write32(&ht->stripesMoved, 0);
+
 #ifndef NO_ATOMIC_HASHTABLE
    if (ht->atomic) {
       Atomic_Init();
@@ -323,15 +848,16 @@ HashTable_AllocOnce(Atomic_Ptr *var,          // IN/OUT: the atomic var
 static void
 HashTableClearInternal(HashTable *ht)  // IN/OUT:
 {
-   int i;
+   uint32 i;
 
    ht->numElements = 0;
 
-   for (i = 0; i < ht->numEntries; i++) {
+   for (i = 0; i < HashTableNumLinks(ht); i++) {
+      HashTableLink *bucket = HashTableLinkAt(ht, i);
       HashTableEntry *entry;
 
-      while ((entry = ENTRY(ht->buckets[i])) != NULL) {
-         SETENTRY(ht->buckets[i], ENTRY(entry->next));
+      while ((entry = ENTRY(*bucket)) != NULL) {
+         SETENTRY(*bucket, ENTRY(entry->next));
          if (ht->copyKey) {
             free((void *) entry->keyStr);
          }
@@ -341,6 +867,13 @@ HashTableClearInternal(HashTable *ht)  // IN/OUT:
          free(entry);
       }
    }
+
+   /* Nothing left to move. */
+   free(ht->oldBuckets);
+   ht->oldBuckets = NULL;
+   for (i = 0; i < ht->numStripes && ht->stripes != NULL; i++) {
+      ht->stripes[i].numElements = 0;
+   }
 }
 
 
@@ -380,6 +913,7 @@ HashTable_Free(HashTable *ht)  // IN/OUT:
       HashTableClearInternal(ht);
 
       free(ht->buckets);
+      free(ht->stripes);
       free(ht);
    }
 }
@@ -410,6 +944,7 @@ HashTable_FreeUnsafe(HashTable *ht)  // IN/OUT:
       HashTableClearInternal(ht);
 
       free(ht->buckets);
+      free(ht->stripes);
       free(ht);
    }
 }
@@ -438,10 +973,11 @@ HashTableLookup(const HashTable *ht,  // IN:
 {
    HashTableEntry *entry;
 
-   for (entry = ENTRY(ht->buckets[hash]);
+   for (entry = ENTRY(*HashTableBucket(ht, hash));
         entry != NULL;
         entry = ENTRY(entry->next)) {
-      if (HashTableEqualKeys(ht, entry->keyStr, keyStr)) {
+      if (entry->hash == hash &&
+          HashTableEqualKeys(ht, entry->keyStr, keyStr)) {
          return entry;
       }
    }
@@ -473,17 +1009,15 @@ HashTable_Lookup(const HashTable  *ht, // IN:
                  void **clientData)    // OUT/OPT:
 {
    uint32 hash = HashTableComputeHash(ht, keyStr);
+   HashTableStripe *stripe = HashTableLock(ht, hash);
    HashTableEntry *entry = HashTableLookup(ht, keyStr, hash);
 
-   if (entry == NULL) {
-      return FALSE;
-   }
-
-   if (clientData) {
+   if (entry != NULL && clientData) {
       *clientData = Atomic_ReadPtr(&entry->clientData);
    }
+   HashTableUnlock(ht, stripe);
 
-   return TRUE;
+   return entry != NULL;
 }
 
 
@@ -544,10 +1078,11 @@ HashTable_LookupAndDelete(HashTable *ht,       // IN/OUT: the hash table
 
    ASSERT(!ht->atomic);
 
-   for (linkp = &ht->buckets[hash];
+   for (linkp = HashTableBucket(ht, hash);
         (entry = ENTRY(*linkp)) != NULL;
         linkp = &entry->next) {
-      if (HashTableEqualKeys(ht, entry->keyStr, keyStr)) {
+      if (entry->hash == hash &&
+          HashTableEqualKeys(ht, entry->keyStr, keyStr)) {
          SETENTRY(*linkp, ENTRY(entry->next));
          ht->numElements--;
          if (ht->copyKey) {
@@ -560,6 +1095,10 @@ HashTable_LookupAndDelete(HashTable *ht,       // IN/OUT: the hash table
          }
          free(entry);
 
+         if (ht->resize && HashTableMove(ht, ht->stripes)) {
+            HashTableGrow(ht, ht->stripes);
+         }
+
          return TRUE;
       }
    }
@@ -705,9 +1244,13 @@ HashTable_ReplaceIfEqual(HashTable *ht,        // IN/OUT:
                          void *newClientData)  // IN/OPT:
 {
    uint32 hash = HashTableComputeHash(ht, keyStr);
+   HashTableStripe *stripe = HashTableLock(ht, hash);
    HashTableEntry *entry = HashTableLookup(ht, keyStr, hash);
    Bool retval = FALSE;
 
+   /* Entries of atomic tables stay where they are once found. */
+   HashTableUnlock(ht, stripe);
+
    if (entry == NULL) {
       return FALSE;
    }
@@ -762,12 +1305,23 @@ HashTableLookupOrInsert(HashTable *ht,       // IN/OUT:
    HashTableEntry *entry = NULL;
    HashTableEntry *oldEntry = NULL;
    HashTableEntry *head;
+   HashTableLink *bucket;
+   HashTableStripe *stripe;
+   Bool grow = FALSE;
+
+   /* Do not allocate with a stripe locked. */
+   if (ht->atomic && ht->resize) {
+      entry = HashTableNewEntry(ht, keyStr, clientData, hash);
+   }
+   stripe = HashTableLock(ht, hash);
 
 again:
-   head = ENTRY(ht->buckets[hash]);
+   bucket = HashTableBucket(ht, hash);
+   head = ENTRY(*bucket);
 
    oldEntry = HashTableLookup(ht, keyStr, hash);
    if (oldEntry != NULL) {
+      HashTableUnlock(ht, stripe);
       if (entry != NULL) {
          if (ht->copyKey) {
             free((void *) entry->keyStr);
@@ -779,24 +1333,31 @@ again:
    }
 
    if (entry == NULL) {
-      entry = Util_SafeMalloc(sizeof *entry);
-      if (ht->copyKey) {
-         entry->keyStr = Util_SafeStrdup(keyStr);
-      } else {
-         entry->keyStr = keyStr;
-      }
-      Atomic_WritePtr(&entry->clientData, clientData);
+      entry = HashTableNewEntry(ht, keyStr, clientData, hash);
    }
    SETENTRY(entry->next, head);
-   if (ht->atomic) {
-      if (!SETENTRYATOMIC(ht->buckets[hash], head, entry)) {
+   if (ht->atomic && !ht->resize) {
+      if (!SETENTRYATOMIC(*bucket, head, entry)) {
          goto again;
       }
    } else {
-      SETENTRY(ht->buckets[hash], entry);
+      SETENTRY(*bucket, entry);
    }
 
-   ht->numElements++;
+   if (ht->atomic && ht->resize) {
+      stripe->numElements++;
+   } else {
+      ht->numElements++;
+   }
+
+   if (ht->resize) {
+      grow = HashTableMove(ht, stripe);
+   }
+   HashTableUnlock(ht, stripe);
+
+   if (grow) {
+      HashTableGrow(ht, stripe);
+   }
 
    return NULL;
 }
@@ -832,6 +1393,56 @@ HashTable_GetNumElements(const HashTable *ht)  // IN:
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HashTable_GetStats --
+ *
+ *      Get the occupancy of the buckets of a hash table, counting the old
+ *      buckets of a table being resized. Atomic tables must not be
+ *      modified meanwhile.
+ *
+ * Results:
+ *      The statistics.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HashTable_GetStats(const HashTable *ht,    // IN:
+                   HashTableStats *stats)  // OUT:
+{
+   uint32 i;
+
+   ASSERT(ht);
+   ASSERT(stats);
+
+   memset(stats, 0, sizeof *stats);
+   stats->numBuckets = HashTableNumLinks(ht);
+
+   for (i = 0; i < HashTableNumLinks(ht); i++) {
+      HashTableEntry *entry;
+      size_t length = 0;
+
+      for (entry = ENTRY(*HashTableLinkAt(ht, i));
+           entry != NULL;
+           entry = ENTRY(entry->next)) {
+         length++;
+      }
+
+      if (length != 0) {
+         stats->usedBuckets++;
+         stats->maxChain = MAX(stats->maxChain, length);
+         stats->numElements += length;
+         stats->probes += (uint64) length * (length + 1) / 2;
+      }
+   }
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -875,10 +1486,10 @@ HashTable_KeyArray(const HashTable *ht,  // IN:
    *keys = Util_SafeMalloc(*size * sizeof **keys);
 
    /* fill array */
-   for (i = 0, j = 0; i < ht->numEntries; i++) {
+   for (i = 0, j = 0; i < HashTableNumLinks(ht); i++) {
       HashTableEntry *entry;
 
-      for (entry = ENTRY(ht->buckets[i]);
+      for (entry = ENTRY(*HashTableLinkAt(ht, i));
            entry != NULL;
            entry = ENTRY(entry->next)) {
          (*keys)[j++] = entry->keyStr;
@@ -931,10 +1542,10 @@ HashTable_ToArray(const HashTable *ht,  // IN:
    *clientDatas = Util_SafeMalloc(*size * sizeof **clientDatas);
 
    /* fill array */
-   for (i = 0, j = 0; i < ht->numEntries; i++) {
+   for (i = 0, j = 0; i < HashTableNumLinks(ht); i++) {
       HashTableEntry *entry;
 
-      for (entry = ENTRY(ht->buckets[i]);
+      for (entry = ENTRY(*HashTableLinkAt(ht, i));
            entry != NULL;
            entry = ENTRY(entry->next)) {
          (*clientDatas)[j++] = Atomic_ReadPtr(&entry->clientData);
@@ -967,15 +1578,15 @@ HashTable_ForEach(const HashTable *ht,          // IN:
                   HashTableForEachCallback cb,  // IN:
                   void *clientData)             // IN:
 {
-   int i;
+   uint32 i;
 
    ASSERT(ht);
    ASSERT(cb);
 
-   for (i = 0; i < ht->numEntries; i++) {
+   for (i = 0; i < HashTableNumLinks(ht); i++) {
       HashTableEntry *entry;
 
-      for (entry = ENTRY(ht->buckets[i]);
+      for (entry = ENTRY(*HashTableLinkAt(ht, i));
            entry != NULL;
            entry = ENTRY(entry->next)) {
          int result = (*cb)(entry->keyStr, Atomic_ReadPtr(&entry->clientData),
@@ -1011,18 +1622,18 @@ HashTable_ForEach(const HashTable *ht,          // IN:
 void
 HashPrint(HashTable *ht) // IN
 {
-   int i;
+   uint32 i;
 
-   for (i = 0; i < ht->numEntries; i++) {
+   for (i = 0; i < HashTableNumLinks(ht); i++) {
       HashTableEntry *entry;
 
-      if (ht->buckets[i] == NULL) {
+      if (ENTRY(*HashTableLinkAt(ht, i)) == NULL) {
          continue;
       }
 
-      printf("%4d: \n", i);
+      printf("%4u: \n", i);
 
-      for (entry = ENTRY(ht->buckets[i]);
+      for (entry = ENTRY(*HashTableLinkAt(ht, i));
            entry != NULL;
            entry = ENTRY(entry->next)) {
          if (ht->keyType == HASH_INT_KEY) {
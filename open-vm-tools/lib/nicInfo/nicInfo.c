@@ -204,7 +204,7 @@ GuestInfoAddNicEntry(NicInfoV3 *nicInfo,
       return NULL;
    }
 
-   newNic = XDRUTIL_ARRAYAPPEND(nicInfo, nics, 1);
+   newNic = XDRUTIL_ARRAYAPPEND_GEOMETRIC(nicInfo, nics, 1);
    ASSERT_MEM_ALLOC(newNic);
 
    newNic->macAddress = Util_SafeStrdup(macAddress);
@@ -250,7 +250,7 @@ GuestInfoAddIpAddress(GuestNicV3 *nic,
       return NULL;
    }
 
-   ip = XDRUTIL_ARRAYAPPEND(nic, ips, 1);
+   ip = XDRUTIL_ARRAYAPPEND_GEOMETRIC(nic, ips, 1);
    ASSERT_MEM_ALLOC(ip);
 
    ASSERT_ON_COMPILE(sizeof *origin == sizeof *ip->ipAddressOrigin);
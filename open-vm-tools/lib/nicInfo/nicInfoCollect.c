@@ -0,0 +1,885 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file nicInfoCollect.c
+ *
+ * Interface inventory of the GuestInfo collector library.
+ *
+ * The platform code records every interface and address it enumerates in a
+ * NicInventory. Only once the enumeration is done are the interfaces ranked,
+ * by the rules set with GuestInfo_SetNicRules, and the best ones copied into
+ * the NicInfoV3, up to NICINFO_MAX_NICS interfaces of NICINFO_MAX_IPS
+ * addresses each. So the uplinks of a guest running hundreds of containers
+ * are reported whatever the order the OS lists its interfaces in. When all
+ * the interfaces fit and no ranking rule is configured, they are reported
+ * in the order the OS lists them.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "vmware.h"
+#include "conf.h"
+#include "nicInfoInt.h"
+#include "str.h"
+#include "util.h"
+#include "xdrutil.h"
+
+
+/**
+ * Interfaces ranked last unless the user says otherwise: the host side of
+ * container, virtual machine and overlay network links.
+ */
+#define NICINFO_DEFAULT_LOW_PRIORITY \
+   "veth*,cali*,docker*,br-*,cni*,flannel*,vxlan*,tunl*,virbr*,vnet*," \
+   "weave*,kube-*"
+
+/**
+ * Interface classes, in rank order.
+ */
+typedef enum NicClass {
+   NIC_CLASS_PRIMARY,
+   NIC_CLASS_NORMAL,
+   NIC_CLASS_LOW,
+   NIC_CLASS_EXCLUDED,
+} NicClass;
+
+typedef struct NicAddress {
+   struct sockaddr_storage ss;
+   InetAddressPrefixLength pfxLen;
+} NicAddress;
+
+typedef struct NicEntry {
+   char *name;
+   char macAddress[NICINFO_MAC_LEN];
+   NicClass nicClass;
+   guint order;            // enumeration order
+   GPtrArray *addrs;       // NicAddress, in enumeration order
+   GHashTable *seen;       // the NicAddresses, for deduplication
+} NicEntry;
+
+struct NicInventory {
+   GPtrArray *nics;        // NicEntry
+   GHashTable *byName;     // name -> NicEntry
+   NicInfoDropped dropped;
+};
+
+/*
+ * The rules, compiled: arrays of GPatternSpec for the primary, low priority
+ * and excluded classes. The low priority rules start as the default ones.
+ * Not locked: rules are set and used by the thread gathering guest info.
+ */
+static GPtrArray *nicRules[NIC_CLASS_EXCLUDED + 1];
+static Bool nicRulesSet;
+static Bool nicRanksConfigured;   // Primary or low priority rules were given
+
+
+/*
+ * Local functions.
+ */
+
+
+/*
+ ******************************************************************************
+ * NicRulesCompile --                                                    */ /**
+ *
+ * @brief Compiles a rule list: comma separated glob patterns.
+ *
+ * @param[in] list  The rule list, may be NULL.
+ *
+ * @return The GPatternSpecs of the non-empty patterns, NULL if none.
+ *
+ ******************************************************************************
+ */
+
+static GPtrArray *
+NicRulesCompile(const char *list)
+{
+   GPtrArray *specs = NULL;
+   gchar **patterns;
+   guint i;
+
+   if (list == NULL) {
+      return NULL;
+   }
+
+   patterns = g_strsplit(list, ",", 0);
+   for (i = 0; patterns[i] != NULL; i++) {
+      gchar *pattern = g_strstrip(patterns[i]);
+
+      if (*pattern == '\0') {
+         continue;
+      }
+      if (specs == NULL) {
+         specs = g_ptr_array_new();
+      }
+      g_ptr_array_add(specs, g_pattern_spec_new(pattern));
+   }
+   g_strfreev(patterns);
+
+   return specs;
+}
+
+
+/*
+ ******************************************************************************
+ * NicRulesFree --                                                       */ /**
+ *
+ * @brief Frees compiled rules.
+ *
+ * @param[in] specs  The GPatternSpecs, may be NULL.
+ *
+ ******************************************************************************
+ */
+
+static void
+NicRulesFree(GPtrArray *specs)
+{
+   guint i;
+
+   if (specs == NULL) {
+      return;
+   }
+
+   for (i = 0; i < specs->len; i++) {
+      g_pattern_spec_free(g_ptr_array_index(specs, i));
+   }
+   g_ptr_array_free(specs, TRUE);
+}
+
+
+/*
+ ******************************************************************************
+ * NicRulesMatch --                                                      */ /**
+ *
+ * @brief Tells whether an interface name matches compiled rules.
+ *
+ * @param[in] specs  The GPatternSpecs, may be NULL.
+ * @param[in] name   Interface name.
+ *
+ * @retval TRUE  One of the patterns matches.
+ * @retval FALSE None does.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+NicRulesMatch(const GPtrArray *specs,
+              const char *name)
+{
+   guint i;
+
+   if (specs == NULL) {
+      return FALSE;
+   }
+
+   for (i = 0; i < specs->len; i++) {
+      if (g_pattern_match_string(g_ptr_array_index(specs, i), name)) {
+         return TRUE;
+      }
+   }
+
+   return FALSE;
+}
+
+
+/*
+ ******************************************************************************
+ * NicClassify --                                                        */ /**
+ *
+ * @brief Classifies an interface by name. The exclude rules take precedence
+ * over the primary ones, which take precedence over the low priority ones.
+ *
+ * @param[in] name   Interface name.
+ *
+ * @return The class of the interface.
+ *
+ ******************************************************************************
+ */
+
+static NicClass
+NicClassify(const char *name)
+{
+   if (!nicRulesSet) {
+      GuestInfo_SetNicRules(NULL, NULL, NULL);
+   }
+
+   if (NicRulesMatch(nicRules[NIC_CLASS_EXCLUDED], name)) {
+      return NIC_CLASS_EXCLUDED;
+   }
+   if (NicRulesMatch(nicRules[NIC_CLASS_PRIMARY], name)) {
+      return NIC_CLASS_PRIMARY;
+   }
+   if (NicRulesMatch(nicRules[NIC_CLASS_LOW], name)) {
+      return NIC_CLASS_LOW;
+   }
+
+   return NIC_CLASS_NORMAL;
+}
+
+
+/*
+ ******************************************************************************
+ * NicAddressBytes --                                                    */ /**
+ *
+ * @brief Locates the address of an AF_INET or AF_INET6 sockaddr.
+ *
+ * @param[in]  addr  The address.
+ * @param[out] len   Length of the address.
+ *
+ * @return The address bytes.
+ *
+ ******************************************************************************
+ */
+
+static const uint8 *
+NicAddressBytes(const NicAddress *addr,
+                size_t *len)
+{
+   if (addr->ss.ss_family == AF_INET) {
+      const struct sockaddr_in *sin = (const struct sockaddr_in *)&addr->ss;
+
+      *len = sizeof sin->sin_addr;
+      return (const uint8 *)&sin->sin_addr;
+   } else {
+      const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6 *)&addr->ss;
+
+      ASSERT(addr->ss.ss_family == AF_INET6);
+      *len = sizeof sin6->sin6_addr;
+      return (const uint8 *)&sin6->sin6_addr;
+   }
+}
+
+
+/*
+ ******************************************************************************
+ * NicAddressHash --                                                     */ /**
+ *
+ * @brief GHashFunc of NicAddresses: FNV-1a of the family and address. The
+ * prefix length is not part of the key.
+ *
+ * @param[in] key    A NicAddress.
+ *
+ * @return The hash.
+ *
+ ******************************************************************************
+ */
+
+static guint
+NicAddressHash(gconstpointer key)
+{
+   const NicAddress *addr = key;
+   const uint8 *bytes;
+   size_t len;
+   size_t i;
+   guint hash = 2166136261U ^ addr->ss.ss_family;
+
+   bytes = NicAddressBytes(addr, &len);
+   for (i = 0; i < len; i++) {
+      hash = (hash ^ bytes[i]) * 16777619U;
+   }
+
+   return hash;
+}
+
+
+/*
+ ******************************************************************************
+ * NicAddressEqual --                                                    */ /**
+ *
+ * @brief GEqualFunc of NicAddresses.
+ *
+ * @param[in] a   A NicAddress.
+ * @param[in] b   Another one.
+ *
+ * @retval TRUE  Same family and address.
+ * @retval FALSE Otherwise.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+NicAddressEqual(gconstpointer a,
+                gconstpointer b)
+{
+   const uint8 *aBytes;
+   const uint8 *bBytes;
+   size_t aLen;
+   size_t bLen;
+
+   if (((const NicAddress *)a)->ss.ss_family !=
+       ((const NicAddress *)b)->ss.ss_family) {
+      return FALSE;
+   }
+
+   aBytes = NicAddressBytes(a, &aLen);
+   bBytes = NicAddressBytes(b, &bLen);
+
+   return aLen == bLen && memcmp(aBytes, bBytes, aLen) == 0;
+}
+
+
+/*
+ ******************************************************************************
+ * NicEntryFree --                                                       */ /**
+ *
+ * @brief Frees an interface of the inventory.
+ *
+ * @param[in] data   The NicEntry.
+ *
+ ******************************************************************************
+ */
+
+static void
+NicEntryFree(gpointer data)
+{
+   NicEntry *entry = data;
+   guint i;
+
+   g_hash_table_destroy(entry->seen);
+   for (i = 0; i < entry->addrs->len; i++) {
+      g_free(g_ptr_array_index(entry->addrs, i));
+   }
+   g_ptr_array_free(entry->addrs, TRUE);
+   g_free(entry->name);
+   g_free(entry);
+}
+
+
+/*
+ ******************************************************************************
+ * NicEntryCompare --                                                    */ /**
+ *
+ * @brief Ranks interfaces: by class, then those with addresses first, then
+ * in enumeration order.
+ *
+ * @param[in] a   Pointer to a NicEntry pointer.
+ * @param[in] b   Pointer to another one.
+ *
+ * @return Negative, zero or positive as @a a ranks before, with or after
+ *         @a b.
+ *
+ ******************************************************************************
+ */
+
+static gint
+NicEntryCompare(gconstpointer a,
+                gconstpointer b)
+{
+   const NicEntry *aEntry = *(NicEntry * const *)a;
+   const NicEntry *bEntry = *(NicEntry * const *)b;
+   Bool aAddrs = aEntry->addrs->len != 0;
+   Bool bAddrs = bEntry->addrs->len != 0;
+
+   if (aEntry->nicClass != bEntry->nicClass) {
+      return aEntry->nicClass < bEntry->nicClass ? -1 : 1;
+   }
+   if (aAddrs != bAddrs) {
+      return aAddrs ? -1 : 1;
+   }
+
+   return aEntry->order < bEntry->order ? -1 : aEntry->order > bEntry->order;
+}
+
+
+/*
+ ******************************************************************************
+ * RouteCompare --                                                       */ /**
+ *
+ * @brief Ranks routes: default routes first, then by rank of their NIC,
+ * then in enumeration order.
+ *
+ * @param[in] a   Pointer to an InetCidrRouteEntry pointer.
+ * @param[in] b   Pointer to another one.
+ *
+ * @return Negative, zero or positive as @a a ranks before, with or after
+ *         @a b.
+ *
+ ******************************************************************************
+ */
+
+static gint
+RouteCompare(gconstpointer a,
+             gconstpointer b)
+{
+   const InetCidrRouteEntry *aRoute = *(InetCidrRouteEntry * const *)a;
+   const InetCidrRouteEntry *bRoute = *(InetCidrRouteEntry * const *)b;
+   Bool aDefault = aRoute->inetCidrRoutePfxLen == 0;
+   Bool bDefault = bRoute->inetCidrRoutePfxLen == 0;
+
+   if (aDefault != bDefault) {
+      return aDefault ? -1 : 1;
+   }
+   if (aRoute->inetCidrRouteIfIndex != bRoute->inetCidrRouteIfIndex) {
+      return aRoute->inetCidrRouteIfIndex < bRoute->inetCidrRouteIfIndex ?
+             -1 : 1;
+   }
+
+   /* The pointers are into the routes array, in enumeration order. */
+   return aRoute < bRoute ? -1 : aRoute > bRoute;
+}
+
+
+/*
+ * Global functions.
+ */
+
+
+/*
+ ******************************************************************************
+ * GuestInfo_SetNicRules --                                              */ /**
+ *
+ * @brief Sets the rules ranking the interfaces to report.
+ *
+ * Each rule list is a comma separated list of glob patterns matched against
+ * interface names, e.g. "eth*,ens*". Interfaces matching the exclude rules
+ * are never reported. Then come the ones matching the primary rules, then
+ * those matching none, then those matching the low priority rules.
+ *
+ * The default rules only rank the interfaces when there are more than
+ * NICINFO_MAX_NICS of them; otherwise they are reported in the OS order.
+ *
+ * @param[in] primary      Primary rules, NULL for none.
+ * @param[in] lowPriority  Low priority rules, NULL for the default ones: the
+ *                         usual container and virtual network interfaces.
+ * @param[in] exclude      Exclude rules, NULL for none.
+ *
+ ******************************************************************************
+ */
+
+void
+GuestInfo_SetNicRules(const char *primary,
+                      const char *lowPriority,
+                      const char *exclude)
+{
+   NicClass nicClass;
+
+   for (nicClass = NIC_CLASS_PRIMARY; nicClass <= NIC_CLASS_EXCLUDED;
+        nicClass++) {
+      NicRulesFree(nicRules[nicClass]);
+   }
+
+   nicRules[NIC_CLASS_PRIMARY] = NicRulesCompile(primary);
+   nicRules[NIC_CLASS_NORMAL] = NULL;
+   nicRules[NIC_CLASS_LOW] =
+      NicRulesCompile(lowPriority != NULL ? lowPriority :
+                                            NICINFO_DEFAULT_LOW_PRIORITY);
+   nicRules[NIC_CLASS_EXCLUDED] = NicRulesCompile(exclude);
+   nicRulesSet = TRUE;
+   nicRanksConfigured = nicRules[NIC_CLASS_PRIMARY] != NULL ||
+                        (lowPriority != NULL &&
+                         nicRules[NIC_CLASS_LOW] != NULL);
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfo_SetNicRulesFromConfig --                                    */ /**
+ *
+ * @brief Sets the rules ranking the interfaces to report from the guestinfo
+ * section of the tools configuration, so that vmtoolsd and toolbox-cmd
+ * report the same interfaces.
+ *
+ * @param[in] config   The configuration, NULL for the default rules.
+ *
+ * @sa CONFNAME_GUESTINFO_PRIMARYNICS
+ * @sa CONFNAME_GUESTINFO_LOWPRIORITYNICS
+ * @sa CONFNAME_GUESTINFO_EXCLUDENICS
+ *
+ ******************************************************************************
+ */
+
+void
+GuestInfo_SetNicRulesFromConfig(GKeyFile *config)
+{
+   gchar *primary = NULL;
+   gchar *lowPriority = NULL;
+   gchar *exclude = NULL;
+
+   /*
+    * Unset keys are NULL: no primary or excluded NICs, and the default low
+    * priority ones.
+    */
+   if (config != NULL) {
+      primary = g_key_file_get_string(config, CONFGROUPNAME_GUESTINFO,
+                                      CONFNAME_GUESTINFO_PRIMARYNICS, NULL);
+      lowPriority = g_key_file_get_string(config, CONFGROUPNAME_GUESTINFO,
+                                          CONFNAME_GUESTINFO_LOWPRIORITYNICS,
+                                          NULL);
+      exclude = g_key_file_get_string(config, CONFGROUPNAME_GUESTINFO,
+                                      CONFNAME_GUESTINFO_EXCLUDENICS, NULL);
+   }
+
+   GuestInfo_SetNicRules(primary, lowPriority, exclude);
+
+   g_free(primary);
+   g_free(lowPriority);
+   g_free(exclude);
+}
+
+
+/*
+ * Private library functions.
+ */
+
+
+/*
+ ******************************************************************************
+ * GuestInfoInventoryNew --                                              */ /**
+ *
+ * @brief Creates an empty interface inventory.
+ *
+ * @return The inventory, free with GuestInfoInventoryFree.
+ *
+ ******************************************************************************
+ */
+
+NicInventory *
+GuestInfoInventoryNew(void)
+{
+   NicInventory *inv = g_new0(NicInventory, 1);
+
+   inv->nics = g_ptr_array_new();
+   inv->byName = g_hash_table_new(g_str_hash, g_str_equal);
+
+   return inv;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfoInventoryFree --                                             */ /**
+ *
+ * @brief Frees an interface inventory.
+ *
+ * @param[in] inv  The inventory, may be NULL.
+ *
+ ******************************************************************************
+ */
+
+void
+GuestInfoInventoryFree(NicInventory *inv)
+{
+   guint i;
+
+   if (inv == NULL) {
+      return;
+   }
+
+   g_hash_table_destroy(inv->byName);
+   for (i = 0; i < inv->nics->len; i++) {
+      NicEntryFree(g_ptr_array_index(inv->nics, i));
+   }
+   g_ptr_array_free(inv->nics, TRUE);
+   g_free(inv);
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfoInventoryAddNic --                                           */ /**
+ *
+ * @brief Records an interface, and classifies it by name.
+ *
+ * @param[in,out] inv         The inventory.
+ * @param[in]     name        Interface name.
+ * @param[in]     macAddress  MAC address of the interface.
+ *
+ * @retval TRUE  Interface recorded.
+ * @retval FALSE An interface of that name was already recorded.
+ *
+ ******************************************************************************
+ */
+
+Bool
+GuestInfoInventoryAddNic(NicInventory *inv,
+                         const char *name,
+                         const char macAddress[NICINFO_MAC_LEN])
+{
+   NicEntry *entry;
+
+   ASSERT(inv);
+   ASSERT(name);
+   ASSERT(macAddress);
+
+   if (g_hash_table_lookup(inv->byName, name) != NULL) {
+      return FALSE;
+   }
+
+   entry = g_new0(NicEntry, 1);
+   entry->name = g_strdup(name);
+   Str_Strcpy(entry->macAddress, macAddress, sizeof entry->macAddress);
+   entry->nicClass = NicClassify(name);
+   entry->order = inv->nics->len;
+   entry->addrs = g_ptr_array_new();
+   entry->seen = g_hash_table_new(NicAddressHash, NicAddressEqual);
+
+   g_ptr_array_add(inv->nics, entry);
+   g_hash_table_insert(inv->byName, entry->name, entry);
+
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfoInventoryAddAddress --                                       */ /**
+ *
+ * @brief Records an address of an interface. An address the interface already
+ * has is counted as dropped.
+ *
+ * @param[in,out] inv       The inventory.
+ * @param[in]     name      Interface name.
+ * @param[in]     sockAddr  The address, AF_INET or AF_INET6.
+ * @param[in]     pfxLen    Prefix length (use 0 if unknown).
+ *
+ * @retval TRUE  Address recorded.
+ * @retval FALSE Unknown interface, unsupported family, or duplicate address.
+ *
+ ******************************************************************************
+ */
+
+Bool
+GuestInfoInventoryAddAddress(NicInventory *inv,
+                             const char *name,
+                             const struct sockaddr *sockAddr,
+                             InetAddressPrefixLength pfxLen)
+{
+   NicEntry *entry;
+   NicAddress *addr;
+
+   ASSERT(inv);
+   ASSERT(sockAddr);
+
+   entry = g_hash_table_lookup(inv->byName, name);
+   if (entry == NULL) {
+      return FALSE;
+   }
+
+   addr = g_new0(NicAddress, 1);
+   switch (sockAddr->sa_family) {
+   case AF_INET:
+      memcpy(&addr->ss, sockAddr, sizeof (struct sockaddr_in));
+      break;
+   case AF_INET6:
+      memcpy(&addr->ss, sockAddr, sizeof (struct sockaddr_in6));
+      break;
+   default:
+      g_free(addr);
+      return FALSE;
+   }
+   addr->pfxLen = pfxLen;
+
+   if (g_hash_table_lookup(entry->seen, addr) != NULL) {
+      inv->dropped.duplicateIps++;
+      g_free(addr);
+      return FALSE;
+   }
+
+   g_ptr_array_add(entry->addrs, addr);
+   g_hash_table_insert(entry->seen, addr, addr);
+
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfoInventoryFinish --                                           */ /**
+ *
+ * @brief Ranks the interfaces of the inventory, and adds the best ones to the
+ * NIC list, within NICINFO_MAX_NICS interfaces of NICINFO_MAX_IPS addresses.
+ * The interfaces keep the OS order if they all fit and no primary or low
+ * priority rule is configured.
+ *
+ * @param[in,out] inv      The inventory.
+ * @param[in,out] nicInfo  NIC container, without NICs yet.
+ *
+ * @note The NICs come in rank order, which GuestInfoInventoryLimitRoutes
+ *       relies on.
+ *
+ ******************************************************************************
+ */
+
+void
+GuestInfoInventoryFinish(NicInventory *inv,
+                         NicInfoV3 *nicInfo)
+{
+   guint i;
+
+   ASSERT(inv);
+   ASSERT(nicInfo);
+   ASSERT(nicInfo->nics.nics_len == 0);
+
+   if (!nicRanksConfigured) {
+      guint numReported = 0;
+
+      for (i = 0; i < inv->nics->len; i++) {
+         NicEntry *entry = g_ptr_array_index(inv->nics, i);
+
+         numReported += entry->nicClass != NIC_CLASS_EXCLUDED;
+      }
+      if (numReported > NICINFO_MAX_NICS) {
+         g_ptr_array_sort(inv->nics, NicEntryCompare);
+      }
+   } else {
+      g_ptr_array_sort(inv->nics, NicEntryCompare);
+   }
+
+   for (i = 0; i < inv->nics->len; i++) {
+      NicEntry *entry = g_ptr_array_index(inv->nics, i);
+      GuestNicV3 *nic;
+      guint j;
+
+      if (entry->nicClass == NIC_CLASS_EXCLUDED) {
+         inv->dropped.excludedNics++;
+         continue;
+      }
+      if (nicInfo->nics.nics_len == NICINFO_MAX_NICS) {
+         inv->dropped.nics++;
+         continue;
+      }
+
+      nic = GuestInfoAddNicEntry(nicInfo, entry->macAddress, NULL, NULL);
+      ASSERT(nic);
+
+      for (j = 0; j < entry->addrs->len; j++) {
+         NicAddress *addr = g_ptr_array_index(entry->addrs, j);
+
+         if (nic->ips.ips_len == NICINFO_MAX_IPS) {
+            inv->dropped.ips += entry->addrs->len - j;
+            break;
+         }
+         GuestInfoAddIpAddress(nic, (struct sockaddr *)&addr->ss,
+                               addr->pfxLen, NULL, NULL);
+      }
+   }
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfoInventoryLimitRoutes --                                      */ /**
+ *
+ * @brief Keeps the NICINFO_MAX_ROUTES best routes of the NIC list: default
+ * routes first, then those of the best ranked NICs.
+ *
+ * @param[in,out] inv      The inventory the NICs come from.
+ * @param[in,out] nicInfo  NIC container, with all the routes.
+ *
+ ******************************************************************************
+ */
+
+void
+GuestInfoInventoryLimitRoutes(NicInventory *inv,
+                              NicInfoV3 *nicInfo)
+{
+   InetCidrRouteEntry **sorted;
+   InetCidrRouteEntry *kept;
+   u_int len = nicInfo->routes.routes_len;
+   u_int i;
+
+   ASSERT(inv);
+
+   if (len <= NICINFO_MAX_ROUTES) {
+      return;
+   }
+
+   sorted = g_new(InetCidrRouteEntry *, len);
+   for (i = 0; i < len; i++) {
+      sorted[i] = XDRUTIL_GETITEM(nicInfo, routes, i);
+   }
+   qsort(sorted, len, sizeof *sorted, RouteCompare);
+
+   kept = g_new(InetCidrRouteEntry, NICINFO_MAX_ROUTES);
+   for (i = 0; i < len; i++) {
+      if (i < NICINFO_MAX_ROUTES) {
+         kept[i] = *sorted[i];
+      } else {
+         VMX_XDR_FREE(xdr_InetCidrRouteEntry, sorted[i]);
+      }
+   }
+
+   /*
+    * Back in the routes array, which stays allocated as
+    * XDRUTIL_ARRAYAPPEND_GEOMETRIC expects from the shorter length.
+    */
+   memcpy(nicInfo->routes.routes_val, kept, NICINFO_MAX_ROUTES * sizeof *kept);
+   nicInfo->routes.routes_len = NICINFO_MAX_ROUTES;
+   g_free(kept);
+   g_free(sorted);
+   inv->dropped.routes += len - NICINFO_MAX_ROUTES;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfoInventoryGetDropped --                                       */ /**
+ *
+ * @brief Returns what the inventory did not report.
+ *
+ * @param[in] inv  The inventory.
+ *
+ * @return The dropped counts.
+ *
+ ******************************************************************************
+ */
+
+const NicInfoDropped *
+GuestInfoInventoryGetDropped(const NicInventory *inv)
+{
+   return &inv->dropped;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfoInventoryLogDropped --                                       */ /**
+ *
+ * @brief Logs what the inventory did not report: as a message when that
+ * changed since the last time, as a debug message otherwise.
+ *
+ * @param[in] inv  The inventory.
+ *
+ ******************************************************************************
+ */
+
+void
+GuestInfoInventoryLogDropped(const NicInventory *inv)
+{
+   static NicInfoDropped lastDropped;
+   const NicInfoDropped *dropped = &inv->dropped;
+   char summary[256];
+
+   Str_Sprintf(summary, sizeof summary,
+               "%u interfaces: %u excluded, %u over the limit (%d); "
+               "%u addresses over the limit (%d), %u duplicates; "
+               "%u routes over the limit (%d)",
+               inv->nics->len, dropped->excludedNics,
+               dropped->nics, NICINFO_MAX_NICS,
+               dropped->ips, NICINFO_MAX_IPS, dropped->duplicateIps,
+               dropped->routes, NICINFO_MAX_ROUTES);
+
+   if (memcmp(dropped, &lastDropped, sizeof *dropped) != 0) {
+      lastDropped = *dropped;
+      g_message("%s: %s.", __FUNCTION__, summary);
+   } else {
+      g_debug("%s: %s.", __FUNCTION__, summary);
+   }
+}
@@ -65,4 +65,41 @@ void GuestInfoSockaddrToTypedIpAddress(const struct sockaddr *sa,    // IN
 GuestNicV3 *
 GuestInfoUtilFindNicByMac(const NicInfoV3 *nicInfo,
                           const char *macAddress);
+
+/*
+ * Interface inventory: every interface is recorded before the ones reported
+ * are chosen.
+ */
+
+typedef struct NicInventory NicInventory;
+
+/*
+ * What an inventory did not report.
+ */
+typedef struct NicInfoDropped {
+   u_int excludedNics;  // NICs matching the exclude rules
+   u_int nics;          // NICs past NICINFO_MAX_NICS
+   u_int ips;           // addresses of reported NICs past NICINFO_MAX_IPS
+   u_int duplicateIps;  // addresses recorded twice for a NIC
+   u_int routes;        // routes past NICINFO_MAX_ROUTES
+} NicInfoDropped;
+
+NicInventory *GuestInfoInventoryNew(void);
+void GuestInfoInventoryFree(NicInventory *inv);
+
+Bool GuestInfoInventoryAddNic(NicInventory *inv,                       // IN/OUT
+                              const char *name,                        // IN
+                              const char macAddress[NICINFO_MAC_LEN]); // IN
+
+Bool GuestInfoInventoryAddAddress(NicInventory *inv,                // IN/OUT
+                                  const char *name,                 // IN
+                                  const struct sockaddr *sockAddr,  // IN
+                                  InetAddressPrefixLength pfxLen);  // IN
+
+void GuestInfoInventoryFinish(NicInventory *inv,    // IN/OUT
+                              NicInfoV3 *nicInfo);  // IN/OUT
+void GuestInfoInventoryLimitRoutes(NicInventory *inv,    // IN/OUT
+                                   NicInfoV3 *nicInfo);  // IN/OUT
+const NicInfoDropped *GuestInfoInventoryGetDropped(const NicInventory *inv);
+void GuestInfoInventoryLogDropped(const NicInventory *inv);
 #endif
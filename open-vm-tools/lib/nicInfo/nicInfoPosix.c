@@ -129,7 +129,8 @@
 
 
 #ifndef NO_DNET
-static void RecordNetworkAddress(GuestNicV3 *nic, const struct addr *addr);
+static void RecordNetworkAddress(NicInventory *inv, const char *name,
+                                 const struct addr *addr);
 static int ReadInterfaceDetails(const struct intf_entry *entry, void *arg);
 static Bool RecordRoutingInfo(NicInfoV3 *nicInfo);
 
@@ -232,7 +233,9 @@ Bool
 GuestInfoGetNicInfo(NicInfoV3 *nicInfo) // OUT
 {
 #ifndef NO_DNET
+   NicInventory *inv;
    intf_t *intf;
+   Bool ret = FALSE;
 
    /* Get a handle to read the network interface configuration details. */
    if ((intf = intf_open()) == NULL) {
@@ -240,89 +243,98 @@ GuestInfoGetNicInfo(NicInfoV3 *nicInfo) // OUT
       return FALSE;
    }
 
-   if (intf_loop(intf, ReadInterfaceDetails, nicInfo) < 0) {
+   /*
+    * Record all the interfaces first, to report the best ones rather than
+    * the first ones libdnet happens to enumerate.
+    */
+   inv = GuestInfoInventoryNew();
+
+   if (intf_loop(intf, ReadInterfaceDetails, inv) < 0) {
       intf_close(intf);
+      GuestInfoInventoryFree(inv);
       g_debug("Error, negative result from intf_loop\n");
       return FALSE;
    }
 
    intf_close(intf);
 
+   GuestInfoInventoryFinish(inv, nicInfo);
+
 #ifdef USE_RESOLVE
    if (!RecordResolverInfo(nicInfo)) {
-      return FALSE;
+      goto exit;
    }
 #endif
 
    if (!RecordRoutingInfo(nicInfo)) {
-      return FALSE;
+      goto exit;
    }
 
-   return TRUE;
+   GuestInfoInventoryLimitRoutes(inv, nicInfo);
+   GuestInfoInventoryLogDropped(inv);
+   ret = TRUE;
+
+exit:
+   GuestInfoInventoryFree(inv);
+   return ret;
 #elif defined(USERWORLD)
    struct ifaddrs *ifaddrs = NULL;
 
    if (getifaddrs(&ifaddrs) == 0 && ifaddrs != NULL) {
-      struct ifaddrs *pkt;
+      NicInventory *inv = GuestInfoInventoryNew();
+      struct ifaddrs *ifa;
+
       /*
        * ESXi reports an AF_PACKET record for each physical interface.
        * The MAC address is the first six bytes of sll_addr.  AF_PACKET
-       * records are intermingled with AF_INET and AF_INET6 records.
+       * records are intermingled with AF_INET and AF_INET6 records, so
+       * record the interfaces first, then their addresses.
        */
-      for (pkt = ifaddrs; pkt != NULL; pkt = pkt->ifa_next) {
-         GuestNicV3 *nic;
-         struct ifaddrs *ip;
-         struct sockaddr_ll *sll = (struct sockaddr_ll *)pkt->ifa_addr;
+      for (ifa = ifaddrs; ifa != NULL; ifa = ifa->ifa_next) {
+         struct sockaddr_ll *sll = (struct sockaddr_ll *)ifa->ifa_addr;
          if (sll != NULL && sll->sll_family == AF_PACKET) {
             char macAddress[NICINFO_MAC_LEN];
             Str_Sprintf(macAddress, sizeof macAddress,
                         "%02x:%02x:%02x:%02x:%02x:%02x",
                         sll->sll_addr[0], sll->sll_addr[1], sll->sll_addr[2],
                         sll->sll_addr[3], sll->sll_addr[4], sll->sll_addr[5]);
-            nic = GuestInfoAddNicEntry(nicInfo, macAddress, NULL, NULL);
-            if (nic == NULL) {
-               /*
-                * We reached the maximum number of NICs that we can report.
-                */
-               break;
-            }
+            GuestInfoInventoryAddNic(inv, ifa->ifa_name, macAddress);
+         }
+      }
+
+      for (ifa = ifaddrs; ifa != NULL; ifa = ifa->ifa_next) {
+         struct sockaddr *sa = (struct sockaddr *)ifa->ifa_addr;
+         if (sa != NULL) {
+            int family = sa->sa_family;
+            Bool goodAddress = FALSE;
+            unsigned nBits = 0;
             /*
-             * Now look for all IPv4 and IPv6 interfaces with the same
-             * interface name as the current AF_PACKET interface.
+             * Ignore any loopback addresses.
              */
-            for (ip = ifaddrs; ip != NULL; ip = ip->ifa_next) {
-               struct sockaddr *sa = (struct sockaddr *)ip->ifa_addr;
-               if (sa != NULL &&
-                   strncmp(ip->ifa_name, pkt->ifa_name, IFNAMSIZ) == 0) {
-                  int family = sa->sa_family;
-                  Bool goodAddress = FALSE;
-                  unsigned nBits = 0;
-                  /*
-                   * Ignore any loopback addresses.
-                   */
-                  if (family == AF_INET) {
-                     struct sockaddr_in *sin = (struct sockaddr_in *)sa;
-                     if ((ntohl(sin->sin_addr.s_addr) >> IN_CLASSA_NSHIFT) !=
-                         IN_LOOPBACKNET) {
-                        nBits = CountNetmaskBitsV4(ip->ifa_netmask);
-                        goodAddress = TRUE;
-                     }
-                  } else if (family == AF_INET6) {
-                     struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)sa;
-                     if (!IN6_IS_ADDR_LOOPBACK(&sin6->sin6_addr)) {
-                        nBits = CountNetmaskBitsV6(ip->ifa_netmask);
-                        goodAddress = TRUE;
-                     }
-                  }
-                  if (goodAddress) {
-                     GuestInfoAddIpAddress(nic, ip->ifa_addr, nBits, NULL,
-                                           NULL);
-                  }
+            if (family == AF_INET) {
+               struct sockaddr_in *sin = (struct sockaddr_in *)sa;
+               if ((ntohl(sin->sin_addr.s_addr) >> IN_CLASSA_NSHIFT) !=
+                   IN_LOOPBACKNET) {
+                  nBits = CountNetmaskBitsV4(ifa->ifa_netmask);
+                  goodAddress = TRUE;
+               }
+            } else if (family == AF_INET6) {
+               struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)sa;
+               if (!IN6_IS_ADDR_LOOPBACK(&sin6->sin6_addr)) {
+                  nBits = CountNetmaskBitsV6(ifa->ifa_netmask);
+                  goodAddress = TRUE;
                }
             }
+            if (goodAddress) {
+               GuestInfoInventoryAddAddress(inv, ifa->ifa_name, sa, nBits);
+            }
          }
       }
       freeifaddrs(ifaddrs);
+
+      GuestInfoInventoryFinish(inv, nicInfo);
+      GuestInfoInventoryLogDropped(inv);
+      GuestInfoInventoryFree(inv);
    }
 
 #ifdef USE_RESOLVE
@@ -424,17 +436,19 @@ GuestInfoGetPrimaryIP(void)
  ******************************************************************************
  * RecordNetworkAddress --                                               */ /**
  *
- * @brief Massages a dnet(3)-style interface address (IPv4 or IPv6) and stores
- *        it as part of a GuestNicV3 structure.
+ * @brief Massages a dnet(3)-style interface address (IPv4 or IPv6) and records
+ *        it in the interface inventory.
  *
- * @param[in]  nic      Operand NIC.
+ * @param[in]  inv      Interface inventory.
+ * @param[in]  name     Operand NIC name.
  * @param[in]  addr     dnet(3) address.
  *
  ******************************************************************************
  */
 
 static void
-RecordNetworkAddress(GuestNicV3 *nic,           // IN: operand NIC
+RecordNetworkAddress(NicInventory *inv,         // IN/OUT: interface inventory
+                     const char *name,          // IN: operand NIC
                      const struct addr *addr)   // IN: dnet(3) address to process
 {
    struct sockaddr_storage ss;
@@ -442,7 +456,7 @@ RecordNetworkAddress(GuestNicV3 *nic,           // IN: operand NIC
 
    memset(&ss, 0, sizeof ss);
    addr_ntos(addr, sa);
-   GuestInfoAddIpAddress(nic, sa, addr->addr_bits, NULL, NULL);
+   GuestInfoInventoryAddAddress(inv, name, sa, addr->addr_bits);
 }
 
 
@@ -454,9 +468,10 @@ RecordNetworkAddress(GuestNicV3 *nic,           // IN: operand NIC
  * on the host.
  *
  * @param[in]  entry    Current interface entry.
- * @param[in]  arg      Pointer to NicInfoV3 container.
+ * @param[in]  arg      Pointer to the NicInventory.
  *
- * @note New GuestNicV3 structures are added to the NicInfoV3 structure.
+ * @note Ethernet interfaces and their addresses are recorded in the
+ * NicInventory.
  *
  * @retval 0    Success.
  * @retval -1   Failure.
@@ -466,17 +481,16 @@ RecordNetworkAddress(GuestNicV3 *nic,           // IN: operand NIC
 
 static int
 ReadInterfaceDetails(const struct intf_entry *entry,  // IN: current interface entry
-                     void *arg)                       // IN: Pointer to the GuestNicList
+                     void *arg)                       // IN: Pointer to the NicInventory
 {
    int i;
-   NicInfoV3 *nicInfo = arg;
+   NicInventory *inv = arg;
 
    ASSERT(entry);
    ASSERT(arg);
 
    if (entry->intf_type == INTF_TYPE_ETH &&
        entry->intf_link_addr.addr_type == ADDR_TYPE_ETH) {
-      GuestNicV3 *nic = NULL;
       char macAddress[NICINFO_MAC_LEN];
 
       /*
@@ -489,18 +503,14 @@ ReadInterfaceDetails(const struct intf_entry *entry,  // IN: current interface e
       if (entry->intf_link_addr.addr_type == ADDR_TYPE_ETH) {
          Str_Sprintf(macAddress, sizeof macAddress, "%s",
                      addr_ntoa(&entry->intf_link_addr));
-         nic = GuestInfoAddNicEntry(nicInfo, macAddress, NULL, NULL);
-         if (NULL == nic) {
-            /*
-             * We reached maximum number of NICs we can report to the host.
-             */
+         if (!GuestInfoInventoryAddNic(inv, entry->intf_name, macAddress)) {
             return 0;
          }
 
          /* Record the "primary" address. */
          if (entry->intf_addr.addr_type == ADDR_TYPE_IP ||
              entry->intf_addr.addr_type == ADDR_TYPE_IP6) {
-            RecordNetworkAddress(nic, &entry->intf_addr);
+            RecordNetworkAddress(inv, entry->intf_name, &entry->intf_addr);
          }
 
          /* Walk the list of alias's and add those that are IPV4 or IPV6 */
@@ -508,7 +518,7 @@ ReadInterfaceDetails(const struct intf_entry *entry,  // IN: current interface e
             const struct addr *alias = &entry->intf_alias_addrs[i];
             if (alias->addr_type == ADDR_TYPE_IP ||
                 alias->addr_type == ADDR_TYPE_IP6) {
-               RecordNetworkAddress(nic, alias);
+               RecordNetworkAddress(inv, entry->intf_name, alias);
             }
          }
       }
@@ -699,6 +709,50 @@ RecordResolverNS(DnsConfigInfo *dnsConfigInfo) // IN
 #ifndef NO_DNET
 
 #ifdef USE_SLASH_PROC
+/*
+ ******************************************************************************
+ * GetRouteNicIndex --                                                   */ /**
+ *
+ * @brief GuestInfoGetNicInfoIfIndex, remembering the NIC of each interface
+ * across the routes of a routing table.
+ *
+ * @param[in]     nicInfo     NIC container.
+ * @param[in,out] nicIndexes  Interface index -> NIC offset + 1, or 0 if none.
+ * @param[in]     ifIndex     Device to search for.
+ * @param[out]    nicIndex    Array offset, if found.
+ *
+ * @retval TRUE  Device found.
+ * @retval FALSE Device not found.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+GetRouteNicIndex(NicInfoV3 *nicInfo,
+                 GHashTable *nicIndexes,
+                 int ifIndex,
+                 uint32_t *nicIndex)
+{
+   gpointer value;
+
+   if (!g_hash_table_lookup_extended(nicIndexes, GINT_TO_POINTER(ifIndex),
+                                     NULL, &value)) {
+      int index;
+
+      value = GuestInfoGetNicInfoIfIndex(nicInfo, ifIndex, &index) ?
+              GINT_TO_POINTER(index + 1) : NULL;
+      g_hash_table_insert(nicIndexes, GINT_TO_POINTER(ifIndex), value);
+   }
+
+   if (value == NULL) {
+      return FALSE;
+   }
+
+   *nicIndex = GPOINTER_TO_INT(value) - 1;
+   return TRUE;
+}
+
+
 /*
  ******************************************************************************
  * RecordRoutingInfoIPv4 --                                              */ /**
@@ -709,7 +763,8 @@ RecordResolverNS(DnsConfigInfo *dnsConfigInfo) // IN
  * @param[out] nicInfo  NicInfoV3 container.
  *
  * @note Do not call this routine without first populating @a nicInfo 's NIC
- * list.
+ * list.  All the routes are collected: the caller keeps the best
+ * NICINFO_MAX_ROUTES.
  *
  * @retval TRUE         Values collected, attached to @a nicInfo.
  * @retval FALSE        Something went wrong.  @a nicInfo is unharmed.
@@ -721,6 +776,7 @@ static Bool
 RecordRoutingInfoIPv4(NicInfoV3 *nicInfo)
 {
    GPtrArray *routes = NULL;
+   GHashTable *nicIndexes;
    guint i;
    Bool ret = FALSE;
 
@@ -728,6 +784,8 @@ RecordRoutingInfoIPv4(NicInfoV3 *nicInfo)
       return FALSE;
    }
 
+   nicIndexes = g_hash_table_new(g_direct_hash, g_direct_equal);
+
    for (i = 0; i < routes->len; i++) {
       struct rtentry *rtentry;
       struct sockaddr_in *sin_dst;
@@ -736,23 +794,15 @@ RecordRoutingInfoIPv4(NicInfoV3 *nicInfo)
       InetCidrRouteEntry *icre;
       uint32_t ifIndex;
 
-      /* Check to see if we're going above our limit. See bug 605821. */
-      if (nicInfo->routes.routes_len == NICINFO_MAX_ROUTES) {
-         g_message("%s: route limit (%d) reached, skipping overflow.",
-                   __FUNCTION__, NICINFO_MAX_ROUTES);
-         break;
-      }
-
       rtentry = g_ptr_array_index(routes, i);
 
       if ((rtentry->rt_flags & RTF_UP) == 0 ||
-          !GuestInfoGetNicInfoIfIndex(nicInfo,
-                                      if_nametoindex(rtentry->rt_dev),
-                                      &ifIndex)) {
+          !GetRouteNicIndex(nicInfo, nicIndexes,
+                            if_nametoindex(rtentry->rt_dev), &ifIndex)) {
          continue;
       }
 
-      icre = XDRUTIL_ARRAYAPPEND(nicInfo, routes, 1);
+      icre = XDRUTIL_ARRAYAPPEND_GEOMETRIC(nicInfo, routes, 1);
       ASSERT_MEM_ALLOC(icre);
 
       sin_dst = (struct sockaddr_in *)&rtentry->rt_dst;
@@ -784,6 +834,7 @@ RecordRoutingInfoIPv4(NicInfoV3 *nicInfo)
 
    ret = TRUE;
 
+   g_hash_table_destroy(nicIndexes);
    SlashProcNet_FreeRoute(routes);
    return ret;
 }
@@ -799,7 +850,8 @@ RecordRoutingInfoIPv4(NicInfoV3 *nicInfo)
  * @param[out] nicInfo  NicInfoV3 container.
  *
  * @note Do not call this routine without first populating @a nicInfo 's NIC
- * list.
+ * list.  All the routes are collected: the caller keeps the best
+ * NICINFO_MAX_ROUTES.
  *
  * @retval TRUE         Values collected, attached to @a nicInfo.
  * @retval FALSE        Something went wrong.  @a nicInfo is unharmed.
@@ -811,6 +863,7 @@ static Bool
 RecordRoutingInfoIPv6(NicInfoV3 *nicInfo)
 {
    GPtrArray *routes = NULL;
+   GHashTable *nicIndexes;
    guint i;
    Bool ret = FALSE;
 
@@ -818,6 +871,8 @@ RecordRoutingInfoIPv6(NicInfoV3 *nicInfo)
       return FALSE;
    }
 
+   nicIndexes = g_hash_table_new(g_direct_hash, g_direct_equal);
+
    for (i = 0; i < routes->len; i++) {
       struct sockaddr_storage ss;
       struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&ss;
@@ -825,22 +880,15 @@ RecordRoutingInfoIPv6(NicInfoV3 *nicInfo)
       InetCidrRouteEntry *icre;
       uint32_t ifIndex = -1;
 
-      /* Check to see if we're going above our limit. See bug 605821. */
-      if (nicInfo->routes.routes_len == NICINFO_MAX_ROUTES) {
-         g_message("%s: route limit (%d) reached, skipping overflow.",
-                   __FUNCTION__, NICINFO_MAX_ROUTES);
-         break;
-      }
-
       in6_rtmsg = g_ptr_array_index(routes, i);
 
       if ((in6_rtmsg->rtmsg_flags & RTF_UP) == 0 ||
-          !GuestInfoGetNicInfoIfIndex(nicInfo, in6_rtmsg->rtmsg_ifindex,
-                                      &ifIndex)) {
+          !GetRouteNicIndex(nicInfo, nicIndexes, in6_rtmsg->rtmsg_ifindex,
+                            &ifIndex)) {
          continue;
       }
 
-      icre = XDRUTIL_ARRAYAPPEND(nicInfo, routes, 1);
+      icre = XDRUTIL_ARRAYAPPEND_GEOMETRIC(nicInfo, routes, 1);
       ASSERT_MEM_ALLOC(icre);
 
       /*
@@ -872,6 +920,7 @@ RecordRoutingInfoIPv6(NicInfoV3 *nicInfo)
 
    ret = TRUE;
 
+   g_hash_table_destroy(nicIndexes);
    SlashProcNet_FreeRoute6(routes);
    return ret;
 }
@@ -223,88 +223,649 @@ done:
 }
 
 
+/*
+ * State shared by the entries of one /proc scan: a buffer reused for every
+ * /proc file read, a uid to user name cache so getpwuid() is called once
+ * per owner rather than once per process, and the previous snapshot (sorted
+ * by pid) for ProcMgr_ListProcessesIncremental().
+ */
+typedef struct ProcMgrUidName {
+   uid_t uid;
+   char *name;                    // UTF-8
+} ProcMgrUidName;
+
+typedef struct ProcMgrListState {
+   DynBuf fileBuf;
+   ProcMgrUidName *uidNames;
+   size_t numUidNames;
+   ProcMgrProcInfoArray *prevList;
+} ProcMgrListState;
+
+static time_t procMgrHostStartTime = 0;
+static unsigned long long procMgrHertz = 100;
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrInitStartTime --
+ *
+ *      Figure out when the system started.  We need this number to
+ *      compute process start times, which are relative to this number.
+ *      We grab the first float in /proc/uptime, convert it to an integer,
+ *      and then subtract that from the current time.  That leaves us
+ *      with the seconds since epoch that the system booted up.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Sets procMgrHostStartTime and procMgrHertz the first time.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ProcMgrInitStartTime(void)
+{
+   FILE *uptimeFile = NULL;
+   int numberFound;
+
+   if (0 != procMgrHostStartTime) {
+      return;
+   }
+
+   uptimeFile = fopen("/proc/uptime", "r");
+   if (NULL != uptimeFile) {
+      double secondsSinceBoot;
+      char *realLocale;
+
+      /*
+       * Set the locale such that floats are delimited with ".".
+       */
+      realLocale = setlocale(LC_NUMERIC, NULL);
+      setlocale(LC_NUMERIC, "C");
+      numberFound = fscanf(uptimeFile, "%lf", &secondsSinceBoot);
+      setlocale(LC_NUMERIC, realLocale);
+
+      /*
+       * Figure out system boot time in absolute terms.
+       */
+      if (numberFound) {
+         procMgrHostStartTime = time(NULL) - (time_t) secondsSinceBoot;
+      }
+      fclose(uptimeFile);
+   }
+
+   /*
+    * Figure out the "hertz" value, which may be radically
+    * different than the actual CPU frequency of the machine.
+    * The process start time is expressed in terms of this value,
+    * so let's compute it now and keep it in a static variable.
+    */
+#ifdef HZ
+   procMgrHertz = (unsigned long long) HZ;
+#else
+   /*
+    * Don't do anything.  Use the default value of 100.
+    */
+#endif
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrReadPidFile --
+ *
+ *      Read /proc/<pid>/<name> into the list state's file buffer,
+ *      replacing what was there.  The contents are NUL terminated.
+ *
+ * Results:
+ *      The length of the file (not counting the NUL), or -1 if the file
+ *      could not be opened or read.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ProcMgrReadPidFile(ProcMgrListState *state,   // IN/OUT
+                   const char *pidStr,        // IN
+                   const char *name)          // IN
+{
+   char path[64];
+   char tmp[512];
+   int numRead;
+   int size = 0;
+   int fd;
+
+   if (Str_Snprintf(path, sizeof path, "/proc/%s/%s", pidStr, name) == -1) {
+      Debug("Giant process id '%s'\n", pidStr);
+      return -1;
+   }
+
+   fd = open(path, O_RDONLY);
+   if (-1 == fd) {
+      return -1;
+   }
+
+   DynBuf_SetSize(&state->fileBuf, 0);
+   while ((numRead = read(fd, tmp, sizeof tmp)) > 0) {
+      if (!DynBuf_Append(&state->fileBuf, tmp, numRead)) {
+         numRead = -1;
+         break;
+      }
+      size += numRead;
+   }
+   close(fd);
+
+   if (numRead < 0 || !DynBuf_Append(&state->fileBuf, "", 1)) {
+      return -1;
+   }
+
+   return size;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrGetOwnerName --
+ *
+ *      Look up the name of a uid, going through the list state's cache.
+ *
+ * Results:
+ *      The user name, or the uid in decimal if it has none.  Must be
+ *      freed by the caller.
+ *
+ * Side effects:
+ *      May add an entry to the cache.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static char *
+ProcMgrGetOwnerName(ProcMgrListState *state,   // IN/OUT
+                    uid_t uid)                 // IN
+{
+   struct passwd *pwd;
+   char *name;
+   size_t i;
+
+   for (i = 0; i < state->numUidNames; i++) {
+      if (state->uidNames[i].uid == uid) {
+         return Util_SafeStrdup(state->uidNames[i].name);
+      }
+   }
+
+   pwd = getpwuid(uid);
+   name = (NULL == pwd)
+          ? Str_SafeAsprintf(NULL, "%d", (int) uid)
+          : Unicode_Alloc(pwd->pw_name, STRING_ENCODING_DEFAULT);
+
+   state->uidNames = Util_SafeRealloc(state->uidNames,
+                                      (state->numUidNames + 1) *
+                                      sizeof *state->uidNames);
+   state->uidNames[state->numUidNames].uid = uid;
+   state->uidNames[state->numUidNames].name = name;
+   state->numUidNames++;
+
+   return Util_SafeStrdup(name);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrFindPrevEntry --
+ *
+ *      Look up a pid in the previous snapshot.
+ *
+ * Results:
+ *      The entry, or NULL if there is none.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static ProcMgrProcInfo *
+ProcMgrFindPrevEntry(ProcMgrListState *state,   // IN
+                     pid_t pid)                 // IN
+{
+   size_t lo = 0;
+   size_t hi;
+
+   if (NULL == state->prevList) {
+      return NULL;
+   }
+
+   hi = ProcMgrProcInfoArray_Count(state->prevList);
+   while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      ProcMgrProcInfo *procInfo =
+         ProcMgrProcInfoArray_AddressOf(state->prevList, mid);
+
+      if (procInfo->procId == pid) {
+         return procInfo;
+      } else if (procInfo->procId < pid) {
+         lo = mid + 1;
+      } else {
+         hi = mid;
+      }
+   }
+
+   return NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrSameCmdLine --
+ *
+ *      Check whether the contents of /proc/<pid>/cmdline give the command
+ *      line of a previous listing, once the separating NULs are turned
+ *      into spaces.
+ *
+ * Results:
+ *      TRUE if they do.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+ProcMgrSameCmdLine(const char *prevCmdLine,  // IN
+                   const char *cmdLine,      // IN: NUL terminated
+                   int numRead)              // IN
+{
+   int i;
+
+   for (i = 0; i < numRead - 1; i++) {
+      if (prevCmdLine[i] != ('\0' == cmdLine[i] ? ' ' : cmdLine[i])) {
+         return FALSE;
+      }
+   }
+
+   return strcmp(prevCmdLine + i, cmdLine + i) == 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrReadCmdLine --
+ *
+ *      Read the command name and line of a process.  If they are those of
+ *      the same process in the previous listing, that entry's strings are
+ *      taken over rather than allocated again.
+ *
+ * Results:
+ *      TRUE on success, FALSE if the process should be skipped.
+ *
+ * Side effects:
+ *      Sets procCmdName (may be left NULL) and procCmdLine.
+ *      May take strings out of prevInfo.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+ProcMgrReadCmdLine(ProcMgrListState *state,   // IN/OUT
+                   const char *pidStr,        // IN
+                   ProcMgrProcInfo *prevInfo, // IN/OUT: optional
+                   ProcMgrProcInfo *procInfo) // IN/OUT
+{
+   int numRead;
+   int replaceLoop;
+   char *cmdLineTemp;
+   char *cmdNameBegin;
+   Bool cmdNameLookup = TRUE;
+
+   /*
+    * Read in the command and its arguments.  Arguments are separated
+    * by \0, which we convert to ' '.  Then we add a NULL terminator
+    * at the end.  Example: "perl -cw try.pl" is read in as
+    * "perl\0-cw\0try.pl\0", which we convert to "perl -cw try.pl\0".
+    * It would have been nice to preserve the NUL character so it is easy
+    * to determine what the command line arguments are without
+    * using a quote and space parsing heuristic.  But we do this
+    * to have parity with how Windows reports the command line.
+    * In the future, we could keep the NUL version around and pass it
+    * back to the client for easier parsing when retrieving individual
+    * command line parameters is needed.
+    *
+    * We may not be able to open the file due to the security reason.
+    * In that case, just ignore the process.
+    */
+   numRead = ProcMgrReadPidFile(state, pidStr, "cmdline");
+   if (numRead < 0) {
+      return FALSE;
+   }
+   cmdLineTemp = DynBuf_Get(&state->fileBuf);
+
+   if (numRead > 0 && NULL != prevInfo && NULL != prevInfo->procCmdLine &&
+       ProcMgrSameCmdLine(prevInfo->procCmdLine, cmdLineTemp, numRead)) {
+      procInfo->procCmdName = prevInfo->procCmdName;
+      procInfo->procCmdLine = prevInfo->procCmdLine;
+      prevInfo->procCmdName = NULL;
+      prevInfo->procCmdLine = NULL;
+      return TRUE;
+   }
+
+   if (numRead > 0) {
+      /*
+       * Stop before we hit the final '\0'; want to leave it alone.
+       */
+      for (replaceLoop = 0 ; replaceLoop < (numRead - 1) ; replaceLoop++) {
+         if ('\0' == cmdLineTemp[replaceLoop]) {
+            if (cmdNameLookup) {
+               /*
+                * Store the command name.
+                * Find the last path separator, to get the cmd name.
+                * If no separator is found, then use the whole name.
+                */
+               cmdNameBegin = strrchr(cmdLineTemp, '/');
+               if (NULL == cmdNameBegin) {
+                  cmdNameBegin = cmdLineTemp;
+               } else {
+                  /*
+                   * Skip over the last separator.
+                   */
+                  cmdNameBegin++;
+               }
+               procInfo->procCmdName = Unicode_Alloc(cmdNameBegin,
+                                                     STRING_ENCODING_DEFAULT);
+               cmdNameLookup = FALSE;
+            }
+            cmdLineTemp[replaceLoop] = ' ';
+         }
+      }
+      procInfo->procCmdLine = Unicode_Alloc(cmdLineTemp,
+                                            STRING_ENCODING_DEFAULT);
+      return TRUE;
+   }
+
+   /*
+    * Some procs don't have a command line text, so read a name from
+    * the 'status' file (should be the first line). If unable to get a name,
+    * the process is still real, so it should be included in the list, just
+    * without a name.
+    */
+   numRead = ProcMgrReadPidFile(state, pidStr, "status");
+   if (numRead > 0) {
+      /*
+       * Extract the part with just the name, by reading until the first
+       * space, then reading the next non-space word after that, and
+       * ignoring everything else. The format looks like this:
+       *     "^Name:[ \t]*(.*)$"
+       * for example:
+       *     "Name:    nfsd"
+       */
+      const char *nameStart;
+      char *copyItr;
+
+      cmdLineTemp = DynBuf_Get(&state->fileBuf);
+
+      /* Skip non-whitespace. */
+      for (nameStart = cmdLineTemp; *nameStart &&
+                                    *nameStart != ' ' &&
+                                    *nameStart != '\t' &&
+                                    *nameStart != '\n'; ++nameStart);
+      /* Skip whitespace. */
+      for (;*nameStart &&
+            (*nameStart == ' ' ||
+             *nameStart == '\t' ||
+             *nameStart == '\n'); ++nameStart);
+      /* Copy the name to the start of the string and null term it. */
+      for (copyItr = cmdLineTemp; *nameStart && *nameStart != '\n';) {
+         *(copyItr++) = *(nameStart++);
+      }
+      *copyItr = '\0';
+      /*
+       * Store the command name; it is the command line too.
+       */
+      procInfo->procCmdName = Unicode_Alloc(cmdLineTemp,
+                                            STRING_ENCODING_DEFAULT);
+      procInfo->procCmdLine = Unicode_Alloc(cmdLineTemp,
+                                            STRING_ENCODING_DEFAULT);
+   } else {
+      procInfo->procCmdLine = Unicode_Alloc("", STRING_ENCODING_UTF8);
+   }
+
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrFreeProcInfo --
+ *
+ *      Free the strings of a process info entry.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ProcMgrFreeProcInfo(ProcMgrProcInfo *procInfo)  // IN
+{
+   free(procInfo->procCmdName);
+   free(procInfo->procCmdLine);
+   free(procInfo->procOwner);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrReadProcEntry --
+ *
+ *      Fill in the process information for /proc/<pid>.  The command line
+ *      is read every time, since exec and argv rewrites change it; if the
+ *      previous snapshot has the same process (same pid and start time)
+ *      with the same command line, its strings are reused.
+ *
+ * Results:
+ *      TRUE on success, FALSE if the process should be skipped.
+ *
+ * Side effects:
+ *      May take strings out of the previous snapshot.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+ProcMgrReadProcEntry(ProcMgrListState *state,   // IN/OUT
+                     const char *pidStr,        // IN
+                     ProcMgrProcInfo *procInfo) // OUT
+{
+   struct stat fileStat;
+   char procPath[64];
+   int numRead;
+   int numberFound;
+   unsigned long long dummy;
+   unsigned long long relativeStartTime;
+   char *stringBegin;
+   ProcMgrProcInfo *prevInfo;
+
+   memset(procInfo, 0, sizeof *procInfo);
+
+   /*
+    * stat() /proc/<pid> to get the owner.  If we can't stat(), ignore and
+    * continue.  Maybe we don't have enough permission.
+    */
+   if (Str_Snprintf(procPath, sizeof procPath, "/proc/%s", pidStr) == -1) {
+      Debug("Giant process id '%s'\n", pidStr);
+      return FALSE;
+   }
+   if (0 != stat(procPath, &fileStat)) {
+      return FALSE;
+   }
+
+   /*
+    * Figure out the process start time.  Read /proc/<pid>/stat
+    * and read the start time and compute it in absolute time.
+    */
+   numRead = ProcMgrReadPidFile(state, pidStr, "stat");
+   if (0 >= numRead) {
+      return FALSE;
+   }
+
+   /*
+    * Skip over initial process id and process name.  "123 (bash) [...]".
+    * The name may itself contain ')', so look for the last one.
+    */
+   stringBegin = strrchr(DynBuf_Get(&state->fileBuf), ')');
+   if (NULL == stringBegin || stringBegin[1] == '\0') {
+      return FALSE;
+   }
+   stringBegin += 2;
+
+   numberFound = sscanf(stringBegin, "%c %d %d %d %d %d "
+                        "%lu %lu %lu %lu %lu %Lu %Lu %Lu %Lu %ld %ld "
+                        "%d %ld %Lu",
+                        (char *) &dummy, (int *) &dummy, (int *) &dummy,
+                        (int *) &dummy, (int *) &dummy,  (int *) &dummy,
+                        (unsigned long *) &dummy, (unsigned long *) &dummy,
+                        (unsigned long *) &dummy, (unsigned long *) &dummy,
+                        (unsigned long *) &dummy,
+                        (unsigned long long *) &dummy,
+                        (unsigned long long *) &dummy,
+                        (unsigned long long *) &dummy,
+                        (unsigned long long *) &dummy,
+                        (long *) &dummy, (long *) &dummy,
+                        (int *) &dummy, (long *) &dummy,
+                        &relativeStartTime);
+   if (20 != numberFound) {
+      return FALSE;
+   }
+
+   procInfo->procId = (pid_t) atoi(pidStr);
+   procInfo->procStartTicks = relativeStartTime;
+   procInfo->procStartTime = procMgrHostStartTime +
+                             (relativeStartTime / procMgrHertz);
+
+   prevInfo = ProcMgrFindPrevEntry(state, procInfo->procId);
+   if (NULL != prevInfo && prevInfo->procStartTicks != relativeStartTime) {
+      prevInfo = NULL;
+   }
+   if (!ProcMgrReadCmdLine(state, pidStr, prevInfo, procInfo)) {
+      ProcMgrFreeProcInfo(procInfo);
+      return FALSE;
+   }
+
+   /*
+    * Store the owner of the process.
+    */
+   procInfo->procOwner = ProcMgrGetOwnerName(state, fileStat.st_uid);
+
+   return TRUE;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
- * ProcMgr_ListProcesses --
+ * ProcMgrCompareProcId --
  *
- *      List all the processes that the calling client has privilege to
- *      enumerate. The strings in the returned structure should be all
- *      UTF-8 encoded, although we do not enforce it right now.
+ *      qsort comparator ordering process info by pid.
  *
  * Results:
- *      
- *      A ProcMgrProcInfoArray.
+ *      <0, 0 or >0.
  *
  * Side effects:
+ *      None.
  *
  *----------------------------------------------------------------------
  */
 
-ProcMgrProcInfoArray *
-ProcMgr_ListProcesses(void)
+static int
+ProcMgrCompareProcId(const ProcMgrProcInfo *a,  // IN
+                     const ProcMgrProcInfo *b)  // IN
+{
+   return (a->procId > b->procId) - (a->procId < b->procId);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrListProcessesInt --
+ *
+ *      Common code for the listing functions: read either every process
+ *      in /proc, or just the given pids.
+ *
+ * Results:
+ *      A ProcMgrProcInfoArray, NULL on failure.  A full listing is sorted
+ *      by pid; a listing of given pids is in the order they were given.
+ *
+ * Side effects:
+ *      Takes over strings from prevList, if any.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static ProcMgrProcInfoArray *
+ProcMgrListProcessesInt(size_t numPids,                  // IN
+                        const ProcMgr_Pid *pids,         // IN: optional
+                        ProcMgrProcInfoArray *prevList)  // IN/OUT: optional
 {
    ProcMgrProcInfoArray *procList = NULL;
    ProcMgrProcInfo procInfo;
+   ProcMgrListState state;
    Bool failed = TRUE;
-   DIR *dir;
+   DIR *dir = NULL;
    struct dirent *ent;
-   static time_t hostStartTime = 0;
-   static unsigned long long hertz = 100;
-   int numberFound;
+   size_t i;
 
    procList = Util_SafeCalloc(1, sizeof *procList);
    ProcMgrProcInfoArray_Init(procList, 0);
-   procInfo.procCmdName = NULL;
-   procInfo.procCmdLine = NULL;
-   procInfo.procOwner = NULL;
 
-   /*
-    * Figure out when the system started.  We need this number to
-    * compute process start times, which are relative to this number.
-    * We grab the first float in /proc/uptime, convert it to an integer,
-    * and then subtract that from the current time.  That leaves us
-    * with the seconds since epoch that the system booted up.
-    */
-   if (0 == hostStartTime) {
-      FILE *uptimeFile = NULL;
+   memset(&state, 0, sizeof state);
+   DynBuf_Init(&state.fileBuf);
+   state.prevList = prevList;
 
-      uptimeFile = fopen("/proc/uptime", "r");
-      if (NULL != uptimeFile) {
-         double secondsSinceBoot;
-         char *realLocale;
+   ProcMgrInitStartTime();
 
-         /*
-          * Set the locale such that floats are delimited with ".".
-          */
-         realLocale = setlocale(LC_NUMERIC, NULL);
-         setlocale(LC_NUMERIC, "C");
-         numberFound = fscanf(uptimeFile, "%lf", &secondsSinceBoot);
-         setlocale(LC_NUMERIC, realLocale);
+   if (NULL != pids) {
+      /*
+       * Only look at the pids we were asked about.
+       */
+      for (i = 0; i < numPids; i++) {
+         char pidStr[16];
 
-         /*
-          * Figure out system boot time in absolute terms.
-          */
-         if (numberFound) {
-            hostStartTime = time(NULL) - (time_t) secondsSinceBoot;
+         Str_Sprintf(pidStr, sizeof pidStr, "%d", (int) pids[i]);
+         if (!ProcMgrReadProcEntry(&state, pidStr, &procInfo)) {
+            continue;
+         }
+         if (!ProcMgrProcInfoArray_Push(procList, procInfo)) {
+            Warning("%s: failed to expand DynArray - out of memory\n",
+                    __FUNCTION__);
+            ProcMgrFreeProcInfo(&procInfo);
+            goto abort;
          }
-         fclose(uptimeFile);
       }
 
       /*
-       * Figure out the "hertz" value, which may be radically
-       * different than the actual CPU frequency of the machine.
-       * The process start time is expressed in terms of this value,
-       * so let's compute it now and keep it in a static variable.
-       */
-#ifdef HZ
-      hertz = (unsigned long long) HZ;
-#else
-      /*
-       * Don't do anything.  Use the default value of 100.
+       * An empty list is fine: none of the processes exist.
        */
-#endif
-   } // if (0 == hostStartTime)
+      failed = FALSE;
+      goto abort;
+   }
 
    /*
     * Scan /proc for any directory that is all numbers.
@@ -317,22 +878,6 @@ ProcMgr_ListProcesses(void)
    }
 
    while ((ent = readdir(dir))) {
-      struct stat fileStat;
-      char cmdFilePath[1024];
-      int statResult;
-      int numRead = 0;   /* number of bytes that read() actually read */
-      int cmdFd;
-      int replaceLoop;
-      struct passwd *pwd;
-      char *cmdLineTemp = NULL;
-      char *cmdStatTemp = NULL;
-      size_t strLen = 0;
-      unsigned long long dummy;
-      unsigned long long relativeStartTime;
-      char *stringBegin;
-      char *cmdNameBegin;
-      Bool cmdNameLookup = TRUE;
-
       /*
        * We only care about dirs that look like processes.
        */
@@ -340,249 +885,134 @@ ProcMgr_ListProcesses(void)
          continue;
       }
 
-      if (snprintf(cmdFilePath,
-                   sizeof cmdFilePath,
-                   "/proc/%s/cmdline",
-                   ent->d_name) == -1) {
-         Debug("Giant process id '%s'\n", ent->d_name);
-         continue;
-      }
-      
-      cmdFd = open(cmdFilePath, O_RDONLY);
-      if (-1 == cmdFd) {
-         /*
-          * We may not be able to open the file due to the security reason.
-          * In that case, just ignore and continue.
-          */
+      if (!ProcMgrReadProcEntry(&state, ent->d_name, &procInfo)) {
          continue;
       }
 
       /*
-       * Read in the command and its arguments.  Arguments are separated
-       * by \0, which we convert to ' '.  Then we add a NULL terminator
-       * at the end.  Example: "perl -cw try.pl" is read in as
-       * "perl\0-cw\0try.pl\0", which we convert to "perl -cw try.pl\0".
-       * It would have been nice to preserve the NUL character so it is easy
-       * to determine what the command line arguments are without
-       * using a quote and space parsing heuristic.  But we do this
-       * to have parity with how Windows reports the command line.
-       * In the future, we could keep the NUL version around and pass it
-       * back to the client for easier parsing when retrieving individual
-       * command line parameters is needed.
+       * Store the process info into a list buffer.
        */
-      numRead = ProcMgr_ReadProcFile(cmdFd, &cmdLineTemp);
-      close(cmdFd);
-
-      if (numRead < 0) {
-         continue;
-      }
-
-      if (numRead > 0) {
-         /*
-          * Stop before we hit the final '\0'; want to leave it alone.
-          */
-         for (replaceLoop = 0 ; replaceLoop < (numRead - 1) ; replaceLoop++) {
-            if ('\0' == cmdLineTemp[replaceLoop]) {
-               if (cmdNameLookup) {
-                  /*
-                   * Store the command name.
-                   * Find the last path separator, to get the cmd name.
-                   * If no separator is found, then use the whole name.
-                   */
-                  cmdNameBegin = strrchr(cmdLineTemp, '/');
-                  if (NULL == cmdNameBegin) {
-                     cmdNameBegin = cmdLineTemp;
-                  } else {
-                     /*
-                      * Skip over the last separator.
-                      */
-                     cmdNameBegin++;
-                  }
-                  procInfo.procCmdName = Unicode_Alloc(cmdNameBegin, STRING_ENCODING_DEFAULT);
-                  cmdNameLookup = FALSE;
-               }
-               cmdLineTemp[replaceLoop] = ' ';
-            }
-         }
-      } else {
-         /*
-          * Some procs don't have a command line text, so read a name from
-          * the 'status' file (should be the first line). If unable to get a name,
-          * the process is still real, so it should be included in the list, just 
-          * without a name.
-          */
-         cmdFd = -1;
-         numRead = 0;
-
-         if (snprintf(cmdFilePath,
-                      sizeof cmdFilePath,
-                      "/proc/%s/status",
-                      ent->d_name) != -1) {
-            cmdFd = open(cmdFilePath, O_RDONLY);
-         }
-         if (cmdFd != -1) {
-            numRead = ProcMgr_ReadProcFile(cmdFd, &cmdLineTemp);
-            close(cmdFd);
-         }
-         if (numRead > 0) {
-            /*
-             * Extract the part with just the name, by reading until the first
-             * space, then reading the next non-space word after that, and
-             * ignoring everything else. The format looks like this:
-             *     "^Name:[ \t]*(.*)$"
-             * for example:
-             *     "Name:    nfsd"
-             */
-            const char *nameStart;
-            char *copyItr;
-
-            /* Skip non-whitespace. */
-            for (nameStart = cmdLineTemp; *nameStart && 
-                                          *nameStart != ' ' &&
-                                          *nameStart != '\t' &&
-                                          *nameStart != '\n'; ++nameStart);
-            /* Skip whitespace. */
-            for (;*nameStart && 
-                  (*nameStart == ' ' ||
-                   *nameStart == '\t' ||
-                   *nameStart == '\n'); ++nameStart);
-            /* Copy the name to the start of the string and null term it. */
-            for (copyItr = cmdLineTemp; *nameStart && *nameStart != '\n';) {
-               *(copyItr++) = *(nameStart++);
-            }
-            *copyItr = '\0';
-            /*
-             * Store the command name.
-             */
-            procInfo.procCmdName = Unicode_Alloc(cmdLineTemp, STRING_ENCODING_DEFAULT);
-         }
+      if (!ProcMgrProcInfoArray_Push(procList, procInfo)) {
+         Warning("%s: failed to expand DynArray - out of memory\n",
+                 __FUNCTION__);
+         ProcMgrFreeProcInfo(&procInfo);
+         goto abort;
       }
+   } // while readdir
 
+   if (0 < ProcMgrProcInfoArray_Count(procList)) {
       /*
-       * Get the inode information for this process.  This gives us
-       * the process owner.
+       * readdir() of /proc goes in pid order, so this is normally a no-op;
+       * ProcMgr_ListProcessesIncremental() relies on it.
        */
-      if (snprintf(cmdFilePath,
-                   sizeof cmdFilePath,
-                   "/proc/%s",
-                   ent->d_name) == -1) {
-         Debug("Giant process id '%s'\n", ent->d_name);
-         goto next_entry;
-      }
+      ProcMgrProcInfoArray_QSort(procList, ProcMgrCompareProcId);
+      failed = FALSE;
+   }
 
-      /*
-       * stat() /proc/<pid> to get the owner.  We use fileStat.st_uid
-       * later in this code.  If we can't stat(), ignore and continue.
-       * Maybe we don't have enough permission.
-       */
-      statResult = stat(cmdFilePath, &fileStat);
-      if (0 != statResult) {
-         goto next_entry;
-      }
+abort:
+   if (NULL != dir) {
+      closedir(dir);
+   }
 
+   if (failed) {
       /*
-       * Figure out the process start time.  Open /proc/<pid>/stat
-       * and read the start time and compute it in absolute time.
-       */
-      if (snprintf(cmdFilePath,
-                   sizeof cmdFilePath,
-                   "/proc/%s/stat",
-                   ent->d_name) == -1) {
-         Debug("Giant process id '%s'\n", ent->d_name);
-         goto next_entry;
-      }
-      cmdFd = open(cmdFilePath, O_RDONLY);
-      if (-1 == cmdFd) {
-         goto next_entry;
-      }
-      numRead = ProcMgr_ReadProcFile(cmdFd, &cmdStatTemp);
-      close(cmdFd);
-      if (0 >= numRead) {
-         goto next_entry;
-      }
-      /*
-       * Skip over initial process id and process name.  "123 (bash) [...]".
+       * Anything not yet in procList is freed here.
        */
-      stringBegin = strchr(cmdStatTemp, ')') + 2;
-
-      numberFound = sscanf(stringBegin, "%c %d %d %d %d %d "
-                           "%lu %lu %lu %lu %lu %Lu %Lu %Lu %Lu %ld %ld "
-                           "%d %ld %Lu",
-                           (char *) &dummy, (int *) &dummy, (int *) &dummy,
-                           (int *) &dummy, (int *) &dummy,  (int *) &dummy,
-                           (unsigned long *) &dummy, (unsigned long *) &dummy,
-                           (unsigned long *) &dummy, (unsigned long *) &dummy,
-                           (unsigned long *) &dummy,
-                           (unsigned long long *) &dummy,
-                           (unsigned long long *) &dummy,
-                           (unsigned long long *) &dummy,
-                           (unsigned long long *) &dummy,
-                           (long *) &dummy, (long *) &dummy,
-                           (int *) &dummy, (long *) &dummy,
-                           &relativeStartTime);
-      if (20 != numberFound) {
-         goto next_entry;
-      }
+      ProcMgr_FreeProcList(procList);
+      procList = NULL;
+   }
 
-      /*
-       * Store the command line string pointer in dynbuf.
-       */
-      if (cmdLineTemp) {
-         procInfo.procCmdLine = Unicode_Alloc(cmdLineTemp, STRING_ENCODING_DEFAULT);
-      } else {
-         procInfo.procCmdLine = Unicode_Alloc("", STRING_ENCODING_UTF8);
-      }
+   for (i = 0; i < state.numUidNames; i++) {
+      free(state.uidNames[i].name);
+   }
+   free(state.uidNames);
+   DynBuf_Destroy(&state.fileBuf);
 
-      /*
-       * Store the pid in dynbuf.
-       */
-      procInfo.procId = (pid_t) atoi(ent->d_name);
+   return procList;
+}
 
-      /*
-       * Store the owner of the process.
-       */
-      pwd = getpwuid(fileStat.st_uid);
-      procInfo.procOwner = (NULL == pwd)
-                           ? Str_SafeAsprintf(&strLen, "%d", (int) fileStat.st_uid)
-                           : Unicode_Alloc(pwd->pw_name, STRING_ENCODING_DEFAULT);
 
-      /*
-       * Store the time that the process started.
-       */
-      procInfo.procStartTime = hostStartTime + (relativeStartTime / hertz);
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgr_ListProcesses --
+ *
+ *      List all the processes that the calling client has privilege to
+ *      enumerate. The strings in the returned structure should be all
+ *      UTF-8 encoded, although we do not enforce it right now.
+ *
+ * Results:
+ *
+ *      A ProcMgrProcInfoArray, sorted by pid.
+ *
+ * Side effects:
+ *
+ *----------------------------------------------------------------------
+ */
 
-      /*
-       * Store the process info pointer into a list buffer.
-       */
-      if (!ProcMgrProcInfoArray_Push(procList, procInfo)) {
-         Warning("%s: failed to expand DynArray - out of memory\n",
-                 __FUNCTION__);
-         goto abort;
-      }
-      procInfo.procCmdName = NULL;
-      procInfo.procCmdLine = NULL;
-      procInfo.procOwner = NULL;
+ProcMgrProcInfoArray *
+ProcMgr_ListProcesses(void)
+{
+   return ProcMgrListProcessesInt(0, NULL, NULL);
+}
 
-next_entry:
-      free(cmdLineTemp);
-      free(cmdStatTemp);
-   } // while readdir
 
-   if (0 < ProcMgrProcInfoArray_Count(procList)) {
-      failed = FALSE;
-   }
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgr_ListProcessesForPids --
+ *
+ *      List only the given processes, reading just their /proc entries
+ *      rather than walking all of /proc.
+ *
+ * Results:
+ *
+ *      A ProcMgrProcInfoArray in the order of 'pids', with no entry for
+ *      processes that don't exist or can't be read; NULL on failure.
+ *
+ * Side effects:
+ *
+ *----------------------------------------------------------------------
+ */
 
-abort:
-   closedir(dir);
+ProcMgrProcInfoArray *
+ProcMgr_ListProcessesForPids(size_t numPids,           // IN
+                             const ProcMgr_Pid *pids)  // IN
+{
+   ASSERT(numPids == 0 || pids != NULL);
 
-   free(procInfo.procCmdName);
-   free(procInfo.procCmdLine);
-   free(procInfo.procOwner);
+   return ProcMgrListProcessesInt(numPids, pids, NULL);
+}
 
-   if (failed) {
-      ProcMgr_FreeProcList(procList);
-      procList = NULL;
-   }
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgr_ListProcessesIncremental --
+ *
+ *      Like ProcMgr_ListProcesses(), but given the previous full listing,
+ *      the command name and line strings of every process still in it
+ *      (same pid and start time) whose command line has not changed are
+ *      carried over rather than allocated again.
+ *
+ * Results:
+ *
+ *      A ProcMgrProcInfoArray, sorted by pid; NULL on failure.
+ *
+ * Side effects:
+ *
+ *      prevList is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+ProcMgrProcInfoArray *
+ProcMgr_ListProcessesIncremental(ProcMgrProcInfoArray *prevList)  // IN
+{
+   ProcMgrProcInfoArray *procList;
+
+   procList = ProcMgrListProcessesInt(0, NULL, prevList);
+   ProcMgr_FreeProcList(prevList);
 
    return procList;
 }
@@ -1189,6 +1619,104 @@ ProcMgr_FreeProcList(ProcMgrProcInfoArray *procList)
 }
 
 
+#if !defined(linux)
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgr_ListProcessesForPids --
+ *
+ *      List only the given processes.  There is no cheaper way to look up
+ *      a single process here, so this filters the full list.
+ *
+ * Results:
+ *
+ *      A ProcMgrProcInfoArray in the order of 'pids', with no entry for
+ *      processes that don't exist or can't be read; NULL on failure.
+ *
+ * Side effects:
+ *
+ *----------------------------------------------------------------------
+ */
+
+ProcMgrProcInfoArray *
+ProcMgr_ListProcessesForPids(size_t numPids,           // IN
+                             const ProcMgr_Pid *pids)  // IN
+{
+   ProcMgrProcInfoArray *allProcs;
+   ProcMgrProcInfoArray *procList;
+   size_t procCount;
+   size_t i;
+   size_t j;
+
+   allProcs = ProcMgr_ListProcesses();
+   if (NULL == allProcs) {
+      return NULL;
+   }
+
+   procList = Util_SafeCalloc(1, sizeof *procList);
+   ProcMgrProcInfoArray_Init(procList, 0);
+
+   procCount = ProcMgrProcInfoArray_Count(allProcs);
+   for (i = 0; i < numPids; i++) {
+      for (j = 0; j < procCount; j++) {
+         ProcMgrProcInfo procInfo = *ProcMgrProcInfoArray_AddressOf(allProcs, j);
+
+         if (procInfo.procId != pids[i]) {
+            continue;
+         }
+         procInfo.procCmdName = Util_SafeStrdup(procInfo.procCmdName);
+         procInfo.procCmdLine = Util_SafeStrdup(procInfo.procCmdLine);
+         procInfo.procOwner = Util_SafeStrdup(procInfo.procOwner);
+         if (!ProcMgrProcInfoArray_Push(procList, procInfo)) {
+            Warning("%s: failed to expand DynArray - out of memory\n",
+                    __FUNCTION__);
+            free(procInfo.procCmdName);
+            free(procInfo.procCmdLine);
+            free(procInfo.procOwner);
+            ProcMgr_FreeProcList(procList);
+            procList = NULL;
+            goto done;
+         }
+         break;
+      }
+   }
+
+done:
+   ProcMgr_FreeProcList(allProcs);
+
+   return procList;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgr_ListProcessesIncremental --
+ *
+ *      Same as ProcMgr_ListProcesses(); nothing is carried over from the
+ *      previous listing here.
+ *
+ * Results:
+ *
+ *      A ProcMgrProcInfoArray; NULL on failure.
+ *
+ * Side effects:
+ *
+ *      prevList is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+ProcMgrProcInfoArray *
+ProcMgr_ListProcessesIncremental(ProcMgrProcInfoArray *prevList)  // IN
+{
+   ProcMgr_FreeProcList(prevList);
+
+   return ProcMgr_ListProcesses();
+}
+#endif // !defined(linux)
+
+
 /*
  *----------------------------------------------------------------------
  *
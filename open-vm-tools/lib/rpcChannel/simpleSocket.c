@@ -457,7 +457,8 @@ Socket_DecodePacket(const char *recvBuf,       // IN
    *payloadLen = 0;
 
    /* decoding the packet */
-   res = DataMap_Deserialize(recvBuf, fullPktLen, &map);
+   /* The payload is copied out below, so the map can borrow recvBuf. */
+   res = DataMap_DeserializeArena(recvBuf, fullPktLen, TRUE, &map);
    if (res != DMERR_SUCCESS) {
       Debug(LGPFX "Error in dataMap decoding, error=%d\n", res);
       return FALSE;
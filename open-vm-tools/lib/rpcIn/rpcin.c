@@ -851,7 +851,8 @@ RpcInDecodePacket(ConnInfo *conn,       // IN
 
 
    /* decoding the packet */
-   res = DataMap_Deserialize(conn->recvBuf, fullPacketLen, &map);
+   /* The payload is copied out below, so the map can borrow recvBuf. */
+   res = DataMap_DeserializeArena(conn->recvBuf, fullPacketLen, TRUE, &map);
    if (res != DMERR_SUCCESS) {
       Debug("RpcIn: Error in dataMap decoding for conn %d, error=%d\n",
             fd, res);
@@ -55,6 +55,7 @@ NullDriverClose(SyncDriverHandle handle)
  * Calls sync().
  *
  * @param[in]  paths     Unused.
+ * @param[in]  flags     Unused.
  * @param[out] handle    Where to store the operation handle.
  *
  * @return A SyncDriverErr.
@@ -64,6 +65,7 @@ NullDriverClose(SyncDriverHandle handle)
 
 SyncDriverErr
 NullDriver_Freeze(const GSList *paths,
+                  uint32 flags,
                   SyncDriverHandle *handle)
 {
    /*
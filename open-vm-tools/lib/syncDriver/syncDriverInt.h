@@ -41,24 +41,29 @@ typedef enum {
 } SyncDriverErr;
 
 typedef SyncDriverErr (*SyncFreezeFn)(const GSList *paths,
+                                      uint32 flags,
                                       SyncDriverHandle *handle);
 
 typedef struct SyncHandle {
    SyncDriverErr (*thaw)(const SyncDriverHandle handle);
    void (*close)(SyncDriverHandle handle);
+   char *timings;    /* Per file system timing report, may be NULL. */
 } SyncHandle;
 
 #if defined(linux)
 SyncDriverErr
 LinuxDriver_Freeze(const GSList *userPaths,
+                   uint32 flags,
                    SyncDriverHandle *handle);
 
 SyncDriverErr
 VmSync_Freeze(const GSList *userPaths,
+              uint32 flags,
               SyncDriverHandle *handle);
 
 SyncDriverErr
 NullDriver_Freeze(const GSList *userPaths,
+                  uint32 flags,
                   SyncDriverHandle *handle);
 #endif
 
@@ -21,6 +21,13 @@
  *
  * A sync driver backend that uses the Linux "FIFREEZE" and "FITHAW" ioctls
  * to freeze and thaw file systems.
+ *
+ * File systems are frozen one at a time, in the order given, since a file
+ * system may live on top of another one (e.g., on a loop device) and must be
+ * frozen first. Each freeze starts by flushing the file system's dirty data,
+ * so with SYNCDRIVER_FREEZE_PARALLEL_SYNC all file systems are first
+ * flushed concurrently with syncfs(), leaving the serial freezes with
+ * little to write.
  */
 
 #include <errno.h>
@@ -28,12 +35,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
 #include <linux/fs.h>
 #include <sys/ioctl.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include "vmware.h"
 #include "debug.h"
 #include "dynbuf.h"
+#include "strutil.h"
 #include "syncDriverInt.h"
 
 /* Out toolchain headers are somewhat outdated and don't define these. */
@@ -43,12 +54,32 @@
 #endif
 
 
+/* Maximum number of threads flushing file systems in parallel. */
+#define LINUX_MAX_SYNC_THREADS   8
+
 typedef struct LinuxDriver {
    SyncHandle  driver;
    size_t      fdCnt;
    int        *fds;
 } LinuxDriver;
 
+/* A file system to be frozen. */
+typedef struct LinuxFs {
+   const char *path;
+   int         fd;         /* -1 once frozen (owned by the driver) or closed. */
+   int         syncErr;    /* errno from syncfs(), 0 if it worked. */
+   uint64      syncUs;
+   uint64      freezeUs;
+   Bool        synced;
+   Bool        frozen;
+} LinuxFs;
+
+typedef struct LinuxSyncWork {
+   LinuxFs      *fs;
+   size_t        count;
+   volatile gint next;
+} LinuxSyncWork;
+
 
 /*
  *******************************************************************************
@@ -116,6 +147,175 @@ LinuxFiClose(SyncDriverHandle handle)
 }
 
 
+/*
+ *******************************************************************************
+ * LinuxNowUs --                                                          */ /**
+ *
+ * @return The monotonic time, in microseconds.
+ *
+ *******************************************************************************
+ */
+
+static uint64
+LinuxNowUs(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+/*
+ *******************************************************************************
+ * LinuxSyncWorker --                                                     */ /**
+ *
+ * Flushes file systems with syncfs() until there are none left. Run by
+ * several threads at once.
+ *
+ * @param[in] data   The LinuxSyncWork shared by the threads.
+ *
+ * @return NULL.
+ *
+ *******************************************************************************
+ */
+
+static gpointer
+LinuxSyncWorker(gpointer data)
+{
+   LinuxSyncWork *work = data;
+   size_t i;
+
+   while ((i = (size_t) g_atomic_int_exchange_and_add(&work->next, 1)) <
+          work->count) {
+      LinuxFs *fs = &work->fs[i];
+      uint64 start = LinuxNowUs();
+
+#if defined(SYS_syncfs)
+      if (syscall(SYS_syncfs, fs->fd) == -1) {
+         fs->syncErr = errno;
+      }
+#else
+      fs->syncErr = ENOSYS;
+#endif
+      fs->syncUs = LinuxNowUs() - start;
+      fs->synced = TRUE;
+   }
+
+   return NULL;
+}
+
+
+/*
+ *******************************************************************************
+ * LinuxSyncAll --                                                        */ /**
+ *
+ * Flushes the given file systems with syncfs(), in parallel. Failures are
+ * not fatal: the freeze that follows flushes the file system anyway.
+ *
+ * @param[in] fs     File systems to flush.
+ * @param[in] count  Number of file systems.
+ *
+ *******************************************************************************
+ */
+
+static void
+LinuxSyncAll(LinuxFs *fs,
+             size_t count)
+{
+   GThread *threads[LINUX_MAX_SYNC_THREADS - 1];
+   size_t numThreads = 0;
+   LinuxSyncWork work;
+   uint64 start = LinuxNowUs();
+   size_t i;
+
+   work.fs = fs;
+   work.count = count;
+   work.next = 0;
+
+   /* The calling thread is one of the workers. */
+   if (g_thread_supported()) {
+      while (numThreads < ARRAYSIZE(threads) && numThreads + 1 < count) {
+         threads[numThreads] = g_thread_create(LinuxSyncWorker, &work, TRUE,
+                                               NULL);
+         if (threads[numThreads] == NULL) {
+            break;
+         }
+         numThreads++;
+      }
+   }
+
+   LinuxSyncWorker(&work);
+
+   for (i = 0; i < numThreads; i++) {
+      g_thread_join(threads[i]);
+   }
+
+   for (i = 0; i < count; i++) {
+      if (fs[i].syncErr != 0) {
+         Debug(LGPFX "syncfs on '%s' failed: %d (%s)\n",
+               fs[i].path, fs[i].syncErr, strerror(fs[i].syncErr));
+      }
+   }
+
+   Debug(LGPFX "Flushed %"FMTSZ"u file systems with %"FMTSZ"u threads "
+         "in %"FMT64"u us.\n",
+         count, numThreads + 1, LinuxNowUs() - start);
+}
+
+
+/*
+ *******************************************************************************
+ * LinuxTimingReport --                                                   */ /**
+ *
+ * Builds the report of how long flushing and freezing each file system took.
+ *
+ * @param[in] fs     File systems that were frozen.
+ * @param[in] count  Number of file systems.
+ *
+ * @return The report (to be freed with free()), or NULL.
+ *
+ *******************************************************************************
+ */
+
+static char *
+LinuxTimingReport(const LinuxFs *fs,
+                  size_t count)
+{
+   DynBuf report;
+   Bool ok = TRUE;
+   size_t i;
+
+   DynBuf_Init(&report);
+
+   for (i = 0; i < count && ok; i++) {
+      ok = StrUtil_DynBufPrintf(&report, "%s%s", i > 0 ? "; " : "",
+                                fs[i].path);
+      if (ok && fs[i].synced) {
+         ok = fs[i].syncErr == 0 ?
+              StrUtil_DynBufPrintf(&report, " sync=%"FMT64"u.%01"FMT64"ums",
+                                   fs[i].syncUs / 1000,
+                                   fs[i].syncUs % 1000 / 100) :
+              StrUtil_DynBufPrintf(&report, " sync=failed");
+      }
+      if (ok) {
+         ok = fs[i].frozen ?
+              StrUtil_DynBufPrintf(&report, " freeze=%"FMT64"u.%01"FMT64"ums",
+                                   fs[i].freezeUs / 1000,
+                                   fs[i].freezeUs % 1000 / 100) :
+              StrUtil_DynBufPrintf(&report, " freeze=skipped");
+      }
+   }
+
+   if (!ok || !DynBuf_Append(&report, "", 1)) {
+      DynBuf_Destroy(&report);
+      return NULL;
+   }
+
+   return DynBuf_Detach(&report);
+}
+
+
 /*
  *******************************************************************************
  * LinuxDriver_Freeze --                                                  */ /**
@@ -125,12 +325,17 @@ LinuxFiClose(SyncDriverHandle handle)
  * If the first attempt at using the ioctl fails, assume that it doesn't exist
  * and return SD_UNAVAILABLE, so that other means of freezing are tried.
  *
+ * All the paths are opened first. With SYNCDRIVER_FREEZE_PARALLEL_SYNC they
+ * are then flushed concurrently, and finally frozen in order. How long each
+ * step took for each file system is recorded in the handle.
+ *
  * NOTE: This function performs two system calls open() and ioctl(). We have
  * seen open() being slow with NFS mount points at times and ioctl() being
  * slow when guest is performing significant IO. Therefore, caller should
  * consider running this function in a separate thread.
  *
  * @param[in]  paths    List of paths to freeze.
+ * @param[in]  flags    SYNCDRIVER_FREEZE_* flags.
  * @param[out] handle   Handle to use for thawing.
  *
  * @return A SyncDriverErr.
@@ -140,15 +345,21 @@ LinuxFiClose(SyncDriverHandle handle)
 
 SyncDriverErr
 LinuxDriver_Freeze(const GSList *paths,
+                   uint32 flags,
                    SyncDriverHandle *handle)
 {
    ssize_t count = 0;
    Bool first = TRUE;
    DynBuf fds;
+   DynBuf fsBuf;
+   LinuxFs *fs;
+   size_t fsCount;
+   size_t i;
    LinuxDriver *sync = NULL;
    SyncDriverErr err = SD_SUCCESS;
 
    DynBuf_Init(&fds);
+   DynBuf_Init(&fsBuf);
 
    Debug(LGPFX "Freezing using Linux ioctls...\n");
 
@@ -166,13 +377,12 @@ LinuxDriver_Freeze(const GSList *paths,
    VERIFY(paths != NULL);
 
    /*
-    * Iterate through the requested paths. If we get an error for the first
-    * path, and it's not EPERM, assume that the ioctls are not available in
-    * the current kernel.
+    * Open all the requested paths.
     */
    while (paths != NULL) {
       int fd;
       struct stat sbuf;
+      LinuxFs entry;
       const char *path = paths->data;
       Debug(LGPFX "opening path '%s'.\n", path);
       paths = g_slist_next(paths);
@@ -226,6 +436,33 @@ LinuxDriver_Freeze(const GSList *paths,
          continue;
       }
 
+      memset(&entry, 0, sizeof entry);
+      entry.path = path;
+      entry.fd = fd;
+      if (!DynBuf_Append(&fsBuf, &entry, sizeof entry)) {
+         close(fd);
+         err = SD_ERROR;
+         goto exit;
+      }
+   }
+
+   fs = DynBuf_Get(&fsBuf);
+   fsCount = DynBuf_GetSize(&fsBuf) / sizeof *fs;
+
+   if ((flags & SYNCDRIVER_FREEZE_PARALLEL_SYNC) != 0 && fsCount > 0) {
+      LinuxSyncAll(fs, fsCount);
+   }
+
+   /*
+    * Freeze the file systems in order. If we get an error for the first
+    * one, and it's not EPERM, assume that the ioctls are not available in
+    * the current kernel.
+    */
+   for (i = 0; i < fsCount; i++) {
+      int fd = fs[i].fd;
+      const char *path = fs[i].path;
+      uint64 start = LinuxNowUs();
+
       Debug(LGPFX "freezing path '%s' (fd=%d).\n", path, fd);
       if (ioctl(fd, FIFREEZE) == -1) {
          int ioctlerr = errno;
@@ -240,6 +477,7 @@ LinuxDriver_Freeze(const GSList *paths,
           * bind mounts).
           */
          close(fd);
+         fs[i].fd = -1;
          Debug(LGPFX "freeze on '%s' returned: %d (%s)\n",
                path, ioctlerr, strerror(ioctlerr));
          if (ioctlerr != EBUSY && ioctlerr != EOPNOTSUPP) {
@@ -249,23 +487,42 @@ LinuxDriver_Freeze(const GSList *paths,
             break;
          }
       } else {
-         Debug(LGPFX "successfully froze '%s' (fd=%d).\n", path, fd);
+         fs[i].freezeUs = LinuxNowUs() - start;
+         Debug(LGPFX "successfully froze '%s' (fd=%d) in %"FMT64"u us.\n",
+               path, fd, fs[i].freezeUs);
          if (!DynBuf_Append(&fds, &fd, sizeof fd)) {
             if (ioctl(fd, FITHAW) == -1) {
                Warning(LGPFX "failed to thaw '%s': %d (%s)\n",
                        path, errno, strerror(errno));
             }
             close(fd);
+            fs[i].fd = -1;
             err = SD_ERROR;
             break;
          }
+         fs[i].fd = -1;
+         fs[i].frozen = TRUE;
          count++;
       }
 
       first = FALSE;
    }
 
+   if (err == SD_SUCCESS) {
+      sync->driver.timings = LinuxTimingReport(fs, fsCount);
+   }
+
 exit:
+   /* Close whatever was opened but not frozen. */
+   fs = DynBuf_Get(&fsBuf);
+   fsCount = DynBuf_GetSize(&fsBuf) / sizeof *fs;
+   for (i = 0; i < fsCount; i++) {
+      if (fs[i].fd != -1) {
+         close(fs[i].fd);
+      }
+   }
+   DynBuf_Destroy(&fsBuf);
+
    sync->fds = DynBuf_Detach(&fds);
    sync->fdCnt = count;
 
@@ -277,4 +534,3 @@ exit:
    }
    return err;
 }
-
@@ -229,6 +229,34 @@ Bool
 SyncDriver_Freeze(const char *userPaths,     // IN
                   Bool enableNullDriver,     // IN
                   SyncDriverHandle *handle)  // OUT
+{
+   return SyncDriver_FreezeEx(userPaths, enableNullDriver, 0, handle);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * SyncDriver_FreezeEx --
+ *
+ *    Same as SyncDriver_Freeze, with SYNCDRIVER_FREEZE_* flags that tune how
+ *    the file systems are frozen. Backends ignore flags they don't support.
+ *
+ * Results:
+ *    TRUE on success
+ *    FALSE on failure
+ *
+ * Side effects:
+ *    See SyncDriver_Freeze.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+SyncDriver_FreezeEx(const char *userPaths,     // IN
+                    Bool enableNullDriver,     // IN
+                    uint32 flags,              // IN
+                    SyncDriverHandle *handle)  // OUT
 {
    GSList *paths = NULL;
    SyncDriverErr err = SD_UNAVAILABLE;
@@ -288,7 +316,7 @@ SyncDriver_Freeze(const char *userPaths,     // IN
          continue;
       }
 #endif
-      err = freezeFn(paths, handle);
+      err = freezeFn(paths, flags, handle);
    }
 
    /*
@@ -352,6 +380,31 @@ SyncDriver_QueryStatus(const SyncDriverHandle handle, // IN
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * SyncDriver_GetTimings --
+ *
+ *    Returns how long flushing and freezing each file system took during
+ *    the freeze that returned the handle, if the backend measured it.
+ *
+ * Results:
+ *    A report of the form "<path> sync=<ms> freeze=<ms>; ...", owned by
+ *    the handle, or NULL.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+const char *
+SyncDriver_GetTimings(const SyncDriverHandle handle) // IN
+{
+   return handle != NULL ? handle->timings : NULL;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -372,6 +425,8 @@ void
 SyncDriver_CloseHandle(SyncDriverHandle *handle)   // IN/OUT
 {
    if (*handle != NULL) {
+      free((*handle)->timings);
+      (*handle)->timings = NULL;
       if ((*handle)->close != NULL) {
          (*handle)->close(*handle);
       }
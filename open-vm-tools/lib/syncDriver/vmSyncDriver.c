@@ -92,6 +92,7 @@ VmSyncClose(SyncDriverHandle handle)
  * ioctl to freeze the requested filesystems.
  *
  * @param[in]  paths    List of paths to freeze.
+ * @param[in]  flags    Unused.
  * @param[out] handle   Where to store the handle to use for thawing.
  *
  * @return A SyncDriverErr.
@@ -101,6 +102,7 @@ VmSyncClose(SyncDriverHandle handle)
 
 SyncDriverErr
 VmSync_Freeze(const GSList *paths,
+              uint32 flags,
               SyncDriverHandle *handle)
 {
    int file;
@@ -24,6 +24,7 @@
 
 #include <sys/wait.h>
 #include <sys/stat.h>
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
@@ -64,12 +65,25 @@
 #define BASEFILENAME "/tmp/.vmware-deploy"
 #endif
 
+/*
+ * The files of the last package extracted are kept here, so that deploying
+ * the same package again can copy them instead of extracting it. They may
+ * hold passwords, so the directory must be owned by root and accessible
+ * only by it; the cache is not used otherwise.
+ */
+#ifndef CACHEPATH
+#define CACHEPATH "/var/cache/vmware-imc"
+#endif
+
 #ifndef CABCOMMANDLOG
 #define CABCOMMANDLOG "/var/log/vmware-imc/toolsDeployPkg.log"
 #endif
 
 #define MAXSTRING 2048
 
+// Size of the buffer used to copy package contents
+#define COPYBUFSIZE (1024 * 1024)
+
 /*
  * Constant definitions
  */
@@ -128,6 +142,16 @@ static int ForkExecAndWaitCommand(const char* command);
 static void SetDeployError(const char* format, ...);
 static const char* GetDeployError(void);
 static void NoLogging(int level, const char* fmtstr, ...);
+static uint64 GetTimeMs(void);
+static void LogPhaseTime(const char* phase, uint64* start);
+static Bool GetPackageKey(const char* pkgName, char* key, size_t keySize);
+static Bool OpenCache(Bool create);
+static void ClearCache(void);
+static Bool CopyFile(const char* from, const char* to, mode_t mode, char* buf);
+static Bool CopyTreeWithBuffer(const char* from, const char* to, char* buf);
+static Bool CopyTree(const char* from, const char* to);
+static Bool RestoreFromCache(const char* key, const char* destDir);
+static void StoreInCache(const char* key, const char* srcDir);
 
 /*
  * Globals
@@ -990,6 +1014,10 @@ Deploy(const char* packageName)
    const char *cloudInitConfigFilePath = "/etc/cloud/cloud.cfg";
    char cloudCommand[1024];
    int forkExecResult;
+   char key[64];
+   Bool haveKey;
+   uint64 deployStart = GetTimeMs();
+   uint64 phaseStart = deployStart;
 
    TransitionState(NULL, INPROGRESS);
 
@@ -1006,6 +1034,7 @@ Deploy(const char* packageName)
                      GetDeployError());
       return DEPLOY_ERROR;
    }
+   LogPhaseTime("read header", &phaseStart);
 
    // Print the header command
 #ifdef VMX86_DEBUG
@@ -1018,15 +1047,29 @@ Deploy(const char* packageName)
       return DEPLOY_ERROR;
    }
 
-   if (archiveType == VMWAREDEPLOYPKG_PAYLOAD_TYPE_CAB) {
-      if (!ExtractCabPackage(packageName, EXTRACTPATH)) {
-         free(command);
-         return DEPLOY_ERROR;
+   // Copy the files from the cache if this package was extracted before
+   haveKey = GetPackageKey(packageName, key, sizeof key);
+   LogPhaseTime("hash package", &phaseStart);
+   if (haveKey && RestoreFromCache(key, EXTRACTPATH)) {
+      sLog(log_info, "Package found in the cache, skipping extraction. \n");
+      LogPhaseTime("restore from cache", &phaseStart);
+   } else {
+      if (archiveType == VMWAREDEPLOYPKG_PAYLOAD_TYPE_CAB) {
+         if (!ExtractCabPackage(packageName, EXTRACTPATH)) {
+            free(command);
+            return DEPLOY_ERROR;
+         }
+      } else if (archiveType == VMWAREDEPLOYPKG_PAYLOAD_TYPE_ZIP) {
+         if (!ExtractZipPackage(packageName, EXTRACTPATH)) {
+            free(command);
+            return DEPLOY_ERROR;
+         }
       }
-   } else if (archiveType == VMWAREDEPLOYPKG_PAYLOAD_TYPE_ZIP) {
-      if (!ExtractZipPackage(packageName, EXTRACTPATH)) {
-         free(command);
-         return DEPLOY_ERROR;
+      LogPhaseTime("extract", &phaseStart);
+
+      if (haveKey) {
+         StoreInCache(key, EXTRACTPATH);
+         LogPhaseTime("store in cache", &phaseStart);
       }
    }
 
@@ -1040,8 +1083,12 @@ Deploy(const char* packageName)
       cloudInitEnabled = TRUE;
       sSkipReboot = TRUE;
       free(command);
+      LogPhaseTime("cloud-init check", &phaseStart);
       deployStatus =  CloudInitSetup(EXTRACTPATH);
+      LogPhaseTime("cloud-init setup", &phaseStart);
    } else {
+      LogPhaseTime("cloud-init check", &phaseStart);
+
       // Run the deployment command
       sLog(log_info, "Launching deployment %s.  \n", command);
       deploymentResult = ForkExecAndWaitCommand(command);
@@ -1081,6 +1128,7 @@ Deploy(const char* packageName)
          deployStatus = DEPLOY_SUCCESS;
          sLog(log_info, "Deployment succeded. \n");
       }
+      LogPhaseTime("customization", &phaseStart);
    }
 
    if (!cloudInitEnabled || DEPLOY_SUCCESS != deployStatus) {
@@ -1102,6 +1150,7 @@ Deploy(const char* packageName)
       } else {
          sLog(log_info, "No nics to enable.\n");
       }
+      LogPhaseTime("enable nics", &phaseStart);
    }
 
    cleanupCommand = malloc(strlen(CLEANUPCMD) + strlen(CLEANUPPATH) + 1);
@@ -1120,6 +1169,8 @@ Deploy(const char* packageName)
       //TODO: What should be done if cleanup fails ??
    }
    free (cleanupCommand);
+   LogPhaseTime("cleanup", &phaseStart);
+   LogPhaseTime("deployment", &deployStart);
 
    if (flags & VMWAREDEPLOYPKG_HEADER_FLAGS_SKIP_REBOOT) {
       forceSkipReboot = true;
@@ -1202,7 +1253,7 @@ ExtractZipPackage(const char* pkgName,
 
    int pkgFd, zipFd;
    char zipName[1024];
-   char copyBuf[4096];
+   char* copyBuf;
    ssize_t rdCount;
    char* destCopy;
 
@@ -1222,15 +1273,51 @@ ExtractZipPackage(const char* pkgName,
       close(pkgFd);
       return FALSE;;
    }
+   if ((copyBuf = malloc(COPYBUFSIZE)) == NULL) {
+      sLog(log_error, "Error allocating memory.");
+      close(pkgFd);
+      close(zipFd);
+      return FALSE;
+   }
    lseek(pkgFd, sizeof(VMwareDeployPkgHdr), 0);
-   while((rdCount = read(pkgFd, copyBuf, sizeof copyBuf)) > 0) {
-      if (write(zipFd, copyBuf, rdCount) < 0) {
-         sLog(log_warning, "write() failed");
+   while((rdCount = read(pkgFd, copyBuf, COPYBUFSIZE)) > 0) {
+      ssize_t done = 0;
+
+      while (done < rdCount) {
+         ssize_t wrCount = write(zipFd, copyBuf + done, rdCount - done);
+
+         if (wrCount < 0) {
+            if (errno == EINTR) {
+               continue;
+            }
+            sLog(log_error, "Failed to write temporary zip file %s: %s",
+                 zipName, strerror(errno));
+            ret = FALSE;
+            break;
+         }
+         done += wrCount;
+      }
+      if (!ret) {
+         break;
       }
    }
+   if (rdCount < 0) {
+      sLog(log_error, "Failed to read package file %s: %s", pkgName,
+           strerror(errno));
+      ret = FALSE;
+   }
 
+   free(copyBuf);
    close(pkgFd);
-   close(zipFd);
+   if (close(zipFd) < 0 && ret) {
+      sLog(log_error, "Failed to write temporary zip file %s: %s", zipName,
+           strerror(errno));
+      ret = FALSE;
+   }
+   if (!ret) {
+      unlink(zipName);
+      return FALSE;
+   }
 
    destCopy = strdup(destDir);  // destDir is const
    args[0] = "/usr/bin/unzip";
@@ -1259,6 +1346,405 @@ ExtractZipPackage(const char* pkgName,
 
 //......................................................................................
 
+/**
+ *
+ * Get the current time in milliseconds, from a clock that is not affected
+ * by changes of the system time (which customization may well do).
+ *
+ * @returns Time in milliseconds
+ *
+ **/
+static uint64
+GetTimeMs(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+//......................................................................................
+
+/**
+ *
+ * Log how long a phase of the deployment took, and start the next one.
+ *
+ * @param   [IN]      phase  Name of the phase
+ * @param   [IN/OUT]  start  Start time of the phase, set to the current time
+ *
+ **/
+static void
+LogPhaseTime(const char* phase,
+             uint64* start)
+{
+   uint64 now = GetTimeMs();
+
+   sLog(log_info, "Phase '%s' took %u ms. \n", phase,
+        (unsigned int)(now - *start));
+   *start = now;
+}
+
+//......................................................................................
+
+/**
+ *
+ * Compute the cache key of a package: the 64-bit FNV-1a hash of its
+ * contents, and its size.
+ *
+ * @param   [IN]  pkgName  Package file
+ * @param   [OUT] key      Buffer for the key
+ * @param   [IN]  keySize  Size of the buffer
+ * @returns TRUE on success, FALSE if the package could not be read
+ *
+ **/
+static Bool
+GetPackageKey(const char* pkgName,
+              char* key,
+              size_t keySize)
+{
+   uint64 hash = CONST64U(14695981039346656037);
+   uint64 size = 0;
+   char* buf;
+   ssize_t count;
+   int fd;
+
+   if ((fd = open(pkgName, O_RDONLY)) < 0) {
+      sLog(log_warning, "Failed to open package file %s for read: %s",
+           pkgName, strerror(errno));
+      return FALSE;
+   }
+   if ((buf = malloc(COPYBUFSIZE)) == NULL) {
+      close(fd);
+      return FALSE;
+   }
+
+   while ((count = read(fd, buf, COPYBUFSIZE)) > 0) {
+      ssize_t i;
+
+      for (i = 0; i < count; i++) {
+         hash ^= (uint8)buf[i];
+         hash *= CONST64U(1099511628211);
+      }
+      size += count;
+   }
+
+   free(buf);
+   close(fd);
+   if (count < 0) {
+      return FALSE;
+   }
+
+   snprintf(key, keySize, "%016"FMT64"x-%"FMT64"x", hash, size);
+   key[keySize - 1] = '\0';
+   return TRUE;
+}
+
+//......................................................................................
+
+/**
+ *
+ * Check that the cache directory can be used: it must be a directory owned
+ * by root that nobody else can access, and we must be root.
+ *
+ * @param   [IN]  create  Create the directory if it does not exist
+ * @returns TRUE if the cache can be used
+ *
+ **/
+static Bool
+OpenCache(Bool create)
+{
+   struct stat stats;
+
+   if (geteuid() != 0) {
+      return FALSE;
+   }
+   if (create && mkdir(CACHEPATH, 0700) == -1 && errno != EEXIST) {
+      sLog(log_warning, "Unable to create directory %s (%s)", CACHEPATH,
+           strerror(errno));
+      return FALSE;
+   }
+   if (lstat(CACHEPATH, &stats) != 0) {
+      return FALSE;
+   }
+   if (!S_ISDIR(stats.st_mode) || stats.st_uid != 0 ||
+       (stats.st_mode & 077) != 0) {
+      sLog(log_warning, "%s is not a directory accessible only by root, "
+           "not using the package cache.", CACHEPATH);
+      return FALSE;
+   }
+   return TRUE;
+}
+
+//......................................................................................
+
+/**
+ *
+ * Remove the cache directory and everything in it.
+ *
+ **/
+static void
+ClearCache(void)
+{
+   if (ForkExecAndWaitCommand(CLEANUPCMD CACHEPATH) != 0) {
+      sLog(log_warning, "Error removing directory %s.", CACHEPATH);
+   }
+}
+
+//......................................................................................
+
+/**
+ *
+ * Copy a file, with its permissions.
+ *
+ * @param   [IN]  from   Source file
+ * @param   [IN]  to     Destination file, replaced if it exists
+ * @param   [IN]  mode   Permissions of the destination
+ * @param   [IN]  buf    Copy buffer of COPYBUFSIZE bytes
+ * @returns TRUE on success
+ *
+ **/
+static Bool
+CopyFile(const char* from,
+         const char* to,
+         mode_t mode,
+         char* buf)
+{
+   int fromFd, toFd;
+   ssize_t rdCount;
+   Bool ret = TRUE;
+
+   if ((fromFd = open(from, O_RDONLY | O_NOFOLLOW)) < 0) {
+      sLog(log_warning, "Failed to open %s for read: %s", from,
+           strerror(errno));
+      return FALSE;
+   }
+   if ((toFd = open(to, O_CREAT | O_WRONLY | O_TRUNC | O_NOFOLLOW,
+                    0600)) < 0) {
+      sLog(log_warning, "Failed to create %s: %s", to, strerror(errno));
+      close(fromFd);
+      return FALSE;
+   }
+
+   while (ret && (rdCount = read(fromFd, buf, COPYBUFSIZE)) > 0) {
+      ssize_t done = 0;
+
+      while (done < rdCount) {
+         ssize_t wrCount = write(toFd, buf + done, rdCount - done);
+
+         if (wrCount < 0) {
+            if (errno == EINTR) {
+               continue;
+            }
+            ret = FALSE;
+            break;
+         }
+         done += wrCount;
+      }
+   }
+   if (rdCount < 0 || fchmod(toFd, mode) != 0) {
+      ret = FALSE;
+   }
+
+   close(fromFd);
+   if (close(toFd) < 0) {
+      ret = FALSE;
+   }
+   if (!ret) {
+      sLog(log_warning, "Failed to copy %s to %s: %s", from, to,
+           strerror(errno));
+   }
+   return ret;
+}
+
+//......................................................................................
+
+/**
+ *
+ * Copy a directory tree of regular files and directories, with their
+ * permissions. Extracted packages hold nothing else, so anything else
+ * fails the copy.
+ *
+ * @param   [IN]  from   Source directory
+ * @param   [IN]  to     Destination directory, created if it does not exist
+ * @param   [IN]  buf    Copy buffer of COPYBUFSIZE bytes
+ * @returns TRUE on success
+ *
+ **/
+static Bool
+CopyTreeWithBuffer(const char* from,
+                   const char* to,
+                   char* buf)
+{
+   struct stat stats;
+   struct dirent* entry;
+   DIR* dir;
+   Bool ret = TRUE;
+
+   if (lstat(from, &stats) != 0 || !S_ISDIR(stats.st_mode)) {
+      sLog(log_warning, "%s is not a directory.", from);
+      return FALSE;
+   }
+   // keep it private until it is complete
+   if (mkdir(to, 0700) == -1 && errno != EEXIST) {
+      sLog(log_warning, "Unable to create directory %s (%s)", to,
+           strerror(errno));
+      return FALSE;
+   }
+   if ((dir = opendir(from)) == NULL) {
+      sLog(log_warning, "Unable to open directory %s (%s)", from,
+           strerror(errno));
+      return FALSE;
+   }
+
+   while (ret && (entry = readdir(dir)) != NULL) {
+      struct stat entryStats;
+      char* fromPath;
+      char* toPath;
+
+      if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+         continue;
+      }
+
+      fromPath = malloc(strlen(from) + strlen(entry->d_name) + 2);
+      toPath = malloc(strlen(to) + strlen(entry->d_name) + 2);
+      if (fromPath == NULL || toPath == NULL) {
+         free(fromPath);
+         free(toPath);
+         ret = FALSE;
+         break;
+      }
+      sprintf(fromPath, "%s/%s", from, entry->d_name);
+      sprintf(toPath, "%s/%s", to, entry->d_name);
+
+      if (lstat(fromPath, &entryStats) != 0) {
+         ret = FALSE;
+      } else if (S_ISDIR(entryStats.st_mode)) {
+         ret = CopyTreeWithBuffer(fromPath, toPath, buf);
+      } else if (S_ISREG(entryStats.st_mode)) {
+         ret = CopyFile(fromPath, toPath, entryStats.st_mode & 0777, buf);
+      } else {
+         sLog(log_warning, "Not copying %s, it is not a regular file.",
+              fromPath);
+         ret = FALSE;
+      }
+
+      free(fromPath);
+      free(toPath);
+   }
+
+   closedir(dir);
+   if (ret && chmod(to, stats.st_mode & 0777) != 0) {
+      ret = FALSE;
+   }
+   return ret;
+}
+
+//......................................................................................
+
+/**
+ *
+ * Copy a directory tree of regular files and directories, with their
+ * permissions.
+ *
+ * @param   [IN]  from   Source directory
+ * @param   [IN]  to     Destination directory, created if it does not exist
+ * @returns TRUE on success
+ *
+ **/
+static Bool
+CopyTree(const char* from,
+         const char* to)
+{
+   char* buf;
+   Bool ret;
+
+   if ((buf = malloc(COPYBUFSIZE)) == NULL) {
+      sLog(log_warning, "Error allocating memory.");
+      return FALSE;
+   }
+   ret = CopyTreeWithBuffer(from, to, buf);
+   free(buf);
+   return ret;
+}
+
+//......................................................................................
+
+/**
+ *
+ * Copy the files of a package from the cache, if it is there.
+ *
+ * @param   [IN]  key      Cache key of the package
+ * @param   [IN]  destDir  Extraction directory
+ * @returns TRUE if the files were copied, FALSE if the package must be
+ *          extracted
+ *
+ **/
+static Bool
+RestoreFromCache(const char* key,
+                 const char* destDir)
+{
+   char path[1024];
+   struct stat stats;
+
+   if (!OpenCache(FALSE)) {
+      return FALSE;
+   }
+
+   snprintf(path, sizeof path, "%s/%s", CACHEPATH, key);
+   path[(sizeof path) - 1] = '\0';
+   if (lstat(path, &stats) != 0 || !S_ISDIR(stats.st_mode)) {
+      return FALSE;
+   }
+
+   if (!CopyTree(path, destDir)) {
+      sLog(log_warning, "Failed to copy the package from the cache.");
+      return FALSE;
+   }
+   return TRUE;
+}
+
+//......................................................................................
+
+/**
+ *
+ * Put the files of an extracted package in the cache, in place of those
+ * of the previous package. The files are copied to a temporary directory
+ * that is renamed when complete, so that an interrupted copy is never taken
+ * for a cached package.
+ *
+ * @param   [IN]  key     Cache key of the package
+ * @param   [IN]  srcDir  Extraction directory
+ *
+ **/
+static void
+StoreInCache(const char* key,
+             const char* srcDir)
+{
+   char path[1024];
+   char tmpPath[1024];
+
+   if (geteuid() != 0) {
+      return;
+   }
+
+   ClearCache();
+   if (!OpenCache(TRUE)) {
+      return;
+   }
+
+   snprintf(path, sizeof path, "%s/%s", CACHEPATH, key);
+   path[(sizeof path) - 1] = '\0';
+   snprintf(tmpPath, sizeof tmpPath, "%s/%s.tmp", CACHEPATH, key);
+   tmpPath[(sizeof tmpPath) - 1] = '\0';
+
+   if (!CopyTree(srcDir, tmpPath) || rename(tmpPath, path) != 0) {
+      sLog(log_warning, "Failed to store the package in the cache.");
+      ClearCache();
+   }
+}
+
+//......................................................................................
+
 /**
  *
  * Coverts the string into array of "C" string with NULL as the last
@@ -22,6 +22,11 @@
  *      Implementation of the mspack wrapper.
  */
 
+#if defined __linux__ && !defined _GNU_SOURCE
+/* Force GNU strerror_r prototype instead of Posix prototype */
+#  define _GNU_SOURCE
+#endif
+
 #include "mspackWrapper.h"
 #include <string.h>
 #include <stdio.h>
@@ -31,12 +36,58 @@
 #include <mspack.h>
 #include <stdarg.h>
 #include <errno.h> 
+#include <pthread.h>
+#include <unistd.h>
+
+/*
+ * Extracted files are written through a buffer of this size, so that each
+ * file takes a few large writes rather than many small ones. The
+ * decompressor reads its input in blocks of CAB_READ_BUFFER_SIZE.
+ */
+
+#define CAB_WRITE_BUFFER_SIZE (1024 * 1024)
+#define CAB_READ_BUFFER_SIZE  (64 * 1024)
+
+// Upper bound on the number of threads extracting folders of a cabinet
+#define CAB_MAX_THREADS 8
+
+/*
+ * mspack I/O system. Each decompressor gets its own, so the threads that
+ * extract different folders do not share any state here.
+ */
+
+typedef struct CabSystem {
+   struct mspack_system ops;
+   int writeError;               // errno of the last failed flush on close
+} CabSystem;
+
+typedef struct CabFile {
+   CabSystem* sys;
+   int fd;
+   char* buf;                    // write buffer, NULL unless opened for writing
+   size_t used;
+} CabFile;
+
+/*
+ * Work shared by the threads extracting a cabinet: each takes the next
+ * folder not extracted yet, until there are none left or one fails.
+ */
+
+typedef struct CabJob {
+   const char* cabFileName;
+   const char* destDirectory;
+   pthread_mutex_t lock;
+   unsigned int nextFolder;
+   unsigned int numFolders;
+   unsigned int error;
+} CabJob;
 
 /*
  * Template functions
  */
 
 static void DefaultLog(int logLevel, const char* fmtstr, ...);
+static const char* ErrnoString(int error, char* buf, size_t bufSize);
 
 /* 
  * String explanation for the error codes.
@@ -59,6 +110,7 @@ static const char*  LINUXCAB_STRERR[] = {
  */
 
 static LogFunction sLog = DefaultLog;
+static unsigned int sMaxThreads = 0;
 
 // .....................................................................................
 
@@ -80,6 +132,33 @@ DefaultLog(int logLevel, const char* fmtstr, ...)
 }
 
 
+// .....................................................................................
+
+/**
+ *
+ * Get the message for an errno value. Unlike strerror(), this is safe to
+ * call from the extraction threads.
+ *
+ * @param   [in]  error    errno value
+ * @param   [in]  buf      Buffer the message may be written to
+ * @param   [in]  bufSize  Size of the buffer
+ * @returns The message, in buf or in static storage
+ *
+ **/
+static const char*
+ErrnoString(int error, char* buf, size_t bufSize)
+{
+#if defined __linux__
+   return strerror_r(error, buf, bufSize);
+#else
+   if (strerror_r(error, buf, bufSize) != 0) {
+      snprintf(buf, bufSize, "error %d", error);
+   }
+   return buf;
+#endif
+}
+
+
 // .....................................................................................
 
 /**
@@ -96,6 +175,346 @@ MspackWrapper_SetLogger(LogFunction log)
    sLog = log;
 }
 
+// .....................................................................................
+
+/**
+ *
+ * Set the maximum number of threads used to extract a cabinet.
+ *
+ * @param   [in]  maxThreads   Number of threads, 0 for one per CPU.
+ * @returns None
+ *
+ **/
+void
+MspackWrapper_SetMaxThreads(unsigned int maxThreads)
+{
+   sMaxThreads = maxThreads;
+}
+
+//......................................................................................
+
+/**
+ *
+ * Write all of a buffer to a file descriptor.
+ *
+ * @param   [in]  fd     File descriptor
+ * @param   [in]  buf    Data to write
+ * @param   [in]  len    Size of the data
+ * @returns 0 on success, -1 on error (errno is set)
+ *
+ **/
+static int
+WriteAll(int fd,
+         const char* buf,
+         size_t len)
+{
+   size_t done = 0;
+
+   while (done < len) {
+      ssize_t n = write(fd, buf + done, len - done);
+
+      if (n < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         return -1;
+      }
+      done += n;
+   }
+   return 0;
+}
+
+//......................................................................................
+
+/**
+ *
+ * Write out the buffered data of a file opened for writing.
+ *
+ * @param   [in]  file  File to flush
+ * @returns 0 on success, -1 on error (errno is set)
+ *
+ **/
+static int
+CabFlush(CabFile* file)
+{
+   int ret = WriteAll(file->fd, file->buf, file->used);
+
+   file->used = 0;
+   return ret;
+}
+
+//......................................................................................
+
+/**
+ *
+ * mspack_system open: open a file for reading or writing. Files opened for
+ * writing get a write buffer.
+ *
+ **/
+static struct mspack_file*
+CabOpen(struct mspack_system* self,
+        const char* filename,
+        int mode)
+{
+   CabFile* file;
+   int flags;
+
+   switch (mode) {
+   case MSPACK_SYS_OPEN_READ:
+      flags = O_RDONLY;
+      break;
+   case MSPACK_SYS_OPEN_WRITE:
+      flags = O_WRONLY | O_CREAT | O_TRUNC;
+      break;
+   case MSPACK_SYS_OPEN_UPDATE:
+      flags = O_RDWR;
+      break;
+   case MSPACK_SYS_OPEN_APPEND:
+      flags = O_WRONLY | O_CREAT | O_APPEND;
+      break;
+   default:
+      return NULL;
+   }
+
+   file = calloc(1, sizeof *file);
+   if (!file) {
+      return NULL;
+   }
+   file->sys = (CabSystem*)self;
+   if (mode == MSPACK_SYS_OPEN_WRITE) {
+      file->buf = malloc(CAB_WRITE_BUFFER_SIZE);
+      if (!file->buf) {
+         free(file);
+         return NULL;
+      }
+   }
+
+   file->fd = open(filename, flags, 0666);
+   if (file->fd < 0) {
+      free(file->buf);
+      free(file);
+      return NULL;
+   }
+   return (struct mspack_file*)file;
+}
+
+//......................................................................................
+
+/**
+ *
+ * mspack_system close: flush and close a file. mspack has no way to hear
+ * about a failed flush here, so it is recorded in the CabSystem.
+ *
+ **/
+static void
+CabClose(struct mspack_file* mspackFile)
+{
+   CabFile* file = (CabFile*)mspackFile;
+
+   if (file->buf && CabFlush(file) != 0) {
+      file->sys->writeError = errno;
+   }
+   close(file->fd);
+   free(file->buf);
+   free(file);
+}
+
+//......................................................................................
+
+/**
+ *
+ * mspack_system read: read up to bytes, short only at end of file.
+ *
+ **/
+static int
+CabRead(struct mspack_file* mspackFile,
+        void* buffer,
+        int bytes)
+{
+   CabFile* file = (CabFile*)mspackFile;
+   int done = 0;
+
+   while (done < bytes) {
+      ssize_t n = read(file->fd, (char*)buffer + done, bytes - done);
+
+      if (n < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         return -1;
+      }
+      if (n == 0) {
+         break;
+      }
+      done += n;
+   }
+   return done;
+}
+
+//......................................................................................
+
+/**
+ *
+ * mspack_system write: buffer small writes, write big ones through.
+ *
+ **/
+static int
+CabWrite(struct mspack_file* mspackFile,
+         void* buffer,
+         int bytes)
+{
+   CabFile* file = (CabFile*)mspackFile;
+
+   if (file->buf) {
+      if (file->used + bytes > CAB_WRITE_BUFFER_SIZE && CabFlush(file) != 0) {
+         return -1;
+      }
+      if (bytes < CAB_WRITE_BUFFER_SIZE) {
+         memcpy(file->buf + file->used, buffer, bytes);
+         file->used += bytes;
+         return bytes;
+      }
+   }
+
+   return WriteAll(file->fd, buffer, bytes) == 0 ? bytes : -1;
+}
+
+//......................................................................................
+
+/**
+ *
+ * mspack_system seek.
+ *
+ **/
+static int
+CabSeek(struct mspack_file* mspackFile,
+        off_t offset,
+        int mode)
+{
+   CabFile* file = (CabFile*)mspackFile;
+   int whence;
+
+   switch (mode) {
+   case MSPACK_SYS_SEEK_START:
+      whence = SEEK_SET;
+      break;
+   case MSPACK_SYS_SEEK_CUR:
+      whence = SEEK_CUR;
+      break;
+   case MSPACK_SYS_SEEK_END:
+      whence = SEEK_END;
+      break;
+   default:
+      return -1;
+   }
+
+   if (file->buf && CabFlush(file) != 0) {
+      return -1;
+   }
+   return lseek(file->fd, offset, whence) == (off_t)-1 ? -1 : 0;
+}
+
+//......................................................................................
+
+/**
+ *
+ * mspack_system tell.
+ *
+ **/
+static off_t
+CabTell(struct mspack_file* mspackFile)
+{
+   CabFile* file = (CabFile*)mspackFile;
+   off_t pos = lseek(file->fd, 0, SEEK_CUR);
+
+   return pos == (off_t)-1 ? pos : pos + (off_t)file->used;
+}
+
+//......................................................................................
+
+/**
+ *
+ * mspack_system message: pass warnings from the library to our log.
+ *
+ **/
+static void
+CabMessage(struct mspack_file* file,
+           const char* format,
+           ...)
+{
+   char msg[256];
+   va_list args;
+
+   va_start(args, format);
+   vsnprintf(msg, sizeof msg, format, args);
+   va_end(args);
+   sLog(log_warning, "mspack: %s\n", msg);
+}
+
+//......................................................................................
+
+/**
+ *
+ * mspack_system alloc, free and copy.
+ *
+ **/
+static void*
+CabAlloc(struct mspack_system* self,
+         size_t bytes)
+{
+   return malloc(bytes);
+}
+
+static void
+CabFree(void* ptr)
+{
+   free(ptr);
+}
+
+static void
+CabCopy(void* src,
+        void* dest,
+        size_t bytes)
+{
+   memcpy(dest, src, bytes);
+}
+
+//......................................................................................
+
+/**
+ *
+ * Create a cabinet decompressor doing its I/O through the given system.
+ *
+ * @param   [out] sys   I/O system for the decompressor, initialized here
+ * @returns The decompressor, NULL on error
+ *
+ **/
+static struct mscab_decompressor*
+CreateDecompressor(CabSystem* sys)
+{
+   struct mscab_decompressor* deflator;
+
+   memset(sys, 0, sizeof *sys);
+   sys->ops.open = CabOpen;
+   sys->ops.close = CabClose;
+   sys->ops.read = CabRead;
+   sys->ops.write = CabWrite;
+   sys->ops.seek = CabSeek;
+   sys->ops.tell = CabTell;
+   sys->ops.message = CabMessage;
+   sys->ops.alloc = CabAlloc;
+   sys->ops.free = CabFree;
+   sys->ops.copy = CabCopy;
+
+   deflator = mspack_create_cab_decompressor(&sys->ops);
+#ifdef MSCABD_PARAM_DECOMPBUF
+   if (deflator) {
+      deflator->set_param(deflator, MSCABD_PARAM_DECOMPBUF, CAB_READ_BUFFER_SIZE);
+   }
+#endif
+   return deflator;
+}
+
 //......................................................................................
 
 /**
@@ -114,6 +533,7 @@ unsigned int
 SetupPath (char* path) {
    struct stat stats;
    char* token;
+   char errBuf[128];
 
    // walk through the path (it employs in string replacement) 
    for (token = path; *token; ++token) {
@@ -136,12 +556,15 @@ SetupPath (char* path) {
       sLog(log_debug, "Creating directory %s \n", path);
 #endif
 
-      // ignore if the directory exists
+      /*
+       * ignore if the directory exists; another thread extracting the same
+       * cabinet may create it between the stat and the mkdir
+       */
       if (!((stat(path, &stats) == 0) && S_ISDIR(stats.st_mode))) {
          // make directory and check error
-         if (mkdir(path, 0777) == -1) {
+         if (mkdir(path, 0777) == -1 && errno != EEXIST) {
             sLog(log_error, "Unable to create directory %s (%s)\n", path, 
-                 strerror(errno));
+                 ErrnoString(errno, errBuf, sizeof errBuf));
             return LINUXCAB_ERROR;
          }
       }
@@ -160,6 +583,7 @@ SetupPath (char* path) {
  * Extract one given file.
  *
  * @param deflator      IN: Pointer to the cabinet decompressor
+ * @param sys           IN: I/O system of the decompressor
  * @param file          IN: Pointer to file under decompression
  * @param destDirector  IN: Destination directory
  * @return
@@ -169,10 +593,12 @@ SetupPath (char* path) {
  **/
 static unsigned int
 ExtractFile (struct mscab_decompressor* deflator,
+             CabSystem* sys,
              struct mscabd_file* file,
              const char* destDirectory)
 {
    size_t sz;
+   char errBuf[128];
 
    // copy it into a string as SetupPath will do an in place text manipulation
    char fileName[strlen(file->filename)+1];
@@ -194,9 +620,15 @@ ExtractFile (struct mscab_decompressor* deflator,
       #endif
 
       // Extract File
+      sys->writeError = 0;
       if (deflator->extract(deflator,file,outCabFile) != MSPACK_ERR_OK) {
          return LINUXCAB_ERR_EXTRACT;
       }
+      if (sys->writeError != 0) {
+         sLog(log_error, "Error writing %s (%s)\n", outCabFile,
+              ErrnoString(sys->writeError, errBuf, sizeof errBuf));
+         return LINUXCAB_ERR_EXTRACT;
+      }
    }
 
    return LINUXCAB_SUCCESS;
@@ -204,6 +636,250 @@ ExtractFile (struct mscab_decompressor* deflator,
 
 //.............................................................................
 
+/**
+ *
+ * Extract folders of a cabinet, taking them one at a time from the job
+ * until all have been taken or extraction failed somewhere. The files of a
+ * folder form one compressed stream, so they are extracted in order by one
+ * thread; different folders are independent.
+ *
+ * @param deflator      IN: Decompressor, private to this thread
+ * @param sys           IN: I/O system of the decompressor
+ * @param cab           IN: The cabinet, as opened by this decompressor
+ * @param job           IN: Shared state of the extraction
+ *
+ **/
+static void
+ExtractFolders(struct mscab_decompressor* deflator,
+               CabSystem* sys,
+               struct mscabd_cabinet* cab,
+               CabJob* job)
+{
+   for (;;) {
+      struct mscabd_folder* folder = cab->folders;
+      struct mscabd_file* file;
+      unsigned int index;
+      unsigned int error = LINUXCAB_SUCCESS;
+
+      pthread_mutex_lock(&job->lock);
+      index = job->nextFolder++;
+      if (job->error != LINUXCAB_SUCCESS) {
+         index = job->numFolders;
+      }
+      pthread_mutex_unlock(&job->lock);
+
+      if (index >= job->numFolders) {
+         return;
+      }
+
+      while (index-- > 0 && folder) {
+         folder = folder->next;
+      }
+
+      for (file = cab->files; file && error == LINUXCAB_SUCCESS;
+           file = file->next) {
+         if (file->folder == folder) {
+            error = ExtractFile(deflator, sys, file, job->destDirectory);
+         }
+      }
+
+      if (error != LINUXCAB_SUCCESS) {
+         pthread_mutex_lock(&job->lock);
+         if (job->error == LINUXCAB_SUCCESS) {
+            job->error = error;
+         }
+         pthread_mutex_unlock(&job->lock);
+         return;
+      }
+   }
+}
+
+//.............................................................................
+
+/**
+ *
+ * Thread body for extracting folders of a cabinet with a decompressor of
+ * its own.
+ *
+ * @param data          IN: The CabJob
+ * @return NULL
+ *
+ **/
+static void*
+ExtractFoldersThread(void* data)
+{
+   CabJob* job = data;
+   CabSystem sys;
+   struct mscab_decompressor* deflator = CreateDecompressor(&sys);
+   struct mscabd_cabinet* cab = NULL;
+   unsigned int error = LINUXCAB_SUCCESS;
+
+   if (!deflator) {
+      error = LINUXCAB_ERR_DECOMPRESSOR;
+   } else if (!(cab = deflator->search(deflator, (char*)job->cabFileName))) {
+      error = LINUXCAB_ERR_OPEN;
+   } else {
+      ExtractFolders(deflator, &sys, cab, job);
+      deflator->close(deflator, cab);
+   }
+
+   if (deflator) {
+      mspack_destroy_cab_decompressor(deflator);
+   }
+
+   if (error != LINUXCAB_SUCCESS) {
+      pthread_mutex_lock(&job->lock);
+      if (job->error == LINUXCAB_SUCCESS) {
+         job->error = error;
+      }
+      pthread_mutex_unlock(&job->lock);
+   }
+   return NULL;
+}
+
+//.............................................................................
+
+/**
+ *
+ * Extract the folders of a single cabinet with several threads. This
+ * thread takes part with the decompressor that already opened the cabinet.
+ *
+ * @param deflator      IN: Decompressor that opened the cabinet
+ * @param sys           IN: I/O system of the decompressor
+ * @param cab           IN: The cabinet
+ * @param cabFileName   IN: Cabinet file name, for the other threads to open
+ * @param destDirectory IN: Destination directory
+ * @param numFolders    IN: Number of folders in the cabinet
+ * @param numThreads    IN: Number of threads to use, including this one
+ *
+ * @return LINUXCAB_SUCCESS or the first error of any thread
+ *
+ **/
+static unsigned int
+ExtractFoldersParallel(struct mscab_decompressor* deflator,
+                       CabSystem* sys,
+                       struct mscabd_cabinet* cab,
+                       const char* cabFileName,
+                       const char* destDirectory,
+                       unsigned int numFolders,
+                       unsigned int numThreads)
+{
+   pthread_t threads[CAB_MAX_THREADS];
+   unsigned int started = 0;
+   unsigned int i;
+   CabJob job;
+   char errBuf[128];
+
+   job.cabFileName = cabFileName;
+   job.destDirectory = destDirectory;
+   job.nextFolder = 0;
+   job.numFolders = numFolders;
+   job.error = LINUXCAB_SUCCESS;
+   pthread_mutex_init(&job.lock, NULL);
+
+   for (i = 1; i < numThreads; i++) {
+      /* If a thread cannot be started, the others take its share. */
+      int ret = pthread_create(&threads[started], NULL, ExtractFoldersThread,
+                               &job);
+
+      if (ret != 0) {
+         sLog(log_warning, "Unable to start extraction thread (%s)\n",
+              ErrnoString(ret, errBuf, sizeof errBuf));
+         break;
+      }
+      started++;
+   }
+
+#ifdef VMX86_DEBUG
+   sLog(log_debug, "Extracting %u folders with %u threads\n", numFolders,
+        started + 1);
+#endif
+
+   ExtractFolders(deflator, sys, cab, &job);
+
+   for (i = 0; i < started; i++) {
+      pthread_join(threads[i], NULL);
+   }
+   pthread_mutex_destroy(&job.lock);
+
+   return job.error;
+}
+
+//.............................................................................
+
+/**
+ *
+ * Compare two file names of a cabinet as the paths they are extracted to,
+ * i.e. with '\\' and '/' the same. qsort() callback.
+ *
+ * @param a             IN: Pointer to the first file name
+ * @param b             IN: Pointer to the second file name
+ * @return <0, 0 or >0 as for strcmp()
+ *
+ **/
+static int
+CompareFileNames(const void* a,
+                 const void* b)
+{
+   const char* n1 = *(const char* const*)a;
+   const char* n2 = *(const char* const*)b;
+
+   for (;; n1++, n2++) {
+      int c1 = *n1 == '\\' ? '/' : (unsigned char)*n1;
+      int c2 = *n2 == '\\' ? '/' : (unsigned char)*n2;
+
+      if (c1 != c2 || c1 == 0) {
+         return c1 - c2;
+      }
+   }
+}
+
+//.............................................................................
+
+/**
+ *
+ * Check whether several files of a cabinet are extracted to the same path.
+ * Extracted sequentially, the last one wins; threads extracting them in
+ * parallel would race writing the same file.
+ *
+ * @param cab           IN: The cabinet
+ * @return Non-zero if so, or if it could not be checked
+ *
+ **/
+static int
+HasDuplicateFileNames(struct mscabd_cabinet* cab)
+{
+   struct mscabd_file* file;
+   const char** names;
+   unsigned int numFiles = 0;
+   unsigned int i;
+   int found = 0;
+
+   for (file = cab->files; file; file = file->next) {
+      numFiles++;
+   }
+   if ((names = malloc(numFiles * sizeof *names)) == NULL) {
+      return 1;
+   }
+   for (file = cab->files, i = 0; file; file = file->next, i++) {
+      names[i] = file->filename;
+   }
+
+   qsort(names, numFiles, sizeof *names, CompareFileNames);
+   for (i = 1; i < numFiles && !found; i++) {
+      found = CompareFileNames(&names[i - 1], &names[i]) == 0;
+   }
+   if (found) {
+      sLog(log_info, "File %s appears more than once in the cabinet\n",
+           names[i - 1]);
+   }
+
+   free(names);
+   return found;
+}
+
+//.............................................................................
+
 /**
  * 
  * Expands all files in the cabinet into the specified directory. Also returns
@@ -225,12 +901,13 @@ ExpandAllFilesInCab (const char* cabFileName,
    int returnState = LINUXCAB_SUCCESS;
    struct mscabd_cabinet* cab;
    struct mscabd_cabinet* cabToClose;
+   struct mscabd_folder* folder;
+   unsigned int numFolders = 0;
+   unsigned int numThreads;
+   CabSystem sys;
 
-   // Create decompressor instance
-   // Note : I am using NULL for reading file operations meaning requesting it
-   // to use the default routines. It may be a good idea to write that up in the
-   // future
-   struct mscab_decompressor* deflator = mspack_create_cab_decompressor (NULL);
+   // Create decompressor instance, with buffered writes
+   struct mscab_decompressor* deflator = CreateDecompressor(&sys);
 
    // deflator error ?
    if (!deflator) {
@@ -243,9 +920,41 @@ ExpandAllFilesInCab (const char* cabFileName,
 
    // was the file found ?
    if (!cab) {
+      mspack_destroy_cab_decompressor(deflator);
       return LINUXCAB_ERR_OPEN;
    }
 
+   /*
+    * Folders of a single cabinet are independent compressed streams, so
+    * they can be extracted in parallel. Sets of several cabinets, where a
+    * folder may span cabinets, are extracted sequentially, and so are
+    * cabinets holding several files of the same name, for the last one to
+    * win as it always did.
+    */
+   for (folder = cab->folders; folder; folder = folder->next) {
+      numFolders++;
+   }
+   numThreads = sMaxThreads != 0 ? sMaxThreads : sysconf(_SC_NPROCESSORS_ONLN);
+   if (numThreads > CAB_MAX_THREADS) {
+      numThreads = CAB_MAX_THREADS;
+   }
+   if (numThreads > numFolders) {
+      numThreads = numFolders;
+   }
+   if (cab->next || cab->prevcab || cab->nextcab) {
+      numThreads = 1;
+   }
+   if (numThreads > 1 && HasDuplicateFileNames(cab)) {
+      numThreads = 1;
+   }
+
+   if (numThreads > 1) {
+      returnState = ExtractFoldersParallel(deflator, &sys, cab, cabFileName,
+                                           destDirectory, numFolders,
+                                           numThreads);
+      cab = NULL;
+   }
+
    /*
     * Extract file by file 
     * NOTE: open call cannot be used as cab can span multiple files. Hence
@@ -259,7 +968,7 @@ ExpandAllFilesInCab (const char* cabFileName,
 
       // iterate through the files
       while(file) {
-         returnState = ExtractFile(deflator, file, destDirectory);
+         returnState = ExtractFile(deflator, &sys, file, destDirectory);
 
          // error extracting ?
          if (returnState != LINUXCAB_SUCCESS) { 
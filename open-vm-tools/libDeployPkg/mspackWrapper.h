@@ -72,6 +72,20 @@
 void
 MspackWrapper_SetLogger(LogFunction log);
 
+// .....................................................................................
+
+/**
+ *
+ * Set the maximum number of threads used to extract the folders of a
+ * cabinet in parallel.
+ *
+ * @param   [in]  maxThreads   Number of threads, 0 for one per online CPU.
+ * @returns None
+ *
+ **/
+void
+MspackWrapper_SetMaxThreads(unsigned int maxThreads);
+
 //......................................................................................
 
 /**
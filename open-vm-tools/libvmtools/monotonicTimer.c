@@ -20,6 +20,12 @@
  * @file monotonicTimer.c
  *
  * A GSource that implements a timer backed by a monotonic time source.
+ *
+ * A timer may be given some slack, in which case its expiration is pushed
+ * out to the next multiple of the slack on the monotonic clock. All timers
+ * in the process that share a slack (or whose slacks are multiples of each
+ * other) then expire together, so that an idle process wakes up once for
+ * all of them instead of once for each.
  */
 
 #include <limits.h>
@@ -30,10 +36,39 @@
 typedef struct MTimerSource {
    GSource     src;
    gint        timeout;
+   gint        slack;
    uint64      last;
 } MTimerSource;
 
 
+/*
+ *******************************************************************************
+ * MTimerSourceDeadline --                                                */ /**
+ *
+ * Computes when the timer should next fire: 'timeout' after the last time
+ * it fired, rounded up to a multiple of the slack.
+ *
+ * @param[in]  timer       The timer.
+ *
+ * @return The deadline, in milliseconds of monotonic time.
+ *
+ *******************************************************************************
+ */
+
+static uint64
+MTimerSourceDeadline(MTimerSource *timer)
+{
+   uint64 deadline = timer->last + timer->timeout;
+
+   if (timer->slack > 0) {
+      deadline += timer->slack - 1;
+      deadline -= deadline % timer->slack;
+   }
+
+   return deadline;
+}
+
+
 /*
  *******************************************************************************
  * MTimerSourcePrepare --                                                 */ /**
@@ -62,18 +97,26 @@ MTimerSourcePrepare(GSource *src,
       return TRUE;
    } else {
          uint64 now = System_GetTimeMonotonic() * 10;
-         uint64 diff;
+         uint64 deadline = MTimerSourceDeadline(timer);
 
          ASSERT(now >= timer->last);
 
-         diff = now - timer->last;
-         if (diff >= timer->timeout) {
-            timer->last = now;
+         if (now >= deadline) {
+            /*
+             * If the timer fires within its slack, count from the deadline
+             * so that it stays on the shared schedule; otherwise the main
+             * loop was busy, and it starts over from now.
+             */
+            if (timer->slack > 0 && now - deadline < timer->slack) {
+               timer->last = deadline;
+            } else {
+               timer->last = now;
+            }
             *timeout = 0;
             return TRUE;
          }
 
-      *timeout = MIN(INT_MAX, timer->timeout - diff);
+      *timeout = MIN(INT_MAX, deadline - now);
       return FALSE;
    }
 }
@@ -167,6 +210,36 @@ MTimerSourceFinalize(GSource *src)
 
 GSource *
 VMTools_CreateTimer(gint timeout)
+{
+   return VMTools_CreateCoalescedTimer(timeout, 0);
+}
+
+
+/*
+ *******************************************************************************
+ * VMTools_CreateCoalescedTimer --                                        */ /**
+ *
+ * @brief Create a monotonic timer that may fire up to 'slack' milliseconds
+ * late.
+ *
+ * The timer fires at the first multiple of 'slack' on the monotonic clock
+ * that is at least 'timeout' milliseconds after it last fired, so periodic
+ * timers that can tolerate some delay and use the same slack share their
+ * wakeups. A slack of 1000 has the timer fire on whole seconds, like
+ * g_timeout_add_seconds().
+ *
+ * @param[in] timeout   The timeout for the timer, must be >= 0.
+ * @param[in] slack     How late the timer may fire, must be >= 0. 0 means
+ *                      the same as VMTools_CreateTimer().
+ *
+ * @return The new source.
+ *
+ *******************************************************************************
+ */
+
+GSource *
+VMTools_CreateCoalescedTimer(gint timeout,
+                             gint slack)
 {
    static GSourceFuncs srcFuncs = {
       MTimerSourcePrepare,
@@ -179,10 +252,12 @@ VMTools_CreateTimer(gint timeout)
    MTimerSource *ret;
 
    ASSERT(timeout >= 0);
+   ASSERT(slack >= 0);
 
    ret = (MTimerSource *) g_source_new(&srcFuncs, sizeof *ret);
    ret->last = System_GetTimeMonotonic() * 10;
    ret->timeout = timeout;
+   ret->slack = slack;
 
    return &ret->src;
 }
@@ -0,0 +1,163 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file procExitSource.c
+ *
+ *    A GSource implementation that is activated when a process started with
+ *    ProcMgr_ExecAsync() exits.
+ *
+ *    On POSIX systems the selectable of an async proc is the read end of the
+ *    pipe the waiter process writes the exit status to, so it becomes
+ *    readable as soon as the child is done. On Windows it is the process
+ *    handle, which is signaled when the process exits. Either way the main
+ *    loop can poll it directly instead of polling the process on a timer.
+ */
+
+#include "vm_assert.h"
+#include "procMgr.h"
+#include "vmware/tools/utils.h"
+
+typedef struct ProcExitSource {
+   GSource     src;
+   GPollFD     exitFd;
+} ProcExitSource;
+
+
+/**
+ * Does nothing.
+ *
+ * @param[in]  _src        Unused.
+ * @param[out] timeout     Set to -1.
+ *
+ * @return FALSE
+ */
+
+static gboolean
+ProcExitSourcePrepare(GSource *_src,
+                      gint *timeout)
+{
+   *timeout = -1;
+   return FALSE;
+}
+
+
+/**
+ * Checks whether the process has exited.
+ *
+ * @param[in]  _src     The event source.
+ *
+ * @return Whether the process's selectable was signaled.
+ */
+
+static gboolean
+ProcExitSourceCheck(GSource *_src)
+{
+   ProcExitSource *src = (ProcExitSource *) _src;
+   return (src->exitFd.revents != 0);
+}
+
+
+/**
+ * Calls the callback associated with the source, if any.
+ *
+ * The callback is expected to collect the exit code and return FALSE; if it
+ * returns TRUE it will be called again on every main loop iteration, since
+ * the selectable stays signaled.
+ *
+ * @param[in]  src         The event source.
+ * @param[in]  callback    The callback to be called.
+ * @param[in]  data        User-supplied data.
+ *
+ * @return The return value of the callback, or FALSE if the callback is NULL.
+ */
+
+static gboolean
+ProcExitSourceDispatch(GSource *src,
+                       GSourceFunc callback,
+                       gpointer data)
+{
+   return (callback != NULL) ? callback(data) : FALSE;
+}
+
+
+/**
+ * Destroys the event source. Nothing needs to be done; the selectable
+ * belongs to the async proc.
+ *
+ * @param[in]  src      The event source.
+ */
+
+static void
+ProcExitSourceFinalize(GSource *src)
+{
+}
+
+/**
+ * @addtogroup vmtools_utils
+ * @{
+ */
+
+/**
+ * Creates a new source that is dispatched when the given async process
+ * exits. The callback is a regular GSourceFunc; it would normally call
+ * ProcMgr_GetExitCode() and return FALSE.
+ *
+ * The async proc must outlive the source, since the source polls its
+ * selectable.
+ *
+ * Example:
+ *
+ * @code
+ *
+ *    GSource *src = VMTools_NewProcExitSource(asyncProc);
+ *    g_source_set_callback(src, MyCallback, myData, NULL);
+ *    g_source_attach(src, myContext);
+ *    g_source_unref(src);
+ *
+ * @endcode
+ *
+ * @param[in]  asyncProc   Process to watch.
+ *
+ * @return Pointer to the new source.
+ */
+
+GSource *
+VMTools_NewProcExitSource(struct ProcMgr_AsyncProc *asyncProc)
+{
+   static GSourceFuncs srcFuncs = {
+      ProcExitSourcePrepare,
+      ProcExitSourceCheck,
+      ProcExitSourceDispatch,
+      ProcExitSourceFinalize,
+      NULL,
+      NULL
+   };
+   ProcExitSource *ret;
+
+   ASSERT(asyncProc != NULL);
+
+   ret = (ProcExitSource *) g_source_new(&srcFuncs, sizeof *ret);
+   ret->exitFd.fd = (intptr_t) ProcMgr_GetAsyncProcSelectable(asyncProc);
+   ret->exitFd.events = G_IO_IN | G_IO_HUP | G_IO_ERR;
+
+   g_source_add_poll(&ret->src, &ret->exitFd);
+   return &ret->src;
+}
+
+/** @}  */
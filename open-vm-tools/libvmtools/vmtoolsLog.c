@@ -387,38 +387,55 @@ VMToolsFreeLogEntry(gpointer data)
 
 
 /**
- * Function that calls the log handler.
+ * Function that calls the log handler for a formatted message.
  *
- * Also, frees the _data to avoid having separate free call.
- *
- * @param[in] _data     LogEntry pointer.
- * @param[in] userData  User data pointer.
+ * @param[in] domain    Log domain.
+ * @param[in] level     Log level.
+ * @param[in] msg       Formatted message.
+ * @param[in] handler   Handler to log to.
  */
 
 static void
-VMToolsLogMsg(gpointer _data, gpointer userData)
+VMToolsDispatchMsg(const gchar *domain,
+                   GLogLevelFlags level,
+                   const gchar *msg,
+                   LogHandler *handler)
 {
-   LogEntry *entry = _data;
-   GlibLogger *logger = entry->handler->logger;
+   GlibLogger *logger = handler->logger;
    gboolean usedSyslog = FALSE;
 
    if (logger != NULL) {
-       logger->logfn(entry->domain, entry->level, entry->msg, logger);
-       usedSyslog = entry->handler->isSysLog;
+       logger->logfn(domain, level, msg, logger);
+       usedSyslog = handler->isSysLog;
    } else if (gErrorData->logger != NULL) {
-      gErrorData->logger->logfn(entry->domain, entry->level, entry->msg,
-                                gErrorData->logger);
+      gErrorData->logger->logfn(domain, level, msg, gErrorData->logger);
       usedSyslog = gErrorData->isSysLog;
    }
 
    /*
     * Any fatal errors need to go to syslog no matter what.
     */
-   if (!usedSyslog && IS_FATAL(entry->level) && gErrorSyslog) {
-      gErrorSyslog->logger->logfn(entry->domain, entry->level, entry->msg,
-                                  gErrorSyslog->logger);
+   if (!usedSyslog && IS_FATAL(level) && gErrorSyslog) {
+      gErrorSyslog->logger->logfn(domain, level, msg, gErrorSyslog->logger);
    }
+}
+
+
+/**
+ * Function that calls the log handler for a cached entry.
+ *
+ * Also, frees the _data to avoid having separate free call.
+ *
+ * @param[in] _data     LogEntry pointer.
+ * @param[in] userData  User data pointer.
+ */
 
+static void
+VMToolsLogMsg(gpointer _data, gpointer userData)
+{
+   LogEntry *entry = _data;
+
+   VMToolsDispatchMsg(entry->domain, entry->level, entry->msg, entry->handler);
    VMToolsFreeLogEntry(entry);
 }
 
@@ -442,28 +459,24 @@ VMToolsLog(const gchar *domain,
    LogHandler *data = _data;
 
    if (SHOULD_LOG(level, data)) {
-      LogEntry *entry;
-
       data = data->inherited ? gDefaultData : data;
 
-      entry = g_malloc0(sizeof(LogEntry));
-      if (entry) {
-         entry->domain = domain ? g_strdup(domain) : NULL;
-         if (domain && !entry->domain) {
-            VMToolsLogPanic();
-         }
-         entry->handler = data;
-         entry->level = level;
-      }
-
       if (gLogIOSuspended && data->needsFileIO) {
+         LogEntry *entry;
+
          if (gMaxCacheEntries == 0) {
             /* No way to log at this point, drop it */
-            VMToolsFreeLogEntry(entry);
             gDroppedLogCount++;
             goto exit;
          }
 
+         entry = g_malloc0(sizeof(LogEntry));
+         entry->domain = domain ? g_strdup(domain) : NULL;
+         if (domain && !entry->domain) {
+            VMToolsLogPanic();
+         }
+         entry->handler = data;
+         entry->level = level;
          entry->msg = VMToolsLogFormat(message, domain, level, data, TRUE);
 
          /*
@@ -509,8 +522,10 @@ VMToolsLog(const gchar *domain,
          }
 
       } else {
-         entry->msg = VMToolsLogFormat(message, domain, level, data, FALSE);
-         VMToolsLogMsg(entry, NULL);
+         gchar *msg = VMToolsLogFormat(message, domain, level, data, FALSE);
+
+         VMToolsDispatchMsg(domain, level, msg, data);
+         g_free(msg);
       }
    }
 
@@ -637,6 +652,7 @@ VMToolsGetLogHandler(const gchar *handler,
       gboolean append = strcmp(handler, "file+") == 0;
       guint maxSize;
       guint maxFiles;
+      gboolean async;
       GError *err = NULL;
 
       /* Use the same type name for both. */
@@ -659,7 +675,16 @@ VMToolsGetLogHandler(const gchar *handler,
             maxFiles = 10;
          }
 
-         glogger = GlibUtils_CreateFileLogger(path, append, maxSize, maxFiles);
+         /* Write from a background thread unless told otherwise. */
+         g_snprintf(key, sizeof key, "%s.async", domain);
+         async = g_key_file_get_boolean(cfg, LOGGING_GROUP, key, &err);
+         if (err != NULL) {
+            g_clear_error(&err);
+            async = TRUE;
+         }
+
+         glogger = GlibUtils_CreateFileLogger(path, append, maxSize, maxFiles,
+                                              async);
          needsFileIO = TRUE;
       } else {
          g_warning("Missing path for domain '%s'.", domain);
@@ -1303,14 +1328,60 @@ VMTools_RestartLogging(void)
 }
 
 
+/**
+ * Suspends or resumes writing by a handler's logger, if it queues messages.
+ *
+ * @param[in] handler   Log handler, may be NULL.
+ * @param[in] suspend   Whether to suspend or resume.
+ */
+
+static void
+VMToolsSuspendLogHandler(LogHandler *handler,
+                         gboolean suspend)
+{
+   if (handler != NULL && handler->needsFileIO &&
+       handler->logger != NULL && handler->logger->suspend != NULL) {
+      handler->logger->suspend(handler->logger, suspend);
+   }
+}
+
+
+/**
+ * Suspends or resumes writing by all the loggers that queue messages.
+ *
+ * @param[in] suspend   Whether to suspend or resume.
+ */
+
+static void
+VMToolsSuspendLogHandlers(gboolean suspend)
+{
+   guint i;
+
+   g_static_rec_mutex_lock(&gLogStateMutex);
+   VMToolsSuspendLogHandler(gDefaultData, suspend);
+   VMToolsSuspendLogHandler(gErrorData, suspend);
+   if (gDomains != NULL) {
+      for (i = 0; i < gDomains->len; i++) {
+         VMToolsSuspendLogHandler(g_ptr_array_index(gDomains, i), suspend);
+      }
+   }
+   g_static_rec_mutex_unlock(&gLogStateMutex);
+}
+
+
 /**
  * Suspend IO caused by logging activity.
+ *
+ * Messages already queued by async file loggers are written out before
+ * returning. Their writer threads then write nothing until IO resumes,
+ * including messages queued by threads that raced with this call.
  */
 
 void
 VMTools_SuspendLogIO()
 {
    gLogIOSuspended = TRUE;
+   VMToolsSuspendLogHandlers(TRUE);
 }
 
 
@@ -1327,6 +1398,7 @@ VMTools_ResumeLogIO()
     * Resume the log IO first, so that we can also log messages
     * from within this function itself!
     */
+   VMToolsSuspendLogHandlers(FALSE);
    gLogIOSuspended = FALSE;
 
    /*
@@ -88,6 +88,17 @@ MALLOC_DEFINE(M_VMMEMCTL, BALLOON_NAME, "vmmemctl metadata");
 
 static os_state global_state;
 
+/*
+ * Inflation rate policy, a BalloonRatePolicy: 0 for fixed rates, 1 for
+ * rates following the guest memory pressure. Both a loader tunable and a
+ * sysctl, vm.vmmemctl_rate_policy; the poll picks up changes.
+ */
+static int vmmemctl_rate_policy = BALLOON_RATE_POLICY;
+TUNABLE_INT("vm." BALLOON_NAME "_rate_policy", &vmmemctl_rate_policy);
+SYSCTL_INT(_vm, OID_AUTO, vmmemctl_rate_policy, CTLFLAG_RW,
+           &vmmemctl_rate_policy, 0,
+           BALLOON_NAME " inflation rate policy (0 fixed, 1 adaptive)");
+
 static void vmmemctl_init_sysctl(void);
 static void vmmemctl_deinit_sysctl(void);
 
@@ -227,6 +238,40 @@ OS_ReservedPageGetLimit(void)
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * OS_MemoryPressure --
+ *
+ *      Estimate how short of memory the guest is, from how far the free
+ *      and cached pages are below the target of the page daemon.
+ *
+ * Results:
+ *      0 when the page daemon is idle, up to 100 when the free pages are
+ *      down to the minimum.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+unsigned int
+OS_MemoryPressure(void)
+{
+   u_int avail = cnt.v_free_count + cnt.v_cache_count;
+
+   if (avail >= cnt.v_free_target) {
+      return 0;
+   }
+   if (avail <= cnt.v_free_min || cnt.v_free_target <= cnt.v_free_min) {
+      return 100;
+   }
+   return (cnt.v_free_target - avail) * 100 /
+          (cnt.v_free_target - cnt.v_free_min);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -629,7 +674,11 @@ vmmemctl_poll(void *data) // IN
    os_timer *t = data;
 
    if (!t->stop) {
-      /* invoke registered handler, rearm timer */
+      /* apply the rate policy, invoke registered handler, rearm timer */
+      Balloon_SetRatePolicy(vmmemctl_rate_policy ==
+                            BALLOON_RATE_POLICY_ADAPTIVE ?
+                            BALLOON_RATE_POLICY_ADAPTIVE :
+                            BALLOON_RATE_POLICY_FIXED);
       Balloon_QueryAndExecute();
       t->callout_handle = timeout(vmmemctl_poll, t, BALLOON_POLL_PERIOD * hz);
    }
@@ -75,18 +75,28 @@
 #include "block.h"
 #include "dbllnklst.h"
 
+/*
+ * Blocked files are hashed by name. Each bucket has its own lock, so that
+ * lookups, which happen on every access to the file system, neither walk
+ * all blocks nor contend with the blocks added and removed elsewhere.
+ */
+#define BLOCK_HASH_BUCKETS      1024    // Must be a power of 2
+
 typedef struct BlockInfo {
    DblLnkLst_Links links;
    os_atomic_t refcount;
    os_blocker_id_t blocker;
    os_completion_t completion;
+   unsigned int hash;
    char filename[OS_PATH_MAX];
 } BlockInfo;
 
+typedef struct BlockBucket {
+   DblLnkLst_Links blocks;
+   os_rwlock_t lock;
+} BlockBucket;
 
-/* XXX: Is it worth turning this into a hash table? */
-static DblLnkLst_Links blockedFiles;
-static os_rwlock_t blockedFilesLock;
+static BlockBucket blockedFiles[BLOCK_HASH_BUCKETS];
 static os_kmem_cache_t *blockInfoCache;
 
 
@@ -109,6 +119,8 @@ static os_kmem_cache_t *blockInfoCache;
 int
 BlockInit(void)
 {
+   unsigned int i;
+
    ASSERT(!blockInfoCache);
 
    blockInfoCache = os_kmem_cache_create("blockInfoCache",
@@ -119,8 +131,10 @@ BlockInit(void)
       return OS_ENOMEM;
    }
 
-   DblLnkLst_Init(&blockedFiles);
-   os_rwlock_init(&blockedFilesLock);
+   for (i = 0; i < BLOCK_HASH_BUCKETS; i++) {
+      DblLnkLst_Init(&blockedFiles[i].blocks);
+      os_rwlock_init(&blockedFiles[i].lock);
+   }
 
    return 0;
 }
@@ -145,14 +159,72 @@ BlockInit(void)
 void
 BlockCleanup(void)
 {
+   unsigned int i;
+
    ASSERT(blockInfoCache);
-   ASSERT(!DblLnkLst_IsLinked(&blockedFiles));
 
-   os_rwlock_destroy(&blockedFilesLock);
+   for (i = 0; i < BLOCK_HASH_BUCKETS; i++) {
+      ASSERT(!DblLnkLst_IsLinked(&blockedFiles[i].blocks));
+      os_rwlock_destroy(&blockedFiles[i].lock);
+   }
    os_kmem_cache_destroy(blockInfoCache);
 }
 
 
+/*
+ *----------------------------------------------------------------------------
+ *
+ * BlockHash --
+ *
+ *    Hashes a filename (32-bit FNV-1a).
+ *
+ * Results:
+ *    The hash.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static unsigned int
+BlockHash(const char *filename)  // IN: file to hash
+{
+   const unsigned char *p = (const unsigned char *)filename;
+   unsigned int hash = 2166136261U;
+
+   while (*p != '\0') {
+      hash ^= *p++;
+      hash *= 16777619U;
+   }
+
+   return hash;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * BlockGetBucket --
+ *
+ *    Finds the bucket for a filename hash.
+ *
+ * Results:
+ *    The bucket.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static BlockBucket *
+BlockGetBucket(unsigned int hash)  // IN: hash of the filename
+{
+   return &blockedFiles[hash & (BLOCK_HASH_BUCKETS - 1)];
+}
+
+
 /*
  *----------------------------------------------------------------------------
  *
@@ -172,6 +244,7 @@ BlockCleanup(void)
 static BlockInfo *
 AllocBlock(os_kmem_cache_t *cache,        // IN: cache to allocate from
            const char *filename,          // IN: filname of block
+           unsigned int hash,             // IN: hash of filename
            const os_blocker_id_t blocker) // IN: blocker id
 {
    BlockInfo *block;
@@ -194,6 +267,7 @@ AllocBlock(os_kmem_cache_t *cache,        // IN: cache to allocate from
    os_atomic_set(&block->refcount, 1);
    os_completion_init(&block->completion);
    block->blocker = blocker;
+   block->hash = hash;
 
    return block;
 }
@@ -292,11 +366,11 @@ BlockDropReference(BlockInfo *block)
  *
  * GetBlock --
  *
- *    Searches for a block on the provided filename by the provided blocker.
- *    If blocker is NULL, it is ignored and any matching filename is returned.
+ *    Searches the filename's bucket for a block on the provided filename by
+ *    the provided blocker. If blocker is NULL, it is ignored and any
+ *    matching filename is returned.
  *
- *    Note that this assumes the proper locking has been done on the data
- *    structure holding the blocked files.
+ *    Note that this assumes the bucket's lock is held.
  *
  * Results:
  *    A pointer to the corresponding BlockInfo if found, NULL otherwise.
@@ -308,7 +382,9 @@ BlockDropReference(BlockInfo *block)
  */
 
 static BlockInfo *
-GetBlock(const char *filename,          // IN: file to find block for
+GetBlock(BlockBucket *bucket,           // IN: bucket of filename
+         const char *filename,          // IN: file to find block for
+         unsigned int hash,             // IN: hash of filename
          const os_blocker_id_t blocker) // IN: blocker associated with this block
 {
    struct DblLnkLst_Links *curr;
@@ -320,14 +396,15 @@ GetBlock(const char *filename,          // IN: file to find block for
     * different name.
     */
 #ifdef os_assert_rwlock_held
-   os_assert_rwlock_held(&blockedFilesLock);
+   os_assert_rwlock_held(&bucket->lock);
 #else
-   ASSERT(os_rwlock_held(&blockedFilesLock));
+   ASSERT(os_rwlock_held(&bucket->lock));
 #endif
 
-   DblLnkLst_ForEach(curr, &blockedFiles) {
+   DblLnkLst_ForEach(curr, &bucket->blocks) {
       BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo, links);
-      if ((blocker == OS_UNKNOWN_BLOCKER || currBlock->blocker == blocker) &&
+      if (currBlock->hash == hash &&
+          (blocker == OS_UNKNOWN_BLOCKER || currBlock->blocker == blocker) &&
           strcmp(currBlock->filename, filename) == 0) {
          return currBlock;
       }
@@ -342,8 +419,8 @@ GetBlock(const char *filename,          // IN: file to find block for
  *
  * BlockDoRemoveBlock --
  *
- *    Removes given block from the block list and notifies waiters that block
- *    is gone.
+ *    Removes given block from its bucket and notifies waiters that block
+ *    is gone. The bucket's lock must be held for writing.
  *
  * Results:
  *    None.
@@ -400,30 +477,34 @@ BlockAddFileBlock(const char *filename,           // IN: name of file to block
                   const os_blocker_id_t blocker)  // IN: blocker adding the block
 {
    BlockInfo *block;
+   BlockBucket *bucket;
+   unsigned int hash;
    int retval;
 
    ASSERT(filename);
 
-   os_write_lock(&blockedFilesLock);
+   hash = BlockHash(filename);
+   bucket = BlockGetBucket(hash);
+   os_write_lock(&bucket->lock);
 
-   if (GetBlock(filename, OS_UNKNOWN_BLOCKER)) {
+   if (GetBlock(bucket, filename, hash, OS_UNKNOWN_BLOCKER)) {
       retval = OS_EEXIST;
       goto out;
    }
 
-   block = AllocBlock(blockInfoCache, filename, blocker);
+   block = AllocBlock(blockInfoCache, filename, hash, blocker);
    if (!block) {
       Warning("BlockAddFileBlock: out of memory\n");
       retval = OS_ENOMEM;
       goto out;
    }
 
-   DblLnkLst_LinkLast(&blockedFiles, &block->links);
+   DblLnkLst_LinkLast(&bucket->blocks, &block->links);
    LOG(4, "added block for [%s]\n", filename);
    retval = 0;
 
 out:
-   os_write_unlock(&blockedFilesLock);
+   os_write_unlock(&bucket->lock);
    return retval;
 }
 
@@ -451,13 +532,17 @@ BlockRemoveFileBlock(const char *filename,          // IN: block to remove
                      const os_blocker_id_t blocker) // IN: blocker removing this block
 {
    BlockInfo *block;
+   BlockBucket *bucket;
+   unsigned int hash;
    int retval;
 
    ASSERT(filename);
 
-   os_write_lock(&blockedFilesLock);
+   hash = BlockHash(filename);
+   bucket = BlockGetBucket(hash);
+   os_write_lock(&bucket->lock);
 
-   block = GetBlock(filename, blocker);
+   block = GetBlock(bucket, filename, hash, blocker);
    if (!block) {
       retval = OS_ENOENT;
       goto out;
@@ -467,7 +552,7 @@ BlockRemoveFileBlock(const char *filename,          // IN: block to remove
    retval = 0;
 
 out:
-   os_write_unlock(&blockedFilesLock);
+   os_write_unlock(&bucket->lock);
    return retval;
 }
 
@@ -494,24 +579,29 @@ BlockRemoveAllBlocks(const os_blocker_id_t blocker)  // IN: blocker to remove bl
    struct DblLnkLst_Links *curr;
    struct DblLnkLst_Links *tmp;
    unsigned int removed = 0;
+   unsigned int i;
 
-   os_write_lock(&blockedFilesLock);
+   for (i = 0; i < BLOCK_HASH_BUCKETS; i++) {
+      BlockBucket *bucket = &blockedFiles[i];
 
-   DblLnkLst_ForEachSafe(curr, tmp, &blockedFiles) {
-      BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo, links);
-      if (currBlock->blocker == blocker || blocker == OS_UNKNOWN_BLOCKER) {
+      os_write_lock(&bucket->lock);
 
-         BlockDoRemoveBlock(currBlock);
+      DblLnkLst_ForEachSafe(curr, tmp, &bucket->blocks) {
+         BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo, links);
+         if (currBlock->blocker == blocker || blocker == OS_UNKNOWN_BLOCKER) {
 
-         /*
-          * We count only entries removed from the -list-, regardless of whether
-          * or not other waiters exist.
-          */
-         ++removed;
+            BlockDoRemoveBlock(currBlock);
+
+            /*
+             * We count only entries removed from the -list-, regardless of
+             * whether or not other waiters exist.
+             */
+            ++removed;
+         }
       }
-   }
 
-   os_write_unlock(&blockedFilesLock);
+      os_write_unlock(&bucket->lock);
+   }
 
    return removed;
 }
@@ -552,12 +642,7 @@ BlockWaitOnFile(const char *filename,   // IN: file to block on
     * blocking here.)
     */
    if (cookie == NULL) {
-      os_read_lock(&blockedFilesLock);
-      block = GetBlock(filename, OS_UNKNOWN_BLOCKER);
-      if (block) {
-         BlockGrabReference(block);
-      }
-      os_read_unlock(&blockedFilesLock);
+      block = BlockLookup(filename, OS_UNKNOWN_BLOCKER);
 
       if (!block) {
          /* This file is not blocked, just return */
@@ -605,15 +690,19 @@ BlockLookup(const char *filename,               // IN: pathname to test for
                                                 //     search for
 {
    BlockInfo *block;
+   BlockBucket *bucket;
+   unsigned int hash;
 
-   os_read_lock(&blockedFilesLock);
+   hash = BlockHash(filename);
+   bucket = BlockGetBucket(hash);
+   os_read_lock(&bucket->lock);
 
-   block = GetBlock(filename, blocker);
+   block = GetBlock(bucket, filename, hash, blocker);
    if (block) {
       BlockGrabReference(block);
    }
 
-   os_read_unlock(&blockedFilesLock);
+   os_read_unlock(&bucket->lock);
 
    return block;
 }
@@ -641,16 +730,21 @@ BlockListFileBlocks(void)
 {
    DblLnkLst_Links *curr;
    int count = 0;
+   unsigned int i;
 
-   os_read_lock(&blockedFilesLock);
+   for (i = 0; i < BLOCK_HASH_BUCKETS; i++) {
+      BlockBucket *bucket = &blockedFiles[i];
 
-   DblLnkLst_ForEach(curr, &blockedFiles) {
-      BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo, links);
-      LOG(1, "BlockListFileBlocks: (%d) Filename: [%s], Blocker: [%p]\n",
-          count++, currBlock->filename, currBlock->blocker);
-   }
+      os_read_lock(&bucket->lock);
 
-   os_read_unlock(&blockedFilesLock);
+      DblLnkLst_ForEach(curr, &bucket->blocks) {
+         BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo, links);
+         LOG(1, "BlockListFileBlocks: (%d) Filename: [%s], Blocker: [%p]\n",
+             count++, currBlock->filename, currBlock->blocker);
+      }
+
+      os_read_unlock(&bucket->lock);
+   }
 
    if (!count) {
       LOG(1, "BlockListFileBlocks: No blocks currently exist.\n");
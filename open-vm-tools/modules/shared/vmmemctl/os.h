@@ -96,6 +96,8 @@ extern void OS_Free(void *ptr, size_t size);
 
 extern void OS_Yield(void);
 
+extern unsigned int  OS_MemoryPressure(void);
+
 extern unsigned long OS_ReservedPageGetLimit(void);
 extern PA64          OS_ReservedPageGetPA(PageHandle handle);
 extern PageHandle    OS_ReservedPageGetHandle(PA64 pa);
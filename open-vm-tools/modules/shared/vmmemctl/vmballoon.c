@@ -99,12 +99,27 @@ extern "C" {
 /* Maximum number of page allocations without yielding processor */
 #define BALLOON_ALLOC_YIELD_THRESHOLD   1024
 
+/*
+ * Adaptive rate policy. Failures of sleeping page allocations are tracked
+ * as a rate, in 1/1024ths, that loses a quarter of its weight every cycle.
+ * Combined with the memory pressure reported by the OS, it brings the
+ * allocation rate down from BALLOON_NOSLEEP_ALLOC_MAX, to reach rateAlloc
+ * at BALLOON_PRESSURE_SLOW. Above BALLOON_PRESSURE_SEVERE, rateAlloc is
+ * halved every cycle.
+ */
+#define BALLOON_FAIL_RATE_ONE           1024
+#define BALLOON_FAIL_RATE_CANSLEEP      (BALLOON_FAIL_RATE_ONE / 2)
+#define BALLOON_PRESSURE_SLOW           25 /* percent */
+#define BALLOON_PRESSURE_SEVERE         50 /* percent */
+
 /*
  * Balloon operations
  */
 static void BalloonPageFree(Balloon *b, int isLargePage);
 static void BalloonAdjustSize(Balloon *b, uint32 target);
 static void BalloonReset(Balloon *b);
+static unsigned int BalloonNoSleepRate(const Balloon *b);
+static void BalloonUpdatePressure(Balloon *b);
 
 static void BalloonAddPage(Balloon *b, uint16 idx, PageHandle page);
 static void BalloonAddPageBatched(Balloon *b, uint16 idx, PageHandle page);
@@ -165,7 +180,7 @@ Balloon_GetStats(void)
     */
    stats->nPages = b->nPages;
    stats->nPagesTarget = b->nPagesTarget;
-   stats->rateNoSleepAlloc = BALLOON_NOSLEEP_ALLOC_MAX;
+   stats->rateNoSleepAlloc = BalloonNoSleepRate(b);
    stats->rateAlloc = b->rateAlloc;
    stats->rateFree = b->rateFree;
 
@@ -448,6 +463,10 @@ Balloon_QueryAndExecute(void)
       b->slowPageAllocationCycles--;
    }
 
+   /* sample guest memory pressure, age past allocation failures */
+   BalloonUpdatePressure(b);
+   b->allocFailRate -= b->allocFailRate / 4;
+
    if (status == BALLOON_SUCCESS) {
       /* update target, adjust size */
       b->nPagesTarget = target;
@@ -725,12 +744,238 @@ BalloonPageFree(Balloon *b,      // IN/OUT
    STATS_INC(b->stats.primFree[isLargePage]);
 
    /* update balloon size */
-   b->nPages--;
+   b->nPages -= isLargePage ? OS_LARGE_2_SMALL_PAGES : 1;
 
    /* reclaim chunk, if empty */
    BalloonChunkDestroyEmpty(b, chunk, isLargePage);
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * BalloonUpdatePressure --
+ *
+ *      Samples the guest memory pressure.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+BalloonUpdatePressure(Balloon *b) // IN/OUT
+{
+   b->pressure = MIN(OS_MemoryPressure(), 100);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * BalloonStress --
+ *
+ *      Combines the guest memory pressure and the recent page allocation
+ *      failures into a single measure of how hard inflating the balloon
+ *      currently is for the guest.
+ *
+ * Results:
+ *      Stress, from 0 to BALLOON_FAIL_RATE_ONE.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static uint32
+BalloonStress(const Balloon *b) // IN
+{
+   uint32 pressure = b->pressure * BALLOON_FAIL_RATE_ONE / 100;
+
+   return MAX(pressure, b->allocFailRate);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * BalloonAdaptiveRate --
+ *
+ *      Computes the allocation rate of the adaptive policy: the rate goes
+ *      down with the stress, so that the balloon slows down before the
+ *      guest runs out of memory, and picks up again as the pressure goes
+ *      away instead of after a fixed number of cycles.
+ *
+ * Results:
+ *      Pages per cycle, from rateAlloc to BALLOON_NOSLEEP_ALLOC_MAX.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static unsigned int
+BalloonAdaptiveRate(const Balloon *b) // IN
+{
+   uint32 slow = BALLOON_PRESSURE_SLOW * BALLOON_FAIL_RATE_ONE / 100;
+   uint32 stress = BalloonStress(b);
+
+   if (stress >= slow || b->rateAlloc >= BALLOON_NOSLEEP_ALLOC_MAX) {
+      return b->rateAlloc;
+   }
+
+   return b->rateAlloc +
+          (BALLOON_NOSLEEP_ALLOC_MAX - b->rateAlloc) * (slow - stress) / slow;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * BalloonNoSleepRate --
+ *
+ *      Computes how many pages may be allocated in the next cycle, as
+ *      long as the allocations do not have to sleep.
+ *
+ *      The fixed policy allows BALLOON_NOSLEEP_ALLOC_MAX pages, or only
+ *      rateAlloc pages for a few cycles after a failure.
+ *
+ * Results:
+ *      Pages per cycle.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static unsigned int
+BalloonNoSleepRate(const Balloon *b) // IN
+{
+   if (b->ratePolicy == BALLOON_RATE_POLICY_ADAPTIVE) {
+      return BalloonAdaptiveRate(b);
+   }
+
+   return b->slowPageAllocationCycles ?
+             b->rateAlloc : BALLOON_NOSLEEP_ALLOC_MAX;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * BalloonSleepRate --
+ *
+ *      Computes how many pages may be allocated in a cycle once the
+ *      allocations have to sleep.
+ *
+ *      The fixed policy allows rateAlloc pages. The adaptive policy keeps
+ *      its rate: as long as the guest is not under pressure, sleeping
+ *      allocations only reclaim memory the guest can spare. The caller
+ *      samples the pressure again as it goes.
+ *
+ * Results:
+ *      Pages per cycle.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static unsigned int
+BalloonSleepRate(const Balloon *b) // IN
+{
+   if (b->ratePolicy == BALLOON_RATE_POLICY_ADAPTIVE) {
+      return BalloonAdaptiveRate(b);
+   }
+
+   return b->rateAlloc;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * BalloonAllocFailed --
+ *
+ *      Accounts for a failed page allocation in the failure rate.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+BalloonAllocFailed(Balloon *b,    // IN/OUT
+                   uint32 weight) // IN
+{
+   b->allocFailRate = MIN(b->allocFailRate + weight, BALLOON_FAIL_RATE_ONE);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * BalloonAdaptAllocRate --
+ *
+ *      Adjusts the sleeping allocation rate at the end of an inflation
+ *      cycle.
+ *
+ *      The fixed policy only increases it, by BALLOON_RATE_ALLOC_INC for
+ *      each rateAlloc pages allocated without failure. The adaptive policy
+ *      increases it by a quarter when the guest is not under pressure, and
+ *      halves it when the guest is under severe pressure.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+BalloonAdaptAllocRate(Balloon *b,               // IN/OUT
+                      int status,               // IN
+                      unsigned int allocations) // IN
+{
+   uint32 slow = BALLOON_PRESSURE_SLOW * BALLOON_FAIL_RATE_ONE / 100;
+
+   if (b->ratePolicy != BALLOON_RATE_POLICY_ADAPTIVE) {
+      /*
+       * We reached our goal without failures so try increasing
+       * allocation rate.
+       */
+      if (status == BALLOON_SUCCESS && allocations >= b->rateAlloc) {
+         unsigned int mult = allocations / b->rateAlloc;
+
+         b->rateAlloc = MIN(b->rateAlloc + mult * BALLOON_RATE_ALLOC_INC,
+                            BALLOON_RATE_ALLOC_MAX);
+      }
+      return;
+   }
+
+   if (b->pressure >= BALLOON_PRESSURE_SEVERE) {
+      b->rateAlloc = MAX(b->rateAlloc / 2, BALLOON_RATE_ALLOC_MIN);
+   } else if (status == BALLOON_SUCCESS && allocations >= b->rateAlloc &&
+              BalloonStress(b) < slow) {
+      b->rateAlloc = MIN(b->rateAlloc + b->rateAlloc / 4,
+                         BALLOON_RATE_ALLOC_MAX);
+   }
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -792,8 +1037,7 @@ BalloonInflate(Balloon *b,      // IN/OUT
     * Start with no sleep allocation rate which may be higher
     * than sleeping allocation rate.
     */
-   rate = b->slowPageAllocationCycles ?
-                b->rateAlloc : BALLOON_NOSLEEP_ALLOC_MAX;
+   rate = BalloonNoSleepRate(b);
 
    nEntries = 0;
    while (b->nPages < target &&
@@ -840,7 +1084,8 @@ BalloonInflate(Balloon *b,      // IN/OUT
             b->slowPageAllocationCycles = SLOW_PAGE_ALLOCATION_CYCLES;
 
             /* Lower rate for sleeping allocations. */
-            rate = b->rateAlloc;
+            BalloonUpdatePressure(b);
+            rate = BalloonSleepRate(b);
             allocType = BALLOON_PAGE_ALLOC_CANSLEEP;
          } else {
             ASSERT(allocType == BALLOON_PAGE_ALLOC_CANSLEEP);
@@ -849,12 +1094,13 @@ BalloonInflate(Balloon *b,      // IN/OUT
              * memory pressure. Quickly decrease allocation rate.
              */
             b->rateAlloc = MAX(b->rateAlloc / 2, BALLOON_RATE_ALLOC_MIN);
+            BalloonAllocFailed(b, BALLOON_FAIL_RATE_CANSLEEP);
 
             /* Stop allocating any more memory */
             break;
          }
 
-         if (allocations >= b->rateAlloc) {
+         if (allocations >= BalloonSleepRate(b)) {
             break;
          }
 
@@ -874,6 +1120,15 @@ BalloonInflate(Balloon *b,      // IN/OUT
 
       if (allocations % BALLOON_ALLOC_YIELD_THRESHOLD == 0) {
          OS_Yield();
+
+         /*
+          * Sleeping allocations reclaim memory from the guest: keep an eye
+          * on the pressure they cause.
+          */
+         if (allocType == BALLOON_PAGE_ALLOC_CANSLEEP) {
+            BalloonUpdatePressure(b);
+            rate = BalloonSleepRate(b);
+         }
       }
 
       if (allocations >= rate) {
@@ -886,16 +1141,7 @@ BalloonInflate(Balloon *b,      // IN/OUT
       b->balloonOps->lock(b, nEntries, isLargePages, NULL);
    }
 
-   /*
-    * We reached our goal without failures so try increasing
-    * allocation rate.
-    */
-   if (status == BALLOON_SUCCESS && allocations >= b->rateAlloc) {
-      unsigned int mult = allocations / b->rateAlloc;
-
-      b->rateAlloc = MIN(b->rateAlloc + mult * BALLOON_RATE_ALLOC_INC,
-                         BALLOON_RATE_ALLOC_MAX);
-   }
+   BalloonAdaptAllocRate(b, status, allocations);
 
    /* release non-balloonable pages, succeed */
    BalloonErrorPagesFree(b);
@@ -1441,6 +1687,9 @@ Balloon_Init(BalloonGuest guestType)    // IN
 {
    Balloon *b = &globalBalloon;
 
+   /* start afresh, the balloon may have been cleaned up before */
+   OS_MemZero(b, sizeof *b);
+
    DblLnkLst_Init(&b->pages[TRUE].chunks);
    DblLnkLst_Init(&b->pages[FALSE].chunks);
 
@@ -1449,6 +1698,7 @@ Balloon_Init(BalloonGuest guestType)    // IN
    /* initialize rates */
    b->rateAlloc = BALLOON_RATE_ALLOC_MAX;
    b->rateFree  = BALLOON_RATE_FREE_MAX;
+   b->ratePolicy = BALLOON_RATE_POLICY;
 
    /* initialize reset flag */
    b->resetFlag = TRUE;
@@ -1463,6 +1713,31 @@ Balloon_Init(BalloonGuest guestType)    // IN
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * Balloon_SetRatePolicy --
+ *
+ *      Selects the policy that sets the inflation rates of the balloon.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+Balloon_SetRatePolicy(BalloonRatePolicy policy) // IN
+{
+   Balloon *b = &globalBalloon;
+
+   b->ratePolicy = policy;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -77,6 +77,14 @@ typedef enum BalloonPageAllocType {
    BALLOON_PAGE_ALLOC_TYPES_NR,	// total number of alloc types
 } BalloonPageAllocType;
 
+/*
+ * Inflation rate policies
+ */
+typedef enum BalloonRatePolicy {
+   BALLOON_RATE_POLICY_FIXED = 0,    // fixed rates, slow down after failures
+   BALLOON_RATE_POLICY_ADAPTIVE = 1, // rates follow the guest memory pressure
+} BalloonRatePolicy;
+
 
 /*
  * Types
@@ -162,6 +170,15 @@ typedef struct {
    /* slowdown page allocations for next few cycles */
    int slowPageAllocationCycles;
 
+   /* inflation rate policy */
+   BalloonRatePolicy ratePolicy;
+
+   /* guest memory pressure (percent), as last reported by the OS */
+   uint32 pressure;
+
+   /* decayed rate of page allocation failures (1/1024ths) */
+   uint32 allocFailRate;
+
    /* statistics */
    BalloonStats stats;
 
@@ -194,6 +211,7 @@ Bool Balloon_Init(BalloonGuest guestType);
 void Balloon_Cleanup(void);
 
 void Balloon_QueryAndExecute(void);
+void Balloon_SetRatePolicy(BalloonRatePolicy policy);
 
 const BalloonStats *Balloon_GetStats(void);
 
@@ -36,6 +36,7 @@
 #include <sys/proc.h>
 #include <sys/disp.h>
 #include <sys/ksynch.h>
+#include <sys/vmsystm.h>
 
 #include "os.h"
 #include "vmballoon.h"
@@ -97,6 +98,14 @@ typedef struct {
 
 static os_state global_state;
 
+/*
+ * Inflation rate policy, a BalloonRatePolicy: 0 for fixed rates, 1 for
+ * rates following the guest memory pressure. A module tunable, e.g.
+ * "set vmmemctl:vmmemctl_rate_policy = 1" in /etc/system; the poll picks
+ * up changes made with mdb -kw.
+ */
+int vmmemctl_rate_policy = BALLOON_RATE_POLICY;
+
 
 /*
  *-----------------------------------------------------------------------------
@@ -218,6 +227,39 @@ OS_ReservedPageGetLimit(void)
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * OS_MemoryPressure --
+ *
+ *      Estimate how short of memory the guest is, from how far the free
+ *      memory is below the point where the page scanner starts.
+ *
+ * Results:
+ *      0 when the page scanner is idle, up to 100 when the free memory is
+ *      down to minfree.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+unsigned int
+OS_MemoryPressure(void)
+{
+   pgcnt_t avail = freemem;
+
+   if (avail >= lotsfree) {
+      return 0;
+   }
+   if (avail <= minfree || lotsfree <= minfree) {
+      return 100;
+   }
+   return (unsigned int)((lotsfree - avail) * 100 / (lotsfree - minfree));
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -521,6 +563,10 @@ vmmemctl_poll_worker(os_timer *t) // IN
    while (!t->stop) {
       mutex_exit(&t->lock);
 
+      Balloon_SetRatePolicy(vmmemctl_rate_policy ==
+                            BALLOON_RATE_POLICY_ADAPTIVE ?
+                            BALLOON_RATE_POLICY_ADAPTIVE :
+                            BALLOON_RATE_POLICY_FIXED);
       Balloon_QueryAndExecute();
 
       mutex_enter(&t->lock);
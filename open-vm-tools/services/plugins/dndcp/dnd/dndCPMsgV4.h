@@ -173,6 +173,7 @@ typedef enum DnDCPMsgPacketType {
 #define DND_CP_CAP_ACTIVE_CP        (1 << 13)
 #define DND_CP_CAP_GUEST_PROGRESS   (1 << 14)
 #define DND_CP_CAP_BIG_BUFFER       (1 << 15)
+#define DND_CP_CAP_PACKET_WINDOW    (1 << 16)
 
 #define DND_CP_CAP_FORMATS_CP       (DND_CP_CAP_PLAIN_TEXT_CP   | \
                                      DND_CP_CAP_RTF_CP          | \
@@ -220,6 +221,17 @@ DnDCPMsgHdrV4;
                                            DND_CP_MSG_HEADERSIZE_V4)
 #define DND_CP_MSG_MAX_BINARY_SIZE_V4 (1 << 22)
 
+/*
+ * Packet window for big messages. Without DND_CP_CAP_PACKET_WINDOW, the
+ * receiver asks for each packet with DNDCP_CMD_REQUEST_NEXT. When both sides
+ * advertise it in DNDCP_CMD_PING / DNDCP_CMD_PING_REPLY (with their window in
+ * param4), the sender keeps up to the smaller of the two windows of packets
+ * in flight, and the receiver acknowledges every half window with the number
+ * of bytes it has received so far.
+ */
+#define DND_CP_PACKET_WINDOW_V4 16
+#define DND_CP_PACKET_WINDOW_MAX_V4 64
+
 /* DnD version 4 message. */
 typedef struct DnDCPMsgV4 {
    DnDCPMsgHdrV4 hdr;
@@ -43,6 +43,7 @@ typedef struct RpcParams {
          uint32 major;
          uint32 minor;
          uint32 capability;
+         uint32 packetWindow;   /* With DND_CP_CAP_PACKET_WINDOW. */
       } version;
 
       struct {
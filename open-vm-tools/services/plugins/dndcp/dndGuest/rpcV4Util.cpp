@@ -24,7 +24,7 @@
  * including
  * *packet marshalling/un-marshalling
  * *common rpc (ping, pingReply, etc)
- * *big buffer support
+ * *big buffer support (stop-and-wait, or windowed if both sides support it)
  * are implemented here.
  */
 
@@ -52,7 +52,11 @@ extern "C" {
 
 RpcV4Util::RpcV4Util(void)
    : mVersionMajor(4),
-     mVersionMinor(0)
+     mVersionMinor(0),
+     mPacketWindow(DND_CP_PACKET_WINDOW_V4),
+     mPeerPacketWindow(0),
+     mBigMsgOutAcked(0),
+     mBigMsgInUnacked(0)
 {
    DnDCPMsgV4_Init(&mBigMsgIn);
    DnDCPMsgV4_Init(&mBigMsgOut);
@@ -113,6 +117,38 @@ RpcV4Util::Init(RpcBase *rpc,
 }
 
 
+/**
+ * Set how many packets of a big message may be in flight. The window is
+ * advertised in the next ping or ping reply, and only used once the peer has
+ * advertised one too.
+ *
+ * @param[in] window number of packets; 0 or 1 keeps stop-and-wait.
+ */
+
+void
+RpcV4Util::SetPacketWindow(uint32 window)
+{
+   mPacketWindow = MIN(window, DND_CP_PACKET_WINDOW_MAX_V4);
+}
+
+
+/**
+ * Get the packet window in use for big messages: the smaller of ours and the
+ * peer's, or 1 (stop-and-wait) if either side does not support windowing.
+ *
+ * @return number of packets that may be in flight.
+ */
+
+uint32
+RpcV4Util::GetPacketWindow(void)
+{
+   if (mPacketWindow <= 1 || mPeerPacketWindow <= 1) {
+      return 1;
+   }
+   return MIN(mPacketWindow, mPeerPacketWindow);
+}
+
+
 /**
  * Serialize the clipboard item if there is one, then send the message to
  * destId.
@@ -209,10 +245,18 @@ RpcV4Util::SendMsg(RpcParams *params,
       memcpy(msgOut->binary, binary,binarySize);
    }
 
-   ret = SendMsg(msgOut);
-   /* The mBigMsgOut is destroyed when the message sending was failed. */
-   if (!ret && msgOut == &mBigMsgOut) {
-      DnDCPMsgV4_Destroy(&mBigMsgOut);
+   if (msgOut == &mBigMsgOut) {
+      mBigMsgOutAcked = 0;
+      ret = SendBigMsgPackets();
+      /*
+       * The mBigMsgOut is destroyed when the message sending was failed, or
+       * when the whole message already fit in the packet window.
+       */
+      if (!ret || mBigMsgOut.hdr.payloadOffset == mBigMsgOut.hdr.binarySize) {
+         DnDCPMsgV4_Destroy(&mBigMsgOut);
+      }
+   } else {
+      ret = SendMsg(msgOut);
    }
    DnDCPMsgV4_Destroy(&shortMsg);
    return ret;
@@ -239,6 +283,10 @@ RpcV4Util::SendPingMsg(uint32 destId,
    params.optional.version.major = mVersionMajor;
    params.optional.version.minor = mVersionMinor;
    params.optional.version.capability = capability;
+   if (mPacketWindow > 1) {
+      params.optional.version.capability |= DND_CP_CAP_PACKET_WINDOW;
+      params.optional.version.packetWindow = mPacketWindow;
+   }
 
    return SendMsg(&params);
 }
@@ -264,6 +312,10 @@ RpcV4Util::SendPingReplyMsg(uint32 destId,
    params.optional.version.major = mVersionMajor;
    params.optional.version.minor = mVersionMinor;
    params.optional.version.capability = capability;
+   if (mPacketWindow > 1) {
+      params.optional.version.capability |= DND_CP_CAP_PACKET_WINDOW;
+      params.optional.version.packetWindow = mPacketWindow;
+   }
 
    return SendMsg(&params);
 }
@@ -297,8 +349,10 @@ RpcV4Util::SendCmdReplyMsg(uint32 destId,
 
 /**
  * Construct a DNDCP_CMD_REQUEST_NEXT message and send it to mBigMsgIn.addrId.
- * This is used for big message receiving. After received a packet, receiver
- * side should send this message to ask for next piece of binary.
+ * This is used for big message receiving. After received a packet (or, with
+ * a packet window, half a window of packets), receiver side should send this
+ * message to ask for next piece of binary. payloadOffset is the number of
+ * bytes received so far, which acknowledges them.
  *
  * @return true on success, false otherwise.
  */
@@ -312,13 +366,36 @@ RpcV4Util::RequestNextPacket(void)
    params.cmd = DNDCP_CMD_REQUEST_NEXT;
    params.sessionId = mBigMsgIn.hdr.sessionId;
    params.optional.requestNextCmd.cmd = mBigMsgIn.hdr.cmd;
-   params.optional.requestNextCmd.cmd = mBigMsgIn.hdr.binarySize;
-   params.optional.requestNextCmd.cmd = mBigMsgIn.hdr.payloadOffset;
+   params.optional.requestNextCmd.binarySize = mBigMsgIn.hdr.binarySize;
+   params.optional.requestNextCmd.payloadOffset = mBigMsgIn.hdr.payloadOffset;
 
    return SendMsg(&params);
 }
 
 
+/**
+ * Send the next packets of mBigMsgOut: as many as the packet window allows
+ * beyond what the receiver has acknowledged, i.e. a single packet in
+ * stop-and-wait mode.
+ *
+ * @return true on success, false otherwise.
+ */
+
+bool
+RpcV4Util::SendBigMsgPackets(void)
+{
+   uint32 windowSize = GetPacketWindow() * DND_CP_PACKET_MAX_PAYLOAD_SIZE_V4;
+
+   while (mBigMsgOut.hdr.payloadOffset < mBigMsgOut.hdr.binarySize &&
+          mBigMsgOut.hdr.payloadOffset - mBigMsgOutAcked < windowSize) {
+      if (!SendMsg(&mBigMsgOut)) {
+         return false;
+      }
+   }
+   return true;
+}
+
+
 /**
  * Serialize a message and send it to msg->addrId.
  *
@@ -433,12 +510,21 @@ RpcV4Util::HandlePacket(uint32 srcId,
    }
 
    mBigMsgIn.addrId = srcId;
+   if (DND_CP_MSG_PACKET_TYPE_MULTIPLE_NEW == packetType) {
+      mBigMsgInUnacked = 0;
+   }
 
    /*
     * If there are multiple packets for the message, sends DNDCP_REQUEST_NEXT
-    * back to sender to ask for next packet.
+    * back to sender to ask for next packet. With a packet window, the sender
+    * does not wait for every packet to be acknowledged; acknowledging every
+    * half window keeps it from stalling.
     */
    if (DND_CP_MSG_PACKET_TYPE_MULTIPLE_END != packetType) {
+      if (++mBigMsgInUnacked < MAX(GetPacketWindow() / 2, 1)) {
+         return;
+      }
+      mBigMsgInUnacked = 0;
       if (!RequestNextPacket()) {
          LOG(1, ("%s: RequestNextPacket failed.\n", __FUNCTION__));
          goto cleanup;
@@ -476,7 +562,29 @@ RpcV4Util::HandleMsg(DnDCPMsgV4 *msgIn)
        * of data. For details about big buffer support, please refer to
        * https://wiki.eng.vmware.com/DnDVersion4Message#Binary_Buffer
        */
-      bool ret = SendMsg(&mBigMsgOut);
+      bool ret;
+
+      if (NULL == mBigMsgOut.binary) {
+         LOG(1, ("%s: no big message being sent.\n", __FUNCTION__));
+         return;
+      }
+
+      if (GetPacketWindow() > 1) {
+         /* Cumulative ack: param1 is the command, param3 the bytes received. */
+         if (msgIn->hdr.sessionId != mBigMsgOut.hdr.sessionId ||
+             msgIn->hdr.param1 != mBigMsgOut.hdr.cmd ||
+             msgIn->hdr.param3 < mBigMsgOutAcked ||
+             msgIn->hdr.param3 > mBigMsgOut.hdr.payloadOffset) {
+            LOG(1, ("%s: ignoring stale ack.\n", __FUNCTION__));
+            return;
+         }
+         mBigMsgOutAcked = msgIn->hdr.param3;
+      } else {
+         /* Peers without a packet window do not fill in the offset. */
+         mBigMsgOutAcked = mBigMsgOut.hdr.payloadOffset;
+      }
+
+      ret = SendBigMsgPackets();
 
       if (!ret) {
          LOG(1, ("%s: SendMsg failed. \n", __FUNCTION__));
@@ -492,6 +600,13 @@ RpcV4Util::HandleMsg(DnDCPMsgV4 *msgIn)
       return;
    }
 
+   if (DNDCP_CMD_PING == msgIn->hdr.cmd ||
+       DNDCP_CMD_PING_REPLY == msgIn->hdr.cmd) {
+      /* param3 is version.capability, param4 version.packetWindow. */
+      mPeerPacketWindow = (msgIn->hdr.param3 & DND_CP_CAP_PACKET_WINDOW) ?
+                          msgIn->hdr.param4 : 0;
+   }
+
    params.addrId = msgIn->addrId;
    params.cmd = msgIn->hdr.cmd;
    params.sessionId = msgIn->hdr.sessionId;
@@ -79,6 +79,8 @@ public:
       { return SendMsg(params, NULL, 0); }
    uint32 GetVersionMajor(void) { return mVersionMajor; }
    uint32 GetVersionMinor(void) { return mVersionMinor; }
+   void SetPacketWindow(uint32 window);
+   uint32 GetPacketWindow(void);
 
    bool AddRpcReceivedListener(const DnDRpcListener *obj);
    bool RemoveRpcReceivedListener(const DnDRpcListener *obj);
@@ -90,6 +92,7 @@ private:
    void FireRpcSentCallbacks(uint32 cmd, uint32 dest, uint32 session);
    bool SendMsg(DnDCPMsgV4 *msg);
    bool RequestNextPacket(void);
+   bool SendBigMsgPackets(void);
    void HandlePacket(uint32 srcId,
                      const uint8 *packet,
                      size_t packetSize);
@@ -106,6 +109,10 @@ private:
    DnDCPMsgV4 mBigMsgOut;
    uint32 mMsgType;
    uint32 mMsgSrc;
+   uint32 mPacketWindow;
+   uint32 mPeerPacketWindow;
+   uint32 mBigMsgOutAcked;
+   uint32 mBigMsgInUnacked;
    DblLnkLst_Links mRpcSentListeners;
    DblLnkLst_Links mRpcReceivedListeners;
 };
@@ -47,6 +47,7 @@
 #include "vmtoolsd_version.h"
 #include "rpcout.h"
 #include "rabbitmqProxyConst.h"
+#include "rabbitmqProxyFraming.h"
 #include "vm_basic_types.h"
 #include "poll.h"
 #ifdef OPEN_VM_TOOLS
@@ -81,6 +82,14 @@ VM_EMBED_VERSION(VMTOOLSD_VERSION_STRING);
 /*user level recv buffer */
 #define RMQ_CLIENT_CONN_RECV_BUFF_SIZE           (64 * 1024)
 
+/*
+ * Chunks from RabbitMQ clients at least this large are forwarded to VMX in
+ * their recv buffer, trimmed to the packet, without copying the payload;
+ * smaller chunks are copied into a right sized packet, so the recv buffer
+ * is kept for the next read rather than reallocated.
+ */
+#define RMQ_CLIENT_ZERO_COPY_MIN_LEN             (8 * 1024)
+
 /* these are socket level send/recv buffers */
 #define DEFAULT_RMQCLIENT_CONN_RECV_BUFF_SIZE    (64 * 1024)
 #define DEFAULT_RMQCLIENT_CONN_SEND_BUFF_SIZE    (64 * 1024)
@@ -124,6 +133,8 @@ typedef struct {
    gboolean messageTunnellingEnabled;    /* Status of Message bus Tunnelling */
 
    int maxSendQueueLen;
+
+   RmqProxyDataHeader dataHeader;   /* COMMAND_DATA packet header template */
 } GuestProxyData;
 
 static GuestProxyData proxyData;
@@ -369,9 +380,13 @@ StartRecvFromRmqClient(ConnInfo *conn)   // IN
 
    ASSERT(AsyncSocket_GetState(conn->asock) == AsyncSocketConnected);
 
+   /*
+    * Data is received after room for the packet header, so it can be sent
+    * on to VMX in place (see SendToVmxRmqProxy).
+    */
    if (conn->recvBuf == NULL) {
       conn->recvBufLen = RMQ_CLIENT_CONN_RECV_BUFF_SIZE;
-      conn->recvBuf = malloc(conn->recvBufLen);
+      conn->recvBuf = malloc(proxyData.dataHeader.len + conn->recvBufLen);
       if (conn->recvBuf == NULL) {
          g_info("Error in allocating recv buffer for socket %d, "
                 "closing connection.\n",
@@ -381,7 +396,8 @@ StartRecvFromRmqClient(ConnInfo *conn)   // IN
       }
    }
 
-   res = AsyncSocket_RecvPartial(conn->asock, conn->recvBuf,
+   res = AsyncSocket_RecvPartial(conn->asock,
+                                 conn->recvBuf + proxyData.dataHeader.len,
                                  conn->recvBufLen,
                                  conn->recvCb, conn);
    if (res != ASOCKERR_SUCCESS) {
@@ -666,6 +682,12 @@ SendVmxConnectRequest(void)
  *
  *      Package RabbitMQ Client data and send it to VMX RabbitMQ Proxy.
  *
+ *      The data was received into cli->recvBuf after room reserved for the
+ *      packet header, so the packet is built by writing the precomputed
+ *      header in front of it. Large chunks are sent from the recv buffer
+ *      itself, which is shrunk to the packet and handed over to the send
+ *      queue; a new recv buffer is allocated for the next read.
+ *
  * Result:
  *      TRUE on sucess, FALSE on error
  *
@@ -677,69 +699,35 @@ SendVmxConnectRequest(void)
 
 static gboolean
 SendToVmxRmqProxy(ConnInfo *cli,     // IN
-                  char *buf,         // IN
                   int len)           // IN
 {
-   DataMap map;
-   ErrorCode res;
-   char *newBuf;
-   char *serBuf;
-   int bufLen;
-   gboolean mapCreated = FALSE;
-   char *ver;
-
-   res = DataMap_Create(&map);
-   if (res != DMERR_SUCCESS) {
-      goto quit;
-   }
-
-   mapCreated = TRUE;
-
-   res = DataMap_SetInt64(&map, RMQPROXYDM_FLD_COMMAND,
-                          COMMAND_DATA, TRUE);
-   if (res != DMERR_SUCCESS) {
-      goto quit;
-   }
-
-   ver = strdup(GUEST_RABBITMQ_PROXY_VERSION);
-   if (ver == NULL) {
-      res = DMERR_INSUFFICIENT_MEM;
-      goto quit;
-   }
-   res = DataMap_SetString(&map, RMQPROXYDM_FLD_GUEST_VER_ID, ver, -1, TRUE);
-   if (res != DMERR_SUCCESS) {
-      goto quit;
-   }
-
-   newBuf = malloc(len);
-   if (newBuf == NULL) {
-      g_warning("Error in allocating memory.\n");
-      goto quit;
-   }
-   memcpy(newBuf, buf, len);
-   res = DataMap_SetString(&map, RMQPROXYDM_FLD_PAYLOAD, newBuf,
-                           len, TRUE);
-   if (res != DMERR_SUCCESS) {
-      goto quit;
-   }
-
-   res = DataMap_Serialize(&map, &serBuf, &bufLen);
-   if (res != DMERR_SUCCESS) {
-      goto quit;
+   int hdrLen = proxyData.dataHeader.len;
+   char *packet;
+
+   if (len >= RMQ_CLIENT_ZERO_COPY_MIN_LEN) {
+      /*
+       * Shrinking gives the unused tail of the buffer back to the allocator,
+       * normally in place, so that the send queue does not hold on to it.
+       */
+      packet = realloc(cli->recvBuf, hdrLen + len);
+      if (packet == NULL) {
+         packet = cli->recvBuf;
+      }
+      cli->recvBuf = NULL;
+   } else {
+      packet = malloc(hdrLen + len);
+      if (packet == NULL) {
+         g_info("Error in allocating packet for socket %d, "
+                "closing connection.\n", AsyncSocket_GetFd(cli->asock));
+         CloseConn(cli);
+         return FALSE;
+      }
+      memcpy(packet + hdrLen, cli->recvBuf + hdrLen, len);
    }
 
-   DataMap_Destroy(&map);
-   return SendToConn(cli->toConn, serBuf, bufLen);
+   RmqProxy_FillDataHeader(&proxyData.dataHeader, packet, len);
 
-quit:
-   if (mapCreated) {
-      DataMap_Destroy(&map);
-   }
-   g_info("Error in dataMap encoding for socket %d, error=%d, "
-          "closing connection.\n",
-          AsyncSocket_GetFd(cli->asock), res);
-   CloseConn(cli);
-   return FALSE;
+   return SendToConn(cli->toConn, packet, hdrLen + len);
 }
 
 
@@ -771,8 +759,8 @@ RmqClientConnRecvedCb(void *buf,            // IN
 
    g_debug("Recved %d bytes from client connection %d\n", len,
            AsyncSocket_GetFd(conn->asock));
-   ASSERT(buf == conn->recvBuf);
-   if (SendToVmxRmqProxy(conn, conn->recvBuf, len)) {
+   ASSERT(buf == conn->recvBuf + proxyData.dataHeader.len);
+   if (SendToVmxRmqProxy(conn, len)) {
       StartRecvFromRmqClient(conn);
    }
 }
@@ -783,7 +771,8 @@ RmqClientConnRecvedCb(void *buf,            // IN
  *
  * ProcessVmxDataPacket --
  *
- *      Process the dataMap packet received from VMX.
+ *      Process the dataMap packet received from VMX, as decoded in place by
+ *      RmqProxy_ParsePacket.
  *
  * Result:
  *      TRUE on success, FALSE on error.
@@ -795,26 +784,26 @@ RmqClientConnRecvedCb(void *buf,            // IN
  */
 
 static gboolean
-ProcessVmxDataPacket(ConnInfo *cli,     // IN
-                     DataMap *map)      // IN
+ProcessVmxDataPacket(ConnInfo *cli,            // IN
+                     int64 cmdType,            // IN
+                     const char *payload,      // IN
+                     int32 payloadLen)         // IN
 {
-   ErrorCode res;
-   int64 cmdType;
-
-   res = DataMap_GetInt64(map, RMQPROXYDM_FLD_COMMAND, &cmdType);
-   ASSERT(res == DMERR_SUCCESS);
-
    switch (cmdType) {
       case COMMAND_DATA:
          {
             char *buf;
-            int payloadLen;
-            char *payload;
 
-            res = DataMap_GetString(map, RMQPROXYDM_FLD_PAYLOAD,
-                                    &payload, &payloadLen);
-            ASSERT(res == DMERR_SUCCESS && payloadLen > 0);
-            buf = malloc(payloadLen); /* get rid of this ? */
+            if (payload == NULL || payloadLen <= 0) {
+               g_info("Data packet without payload for socket %d, "
+                      "closing connection.\n",
+                      AsyncSocket_GetFd(cli->asock));
+               CloseConn(cli);
+               return FALSE;
+            }
+
+            /* the one copy: out of the recv buffer, which is reused */
+            buf = malloc(payloadLen);
 
             if (buf) {
                memcpy(buf, payload, payloadLen);
@@ -919,19 +908,25 @@ VmxConnRecvedCb(void *buf,            // IN
       ASSERT(len == sizeof conn->packetLen);
       ProcessPacketHeaderLen(conn, len);
    } else {
-      DataMap map;
       ErrorCode res;
+      int64 cmdType;
+      const char *payload;
+      int32 payloadLen;
       int packetLen = len + sizeof conn->packetLen;
 
       /* decoding the packet */
-      res = DataMap_Deserialize(conn->recvBuf, packetLen, &map);
-      ASSERT(res == DMERR_SUCCESS);
+      res = RmqProxy_ParsePacket(conn->recvBuf, packetLen, &cmdType,
+                                 &payload, &payloadLen);
+      if (res != DMERR_SUCCESS) {
+         g_info("Error in dataMap decoding for socket %d, error=%d, "
+                "closing connection.\n", AsyncSocket_GetFd(conn->asock), res);
+         CloseConn(conn);
+         return;
+      }
 
-      if (ProcessVmxDataPacket(conn->toConn, &map)) {
+      if (ProcessVmxDataPacket(conn->toConn, cmdType, payload, payloadLen)) {
          StartRecvFromVmx(conn); /* continue to recv next packet */
       }
-
-      DataMap_Destroy(&map);
    }
 
 }
@@ -1558,6 +1553,9 @@ InitProxyData(ToolsAppCtx *ctx)   // IN
    proxyData.messageTunnellingEnabled = FALSE;
    proxyData.maxSendQueueLen = GetConfigInt("maxSendQueueLen",
                                             DEFAULT_MAX_SEND_QUEUE_LEN);
+
+   RmqProxy_InitDataHeader(&proxyData.dataHeader,
+                           GUEST_RABBITMQ_PROXY_VERSION);
 }
 
 
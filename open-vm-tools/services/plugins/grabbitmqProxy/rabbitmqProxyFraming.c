@@ -0,0 +1,305 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * rabbitmqProxyFraming.c --
+ *
+ *    Allocation free encoding and decoding of RabbitMQ proxy data packets.
+ */
+
+#include <string.h>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#else
+#include <winsock2.h>
+#endif
+
+#include "vm_assert.h"
+#include "rabbitmqProxyFraming.h"
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * PutInt32 --
+ *
+ *      Encode an int32 in network byte order, as dataMap.c does.
+ *
+ * Result:
+ *      Pointer past the encoded value.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static char *
+PutInt32(char *buf,   // OUT
+         int32 num)   // IN
+{
+   uint32 netVal = htonl((uint32)num);
+
+   memcpy(buf, &netVal, sizeof netVal);
+   return buf + sizeof netVal;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * GetInt32 --
+ *
+ *      Decode an int32 in network byte order, checking the bounds.
+ *
+ * Result:
+ *      TRUE on success, FALSE if the buffer is too short.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+GetInt32(const char **buf,   // IN/OUT
+         int32 *left,        // IN/OUT
+         int32 *num)         // OUT
+{
+   uint32 netVal;
+
+   if (*left < (int32)sizeof netVal) {
+      return FALSE;
+   }
+
+   memcpy(&netVal, *buf, sizeof netVal);
+   *num = (int32)ntohl(netVal);
+   *buf += sizeof netVal;
+   *left -= sizeof netVal;
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RmqProxy_InitDataHeader --
+ *
+ *      Build the constant part of a COMMAND_DATA packet: the command and
+ *      version fields followed by the payload field header. The packet and
+ *      payload lengths are filled in per packet by RmqProxy_FillDataHeader.
+ *
+ * Result:
+ *      None
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+RmqProxy_InitDataHeader(RmqProxyDataHeader *hdr,   // OUT
+                        const char *version)       // IN
+{
+   int32 verLen = strlen(version);
+   char *p = hdr->bytes;
+
+   VERIFY(verLen <= RMQPROXY_MAX_VERSION_LEN);
+
+   p = PutInt32(p, 0);                         /* packet length, patched */
+
+   p = PutInt32(p, DMFIELDTYPE_INT64);
+   p = PutInt32(p, RMQPROXYDM_FLD_COMMAND);
+   p = PutInt32(p, COMMAND_DATA);              /* int64, low word first */
+   p = PutInt32(p, 0);
+
+   p = PutInt32(p, DMFIELDTYPE_STRING);
+   p = PutInt32(p, RMQPROXYDM_FLD_GUEST_VER_ID);
+   p = PutInt32(p, verLen);
+   memcpy(p, version, verLen);
+   p += verLen;
+
+   p = PutInt32(p, DMFIELDTYPE_STRING);
+   p = PutInt32(p, RMQPROXYDM_FLD_PAYLOAD);
+   p = PutInt32(p, 0);                         /* payload length, patched */
+
+   hdr->len = p - hdr->bytes;
+   ASSERT(hdr->len == RMQPROXY_DATA_HEADER_LEN(verLen));
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RmqProxy_FillDataHeader --
+ *
+ *      Write the packet header for a payload of the given length to 'dst',
+ *      which must have room for hdr->len bytes. The payload itself is
+ *      expected to immediately follow the header.
+ *
+ * Result:
+ *      None
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+RmqProxy_FillDataHeader(const RmqProxyDataHeader *hdr,   // IN
+                        char *dst,                       // OUT
+                        int32 payloadLen)                // IN
+{
+   memcpy(dst, hdr->bytes, hdr->len);
+   PutInt32(dst, hdr->len - sizeof(int32) + payloadLen);
+   PutInt32(dst + hdr->len - sizeof(int32), payloadLen);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RmqProxy_ParsePacket --
+ *
+ *      Decode a packet received from the VMX proxy in place. Only the
+ *      command and payload fields are extracted; other fields are validated
+ *      and skipped. No memory is allocated and the payload is not copied.
+ *      - 'buf': the packet, starting with its length prefix.
+ *      - 'payload': on success, points into 'buf', or is NULL when the
+ *        packet has no payload.
+ *
+ * Result:
+ *      DMERR_SUCCESS on success, a DataMap error code otherwise.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+ErrorCode
+RmqProxy_ParsePacket(const char *buf,            // IN
+                     int32 bufLen,               // IN
+                     int64 *command,             // OUT
+                     const char **payload,       // OUT
+                     int32 *payloadLen)          // OUT
+{
+   int32 left = bufLen;
+   int32 contentLen;
+   Bool haveCommand = FALSE;
+
+   *payload = NULL;
+   *payloadLen = 0;
+
+   if (!GetInt32(&buf, &left, &contentLen) || contentLen < 0 ||
+       contentLen > left) {
+      return DMERR_TRUNCATED_DATA;
+   }
+
+   left = contentLen;
+
+   while (left > 0) {
+      int32 type;
+      int32 fieldId;
+      int32 len;
+
+      if (!GetInt32(&buf, &left, &type) || !GetInt32(&buf, &left, &fieldId)) {
+         return DMERR_TRUNCATED_DATA;
+      }
+
+      switch (type) {
+      case DMFIELDTYPE_INT64:
+         {
+            int32 low;
+            int32 high;
+
+            if (!GetInt32(&buf, &left, &low) ||
+                !GetInt32(&buf, &left, &high)) {
+               return DMERR_TRUNCATED_DATA;
+            }
+
+            if (fieldId == RMQPROXYDM_FLD_COMMAND) {
+               if (haveCommand) {
+                  return DMERR_DUPLICATED_FIELD_IDS;
+               }
+               *command = (int64)((((uint64)(uint32)high) << 32) |
+                                  (uint32)low);
+               haveCommand = TRUE;
+            } else if (fieldId == RMQPROXYDM_FLD_PAYLOAD) {
+               return DMERR_TYPE_MISMATCH;
+            }
+            break;
+         }
+      case DMFIELDTYPE_STRING:
+         if (!GetInt32(&buf, &left, &len) || len < 0 || len > left) {
+            return DMERR_TRUNCATED_DATA;
+         }
+
+         if (fieldId == RMQPROXYDM_FLD_PAYLOAD) {
+            if (*payload != NULL) {
+               return DMERR_DUPLICATED_FIELD_IDS;
+            }
+            *payload = buf;
+            *payloadLen = len;
+         } else if (fieldId == RMQPROXYDM_FLD_COMMAND) {
+            return DMERR_TYPE_MISMATCH;
+         }
+
+         buf += len;
+         left -= len;
+         break;
+      case DMFIELDTYPE_INT64LIST:
+         if (!GetInt32(&buf, &left, &len) || len < 0 ||
+             len > left / (int32)sizeof(int64)) {
+            return DMERR_TRUNCATED_DATA;
+         }
+         buf += len * sizeof(int64);
+         left -= len * sizeof(int64);
+         break;
+      case DMFIELDTYPE_STRINGLIST:
+         {
+            int32 count;
+
+            if (!GetInt32(&buf, &left, &count) || count < 0) {
+               return DMERR_TRUNCATED_DATA;
+            }
+
+            while (count-- > 0) {
+               if (!GetInt32(&buf, &left, &len) || len < 0 || len > left) {
+                  return DMERR_TRUNCATED_DATA;
+               }
+               buf += len;
+               left -= len;
+            }
+            break;
+         }
+      default:
+         return DMERR_UNKNOWN_TYPE;
+      }
+
+      if (fieldId == RMQPROXYDM_FLD_COMMAND && !haveCommand) {
+         return DMERR_TYPE_MISMATCH;
+      }
+   }
+
+   return haveCommand ? DMERR_SUCCESS : DMERR_NOT_FOUND;
+}
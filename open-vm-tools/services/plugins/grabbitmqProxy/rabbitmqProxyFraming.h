@@ -0,0 +1,68 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * rabbitmqProxyFraming.h --
+ *
+ *    Allocation free encoding and decoding of RabbitMQ proxy data packets.
+ *
+ *    A data packet is a serialized DataMap (see dataMap.c) carrying the
+ *    command, the guest proxy version and the payload. The encoder emits the
+ *    fields in a fixed order with the payload last, so everything but the
+ *    payload bytes is a per-process constant header with two length fields
+ *    patched in. The output is byte-for-byte a valid DataMap encoding.
+ */
+
+#ifndef _RABBITMQ_PROXY_FRAMING_H_
+#define _RABBITMQ_PROXY_FRAMING_H_
+
+#include "vm_basic_types.h"
+#include "rabbitmqProxyConst.h"
+
+#define RMQPROXY_MAX_VERSION_LEN        16
+
+/*
+ * Packet length prefix, command (type, id, int64), version (type, id, len,
+ * bytes) and payload header (type, id, len).
+ */
+#define RMQPROXY_DATA_HEADER_LEN(verLen)  (4 + 16 + 12 + (verLen) + 12)
+#define RMQPROXY_MAX_DATA_HEADER_LEN \
+   RMQPROXY_DATA_HEADER_LEN(RMQPROXY_MAX_VERSION_LEN)
+
+typedef struct {
+   char   bytes[RMQPROXY_MAX_DATA_HEADER_LEN];
+   int32  len;
+} RmqProxyDataHeader;
+
+void
+RmqProxy_InitDataHeader(RmqProxyDataHeader *hdr,   // OUT
+                        const char *version);      // IN
+
+void
+RmqProxy_FillDataHeader(const RmqProxyDataHeader *hdr,   // IN
+                        char *dst,                       // OUT
+                        int32 payloadLen);               // IN
+
+ErrorCode
+RmqProxy_ParsePacket(const char *buf,            // IN
+                     int32 bufLen,               // IN
+                     int64 *command,             // OUT
+                     const char **payload,       // OUT
+                     int32 *payloadLen);         // OUT
+
+#endif  /* _RABBITMQ_PROXY_FRAMING_H_ */
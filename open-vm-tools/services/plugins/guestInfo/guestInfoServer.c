@@ -83,6 +83,12 @@ VM_EMBED_VERSION(VMTOOLSD_VERSION_STRING);
  */
 #define GUESTINFO_STATS_INTERVAL 20
 
+/**
+ * How late the gather loops may run, so that they share wakeups with other
+ * periodic timers.
+ */
+#define GUESTINFO_TIMER_SLACK 1000
+
 #define GUESTINFO_DEFAULT_DELIMITER ' '
 
 /*
@@ -155,6 +161,14 @@ static GuestInfoCache gInfoCache;
 
 static Bool vmResumed;
 
+/*
+ * Buffer the XDR updates are encoded in. It is kept from one gather cycle
+ * to the next, so that, once it is large enough for the nic info of the
+ * guest, it does not have to grow again each time the info is sent.
+ */
+
+static DynBuf gInfoXdrBuf;
+
 
 /*
  * Local functions
@@ -172,6 +186,7 @@ static Bool DiskInfoChanged(const GuestDiskInfo *diskInfo);
 static void GuestInfoClearCache(void);
 static GuestNicList *NicInfoV3ToV2(const NicInfoV3 *infoV3);
 static void TweakGatherLoops(ToolsAppCtx *ctx, gboolean enable);
+static void SetNicRules(ToolsAppCtx *ctx);
 
 
 /*
@@ -613,7 +628,8 @@ GuestInfoSendNicInfoXdr(ToolsAppCtx *ctx,          // IN
    /* Add the RPC preamble: message name, and type. */
    request = g_strdup_printf("%s  %d ", GUEST_INFO_COMMAND, type);
 
-   if (DynXdr_Create(&xdrs) == NULL) {
+   DynBuf_SetSize(&gInfoXdrBuf, 0);
+   if (DynXdr_CreateWithBuf(&xdrs, &gInfoXdrBuf) == NULL) {
       goto exit;
    }
 
@@ -630,7 +646,7 @@ GuestInfoSendNicInfoXdr(ToolsAppCtx *ctx,          // IN
       }
       vm_free(reply);
    }
-   DynXdr_Destroy(&xdrs, TRUE);
+   DynXdr_Destroy(&xdrs, FALSE);
 
 exit:
    g_free(request);
@@ -1356,7 +1372,8 @@ TweakGatherLoop(ToolsAppCtx *ctx,
    if (*currInterval) {
       g_info("New value for %s is %us.\n", cfgKey, *currInterval / 1000);
 
-      *timeoutSource = g_timeout_source_new(*currInterval);
+      *timeoutSource = VMTools_CreateCoalescedTimer(*currInterval,
+                                                    GUESTINFO_TIMER_SLACK);
       VMTOOLSAPP_ATTACH_SOURCE(ctx, *timeoutSource, callback, ctx, NULL);
       g_source_unref(*timeoutSource);
    } else {
@@ -1430,6 +1447,28 @@ TweakGatherLoops(ToolsAppCtx *ctx,
 }
 
 
+/*
+ ******************************************************************************
+ * SetNicRules --                                                        */ /**
+ *
+ * @brief Sets the rules choosing the NICs to report from the config.
+ *
+ * @param[in]  ctx      The app context.
+ *
+ * @sa CONFNAME_GUESTINFO_PRIMARYNICS
+ * @sa CONFNAME_GUESTINFO_LOWPRIORITYNICS
+ * @sa CONFNAME_GUESTINFO_EXCLUDENICS
+ *
+ ******************************************************************************
+ */
+
+static void
+SetNicRules(ToolsAppCtx *ctx)
+{
+   GuestInfo_SetNicRulesFromConfig(ctx->config);
+}
+
+
 /*
  ******************************************************************************
  *
@@ -1468,7 +1507,8 @@ GuestInfo_ServerReportStats(
  ******************************************************************************
  * GuestInfoServerConfReload --                                          */ /**
  *
- * @brief Reconfigures the poll loop interval upon config file reload.
+ * @brief Reconfigures the poll loop interval and the NIC rules upon config
+ * file reload.
  *
  * @param[in]  src     The source object.
  * @param[in]  ctx     The application context.
@@ -1482,6 +1522,7 @@ GuestInfoServerConfReload(gpointer src,
                           ToolsAppCtx *ctx,
                           gpointer data)
 {
+   SetNicRules(ctx);
    TweakGatherLoops(ctx, TRUE);
 }
 
@@ -1530,6 +1571,7 @@ GuestInfoServerShutdown(gpointer src,
                         gpointer data)
 {
    GuestInfoClearCache();
+   DynBuf_Destroy(&gInfoXdrBuf);
 
    if (gatherInfoTimeoutSource != NULL) {
       g_source_destroy(gatherInfoTimeoutSource);
@@ -1711,9 +1753,12 @@ ToolsOnLoad(ToolsAppCtx *ctx)
       regData.regs = VMTools_WrapArray(regs, sizeof *regs, ARRAYSIZE(regs));
 
       memset(&gInfoCache, 0, sizeof gInfoCache);
+      DynBuf_Init(&gInfoXdrBuf);
       vmResumed = FALSE;
       gInfoCache.method = NIC_INFO_V3_WITH_INFO_IPADDRESS_V3;
 
+      SetNicRules(ctx);
+
       /*
        * Set up the GuestInfo gather loops.
        */
@@ -29,6 +29,7 @@
 
 #define G_LOG_DOMAIN "hgfsd"
 
+#include "conf.h"
 #include "hgfs.h"
 #include "hgfsServerManager.h"
 #include "vm_basic_defs.h"
@@ -263,6 +264,10 @@ ToolsOnLoad(ToolsAppCtx *ctx)
                               ctx->name,
                               NULL,       // rpc channel unused
                               NULL);      // no rpc callback
+   mgrData->notify = VMTools_ConfigGetBoolean(ctx->config,
+                                              CONFGROUPNAME_HGFSSERVER,
+                                              CONFNAME_HGFSSERVER_NOTIFY,
+                                              CONFVAL_HGFSSERVER_NOTIFY_DEFAULT);
 
    if (!HgfsServerManager_Register(mgrData)) {
       g_warning("HgfsServer_InitState() failed, aborting HGFS server init.\n");
@@ -0,0 +1,150 @@
+/*********************************************************
+ * Copyright (C) 2008-2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file hostTimeBackdoor.c
+ *
+ * Host time source: reads the host time through the backdoor.
+ */
+
+#include "timeSync.h"
+#include "backdoor.h"
+#include "backdoor_def.h"
+
+
+/*
+ * TimeSync_ReadHost --                                                 */ /**
+ *
+ * Read the time reported by the Host OS.
+ *
+ * @param[out]  host                Time on the Host.
+ * @param[out]  apparentError       Apparent time error = apparent - real.
+ * @param[out]  apparentErrorValid  Did the platform inform us of apparentError.
+ * @param[out]  maxTimeError        Maximum amount of error than can go.
+ *                                  uncorrected.
+ *
+ * @return TRUE on success.
+ *
+ */
+
+Bool
+TimeSync_ReadHost(int64 *host,
+                  int64 *apparentError,
+                  Bool *apparentErrorValid,
+                  int64 *maxTimeError)
+{
+   Backdoor_proto bp;
+   int64 maxTimeLag;
+   int64 interruptLag;
+   int64 hostSecs;
+   int64 hostUsecs;
+   Bool timeLagCall;
+
+   /*
+    * We need 3 things from the host, and there exist 3 different versions of
+    * the calls (described further below):
+    * 1) host time
+    * 2) maximum time lag allowed (config option), which is a
+    *    threshold that keeps the tools from being over eager about
+    *    resetting the time when it is only a little bit off.
+    * 3) interrupt lag (the amount that apparent time lags real time)
+    *
+    * First 2 versions of the call add interrupt lag to the maximum allowed
+    * time lag, where as in the last call it is returned separately.
+    *
+    * Three versions of the call:
+    *
+    * - BDOOR_CMD_GETTIME: suffers from a 136-year overflow problem that
+    *   cannot be corrected without breaking backwards compatibility with
+    *   older Tools. So, we have the newer BDOOR_CMD_GETTIMEFULL, which is
+    *   overflow safe.
+    *
+    * - BDOOR_CMD_GETTIMEFULL: overcomes the problem above.
+    *
+    * - BDOOR_CMD_GETTIMEFULL_WITH_LAG: Both BDOOR_CMD_GETTIMEFULL and
+    *   BDOOR_CMD_GETTIME returns max lag limit as interrupt lag + the maximum
+    *   allowed time lag. BDOOR_CMD_GETTIMEFULL_WITH_LAG separates these two
+    *   values. This is helpful when synchronizing time backwards by slewing
+    *   the clock.
+    *
+    * We use BDOOR_CMD_GETTIMEFULL_WITH_LAG first and fall back to
+    * BDOOR_CMD_GETTIMEFULL or BDOOR_CMD_GETTIME.
+    *
+    * Note that BDOOR_CMD_GETTIMEFULL and BDOOR_CMD_GETTIMEFULL_WITH_LAG will
+    * not touch EAX when it succeeds. So we check for errors by comparing EAX to
+    * BDOOR_MAGIC, which was set by the call to Backdoor() prior to touching the
+    * backdoor port.
+    */
+   bp.in.cx.halfs.low = BDOOR_CMD_GETTIMEFULL_WITH_LAG;
+   Backdoor(&bp);
+   if (bp.out.ax.word == BDOOR_MAGIC) {
+      hostSecs = ((uint64)bp.out.si.word << 32) | bp.out.dx.word;
+      interruptLag = bp.out.di.word;
+      timeLagCall = TRUE;
+      g_debug("Using BDOOR_CMD_GETTIMEFULL_WITH_LAG\n");
+   } else {
+      g_debug("BDOOR_CMD_GETTIMEFULL_WITH_LAG not supported by current host, "
+              "attempting BDOOR_CMD_GETTIMEFULL\n");
+      interruptLag = 0;
+      timeLagCall = FALSE;
+      bp.in.cx.halfs.low = BDOOR_CMD_GETTIMEFULL;
+      Backdoor(&bp);
+      if (bp.out.ax.word == BDOOR_MAGIC) {
+         hostSecs = ((uint64)bp.out.si.word << 32) | bp.out.dx.word;
+      } else {
+         g_debug("BDOOR_CMD_GETTIMEFULL not supported by current host, "
+                 "attempting BDOOR_CMD_GETTIME\n");
+         bp.in.cx.halfs.low = BDOOR_CMD_GETTIME;
+         Backdoor(&bp);
+         hostSecs = bp.out.ax.word;
+      }
+   }
+   hostUsecs = bp.out.bx.word;
+   maxTimeLag = bp.out.cx.word;
+
+   *host = hostSecs * US_PER_SEC + hostUsecs;
+   *apparentError = -interruptLag;
+   *apparentErrorValid = timeLagCall;
+   *maxTimeError = maxTimeLag;
+
+   if (hostSecs <= 0) {
+      g_warning("Invalid host OS time: %"FMT64"d secs, %"FMT64"d usecs.\n\n",
+                hostSecs, hostUsecs);
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+/*
+ * TimeSync_StopCatchup --                                              */ /**
+ *
+ * Tell timetracker to stop trying to catch up, once both the guest OS error
+ * and the apparent time error have been corrected.
+ *
+ */
+
+void
+TimeSync_StopCatchup(void)
+{
+   Backdoor_proto bp;
+
+   bp.in.cx.halfs.low = BDOOR_CMD_STOPCATCHUP;
+   Backdoor(&bp);
+}
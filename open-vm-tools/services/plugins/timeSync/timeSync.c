@@ -83,13 +83,20 @@
  *
  * 5. Avoid changing the slew in any other circumstance.  This allows a
  *    another agent to slew the time when we are not actively slewing.
+ *
+ * How small errors are slewed depends on the discipline set in tools.conf
+ * (see CONFNAME_TIMESYNC_DISCIPLINE).  The default discipline slews part of
+ * the error each period, then hands the clock over to the kernel PLL once
+ * it has measured the frequency error.  The filtered discipline takes the
+ * median of several samples, so that the occasional bad reading is ignored,
+ * and drives the clock frequency with a PI controller.
+ *
+ * The discipline itself lives in timeSyncDiscipline.c, and reads and
+ * corrects time only through the platform functions in timeSync.h.
  */
 
 #include "timeSync.h"
-#include "backdoor.h"
-#include "backdoor_def.h"
 #include "conf.h"
-#include "msg.h"
 #include "strutil.h"
 #include "system.h"
 #include "vmware/guestrpc/timesync.h"
@@ -106,47 +113,11 @@ VM_EMBED_VERSION(VMTOOLSD_VERSION_STRING);
 
 /* Sync the time once a minute. */
 #define TIMESYNC_TIME 60
+/* How late a periodic sync may run, to share wakeups with other timers. */
+#define TIMESYNC_SLACK_MS 1000
 /* Correct PERCENT_CORRECTION percent of the error each period. */
 #define TIMESYNC_PERCENT_CORRECTION 50
 
-/* When measuring the difference between time on the host and time in the
- * guest we try up to TIMESYNC_MAX_SAMPLES times to read a sample
- * where the two host reads are within TIMESYNC_GOOD_SAMPLE_THRESHOLD
- * microseconds. */
-#define TIMESYNC_MAX_SAMPLES 4
-#define TIMESYNC_GOOD_SAMPLE_THRESHOLD 2000
-
-/* Once the error drops below TIMESYNC_PLL_ACTIVATE, activate the PLL.
- * 500ppm error acumulated over a 60 second interval can produce 30ms of
- * error. */
-#define TIMESYNC_PLL_ACTIVATE (30 * 1000) /* 30ms. */
-/* If the error goes above TIMESYNC_PLL_UNSYNC, deactivate the PLL. */
-#define TIMESYNC_PLL_UNSYNC (2 * TIMESYNC_PLL_ACTIVATE)
-/* Period during which the frequency error of guest time is measured. */
-#define TIMESYNC_CALIBRATION_DURATION (15 * 60 * US_PER_SEC) /* 15min. */
-
-typedef enum TimeSyncState {
-   TIMESYNC_INITIALIZING,
-   TIMESYNC_STOPPED,
-   TIMESYNC_RUNNING,
-} TimeSyncState;
-
-typedef enum TimeSyncSlewState {
-   TimeSyncUncalibrated,
-   TimeSyncCalibrating,
-   TimeSyncPLL,
-} TimeSyncSlewState;
-
-typedef struct TimeSyncData {
-   gboolean           slewActive;
-   gboolean           slewCorrection;
-   uint32             slewPercentCorrection;
-   uint32             timeSyncPeriod;         /* In seconds. */
-   TimeSyncState      state;
-   TimeSyncSlewState  slewState;
-   GSource           *timer;
-} TimeSyncData;
-
 /*
  * See bug 1395378
  * Set default value to FALSE. This serves two purposes.
@@ -157,460 +128,6 @@ typedef struct TimeSyncData {
  */
 gboolean gTimeSyncToolsStartupAllowBackward = FALSE;
 
-static void TimeSyncSetSlewState(TimeSyncData *data, gboolean active);
-static void TimeSyncResetSlew(TimeSyncData *data);
-
-/**
- * Read the time reported by the Host OS.
- *
- * @param[out]  host                Time on the Host.
- * @param[out]  apparentError       Apparent time error = apparent - real.
- * @param[out]  apparentErrorValid  Did the platform inform us of apparentError.
- * @param[out]  maxTimeError        Maximum amount of error than can go.
- *                                  uncorrected.
- *
- * @return TRUE on success.
- */
-
-static gboolean
-TimeSyncReadHost(int64 *host, int64 *apparentError, Bool *apparentErrorValid,
-                 int64 *maxTimeError)
-{
-   Backdoor_proto bp;
-   int64 maxTimeLag;
-   int64 interruptLag;
-   int64 hostSecs;
-   int64 hostUsecs;
-   Bool timeLagCall;
-
-   /*
-    * We need 3 things from the host, and there exist 3 different versions of
-    * the calls (described further below):
-    * 1) host time
-    * 2) maximum time lag allowed (config option), which is a
-    *    threshold that keeps the tools from being over eager about
-    *    resetting the time when it is only a little bit off.
-    * 3) interrupt lag (the amount that apparent time lags real time)
-    *
-    * First 2 versions of the call add interrupt lag to the maximum allowed
-    * time lag, where as in the last call it is returned separately.
-    *
-    * Three versions of the call:
-    *
-    * - BDOOR_CMD_GETTIME: suffers from a 136-year overflow problem that
-    *   cannot be corrected without breaking backwards compatibility with
-    *   older Tools. So, we have the newer BDOOR_CMD_GETTIMEFULL, which is
-    *   overflow safe.
-    *
-    * - BDOOR_CMD_GETTIMEFULL: overcomes the problem above.
-    *
-    * - BDOOR_CMD_GETTIMEFULL_WITH_LAG: Both BDOOR_CMD_GETTIMEFULL and
-    *   BDOOR_CMD_GETTIME returns max lag limit as interrupt lag + the maximum
-    *   allowed time lag. BDOOR_CMD_GETTIMEFULL_WITH_LAG separates these two
-    *   values. This is helpful when synchronizing time backwards by slewing
-    *   the clock.
-    *
-    * We use BDOOR_CMD_GETTIMEFULL_WITH_LAG first and fall back to
-    * BDOOR_CMD_GETTIMEFULL or BDOOR_CMD_GETTIME.
-    *
-    * Note that BDOOR_CMD_GETTIMEFULL and BDOOR_CMD_GETTIMEFULL_WITH_LAG will
-    * not touch EAX when it succeeds. So we check for errors by comparing EAX to
-    * BDOOR_MAGIC, which was set by the call to Backdoor() prior to touching the
-    * backdoor port.
-    */
-   bp.in.cx.halfs.low = BDOOR_CMD_GETTIMEFULL_WITH_LAG;
-   Backdoor(&bp);
-   if (bp.out.ax.word == BDOOR_MAGIC) {
-      hostSecs = ((uint64)bp.out.si.word << 32) | bp.out.dx.word;
-      interruptLag = bp.out.di.word;
-      timeLagCall = TRUE;
-      g_debug("Using BDOOR_CMD_GETTIMEFULL_WITH_LAG\n");
-   } else {
-      g_debug("BDOOR_CMD_GETTIMEFULL_WITH_LAG not supported by current host, "
-              "attempting BDOOR_CMD_GETTIMEFULL\n");
-      interruptLag = 0;
-      timeLagCall = FALSE;
-      bp.in.cx.halfs.low = BDOOR_CMD_GETTIMEFULL;
-      Backdoor(&bp);
-      if (bp.out.ax.word == BDOOR_MAGIC) {
-         hostSecs = ((uint64)bp.out.si.word << 32) | bp.out.dx.word;
-      } else {
-         g_debug("BDOOR_CMD_GETTIMEFULL not supported by current host, "
-                 "attempting BDOOR_CMD_GETTIME\n");
-         bp.in.cx.halfs.low = BDOOR_CMD_GETTIME;
-         Backdoor(&bp);
-         hostSecs = bp.out.ax.word;
-      }
-   }
-   hostUsecs = bp.out.bx.word;
-   maxTimeLag = bp.out.cx.word;
-
-   *host = hostSecs * US_PER_SEC + hostUsecs;
-   *apparentError = -interruptLag;
-   *apparentErrorValid = timeLagCall;
-   *maxTimeError = maxTimeLag;
-
-   if (hostSecs <= 0) {
-      g_warning("Invalid host OS time: %"FMT64"d secs, %"FMT64"d usecs.\n\n",
-                hostSecs, hostUsecs);
-      return FALSE;
-   }
-
-   return TRUE;
-}
-
-
-/**
- * Read the Guest OS time and the Host OS time.
- *
- * There are three time domains that are revelant here:
- * 1. Guest time     - the time reported by the guest
- * 2. Apparent time  - the time reported by the virtualization layer
- * 3. Host time      - the time reported by the host operating system.
- *
- * This function reports the host time, the guest time and the difference
- * between apparent time and host time (apparentError).  The host and
- * guest time may be sampled multiple times to ensure an accurate reading.
- *
- * @param[out]  host                Time on the Host.
- * @param[out]  guest               Time in the Guest.
- * @param[out]  apparentError       Apparent time error = apparent - real.
- * @param[out]  apparentErrorValid  Did the platform inform us of apparentError.
- * @param[out]  maxTimeError        Maximum amount of error than can go.
- *                                  uncorrected.
- *
- * @return TRUE on success.
- */
-
-static gboolean
-TimeSyncReadHostAndGuest(int64 *host, int64 *guest, 
-                         int64 *apparentError, Bool *apparentErrorValid,
-                         int64 *maxTimeError)
-{
-   int64 host1, host2, hostDiff;
-   int64 tmpGuest, tmpApparentError, tmpMaxTimeError;
-   Bool tmpApparentErrorValid;
-   int64 bestHostDiff = MAX_INT64;
-   int iter = 0;
-   DEBUG_ONLY(static int64 lastHost = 0);
-
-   *apparentErrorValid = FALSE;
-   *host = *guest = *apparentError = *maxTimeError = 0;
-
-   if (!TimeSyncReadHost(&host2, &tmpApparentError, 
-                         &tmpApparentErrorValid, &tmpMaxTimeError)) {
-      return FALSE;
-   }
-
-   do {
-      iter++;
-      host1 = host2;
-
-      if (!TimeSync_GetCurrentTime(&tmpGuest)) {
-         g_warning("Unable to retrieve the guest OS time: %s.\n\n", 
-                   Msg_ErrString());
-         return FALSE;
-      }
-      
-      if (!TimeSyncReadHost(&host2, &tmpApparentError, 
-                            &tmpApparentErrorValid, &tmpMaxTimeError)) {
-         return FALSE;
-      }
-      
-      if (host1 < host2) {
-         hostDiff = host2 - host1;
-      } else {
-         hostDiff = 0;
-      }
-
-      if (hostDiff <= bestHostDiff) {
-         bestHostDiff = hostDiff;
-         *host = host1 + hostDiff / 2;
-         *guest = tmpGuest;
-         *apparentError = tmpApparentError;
-         *apparentErrorValid = tmpApparentErrorValid;
-         *maxTimeError = tmpMaxTimeError;
-      }
-   } while (iter < TIMESYNC_MAX_SAMPLES && 
-            bestHostDiff > TIMESYNC_GOOD_SAMPLE_THRESHOLD);
-
-   ASSERT(*host != 0 && *guest != 0);
-
-#ifdef VMX86_DEBUG
-   g_debug("Daemon: Guest vs host error %.6fs; guest vs apparent error %.6fs; "
-           "limit=%.2fs; apparentError %.6fs; iter=%d error=%.6fs; "
-           "%.6f secs since last update\n",
-           (*guest - *host) / 1000000.0, 
-           (*guest - *host - *apparentError) / 1000000.0, 
-           *maxTimeError / 1000000.0, *apparentError / 1000000.0,
-           iter, bestHostDiff / 1000000.0,
-           (*host - lastHost) / 1000000.0);
-   lastHost = *host;
-#endif
-
-   return TRUE;
-}
-
-
-/**
- * Set the guest OS time to the host OS time by stepping the time.
- *
- * @param[in]  data              Structure tracking time sync state.
- * @param[in]  adjustment        Amount to correct the guest time.
- */
-
-gboolean
-TimeSyncStepTime(TimeSyncData *data, int64 adjustment)
-{
-   Backdoor_proto bp;
-   int64 before;
-   int64 after;
-
-   if (vmx86_debug) {
-      TimeSync_GetCurrentTime(&before);
-   }
-
-   /* Stepping invalidates the current slew, reset to nominal. */
-   TimeSyncSetSlewState(data, FALSE);
-
-   if (!TimeSync_AddToCurrentTime(adjustment)) {
-      return FALSE;
-   }
-
-   /* 
-    * Tell timetracker to stop trying to catch up, since we have corrected
-    * both the guest OS error and the apparent time error. 
-    */
-   bp.in.cx.halfs.low = BDOOR_CMD_STOPCATCHUP;
-   Backdoor(&bp);
-
-   if (vmx86_debug) {
-      TimeSync_GetCurrentTime(&after);
-      
-      g_debug("Time changed by %"FMT64"dus from %"FMT64"d.%06"FMT64"d -> "
-              "%"FMT64"d.%06"FMT64"d\n", adjustment,
-              before / US_PER_SEC, before % US_PER_SEC, 
-              after / US_PER_SEC, after % US_PER_SEC);
-   }
-
-   return TRUE;
-}
-
-
-/**
- * Slew the guest OS time advancement to correct the time.
- *
- * In addition to standard slewing (implemented via TimeSync_Slew), we
- * also support using an NTP style PLL to slew the time.  The PLL can take
- * a while to end up with an accurate measurement of the frequency error,
- * so before entering PLL mode we calibrate the frequency error over a
- * period of TIMESYNC_PLL_ACTIVATE seconds.  
- *
- * When using standard slewing, only correct slewPercentCorrection of the
- * error.  This is to avoid overcorrection when the error is mis-measured,
- * or overcorrection caused by the daemon waking up later than it is
- * supposed to leaving the slew in place for longer than anticpiated.
- *
- * @param[in]  data              Structure tracking time sync state.
- * @param[in]  adjustment        Amount to correct the guest time.
- */
-
-static gboolean
-TimeSyncSlewTime(TimeSyncData *data, int64 adjustment)
-{
-   static int64 calibrationStart;
-   static int64 calibrationAdjustment;
-
-   int64 now;
-   int64 remaining = 0;
-   int64 timeSyncPeriodUS = data->timeSyncPeriod * US_PER_SEC;
-   int64 slewDiff = (adjustment * data->slewPercentCorrection) / 100;
-   
-   if (!TimeSync_GetCurrentTime(&now)) {
-      return FALSE;
-   }
-
-   if (adjustment > TIMESYNC_PLL_UNSYNC && 
-       data->slewState != TimeSyncUncalibrated) {
-      g_debug("Adjustment too large (%"FMT64"d), resetting PLL state.\n", 
-              adjustment);
-      data->slewState = TimeSyncUncalibrated;
-   }
-
-   if (data->slewState == TimeSyncUncalibrated) {
-      g_debug("Slewing time: adjustment %"FMT64"d\n", adjustment);
-      if (!TimeSync_Slew(slewDiff, timeSyncPeriodUS, &remaining)) {
-         data->slewState = TimeSyncUncalibrated;
-         return FALSE;
-      }
-      if (adjustment < TIMESYNC_PLL_ACTIVATE && TimeSync_PLLSupported()) {
-         g_debug("Starting PLL calibration.\n");
-         calibrationStart = now;
-         /* Starting out the calibration period we are adjustment behind,
-          * but have already requested to correct slewDiff of that. */
-         calibrationAdjustment = slewDiff - adjustment;
-         data->slewState = TimeSyncCalibrating;
-      }
-   } else if (data->slewState == TimeSyncCalibrating) {
-      if (now > calibrationStart + TIMESYNC_CALIBRATION_DURATION) {
-         int64 ppmErr;
-         /* Reset slewing to nominal and find out remaining slew. */
-         TimeSync_Slew(0, timeSyncPeriodUS, &remaining);
-         calibrationAdjustment += adjustment;
-         calibrationAdjustment -= remaining;
-         ppmErr = ((1000000 * calibrationAdjustment) << 16) / 
-                   (now - calibrationStart);
-         if (ppmErr >> 16 < 500 && ppmErr >> 16 > -500) {
-            g_debug("Activating PLL ppmEst=%"FMT64"d (%"FMT64"d)\n", 
-                    ppmErr >> 16, ppmErr);
-            TimeSync_PLLUpdate(adjustment);
-            TimeSync_PLLSetFrequency(ppmErr);
-            data->slewState = TimeSyncPLL;
-         } else {
-            /* PPM error is too large to try the PLL. */
-            g_debug("PPM error too large: %"FMT64"d (%"FMT64"d) "
-                    "not activating PLL\n", ppmErr >> 16, ppmErr);
-            data->slewState = TimeSyncUncalibrated;
-         }
-      } else {
-         g_debug("Calibrating error: adjustment %"FMT64"d\n", adjustment);
-         if (!TimeSync_Slew(slewDiff, timeSyncPeriodUS, &remaining)) {
-            return FALSE;
-         }
-         calibrationAdjustment += slewDiff;
-         calibrationAdjustment -= remaining;
-      }
-   } else {
-      ASSERT(data->slewState == TimeSyncPLL);
-      g_debug("Updating PLL: adjustment %"FMT64"d\n", adjustment);
-      if (!TimeSync_PLLUpdate(adjustment)) {
-         TimeSyncResetSlew(data);
-      }
-   }
-   return TRUE;
-}
-
-
-/**
- * Reset the slew to nominal.
- *
- * @param[in]  data              Structure tracking time sync state.
- */
-
-static void
-TimeSyncResetSlew(TimeSyncData *data)
-{
-   int64 remaining;
-   int64 timeSyncPeriodUS = data->timeSyncPeriod * US_PER_SEC;
-   data->slewState = TimeSyncUncalibrated;
-   TimeSync_Slew(0, timeSyncPeriodUS, &remaining);
-   if (TimeSync_PLLSupported()) {
-      TimeSync_PLLUpdate(0);
-      TimeSync_PLLSetFrequency(0);
-   }
-}
-
-
-/**
- * Update whether slewing is used for time correction.
- *
- * @param[in]  data              Structure tracking time sync state.
- * @param[in]  active            Is slewing active.
- */
-
-static void
-TimeSyncSetSlewState(TimeSyncData *data, gboolean active)
-{
-   if (active != data->slewActive) {
-      g_debug(active ? "Starting slew.\n" : "Stopping slew.\n");
-      if (!active) {
-         TimeSyncResetSlew(data);
-      }
-      data->slewActive = active;
-   }
-}
-
-
-/**
- * Set the guest OS time to the host OS time.
- *
- * @param[in]  slewCorrection    Is clock slewing enabled?
- * @param[in]  syncOnce          Is this function called in a loop?
- * @param[in]  allowBackwardSync Can we sync time backwards when doing syncOnce?
- * @param[in]  _data             Time sync data.
- *
- * @return TRUE on success.
- */
-
-static gboolean
-TimeSyncDoSync(Bool slewCorrection,
-               Bool syncOnce,
-               Bool allowBackwardSync,
-               void *_data)
-{
-   int64 guest, host;
-   int64 gosError, apparentError, maxTimeError;
-   Bool apparentErrorValid;
-   TimeSyncData *data = _data;
-
-   g_debug("Synchronizing time: "
-           "syncOnce %d, slewCorrection %d, allowBackwardSync %d.\n",
-           syncOnce, slewCorrection, allowBackwardSync);
-
-   if (!TimeSyncReadHostAndGuest(&host, &guest, &apparentError, 
-                                 &apparentErrorValid, &maxTimeError)) {
-      return FALSE;
-   }
-
-   gosError = guest - host - apparentError;
-
-   if (syncOnce) {
-
-      /*
-       * Non-loop behavior:
-       *
-       * Perform a step correction if:
-       * 1) The guest OS error is behind by more than maxTimeError.
-       * 2) The guest OS is ahead of the host OS.
-       */
-
-      if (gosError < -maxTimeError || 
-          (gosError + apparentError > 0 && allowBackwardSync)) {
-         g_debug("One time synchronization: stepping time.\n");
-         if (!TimeSyncStepTime(data, -gosError + -apparentError)) {
-            return FALSE;
-         }
-      } else {
-         g_debug("One time synchronization: correction not needed.\n");
-      }
-   } else {
-
-      /*
-       * Loop behavior:
-       *
-       * If guest error is more than maxTimeError behind perform a step
-       * correction.  Otherwise, if we can distinguish guest error from
-       * apparent time error perform a slew correction .
-       */
-
-      TimeSyncSetSlewState(data, apparentErrorValid && slewCorrection);
-
-      if (gosError < -maxTimeError) {
-         g_debug("Periodic synchronization: stepping time.\n");
-         if (!TimeSyncStepTime(data, -gosError + -apparentError)) {
-            return FALSE;
-         }
-      } else if (slewCorrection && apparentErrorValid) {
-         g_debug("Periodic synchronization: slewing time.\n");
-         if (!TimeSyncSlewTime(data, -gosError)) {
-            return FALSE;
-         }
-      }
-   }
-
-   return TRUE;
-}
-
 
 /**
  * Run the "time synchronization" loop.
@@ -665,7 +182,8 @@ TimeSyncStartLoop(ToolsAppCtx *ctx,
       g_warning("Unable to synchronize time when starting time loop.\n");
    }
 
-   data->timer = g_timeout_source_new(data->timeSyncPeriod * 1000);
+   data->timer = VMTools_CreateCoalescedTimer(data->timeSyncPeriod * 1000,
+                                              TIMESYNC_SLACK_MS);
    VMTOOLSAPP_ATTACH_SOURCE(ctx, data->timer, ToolsDaemonTimeSyncLoop, data, NULL);
 
    data->state = TIMESYNC_RUNNING;
@@ -879,6 +397,53 @@ TimeSyncSetOption(gpointer src,
 }
 
 
+/**
+ * Reads the discipline from the config file.
+ *
+ * @param[in]  ctx      The app context.
+ *
+ * @return The discipline, the default one if not set or invalid.
+ */
+
+static TimeSyncDiscipline
+TimeSyncReadDiscipline(ToolsAppCtx *ctx)
+{
+   TimeSyncDiscipline discipline = TIMESYNC_DISCIPLINE_SLEW;
+   gchar *value = g_key_file_get_string(ctx->config, CONFGROUPNAME_TIMESYNC,
+                                        CONFNAME_TIMESYNC_DISCIPLINE, NULL);
+
+   if (value == NULL || strcmp(value, CONFVAL_TIMESYNC_DISCIPLINE_SLEW) == 0) {
+      discipline = TIMESYNC_DISCIPLINE_SLEW;
+   } else if (strcmp(value, CONFVAL_TIMESYNC_DISCIPLINE_FILTERED) == 0) {
+      discipline = TIMESYNC_DISCIPLINE_FILTERED;
+   } else {
+      g_warning("Invalid %s.%s '%s', using '%s'.\n", CONFGROUPNAME_TIMESYNC,
+                CONFNAME_TIMESYNC_DISCIPLINE, value,
+                CONFVAL_TIMESYNC_DISCIPLINE_SLEW);
+   }
+
+   g_free(value);
+   return discipline;
+}
+
+
+/**
+ * Handles a config reload callback; switches discipline if it changed.
+ *
+ * @param[in]  src      The source object.
+ * @param[in]  ctx      The app context.
+ * @param[in]  plugin   Plugin registration data.
+ */
+
+static void
+TimeSyncConfReload(gpointer src,
+                   ToolsAppCtx *ctx,
+                   ToolsPluginData *plugin)
+{
+   TimeSyncSetDiscipline(plugin->_private, TimeSyncReadDiscipline(ctx));
+}
+
+
 /**
  * Handles a shutdown callback; cleans up internal plugin state.
  *
@@ -925,6 +490,7 @@ ToolsOnLoad(ToolsAppCtx *ctx)
       { TIMESYNC_SYNCHRONIZE, TimeSyncTcloHandler, data, NULL, NULL, 0 }
    };
    ToolsPluginSignalCb sigs[] = {
+      { TOOLS_CORE_SIG_CONF_RELOAD, TimeSyncConfReload, &regData },
       { TOOLS_CORE_SIG_SET_OPTION, TimeSyncSetOption, &regData },
       { TOOLS_CORE_SIG_SHUTDOWN, TimeSyncShutdown, &regData }
    };
@@ -939,7 +505,11 @@ ToolsOnLoad(ToolsAppCtx *ctx)
    data->state = TIMESYNC_INITIALIZING;
    data->slewState = TimeSyncUncalibrated;
    data->timeSyncPeriod = TIMESYNC_TIME;
+   data->discipline = TimeSyncReadDiscipline(ctx);
    data->timer = NULL;
+   data->piFrequency = 0;
+   data->piLastUpdate = 0;
+   data->piCoarse = FALSE;
 
    regData.regs = VMTools_WrapArray(regs, sizeof *regs, ARRAYSIZE(regs));
    regData._private = data;
@@ -26,10 +26,81 @@
  */
 
 #define G_LOG_DOMAIN "timeSync"
+#include <glib.h>
 #include "vm_basic_types.h"
 
 #define US_PER_SEC 1000000
 
+typedef enum TimeSyncState {
+   TIMESYNC_INITIALIZING,
+   TIMESYNC_STOPPED,
+   TIMESYNC_RUNNING,
+} TimeSyncState;
+
+typedef enum TimeSyncSlewState {
+   TimeSyncUncalibrated,
+   TimeSyncCalibrating,
+   TimeSyncPLL,
+} TimeSyncSlewState;
+
+/*
+ * How the periodic sync corrects small errors (see CONFNAME_TIMESYNC_DISCIPLINE):
+ * slewing part of the error each period until the kernel PLL takes over, or
+ * a median filter over several samples driving a PI controller.
+ */
+typedef enum TimeSyncDiscipline {
+   TIMESYNC_DISCIPLINE_SLEW,
+   TIMESYNC_DISCIPLINE_FILTERED,
+} TimeSyncDiscipline;
+
+typedef struct TimeSyncData {
+   gboolean           slewActive;
+   gboolean           slewCorrection;
+   uint32             slewPercentCorrection;
+   uint32             timeSyncPeriod;         /* In seconds. */
+   TimeSyncState      state;
+   TimeSyncSlewState  slewState;
+   TimeSyncDiscipline discipline;
+   GSource           *timer;
+
+   /* State of the filtered discipline. */
+   int64              piFrequency;            /* ppm << 16. */
+   int64              piLastUpdate;           /* Guest time, 0 if none. */
+   gboolean           piCoarse;               /* Slewing a large error. */
+} TimeSyncData;
+
+/* Discipline, in timeSyncDiscipline.c. */
+
+gboolean
+TimeSyncDoSync(Bool slewCorrection,
+               Bool syncOnce,
+               Bool allowBackwardSync,
+               void *_data);
+
+void
+TimeSyncResetSlew(TimeSyncData *data);
+
+void
+TimeSyncSetSlewState(TimeSyncData *data,
+                     gboolean active);
+
+void
+TimeSyncSetDiscipline(TimeSyncData *data,
+                      TimeSyncDiscipline discipline);
+
+/* Host time source. */
+
+Bool
+TimeSync_ReadHost(int64 *host,
+                  int64 *apparentError,
+                  Bool *apparentErrorValid,
+                  int64 *maxTimeError);
+
+void
+TimeSync_StopCatchup(void);
+
+/* Guest clock. */
+
 Bool
 TimeSync_GetCurrentTime(int64 *now);
 
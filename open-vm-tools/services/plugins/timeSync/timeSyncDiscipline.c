@@ -0,0 +1,608 @@
+/*********************************************************
+ * Copyright (C) 2008-2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file timeSyncDiscipline.c
+ *
+ * Measures the error of the guest clock against the host and decides how to
+ * correct it: stepping, slewing, the kernel PLL or the filtered discipline.
+ * See timeSync.c for the policy.
+ *
+ * Time is read and corrected only through the TimeSync_* functions, which
+ * the platform provides, so that this file also runs against a simulated
+ * clock (see tests/testTimeSync).
+ */
+
+#include "timeSync.h"
+#include "msg.h"
+#include "vm_assert.h"
+
+
+/* When measuring the difference between time on the host and time in the
+ * guest we try up to TIMESYNC_MAX_SAMPLES times to read a sample
+ * where the two host reads are within TIMESYNC_GOOD_SAMPLE_THRESHOLD
+ * microseconds. */
+#define TIMESYNC_MAX_SAMPLES 4
+#define TIMESYNC_GOOD_SAMPLE_THRESHOLD 2000
+
+/* Once the error drops below TIMESYNC_PLL_ACTIVATE, activate the PLL.
+ * 500ppm error acumulated over a 60 second interval can produce 30ms of
+ * error. */
+#define TIMESYNC_PLL_ACTIVATE (30 * 1000) /* 30ms. */
+/* If the error goes above TIMESYNC_PLL_UNSYNC, deactivate the PLL. */
+#define TIMESYNC_PLL_UNSYNC (2 * TIMESYNC_PLL_ACTIVATE)
+/* Period during which the frequency error of guest time is measured. */
+#define TIMESYNC_CALIBRATION_DURATION (15 * 60 * US_PER_SEC) /* 15min. */
+
+/* The filtered discipline keeps the median of TIMESYNC_FILTER_SAMPLES
+ * samples.  Its PI controller corrects TIMESYNC_PI_PROPORTIONAL percent of
+ * the error over the next period and adds TIMESYNC_PI_INTEGRAL percent of
+ * it to the frequency estimate; this puts both poles of the loop near 0.63,
+ * so an error halves every period and a half without overshooting. */
+#define TIMESYNC_FILTER_SAMPLES 7
+#define TIMESYNC_PI_PROPORTIONAL 60
+#define TIMESYNC_PI_INTEGRAL 15
+/* Largest frequency correction, as for the kernel PLL. */
+#define TIMESYNC_MAX_PPM 500
+
+typedef struct TimeSyncSample {
+   int64 host;
+   int64 guest;
+   int64 apparentError;
+   int64 maxTimeError;
+   Bool  apparentErrorValid;
+} TimeSyncSample;
+
+#define TIMESYNC_SAMPLE_ERROR(s) ((s)->guest - (s)->host - (s)->apparentError)
+
+
+/**
+ * Read the Guest OS time and the Host OS time.
+ *
+ * There are three time domains that are revelant here:
+ * 1. Guest time     - the time reported by the guest
+ * 2. Apparent time  - the time reported by the virtualization layer
+ * 3. Host time      - the time reported by the host operating system.
+ *
+ * This function reports the host time, the guest time and the difference
+ * between apparent time and host time (apparentError).  The host and
+ * guest time may be sampled multiple times to ensure an accurate reading.
+ *
+ * @param[out]  host                Time on the Host.
+ * @param[out]  guest               Time in the Guest.
+ * @param[out]  apparentError       Apparent time error = apparent - real.
+ * @param[out]  apparentErrorValid  Did the platform inform us of apparentError.
+ * @param[out]  maxTimeError        Maximum amount of error than can go.
+ *                                  uncorrected.
+ *
+ * @return TRUE on success.
+ */
+
+static gboolean
+TimeSyncReadHostAndGuest(int64 *host, int64 *guest, 
+                         int64 *apparentError, Bool *apparentErrorValid,
+                         int64 *maxTimeError)
+{
+   int64 host1, host2, hostDiff;
+   int64 tmpGuest, tmpApparentError, tmpMaxTimeError;
+   Bool tmpApparentErrorValid;
+   int64 bestHostDiff = MAX_INT64;
+   int iter = 0;
+   DEBUG_ONLY(static int64 lastHost = 0);
+
+   *apparentErrorValid = FALSE;
+   *host = *guest = *apparentError = *maxTimeError = 0;
+
+   if (!TimeSync_ReadHost(&host2, &tmpApparentError, 
+                          &tmpApparentErrorValid, &tmpMaxTimeError)) {
+      return FALSE;
+   }
+
+   do {
+      iter++;
+      host1 = host2;
+
+      if (!TimeSync_GetCurrentTime(&tmpGuest)) {
+         g_warning("Unable to retrieve the guest OS time: %s.\n\n", 
+                   Msg_ErrString());
+         return FALSE;
+      }
+      
+      if (!TimeSync_ReadHost(&host2, &tmpApparentError, 
+                             &tmpApparentErrorValid, &tmpMaxTimeError)) {
+         return FALSE;
+      }
+      
+      if (host1 < host2) {
+         hostDiff = host2 - host1;
+      } else {
+         hostDiff = 0;
+      }
+
+      if (hostDiff <= bestHostDiff) {
+         bestHostDiff = hostDiff;
+         *host = host1 + hostDiff / 2;
+         *guest = tmpGuest;
+         *apparentError = tmpApparentError;
+         *apparentErrorValid = tmpApparentErrorValid;
+         *maxTimeError = tmpMaxTimeError;
+      }
+   } while (iter < TIMESYNC_MAX_SAMPLES && 
+            bestHostDiff > TIMESYNC_GOOD_SAMPLE_THRESHOLD);
+
+   ASSERT(*host != 0 && *guest != 0);
+
+#ifdef VMX86_DEBUG
+   g_debug("Daemon: Guest vs host error %.6fs; guest vs apparent error %.6fs; "
+           "limit=%.2fs; apparentError %.6fs; iter=%d error=%.6fs; "
+           "%.6f secs since last update\n",
+           (*guest - *host) / 1000000.0, 
+           (*guest - *host - *apparentError) / 1000000.0, 
+           *maxTimeError / 1000000.0, *apparentError / 1000000.0,
+           iter, bestHostDiff / 1000000.0,
+           (*host - lastHost) / 1000000.0);
+   lastHost = *host;
+#endif
+
+   return TRUE;
+}
+
+
+/**
+ * Read the Guest OS time and the Host OS time several times, and keep the
+ * median sample.
+ *
+ * A single sample can be off by the time the guest or the host was not
+ * running between the reads; TimeSyncReadHostAndGuest only retries when it
+ * notices.  The median of TIMESYNC_FILTER_SAMPLES samples ignores a minority
+ * of such outliers, which the PI controller would otherwise chase.
+ *
+ * @param[out]  host                Time on the Host.
+ * @param[out]  guest               Time in the Guest.
+ * @param[out]  apparentError       Apparent time error = apparent - real.
+ * @param[out]  apparentErrorValid  Did the platform inform us of apparentError.
+ * @param[out]  maxTimeError        Maximum amount of error than can go.
+ *                                  uncorrected.
+ *
+ * @return TRUE on success.
+ */
+
+static gboolean
+TimeSyncReadHostAndGuestFiltered(int64 *host, int64 *guest,
+                                 int64 *apparentError,
+                                 Bool *apparentErrorValid,
+                                 int64 *maxTimeError)
+{
+   TimeSyncSample samples[TIMESYNC_FILTER_SAMPLES];
+   TimeSyncSample *median;
+   int i;
+   int j;
+
+   for (i = 0; i < ARRAYSIZE(samples); i++) {
+      TimeSyncSample sample;
+
+      if (!TimeSyncReadHostAndGuest(&sample.host, &sample.guest,
+                                    &sample.apparentError,
+                                    &sample.apparentErrorValid,
+                                    &sample.maxTimeError)) {
+         return FALSE;
+      }
+
+      /* Insert by guest OS error. */
+      for (j = i;
+           j > 0 && TIMESYNC_SAMPLE_ERROR(&samples[j - 1]) >
+                    TIMESYNC_SAMPLE_ERROR(&sample);
+           j--) {
+         samples[j] = samples[j - 1];
+      }
+      samples[j] = sample;
+   }
+
+   median = &samples[ARRAYSIZE(samples) / 2];
+   *host = median->host;
+   *guest = median->guest;
+   *apparentError = median->apparentError;
+   *apparentErrorValid = median->apparentErrorValid;
+   *maxTimeError = median->maxTimeError;
+
+   g_debug("Filtered: median error %.6fs, spread %.6fs\n",
+           TIMESYNC_SAMPLE_ERROR(median) / 1000000.0,
+           (TIMESYNC_SAMPLE_ERROR(&samples[ARRAYSIZE(samples) - 1]) -
+            TIMESYNC_SAMPLE_ERROR(&samples[0])) / 1000000.0);
+
+   return TRUE;
+}
+
+
+/**
+ * Set the guest OS time to the host OS time by stepping the time.
+ *
+ * @param[in]  data              Structure tracking time sync state.
+ * @param[in]  adjustment        Amount to correct the guest time.
+ */
+
+gboolean
+TimeSyncStepTime(TimeSyncData *data, int64 adjustment)
+{
+   int64 before;
+   int64 after;
+
+   if (vmx86_debug) {
+      TimeSync_GetCurrentTime(&before);
+   }
+
+   /* Stepping invalidates the current slew, reset to nominal. */
+   TimeSyncSetSlewState(data, FALSE);
+
+   if (!TimeSync_AddToCurrentTime(adjustment)) {
+      return FALSE;
+   }
+
+   /* 
+    * Tell timetracker to stop trying to catch up, since we have corrected
+    * both the guest OS error and the apparent time error. 
+    */
+   TimeSync_StopCatchup();
+
+   if (vmx86_debug) {
+      TimeSync_GetCurrentTime(&after);
+      
+      g_debug("Time changed by %"FMT64"dus from %"FMT64"d.%06"FMT64"d -> "
+              "%"FMT64"d.%06"FMT64"d\n", adjustment,
+              before / US_PER_SEC, before % US_PER_SEC, 
+              after / US_PER_SEC, after % US_PER_SEC);
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Slew the guest OS time advancement to correct the time.
+ *
+ * In addition to standard slewing (implemented via TimeSync_Slew), we
+ * also support using an NTP style PLL to slew the time.  The PLL can take
+ * a while to end up with an accurate measurement of the frequency error,
+ * so before entering PLL mode we calibrate the frequency error over a
+ * period of TIMESYNC_PLL_ACTIVATE seconds.  
+ *
+ * When using standard slewing, only correct slewPercentCorrection of the
+ * error.  This is to avoid overcorrection when the error is mis-measured,
+ * or overcorrection caused by the daemon waking up later than it is
+ * supposed to leaving the slew in place for longer than anticpiated.
+ *
+ * @param[in]  data              Structure tracking time sync state.
+ * @param[in]  adjustment        Amount to correct the guest time.
+ */
+
+static gboolean
+TimeSyncSlewTime(TimeSyncData *data, int64 adjustment)
+{
+   static int64 calibrationStart;
+   static int64 calibrationAdjustment;
+
+   int64 now;
+   int64 remaining = 0;
+   int64 timeSyncPeriodUS = data->timeSyncPeriod * US_PER_SEC;
+   int64 slewDiff = (adjustment * data->slewPercentCorrection) / 100;
+   
+   if (!TimeSync_GetCurrentTime(&now)) {
+      return FALSE;
+   }
+
+   if (adjustment > TIMESYNC_PLL_UNSYNC && 
+       data->slewState != TimeSyncUncalibrated) {
+      g_debug("Adjustment too large (%"FMT64"d), resetting PLL state.\n", 
+              adjustment);
+      data->slewState = TimeSyncUncalibrated;
+   }
+
+   if (data->slewState == TimeSyncUncalibrated) {
+      g_debug("Slewing time: adjustment %"FMT64"d\n", adjustment);
+      if (!TimeSync_Slew(slewDiff, timeSyncPeriodUS, &remaining)) {
+         data->slewState = TimeSyncUncalibrated;
+         return FALSE;
+      }
+      if (adjustment < TIMESYNC_PLL_ACTIVATE && TimeSync_PLLSupported()) {
+         g_debug("Starting PLL calibration.\n");
+         calibrationStart = now;
+         /* Starting out the calibration period we are adjustment behind,
+          * but have already requested to correct slewDiff of that. */
+         calibrationAdjustment = slewDiff - adjustment;
+         data->slewState = TimeSyncCalibrating;
+      }
+   } else if (data->slewState == TimeSyncCalibrating) {
+      if (now > calibrationStart + TIMESYNC_CALIBRATION_DURATION) {
+         int64 ppmErr;
+         /* Reset slewing to nominal and find out remaining slew. */
+         TimeSync_Slew(0, timeSyncPeriodUS, &remaining);
+         calibrationAdjustment += adjustment;
+         calibrationAdjustment -= remaining;
+         ppmErr = (1000000 * calibrationAdjustment * 65536) / 
+                   (now - calibrationStart);
+         if (ppmErr >> 16 < 500 && ppmErr >> 16 > -500) {
+            g_debug("Activating PLL ppmEst=%"FMT64"d (%"FMT64"d)\n", 
+                    ppmErr >> 16, ppmErr);
+            TimeSync_PLLUpdate(adjustment);
+            TimeSync_PLLSetFrequency(ppmErr);
+            data->slewState = TimeSyncPLL;
+         } else {
+            /* PPM error is too large to try the PLL. */
+            g_debug("PPM error too large: %"FMT64"d (%"FMT64"d) "
+                    "not activating PLL\n", ppmErr >> 16, ppmErr);
+            data->slewState = TimeSyncUncalibrated;
+         }
+      } else {
+         g_debug("Calibrating error: adjustment %"FMT64"d\n", adjustment);
+         if (!TimeSync_Slew(slewDiff, timeSyncPeriodUS, &remaining)) {
+            return FALSE;
+         }
+         calibrationAdjustment += slewDiff;
+         calibrationAdjustment -= remaining;
+      }
+   } else {
+      ASSERT(data->slewState == TimeSyncPLL);
+      g_debug("Updating PLL: adjustment %"FMT64"d\n", adjustment);
+      if (!TimeSync_PLLUpdate(adjustment)) {
+         TimeSyncResetSlew(data);
+      }
+   }
+   return TRUE;
+}
+
+
+/**
+ * Slew the guest OS time with the filtered discipline.
+ *
+ * A PI controller drives the frequency of the guest clock: the integral
+ * term is the frequency error, estimated from the error left after each
+ * period, and the proportional term corrects TIMESYNC_PI_PROPORTIONAL
+ * percent of the current error over the next period.  Where the platform
+ * has a PLL the correction is applied as a frequency, which it can set
+ * finely, rather than through the slew, which changes the tick length in
+ * steps of 100ppm on Linux.
+ *
+ * Errors too large to correct at TIMESYNC_MAX_PPM are slewed as in the
+ * default discipline, without touching the frequency estimate.
+ *
+ * @param[in]  data              Structure tracking time sync state.
+ * @param[in]  adjustment        Amount to correct the guest time.
+ */
+
+static gboolean
+TimeSyncFilteredSlewTime(TimeSyncData *data, int64 adjustment)
+{
+   int64 now;
+   int64 interval;
+   int64 frequency;
+   int64 remaining;
+   int64 slewDiff = 0;
+   int64 maxFrequency = (int64)TIMESYNC_MAX_PPM << 16;
+   int64 timeSyncPeriodUS = data->timeSyncPeriod * US_PER_SEC;
+   gboolean coarse = adjustment > TIMESYNC_PLL_UNSYNC ||
+                     adjustment < -TIMESYNC_PLL_UNSYNC;
+
+   if (!TimeSync_GetCurrentTime(&now)) {
+      return FALSE;
+   }
+
+   interval = now - data->piLastUpdate;
+   if (data->piLastUpdate == 0 || interval <= 0) {
+      interval = timeSyncPeriodUS;
+   }
+   data->piLastUpdate = now;
+
+   if (coarse) {
+      g_debug("Filtered: slewing adjustment %"FMT64"d\n", adjustment);
+      slewDiff = (adjustment * data->slewPercentCorrection) / 100;
+      frequency = data->piFrequency;
+   } else {
+      /* Integral: the error left after the period is a frequency error. */
+      data->piFrequency += ((adjustment * US_PER_SEC * 65536) / interval) *
+                           TIMESYNC_PI_INTEGRAL / 100;
+      data->piFrequency = MAX(MIN(data->piFrequency, maxFrequency),
+                              -maxFrequency);
+
+      /* Proportional: correct part of the error over the next period. */
+      frequency = data->piFrequency +
+                  ((adjustment * US_PER_SEC * 65536) / timeSyncPeriodUS) *
+                  TIMESYNC_PI_PROPORTIONAL / 100;
+      frequency = MAX(MIN(frequency, maxFrequency), -maxFrequency);
+
+      g_debug("Filtered: adjustment %"FMT64"d frequency %"FMT64"d "
+              "(%"FMT64"d) ppm\n", adjustment, frequency / 65536,
+              data->piFrequency / 65536);
+   }
+
+   if (TimeSync_PLLSupported()) {
+      /* Only slew to correct a large error, or to stop doing so. */
+      if ((coarse || data->piCoarse) &&
+          !TimeSync_Slew(slewDiff, timeSyncPeriodUS, &remaining)) {
+         return FALSE;
+      }
+      data->piCoarse = coarse;
+      return TimeSync_PLLSetFrequency(frequency);
+   }
+
+   /* No frequency control: slew what the frequency would correct. */
+   slewDiff += frequency * timeSyncPeriodUS / US_PER_SEC / 65536;
+   data->piCoarse = coarse;
+   return TimeSync_Slew(slewDiff, timeSyncPeriodUS, &remaining);
+}
+
+
+/**
+ * Reset the slew to nominal.
+ *
+ * @param[in]  data              Structure tracking time sync state.
+ */
+
+void
+TimeSyncResetSlew(TimeSyncData *data)
+{
+   int64 remaining;
+   int64 timeSyncPeriodUS = data->timeSyncPeriod * US_PER_SEC;
+   data->slewState = TimeSyncUncalibrated;
+   data->piLastUpdate = 0;
+   data->piCoarse = FALSE;
+   TimeSync_Slew(0, timeSyncPeriodUS, &remaining);
+   if (TimeSync_PLLSupported()) {
+      TimeSync_PLLUpdate(0);
+      TimeSync_PLLSetFrequency(0);
+   }
+}
+
+
+/**
+ * Update whether slewing is used for time correction.
+ *
+ * @param[in]  data              Structure tracking time sync state.
+ * @param[in]  active            Is slewing active.
+ */
+
+void
+TimeSyncSetSlewState(TimeSyncData *data, gboolean active)
+{
+   if (active != data->slewActive) {
+      g_debug(active ? "Starting slew.\n" : "Stopping slew.\n");
+      if (!active) {
+         TimeSyncResetSlew(data);
+      }
+      data->slewActive = active;
+   }
+}
+
+
+/**
+ * Set the guest OS time to the host OS time.
+ *
+ * @param[in]  slewCorrection    Is clock slewing enabled?
+ * @param[in]  syncOnce          Is this function called in a loop?
+ * @param[in]  allowBackwardSync Can we sync time backwards when doing syncOnce?
+ * @param[in]  _data             Time sync data.
+ *
+ * @return TRUE on success.
+ */
+
+gboolean
+TimeSyncDoSync(Bool slewCorrection,
+               Bool syncOnce,
+               Bool allowBackwardSync,
+               void *_data)
+{
+   int64 guest, host;
+   int64 gosError, apparentError, maxTimeError;
+   Bool apparentErrorValid;
+   TimeSyncData *data = _data;
+
+   g_debug("Synchronizing time: "
+           "syncOnce %d, slewCorrection %d, allowBackwardSync %d.\n",
+           syncOnce, slewCorrection, allowBackwardSync);
+
+   if (data->discipline == TIMESYNC_DISCIPLINE_FILTERED) {
+      if (!TimeSyncReadHostAndGuestFiltered(&host, &guest, &apparentError,
+                                            &apparentErrorValid,
+                                            &maxTimeError)) {
+         return FALSE;
+      }
+   } else if (!TimeSyncReadHostAndGuest(&host, &guest, &apparentError, 
+                                        &apparentErrorValid, &maxTimeError)) {
+      return FALSE;
+   }
+
+   gosError = guest - host - apparentError;
+
+   if (syncOnce) {
+
+      /*
+       * Non-loop behavior:
+       *
+       * Perform a step correction if:
+       * 1) The guest OS error is behind by more than maxTimeError.
+       * 2) The guest OS is ahead of the host OS.
+       */
+
+      if (gosError < -maxTimeError || 
+          (gosError + apparentError > 0 && allowBackwardSync)) {
+         g_debug("One time synchronization: stepping time.\n");
+         if (!TimeSyncStepTime(data, -gosError + -apparentError)) {
+            return FALSE;
+         }
+      } else {
+         g_debug("One time synchronization: correction not needed.\n");
+      }
+   } else {
+
+      /*
+       * Loop behavior:
+       *
+       * If guest error is more than maxTimeError behind perform a step
+       * correction.  Otherwise, if we can distinguish guest error from
+       * apparent time error perform a slew correction .
+       */
+
+      TimeSyncSetSlewState(data, apparentErrorValid && slewCorrection);
+
+      if (gosError < -maxTimeError) {
+         g_debug("Periodic synchronization: stepping time.\n");
+         if (!TimeSyncStepTime(data, -gosError + -apparentError)) {
+            return FALSE;
+         }
+      } else if (slewCorrection && apparentErrorValid) {
+         g_debug("Periodic synchronization: slewing time.\n");
+         if (data->discipline == TIMESYNC_DISCIPLINE_FILTERED) {
+            if (!TimeSyncFilteredSlewTime(data, -gosError)) {
+               return FALSE;
+            }
+         } else if (!TimeSyncSlewTime(data, -gosError)) {
+            return FALSE;
+         }
+      }
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Select the discipline used by the periodic sync to correct small errors.
+ * Switching discipline resets the slew and forgets the frequency error the
+ * filtered discipline has estimated.
+ *
+ * @param[in]  data              Structure tracking time sync state.
+ * @param[in]  discipline        Discipline to use.
+ */
+
+void
+TimeSyncSetDiscipline(TimeSyncData *data,
+                      TimeSyncDiscipline discipline)
+{
+   if (discipline == data->discipline) {
+      return;
+   }
+
+   g_debug("Switching to the %s discipline.\n",
+           discipline == TIMESYNC_DISCIPLINE_FILTERED ? "filtered" : "slew");
+   if (data->slewActive) {
+      TimeSyncResetSlew(data);
+   }
+   data->discipline = discipline;
+   data->piFrequency = 0;
+   data->piLastUpdate = 0;
+   data->piCoarse = FALSE;
+}
@@ -386,6 +386,11 @@ FoundryToolsDaemon_Initialize(ToolsAppCtx *ctx)
                               VIX_BACKDOORCOMMAND_SEND_HGFS_PACKET,
                               NULL,    // rpc - no rpc registered
                               NULL);   // rpc callback
+   gFoundryHgfsBkdrConn.notify =
+      VMTools_ConfigGetBoolean(ctx->config,
+                               CONFGROUPNAME_HGFSSERVER,
+                               CONFNAME_HGFSSERVER_NOTIFY,
+                               CONFVAL_HGFSSERVER_NOTIFY_DEFAULT);
    HgfsServerManager_Register(&gFoundryHgfsBkdrConn);
 
 }
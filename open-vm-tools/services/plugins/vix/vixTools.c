@@ -306,10 +306,10 @@ typedef struct VixToolsStartProgramState {
  * Tracks processes started via StartProgram, so their exit information can
  * be returned with ListProcessesEx()
  *
- * We need live and dead because the exit status is fetched by from
- * a timer loop, and StartProgram of a very short lived program
+ * We need live and dead because the exit status is fetched from
+ * the event loop, and StartProgram of a very short lived program
  * followed immediately by a ListProcesses could miss the program
- * if we don't save it off for before the timer fires.
+ * if we don't save it off before the exit is noticed.
  *
  * This data is also useful to optimize ListProcessesEx.
  *
@@ -346,6 +346,18 @@ static VixToolsStartedProgramState *startedProcessList = NULL;
  */
 static GHashTable *listProcessesResultsTable = NULL;
 
+/*
+ * The last full process listing.  The next listing reuses the command
+ * lines of processes that are still running rather than reading them
+ * again.  It is only reused for the same user, since what can be read
+ * about other users' processes depends on who is asking.
+ */
+static ProcMgrProcInfoArray *gProcListSnapshot = NULL;
+#ifndef _WIN32
+static uid_t gProcListSnapshotEUid;
+static uid_t gProcListEUid;
+#endif
+
 /*
  * How long to keep around cached results in case the Vix side dies.
  *
@@ -372,6 +384,30 @@ static uint32 listProcessesResultsKey = 1;
 
 static void VixToolsFreeCachedResult(gpointer p);
 
+#ifndef _WIN32
+/*
+ * Directory snapshots that ListFiles pages through, so that fetching
+ * the next page of a large directory doesn't list and stat the whole
+ * directory again.  A cursor is only reused by the same user for the
+ * same directory and pattern, and only while the directory is unchanged.
+ * A request for index 0 always starts a new one.
+ */
+#define  SECONDS_UNTIL_LISTFILES_CURSOR_EXPIRES   60
+#define  MAX_LISTFILES_CURSORS                     8
+
+typedef struct VixToolsListFilesCursor {
+   VixToolsDirCursor *dirCursor;
+   char *dirPathName;
+   char *pattern;
+   uid_t euid;
+   VmTimeType lastUsedMS;
+} VixToolsListFilesCursor;
+
+static GList *listFilesCursors = NULL;
+
+static void VixToolsFreeListFilesCursor(gpointer p, gpointer unused);
+#endif
+
 /*
  * This structure is designed to implemente CreateTemporaryFile,
  * CreateTemporaryDirectory VI guest operations.
@@ -423,12 +459,18 @@ static HashTable *userEnvironmentTable = NULL;
 static HgfsServerMgrData gVixHgfsBkdrConn;
 
 #define SECONDS_BETWEEN_INVALIDATING_HGFS_SESSIONS    120
+/* The invalidator isn't urgent; let it share wakeups with other timers. */
+#define HGFS_SESSION_INVALIDATOR_SLACK_MS             5000
 
 static VixError VixToolsGetFileInfo(VixCommandRequestHeader *requestMsg,
                                     char **result);
 
 static VixError VixToolsSetFileAttributes(VixCommandRequestHeader *requestMsg);
 
+static void VixToolsWatchAsyncProc(ProcMgr_AsyncProc *procState,
+                                   GMainLoop *eventQueue,
+                                   GSourceFunc callback,
+                                   void *clientData);
 static gboolean VixToolsMonitorAsyncProc(void *clientData);
 static gboolean VixToolsMonitorStartProgram(void *clientData);
 static void VixToolsRegisterHgfsSessionInvalidator(void *clientData);
@@ -744,6 +786,11 @@ VixTools_Initialize(Bool thisProcessRunsAsRootParam,
                               VIX_BACKDOORCOMMAND_COMMAND,
                               NULL,    // no RPC registration
                               NULL);   // rpc callback
+   gVixHgfsBkdrConn.notify =
+      VMTools_ConfigGetBoolean(((ToolsAppCtx *) clientData)->config,
+                               CONFGROUPNAME_HGFSSERVER,
+                               CONFNAME_HGFSSERVER_NOTIFY,
+                               CONFVAL_HGFSSERVER_NOTIFY_DEFAULT);
    HgfsServerManager_Register(&gVixHgfsBkdrConn);
 
    listProcessesResultsTable = g_hash_table_new_full(g_int_hash, g_int_equal,
@@ -800,6 +847,15 @@ VixTools_Uninitialize(void) // IN
    }
 
    HgfsServerManager_Unregister(&gVixHgfsBkdrConn);
+
+   ProcMgr_FreeProcList(gProcListSnapshot);
+   gProcListSnapshot = NULL;
+
+#ifndef _WIN32
+   g_list_foreach(listFilesCursors, VixToolsFreeListFilesCursor, NULL);
+   g_list_free(listFilesCursors);
+   listFilesCursors = NULL;
+#endif
 }
 
 
@@ -1416,7 +1472,6 @@ VixToolsRunProgramImpl(char *requestName,      // IN
    STARTUPINFO si;
    wchar_t *envBlock = NULL;
 #endif
-   GSource *timer;
 
    if (NULL != pid) {
       *pid = (int64) -1;
@@ -1549,13 +1604,11 @@ VixToolsRunProgramImpl(char *requestName,      // IN
    }
 
    /*
-    * Start a periodic procedure to check the app periodically
+    * Watch for the app to exit.
     */
    asyncState->eventQueue = eventQueue;
-   timer = g_timeout_source_new(SECONDS_BETWEEN_POLL_TEST_FINISHED * 1000);
-   g_source_set_callback(timer, VixToolsMonitorAsyncProc, asyncState, NULL);
-   g_source_attach(timer, g_main_loop_get_context(eventQueue));
-   g_source_unref(timer);
+   VixToolsWatchAsyncProc(asyncState->procState, eventQueue,
+                          VixToolsMonitorAsyncProc, asyncState);
 
    /*
     * VixToolsMonitorAsyncProc will clean asyncState up when the program finishes.
@@ -1624,7 +1677,6 @@ VixToolsStartProgramImpl(const char *requestName,            // IN
    wchar_t *envBlock = NULL;
    Bool envBlockFromMalloc = TRUE;
 #endif
-   GSource *timer;
 
    /*
     * Initialize this here so we can call free on its member variables in abort
@@ -1805,13 +1857,11 @@ VixToolsStartProgramImpl(const char *requestName,            // IN
            __FUNCTION__, fullCommandLine, *pid);
 
    /*
-    * Start a periodic procedure to check the app periodically
+    * Watch for the app to exit.
     */
    asyncState->eventQueue = eventQueue;
-   timer = g_timeout_source_new(SECONDS_BETWEEN_POLL_TEST_FINISHED * 1000);
-   g_source_set_callback(timer, VixToolsMonitorStartProgram, asyncState, NULL);
-   g_source_attach(timer, g_main_loop_get_context(eventQueue));
-   g_source_unref(timer);
+   VixToolsWatchAsyncProc(asyncState->procState, eventQueue,
+                          VixToolsMonitorStartProgram, asyncState);
 
    /*
     * VixToolsMonitorStartProgram will clean asyncState up when the program
@@ -1840,14 +1890,47 @@ abort:
 } // VixToolsStartProgramImpl
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsWatchAsyncProc --
+ *
+ *    Arranges for 'callback' to be called from the event queue as soon as
+ *    an async program exits, by polling the program's selectable rather
+ *    than checking on it from a timer.
+ *
+ * Return value:
+ *    None.
+ *
+ * Side effects:
+ *    Attaches a source to the event queue's context.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VixToolsWatchAsyncProc(ProcMgr_AsyncProc *procState,  // IN
+                       GMainLoop *eventQueue,          // IN
+                       GSourceFunc callback,           // IN
+                       void *clientData)               // IN
+{
+   GSource *src;
+
+   src = VMTools_NewProcExitSource(procState);
+   g_source_set_callback(src, callback, clientData, NULL);
+   g_source_attach(src, g_main_loop_get_context(eventQueue));
+   g_source_unref(src);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
  * VixToolsMonitorAsyncProc --
  *
- *    This polls a program running in the guest to see if it has completed.
- *    It is used by the test/dev code to detect when a test application
- *    completes.
+ *    Called when a program running in the guest has exited (see
+ *    VixToolsWatchAsyncProc). It is used by the test/dev code to detect
+ *    when a test application completes.
  *
  * Return value:
  *    TRUE on non-glib implementation.
@@ -1882,22 +1965,25 @@ VixToolsMonitorAsyncProc(void *clientData) // IN
     * that freeze the filesystem.
     */
    procIsRunning = ProcMgr_IsAsyncProcRunning(asyncState->procState);
-   if (!procIsRunning) {
-      if (gRestrictCommands) {
-         g_debug("%s: Deferring RunScript cleanup due to IO freeze\n",
-                 __FUNCTION__);
-      } else {
-         goto cleanup;
-      }
+   if (procIsRunning) {
+      VixToolsWatchAsyncProc(asyncState->procState, asyncState->eventQueue,
+                             VixToolsMonitorAsyncProc, asyncState);
+      return FALSE;
    }
 
-   timer = g_timeout_source_new(SECONDS_BETWEEN_POLL_TEST_FINISHED * 1000);
-   g_source_set_callback(timer, VixToolsMonitorAsyncProc, asyncState, NULL);
-   g_source_attach(timer, g_main_loop_get_context(asyncState->eventQueue));
-   g_source_unref(timer);
-   return FALSE;
+   if (gRestrictCommands) {
+      g_debug("%s: Deferring RunScript cleanup due to IO freeze\n",
+              __FUNCTION__);
 
-cleanup:
+      /*
+       * The exit is already signaled, so poll until the freeze is over.
+       */
+      timer = g_timeout_source_new(SECONDS_BETWEEN_POLL_TEST_FINISHED * 1000);
+      g_source_set_callback(timer, VixToolsMonitorAsyncProc, asyncState, NULL);
+      g_source_attach(timer, g_main_loop_get_context(asyncState->eventQueue));
+      g_source_unref(timer);
+      return FALSE;
+   }
 
    /*
     * We need to always check the exit code, even if there is no need to
@@ -2004,7 +2090,9 @@ VixToolsRegisterHgfsSessionInvalidator(void *clientData)    // IN:
    }
 
    gHgfsSessionInvalidatorTimer =
-         g_timeout_source_new(SECONDS_BETWEEN_INVALIDATING_HGFS_SESSIONS * 1000);
+         VMTools_CreateCoalescedTimer(
+            SECONDS_BETWEEN_INVALIDATING_HGFS_SESSIONS * 1000,
+            HGFS_SESSION_INVALIDATOR_SLACK_MS);
 
    g_source_set_callback(gHgfsSessionInvalidatorTimer,
                          VixToolsInvalidateInactiveHGFSSessions,
@@ -2024,9 +2112,9 @@ VixToolsRegisterHgfsSessionInvalidator(void *clientData)    // IN:
  *
  * VixToolsMonitorStartProgram --
  *
- *    This polls a program started by StartProgram to see if it has completed.
- *    If it has, saves off its exitCode and endTime so they can be queried
- *    via ListProcessesEx.
+ *    Called when a program started by StartProgram has exited (see
+ *    VixToolsWatchAsyncProc). Saves off its exitCode and endTime so they
+ *    can be queried via ListProcessesEx.
  *
  * Return value:
  *    TRUE on non-glib implementation.
@@ -2047,7 +2135,6 @@ VixToolsMonitorStartProgram(void *clientData) // IN
    ProcMgr_Pid pid = -1;
    int result = -1;
    VixToolsStartedProgramState *spState;
-   GSource *timer;
 
    asyncState = (VixToolsStartProgramState *) clientData;
    ASSERT(asyncState);
@@ -2056,18 +2143,12 @@ VixToolsMonitorStartProgram(void *clientData) // IN
     * Check if the program has completed.
     */
    procIsRunning = ProcMgr_IsAsyncProcRunning(asyncState->procState);
-   if (!procIsRunning) {
-      goto done;
+   if (procIsRunning) {
+      VixToolsWatchAsyncProc(asyncState->procState, asyncState->eventQueue,
+                             VixToolsMonitorStartProgram, asyncState);
+      return FALSE;
    }
 
-   timer = g_timeout_source_new(SECONDS_BETWEEN_POLL_TEST_FINISHED * 1000);
-   g_source_set_callback(timer, VixToolsMonitorStartProgram, asyncState, NULL);
-   g_source_attach(timer, g_main_loop_get_context(asyncState->eventQueue));
-   g_source_unref(timer);
-   return FALSE;
-
-done:
-
    result = ProcMgr_GetExitCode(asyncState->procState, &exitCode);
    pid = ProcMgr_GetPid(asyncState->procState);
    if (0 != result) {
@@ -4940,6 +5021,77 @@ abort:
 } // VixToolsInitiateFileTransferToGuest
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsListAllProcesses --
+ *
+ *    Lists all processes, starting from the last snapshot if it was taken
+ *    by the same user.  The list must be handed back with
+ *    VixToolsReleaseProcessList().
+ *
+ * Return value:
+ *    The process list, NULL on failure.
+ *
+ * Side effects:
+ *    Consumes the snapshot.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static ProcMgrProcInfoArray *
+VixToolsListAllProcesses(void)
+{
+   ProcMgrProcInfoArray *prevList = gProcListSnapshot;
+
+   gProcListSnapshot = NULL;
+#ifdef _WIN32
+   ProcMgr_FreeProcList(prevList);
+   prevList = NULL;
+#else
+   gProcListEUid = Id_GetEUid();
+   if (NULL != prevList && gProcListSnapshotEUid != gProcListEUid) {
+      ProcMgr_FreeProcList(prevList);
+      prevList = NULL;
+   }
+#endif
+
+   return ProcMgr_ListProcessesIncremental(prevList);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsReleaseProcessList --
+ *
+ *    Keeps a list from VixToolsListAllProcesses() as the snapshot for the
+ *    next listing.
+ *
+ * Return value:
+ *    None
+ *
+ * Side effects:
+ *    Frees any older snapshot.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VixToolsReleaseProcessList(ProcMgrProcInfoArray *procList)   // IN
+{
+   if (NULL == procList) {
+      return;
+   }
+
+   ProcMgr_FreeProcList(gProcListSnapshot);
+   gProcListSnapshot = procList;
+#ifndef _WIN32
+   gProcListSnapshotEUid = gProcListEUid;
+#endif
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -4996,7 +5148,7 @@ VixToolsListProcesses(VixCommandRequestHeader *requestMsg, // IN
    escapeStrs = (requestMsg->requestFlags &
                  VIX_REQUESTMSG_ESCAPE_XML_DATA) != 0;
 
-   procList = ProcMgr_ListProcesses();
+   procList = VixToolsListAllProcesses();
    if (NULL == procList) {
       err = FoundryToolsDaemon_TranslateSystemErr();
       goto abort;
@@ -5106,7 +5258,7 @@ abort:
       VixToolsUnimpersonateUser(userToken);
    }
    VixToolsLogoutUser(userToken);
-   ProcMgr_FreeProcList(procList);
+   VixToolsReleaseProcessList(procList);
    free(cmdNamePtr);
    free(procBufPtr);
    free(escapedName);
@@ -5213,9 +5365,9 @@ VixToolsListProcessesExGenerateData(uint32 numPids,          // IN
    VixToolsStartedProgramState *spList;
    int numReported = 0;
    int i;
-   int j;
    Bool bRet;
    size_t procCount;
+   Bool isSnapshot = FALSE;
 
    DynBuf_Init(&dynBuffer);
 
@@ -5276,14 +5428,27 @@ VixToolsListProcessesExGenerateData(uint32 numPids,          // IN
 
    /*
     * The startedProcess list didn't give everything we need, so
-    * ask the OS.
+    * ask the OS.  If specific pids were asked for, only look those up.
     *
-    * XXX Need a smarter version of ProcMgr_ListProcesses().
-    * It should allow a list of pids for optimization, and
-    * return an error code so there's no risk of errno/LastError
-    * being clobbered.
+    * XXX ProcMgr should return an error code so there's no risk of
+    * errno/LastError being clobbered.
     */
-   procList = ProcMgr_ListProcesses();
+   if (numPids > 0) {
+      ProcMgr_Pid *osPids = Util_SafeCalloc(numPids, sizeof *osPids);
+      size_t numOsPids = 0;
+
+      for (i = 0; i < numPids; i++) {
+         // ignore it if its on the started list -- we added it above
+         if (!VixToolsFindStartedProgramState(pids[i])) {
+            osPids[numOsPids++] = (ProcMgr_Pid) pids[i];
+         }
+      }
+      procList = ProcMgr_ListProcessesForPids(numOsPids, osPids);
+      free(osPids);
+   } else {
+      procList = VixToolsListAllProcesses();
+      isSnapshot = TRUE;
+   }
    if (NULL == procList) {
       err = FoundryToolsDaemon_TranslateSystemErr();
       goto abort;
@@ -5298,26 +5463,22 @@ VixToolsListProcessesExGenerateData(uint32 numPids,          // IN
     */
    procCount = ProcMgrProcInfoArray_Count(procList);
    if (numPids > 0) {
-      for (i = 0; i < numPids; i++) {
-         // ignore it if its on the started list -- we added it above
-         if (VixToolsFindStartedProgramState(pids[i])) {
-            continue;
-         }
-         for (j = 0; j < procCount; j++) {
-            procInfo = ProcMgrProcInfoArray_AddressOf(procList, j);
-            if (pids[i] == procInfo->procId) {
-               err = VixToolsPrintProcInfoEx(&dynBuffer,
-                                             procInfo->procCmdName,
-                                             procInfo->procCmdLine,
-                                             procInfo->procId,
-                                             (NULL == procInfo->procOwner)
-                                             ? "" : procInfo->procOwner,
-                                             (int) procInfo->procStartTime,
-                                             0, 0);
-               if (VIX_OK != err) {
-                  goto abort;
-               }
-            }
+      /*
+       * The list is in the order the pids were asked for, less any that
+       * have gone away.
+       */
+      for (i = 0; i < procCount; i++) {
+         procInfo = ProcMgrProcInfoArray_AddressOf(procList, i);
+         err = VixToolsPrintProcInfoEx(&dynBuffer,
+                                       procInfo->procCmdName,
+                                       procInfo->procCmdLine,
+                                       procInfo->procId,
+                                       (NULL == procInfo->procOwner)
+                                       ? "" : procInfo->procOwner,
+                                       (int) procInfo->procStartTime,
+                                       0, 0);
+         if (VIX_OK != err) {
+            goto abort;
          }
       }
    } else {
@@ -5356,7 +5517,11 @@ done:
 
 abort:
    DynBuf_Destroy(&dynBuffer);
-   ProcMgr_FreeProcList(procList);
+   if (isSnapshot) {
+      VixToolsReleaseProcessList(procList);
+   } else {
+      ProcMgr_FreeProcList(procList);
+   }
    return err;
 }
 
@@ -6210,6 +6375,220 @@ abort:
 } // VixToolsListDirectory
 
 
+#ifndef _WIN32
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsFreeListFilesCursor --
+ *
+ *    Frees a ListFiles cursor.  Usable with g_list_foreach().
+ *
+ * Return value:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VixToolsFreeListFilesCursor(gpointer ptr,          // IN
+                            gpointer unused)       // IN
+{
+   VixToolsListFilesCursor *p = (VixToolsListFilesCursor *) ptr;
+
+   if (NULL != p) {
+      VixToolsDestroyDirCursor(p->dirCursor);
+      free(p->dirPathName);
+      free(p->pattern);
+      free(p);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsGetListFilesCursor --
+ *
+ *    Finds the cursor for paging through a directory listing, creating it
+ *    if this is the first page or the old one can't be used.
+ *
+ * Return value:
+ *    The directory cursor, owned by the cursor list.  NULL with errno
+ *    set if the directory can't be read.
+ *
+ * Side effects:
+ *    Drops expired cursors, and the least recently used one if there
+ *    are too many.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static VixToolsDirCursor *
+VixToolsGetListFilesCursor(const char *dirPathName,   // IN
+                           const char *pattern,       // IN/OPT
+                           GRegex *regex,             // IN/OPT
+                           uint64 index)              // IN
+{
+   VmTimeType now = Hostinfo_SystemTimerMS();
+   uid_t euid = Id_GetEUid();
+   VixToolsListFilesCursor *cursor = NULL;
+   GList *l;
+   GList *next;
+
+   if (NULL == pattern) {
+      pattern = "";
+   }
+
+   for (l = listFilesCursors; NULL != l; l = next) {
+      VixToolsListFilesCursor *c = l->data;
+
+      next = l->next;
+      if (now - c->lastUsedMS > SECONDS_UNTIL_LISTFILES_CURSOR_EXPIRES * 1000) {
+         g_debug("%s: listing of '%s' expired\n", __FUNCTION__,
+                 c->dirPathName);
+         VixToolsFreeListFilesCursor(c, NULL);
+         listFilesCursors = g_list_delete_link(listFilesCursors, l);
+      } else if (NULL == cursor && c->euid == euid &&
+                 0 == strcmp(c->dirPathName, dirPathName) &&
+                 0 == strcmp(c->pattern, pattern)) {
+         cursor = c;
+         listFilesCursors = g_list_delete_link(listFilesCursors, l);
+      }
+   }
+
+   if (NULL != cursor &&
+       (0 == index ||
+        !VixToolsDirCursorIsCurrent(cursor->dirCursor, dirPathName))) {
+      VixToolsFreeListFilesCursor(cursor, NULL);
+      cursor = NULL;
+   }
+
+   if (NULL == cursor) {
+      VixToolsDirCursor *dirCursor = VixToolsNewDirCursor(dirPathName, regex);
+
+      if (NULL == dirCursor) {
+         return NULL;
+      }
+      cursor = Util_SafeMalloc(sizeof *cursor);
+      cursor->dirCursor = dirCursor;
+      cursor->dirPathName = Util_SafeStrdup(dirPathName);
+      cursor->pattern = Util_SafeStrdup(pattern);
+      cursor->euid = euid;
+   }
+
+   cursor->lastUsedMS = now;
+   listFilesCursors = g_list_prepend(listFilesCursors, cursor);
+
+   if (g_list_length(listFilesCursors) > MAX_LISTFILES_CURSORS) {
+      l = g_list_last(listFilesCursors);
+      VixToolsFreeListFilesCursor(l->data, NULL);
+      listFilesCursors = g_list_delete_link(listFilesCursors, l);
+   }
+
+   return cursor->dirCursor;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsListFilesPage --
+ *
+ *    Generates a ListFiles result from a directory cursor: up to
+ *    'maxResults' entries starting at 'index', as many as fit in
+ *    'maxBufferSize'.  Only the entries returned are stat'ed.
+ *
+ * Return value:
+ *    The result, in the format VixToolsListFiles() returns.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static char *
+VixToolsListFilesPage(const VixToolsDirCursor *dirCursor,   // IN
+                      uint64 index,                         // IN
+                      int maxResults,                       // IN
+                      size_t maxBufferSize)                 // IN
+{
+   uint32 numMatches = VixToolsDirCursorNumMatches(dirCursor);
+   uint32 match = VixToolsDirCursorSeek(dirCursor, index);
+   size_t headerSize;
+   int count = 0;
+   int remaining = 0;
+   Bool truncated = FALSE;
+   DynBuf entries;
+   DynBuf result;
+
+   headerSize = 3; // truncation bool + space + '\0'
+   // space for the 'remaining' tag up front
+   headerSize += strlen(listFilesRemainingFormatString) + 10;
+   ASSERT_NOT_IMPLEMENTED(headerSize < maxBufferSize);
+
+   DynBuf_Init(&entries);
+   for (; match < numMatches && count < maxResults; match++) {
+      size_t lastGoodSize = DynBuf_GetSize(&entries);
+      char *fileName = VixToolsDirCursorGetName(dirCursor, match);
+      char *escapedFileName;
+      char *escapedTarget;
+      VixToolsFileInfo info;
+
+      VixToolsDirCursorGetInfo(dirCursor, match, &info);
+      escapedFileName = VixToolsEscapeXMLString(fileName);
+      escapedTarget = VixToolsEscapeXMLString((NULL == info.symlinkTarget)
+                                              ? "" : info.symlinkTarget);
+      ASSERT_MEM_ALLOC(NULL != escapedFileName && NULL != escapedTarget);
+
+      StrUtil_SafeDynBufPrintf(&entries,
+                               fileExtendedInfoLinuxFormatString,
+                               escapedFileName,
+                               info.fileProperties,
+                               info.fileSize,
+                               info.modTime,
+                               info.accessTime,
+                               info.ownerId,
+                               info.groupId,
+                               info.permissions,
+                               escapedTarget);
+      free(escapedTarget);
+      free(escapedFileName);
+      free(info.symlinkTarget);
+      free(fileName);
+
+      if (headerSize + DynBuf_GetSize(&entries) >= maxBufferSize) {
+         DynBuf_SetSize(&entries, lastGoodSize);
+         truncated = TRUE;
+         break;
+      }
+      count++;
+   }
+   if (!truncated) {
+      remaining = numMatches - match;
+   }
+
+   g_debug("%s: returning %d entries from index %"FMT64"u, "
+           "%d remaining%s\n", __FUNCTION__, count, index, remaining,
+           truncated ? " (truncated)" : "");
+
+   DynBuf_Init(&result);
+   StrUtil_SafeDynBufPrintf(&result, "%c ", truncated ? '1' : '0');
+   StrUtil_SafeDynBufPrintf(&result, listFilesRemainingFormatString,
+                            remaining);
+   DynBuf_SafeAppend(&result, DynBuf_Get(&entries),
+                     DynBuf_GetSize(&entries));
+   DynBuf_SafeAppend(&result, "", 1);
+   DynBuf_Destroy(&entries);
+
+   return DynBuf_Detach(&result);
+}
+#endif
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -6291,7 +6670,7 @@ VixToolsListFiles(VixCommandRequestHeader *requestMsg,    // IN
               __FUNCTION__, listRequest->patternLength, pattern);
    }
 
-   if (0 == *dirPathName) {
+   if (0 == *dirPathName || index < 0) {
       err = VIX_E_INVALID_ARG;
       goto abort;
    }
@@ -6323,6 +6702,19 @@ VixToolsListFiles(VixCommandRequestHeader *requestMsg,    // IN
     * if its a symlink to a directory.
     */
    if (!File_IsSymLink(dirPathName) && File_IsDirectory(dirPathName)) {
+#ifndef _WIN32
+      VixToolsDirCursor *dirCursor;
+
+      dirCursor = VixToolsGetListFilesCursor(dirPathName, pattern, regex,
+                                             offset + index);
+      if (NULL == dirCursor) {
+         err = FoundryToolsDaemon_TranslateSystemErr();
+         goto abort;
+      }
+      fileList = VixToolsListFilesPage(dirCursor, offset + index,
+                                       maxResults, maxBufferSize);
+      goto abort;
+#else
       numFiles = File_ListDirectory(dirPathName, &fileNameList);
       if (numFiles < 0) {
          err = FoundryToolsDaemon_TranslateSystemErr();
@@ -6344,6 +6736,7 @@ VixToolsListFiles(VixCommandRequestHeader *requestMsg,    // IN
          free(fileNameList);
          fileNameList = newFileNameList;
       }
+#endif
    } else {
       if (File_Exists(dirPathName)) {
          listingSingleFile = TRUE;
@@ -6404,6 +6797,8 @@ VixToolsListFiles(VixCommandRequestHeader *requestMsg,    // IN
       if (resultBufferSize < maxBufferSize) {
          lastGoodResultBufferSize = resultBufferSize;
       } else {
+         // this one doesn't fit, so it's not part of the results
+         count--;
          truncated = TRUE;
          break;
       }
@@ -6480,6 +6875,11 @@ abort:
       free(fileNameList);
    }
 
+   if (NULL != regex) {
+      g_regex_unref(regex);
+   }
+   g_clear_error(&gerr);
+
    // XXX result too large for g_debug()
 
    g_message("%s: opcode %d returning %"FMT64"d\n", __FUNCTION__,
@@ -7215,7 +7615,6 @@ VixToolsRunScript(VixCommandRequestHeader *requestMsg,  // IN
    Bool forcedRoot = FALSE;
    wchar_t *envBlock = NULL;
 #endif
-   GSource *timer;
    VMAutomationRequestParser parser;
 
    err = VMAutomationRequestParserInit(&parser,
@@ -7478,10 +7877,8 @@ VixToolsRunScript(VixCommandRequestHeader *requestMsg,  // IN
    pid = (int64) ProcMgr_GetPid(asyncState->procState);
 
    asyncState->eventQueue = eventQueue;
-   timer = g_timeout_source_new(SECONDS_BETWEEN_POLL_TEST_FINISHED * 1000);
-   g_source_set_callback(timer, VixToolsMonitorAsyncProc, asyncState, NULL);
-   g_source_attach(timer, g_main_loop_get_context(eventQueue));
-   g_source_unref(timer);
+   VixToolsWatchAsyncProc(asyncState->procState, eventQueue,
+                          VixToolsMonitorAsyncProc, asyncState);
 
    /*
     * VixToolsMonitorAsyncProc will clean asyncState up when the program finishes.
@@ -0,0 +1,651 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * vixToolsDirCursor.c --
+ *
+ *      A snapshot of the entries of a directory that ListFiles can page
+ *      through.  The names are read once (with getdents64() on Linux) and
+ *      filtered with the request's pattern up front; an entry is only
+ *      stat'ed, relative to the open directory, when a page containing it
+ *      is returned.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#else
+#include <dirent.h>
+#endif
+
+#include "vmware.h"
+#include "util.h"
+#include "unicode.h"
+#include "dynbuf.h"
+#include "posix.h"
+#include "vixToolsInt.h"
+
+#if defined(__linux__)
+/*
+ * glibc has no wrapper for getdents64().
+ */
+struct VixToolsLinuxDirent64 {
+   uint64         d_ino;
+   int64          d_off;
+   unsigned short d_reclen;
+   unsigned char  d_type;
+   char           d_name[];
+};
+
+#define DIR_CURSOR_GETDENTS_BUF_SIZE   (64 * 1024)
+#endif
+
+struct VixToolsDirCursor {
+   int dirFd;
+   struct stat dirStat;       // To notice the directory changing.
+   DynBuf names;              // NUL terminated names, back to back.
+   DynBuf nameOffsets;        // uint32 offset into names, per entry.
+   uint32 numEntries;
+   uint32 *matches;           // Entries matching the pattern, NULL for all.
+   uint32 numMatches;
+};
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsDirCursorAddName --
+ *
+ *      Appends an entry to the cursor.
+ *
+ * Return value:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VixToolsDirCursorAddName(VixToolsDirCursor *cursor,    // IN/OUT
+                         const char *name)             // IN
+{
+   uint32 offset = DynBuf_GetSize(&cursor->names);
+
+   DynBuf_SafeAppend(&cursor->names, name, strlen(name) + 1);
+   DynBuf_SafeAppend(&cursor->nameOffsets, &offset, sizeof offset);
+   cursor->numEntries++;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsDirCursorIsDotOrDotDot --
+ *
+ *      Whether a name is "." or "..".
+ *
+ * Return value:
+ *      TRUE if it is.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE Bool
+VixToolsDirCursorIsDotOrDotDot(const char *name)    // IN
+{
+   return name[0] == '.' &&
+          (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsDirCursorReadNames --
+ *
+ *      Reads the names of all the entries of the cursor's directory, other
+ *      than "." and "..".
+ *
+ * Return value:
+ *      TRUE on success, FALSE with errno set on failure.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+VixToolsDirCursorReadNames(VixToolsDirCursor *cursor)    // IN/OUT
+{
+#if defined(__linux__)
+   char *buf = Util_SafeMalloc(DIR_CURSOR_GETDENTS_BUF_SIZE);
+   long n;
+
+   while ((n = syscall(SYS_getdents64, cursor->dirFd, buf,
+                       DIR_CURSOR_GETDENTS_BUF_SIZE)) > 0) {
+      long pos = 0;
+
+      while (pos < n) {
+         struct VixToolsLinuxDirent64 *d =
+            (struct VixToolsLinuxDirent64 *) (buf + pos);
+
+         if (!VixToolsDirCursorIsDotOrDotDot(d->d_name)) {
+            VixToolsDirCursorAddName(cursor, d->d_name);
+         }
+         pos += d->d_reclen;
+      }
+   }
+   free(buf);
+
+   return n == 0;
+#else
+   int fd = dup(cursor->dirFd);
+   DIR *dir;
+   struct dirent *entry;
+   int err;
+
+   if (fd == -1) {
+      return FALSE;
+   }
+   dir = fdopendir(fd);
+   if (dir == NULL) {
+      err = errno;
+      close(fd);
+      errno = err;
+      return FALSE;
+   }
+
+   for (;;) {
+      errno = 0;
+      entry = readdir(dir);
+      if (entry == NULL) {
+         break;
+      }
+      if (!VixToolsDirCursorIsDotOrDotDot(entry->d_name)) {
+         VixToolsDirCursorAddName(cursor, entry->d_name);
+      }
+   }
+   err = errno;
+   closedir(dir);
+   errno = err;
+
+   return err == 0;
+#endif
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsDirCursorCompareNames --
+ *
+ *      qsort comparator for name pointers.
+ *
+ * Return value:
+ *      strcmp() of the names.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+VixToolsDirCursorCompareNames(const void *a,    // IN
+                              const void *b)    // IN
+{
+   return strcmp(*(const char * const *) a, *(const char * const *) b);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsDirCursorSortNames --
+ *
+ *      Sorts the entries after the first 'skip' by their name on disk,
+ *      bytewise, so that listings don't follow the file system's order.
+ *
+ * Return value:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VixToolsDirCursorSortNames(VixToolsDirCursor *cursor,    // IN/OUT
+                           uint32 skip)                  // IN
+{
+   const char *base = DynBuf_Get(&cursor->names);
+   uint32 *offsets = DynBuf_Get(&cursor->nameOffsets);
+   uint32 num = cursor->numEntries - skip;
+   const char **names;
+   uint32 i;
+
+   if (num < 2) {
+      return;
+   }
+
+   names = Util_SafeMalloc(num * sizeof *names);
+   for (i = 0; i < num; i++) {
+      names[i] = base + offsets[skip + i];
+   }
+   qsort(names, num, sizeof *names, VixToolsDirCursorCompareNames);
+   for (i = 0; i < num; i++) {
+      offsets[skip + i] = names[i] - base;
+   }
+   free(names);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsDirCursorGetRawName --
+ *
+ *      Gets the name of an entry as it is on disk.
+ *
+ * Return value:
+ *      The name; owned by the cursor.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static const char *
+VixToolsDirCursorGetRawName(const VixToolsDirCursor *cursor,   // IN
+                            uint32 entry)                      // IN
+{
+   const uint32 *offsets = DynBuf_Get(&cursor->nameOffsets);
+
+   ASSERT(entry < cursor->numEntries);
+
+   return (const char *) DynBuf_Get(&cursor->names) + offsets[entry];
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsDirCursorToUTF8 --
+ *
+ *      Converts an on disk name to UTF-8 the way File_ListDirectory() does:
+ *      a name that is not valid in the default encoding becomes three
+ *      substitution characters.
+ *
+ * Return value:
+ *      Allocated UTF-8 name.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static char *
+VixToolsDirCursorToUTF8(const char *name)    // IN
+{
+   if (Unicode_IsBufferValid(name, -1, STRING_ENCODING_DEFAULT)) {
+      return Unicode_Alloc(name, STRING_ENCODING_DEFAULT);
+   }
+
+   return Unicode_Duplicate(UNICODE_SUBSTITUTION_CHAR
+                            UNICODE_SUBSTITUTION_CHAR
+                            UNICODE_SUBSTITUTION_CHAR);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsNewDirCursor --
+ *
+ *      Takes a snapshot of the entries of a directory, keeping those whose
+ *      name matches 'regex'.  As with File_ListDirectory() plus the
+ *      ListFiles convention, "." and ".." come first; the other entries
+ *      follow sorted by name, so the order is the same for every cursor
+ *      on an unchanged directory.
+ *
+ * Return value:
+ *      The cursor, NULL with errno set on failure.
+ *
+ * Side effects:
+ *      Keeps the directory open until the cursor is destroyed.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+VixToolsDirCursor *
+VixToolsNewDirCursor(const char *dirPath,    // IN
+                     GRegex *regex)          // IN/OPT
+{
+   VixToolsDirCursor *cursor = Util_SafeCalloc(1, sizeof *cursor);
+   int err;
+
+   DynBuf_Init(&cursor->names);
+   DynBuf_Init(&cursor->nameOffsets);
+
+   cursor->dirFd = Posix_Open(dirPath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+   if (cursor->dirFd == -1) {
+      goto error;
+   }
+   if (fstat(cursor->dirFd, &cursor->dirStat) == -1) {
+      goto error;
+   }
+
+   VixToolsDirCursorAddName(cursor, ".");
+   VixToolsDirCursorAddName(cursor, "..");
+   if (!VixToolsDirCursorReadNames(cursor)) {
+      goto error;
+   }
+   VixToolsDirCursorSortNames(cursor, 2);
+
+   if (NULL != regex) {
+      uint32 i;
+
+      cursor->matches = Util_SafeMalloc(cursor->numEntries *
+                                        sizeof *cursor->matches);
+      for (i = 0; i < cursor->numEntries; i++) {
+         char *name =
+            VixToolsDirCursorToUTF8(VixToolsDirCursorGetRawName(cursor, i));
+
+         if (g_regex_match(regex, name, 0, NULL)) {
+            cursor->matches[cursor->numMatches++] = i;
+         }
+         free(name);
+      }
+   } else {
+      cursor->numMatches = cursor->numEntries;
+   }
+
+   return cursor;
+
+error:
+   err = errno;
+   VixToolsDestroyDirCursor(cursor);
+   errno = err;
+
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsDestroyDirCursor --
+ *
+ *      Frees a cursor.
+ *
+ * Return value:
+ *      None
+ *
+ * Side effects:
+ *      Closes the directory.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+VixToolsDestroyDirCursor(VixToolsDirCursor *cursor)    // IN
+{
+   if (NULL == cursor) {
+      return;
+   }
+
+   if (cursor->dirFd != -1) {
+      close(cursor->dirFd);
+   }
+   DynBuf_Destroy(&cursor->names);
+   DynBuf_Destroy(&cursor->nameOffsets);
+   free(cursor->matches);
+   free(cursor);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsDirCursorIsCurrent --
+ *
+ *      Checks that 'dirPath' is still the directory the cursor was taken of,
+ *      and that nothing has been added to or removed from it since.
+ *
+ * Return value:
+ *      TRUE if the snapshot is still good.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+VixToolsDirCursorIsCurrent(const VixToolsDirCursor *cursor,   // IN
+                           const char *dirPath)               // IN
+{
+   const struct stat *then = &cursor->dirStat;
+   struct stat now;
+
+   if (Posix_Stat(dirPath, &now) == -1) {
+      return FALSE;
+   }
+
+   return now.st_dev == then->st_dev &&
+          now.st_ino == then->st_ino &&
+#if defined(__linux__)
+          now.st_mtim.tv_sec == then->st_mtim.tv_sec &&
+          now.st_mtim.tv_nsec == then->st_mtim.tv_nsec &&
+#else
+          now.st_mtime == then->st_mtime &&
+#endif
+          now.st_ctime == then->st_ctime;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsDirCursorNumMatches --
+ *
+ *      Gets the number of entries that matched the pattern.
+ *
+ * Return value:
+ *      Number of matches.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+uint32
+VixToolsDirCursorNumMatches(const VixToolsDirCursor *cursor)    // IN
+{
+   return cursor->numMatches;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsDirCursorSeek --
+ *
+ *      Finds the first match at or after entry 'index' of the directory.
+ *      Like the ListFiles index, 'index' counts every entry, matching or
+ *      not.
+ *
+ * Return value:
+ *      Match number, VixToolsDirCursorNumMatches() if there is none.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+uint32
+VixToolsDirCursorSeek(const VixToolsDirCursor *cursor,   // IN
+                      uint64 index)                      // IN
+{
+   uint32 lo = 0;
+   uint32 hi = cursor->numMatches;
+
+   if (NULL == cursor->matches) {
+      return MIN(index, cursor->numMatches);
+   }
+
+   while (lo < hi) {
+      uint32 mid = lo + (hi - lo) / 2;
+
+      if (cursor->matches[mid] < index) {
+         lo = mid + 1;
+      } else {
+         hi = mid;
+      }
+   }
+
+   return lo;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsDirCursorGetName --
+ *
+ *      Gets the UTF-8 name of a match.
+ *
+ * Return value:
+ *      Allocated name.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+char *
+VixToolsDirCursorGetName(const VixToolsDirCursor *cursor,   // IN
+                         uint32 match)                      // IN
+{
+   uint32 entry;
+
+   ASSERT(match < cursor->numMatches);
+   entry = (NULL == cursor->matches) ? match : cursor->matches[match];
+
+   return VixToolsDirCursorToUTF8(VixToolsDirCursorGetRawName(cursor, entry));
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsDirCursorGetInfo --
+ *
+ *      Gets what ListFiles reports about a match, the same way
+ *      VixToolsPrintFileExtendedInfo() does for a path: a symlink is
+ *      reported as such with the ownership and times of its target, the
+ *      size is only set for regular files.
+ *
+ * Return value:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+VixToolsDirCursorGetInfo(const VixToolsDirCursor *cursor,   // IN
+                         uint32 match,                      // IN
+                         VixToolsFileInfo *info)            // OUT
+{
+   const char *name;
+   struct stat statbuf;
+
+   ASSERT(match < cursor->numMatches);
+   name = VixToolsDirCursorGetRawName(cursor,
+                                      (NULL == cursor->matches)
+                                      ? match : cursor->matches[match]);
+
+   memset(info, 0, sizeof *info);
+
+   if (fstatat(cursor->dirFd, name, &statbuf, AT_SYMLINK_NOFOLLOW) == -1) {
+      g_warning("%s: fstatat(%s) failed with %d\n",
+                __FUNCTION__, name, errno);
+      return;
+   }
+
+   if (S_ISLNK(statbuf.st_mode)) {
+      size_t size = MAX(statbuf.st_size + 1, 256);
+
+      info->fileProperties |= VIX_FILE_ATTRIBUTES_SYMLINK;
+
+      while (TRUE) {
+         char *target = Util_SafeMalloc(size);
+         ssize_t len = readlinkat(cursor->dirFd, name, target, size);
+
+         if (len == -1) {
+            free(target);
+            break;
+         }
+         if (len < size) {
+            target[len] = '\0';
+            info->symlinkTarget = Unicode_Alloc(target,
+                                                STRING_ENCODING_DEFAULT);
+            free(target);
+            break;
+         }
+         free(target);
+         size *= 2;
+      }
+
+      if (fstatat(cursor->dirFd, name, &statbuf, 0) == -1) {
+         g_warning("%s: fstatat(%s) failed with %d\n",
+                   __FUNCTION__, name, errno);
+         return;
+      }
+   } else if (S_ISDIR(statbuf.st_mode)) {
+      info->fileProperties |= VIX_FILE_ATTRIBUTES_DIRECTORY;
+   } else if (S_ISREG(statbuf.st_mode)) {
+      info->fileSize = statbuf.st_size;
+   }
+
+   info->ownerId = statbuf.st_uid;
+   info->groupId = statbuf.st_gid;
+   info->permissions = statbuf.st_mode;
+   info->modTime = statbuf.st_mtime;
+   info->accessTime = statbuf.st_atime;
+}
@@ -137,6 +137,44 @@ char *VixToolsGetEnvVarFromEnvBlock(const wchar_t *envBlock,
 
 char *VixToolsEscapeXMLString(const char *str);
 
+#ifndef _WIN32
+typedef struct VixToolsDirCursor VixToolsDirCursor;
+
+/*
+ * What ListFiles reports about a directory entry.
+ */
+typedef struct VixToolsFileInfo {
+   int32 fileProperties;
+   int64 fileSize;
+   VmTimeType modTime;
+   VmTimeType accessTime;
+   int ownerId;
+   int groupId;
+   int permissions;
+   char *symlinkTarget;    // NULL unless a readable symlink
+} VixToolsFileInfo;
+
+VixToolsDirCursor *VixToolsNewDirCursor(const char *dirPath,
+                                        GRegex *regex);
+
+void VixToolsDestroyDirCursor(VixToolsDirCursor *cursor);
+
+Bool VixToolsDirCursorIsCurrent(const VixToolsDirCursor *cursor,
+                                const char *dirPath);
+
+uint32 VixToolsDirCursorNumMatches(const VixToolsDirCursor *cursor);
+
+uint32 VixToolsDirCursorSeek(const VixToolsDirCursor *cursor,
+                             uint64 index);
+
+char *VixToolsDirCursorGetName(const VixToolsDirCursor *cursor,
+                               uint32 match);
+
+void VixToolsDirCursorGetInfo(const VixToolsDirCursor *cursor,
+                              uint32 match,
+                              VixToolsFileInfo *info);
+#endif
+
 #ifdef _WIN32
 VixError VixToolsInitializeWin32();
 
@@ -56,6 +56,7 @@
 typedef struct VmBackupScript {
    char *path;
    ProcMgr_AsyncProc *proc;
+   uint64 startUs;
 } VmBackupScript;
 
 
@@ -164,6 +165,7 @@ VmBackupRunNextScript(VmBackupScriptOp *op)  // IN/OUT
          }
          if (cmd != NULL) {
             g_debug("Running script: %s\n", cmd);
+            scripts[index].startUs = VmBackup_TimelineNow();
             scripts[index].proc = ProcMgr_ExecAsync(cmd, NULL);
          } else {
             g_debug("Failed to allocate memory to run script: %s\n",
@@ -280,6 +282,9 @@ VmBackupScriptOpQuery(VmBackupOp *_op) // IN
 
       succeeded = (ProcMgr_GetExitCode(currScript->proc, &exitCode) == 0 &&
                    exitCode == 0);
+      /* The end is only noticed when the state machine polls. */
+      VmBackup_TimelineAdd("script", currScript->startUs, "%s%s",
+                           currScript->path, succeeded ? "" : " failed");
       ProcMgr_Free(currScript->proc);
       currScript->proc = NULL;
 
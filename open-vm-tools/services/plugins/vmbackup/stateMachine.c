@@ -225,6 +225,10 @@ VmBackup_SendEvent(const char *event,
       g_source_unref(gBackupState->keepAlive);
    }
 
+   /* The entry covers the time since the previous event (the keep-alive gap). */
+   VmBackup_TimelineAdd("event", gBackupState->lastEventUs, "%s %u", event, code);
+   gBackupState->lastEventUs = VmBackup_TimelineNow();
+
    msg = g_strdup_printf(VMBACKUP_PROTOCOL_EVENT_SET" %s %u %s",
                          event, code, desc);
    g_debug("Sending vmbackup event: %s\n", msg);
@@ -283,6 +287,108 @@ VmBackup_SendEvent(const char *event,
 }
 
 
+/**
+ * Returns the file where the timeline of the last operation is saved.
+ *
+ * @return The path, to free with g_free().
+ */
+
+static gchar *
+VmBackupTimelinePath(void)
+{
+   gchar *path;
+   gchar *dir;
+
+   path = VMBACKUP_CONFIG_GET_STR(gBackupState->ctx->config,
+                                  VMBACKUP_CONF_TIMELINE_FILE, NULL);
+   if (path != NULL) {
+      return path;
+   }
+
+#if defined(OPEN_VM_TOOLS)
+   dir = g_strdup(VMTOOLSD_STATE_DIR);
+#else
+   {
+      char *confPath = GuestApp_GetConfPath();
+      dir = g_strdup(confPath);
+      vm_free(confPath);
+   }
+#endif
+
+   path = g_build_filename(dir, VMBACKUP_TIMELINE_FILE, NULL);
+   g_free(dir);
+   return path;
+}
+
+
+/**
+ * Saves the timeline of the operation that just finished in a local file,
+ * where vmware-toolbox-cmd reads it.
+ *
+ * @param[in]  timeline    The timeline.
+ */
+
+static void
+VmBackupSaveTimeline(const gchar *timeline)
+{
+   GError *err = NULL;
+   gchar *path = VmBackupTimelinePath();
+   gchar *dir = g_path_get_dirname(path);
+
+   if (g_mkdir_with_parents(dir, 0755) != 0) {
+      g_warning("Unable to create %s: %s\n", dir, g_strerror(errno));
+   } else if (!g_file_set_contents(path, timeline, -1, &err)) {
+      g_warning("Unable to save the quiesce timeline: %s\n", err->message);
+      g_clear_error(&err);
+   }
+
+   g_free(dir);
+   g_free(path);
+}
+
+
+/**
+ * Makes the timeline of the operation that just finished available: saves
+ * it for vmware-toolbox-cmd and, if configured to, publishes it in a guest
+ * variable and sends it to the host as a backup event. The whole ring is
+ * returned by "vmbackup.getTimeline".
+ */
+
+static void
+VmBackupReportTimeline(void)
+{
+   gchar *timeline = VmBackup_TimelineGet(TRUE, "\n");
+
+   VmBackupSaveTimeline(timeline);
+
+   if (gBackupState->publishTimeline) {
+      gchar *msg = g_strdup_printf("info-set " VMBACKUP_GUESTINFO_TIMELINE " %s",
+                                   timeline);
+
+      if (!RpcChannel_Send(gBackupState->ctx->rpc, msg, strlen(msg) + 1,
+                           NULL, NULL)) {
+         g_debug("Failed to publish the quiesce timeline.\n");
+      }
+      g_free(msg);
+   }
+   g_free(timeline);
+
+   if (gBackupState->reportTimeline) {
+      timeline = VmBackup_TimelineGet(TRUE, "; ");
+
+      /* Events are limited in size; the saved file has everything. */
+      if (strlen(timeline) > VMBACKUP_MAX_MSG_SIZE) {
+         gchar *desc = g_strdup_printf("%.*s...", VMBACKUP_MAX_MSG_SIZE - 3,
+                                       timeline);
+         g_free(timeline);
+         timeline = desc;
+      }
+      VmBackup_SendEvent(VMBACKUP_EVENT_TIMELINE, VMBACKUP_SUCCESS, timeline);
+      g_free(timeline);
+   }
+}
+
+
 /**
  * Cleans up the backup state object and sends a "done" event to the VMX.
  */
@@ -293,6 +399,11 @@ VmBackupFinalize(void)
    g_debug("*** %s\n", __FUNCTION__);
    ASSERT(gBackupState != NULL);
 
+   VmBackup_TimelineAdd("done", 0, "%s",
+                        gBackupState->machineState == VMBACKUP_MSTATE_IDLE ? "" :
+                        VmBackupGetStateName(gBackupState->machineState));
+   VmBackupReportTimeline();
+
    if (gBackupState->abortTimer != NULL) {
       g_source_destroy(gBackupState->abortTimer);
       g_source_unref(gBackupState->abortTimer);
@@ -366,6 +477,7 @@ VmBackupStartScripts(VmBackupScriptType type)
          NOT_REACHED();
    }
 
+   gBackupState->phaseStartUs = VmBackup_TimelineNow();
    if (gBackupState->execScripts &&
        !VmBackup_SetCurrentOp(gBackupState,
                               VmBackup_NewScriptOp(type, gBackupState),
@@ -453,12 +565,16 @@ VmBackupDoAbort(void)
 #ifdef __linux__
       /* Thaw the guest if already quiesced */
       if (gBackupState->machineState == VMBACKUP_MSTATE_SYNC_FREEZE) {
+         uint64 thawStartUs = VmBackup_TimelineNow();
+
          g_debug("Guest already quiesced, thawing for abort\n");
+         VmBackup_TimelineAdd("frozen", gBackupState->phaseStartUs, "aborted");
          if (!gBackupState->provider->snapshotDone(gBackupState,
                                       gBackupState->provider->clientData)) {
             g_debug("Thaw during abort failed\n");
             eventMsg = "Quiesce could not be aborted.";
          }
+         VmBackup_TimelineAdd("thaw", thawStartUs, "%s", eventMsg);
       }
 #endif
 
@@ -707,6 +823,7 @@ static Bool
 VmBackupEnableSyncWait(void)
 {
    g_debug("*** %s\n", __FUNCTION__);
+   gBackupState->phaseStartUs = VmBackup_TimelineNow();
    g_signal_emit_by_name(gBackupState->ctx->serviceObj,
                          TOOLS_CORE_SIG_IO_FREEZE,
                          gBackupState->ctx,
@@ -822,6 +939,7 @@ VmBackupEnableSync(void)
 {
    g_debug("*** %s\n", __FUNCTION__);
    if (gBackupState->freezeStatus == VMBACKUP_FREEZE_ERROR) {
+      VmBackup_TimelineAdd("freeze", gBackupState->phaseStartUs, "failed");
       g_signal_emit_by_name(gBackupState->ctx->serviceObj,
                             TOOLS_CORE_SIG_IO_FREEZE,
                             gBackupState->ctx,
@@ -833,6 +951,11 @@ VmBackupEnableSync(void)
 
    } else if (gBackupState->freezeStatus == VMBACKUP_FREEZE_CANCELED ||
               gBackupState->freezeStatus == VMBACKUP_FREEZE_FINISHED) {
+      VmBackup_TimelineAdd("freeze", gBackupState->phaseStartUs, "%s",
+                           gBackupState->freezeStatus == VMBACKUP_FREEZE_CANCELED ?
+                           "canceled" : "");
+      /* The guest stays frozen until the host says the snapshot is done. */
+      gBackupState->phaseStartUs = VmBackup_TimelineNow();
       /* Move to next state */
       gBackupState->machineState = VMBACKUP_MSTATE_SYNC_FREEZE;
    } else {
@@ -877,6 +1000,8 @@ VmBackupStartCommon(RpcInData *data,
       { VmBackup_NewNullProvider, NULL },
    };
 
+   VmBackup_TimelineStart(data->name);
+
    if (forceQuiesce) {
       if (gBackupState->quiesceApps || gBackupState->quiesceFS) {
          /*
@@ -944,14 +1069,28 @@ VmBackupStartCommon(RpcInData *data,
    gBackupState->enableNullDriver = VMBACKUP_CONFIG_GET_BOOL(ctx->config,
                                                              "enableNullDriver",
                                                              TRUE);
+   gBackupState->parallelSync = VMBACKUP_CONFIG_GET_BOOL(ctx->config,
+                                                         "enableParallelSync",
+                                                         FALSE);
+   gBackupState->reportFreezeTimings =
+      VMBACKUP_CONFIG_GET_BOOL(ctx->config, "reportFreezeTimings", FALSE);
+   gBackupState->reportTimeline = VMBACKUP_CONFIG_GET_BOOL(ctx->config,
+                                                           "reportTimeline",
+                                                           FALSE);
+   gBackupState->publishTimeline = VMBACKUP_CONFIG_GET_BOOL(ctx->config,
+                                                            "publishTimeline",
+                                                            FALSE);
 
    g_debug("Using quiesceApps = %d, quiesceFS = %d, allowHWProvider = %d,"
            " execScripts = %d, scriptArg = %s, timeout = %u,"
-           " enableNullDriver = %d, forceQuiesce = %d\n",
+           " enableNullDriver = %d, parallelSync = %d,"
+           " reportFreezeTimings = %d, forceQuiesce = %d\n",
            gBackupState->quiesceApps, gBackupState->quiesceFS,
            gBackupState->allowHWProvider, gBackupState->execScripts,
            (gBackupState->scriptArg != NULL) ? gBackupState->scriptArg : "",
-           gBackupState->timeout, gBackupState->enableNullDriver, forceQuiesce);
+           gBackupState->timeout, gBackupState->enableNullDriver,
+           gBackupState->parallelSync, gBackupState->reportFreezeTimings,
+           forceQuiesce);
    g_debug("Quiescing volumes: %s",
            (gBackupState->volumes) ? gBackupState->volumes : "(null)");
 
@@ -1000,6 +1139,7 @@ VmBackupStartCommon(RpcInData *data,
    return RPCIN_SETRETVALS(data, "", TRUE);
 
 error:
+   VmBackup_TimelineAdd("done", 0, "failed to start");
    if (gBackupState->keepAlive != NULL) {
       g_source_destroy(gBackupState->keepAlive);
       g_source_unref(gBackupState->keepAlive);
@@ -1231,11 +1371,17 @@ VmBackupSnapshotDone(RpcInData *data)
                               "Error: unexpected state for quiesce done message.",
                               FALSE);
    } else {
+      uint64 thawStartUs = VmBackup_TimelineNow();
+      Bool thawed;
+
+      VmBackup_TimelineAdd("frozen", gBackupState->phaseStartUs, "%s", "");
       if (data->argsSize > 1) {
          gBackupState->snapshots = g_strndup(data->args + 1, data->argsSize - 1);
       }
-      if (!gBackupState->provider->snapshotDone(gBackupState,
-                                                gBackupState->provider->clientData)) {
+      thawed = gBackupState->provider->snapshotDone(gBackupState,
+                                                 gBackupState->provider->clientData);
+      VmBackup_TimelineAdd("thaw", thawStartUs, "%s", thawed ? "" : "failed");
+      if (!thawed) {
          VmBackup_SendEvent(VMBACKUP_EVENT_REQUESTOR_ERROR,
                             VMBACKUP_SYNC_ERROR,
                             "Error when notifying the sync provider.");
@@ -1289,6 +1435,23 @@ VmBackupSnapshotCompleted(RpcInData *data)
 }
 
 
+/**
+ * Handler for the "vmbackup.getTimeline" message. Returns the timeline of
+ * recent quiesce operations, one entry per line; see VmBackup_TimelineGet().
+ *
+ * @param[in]  data     RPC data.
+ *
+ * @return TRUE
+ */
+
+static gboolean
+VmBackupGetTimeline(RpcInData *data)
+{
+   g_debug("*** %s\n", __FUNCTION__);
+   return RPCIN_SETRETVALSF(data, VmBackup_TimelineGet(FALSE, "\n"), TRUE);
+}
+
+
 /**
  * Prints some information about the plugin's state to the log.
  *
@@ -1374,7 +1537,8 @@ ToolsOnLoad(ToolsAppCtx *ctx)
       { VMBACKUP_PROTOCOL_ABORT, VmBackupAbort, NULL, NULL, NULL, 0 },
       { VMBACKUP_PROTOCOL_SNAPSHOT_COMPLETED, VmBackupSnapshotCompleted, NULL,
                     NULL, NULL, 0 },
-      { VMBACKUP_PROTOCOL_SNAPSHOT_DONE, VmBackupSnapshotDone, NULL, NULL, NULL, 0 }
+      { VMBACKUP_PROTOCOL_SNAPSHOT_DONE, VmBackupSnapshotDone, NULL, NULL, NULL, 0 },
+      { VMBACKUP_PROTOCOL_GET_TIMELINE, VmBackupGetTimeline, NULL, NULL, NULL, 0 }
    };
    ToolsPluginSignalCb sigs[] = {
       { TOOLS_CORE_SIG_DUMP_STATE, VmBackupDumpState, NULL },
@@ -34,6 +34,9 @@
 #include <process.h>
 #endif
 
+/* Longest freeze timing report sent to the VMX. */
+#define VMBACKUP_TIMINGS_MAX_LEN    1024
+
 typedef struct VmBackupDriverOp {
    VmBackupOp callbacks;
    const char *volumes;
@@ -226,10 +229,19 @@ VmBackupNewDriverOp(VmBackupState *state,       // IN
    *op->syncHandle = (handle != NULL) ? *handle : SYNCDRIVER_INVALID_HANDLE;
 
    if (freeze) {
+#if defined(_WIN32)
       success = SyncDriver_Freeze(op->volumes,
                                   useNullDriverPrefs ?
                                   state->enableNullDriver : FALSE,
                                   op->syncHandle);
+#else
+      success = SyncDriver_FreezeEx(op->volumes,
+                                    useNullDriverPrefs ?
+                                    state->enableNullDriver : FALSE,
+                                    state->parallelSync ?
+                                    SYNCDRIVER_FREEZE_PARALLEL_SYNC : 0,
+                                    op->syncHandle);
+#endif
    } else {
       success = VmBackupDriverThaw(op->syncHandle);
    }
@@ -243,6 +255,63 @@ VmBackupNewDriverOp(VmBackupState *state,       // IN
 }
 
 
+#if !defined(_WIN32)
+/*
+ *-----------------------------------------------------------------------------
+ *
+ *  VmBackupSyncDriverReportTimings --
+ *
+ *    Logs how long flushing and freezing each file system took, adds it to
+ *    the quiesce timeline, and sends it to the VMX as an event if configured
+ *    to.
+ *
+ * Result
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VmBackupSyncDriverReportTimings(VmBackupState *state,     // IN
+                                SyncDriverHandle handle)  // IN
+{
+   const char *timings = SyncDriver_GetTimings(handle);
+   gchar **fsTimings;
+   gchar **fs;
+
+   if (timings == NULL) {
+      return;
+   }
+
+   g_debug("Freeze timings: %s\n", timings);
+
+   /* One timeline entry per file system: "<path> sync=Xms freeze=Yms". */
+   fsTimings = g_strsplit(timings, "; ", 0);
+   for (fs = fsTimings; *fs != NULL; fs++) {
+      VmBackup_TimelineAdd("fs", VmBackup_TimelineNow(), "%s", *fs);
+   }
+   g_strfreev(fsTimings);
+
+   if (state->reportFreezeTimings) {
+      gchar *desc;
+
+      /* Keep the event small; the log has the full report. */
+      if (strlen(timings) > VMBACKUP_TIMINGS_MAX_LEN) {
+         desc = g_strdup_printf("%.*s...", VMBACKUP_TIMINGS_MAX_LEN - 3,
+                                timings);
+      } else {
+         desc = g_strdup(timings);
+      }
+      VmBackup_SendEvent(VMBACKUP_EVENT_FREEZE_TIMINGS, VMBACKUP_SUCCESS, desc);
+      g_free(desc);
+   }
+}
+#endif
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -272,6 +341,9 @@ VmBackupSyncDriverReadyForSnapshot(VmBackupState *state)
       success = VmBackup_SendEvent(VMBACKUP_EVENT_SNAPSHOT_COMMIT, 0, "");
       if (success) {
          state->freezeStatus = VMBACKUP_FREEZE_FINISHED;
+#if !defined(_WIN32)
+         VmBackupSyncDriverReportTimings(state, *handle);
+#endif
       } else {
          /*
           * If the vmx does not know this event (e.g. due to an RPC timeout),
@@ -0,0 +1,213 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file timeline.c
+ *
+ * Keeps a timeline of the phases of recent quiesce operations: when each
+ * script, file system freeze, event to the host and thaw happened, relative
+ * to the start of the operation, and how long it took.
+ *
+ * Entries go into a fixed size ring buffer, so the most recent entries
+ * (possibly spanning several operations) are always available, without
+ * the timeline growing while a backup is stuck. Everything here runs in
+ * the service's main thread, so there is no locking.
+ */
+
+#include "vmBackupInt.h"
+
+#include <stdarg.h>
+#include "hostinfo.h"
+#include "str.h"
+
+#define VMBACKUP_TIMELINE_SIZE         256
+#define VMBACKUP_TIMELINE_DETAIL_LEN   96
+
+typedef struct VmBackupTimelineEntry {
+   uint32         op;
+   uint64         offsetUs;
+   uint64         durationUs;
+   const char    *phase;
+   char           detail[VMBACKUP_TIMELINE_DETAIL_LEN];
+} VmBackupTimelineEntry;
+
+static struct {
+   VmBackupTimelineEntry   entries[VMBACKUP_TIMELINE_SIZE];
+   guint                   next;
+   guint                   count;
+   uint32                  op;
+   uint64                  opStartUs;
+} gTimeline;
+
+
+/*
+ ******************************************************************************
+ * VmBackupTimelineAppend --                                            */ /**
+ *
+ * Appends a line describing an entry to the given string.
+ *
+ * @param[in]  str      String to append to.
+ * @param[in]  entry    The entry.
+ * @param[in]  sep      Separator to write before the entry, if not the first.
+ *
+ ******************************************************************************
+ */
+
+static void
+VmBackupTimelineAppend(GString *str,
+                       const VmBackupTimelineEntry *entry,
+                       const char *sep)
+{
+   if (str->len > 0) {
+      g_string_append(str, sep);
+   }
+   g_string_append_printf(str, "%u %"FMT64"u.%03u %"FMT64"u.%03u %s%s%s",
+                          entry->op,
+                          entry->offsetUs / 1000,
+                          (unsigned) (entry->offsetUs % 1000),
+                          entry->durationUs / 1000,
+                          (unsigned) (entry->durationUs % 1000),
+                          entry->phase,
+                          entry->detail[0] != '\0' ? " " : "",
+                          entry->detail);
+}
+
+
+/*
+ ******************************************************************************
+ * VmBackup_TimelineNow --                                              */ /**
+ *
+ * Returns the current time in the time base used by the timeline.
+ *
+ * @return Monotonic time, in microseconds.
+ *
+ ******************************************************************************
+ */
+
+uint64
+VmBackup_TimelineNow(void)
+{
+   return Hostinfo_SystemTimerUS();
+}
+
+
+/*
+ ******************************************************************************
+ * VmBackup_TimelineStart --                                            */ /**
+ *
+ * Starts the timeline of a new quiesce operation. Entries added from now on
+ * are relative to this point, and tagged with a new operation number.
+ *
+ * @param[in]  detail   Description of the operation.
+ *
+ ******************************************************************************
+ */
+
+void
+VmBackup_TimelineStart(const char *detail)
+{
+   gTimeline.op++;
+   gTimeline.opStartUs = VmBackup_TimelineNow();
+   VmBackup_TimelineAdd("start", gTimeline.opStartUs, "%s", detail);
+}
+
+
+/*
+ ******************************************************************************
+ * VmBackup_TimelineAdd --                                              */ /**
+ *
+ * Adds an entry for a phase that started at @a startUs and ended now. The
+ * oldest entry is dropped if the ring is full.
+ *
+ * @param[in]  phase    Name of the phase (a static string).
+ * @param[in]  startUs  When the phase started, from VmBackup_TimelineNow();
+ *                      0 means the start of the operation.
+ * @param[in]  fmt      Format of the detail string, truncated if too long.
+ *
+ ******************************************************************************
+ */
+
+void
+VmBackup_TimelineAdd(const char *phase,
+                     uint64 startUs,
+                     const char *fmt,
+                     ...)
+{
+   VmBackupTimelineEntry *entry = &gTimeline.entries[gTimeline.next];
+   uint64 now = VmBackup_TimelineNow();
+   va_list args;
+
+   if (startUs < gTimeline.opStartUs) {
+      startUs = gTimeline.opStartUs;
+   }
+
+   entry->op = gTimeline.op;
+   entry->offsetUs = startUs - gTimeline.opStartUs;
+   entry->durationUs = now > startUs ? now - startUs : 0;
+   entry->phase = phase;
+
+   va_start(args, fmt);
+   if (Str_Vsnprintf(entry->detail, sizeof entry->detail, fmt, args) < 0) {
+      /* Str_Vsnprintf() truncates at a character boundary; that's fine. */
+      g_debug("Truncated timeline entry for %s.\n", phase);
+   }
+   va_end(args);
+
+   gTimeline.next = (gTimeline.next + 1) % VMBACKUP_TIMELINE_SIZE;
+   if (gTimeline.count < VMBACKUP_TIMELINE_SIZE) {
+      gTimeline.count++;
+   }
+}
+
+
+/*
+ ******************************************************************************
+ * VmBackup_TimelineGet --                                              */ /**
+ *
+ * Formats the timeline, oldest entry first. Each entry reads
+ * "<op> <offset ms> <duration ms> <phase> [detail]".
+ *
+ * @param[in]  lastOpOnly  Only return the entries of the latest operation.
+ * @param[in]  sep         Separator between entries.
+ *
+ * @return The timeline (to be freed with g_free()); an empty string if
+ *         nothing was recorded.
+ *
+ ******************************************************************************
+ */
+
+gchar *
+VmBackup_TimelineGet(gboolean lastOpOnly,
+                     const char *sep)
+{
+   GString *str = g_string_new("");
+   guint first = (gTimeline.next + VMBACKUP_TIMELINE_SIZE - gTimeline.count) %
+                 VMBACKUP_TIMELINE_SIZE;
+   guint i;
+
+   for (i = 0; i < gTimeline.count; i++) {
+      const VmBackupTimelineEntry *entry =
+         &gTimeline.entries[(first + i) % VMBACKUP_TIMELINE_SIZE];
+
+      if (!lastOpOnly || entry->op == gTimeline.op) {
+         VmBackupTimelineAppend(str, entry, sep);
+      }
+   }
+
+   return g_string_free(str, FALSE);
+}
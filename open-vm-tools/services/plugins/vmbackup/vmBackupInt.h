@@ -120,6 +120,12 @@ typedef struct VmBackupState {
    Bool           allowHWProvider;
    Bool           execScripts;
    Bool           enableNullDriver;
+   Bool           parallelSync;
+   Bool           reportFreezeTimings;
+   Bool           reportTimeline;
+   Bool           publishTimeline;
+   uint64         phaseStartUs;
+   uint64         lastEventUs;
    Bool           needsPriv;
    gchar         *scriptArg;
    guint          timeout;
@@ -294,5 +300,21 @@ VmBackup_SendEvent(const char *event,
                    const uint32 code,
                    const char *desc);
 
+uint64
+VmBackup_TimelineNow(void);
+
+void
+VmBackup_TimelineStart(const char *detail);
+
+void
+VmBackup_TimelineAdd(const char *phase,
+                     uint64 startUs,
+                     const char *fmt,
+                     ...) PRINTF_DECL(3, 4);
+
+gchar *
+VmBackup_TimelineGet(gboolean lastOpOnly,
+                     const char *sep);
+
 #endif /* _VMBACKUPINT_H_*/
 
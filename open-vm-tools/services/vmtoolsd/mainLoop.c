@@ -29,9 +29,16 @@
 #endif
 
 #include <stdlib.h>
+#include <string.h>
+#if defined(__linux__)
+#  include <errno.h>
+#  include <sys/inotify.h>
+#  include <unistd.h>
+#endif
 #include "toolsCoreInt.h"
 #include "conf.h"
 #include "guestApp.h"
+#include "hostinfo.h"
 #include "serviceObj.h"
 #include "system.h"
 #include "util.h"
@@ -43,6 +50,39 @@
 #include "vmware/tools/utils.h"
 #include "vmware/tools/vmbackup.h"
 
+/** How late the config file poll may run, to share wakeups with others. */
+#define CONF_POLL_SLACK    1000
+
+#define WAKEUP_MINUTE_MS   (60 * 1000)
+
+/** Main loop wakeup accounting, for the state dump. */
+typedef struct ToolsCoreWakeups {
+   GPollFunc      poll;
+   guint64        total;
+   uint64         start;
+   uint64         minuteStart;
+   guint          thisMinute;
+   guint          lastMinute;
+} ToolsCoreWakeups;
+
+static ToolsCoreWakeups gWakeups;
+
+#if defined(__linux__)
+/** Data for watching the config file's directory with inotify. */
+typedef struct ToolsCoreConfWatch {
+   ToolsServiceState   *state;
+   gchar               *name;
+} ToolsCoreConfWatch;
+#endif
+
+static void
+ToolsCoreStartConfigCheck(ToolsServiceState *state);
+
+#if defined(__linux__)
+static GSource *
+ToolsCoreWatchConfig(ToolsServiceState *state);
+#endif
+
 /*
  ******************************************************************************
  * ToolsCoreCleanup --                                                  */ /**
@@ -131,21 +171,268 @@ ToolsCoreInitializeDebug(ToolsServiceState *state)
 
 
 /**
- * Timer callback that just calls ToolsCore_ReloadConfig().
+ * Starts a new minute of wakeup accounting if the current one is over.
+ *
+ * @param[in]  now      Current monotonic time, in milliseconds.
+ */
+
+static void
+ToolsCoreRollWakeups(uint64 now)
+{
+   uint64 elapsed = now - gWakeups.minuteStart;
+
+   if (elapsed >= WAKEUP_MINUTE_MS) {
+      gWakeups.lastMinute = (elapsed < 2 * WAKEUP_MINUTE_MS) ?
+                            gWakeups.thisMinute : 0;
+      gWakeups.thisMinute = 0;
+      gWakeups.minuteStart = now - elapsed % WAKEUP_MINUTE_MS;
+   }
+}
+
+
+/**
+ * Poll function for the main loop that counts how often it wakes up.
+ *
+ * @param[in]  fds      Descriptors to poll.
+ * @param[in]  nfds     Number of descriptors.
+ * @param[in]  timeout  Timeout in milliseconds, -1 for none.
+ *
+ * @return The result of the original poll function.
+ */
+
+static gint
+ToolsCorePoll(GPollFD *fds,
+              guint nfds,
+              gint timeout)
+{
+   gint ret = gWakeups.poll(fds, nfds, timeout);
+
+   /* A poll that didn't have to wait didn't wake the process up. */
+   if (timeout != 0) {
+      ToolsCoreRollWakeups(System_GetTimeMonotonic() * 10);
+      gWakeups.thisMinute++;
+      gWakeups.total++;
+   }
+
+   return ret;
+}
+
+
+/**
+ * Timer callback that calls ToolsCore_ReloadConfig().
+ *
+ * On Linux the timer is only a fallback for when the config file's
+ * directory can't be watched, e.g. after it was removed: once it can be
+ * watched again, the timer is replaced with the inotify watch.
  *
  * @param[in]  clientData  Service state.
  *
- * @return TRUE.
+ * @return FALSE if the timer was replaced, TRUE otherwise.
  */
 
 static gboolean
 ToolsCoreConfFileCb(gpointer clientData)
 {
-   ToolsCore_ReloadConfig(clientData, FALSE);
+   ToolsServiceState *state = clientData;
+#if defined(__linux__)
+   GSource *src;
+#endif
+
+   ToolsCore_ReloadConfig(state, FALSE);
+
+#if defined(__linux__)
+   src = ToolsCoreWatchConfig(state);
+   if (src != NULL) {
+      g_debug("Config file directory is back, watching it again.\n");
+      state->configCheckTask =
+         g_source_attach(src, g_main_loop_get_context(state->ctx.mainLoop));
+      g_source_unref(src);
+      return FALSE;
+   }
+#endif
+
    return TRUE;
 }
 
 
+#if defined(__linux__)
+/**
+ * Frees the data of a config file watch.
+ *
+ * @param[in]  data     The watch data.
+ */
+
+static void
+ToolsCoreConfWatchFree(gpointer data)
+{
+   ToolsCoreConfWatch *watch = data;
+
+   g_free(watch->name);
+   g_free(watch);
+}
+
+
+/**
+ * Handles inotify events from the config file's directory, reloading the
+ * config file if it was written, replaced or removed.
+ *
+ * If the directory itself goes away, the watch is replaced with a new
+ * config check, which polls until the directory can be watched again.
+ *
+ * @param[in]  chan        The inotify channel.
+ * @param[in]  cond        Unused.
+ * @param[in]  clientData  The watch data.
+ *
+ * @return FALSE if the watch was replaced.
+ */
+
+static gboolean
+ToolsCoreConfWatchCb(GIOChannel *chan,
+                     GIOCondition cond,
+                     gpointer clientData)
+{
+   ToolsCoreConfWatch *watch = clientData;
+   ToolsServiceState *state = watch->state;
+   gboolean reload = FALSE;
+   gboolean rewatch = (cond & (G_IO_ERR | G_IO_HUP | G_IO_NVAL)) != 0;
+   int fd = g_io_channel_unix_get_fd(chan);
+   char buf[4096]
+      __attribute__ ((aligned(__alignof__(struct inotify_event))));
+   ssize_t len;
+
+   while ((len = read(fd, buf, sizeof buf)) > 0) {
+      const char *p = buf;
+
+      while (p < buf + len) {
+         const struct inotify_event *ev = (const struct inotify_event *) p;
+
+         if ((ev->mask & IN_Q_OVERFLOW) != 0 ||
+             (ev->len > 0 && strcmp(ev->name, watch->name) == 0)) {
+            reload = TRUE;
+         }
+         if ((ev->mask & (IN_IGNORED | IN_MOVE_SELF)) != 0) {
+            reload = TRUE;
+            rewatch = TRUE;
+         }
+         p += sizeof *ev + ev->len;
+      }
+   }
+
+   if (len < 0 && errno != EAGAIN && errno != EINTR) {
+      rewatch = TRUE;
+   }
+
+   if (reload) {
+      ToolsCore_ReloadConfig(state, FALSE);
+   }
+
+   if (rewatch) {
+      g_debug("Config file directory watch lost, restarting config check.\n");
+      ToolsCoreStartConfigCheck(state);
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Creates a source that watches the config file's directory with inotify,
+ * so that the config file is reloaded as soon as it changes, without
+ * polling.
+ *
+ * @param[in]  state    Service state.
+ *
+ * @return The new source, or NULL if the directory can't be watched.
+ */
+
+static GSource *
+ToolsCoreWatchConfig(ToolsServiceState *state)
+{
+   ToolsCoreConfWatch *watch;
+   GIOChannel *chan;
+   GSource *src = NULL;
+   gchar *path;
+   gchar *dir = NULL;
+   int fd = -1;
+
+   if (state->configFile != NULL) {
+      path = g_strdup(state->configFile);
+   } else {
+      char *confPath = GuestApp_GetConfPath();
+
+      if (confPath == NULL) {
+         return NULL;
+      }
+      path = g_build_filename(confPath, CONF_FILE, NULL);
+      free(confPath);
+   }
+
+   dir = g_path_get_dirname(path);
+
+   fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+   if (fd < 0) {
+      g_debug("Cannot create inotify instance: %s\n", strerror(errno));
+      goto exit;
+   }
+
+   if (inotify_add_watch(fd, dir,
+                         IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM |
+                         IN_DELETE | IN_ATTRIB | IN_MOVE_SELF |
+                         IN_ONLYDIR) < 0) {
+      g_debug("Cannot watch '%s': %s\n", dir, strerror(errno));
+      close(fd);
+      goto exit;
+   }
+
+   watch = g_new0(ToolsCoreConfWatch, 1);
+   watch->state = state;
+   watch->name = g_path_get_basename(path);
+
+   chan = g_io_channel_unix_new(fd);
+   g_io_channel_set_close_on_unref(chan, TRUE);
+   src = g_io_create_watch(chan, G_IO_IN | G_IO_ERR | G_IO_HUP);
+   g_source_set_callback(src, (GSourceFunc) ToolsCoreConfWatchCb, watch,
+                         ToolsCoreConfWatchFree);
+   g_io_channel_unref(chan);
+
+exit:
+   g_free(dir);
+   g_free(path);
+   return src;
+}
+#endif
+
+
+/**
+ * Starts checking the config file for changes: with inotify where
+ * available, by polling otherwise. The source ID is stored in the
+ * service state.
+ *
+ * @param[in]  state    Service state.
+ */
+
+static void
+ToolsCoreStartConfigCheck(ToolsServiceState *state)
+{
+   GSource *src = NULL;
+
+#if defined(__linux__)
+   src = ToolsCoreWatchConfig(state);
+#endif
+
+   if (src == NULL) {
+      src = VMTools_CreateCoalescedTimer(CONF_POLL_TIME * 1000,
+                                         CONF_POLL_SLACK);
+      g_source_set_callback(src, ToolsCoreConfFileCb, state, NULL);
+   }
+
+   state->configCheckTask =
+      g_source_attach(src, g_main_loop_get_context(state->ctx.mainLoop));
+   g_source_unref(src);
+}
+
+
 /**
  * IO freeze signal handler. Disables the conf file check task if I/O is
  * frozen, re-enable it otherwise. See bug 529653.
@@ -168,9 +455,9 @@ ToolsCoreIOFreezeCb(gpointer src,
       VMTools_SuspendLogIO();
    } else if (state->configCheckTask == 0 && !freeze) {
       VMTools_ResumeLogIO();
-      state->configCheckTask = g_timeout_add(CONF_POLL_TIME * 1000,
-                                             ToolsCoreConfFileCb,
-                                             state);
+      ToolsCoreStartConfigCheck(state);
+      /* Pick up any change made while I/O was frozen. */
+      ToolsCore_ReloadConfig(state, FALSE);
    }
 }
 
@@ -245,9 +532,19 @@ ToolsCoreRunLoop(ToolsServiceState *state)
                           state);
       }
 
-      state->configCheckTask = g_timeout_add(CONF_POLL_TIME * 1000,
-                                             ToolsCoreConfFileCb,
-                                             state);
+      ToolsCoreStartConfigCheck(state);
+
+      /* Count main loop wakeups, for the state dump. */
+      gWakeups.poll = g_main_context_get_poll_func(
+                         g_main_loop_get_context(state->ctx.mainLoop));
+      gWakeups.start = System_GetTimeMonotonic() * 10;
+      gWakeups.minuteStart = gWakeups.start;
+      g_main_context_set_poll_func(g_main_loop_get_context(state->ctx.mainLoop),
+                                   ToolsCorePoll);
+
+      state->readyTime = Hostinfo_SystemTimerUS();
+      g_message("Service '%s' ready %.3f ms after start.\n", state->name,
+                (state->readyTime - state->startTime) / 1000.0);
 
 #if defined(__APPLE__)
       ToolsCore_CFRunLoop(state);
@@ -294,6 +591,27 @@ ToolsCore_DumpState(ToolsServiceState *state)
    ToolsCore_LogState(TOOLS_STATE_LOG_CONTAINER,
                       "Plugin path: %s\n",
                       state->pluginPath);
+   ToolsCore_LogState(TOOLS_STATE_LOG_CONTAINER,
+                      "Startup: ready after %.3f ms, plugins loaded %s%.3f ms\n",
+                      (state->readyTime - state->startTime) / 1000.0,
+                      state->loadedTime != 0 ? "after " : "(pending) ",
+                      state->loadedTime != 0 ?
+                         (state->loadedTime - state->startTime) / 1000.0 : 0.0);
+
+   if (gWakeups.poll != NULL) {
+      uint64 now = System_GetTimeMonotonic() * 10;
+      double minutes = (double) (now - gWakeups.start) / WAKEUP_MINUTE_MS;
+
+      ToolsCoreRollWakeups(now);
+      ToolsCore_LogState(TOOLS_STATE_LOG_CONTAINER,
+                         "Main loop wakeups: %u in the last minute, "
+                         "%.1f per minute on average (%"G_GUINT64_FORMAT
+                         " total)\n",
+                         gWakeups.lastMinute,
+                         (minutes >= 1.0) ? gWakeups.total / minutes :
+                                            (double) gWakeups.total,
+                         gWakeups.total);
+   }
 
    for (i = 0; i < state->providers->len; i++) {
       ToolsAppProviderReg *prov = &g_array_index(state->providers,
@@ -407,6 +725,8 @@ ToolsCore_Setup(ToolsServiceState *state)
     */
    g_message("Tools Version: %s (%s)\n", TOOLS_VERSION_EXT_CURRENT_STR, BUILD_NUMBER);
 
+   state->startTime = Hostinfo_SystemTimerUS();
+
    /* Initializes the app context. */
    gctx = g_main_context_default();
    state->ctx.version = TOOLS_CORE_API_V1;
@@ -22,26 +22,86 @@
  *    Provides functions for loading and manipulating Tools plugins.
  */
 
+#include <errno.h>
+#include <stdio.h>
 #include <string.h>
+#include <glib/gstdio.h>
 #include "toolsCoreInt.h"
 
 #include "vm_assert.h"
 #include "guestApp.h"
+#include "hostinfo.h"
 #include "serviceObj.h"
 #include "util.h"
+#include "vm_version.h"
 #include "vmware/tools/i18n.h"
 #include "vmware/tools/log.h"
 #include "vmware/tools/utils.h"
 
+/** Version of the format of the plugin manifest. */
+#define MANIFEST_VERSION      1
+#define MANIFEST_GROUP        "manifest"
+
+/** How long to wait before saving a changed manifest, in seconds. */
+#define MANIFEST_SAVE_DELAY   5
+
+/**
+ * Signals a plugin can connect to and still be loaded lazily. A plugin that
+ * is not loaded has nothing to reset, reload, dump or shut down; its
+ * capabilities come from the manifest, and setting an option loads it.
+ */
+static const char *gLazySignals[] = {
+   TOOLS_CORE_SIG_CAPABILITIES,
+   TOOLS_CORE_SIG_CONF_RELOAD,
+   TOOLS_CORE_SIG_DUMP_STATE,
+   TOOLS_CORE_SIG_RESET,
+   TOOLS_CORE_SIG_SET_OPTION,
+   TOOLS_CORE_SIG_SHUTDOWN,
+};
+
+
+/** What the manifest says about a plugin that is not loaded yet. */
+typedef struct ToolsPluginDeferred {
+   gchar               *name;
+   gchar              **signals;
+   gchar              **rpcNames;
+   GArray              *rpcs;
+   gchar              **capNames;
+   GArray              *caps;
+} ToolsPluginDeferred;
 
 /** Defines the internal data about a plugin. */
 typedef struct ToolsPlugin {
    gchar               *fileName;
+   gchar               *path;
    GModule             *module;
    ToolsPluginOnLoad    onload;
    ToolsPluginData     *data;
+   ToolsPluginDeferred *deferred;
 } ToolsPlugin;
 
+/**
+ * Stands in for an RPC of a plugin that is not loaded yet: receiving the RPC
+ * loads the plugin, which then handles it.
+ */
+typedef struct ToolsLazyRpc {
+   RpcChannelCallback   rpc;
+   ToolsServiceState   *state;
+   ToolsPlugin         *plugin;
+} ToolsLazyRpc;
+
+/** Capabilities callback of a plugin, wrapped to record its result. */
+typedef struct ToolsCapsHook {
+   ToolsServiceState   *state;
+   gchar               *path;
+   ToolsPluginSignalCb  sig;
+} ToolsCapsHook;
+
+typedef GArray *(*ToolsCapsCallback)(gpointer src,
+                                     ToolsAppCtx *ctx,
+                                     gboolean set,
+                                     gpointer data);
+
 
 #ifdef USE_APPLOADER
 static Bool (*LoadDependencies)(char *libName, Bool useShipped);
@@ -56,6 +116,9 @@ typedef gboolean (*PluginAppRegCallback)(ToolsServiceState *state,
                                          ToolsAppProviderReg *preg,
                                          gpointer reg);
 
+static gboolean
+ToolsCoreLazyRpcCb(RpcInData *data);
+
 
 /**
  * State dump callback for application registration information.
@@ -172,6 +235,25 @@ ToolsCoreDumpSignal(ToolsAppCtx *ctx,
 }
 
 
+/**
+ * Frees the manifest data of a plugin that was not loaded yet.
+ *
+ * @param[in]  deferred    The data.
+ */
+
+static void
+ToolsCoreFreeDeferred(ToolsPluginDeferred *deferred)
+{
+   g_free(deferred->name);
+   g_strfreev(deferred->signals);
+   g_strfreev(deferred->rpcNames);
+   g_array_free(deferred->rpcs, TRUE);
+   g_strfreev(deferred->capNames);
+   g_array_free(deferred->caps, TRUE);
+   g_free(deferred);
+}
+
+
 /**
  * Frees memory associated with a ToolsPlugin instance. If the plugin hasn't
  * been initialized yet, this will unload the shared object.
@@ -187,11 +269,546 @@ ToolsCoreFreePlugin(ToolsPlugin *plugin)
                 plugin->fileName,
                 g_module_error());
    }
+   if (plugin->deferred != NULL) {
+      ToolsCoreFreeDeferred(plugin->deferred);
+   }
    g_free(plugin->fileName);
+   g_free(plugin->path);
    g_free(plugin);
 }
 
 
+/**
+ * Returns the path of the manifest file, from the configuration or the
+ * default location: a system directory for the main service, the user's
+ * cache directory for the others.
+ *
+ * @param[in]  state    The service state.
+ *
+ * @return The path, to be freed with g_free().
+ */
+
+static gchar *
+ToolsCoreManifestPath(ToolsServiceState *state)
+{
+   gchar *dir;
+   gchar *path;
+
+   path = g_key_file_get_string(state->ctx.config, state->name,
+                                "plugins.manifest", NULL);
+   if (path != NULL) {
+      return path;
+   }
+
+   if (state->mainService) {
+#if defined(OPEN_VM_TOOLS)
+      dir = g_strdup(VMTOOLSD_STATE_DIR);
+#else
+      char *confPath = GuestApp_GetConfPath();
+      dir = g_strdup(confPath);
+      vm_free(confPath);
+#endif
+   } else {
+      dir = g_build_filename(g_get_user_cache_dir(), "vmware-tools", NULL);
+   }
+
+   path = g_strdup_printf("%s%c%s-plugins.manifest", dir, DIRSEPC,
+                          state->name);
+   g_free(dir);
+   return path;
+}
+
+
+/**
+ * Loads the plugin manifest. A manifest written by another build of the
+ * service is discarded, since its plugins may have changed.
+ *
+ * @param[in]  state    The service state.
+ */
+
+static void
+ToolsCoreManifestLoad(ToolsServiceState *state)
+{
+   GError *err = NULL;
+   gchar *build;
+   gint version;
+
+   state->manifestPath = ToolsCoreManifestPath(state);
+   state->manifest = g_key_file_new();
+
+   if (!g_key_file_load_from_file(state->manifest, state->manifestPath,
+                                  G_KEY_FILE_NONE, &err)) {
+      g_debug("No plugin manifest loaded from %s: %s\n", state->manifestPath,
+              err->message);
+      g_clear_error(&err);
+      return;
+   }
+
+   version = g_key_file_get_integer(state->manifest, MANIFEST_GROUP,
+                                    "version", NULL);
+   build = g_key_file_get_string(state->manifest, MANIFEST_GROUP, "build",
+                                 NULL);
+   if (version != MANIFEST_VERSION || build == NULL ||
+       strcmp(build, BUILD_NUMBER) != 0) {
+      g_message("Discarding plugin manifest %s from another build.\n",
+                state->manifestPath);
+      g_key_file_free(state->manifest);
+      state->manifest = g_key_file_new();
+   }
+   g_free(build);
+}
+
+
+/**
+ * Saves the plugin manifest if it has changed.
+ *
+ * @param[in]  state    The service state.
+ */
+
+static void
+ToolsCoreManifestSave(ToolsServiceState *state)
+{
+   GError *err = NULL;
+   gchar *data;
+   gchar *dir;
+   gsize len;
+
+   if (state->manifest == NULL || !state->manifestDirty) {
+      return;
+   }
+
+   g_key_file_set_integer(state->manifest, MANIFEST_GROUP, "version",
+                          MANIFEST_VERSION);
+   g_key_file_set_string(state->manifest, MANIFEST_GROUP, "build",
+                         BUILD_NUMBER);
+   data = g_key_file_to_data(state->manifest, &len, NULL);
+
+   dir = g_path_get_dirname(state->manifestPath);
+   if (g_mkdir_with_parents(dir, 0755) != 0) {
+      g_warning("Unable to create %s: %s\n", dir, g_strerror(errno));
+   } else if (!g_file_set_contents(state->manifestPath, data, len, &err)) {
+      g_warning("Unable to save the plugin manifest: %s\n", err->message);
+      g_clear_error(&err);
+   } else {
+      g_debug("Saved plugin manifest %s.\n", state->manifestPath);
+      state->manifestDirty = FALSE;
+   }
+
+   g_free(dir);
+   g_free(data);
+}
+
+
+/**
+ * Timer callback that saves the plugin manifest.
+ *
+ * @param[in]  _state   The service state.
+ *
+ * @return FALSE.
+ */
+
+static gboolean
+ToolsCoreManifestSaveCb(gpointer _state)
+{
+   ToolsServiceState *state = _state;
+
+   state->manifestSaveTask = 0;
+   ToolsCoreManifestSave(state);
+   return FALSE;
+}
+
+
+/**
+ * Marks the manifest as changed, and schedules saving it. Changes usually
+ * come in bursts (plugins loading, capabilities being registered), so the
+ * manifest is saved a little later.
+ *
+ * @param[in]  state    The service state.
+ */
+
+static void
+ToolsCoreManifestChanged(ToolsServiceState *state)
+{
+   state->manifestDirty = TRUE;
+
+   if (state->manifestSaveTask == 0) {
+      GSource *src = VMTools_CreateTimer(MANIFEST_SAVE_DELAY * 1000);
+
+      g_source_set_callback(src, ToolsCoreManifestSaveCb, state, NULL);
+      state->manifestSaveTask =
+         g_source_attach(src, g_main_loop_get_context(state->ctx.mainLoop));
+      g_source_unref(src);
+   }
+}
+
+
+/**
+ * Returns the stamp identifying a version of a plugin file: its size and
+ * modification time.
+ *
+ * @param[in]  path     Path of the plugin.
+ *
+ * @return The stamp, or NULL if the file can't be stat'ed.
+ */
+
+static gchar *
+ToolsCoreManifestStamp(const gchar *path)
+{
+   struct stat st;
+
+   if (g_stat(path, &st) != 0) {
+      return NULL;
+   }
+   return g_strdup_printf("%"G_GUINT64_FORMAT":%"G_GINT64_FORMAT,
+                          (guint64) st.st_size, (gint64) st.st_mtime);
+}
+
+
+/**
+ * Tells whether a plugin connected to the given signal can be loaded lazily.
+ *
+ * @param[in]  signame  Signal name.
+ *
+ * @return Whether the signal is in gLazySignals.
+ */
+
+static gboolean
+ToolsCoreIsLazySignal(const gchar *signame)
+{
+   guint i;
+
+   for (i = 0; i < ARRAYSIZE(gLazySignals); i++) {
+      if (strcmp(signame, gLazySignals[i]) == 0) {
+         return TRUE;
+      }
+   }
+   return FALSE;
+}
+
+
+/**
+ * Records in the manifest what a plugin registered when it was loaded, and
+ * whether it can be loaded lazily next time. It can if it only registers
+ * GuestRPCs without XDR and connects to signals in gLazySignals (with at
+ * most one capabilities callback), and its entry point didn't define new
+ * signals or ask the service to stop.
+ *
+ * @param[in]  state       The service state.
+ * @param[in]  plugin      The plugin.
+ * @param[in]  newSignals  Whether the entry point defined new signals.
+ */
+
+static void
+ToolsCoreManifestRecord(ToolsServiceState *state,
+                        ToolsPlugin *plugin,
+                        gboolean newSignals)
+{
+   GArray *regs = (plugin->data != NULL) ? plugin->data->regs : NULL;
+   GPtrArray *rpcs;
+   GPtrArray *signals;
+   gboolean lazy = !newSignals && plugin->data != NULL &&
+                   state->ctx.errorCode == 0;
+   guint capsCallbacks = 0;
+   gchar *stamp;
+   gchar *oldStamp;
+   guint i;
+
+   if (state->manifest == NULL || plugin->path == NULL ||
+       (stamp = ToolsCoreManifestStamp(plugin->path)) == NULL) {
+      return;
+   }
+
+   rpcs = g_ptr_array_new();
+   signals = g_ptr_array_new();
+
+   for (i = 0; regs != NULL && i < regs->len; i++) {
+      ToolsAppReg *reg = &g_array_index(regs, ToolsAppReg, i);
+      guint j;
+
+      for (j = 0; reg->data != NULL && j < reg->data->len; j++) {
+         if (reg->type == TOOLS_APP_GUESTRPC) {
+            RpcChannelCallback *rpc = &g_array_index(reg->data,
+                                                     RpcChannelCallback, j);
+            lazy &= rpc->xdrIn == NULL && rpc->xdrOut == NULL;
+            g_ptr_array_add(rpcs, (gpointer) rpc->name);
+         } else if (reg->type == TOOLS_APP_SIGNALS) {
+            ToolsPluginSignalCb *sig = &g_array_index(reg->data,
+                                                      ToolsPluginSignalCb, j);
+            lazy &= ToolsCoreIsLazySignal(sig->signame);
+            if (strcmp(sig->signame, TOOLS_CORE_SIG_CAPABILITIES) == 0) {
+               capsCallbacks++;
+            }
+            g_ptr_array_add(signals, (gpointer) sig->signame);
+         } else {
+            lazy = FALSE;
+         }
+      }
+   }
+   lazy &= capsCallbacks <= 1;
+
+   /* A different version of the plugin: forget what the old one did. */
+   oldStamp = g_key_file_get_string(state->manifest, plugin->path, "stamp",
+                                    NULL);
+   if (oldStamp != NULL && strcmp(oldStamp, stamp) != 0) {
+      g_key_file_remove_group(state->manifest, plugin->path, NULL);
+   }
+   g_free(oldStamp);
+
+   g_key_file_set_string(state->manifest, plugin->path, "stamp", stamp);
+   g_key_file_set_string(state->manifest, plugin->path, "name",
+                         plugin->data != NULL ? plugin->data->name : "");
+   g_key_file_set_boolean(state->manifest, plugin->path, "lazy", lazy);
+   g_key_file_set_string_list(state->manifest, plugin->path, "rpcs",
+                              (const gchar **) rpcs->pdata, rpcs->len);
+   g_key_file_set_string_list(state->manifest, plugin->path, "signals",
+                              (const gchar **) signals->pdata, signals->len);
+   ToolsCoreManifestChanged(state);
+
+   g_ptr_array_free(rpcs, TRUE);
+   g_ptr_array_free(signals, TRUE);
+   g_free(stamp);
+}
+
+
+/**
+ * Records in the manifest the capabilities a plugin sets.
+ *
+ * @param[in]  state    The service state.
+ * @param[in]  path     Path of the plugin.
+ * @param[in]  caps     The capabilities, may be NULL.
+ */
+
+static void
+ToolsCoreManifestSetCaps(ToolsServiceState *state,
+                         const gchar *path,
+                         GArray *caps)
+{
+   guint len = (caps != NULL) ? caps->len : 0;
+   gchar **list = g_new0(gchar *, len + 1);
+   guint i;
+
+   for (i = 0; i < len; i++) {
+      ToolsAppCapability *cap = &g_array_index(caps, ToolsAppCapability, i);
+      list[i] = g_strdup_printf("%d,%d,%u,%s", cap->type, cap->index,
+                                cap->value,
+                                cap->name != NULL ? cap->name : "");
+   }
+
+   g_key_file_set_string_list(state->manifest, path, "caps",
+                              (const gchar **) list, len);
+   ToolsCoreManifestChanged(state);
+   g_strfreev(list);
+}
+
+
+/**
+ * Looks up a plugin in the manifest, to find whether it can be loaded
+ * lazily: it must be the same file as when it was recorded, have been found
+ * fit for lazy loading then, and its capabilities must be known if it has
+ * any.
+ *
+ * @param[in]  state    The service state.
+ * @param[in]  path     Path of the plugin.
+ *
+ * @return What the manifest knows about the plugin, or NULL if it must be
+ *         loaded now.
+ */
+
+static ToolsPluginDeferred *
+ToolsCoreManifestLookup(ToolsServiceState *state,
+                        const gchar *path)
+{
+   ToolsPluginDeferred *deferred;
+   gchar *stamp;
+   gchar *recorded;
+   gboolean match;
+   gsize len;
+   guint i;
+
+   if (!g_key_file_get_boolean(state->manifest, path, "lazy", NULL)) {
+      return NULL;
+   }
+
+   stamp = ToolsCoreManifestStamp(path);
+   recorded = g_key_file_get_string(state->manifest, path, "stamp", NULL);
+   match = stamp != NULL && recorded != NULL && strcmp(stamp, recorded) == 0;
+   g_free(stamp);
+   g_free(recorded);
+   if (!match) {
+      return NULL;
+   }
+
+   deferred = g_new0(ToolsPluginDeferred, 1);
+   deferred->name = g_key_file_get_string(state->manifest, path, "name", NULL);
+   deferred->signals = g_key_file_get_string_list(state->manifest, path,
+                                                  "signals", NULL, NULL);
+   deferred->rpcNames = g_key_file_get_string_list(state->manifest, path,
+                                                   "rpcs", &len, NULL);
+   deferred->capNames = g_key_file_get_string_list(state->manifest, path,
+                                                   "caps", NULL, NULL);
+   deferred->rpcs = g_array_new(FALSE, TRUE, sizeof (ToolsLazyRpc));
+   deferred->caps = g_array_new(FALSE, TRUE, sizeof (ToolsAppCapability));
+
+   if (deferred->signals == NULL) {
+      deferred->signals = g_new0(gchar *, 1);
+   }
+   if (deferred->rpcNames == NULL) {
+      deferred->rpcNames = g_new0(gchar *, 1);
+      len = 0;
+   }
+
+   match = deferred->name != NULL;
+   for (i = 0; deferred->signals[i] != NULL; i++) {
+      if (strcmp(deferred->signals[i], TOOLS_CORE_SIG_CAPABILITIES) == 0) {
+         match &= deferred->capNames != NULL;
+      }
+   }
+
+   for (i = 0; deferred->capNames != NULL && deferred->capNames[i] != NULL;
+        i++) {
+      ToolsAppCapability cap = { 0, };
+      int type;
+      int index;
+      int offset;
+
+      if (sscanf(deferred->capNames[i], "%d,%d,%u,%n", &type, &index,
+                 &cap.value, &offset) != 3) {
+         match = FALSE;
+         break;
+      }
+      cap.type = type;
+      cap.index = index;
+      /* Point the name into the string, which is kept around. */
+      cap.name = deferred->capNames[i] + offset;
+      if (*cap.name == '\0') {
+         cap.name = NULL;
+      }
+      g_array_append_val(deferred->caps, cap);
+   }
+
+   g_array_set_size(deferred->rpcs, len);
+   for (i = 0; i < len; i++) {
+      ToolsLazyRpc *stub = &g_array_index(deferred->rpcs, ToolsLazyRpc, i);
+      stub->rpc.name = deferred->rpcNames[i];
+   }
+
+   if (!match) {
+      ToolsCoreFreeDeferred(deferred);
+      return NULL;
+   }
+   return deferred;
+}
+
+
+/**
+ * Finds the loaded plugin with the given registration data.
+ *
+ * @param[in]  state    The service state.
+ * @param[in]  data     The plugin's registration data.
+ *
+ * @return The plugin, or NULL.
+ */
+
+static ToolsPlugin *
+ToolsCoreFindPlugin(ToolsServiceState *state,
+                    ToolsPluginData *data)
+{
+   guint i;
+
+   for (i = 0; i < state->plugins->len; i++) {
+      ToolsPlugin *plugin = g_ptr_array_index(state->plugins, i);
+      if (plugin->data == data) {
+         return plugin;
+      }
+   }
+   return NULL;
+}
+
+
+/**
+ * Handler for the capabilities signal wrapping a plugin's callback, which
+ * records the capabilities in the manifest.
+ *
+ * @param[in]  src      The source object.
+ * @param[in]  ctx      The application context.
+ * @param[in]  set      Whether capabilities are being set.
+ * @param[in]  data     The ToolsCapsHook.
+ *
+ * @return The capabilities returned by the plugin.
+ */
+
+static GArray *
+ToolsCoreCapsHookCb(gpointer src,
+                    ToolsAppCtx *ctx,
+                    gboolean set,
+                    gpointer data)
+{
+   ToolsCapsHook *hook = data;
+   ToolsCapsCallback cb = hook->sig.callback;
+   GArray *caps = cb(src, ctx, set, hook->sig.clientData);
+
+   if (set && hook->state->manifest != NULL) {
+      ToolsCoreManifestSetCaps(hook->state, hook->path, caps);
+   }
+   return caps;
+}
+
+
+/**
+ * Frees a ToolsCapsHook when its signal handler is disconnected.
+ *
+ * @param[in]  data     The ToolsCapsHook.
+ * @param[in]  closure  Unused.
+ */
+
+static void
+ToolsCoreFreeCapsHook(gpointer data,
+                      GClosure *closure)
+{
+   ToolsCapsHook *hook = data;
+
+   g_free(hook->path);
+   g_free(hook);
+}
+
+
+/**
+ * Connects a plugin's capabilities callback through a ToolsCapsHook, so that
+ * the capabilities of the plugin are recorded in the manifest.
+ *
+ * @param[in]  state    The service state.
+ * @param[in]  plugin   The plugin's registration data.
+ * @param[in]  sig      The signal registration.
+ *
+ * @return FALSE if the plugin is not one loaded from a file.
+ */
+
+static gboolean
+ToolsCoreHookCapabilities(ToolsServiceState *state,
+                          ToolsPluginData *plugin,
+                          ToolsPluginSignalCb *sig)
+{
+   ToolsPlugin *owner = ToolsCoreFindPlugin(state, plugin);
+   ToolsCapsHook *hook;
+
+   if (owner == NULL || owner->path == NULL) {
+      return FALSE;
+   }
+
+   hook = g_new0(ToolsCapsHook, 1);
+   hook->state = state;
+   hook->path = g_strdup(owner->path);
+   hook->sig = *sig;
+   g_signal_connect_data(state->ctx.serviceObj,
+                         TOOLS_CORE_SIG_CAPABILITIES,
+                         G_CALLBACK(ToolsCoreCapsHookCb),
+                         hook,
+                         ToolsCoreFreeCapsHook,
+                         0);
+   return TRUE;
+}
+
+
 /**
  * Callback to register applications with the given provider.
  *
@@ -245,6 +862,14 @@ ToolsCoreRegisterApp(ToolsServiceState *state,
       preg->state = TOOLS_PROVIDER_ACTIVE;
    }
 
+   if (type == TOOLS_APP_SIGNALS && state->manifest != NULL &&
+       strcmp(((ToolsPluginSignalCb *) reg)->signame,
+              TOOLS_CORE_SIG_CAPABILITIES) == 0 &&
+       ToolsCoreHookCapabilities(state, plugin, reg)) {
+      error = FALSE;
+      goto exit;
+   }
+
    if (!preg->prov->registerApp(&state->ctx, preg->prov, plugin, reg)) {
       g_warning("Failed registration of app type %d (%s) from plugin %s.",
                 type, preg->prov->name, plugin->name);
@@ -303,6 +928,73 @@ ToolsCoreRegisterProvider(ToolsServiceState *state,
 }
 
 
+/**
+ * Iterates through a plugin's app registration data, calling the callback
+ * for each piece of data.
+ *
+ * @param[in]  state       Service state.
+ * @param[in]  plugin      The plugin.
+ * @param[in]  appRegCb    Callback called for each application registration.
+ */
+
+static void
+ToolsCoreForEachApp(ToolsServiceState *state,
+                    ToolsPlugin *plugin,
+                    PluginAppRegCallback appRegCb)
+{
+   GArray *regs = (plugin->data != NULL) ? plugin->data->regs : NULL;
+   guint j;
+
+   if (regs == NULL) {
+      return;
+   }
+
+   for (j = 0; j < regs->len; j++) {
+      guint k;
+      guint pregIdx;
+      ToolsAppReg *reg = &g_array_index(regs, ToolsAppReg, j);
+      ToolsAppProviderReg *preg = NULL;
+
+      /* Find the provider for the desired reg type. */
+      for (k = 0; k < state->providers->len; k++) {
+         ToolsAppProviderReg *tmp = &g_array_index(state->providers,
+                                                   ToolsAppProviderReg,
+                                                   k);
+         if (tmp->prov->regType == reg->type) {
+            preg = tmp;
+            pregIdx = k;
+            break;
+         }
+      }
+
+      if (preg == NULL) {
+         g_message("Cannot find provider for app type %d, plugin %s may not work.\n",
+                   reg->type, plugin->data->name);
+         if (plugin->data->errorCb != NULL &&
+             !plugin->data->errorCb(&state->ctx, reg->type, NULL, plugin->data)) {
+            break;
+         }
+         continue;
+      }
+
+      for (k = 0; k < reg->data->len; k++) {
+         gpointer appdata = &reg->data->data[preg->prov->regSize * k];
+         if (!appRegCb(state, plugin->data, reg->type, preg, appdata)) {
+            /* Break out of the outer loop. */
+            j = regs->len;
+            break;
+         }
+
+         /*
+          * The registration callback may have modified the provider array,
+          * so we need to re-read the provider pointer.
+          */
+         preg = &g_array_index(state->providers, ToolsAppProviderReg, pregIdx);
+      }
+   }
+}
+
+
 /**
  * Iterates through the list of plugins, and through each plugin's app
  * registration data, calling the appropriate callback for each piece
@@ -326,59 +1018,13 @@ ToolsCoreForEachPlugin(ToolsServiceState *state,
 
    for (i = 0; i < state->plugins->len; i++) {
       ToolsPlugin *plugin = g_ptr_array_index(state->plugins, i);
-      GArray *regs = (plugin->data != NULL) ? plugin->data->regs : NULL;
-      guint j;
 
-      if (pluginCb != NULL) {
-         pluginCb(state, plugin->data);
-      }
-
-      if (regs == NULL || appRegCb == NULL) {
-         continue;
-      }
-
-      for (j = 0; j < regs->len; j++) {
-         guint k;
-         guint pregIdx;
-         ToolsAppReg *reg = &g_array_index(regs, ToolsAppReg, j);
-         ToolsAppProviderReg *preg = NULL;
-
-         /* Find the provider for the desired reg type. */
-         for (k = 0; k < state->providers->len; k++) {
-            ToolsAppProviderReg *tmp = &g_array_index(state->providers,
-                                                      ToolsAppProviderReg,
-                                                      k);
-            if (tmp->prov->regType == reg->type) {
-               preg = tmp;
-               pregIdx = k;
-               break;
-            }
-         }
-
-         if (preg == NULL) {
-            g_message("Cannot find provider for app type %d, plugin %s may not work.\n",
-                      reg->type, plugin->data->name);
-            if (plugin->data->errorCb != NULL &&
-                !plugin->data->errorCb(&state->ctx, reg->type, NULL, plugin->data)) {
-               break;
-            }
-            continue;
-         }
-
-         for (k = 0; k < reg->data->len; k++) {
-            gpointer appdata = &reg->data->data[preg->prov->regSize * k];
-            if (!appRegCb(state, plugin->data, reg->type, preg, appdata)) {
-               /* Break out of the outer loop. */
-               j = regs->len;
-               break;
-            }
+      if (pluginCb != NULL) {
+         pluginCb(state, plugin->data);
+      }
 
-            /*
-             * The registration callback may have modified the provider array,
-             * so we need to re-read the provider pointer.
-             */
-            preg = &g_array_index(state->providers, ToolsAppProviderReg, pregIdx);
-         }
+      if (appRegCb != NULL) {
+         ToolsCoreForEachApp(state, plugin, appRegCb);
       }
    }
 }
@@ -488,17 +1134,76 @@ ToolsCoreStrPtrCompare(gconstpointer _str1,
 }
 
 
+/**
+ * Opens a plugin's shared object and looks up its entry point.
+ *
+ * @param[in]  path     Path of the plugin.
+ * @param[in]  entry    File name of the plugin, for logging.
+ * @param[out] module   Where to store the module.
+ * @param[out] onload   Where to store the entry point.
+ *
+ * @return Whether the plugin was opened.
+ */
+
+static gboolean
+ToolsCoreOpenPlugin(const gchar *path,
+                    const gchar *entry,
+                    GModule **module,
+                    ToolsPluginOnLoad *onload)
+{
+#ifdef USE_APPLOADER
+   /* Trying loading the plugins with system libraries */
+   if (!LoadDependencies((char *) path, FALSE)) {
+      g_warning("Loading of library dependencies for %s failed.\n", entry);
+      return FALSE;
+   }
+#endif
+
+   *module = g_module_open(path, G_MODULE_BIND_LOCAL);
+#ifdef USE_APPLOADER
+   if (*module == NULL) {
+      g_info("Opening plugin '%s' with system libraries failed: %s\n",
+                entry, g_module_error());
+      /* Falling back to the shipped libraries */
+      if (!LoadDependencies((char *) path, TRUE)) {
+         g_warning("Loading of shipped library dependencies for %s failed.\n",
+                  entry);
+         return FALSE;
+      }
+      *module = g_module_open(path, G_MODULE_BIND_LOCAL);
+   }
+#endif
+   if (*module == NULL) {
+      g_warning("Opening plugin '%s' failed: %s.\n", entry, g_module_error());
+      return FALSE;
+   }
+
+   if (!g_module_symbol(*module, "ToolsOnLoad", (gpointer *) onload)) {
+      g_warning("Lookup of plugin entry point for '%s' failed.\n", entry);
+      if (!g_module_close(*module)) {
+         g_warning("Error unloading plugin '%s': %s\n", entry, g_module_error());
+      }
+      *module = NULL;
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+
 /**
  * Loads all the plugins found in the given directory, adding the registration
- * data to the given array.
+ * data to the given array. Plugins that the manifest says can be loaded
+ * lazily are not opened; they are added with what the manifest knows about
+ * them.
  *
- * @param[in]  ctx         Application context.
+ * @param[in]  state       The service state.
  * @param[in]  pluginPath  Path where to look for plugins.
  * @param[out] regs        Array where to store plugin registration info.
  */
 
 static gboolean
-ToolsCoreLoadDirectory(ToolsAppCtx *ctx,
+ToolsCoreLoadDirectory(ToolsServiceState *state,
                        const gchar *pluginPath,
                        GPtrArray *regs)
 {
@@ -536,62 +1241,35 @@ ToolsCoreLoadDirectory(ToolsAppCtx *ctx,
       gchar *path;
       GModule *module = NULL;
       ToolsPlugin *plugin = NULL;
-      ToolsPluginOnLoad onload;
+      ToolsPluginDeferred *deferred = NULL;
+      ToolsPluginOnLoad onload = NULL;
 
       entry = g_ptr_array_index(plugins, i);
       path = g_strdup_printf("%s%c%s", pluginPath, DIRSEPC, entry);
 
       if (!g_file_test(path, G_FILE_TEST_IS_REGULAR)) {
          g_warning("File '%s' is not a regular file, skipping.\n", entry);
-         goto next;
-      }
-
-#ifdef USE_APPLOADER
-      /* Trying loading the plugins with system libraries */
-      if (!LoadDependencies(path, FALSE)) {
-         g_warning("Loading of library dependencies for %s failed.\n", entry);
-         goto next;
+         g_free(path);
+         continue;
       }
-#endif
 
-      module = g_module_open(path, G_MODULE_BIND_LOCAL);
-#ifdef USE_APPLOADER
-      if (module == NULL) {
-         g_info("Opening plugin '%s' with system libraries failed: %s\n",
-                   entry, g_module_error());
-         /* Falling back to the shipped libraries */
-         if (!LoadDependencies(path, TRUE)) {
-            g_warning("Loading of shipped library dependencies for %s failed.\n",
-                     entry);
-            goto next;
-         }
-         module = g_module_open(path, G_MODULE_BIND_LOCAL);
-      }
-#endif
-      if (module == NULL) {
-         g_warning("Opening plugin '%s' failed: %s.\n", entry, g_module_error());
-         goto next;
+      if (state->manifest != NULL) {
+         deferred = ToolsCoreManifestLookup(state, path);
       }
 
-      if (!g_module_symbol(module, "ToolsOnLoad", (gpointer *) &onload)) {
-         g_warning("Lookup of plugin entry point for '%s' failed.\n", entry);
-         goto next;
+      if (deferred == NULL &&
+          !ToolsCoreOpenPlugin(path, entry, &module, &onload)) {
+         g_free(path);
+         continue;
       }
 
-      plugin = g_malloc(sizeof *plugin);
+      plugin = g_new0(ToolsPlugin, 1);
       plugin->fileName = entry;
-      plugin->data = NULL;
+      plugin->path = path;
       plugin->module = module;
       plugin->onload = onload;
+      plugin->deferred = deferred;
       g_ptr_array_add(regs, plugin);
-
-   next:
-      g_free(path);
-      if (plugin == NULL && module != NULL) {
-         if (!g_module_close(module)) {
-            g_warning("Error unloading plugin '%s': %s\n", entry, g_module_error());
-         }
-      }
    }
 
    g_ptr_array_free(plugins, TRUE);
@@ -602,6 +1280,291 @@ exit:
 }
 
 
+/**
+ * Calls a plugin's entry point, and adds the plugin to the list of loaded
+ * plugins if it provided registration data. Records in the manifest what
+ * the plugin registered.
+ *
+ * @param[in]  state    The service state.
+ * @param[in]  plugin   The plugin, opened.
+ *
+ * @return Whether the plugin was added to the list. If not, the caller
+ *         should free it, and stop the service if the plugin provided data.
+ */
+
+static gboolean
+ToolsCoreInitPlugin(ToolsServiceState *state,
+                    ToolsPlugin *plugin)
+{
+   GType type = G_OBJECT_TYPE(state->ctx.serviceObj);
+   VmTimeType start = Hostinfo_SystemTimerUS();
+   guint signalsBefore;
+   guint signalsAfter;
+
+   g_free(g_signal_list_ids(type, &signalsBefore));
+   plugin->data = plugin->onload(&state->ctx);
+   g_free(g_signal_list_ids(type, &signalsAfter));
+
+   if (plugin->data == NULL) {
+      g_info("Plugin '%s' didn't provide deployment data, unloading.\n",
+             plugin->fileName);
+      return FALSE;
+   } else if (state->ctx.errorCode != 0) {
+      /* The plugin has requested the container to quit. */
+      return FALSE;
+   }
+
+   ASSERT(plugin->data->name != NULL);
+   g_module_make_resident(plugin->module);
+   g_ptr_array_add(state->plugins, plugin);
+   VMTools_BindTextDomain(plugin->data->name, NULL, NULL);
+   ToolsCoreManifestRecord(state, plugin, signalsAfter != signalsBefore);
+   g_message("Plugin '%s' initialized in %.3f ms.\n", plugin->data->name,
+             (Hostinfo_SystemTimerUS() - start) / 1000.0);
+   return TRUE;
+}
+
+
+/**
+ * Finds a GuestRPC registered by a loaded plugin.
+ *
+ * @param[in]  state    The service state.
+ * @param[in]  name     Name of the RPC.
+ *
+ * @return The RPC, or NULL.
+ */
+
+static RpcChannelCallback *
+ToolsCoreFindRpc(ToolsServiceState *state,
+                 const gchar *name)
+{
+   guint i;
+
+   for (i = 0; i < state->plugins->len; i++) {
+      ToolsPlugin *plugin = g_ptr_array_index(state->plugins, i);
+      GArray *regs = (plugin->data != NULL) ? plugin->data->regs : NULL;
+      guint j;
+
+      for (j = 0; regs != NULL && j < regs->len; j++) {
+         ToolsAppReg *reg = &g_array_index(regs, ToolsAppReg, j);
+         guint k;
+
+         if (reg->type != TOOLS_APP_GUESTRPC || reg->data == NULL) {
+            continue;
+         }
+         for (k = 0; k < reg->data->len; k++) {
+            RpcChannelCallback *rpc = &g_array_index(reg->data,
+                                                     RpcChannelCallback, k);
+            if (strcmp(rpc->name, name) == 0) {
+               return rpc;
+            }
+         }
+      }
+   }
+   return NULL;
+}
+
+
+/**
+ * Registers the stand-in GuestRPCs of a plugin that is not loaded yet.
+ *
+ * @param[in]  state    The service state.
+ * @param[in]  plugin   The plugin.
+ */
+
+static void
+ToolsCoreRegisterLazyRpcs(ToolsServiceState *state,
+                          ToolsPlugin *plugin)
+{
+   GArray *rpcs = plugin->deferred->rpcs;
+   guint i;
+
+   if (state->ctx.rpc == NULL) {
+      return;
+   }
+
+   for (i = 0; i < rpcs->len; i++) {
+      ToolsLazyRpc *stub = &g_array_index(rpcs, ToolsLazyRpc, i);
+
+      stub->rpc.callback = ToolsCoreLazyRpcCb;
+      stub->rpc.clientData = stub;
+      stub->state = state;
+      stub->plugin = plugin;
+      RpcChannel_RegisterCallback(state->ctx.rpc, &stub->rpc);
+   }
+}
+
+
+/**
+ * Unregisters the stand-in GuestRPCs of a plugin that is not loaded yet.
+ *
+ * @param[in]  state    The service state.
+ * @param[in]  plugin   The plugin.
+ */
+
+static void
+ToolsCoreUnregisterLazyRpcs(ToolsServiceState *state,
+                            ToolsPlugin *plugin)
+{
+   GArray *rpcs = plugin->deferred->rpcs;
+   guint i;
+
+   if (state->ctx.rpc == NULL) {
+      return;
+   }
+
+   for (i = 0; i < rpcs->len; i++) {
+      ToolsLazyRpc *stub = &g_array_index(rpcs, ToolsLazyRpc, i);
+      RpcChannel_UnregisterCallback(state->ctx.rpc, &stub->rpc);
+   }
+}
+
+
+/**
+ * Sends the capabilities of a plugin that was loaded after the capabilities
+ * were registered, and records them in the manifest. What the manifest said
+ * was sent when the capabilities were registered; this updates it.
+ *
+ * @param[in]  state    The service state.
+ * @param[in]  plugin   The plugin.
+ */
+
+static void
+ToolsCoreSendPluginCaps(ToolsServiceState *state,
+                        ToolsPlugin *plugin)
+{
+   GArray *regs = plugin->data->regs;
+   guint i;
+
+   for (i = 0; regs != NULL && i < regs->len; i++) {
+      ToolsAppReg *reg = &g_array_index(regs, ToolsAppReg, i);
+      guint j;
+
+      if (reg->type != TOOLS_APP_SIGNALS || reg->data == NULL) {
+         continue;
+      }
+      for (j = 0; j < reg->data->len; j++) {
+         ToolsPluginSignalCb *sig = &g_array_index(reg->data,
+                                                   ToolsPluginSignalCb, j);
+         ToolsCapsCallback cb = sig->callback;
+         GArray *caps;
+
+         if (strcmp(sig->signame, TOOLS_CORE_SIG_CAPABILITIES) != 0) {
+            continue;
+         }
+
+         caps = cb(state->ctx.serviceObj, &state->ctx, TRUE, sig->clientData);
+         ToolsCoreManifestSetCaps(state, plugin->path, caps);
+         if (caps != NULL) {
+            if (state->ctx.rpc != NULL) {
+               ToolsCore_SetCapabilities(state->ctx.rpc, caps, TRUE);
+            }
+            g_array_free(caps, TRUE);
+         }
+      }
+   }
+}
+
+
+/**
+ * Loads a plugin that was deferred, and registers its applications.
+ *
+ * @param[in]  state    The service state.
+ * @param[in]  plugin   The plugin; freed if it fails to load.
+ */
+
+static void
+ToolsCoreLoadDeferred(ToolsServiceState *state,
+                      ToolsPlugin *plugin)
+{
+   g_ptr_array_remove(state->deferredPlugins, plugin);
+   ToolsCoreUnregisterLazyRpcs(state, plugin);
+   ToolsCoreFreeDeferred(plugin->deferred);
+   plugin->deferred = NULL;
+
+   if (ToolsCoreOpenPlugin(plugin->path, plugin->fileName, &plugin->module,
+                           &plugin->onload) &&
+       ToolsCoreInitPlugin(state, plugin)) {
+      ToolsCoreForEachApp(state, plugin, ToolsCoreRegisterApp);
+      if (state->capsRegistered) {
+         ToolsCoreSendPluginCaps(state, plugin);
+      }
+   } else {
+      gboolean quit = plugin->data != NULL;
+
+      ToolsCoreFreePlugin(plugin);
+      if (quit) {
+         g_main_loop_quit(state->ctx.mainLoop);
+      }
+   }
+
+   if (state->deferredPlugins->len == 0) {
+      state->loadedTime = Hostinfo_SystemTimerUS();
+      g_message("All plugins loaded %.3f ms after start.\n",
+                (state->loadedTime - state->startTime) / 1000.0);
+   }
+}
+
+
+/**
+ * GuestRPC handler standing in for an RPC of a plugin that is not loaded
+ * yet: loads the plugin and hands the RPC to it.
+ *
+ * @param[in]  data     RPC request data.
+ *
+ * @return Whatever the plugin's handler returns.
+ */
+
+static gboolean
+ToolsCoreLazyRpcCb(RpcInData *data)
+{
+   ToolsLazyRpc *stub = data->clientData;
+   ToolsServiceState *state = stub->state;
+   RpcChannelCallback *rpc;
+
+   g_debug("RPC '%s' loads plugin '%s'.\n", data->name,
+           stub->plugin->fileName);
+
+   /* This frees the stub. */
+   ToolsCoreLoadDeferred(state, stub->plugin);
+
+   rpc = ToolsCoreFindRpc(state, data->name);
+   if (rpc == NULL || rpc->xdrIn != NULL || rpc->xdrOut != NULL) {
+      return RPCIN_SETRETVALS(data, "Unknown Command", FALSE);
+   }
+
+   data->clientData = rpc->clientData;
+   return rpc->callback(data);
+}
+
+
+/**
+ * Idle callback that loads the deferred plugins, one per call, so that the
+ * service can handle requests in between.
+ *
+ * @param[in]  _state   The service state.
+ *
+ * @return Whether there are more plugins to load.
+ */
+
+static gboolean
+ToolsCoreLoadNextCb(gpointer _state)
+{
+   ToolsServiceState *state = _state;
+
+   if (state->deferredPlugins->len > 0) {
+      ToolsCoreLoadDeferred(state,
+                            g_ptr_array_index(state->deferredPlugins, 0));
+   }
+
+   if (state->deferredPlugins->len == 0) {
+      state->deferredLoadTask = 0;
+      return FALSE;
+   }
+   return TRUE;
+}
+
+
 /**
  * State dump callback for logging information about loaded plugins.
  *
@@ -616,6 +1579,17 @@ ToolsCore_DumpPluginInfo(ToolsServiceState *state)
    } else {
       ToolsCoreForEachPlugin(state, ToolsCoreDumpPluginInfo, ToolsCoreDumpAppInfo);
    }
+
+   if (state->deferredPlugins != NULL) {
+      guint i;
+
+      for (i = 0; i < state->deferredPlugins->len; i++) {
+         ToolsPlugin *plugin = g_ptr_array_index(state->deferredPlugins, i);
+         ToolsCore_LogState(TOOLS_STATE_LOG_CONTAINER,
+                            "Plugin: %s (not loaded yet)\n",
+                            plugin->deferred->name);
+      }
+   }
 }
 
 
@@ -637,6 +1611,7 @@ ToolsCore_LoadPlugins(ToolsServiceState *state)
    gchar *pluginRoot;
    guint i;
    GPtrArray *plugins = NULL;
+   VmTimeType start = Hostinfo_SystemTimerUS();
 
 #if defined(sun) && defined(__x86_64__)
    const char *subdir = "/amd64";
@@ -671,6 +1646,15 @@ ToolsCore_LoadPlugins(ToolsServiceState *state)
    }
 #endif
 
+   /*
+    * Plugins known from a previous run to only provide GuestRPCs and handle
+    * a few signals are loaded lazily, if so configured.
+    */
+   if (g_key_file_get_boolean(state->ctx.config, state->name,
+                              "plugins.lazyLoad", NULL)) {
+      ToolsCoreManifestLoad(state);
+   }
+
    plugins = g_ptr_array_new();
 
    /*
@@ -689,7 +1673,7 @@ ToolsCore_LoadPlugins(ToolsServiceState *state)
    }
 
    if (g_file_test(state->commonPath, G_FILE_TEST_IS_DIR) &&
-       !ToolsCoreLoadDirectory(&state->ctx, state->commonPath, plugins)) {
+       !ToolsCoreLoadDirectory(state, state->commonPath, plugins)) {
       goto exit;
    }
 
@@ -713,7 +1697,7 @@ ToolsCore_LoadPlugins(ToolsServiceState *state)
    }
 
    if (pluginDirExists &&
-       !ToolsCoreLoadDirectory(&state->ctx, state->pluginPath, plugins)) {
+       !ToolsCoreLoadDirectory(state, state->pluginPath, plugins)) {
       goto exit;
    }
 
@@ -723,28 +1707,27 @@ ToolsCore_LoadPlugins(ToolsServiceState *state)
     */
 
    state->plugins = g_ptr_array_new();
+   state->deferredPlugins = g_ptr_array_new();
 
    for (i = 0; i < plugins->len; i++) {
       ToolsPlugin *plugin = g_ptr_array_index(plugins, i);
 
-      plugin->data = plugin->onload(&state->ctx);
-
-      if (plugin->data == NULL) {
-         g_info("Plugin '%s' didn't provide deployment data, unloading.\n",
-                plugin->fileName);
-         ToolsCoreFreePlugin(plugin);
-      } else if (state->ctx.errorCode != 0) {
+      if (plugin->deferred != NULL) {
+         g_debug("Plugin '%s' will be loaded later.\n", plugin->deferred->name);
+         g_ptr_array_add(state->deferredPlugins, plugin);
+      } else if (!ToolsCoreInitPlugin(state, plugin)) {
          /* Break early if a plugin has requested the container to quit. */
+         gboolean quit = plugin->data != NULL;
+
          ToolsCoreFreePlugin(plugin);
-         break;
-      } else {
-         ASSERT(plugin->data->name != NULL);
-         g_module_make_resident(plugin->module);
-         g_ptr_array_add(state->plugins, plugin);
-         VMTools_BindTextDomain(plugin->data->name, NULL, NULL);
-         g_message("Plugin '%s' initialized.\n", plugin->data->name);
+         if (quit) {
+            break;
+         }
       }
    }
+   g_message("%u plugins loaded, %u deferred, in %.3f ms.\n",
+             state->plugins->len, state->deferredPlugins->len,
+             (Hostinfo_SystemTimerUS() - start) / 1000.0);
 
 
    /*
@@ -753,9 +1736,7 @@ ToolsCore_LoadPlugins(ToolsServiceState *state)
     */
    if (state->debugData != NULL && state->debugData->debugPlugin->plugin != NULL) {
       ToolsPluginData *data = state->debugData->debugPlugin->plugin;
-      ToolsPlugin *plugin = g_malloc(sizeof *plugin);
-      plugin->fileName = NULL;
-      plugin->module = NULL;
+      ToolsPlugin *plugin = g_new0(ToolsPlugin, 1);
       plugin->data = data;
       VMTools_BindTextDomain(data->name, NULL, NULL);
       g_ptr_array_add(state->plugins, plugin);
@@ -783,6 +1764,7 @@ ToolsCore_RegisterPlugins(ToolsServiceState *state)
 {
    ToolsAppProvider *fakeProv;
    ToolsAppProviderReg fakeReg;
+   guint i;
 
    if (state->plugins == NULL) {
       return;
@@ -852,6 +1834,95 @@ ToolsCore_RegisterPlugins(ToolsServiceState *state)
     * individual app providers as necessary.
     */
    ToolsCoreForEachPlugin(state, NULL, ToolsCoreRegisterApp);
+
+   /*
+    * Deferred plugins are loaded when one of their RPCs is received, or when
+    * the service is idle.
+    */
+   for (i = 0; i < state->deferredPlugins->len; i++) {
+      ToolsCoreRegisterLazyRpcs(state,
+                                g_ptr_array_index(state->deferredPlugins, i));
+   }
+
+   if (state->deferredPlugins->len > 0) {
+      GSource *src = g_idle_source_new();
+
+      g_source_set_priority(src, G_PRIORITY_LOW);
+      g_source_set_callback(src, ToolsCoreLoadNextCb, state, NULL);
+      state->deferredLoadTask =
+         g_source_attach(src, g_main_loop_get_context(state->ctx.mainLoop));
+      g_source_unref(src);
+   } else {
+      state->loadedTime = Hostinfo_SystemTimerUS();
+   }
+}
+
+
+/**
+ * Loads the deferred plugins that connect to the given signal, so that they
+ * see it when it's emitted.
+ *
+ * @param[in]  state    The service state.
+ * @param[in]  signame  Signal name.
+ */
+
+void
+ToolsCore_LoadDeferredPlugins(ToolsServiceState *state,
+                              const gchar *signame)
+{
+   guint i = 0;
+
+   if (state->deferredPlugins == NULL) {
+      return;
+   }
+
+   while (i < state->deferredPlugins->len) {
+      ToolsPlugin *plugin = g_ptr_array_index(state->deferredPlugins, i);
+      gchar **sig;
+
+      for (sig = plugin->deferred->signals; *sig != NULL; sig++) {
+         if (strcmp(*sig, signame) == 0) {
+            break;
+         }
+      }
+
+      if (*sig != NULL) {
+         ToolsCoreLoadDeferred(state, plugin);
+      } else {
+         i++;
+      }
+   }
+}
+
+
+/**
+ * Adds the capabilities of the deferred plugins, as recorded in the manifest,
+ * to the given array. The names of the capabilities belong to the plugins,
+ * so the array should be freed before loading any.
+ *
+ * @param[in]     state    The service state.
+ * @param[in,out] caps     The capabilities; allocated if NULL.
+ */
+
+void
+ToolsCore_AddDeferredCapabilities(ToolsServiceState *state,
+                                  GArray **caps)
+{
+   guint i;
+
+   for (i = 0; state->deferredPlugins != NULL &&
+               i < state->deferredPlugins->len; i++) {
+      ToolsPlugin *plugin = g_ptr_array_index(state->deferredPlugins, i);
+      GArray *pcaps = plugin->deferred->caps;
+
+      if (pcaps->len == 0) {
+         continue;
+      }
+      if (*caps == NULL) {
+         *caps = g_array_new(FALSE, TRUE, sizeof (ToolsAppCapability));
+      }
+      g_array_append_vals(*caps, pcaps->data, pcaps->len);
+   }
 }
 
 
@@ -877,6 +1948,11 @@ ToolsCore_UnloadPlugins(ToolsServiceState *state)
       return;
    }
 
+   if (state->deferredLoadTask != 0) {
+      g_source_remove(state->deferredLoadTask);
+      state->deferredLoadTask = 0;
+   }
+
    if (state->capsRegistered) {
       GArray *pcaps = NULL;
       g_signal_emit_by_name(state->ctx.serviceObj,
@@ -884,6 +1960,7 @@ ToolsCore_UnloadPlugins(ToolsServiceState *state)
                             &state->ctx,
                             FALSE,
                             &pcaps);
+      ToolsCore_AddDeferredCapabilities(state, &pcaps);
 
       if (pcaps != NULL) {
          if (state->ctx.rpc) {
@@ -944,4 +2021,26 @@ ToolsCore_UnloadPlugins(ToolsServiceState *state)
 
    g_ptr_array_free(state->plugins, TRUE);
    state->plugins = NULL;
+
+   while (state->deferredPlugins->len > 0) {
+      ToolsPlugin *plugin = g_ptr_array_index(state->deferredPlugins, 0);
+
+      ToolsCoreUnregisterLazyRpcs(state, plugin);
+      g_ptr_array_remove_index(state->deferredPlugins, 0);
+      ToolsCoreFreePlugin(plugin);
+   }
+   g_ptr_array_free(state->deferredPlugins, TRUE);
+   state->deferredPlugins = NULL;
+
+   if (state->manifest != NULL) {
+      if (state->manifestSaveTask != 0) {
+         g_source_remove(state->manifestSaveTask);
+         state->manifestSaveTask = 0;
+      }
+      ToolsCoreManifestSave(state);
+      g_key_file_free(state->manifest);
+      state->manifest = NULL;
+      g_free(state->manifestPath);
+      state->manifestPath = NULL;
+   }
 }
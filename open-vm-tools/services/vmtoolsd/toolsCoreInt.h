@@ -32,6 +32,7 @@
 #include <glib-object.h>
 #include <gmodule.h>
 #include <time.h>
+#include "vm_basic_types.h"
 #include "vmware/tools/plugin.h"
 #include "vmware/tools/rpcdebug.h"
 
@@ -76,6 +77,20 @@ typedef struct ToolsServiceState {
    gchar         *commonPath;
    gchar         *pluginPath;
    GPtrArray     *plugins;
+   /*
+    * Lazy plugin loading: plugins not loaded yet, the manifest of what
+    * each plugin registers, and the task loading them in the background.
+    */
+   GPtrArray     *deferredPlugins;
+   GKeyFile      *manifest;
+   gchar         *manifestPath;
+   gboolean       manifestDirty;
+   guint          manifestSaveTask;
+   guint          deferredLoadTask;
+   /* Startup timing, in microseconds of the system timer. */
+   VmTimeType     startTime;
+   VmTimeType     readyTime;
+   VmTimeType     loadedTime;
 #if defined(_WIN32)
    gchar         *displayName;
 #else
@@ -131,9 +146,17 @@ void
 ToolsCore_ReleaseVsockFamily(ToolsServiceState *state);
 #endif
 
+void
+ToolsCore_AddDeferredCapabilities(ToolsServiceState *state,
+                                  GArray **caps);
+
 gboolean
 ToolsCore_LoadPlugins(ToolsServiceState *state);
 
+void
+ToolsCore_LoadDeferredPlugins(ToolsServiceState *state,
+                              const gchar *signame);
+
 void
 ToolsCore_ReloadConfig(ToolsServiceState *state,
                        gboolean reset);
@@ -132,6 +132,7 @@ ToolsCoreRpcCapReg(RpcInData *data)
                          &state->ctx,
                          TRUE,
                          &pcaps);
+   ToolsCore_AddDeferredCapabilities(state, &pcaps);
 
    if (pcaps != NULL) {
       ToolsCore_SetCapabilities(state->ctx.rpc, pcaps, TRUE);
@@ -252,6 +253,7 @@ ToolsCoreRpcSetOption(RpcInData *data)
    if (option != NULL && value != NULL && strlen(value) != 0) {
 
       g_debug("Setting option '%s' to '%s'.\n", option, value);
+      ToolsCore_LoadDeferredPlugins(state, TOOLS_CORE_SIG_SET_OPTION);
       g_signal_emit_by_name(state->ctx.serviceObj,
                             TOOLS_CORE_SIG_SET_OPTION,
                             &state->ctx,
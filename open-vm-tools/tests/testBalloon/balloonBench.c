@@ -0,0 +1,214 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * balloonBench.c --
+ *
+ *   Trace-driven comparison of the balloon inflation policies. Each trace
+ *   scripts the balloon target and the guest workload over time, and is
+ *   run against the simulated guest with the fixed and the adaptive rate
+ *   policies. For each run, reports:
+ *
+ *   - lag: how much memory the balloon held less than its target, summed
+ *     over the cycles (GB * cycles), what the host waits for;
+ *   - reach: cycles it took to first get to the target;
+ *   - swap out, swap in, stalls: what the guest paid for it, in pages;
+ *   - allocs, fails: page allocations made by the driver.
+ *
+ *   Usage: vmware-testballoon-bench [trace]
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "balloonSim.h"
+
+#define MB2PAGES(mb)    ((mb) * 256)
+#define WARMUP_CYCLES   30
+#define MAX_STEPS       8
+
+typedef struct TraceStep {
+   uint32 cycle;
+   uint32 target;           // in MB
+   uint32 workload;         // in MB
+} TraceStep;
+
+typedef struct Trace {
+   const char *name;
+   uint32 cycles;
+   TraceStep steps[MAX_STEPS];
+} Trace;
+
+/* Cycles are relative to the end of the warm up. */
+static const Trace traces[] = {
+   /* Idle guest, the file cache fills its memory. */
+   { "idle", 240, {
+      { 0, 640, 128 }, { 90, 128, 128 }, { 120, 640, 128 },
+   } },
+   /* Busy guest, the target fits in what the workload leaves. */
+   { "busy", 240, {
+      { 0, 384, 512 },
+   } },
+   /* Busy guest, the target does not fit: the guest has to swap. */
+   { "overcommit", 240, {
+      { 0, 384, 768 },
+   } },
+   /* The workload spikes beyond what the balloon leaves. */
+   { "spikes", 240, {
+      { 0, 384, 256 }, { 20, 384, 640 }, { 30, 384, 256 }, { 60, 384, 640 },
+      { 70, 384, 256 }, { 100, 384, 640 }, { 110, 384, 256 },
+   } },
+   /* The target goes up and down. */
+   { "churn", 240, {
+      { 0, 128, 256 }, { 20, 512, 256 }, { 60, 128, 256 }, { 80, 512, 256 },
+      { 120, 128, 256 }, { 140, 512, 256 }, { 180, 128, 256 },
+      { 200, 512, 256 },
+   } },
+};
+
+static const SimGuestConfig guestConfig = {
+   .totalPages = MB2PAGES(1024),
+   .swapPages = MB2PAGES(512),
+   .minFree = MB2PAGES(4),
+   .lowFree = MB2PAGES(8),
+   .highFree = MB2PAGES(16),
+   .reclaimRate = MB2PAGES(128),
+   .cacheGrowth = MB2PAGES(32),
+   .touchPercent = 5,
+   .largeFrames = 0,
+};
+
+typedef struct BenchResult {
+   double lag;
+   int reach;
+   SimCounters counters;
+   Bool ok;
+} BenchResult;
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * RunTrace --
+ *
+ *    Runs a trace with a policy, after warming up the guest with the first
+ *    step's workload and no balloon.
+ *
+ * Results:
+ *    The measures of the run.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+RunTrace(const Trace *trace,        // IN:
+         BalloonRatePolicy policy,  // IN:
+         BenchResult *result)       // OUT:
+{
+   uint64 lagPages = 0;
+   uint32 target = 0;
+   int step = 0;
+   uint32 cycle;
+
+   memset(result, 0, sizeof *result);
+   result->reach = -1;
+   result->ok = TRUE;
+
+   Sim_Init(&guestConfig, BALLOON_BASIC_CMDS | BALLOON_BATCHED_CMDS);
+   Balloon_Init(BALLOON_GUEST_LINUX);
+   Balloon_SetRatePolicy(policy);
+
+   Sim_Workload(MB2PAGES(trace->steps[0].workload));
+   for (cycle = 0; cycle < WARMUP_CYCLES; cycle++) {
+      Sim_Cycle();
+   }
+   memset(&simGuest.counters, 0, sizeof simGuest.counters);
+
+   for (cycle = 0; cycle < trace->cycles; cycle++) {
+      uint32 nPages;
+
+      if (step < MAX_STEPS && trace->steps[step].cycle == cycle &&
+          (step == 0 || cycle != 0)) {
+         target = MB2PAGES(trace->steps[step].target);
+         simMonitor.target = target;
+         Sim_Workload(MB2PAGES(trace->steps[step].workload));
+         step++;
+      }
+
+      Sim_Cycle();
+      result->ok = result->ok && Sim_Check();
+
+      nPages = Balloon_GetStats()->nPages;
+      if (nPages < target) {
+         lagPages += target - nPages;
+      } else if (result->reach < 0) {
+         result->reach = cycle + 1;
+      }
+   }
+
+   result->lag = lagPages / (double)MB2PAGES(1024);
+   result->counters = simGuest.counters;
+
+   Balloon_Cleanup();
+   result->ok = result->ok && simGuest.balloonPages == 0;
+   Sim_Exit();
+}
+
+
+int
+main(int argc,     // IN:
+     char **argv)  // IN:
+{
+   static const char *policies[] = { "fixed", "adaptive" };
+   Bool ok = TRUE;
+   int i;
+
+   printf("%-10s %-8s %9s %5s %9s %9s %9s %9s %7s\n", "trace", "policy",
+          "lag GB*s", "reach", "swap out", "swap in", "stalls", "allocs",
+          "fails");
+
+   for (i = 0; i < ARRAYSIZE(traces); i++) {
+      BalloonRatePolicy policy;
+
+      if (argc > 1 && strcmp(argv[1], traces[i].name) != 0) {
+         continue;
+      }
+
+      for (policy = BALLOON_RATE_POLICY_FIXED;
+           policy <= BALLOON_RATE_POLICY_ADAPTIVE;
+           policy++) {
+         BenchResult r;
+
+         RunTrace(&traces[i], policy, &r);
+         printf("%-10s %-8s %9.2f %5d %9llu %9llu %9llu %9llu %7llu%s\n",
+                traces[i].name, policies[policy], r.lag, r.reach,
+                (unsigned long long)r.counters.swapOuts,
+                (unsigned long long)r.counters.swapIns,
+                (unsigned long long)r.counters.stalls,
+                (unsigned long long)r.counters.allocs,
+                (unsigned long long)r.counters.allocFails,
+                r.ok ? "" : "  INCONSISTENT");
+         ok = ok && r.ok;
+      }
+   }
+
+   return ok ? 0 : 1;
+}
@@ -0,0 +1,888 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * balloonSim.c --
+ *
+ *   Userspace implementation of the OS interface (os.h) and of the monitor
+ *   backdoor (backdoor_balloon.h) of the balloon driver, on top of a
+ *   simple model of guest memory.
+ *
+ *   Guest memory is made of the workload's pages, the file cache, the
+ *   balloon's pages and free pages. No-sleep allocations only get free
+ *   pages above the minimum; sleeping allocations and the workload then
+ *   reclaim the cache, and then swap workload pages out. Each cycle the
+ *   workload pages some of its swapped pages back in, and a background
+ *   reclaim keeps free pages between the low and high marks.
+ *
+ *   The pressure reported to the driver is PSI-like: the share of the
+ *   workload's accesses in the last cycle that stalled on reclaim or swap,
+ *   or how close free and cache pages are to the minimum, whichever is
+ *   higher.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "os.h"
+#include "backdoor_balloon.h"
+#include "balloonSim.h"
+
+#define SIM_PAGE_FREE           0
+#define SIM_PAGE_RESERVED       1
+#define SIM_PAGE_LOCKED         2
+
+SimGuest simGuest;
+SimMonitor simMonitor;
+
+static Balloon *simBalloon;
+static uint8 *pageState;
+static uint32 numPpns;
+static uint32 *smallFree;
+static uint32 numSmallFree;
+static uint32 *largeFree;
+static uint32 numLargeFree;
+static uint32 pinCount;
+static uint32 workloadDemand;
+static uint64 cycleStalls;
+static uint32 stallPressure;
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Panic --
+ *
+ *    Reports a failed assertion of the driver.
+ *
+ * Results:
+ *    Does not return.
+ *
+ * Side effects:
+ *    Aborts.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+void
+Panic(const char *fmt,  // IN:
+      ...)              // IN:
+{
+   va_list args;
+
+   va_start(args, fmt);
+   vfprintf(stderr, fmt, args);
+   va_end(args);
+   abort();
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Sim_FreePages --
+ *
+ *    Counts the free pages of the guest.
+ *
+ * Results:
+ *    Free pages.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+uint32
+Sim_FreePages(void)
+{
+   SimGuest *g = &simGuest;
+   uint32 used = g->anonPages + g->cachePages + g->balloonPages;
+
+   return used < g->config.totalPages ? g->config.totalPages - used : 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * SimObtain --
+ *
+ *    Finds pages for the workload or for a sleeping allocation: free pages
+ *    above the minimum first, then the file cache, then workload pages
+ *    that are swapped out.
+ *
+ * Results:
+ *    Number of pages found, up to n. The caller accounts for them.
+ *
+ * Side effects:
+ *    Shrinks the cache and swaps out.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static uint32
+SimObtain(uint32 n,         // IN:
+          uint64 *stalls)   // IN/OUT: pages that had to be reclaimed
+{
+   SimGuest *g = &simGuest;
+   uint32 freePages = Sim_FreePages();
+   uint32 got = 0;
+   uint32 take;
+
+   take = 0;
+   if (freePages > g->config.minFree) {
+      take = MIN(n, freePages - g->config.minFree);
+   }
+   got += take;
+   n -= take;
+
+   take = MIN(n, g->cachePages);
+   g->cachePages -= take;
+   got += take;
+   n -= take;
+   *stalls += take;
+
+   take = MIN(n, MIN(g->anonPages, g->config.swapPages - g->swappedPages));
+   g->anonPages -= take;
+   g->swappedPages += take;
+   g->counters.swapOuts += take;
+   got += take;
+   *stalls += take;
+
+   return got;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * SimUnlockAll --
+ *
+ *    The monitor forgets about the balloon, as on a reset: locked pages
+ *    go back to the guest, still reserved by the driver.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+SimUnlockAll(void)
+{
+   uint32 ppn;
+
+   for (ppn = 0; ppn < numPpns; ppn++) {
+      if (pageState[ppn] == SIM_PAGE_LOCKED) {
+         pageState[ppn] = SIM_PAGE_RESERVED;
+      }
+   }
+   simMonitor.lockedPages = 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Sim_Init --
+ *
+ *    Sets up an empty guest, and a monitor with the given capabilities and
+ *    no balloon target.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+void
+Sim_Init(const SimGuestConfig *config,              // IN:
+         BalloonCapabilities capabilities)          // IN:
+{
+   uint32 i;
+
+   memset(&simGuest, 0, sizeof simGuest);
+   memset(&simMonitor, 0, sizeof simMonitor);
+   simGuest.config = *config;
+   simMonitor.capabilities = capabilities;
+   simBalloon = NULL;
+   pinCount = 0;
+   workloadDemand = 0;
+   cycleStalls = 0;
+   stallPressure = 0;
+
+   /* Small pages come first, then the 2MB frames. */
+   numPpns = config->totalPages + config->largeFrames * OS_LARGE_2_SMALL_PAGES;
+   pageState = calloc(numPpns, sizeof *pageState);
+   smallFree = malloc(config->totalPages * sizeof *smallFree);
+   largeFree = malloc((config->largeFrames + 1) * sizeof *largeFree);
+
+   for (numSmallFree = 0; numSmallFree < config->totalPages; numSmallFree++) {
+      smallFree[numSmallFree] = config->totalPages - 1 - numSmallFree;
+   }
+   for (numLargeFree = 0, i = config->largeFrames; i > 0; i--) {
+      largeFree[numLargeFree++] = config->totalPages +
+                                  (i - 1) * OS_LARGE_2_SMALL_PAGES;
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Sim_Exit --
+ *
+ *    Releases the simulation.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+void
+Sim_Exit(void)
+{
+   free(pageState);
+   free(smallFree);
+   free(largeFree);
+   pageState = NULL;
+   smallFree = NULL;
+   largeFree = NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Sim_Workload --
+ *
+ *    Sets how many pages the workload wants from the next cycle on.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+void
+Sim_Workload(uint32 demand) // IN:
+{
+   workloadDemand = demand;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Sim_Cycle --
+ *
+ *    Runs the guest for one balloon cycle: the workload grows or shrinks
+ *    and touches its swapped pages, the background reclaim and the cache
+ *    run, and the driver polls the monitor.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Runs Balloon_QueryAndExecute.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+void
+Sim_Cycle(void)
+{
+   SimGuest *g = &simGuest;
+   uint32 cur = g->anonPages + g->swappedPages;
+   uint32 freePages;
+   uint32 cache;
+   uint32 n;
+
+   cycleStalls = 0;
+
+   if (workloadDemand > cur) {
+      uint32 got = SimObtain(workloadDemand - cur, &cycleStalls);
+
+      g->anonPages += got;
+      g->counters.oom += workloadDemand - cur - got;
+   } else {
+      n = MIN(cur - workloadDemand, g->swappedPages);
+      g->swappedPages -= n;
+      g->anonPages -= cur - workloadDemand - n;
+   }
+
+   /* The workload touches some of its swapped pages. */
+   n = g->swappedPages * g->config.touchPercent / 100;
+   if (n == 0 && g->swappedPages > 0 && g->config.touchPercent > 0) {
+      n = 1;
+   }
+   if (n > 0) {
+      uint32 got;
+
+      g->swappedPages -= n;
+      got = SimObtain(n, &cycleStalls);
+      g->swappedPages += n - got;
+      g->anonPages += got;
+      g->counters.swapIns += got;
+      cycleStalls += got;
+   }
+   g->counters.stalls += cycleStalls;
+
+   /* Background reclaim, then the file cache. */
+   freePages = Sim_FreePages();
+   if (freePages < g->config.lowFree) {
+      n = MIN(g->config.highFree - freePages, g->config.reclaimRate);
+      cache = MIN(n, g->cachePages);
+      g->cachePages -= cache;
+      n -= cache;
+      n = MIN(n, MIN(g->anonPages, g->config.swapPages - g->swappedPages));
+      g->anonPages -= n;
+      g->swappedPages += n;
+      g->counters.swapOuts += n;
+   }
+   freePages = Sim_FreePages();
+   if (freePages > g->config.highFree) {
+      g->cachePages += MIN(g->config.cacheGrowth,
+                           freePages - g->config.highFree);
+   }
+
+   stallPressure = MIN(cycleStalls * 100 / (g->config.totalPages / 64 + 1),
+                       100);
+
+   Balloon_QueryAndExecute();
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Sim_Pressure --
+ *
+ *    Computes the pressure reported to the driver: the share of the last
+ *    cycle's workload accesses that stalled, or how close free and cache
+ *    pages are to the minimum right now, whichever is higher.
+ *
+ * Results:
+ *    Pressure, in percent.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+uint32
+Sim_Pressure(void)
+{
+   SimGuest *g = &simGuest;
+   uint32 avail = Sim_FreePages() + g->cachePages;
+   uint32 level;
+
+   if (avail >= g->config.highFree) {
+      level = 0;
+   } else if (avail <= g->config.minFree) {
+      level = 100;
+   } else {
+      level = (g->config.highFree - avail) * 100 /
+              (g->config.highFree - g->config.minFree);
+   }
+   return MAX(level, stallPressure);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Sim_Check --
+ *
+ *    Checks that the driver and the monitor agree on the balloon: the
+ *    driver's size is what the monitor has locked, the driver holds no
+ *    other page than its batch page, and it broke no protocol rule.
+ *
+ * Results:
+ *    TRUE if they agree.
+ *
+ * Side effects:
+ *    Prints what is wrong.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+Bool
+Sim_Check(void)
+{
+   const BalloonStats *stats = Balloon_GetStats();
+   uint32 reserved = simGuest.balloonPages - simMonitor.lockedPages;
+   Bool ok = TRUE;
+
+   if (simMonitor.errors != 0) {
+      fprintf(stderr, "  %u protocol errors\n", simMonitor.errors);
+      ok = FALSE;
+   }
+   if (simBalloon == NULL || simBalloon->resetFlag) {
+      /* The driver has yet to catch up with a reset. */
+      return ok;
+   }
+   if (stats->nPages != simMonitor.lockedPages) {
+      fprintf(stderr, "  driver has %u pages, monitor locked %u\n",
+              stats->nPages, simMonitor.lockedPages);
+      ok = FALSE;
+   }
+   if (reserved != (simBalloon->batchPage != NULL ? 1 : 0)) {
+      fprintf(stderr, "  driver holds %u unlocked pages\n", reserved);
+      ok = FALSE;
+   }
+   return ok;
+}
+
+
+/*
+ * OS interface.
+ */
+
+void
+OS_MemZero(void *ptr,   // OUT:
+           size_t size) // IN:
+{
+   memset(ptr, 0, size);
+}
+
+
+void
+OS_MemCopy(void *dest,      // OUT:
+           const void *src, // IN:
+           size_t size)     // IN:
+{
+   memcpy(dest, src, size);
+}
+
+
+void *
+OS_Malloc(size_t size) // IN:
+{
+   return malloc(size);
+}
+
+
+void
+OS_Free(void *ptr,   // IN:
+        size_t size) // IN:
+{
+   free(ptr);
+}
+
+
+void
+OS_Yield(void)
+{
+}
+
+
+unsigned int
+OS_MemoryPressure(void)
+{
+   return Sim_Pressure();
+}
+
+
+unsigned long
+OS_ReservedPageGetLimit(void)
+{
+   return simGuest.config.totalPages;
+}
+
+
+PA64
+OS_ReservedPageGetPA(PageHandle handle) // IN:
+{
+   return PPN_2_PA(handle - 1);
+}
+
+
+PageHandle
+OS_ReservedPageGetHandle(PA64 pa) // IN:
+{
+   return PA_2_PPN(pa) + 1;
+}
+
+
+PageHandle
+OS_ReservedPageAlloc(int canSleep,    // IN:
+                     int isLargePage) // IN:
+{
+   SimGuest *g = &simGuest;
+   uint32 ppn;
+
+   g->counters.allocs++;
+
+   if (isLargePage) {
+      if (numLargeFree == 0 ||
+          Sim_FreePages() < g->config.minFree + OS_LARGE_2_SMALL_PAGES) {
+         g->counters.allocFails++;
+         return PAGE_HANDLE_INVALID;
+      }
+      ppn = largeFree[--numLargeFree];
+      g->balloonPages += OS_LARGE_2_SMALL_PAGES;
+   } else {
+      uint64 stalls = 0;
+
+      if (Sim_FreePages() <= g->config.minFree &&
+          (!canSleep || SimObtain(1, &stalls) == 0)) {
+         g->counters.allocFails++;
+         return PAGE_HANDLE_INVALID;
+      }
+      VERIFY(numSmallFree > 0);
+      ppn = smallFree[--numSmallFree];
+      g->balloonPages++;
+   }
+
+   VERIFY(pageState[ppn] == SIM_PAGE_FREE);
+   pageState[ppn] = SIM_PAGE_RESERVED;
+   return ppn + 1;
+}
+
+
+void
+OS_ReservedPageFree(PageHandle handle, // IN:
+                    int isLargePage)   // IN:
+{
+   uint32 ppn = handle - 1;
+
+   VERIFY(ppn < numPpns);
+   if (pageState[ppn] != SIM_PAGE_RESERVED) {
+      /* Freeing a page the monitor still has, or freeing it twice. */
+      simMonitor.errors++;
+      return;
+   }
+   pageState[ppn] = SIM_PAGE_FREE;
+
+   if (isLargePage) {
+      VERIFY(ppn >= simGuest.config.totalPages);
+      largeFree[numLargeFree++] = ppn;
+      simGuest.balloonPages -= OS_LARGE_2_SMALL_PAGES;
+   } else {
+      VERIFY(ppn < simGuest.config.totalPages);
+      smallFree[numSmallFree++] = ppn;
+      simGuest.balloonPages--;
+   }
+}
+
+
+Mapping
+OS_MapPageHandle(PageHandle handle) // IN:
+{
+   void *page;
+
+   if (posix_memalign(&page, PAGE_SIZE, PAGE_SIZE) != 0) {
+      return MAPPING_INVALID;
+   }
+   memset(page, 0, PAGE_SIZE);
+   return (Mapping)page;
+}
+
+
+void *
+OS_Mapping2Addr(Mapping mapping) // IN:
+{
+   return (void *)mapping;
+}
+
+
+void
+OS_UnmapPage(Mapping mapping) // IN:
+{
+   free((void *)mapping);
+}
+
+
+/*
+ * Monitor backdoor.
+ */
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * SimCommand --
+ *
+ *    Common start of the monitor commands: fails the command if a reset
+ *    is pending.
+ *
+ * Results:
+ *    BALLOON_SUCCESS, or BALLOON_ERROR_RESET.
+ *
+ * Side effects:
+ *    On reset, the monitor unlocks all the pages.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static int
+SimCommand(Balloon *b) // IN/OUT:
+{
+   simBalloon = b;
+   if (simMonitor.resetPending) {
+      simMonitor.resetPending = FALSE;
+      SimUnlockAll();
+      b->resetFlag = 1;
+      return BALLOON_ERROR_RESET;
+   }
+   return BALLOON_SUCCESS;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * SimLock --
+ *
+ *    Locks one page or 2MB frame, like the monitor would.
+ *
+ * Results:
+ *    A balloon status.
+ *
+ * Side effects:
+ *    Counts protocol errors.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static int
+SimLock(PPN64 ppn,       // IN:
+        int isLargePage) // IN:
+{
+   uint32 size = isLargePage ? OS_LARGE_2_SMALL_PAGES : 1;
+
+   if (ppn >= numPpns ||
+       (isLargePage != (ppn >= simGuest.config.totalPages)) ||
+       pageState[ppn] != SIM_PAGE_RESERVED) {
+      simMonitor.errors++;
+      return BALLOON_ERROR_PPN_INVALID;
+   }
+   if (simMonitor.pinnedEvery != 0 &&
+       ++pinCount % simMonitor.pinnedEvery == 0) {
+      return BALLOON_ERROR_PPN_PINNED;
+   }
+   if (simMonitor.lockedPages >= simMonitor.target) {
+      return BALLOON_ERROR_PPN_NOTNEEDED;
+   }
+   pageState[ppn] = SIM_PAGE_LOCKED;
+   simMonitor.lockedPages += size;
+   return BALLOON_SUCCESS;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * SimUnlock --
+ *
+ *    Unlocks one page or 2MB frame, like the monitor would.
+ *
+ * Results:
+ *    A balloon status.
+ *
+ * Side effects:
+ *    Counts protocol errors.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static int
+SimUnlock(PPN64 ppn,       // IN:
+          int isLargePage) // IN:
+{
+   if (ppn >= numPpns ||
+       (isLargePage != (ppn >= simGuest.config.totalPages)) ||
+       pageState[ppn] != SIM_PAGE_LOCKED) {
+      simMonitor.errors++;
+      return BALLOON_ERROR_PPN_UNLOCKED;
+   }
+   pageState[ppn] = SIM_PAGE_RESERVED;
+   simMonitor.lockedPages -= isLargePage ? OS_LARGE_2_SMALL_PAGES : 1;
+   return BALLOON_SUCCESS;
+}
+
+
+int
+Backdoor_MonitorStart(Balloon *b,          // IN/OUT:
+                      uint32 protoVersion) // IN:
+{
+   uint32 capabilities = protoVersion & simMonitor.capabilities;
+
+   simBalloon = b;
+   simMonitor.resetPending = FALSE;
+   SimUnlockAll();
+
+   STATS_INC(b->stats.start);
+   if ((capabilities & ~BALLOON_BASIC_CMDS) != 0) {
+      b->hypervisorCapabilities = capabilities;
+   } else {
+      b->hypervisorCapabilities = BALLOON_BASIC_CMDS;
+   }
+   return BALLOON_SUCCESS;
+}
+
+
+int
+Backdoor_MonitorGuestType(Balloon *b) // IN/OUT:
+{
+   int status = SimCommand(b);
+
+   STATS_INC(b->stats.guestType);
+   if (status != BALLOON_SUCCESS) {
+      STATS_INC(b->stats.guestTypeFail);
+   }
+   return status;
+}
+
+
+int
+Backdoor_MonitorGetTarget(Balloon *b,     // IN/OUT:
+                          uint32 *target) // OUT:
+{
+   int status = SimCommand(b);
+
+   *target = simMonitor.target;
+   STATS_INC(b->stats.target);
+   if (status != BALLOON_SUCCESS) {
+      STATS_INC(b->stats.targetFail);
+   }
+   return status;
+}
+
+
+int
+Backdoor_MonitorLockPage(Balloon *b,     // IN/OUT:
+                         PPN64 ppn,      // IN:
+                         uint32 *target) // OUT:
+{
+   int status = SimCommand(b);
+
+   if (status == BALLOON_SUCCESS) {
+      status = SimLock(ppn, FALSE);
+   }
+   if (target != NULL) {
+      *target = simMonitor.target;
+   }
+   STATS_INC(b->stats.lock[FALSE]);
+   if (status != BALLOON_SUCCESS) {
+      STATS_INC(b->stats.lockFail[FALSE]);
+   }
+   return status;
+}
+
+
+int
+Backdoor_MonitorUnlockPage(Balloon *b,     // IN/OUT:
+                           PPN64 ppn,      // IN:
+                           uint32 *target) // OUT:
+{
+   int status = SimCommand(b);
+
+   if (status == BALLOON_SUCCESS) {
+      status = SimUnlock(ppn, FALSE);
+   }
+   if (target != NULL) {
+      *target = simMonitor.target;
+   }
+   STATS_INC(b->stats.unlock[FALSE]);
+   if (status != BALLOON_SUCCESS) {
+      STATS_INC(b->stats.unlockFail[FALSE]);
+   }
+   return status;
+}
+
+
+int
+Backdoor_MonitorLockPagesBatched(Balloon *b,      // IN/OUT:
+                                 PPN64 ppn,       // IN:
+                                 uint32 nPages,   // IN:
+                                 int isLargePage, // IN:
+                                 uint32 *target)  // OUT:
+{
+   int status = SimCommand(b);
+   uint32 i;
+
+   if (ppn != PA_2_PPN(OS_ReservedPageGetPA(b->pageHandle)) ||
+       nPages > b->batchMaxEntries) {
+      simMonitor.errors++;
+      status = BALLOON_ERROR_PPN_INVALID;
+   }
+   for (i = 0; status == BALLOON_SUCCESS && i < nPages; i++) {
+      PA64 pa = Balloon_BatchGetPA(b->batchPage, i);
+
+      Balloon_BatchSetStatus(b->batchPage, i,
+                             SimLock(PA_2_PPN(pa), isLargePage));
+   }
+   if (target != NULL) {
+      *target = simMonitor.target;
+   }
+   STATS_INC(b->stats.lock[isLargePage]);
+   if (status != BALLOON_SUCCESS) {
+      STATS_INC(b->stats.lockFail[isLargePage]);
+   }
+   return status;
+}
+
+
+int
+Backdoor_MonitorUnlockPagesBatched(Balloon *b,      // IN/OUT:
+                                   PPN64 ppn,       // IN:
+                                   uint32 nPages,   // IN:
+                                   int isLargePage, // IN:
+                                   uint32 *target)  // OUT:
+{
+   int status = SimCommand(b);
+   uint32 i;
+
+   if (ppn != PA_2_PPN(OS_ReservedPageGetPA(b->pageHandle)) ||
+       nPages > b->batchMaxEntries) {
+      simMonitor.errors++;
+      status = BALLOON_ERROR_PPN_INVALID;
+   }
+   for (i = 0; status == BALLOON_SUCCESS && i < nPages; i++) {
+      PA64 pa = Balloon_BatchGetPA(b->batchPage, i);
+
+      Balloon_BatchSetStatus(b->batchPage, i,
+                             SimUnlock(PA_2_PPN(pa), isLargePage));
+   }
+   if (target != NULL) {
+      *target = simMonitor.target;
+   }
+   STATS_INC(b->stats.unlock[isLargePage]);
+   if (status != BALLOON_SUCCESS) {
+      STATS_INC(b->stats.unlockFail[isLargePage]);
+   }
+   return status;
+}
@@ -0,0 +1,90 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * balloonSim.h --
+ *
+ *   Userspace simulation of a guest and of the monitor, to run the
+ *   OS-independent balloon driver (vmballoon.c) outside of a kernel.
+ *
+ *   The guest has a workload, a file cache and swap; the balloon driver
+ *   allocates its pages from what is left. The monitor sets the balloon
+ *   target and locks and unlocks the pages, and can be told to refuse
+ *   pages or to reset the balloon.
+ */
+
+#ifndef _BALLOON_SIM_H_
+#define _BALLOON_SIM_H_
+
+#include "vmballoon.h"
+
+typedef struct SimGuestConfig {
+   uint32 totalPages;
+   uint32 swapPages;
+   uint32 minFree;          // no-sleep allocations fail below this
+   uint32 lowFree;          // background reclaim starts below this
+   uint32 highFree;         // ... and stops above this
+   uint32 reclaimRate;      // pages the background reclaim frees per cycle
+   uint32 cacheGrowth;      // pages of file cache read per cycle
+   uint32 touchPercent;     // swapped workload pages touched per cycle
+   uint32 largeFrames;      // 2MB frames available to the balloon
+} SimGuestConfig;
+
+typedef struct SimCounters {
+   uint64 swapOuts;         // pages swapped out
+   uint64 swapIns;          // pages swapped back in by the workload
+   uint64 stalls;           // workload pages that had to be reclaimed
+   uint64 oom;              // workload pages that could not be had at all
+   uint64 allocs;           // balloon page allocations
+   uint64 allocFails;       // ... that failed
+} SimCounters;
+
+typedef struct SimGuest {
+   SimGuestConfig config;
+
+   uint32 anonPages;        // resident workload pages
+   uint32 swappedPages;     // workload pages in swap
+   uint32 cachePages;       // file cache
+   uint32 balloonPages;     // pages held by the balloon driver
+
+   SimCounters counters;
+} SimGuest;
+
+typedef struct SimMonitor {
+   uint32 target;
+   BalloonCapabilities capabilities;
+   uint32 pinnedEvery;      // refuse every Nth page as pinned, 0 for none
+   Bool resetPending;       // fail the next command with a reset
+
+   uint32 lockedPages;      // in small pages
+   uint32 errors;           // protocol violations by the driver
+} SimMonitor;
+
+extern SimGuest simGuest;
+extern SimMonitor simMonitor;
+
+void Sim_Init(const SimGuestConfig *config,
+              BalloonCapabilities capabilities);
+void Sim_Exit(void);
+void Sim_Workload(uint32 demand);
+void Sim_Cycle(void);
+uint32 Sim_FreePages(void);
+uint32 Sim_Pressure(void);
+Bool Sim_Check(void);
+
+#endif /* _BALLOON_SIM_H_ */
@@ -0,0 +1,470 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * balloonTest.c --
+ *
+ *   Scripted tests of the balloon driver against the simulated guest and
+ *   monitor: inflating and deflating with each set of monitor commands,
+ *   pages the monitor refuses, resets, targets that cannot be met, and the
+ *   rates of both inflation policies. After every cycle, the driver and the
+ *   monitor must agree on the balloon.
+ *
+ *   Usage: vmware-testballoon
+ */
+
+#include <stdio.h>
+
+#include "balloonSim.h"
+
+#define MAX_CYCLES      200
+
+static int failures;
+
+static const SimGuestConfig guestConfig = {
+   .totalPages = 65536,
+   .swapPages = 32768,
+   .minFree = 256,
+   .lowFree = 512,
+   .highFree = 1024,
+   .reclaimRate = 8192,
+   .cacheGrowth = 4096,
+   .touchPercent = 5,
+   .largeFrames = 32,
+};
+
+#define CHECK(test, cond)                                               \
+   do {                                                                 \
+      if (!(cond)) {                                                    \
+         printf("FAIL %-28s line %d: %s\n", test, __LINE__, #cond);     \
+         failures++;                                                    \
+         return;                                                        \
+      }                                                                 \
+   } while (0)
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Start --
+ *
+ *    Sets up the simulation and the driver.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+Start(const SimGuestConfig *config,              // IN:
+      BalloonCapabilities capabilities,          // IN:
+      BalloonRatePolicy policy)                  // IN:
+{
+   Sim_Init(config, capabilities);
+   Balloon_Init(BALLOON_GUEST_LINUX);
+   Balloon_SetRatePolicy(policy);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Stop --
+ *
+ *    Cleans up the driver, which must give all its pages back.
+ *
+ * Results:
+ *    TRUE if it did.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+Stop(void)
+{
+   Bool ok;
+
+   Balloon_Cleanup();
+   ok = simGuest.balloonPages == 0 && simMonitor.errors == 0;
+   Sim_Exit();
+   return ok;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * RunTo --
+ *
+ *    Runs cycles until the balloon is within a large page of the target,
+ *    checking the balloon after each cycle.
+ *
+ * Results:
+ *    Number of cycles, or -1 if the balloon was inconsistent or did not
+ *    get there within MAX_CYCLES.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static int
+RunTo(uint32 target) // IN:
+{
+   int cycles;
+
+   simMonitor.target = target;
+   for (cycles = 1; cycles <= MAX_CYCLES; cycles++) {
+      uint32 nPages;
+
+      Sim_Cycle();
+      if (!Sim_Check()) {
+         return -1;
+      }
+      nPages = Balloon_GetStats()->nPages;
+      if (nPages <= target + OS_LARGE_2_SMALL_PAGES - 1 &&
+          nPages + OS_LARGE_2_SMALL_PAGES - 1 >= target &&
+          (target != 0 || nPages == 0)) {
+         return cycles;
+      }
+   }
+   return -1;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * TestInflateDeflate --
+ *
+ *    Inflates and deflates an idle guest's balloon with the given monitor
+ *    commands.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+TestInflateDeflate(const char *test,                 // IN:
+                   BalloonCapabilities capabilities, // IN:
+                   BalloonRatePolicy policy)         // IN:
+{
+   Start(&guestConfig, capabilities, policy);
+
+   CHECK(test, RunTo(40000) > 0);
+   if ((capabilities & BALLOON_BATCHED_2M_CMDS) != 0) {
+      CHECK(test, Balloon_GetStats()->primAlloc[BALLOON_PAGE_ALLOC_LPAGE] > 0);
+   }
+   CHECK(test, RunTo(10000) > 0);
+   CHECK(test, RunTo(30000) > 0);
+   CHECK(test, RunTo(0) > 0);
+   CHECK(test, Stop());
+   printf("ok   %s\n", test);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * TestPinned --
+ *
+ *    The monitor refuses some pages: they must be given back to the guest
+ *    and the target still met.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+TestPinned(const char *test,                 // IN:
+           BalloonCapabilities capabilities) // IN:
+{
+   Start(&guestConfig, capabilities, BALLOON_RATE_POLICY);
+   /* Without batching, a refused page ends the cycle. */
+   simMonitor.pinnedEvery = (capabilities & BALLOON_BATCHED_CMDS) ? 7 : 997;
+
+   CHECK(test, RunTo(20000) > 0);
+   CHECK(test, Balloon_GetStats()->primErrorPageAlloc[FALSE] > 0);
+   CHECK(test, Balloon_GetStats()->primErrorPageAlloc[FALSE] ==
+               Balloon_GetStats()->primErrorPageFree[FALSE]);
+   CHECK(test, RunTo(0) > 0);
+   CHECK(test, Stop());
+   printf("ok   %s\n", test);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * TestReset --
+ *
+ *    The monitor resets the balloon while it inflates: the driver must
+ *    give its pages back, start again, and still meet the target.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+TestReset(const char *test,                 // IN:
+          BalloonCapabilities capabilities) // IN:
+{
+   int i;
+
+   Start(&guestConfig, capabilities, BALLOON_RATE_POLICY);
+
+   simMonitor.target = 50000;
+   for (i = 0; i < 2; i++) {
+      Sim_Cycle();
+      CHECK(test, Sim_Check());
+   }
+   CHECK(test, Balloon_GetStats()->nPages > 0);
+
+   simMonitor.resetPending = TRUE;
+   Sim_Cycle();
+   CHECK(test, Sim_Check());
+   Sim_Cycle();
+   CHECK(test, Sim_Check());
+   CHECK(test, Balloon_GetStats()->start >= 2);
+
+   CHECK(test, RunTo(50000) > 0);
+   CHECK(test, Stop());
+   printf("ok   %s\n", test);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * TestUnreachable --
+ *
+ *    The workload leaves less memory than the target and there is no
+ *    swap: sleeping allocations fail, and the driver must back off to its
+ *    lowest rate instead of failing every cycle at full rate.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+TestUnreachable(const char *test,        // IN:
+                BalloonRatePolicy policy) // IN:
+{
+   SimGuestConfig config = guestConfig;
+   const BalloonStats *stats;
+   int i;
+
+   config.swapPages = 0;
+   Start(&config, BALLOON_BASIC_CMDS | BALLOON_BATCHED_CMDS, policy);
+   Sim_Workload(48000);
+   for (i = 0; i < 5; i++) {
+      Sim_Cycle();
+   }
+
+   simMonitor.target = 30000;
+   for (i = 0; i < 30; i++) {
+      Sim_Cycle();
+      CHECK(test, Sim_Check());
+   }
+
+   stats = Balloon_GetStats();
+   CHECK(test, stats->nPages < 30000);
+   CHECK(test, stats->primAllocFail[BALLOON_PAGE_ALLOC_CANSLEEP] > 0);
+   CHECK(test, stats->rateAlloc == BALLOON_RATE_ALLOC_MIN);
+   CHECK(test, simGuest.counters.oom == 0);
+   CHECK(test, Stop());
+   printf("ok   %s\n", test);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * TestCacheRate --
+ *
+ *    A guest whose free memory is all file cache, and that is under no
+ *    pressure: the adaptive policy keeps inflating at the no-sleep rate by
+ *    reclaiming the cache, the fixed policy drops to rateAlloc.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+TestCacheRate(const char *test,         // IN:
+              BalloonRatePolicy policy) // IN:
+{
+   uint32 before;
+   uint32 grown;
+   int i;
+
+   Start(&guestConfig, BALLOON_BASIC_CMDS | BALLOON_BATCHED_CMDS, policy);
+   Sim_Workload(8192);
+   for (i = 0; i < 20; i++) {
+      Sim_Cycle();
+   }
+   CHECK(test, simGuest.cachePages > 40000);
+
+   simMonitor.target = 40000;
+   Sim_Cycle();
+   CHECK(test, Sim_Check());
+   before = Balloon_GetStats()->nPages;
+   Sim_Cycle();
+   CHECK(test, Sim_Check());
+   grown = Balloon_GetStats()->nPages - before;
+   CHECK(test, Sim_Pressure() == 0);
+
+   if (policy == BALLOON_RATE_POLICY_ADAPTIVE) {
+      CHECK(test, grown > BALLOON_RATE_ALLOC_MAX);
+   } else {
+      CHECK(test, grown <= BALLOON_RATE_ALLOC_MAX);
+   }
+   CHECK(test, RunTo(40000) > 0);
+   CHECK(test, Stop());
+   printf("ok   %s (%u pages in a cycle)\n", test, grown);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * TestPressureRate --
+ *
+ *    A guest under memory pressure: the adaptive policy inflates at no
+ *    more than rateAlloc, on top of the free pages the background reclaim
+ *    made, and lowers rateAlloc while the pressure is severe.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+TestPressureRate(const char *test) // IN:
+{
+   uint32 before;
+   int i;
+
+   Start(&guestConfig, BALLOON_BASIC_CMDS | BALLOON_BATCHED_CMDS,
+         BALLOON_RATE_POLICY_ADAPTIVE);
+   Sim_Workload(60000);
+   for (i = 0; i < 5; i++) {
+      Sim_Cycle();
+   }
+
+   /* The balloon takes the free pages, and the guest starts swapping. */
+   simMonitor.target = 20000;
+   Sim_Cycle();
+   CHECK(test, Sim_Check());
+
+   for (i = 0; i < 5; i++) {
+      uint32 rateAlloc = Balloon_GetStats()->rateAlloc;
+
+      CHECK(test, Sim_Pressure() >= 50);
+      before = Balloon_GetStats()->nPages;
+      Sim_Cycle();
+      CHECK(test, Sim_Check());
+      CHECK(test, Balloon_GetStats()->nPages - before <=
+                  rateAlloc + guestConfig.highFree);
+   }
+   CHECK(test, Balloon_GetStats()->rateAlloc == BALLOON_RATE_ALLOC_MIN);
+
+   /* The workload goes away: the balloon picks up again. */
+   Sim_Workload(4096);
+   CHECK(test, RunTo(20000) > 0);
+   CHECK(test, Balloon_GetStats()->rateAlloc > BALLOON_RATE_ALLOC_MIN);
+   CHECK(test, Stop());
+   printf("ok   %s\n", test);
+}
+
+
+int
+main(int argc,     // IN:
+     char **argv)  // IN:
+{
+   static const struct {
+      const char *name;
+      BalloonCapabilities capabilities;
+   } modes[] = {
+      { "basic",      BALLOON_BASIC_CMDS },
+      { "batched",    BALLOON_BASIC_CMDS | BALLOON_BATCHED_CMDS },
+      { "batched 2M", BALLOON_BASIC_CMDS | BALLOON_BATCHED_CMDS |
+                      BALLOON_BATCHED_2M_CMDS },
+   };
+   char name[64];
+   int i;
+
+   for (i = 0; i < ARRAYSIZE(modes); i++) {
+      snprintf(name, sizeof name, "%s fixed", modes[i].name);
+      TestInflateDeflate(name, modes[i].capabilities,
+                         BALLOON_RATE_POLICY_FIXED);
+      snprintf(name, sizeof name, "%s adaptive", modes[i].name);
+      TestInflateDeflate(name, modes[i].capabilities,
+                         BALLOON_RATE_POLICY_ADAPTIVE);
+      snprintf(name, sizeof name, "%s pinned", modes[i].name);
+      TestPinned(name, modes[i].capabilities);
+      snprintf(name, sizeof name, "%s reset", modes[i].name);
+      TestReset(name, modes[i].capabilities);
+   }
+
+   TestUnreachable("unreachable fixed", BALLOON_RATE_POLICY_FIXED);
+   TestUnreachable("unreachable adaptive", BALLOON_RATE_POLICY_ADAPTIVE);
+   TestCacheRate("cache fixed", BALLOON_RATE_POLICY_FIXED);
+   TestCacheRate("cache adaptive", BALLOON_RATE_POLICY_ADAPTIVE);
+   TestPressureRate("pressure adaptive");
+
+   printf("%s\n", failures == 0 ? "PASSED" : "FAILED");
+   return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,226 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * base64Bench.c --
+ *
+ *   Throughput of the Base64 codecs the CPU supports, across buffer sizes.
+ *   For each size and codec, reports in MB/s of binary data:
+ *
+ *   - encode: Base64_Encode;
+ *   - decode: Base64_Decode of the encoded text;
+ *   - lines: Base64_Decode of the text broken in lines of 76 characters;
+ *   - valid: Base64_ValidEncoding of the encoded text.
+ *
+ *   Usage: vmware-testbase64-bench [size]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "vm_basic_types.h"
+#include "vm_basic_defs.h"
+#include "base64.h"
+
+#define WORK            (64 << 20)      // bytes to go through per measure
+#define LINE            76
+
+typedef enum Operation {
+   OP_ENCODE,
+   OP_DECODE,
+   OP_LINES,
+   OP_VALID,
+} Operation;
+
+static const size_t sizes[] = {
+   16, 64, 256, 1 << 10, 4 << 10, 64 << 10, 1 << 20,
+};
+
+static const char *codecs[] = { "scalar", "ssse3", "avx2", "avx512vbmi" };
+
+typedef struct Buffers {
+   uint8 *data;
+   size_t length;
+   char *text;
+   size_t textLen;
+   char *lines;
+   uint8 *out;
+} Buffers;
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Now --
+ *
+ *    Reads the monotonic clock.
+ *
+ * Results:
+ *    The time in seconds.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static double
+Now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Measure --
+ *
+ *    Runs an operation over the buffers until WORK bytes went through.
+ *
+ * Results:
+ *    The throughput in MB/s of binary data, or 0 if the operation failed.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static double
+Measure(Operation op,     // IN:
+        Buffers *bufs)    // IN:
+{
+   size_t rounds = WORK / bufs->length + 1;
+   size_t len;
+   double start;
+   size_t i;
+   Bool ok = TRUE;
+
+   start = Now();
+   for (i = 0; i < rounds; i++) {
+      switch (op) {
+      case OP_ENCODE:
+         ok &= Base64_Encode(bufs->data, bufs->length, bufs->text,
+                             bufs->textLen + 1, &len);
+         break;
+      case OP_DECODE:
+         ok &= Base64_Decode(bufs->text, bufs->out, bufs->length, &len);
+         break;
+      case OP_LINES:
+         ok &= Base64_Decode(bufs->lines, bufs->out, bufs->length, &len);
+         break;
+      case OP_VALID:
+         ok &= Base64_ValidEncoding(bufs->text, bufs->textLen);
+         break;
+      }
+   }
+
+   return ok ? rounds * bufs->length / (Now() - start) / 1e6 : 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Setup --
+ *
+ *    Fills the buffers for a size: random data and its encodings.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Allocates the buffers.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+Setup(size_t length,  // IN:
+      Buffers *bufs)  // OUT:
+{
+   size_t i;
+   size_t j;
+
+   bufs->length = length;
+   bufs->data = malloc(length);
+   bufs->textLen = Base64_EncodedLength(NULL, length) - 1;
+   bufs->text = malloc(bufs->textLen + 1);
+   bufs->lines = malloc(bufs->textLen + bufs->textLen / LINE + 1);
+   bufs->out = malloc(length);
+
+   for (i = 0; i < length; i++) {
+      bufs->data[i] = rand();
+   }
+
+   Base64_SetCodec(BASE64_CODEC_SCALAR);
+   Base64_Encode(bufs->data, length, bufs->text, bufs->textLen + 1, NULL);
+
+   for (i = 0, j = 0; i < bufs->textLen; i++) {
+      if (i != 0 && i % LINE == 0) {
+         bufs->lines[j++] = '\n';
+      }
+      bufs->lines[j++] = bufs->text[i];
+   }
+   bufs->lines[j] = '\0';
+}
+
+
+int
+main(int argc,     // IN:
+     char **argv)  // IN:
+{
+   Base64Codec best = Base64_GetCodec();
+   int i;
+
+   printf("%-8s %-10s %9s %9s %9s %9s\n", "size", "codec", "encode",
+          "decode", "lines", "valid");
+
+   for (i = 0; i < ARRAYSIZE(sizes); i++) {
+      Base64Codec codec;
+      Buffers bufs;
+
+      if (argc > 1 && strtoul(argv[1], NULL, 0) != sizes[i]) {
+         continue;
+      }
+
+      Setup(sizes[i], &bufs);
+
+      for (codec = BASE64_CODEC_SCALAR; codec <= best; codec++) {
+         Base64_SetCodec(codec);
+         printf("%-8u %-10s %9.0f %9.0f %9.0f %9.0f\n", (unsigned)sizes[i],
+                codecs[codec], Measure(OP_ENCODE, &bufs),
+                Measure(OP_DECODE, &bufs), Measure(OP_LINES, &bufs),
+                Measure(OP_VALID, &bufs));
+      }
+
+      free(bufs.data);
+      free(bufs.text);
+      free(bufs.lines);
+      free(bufs.out);
+   }
+
+   return 0;
+}
@@ -0,0 +1,479 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * base64Test.c --
+ *
+ *   Conformance of the vector Base64 codecs. Checks the scalar codec
+ *   against the RFC 4648 test vectors, then runs Base64_Encode,
+ *   Base64_Decode, Base64_ChunkDecode and Base64_ValidEncoding with every
+ *   codec the CPU supports on random input, and compares everything they
+ *   return and everything they write with what the scalar codec does:
+ *   input with whitespace, padding, NUL and illegal characters, and output
+ *   buffers too small, exact or larger.
+ *
+ *   Usage: vmware-testbase64 [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vm_basic_types.h"
+#include "vm_basic_defs.h"
+#include "base64.h"
+
+#define MAX_DATA        5000
+#define MAX_TEXT        (MAX_DATA * 2 + 16)
+#define SLACK           80
+#define ITERATIONS      20000
+#define FILL            0xa5
+
+typedef struct Vector {
+   const char *data;
+   const char *text;
+} Vector;
+
+static const Vector vectors[] = {
+   { "", "" },
+   { "f", "Zg==" },
+   { "fo", "Zm8=" },
+   { "foo", "Zm9v" },
+   { "foob", "Zm9vYg==" },
+   { "fooba", "Zm9vYmE=" },
+   { "foobar", "Zm9vYmFy" },
+   { "Hello Edward and John!", "SGVsbG8gRWR3YXJkIGFuZCBKb2huIQ==" },
+};
+
+static const char *codecs[] = { "scalar", "ssse3", "avx2", "avx512vbmi" };
+
+static uint32 seed = 0x2545f491;
+static int failures;
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Random --
+ *
+ *    xorshift32.
+ *
+ * Results:
+ *    A pseudo random number below limit.
+ *
+ * Side effects:
+ *    Updates the seed.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static uint32
+Random(uint32 limit)  // IN:
+{
+   seed ^= seed << 13;
+   seed ^= seed >> 17;
+   seed ^= seed << 5;
+
+   return seed % limit;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Fail --
+ *
+ *    Reports a mismatch.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Counts it.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+Fail(Base64Codec codec,     // IN:
+     const char *function,  // IN:
+     size_t length,         // IN:
+     size_t bufSize)        // IN:
+{
+   if (failures++ < 20) {
+      fprintf(stderr, "FAIL %s: %s, input %u, buffer %u\n", codecs[codec],
+              function, (unsigned)length, (unsigned)bufSize);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * CheckVectors --
+ *
+ *    Checks the RFC 4648 test vectors with the current codec.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Counts the failures.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+CheckVectors(Base64Codec codec)  // IN:
+{
+   int i;
+
+   for (i = 0; i < ARRAYSIZE(vectors); i++) {
+      char text[64];
+      uint8 data[64];
+      size_t len;
+
+      if (!Base64_Encode((const uint8 *)vectors[i].data,
+                         strlen(vectors[i].data), text, sizeof text, &len) ||
+          len != strlen(vectors[i].text) ||
+          strcmp(text, vectors[i].text) != 0) {
+         Fail(codec, "Base64_Encode vector", strlen(vectors[i].data),
+              sizeof text);
+      }
+      if (!Base64_Decode(vectors[i].text, data, sizeof data, &len) ||
+          len != strlen(vectors[i].data) ||
+          memcmp(data, vectors[i].data, len) != 0) {
+         Fail(codec, "Base64_Decode vector", strlen(vectors[i].text),
+              sizeof data);
+      }
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Encode --
+ *
+ *    Runs Base64_Encode with a codec, into a buffer of bufSize bytes
+ *    followed by SLACK bytes that must be left alone.
+ *
+ * Results:
+ *    The return value of Base64_Encode.
+ *
+ * Side effects:
+ *    Switches to the codec.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+Encode(Base64Codec codec,  // IN:
+       const uint8 *data,  // IN:
+       size_t length,      // IN:
+       char *text,         // OUT:
+       size_t bufSize,     // IN:
+       size_t *textLen)    // OUT:
+{
+   Base64_SetCodec(codec);
+   memset(text, FILL, bufSize + SLACK);
+   *textLen = FILL;
+
+   return Base64_Encode(data, length, text, bufSize, textLen);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Decode --
+ *
+ *    Runs Base64_Decode (chunk is FALSE) or Base64_ChunkDecode with a
+ *    codec, into a buffer of bufSize bytes followed by SLACK bytes.
+ *
+ * Results:
+ *    The return value.
+ *
+ * Side effects:
+ *    Switches to the codec.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+Decode(Base64Codec codec,  // IN:
+       Bool chunk,         // IN:
+       const char *text,   // IN:
+       size_t textLen,     // IN:
+       uint8 *data,        // OUT:
+       size_t bufSize,     // IN:
+       size_t *dataLen)    // OUT:
+{
+   Base64_SetCodec(codec);
+   memset(data, FILL, bufSize + SLACK);
+   *dataLen = FILL;
+
+   if (chunk) {
+      return Base64_ChunkDecode(text, textLen, data, bufSize, dataLen);
+   }
+   return Base64_Decode(text, data, bufSize, dataLen);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Mangle --
+ *
+ *    Makes a Base64 text harder to decode: line breaks, blanks, padding,
+ *    NULs, illegal or non-ASCII characters, at random.
+ *
+ * Results:
+ *    The new length of the text.
+ *
+ * Side effects:
+ *    Changes text, which must hold MAX_TEXT bytes.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static size_t
+Mangle(char *text,   // IN/OUT:
+       size_t len)   // IN:
+{
+   static const char others[] = { ' ', '\t', '\r', '=', '\0', '-', '_',
+                                  '.', '*', '@', '[', '`', '{', 0x7f };
+   uint32 kind = Random(8);
+   size_t i;
+
+   switch (kind) {
+   case 0:
+   case 1:
+      /* Left alone. */
+      break;
+   case 2:
+      /* Line breaks, as MIME or PEM. */
+      {
+         size_t width = Random(2) ? 64 : 76;
+         char copy[MAX_TEXT];
+         size_t j = 0;
+
+         for (i = 0; i < len && j + 2 < MAX_TEXT; i++) {
+            if (i != 0 && i % width == 0) {
+               copy[j++] = '\n';
+            }
+            copy[j++] = text[i];
+         }
+         memcpy(text, copy, j);
+         len = j;
+      }
+      break;
+   case 3:
+      /* Padding or NUL inside. */
+      if (len != 0) {
+         text[Random(len)] = Random(2) ? '=' : '\0';
+      }
+      break;
+   default:
+      /* A few other characters anywhere. */
+      for (i = Random(4) + 1; i > 0 && len != 0; i--) {
+         uint32 r = Random(4);
+
+         text[Random(len)] = r == 0 ? (char)(0x80 + Random(0x80)) :
+                                      others[Random(sizeof others)];
+      }
+      break;
+   }
+
+   text[len] = '\0';
+
+   return len;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Copy --
+ *
+ *    Copies a buffer to the heap, with nothing around it, so that reads
+ *    past its end show under a memory checker.
+ *
+ * Results:
+ *    The copy, to be freed.
+ *
+ * Side effects:
+ *    Allocates memory.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void *
+Copy(const void *buf,  // IN:
+     size_t size)      // IN:
+{
+   void *copy = malloc(size + (size == 0));
+
+   memcpy(copy, buf, size);
+
+   return copy;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * CheckRandom --
+ *
+ *    Encodes, mangles, decodes and validates a random buffer with the
+ *    scalar codec and with codec, and compares the results.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Counts the failures.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+CheckRandom(Base64Codec codec)  // IN:
+{
+   static uint8 data[MAX_DATA];
+   static char text[MAX_TEXT + SLACK];
+   static char text2[MAX_TEXT + SLACK];
+   static uint8 out[MAX_TEXT + SLACK];
+   static uint8 out2[MAX_TEXT + SLACK];
+   size_t length;
+   size_t bufSize;
+   size_t textLen;
+   size_t textLen2;
+   size_t outLen;
+   size_t outLen2;
+   size_t chunkLen;
+   void *input;
+   Bool ret;
+   Bool ret2;
+   size_t i;
+
+   length = Random(8) == 0 ? Random(MAX_DATA) : Random(300);
+   for (i = 0; i < length; i++) {
+      data[i] = Random(256);
+   }
+
+   /* Encode, into buffers that are too small, exact or larger. */
+   bufSize = Base64_EncodedLength(data, length);
+   switch (Random(4)) {
+   case 0:
+      bufSize = Random(bufSize);
+      break;
+   case 1:
+      bufSize += Random(SLACK / 2);
+      break;
+   }
+
+   input = Copy(data, length);
+   ret = Encode(BASE64_CODEC_SCALAR, input, length, text, bufSize, &textLen);
+   ret2 = Encode(codec, input, length, text2, bufSize, &textLen2);
+   free(input);
+   if (ret != ret2 || textLen != textLen2 ||
+       memcmp(text, text2, bufSize + SLACK) != 0) {
+      Fail(codec, "Base64_Encode", length, bufSize);
+   }
+
+   /* Decode and validate what the scalar codec encoded, mangled. */
+   if (!ret) {
+      ret = Encode(BASE64_CODEC_SCALAR, data, length, text, MAX_TEXT,
+                   &textLen);
+   }
+   textLen = Mangle(text, textLen);
+
+   bufSize = length;
+   switch (Random(4)) {
+   case 0:
+      bufSize = Random(length + 1);
+      break;
+   case 1:
+      bufSize += Random(SLACK / 2);
+      break;
+   }
+
+   input = Copy(text, textLen + 1);
+   ret = Decode(BASE64_CODEC_SCALAR, FALSE, input, 0, out, bufSize, &outLen);
+   ret2 = Decode(codec, FALSE, input, 0, out2, bufSize, &outLen2);
+   free(input);
+   if (ret != ret2 || outLen != outLen2 ||
+       memcmp(out, out2, bufSize + SLACK) != 0) {
+      Fail(codec, "Base64_Decode", textLen, bufSize);
+   }
+
+   chunkLen = textLen & ~(size_t)3;
+   input = Copy(text, chunkLen);
+   ret = Decode(BASE64_CODEC_SCALAR, TRUE, input, chunkLen, out, bufSize,
+                &outLen);
+   ret2 = Decode(codec, TRUE, input, chunkLen, out2, bufSize, &outLen2);
+   free(input);
+   if (ret != ret2 || outLen != outLen2 ||
+       memcmp(out, out2, bufSize + SLACK) != 0) {
+      Fail(codec, "Base64_ChunkDecode", chunkLen, bufSize);
+   }
+
+   input = Copy(text, textLen);
+   Base64_SetCodec(BASE64_CODEC_SCALAR);
+   ret = Base64_ValidEncoding(input, textLen);
+   Base64_SetCodec(codec);
+   ret2 = Base64_ValidEncoding(input, textLen);
+   free(input);
+   if (ret != ret2) {
+      Fail(codec, "Base64_ValidEncoding", textLen, 0);
+   }
+}
+
+
+int
+main(int argc,     // IN:
+     char **argv)  // IN:
+{
+   int iterations = argc > 1 ? atoi(argv[1]) : ITERATIONS;
+   Base64Codec best = Base64_GetCodec();
+   Base64Codec codec;
+
+   printf("best codec: %s\n", codecs[best]);
+
+   for (codec = BASE64_CODEC_SCALAR; codec <= BASE64_CODEC_AVX512VBMI;
+        codec++) {
+      int before = failures;
+      int i;
+
+      if (!Base64_SetCodec(codec)) {
+         printf("%-10s skipped, not supported\n", codecs[codec]);
+         continue;
+      }
+
+      CheckVectors(codec);
+      for (i = 0; codec != BASE64_CODEC_SCALAR && i < iterations; i++) {
+         CheckRandom(codec);
+      }
+      printf("%-10s %s\n", codecs[codec],
+             failures == before ? "ok" : "FAILED");
+   }
+
+   printf("%s\n", failures == 0 ? "PASSED" : "FAILED");
+   return failures == 0 ? 0 : 1;
+}
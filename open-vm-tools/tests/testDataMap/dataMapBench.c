@@ -0,0 +1,373 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * dataMapBench.c --
+ *
+ *   Microbenchmark for DataMap serialization. Builds maps shaped like the
+ *   ones on the wire (a grabbitmqProxy data packet, a guest RPC packet
+ *   carrying a VIX request, and a VIX process list reply) and times:
+ *
+ *   - DataMap_Serialize against DataMap_SerializeToDynBuf into a reused
+ *     DynBuf.
+ *   - DataMap_Deserialize against DataMap_DeserializeArena, both copying
+ *     and borrowing the input buffer.
+ *
+ *   Every decoded map is checked field by field against the original.
+ *
+ *   Usage: vmware-testdatamap-bench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vmware.h"
+#include "hostinfo.h"
+#include "util.h"
+#include "dynbuf.h"
+#include "dataMap.h"
+
+#define DEFAULT_ITERATIONS     100000
+#define MAX_FIELDS             8
+#define PROC_LIST_LEN          64
+
+typedef enum {
+   DECODE_HEAP,
+   DECODE_ARENA_COPY,
+   DECODE_ARENA_BORROW,
+} DecodeType;
+
+static const char *decodeNames[] = {
+   "deserialize",
+   "deserialize (arena)",
+   "deserialize (arena, borrowed)",
+};
+
+typedef struct {
+   const char *name;
+   DataMap map;
+   DMKeyType fields[MAX_FIELDS];
+   int numFields;
+} BenchMap;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Dup --
+ *
+ *      Heap copy of a byte pattern, for handing to the DataMap setters.
+ *
+ * Results:
+ *      Allocated buffer.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static char *
+Dup(int len,   // IN:
+    int seed)  // IN:
+{
+   char *buf = Util_SafeMalloc(len);
+   int i;
+
+   for (i = 0; i < len; i++) {
+      buf[i] = (char)(i * 7 + seed);
+   }
+
+   return buf;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BuildMaps --
+ *
+ *      Build the benchmark maps.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BuildMaps(BenchMap *maps)  // OUT: 3 maps
+{
+   int64 *pids = Util_SafeCalloc(PROC_LIST_LEN, sizeof *pids);
+   char **names = Util_SafeCalloc(PROC_LIST_LEN + 1, sizeof *names);
+   int32 *lens = Util_SafeCalloc(PROC_LIST_LEN, sizeof *lens);
+   int i;
+
+   /* grabbitmqProxy data packet: command, connection, version, payload */
+   maps[0].name = "rmqproxy data (64KB)";
+   VERIFY(DataMap_Create(&maps[0].map) == DMERR_SUCCESS);
+   VERIFY(DataMap_SetInt64(&maps[0].map, 1, 1, TRUE) == DMERR_SUCCESS);
+   VERIFY(DataMap_SetInt64(&maps[0].map, 2, 42, TRUE) == DMERR_SUCCESS);
+   VERIFY(DataMap_SetString(&maps[0].map, 4, Util_SafeStrdup("1.0"), -1,
+                            TRUE) == DMERR_SUCCESS);
+   VERIFY(DataMap_SetString(&maps[0].map, 3, Dup(64 * 1024, 1), 64 * 1024,
+                            TRUE) == DMERR_SUCCESS);
+   maps[0].fields[0] = 1;
+   maps[0].fields[1] = 2;
+   maps[0].fields[2] = 3;
+   maps[0].fields[3] = 4;
+   maps[0].numFields = 4;
+
+   /* guest RPC packet: type, payload (a VIX request) */
+   maps[1].name = "guestrpc / vix request";
+   VERIFY(DataMap_Create(&maps[1].map) == DMERR_SUCCESS);
+   VERIFY(DataMap_SetInt64(&maps[1].map, 1, 1, TRUE) == DMERR_SUCCESS);
+   VERIFY(DataMap_SetString(&maps[1].map, 2, Dup(512, 2), 512,
+                            TRUE) == DMERR_SUCCESS);
+   maps[1].fields[0] = 1;
+   maps[1].fields[1] = 2;
+   maps[1].numFields = 2;
+
+   /* VIX process list reply: pids, names, a status */
+   maps[2].name = "vix process list";
+   for (i = 0; i < PROC_LIST_LEN; i++) {
+      pids[i] = 1000 + i;
+      names[i] = Util_SafeStrdup("/usr/lib/vmware-tools/sbin64/vmtoolsd");
+      lens[i] = strlen(names[i]);
+   }
+   VERIFY(DataMap_Create(&maps[2].map) == DMERR_SUCCESS);
+   VERIFY(DataMap_SetInt64(&maps[2].map, 1, 0, TRUE) == DMERR_SUCCESS);
+   VERIFY(DataMap_SetInt64List(&maps[2].map, 2, pids, PROC_LIST_LEN,
+                               TRUE) == DMERR_SUCCESS);
+   VERIFY(DataMap_SetStringList(&maps[2].map, 3, names, lens,
+                                TRUE) == DMERR_SUCCESS);
+   maps[2].fields[0] = 1;
+   maps[2].fields[1] = 2;
+   maps[2].fields[2] = 3;
+   maps[2].numFields = 3;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VerifyMap --
+ *
+ *      Check a decoded map against the original, field by field.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Exits on a mismatch.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VerifyMap(const BenchMap *orig,      // IN:
+          const DataMap *decoded)    // IN:
+{
+   int i;
+
+   for (i = 0; i < orig->numFields; i++) {
+      DMKeyType id = orig->fields[i];
+      DMFieldType type = DataMap_GetType(&orig->map, id);
+
+      VERIFY(DataMap_GetType(decoded, id) == type);
+
+      switch (type) {
+      case DMFIELDTYPE_INT64: {
+         int64 a, b;
+
+         DataMap_GetInt64(&orig->map, id, &a);
+         DataMap_GetInt64(decoded, id, &b);
+         VERIFY(a == b);
+         break;
+      }
+      case DMFIELDTYPE_STRING: {
+         char *a, *b;
+         int32 aLen, bLen;
+
+         DataMap_GetString(&orig->map, id, &a, &aLen);
+         DataMap_GetString(decoded, id, &b, &bLen);
+         VERIFY(aLen == bLen && memcmp(a, b, aLen) == 0);
+         break;
+      }
+      case DMFIELDTYPE_INT64LIST: {
+         int64 *a, *b;
+         int32 aLen, bLen;
+
+         DataMap_GetInt64List(&orig->map, id, &a, &aLen);
+         DataMap_GetInt64List(decoded, id, &b, &bLen);
+         VERIFY(aLen == bLen && memcmp(a, b, aLen * sizeof *a) == 0);
+         break;
+      }
+      case DMFIELDTYPE_STRINGLIST: {
+         char **a, **b;
+         int32 *aLens, *bLens;
+
+         DataMap_GetStringList(&orig->map, id, &a, &aLens);
+         DataMap_GetStringList(decoded, id, &b, &bLens);
+         for (; *a != NULL; a++, b++, aLens++, bLens++) {
+            VERIFY(*b != NULL && *aLens == *bLens &&
+                   memcmp(*a, *b, *aLens) == 0);
+         }
+         VERIFY(*b == NULL);
+         break;
+      }
+      default:
+         VERIFY(FALSE);
+      }
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Report --
+ *
+ *      Print one timing line.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+Report(const char *what,      // IN:
+       VmTimeType start,      // IN:
+       uint32 iterations)     // IN:
+{
+   double ns = (double)(Hostinfo_SystemTimerNS() - start) / iterations;
+
+   printf("   %-32s %10.1f ns/op\n", what, ns);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchMapRun --
+ *
+ *      Time the serialize and deserialize variants on one map.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Exits on a data mismatch.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchMapRun(BenchMap *bm,         // IN:
+            uint32 iterations)    // IN:
+{
+   DynBuf db;
+   char *packet;
+   uint32 packetLen;
+   VmTimeType start;
+   DecodeType type;
+   uint32 i;
+
+   VERIFY(DataMap_Serialize(&bm->map, &packet, &packetLen) == DMERR_SUCCESS);
+   printf("%s: %u byte packet\n", bm->name, packetLen);
+
+   start = Hostinfo_SystemTimerNS();
+   for (i = 0; i < iterations; i++) {
+      char *buf;
+      uint32 len;
+
+      VERIFY(DataMap_Serialize(&bm->map, &buf, &len) == DMERR_SUCCESS);
+      free(buf);
+   }
+   Report("serialize", start, iterations);
+
+   DynBuf_Init(&db);
+   start = Hostinfo_SystemTimerNS();
+   for (i = 0; i < iterations; i++) {
+      DynBuf_SetSize(&db, 0);
+      VERIFY(DataMap_SerializeToDynBuf(&bm->map, &db) == DMERR_SUCCESS);
+   }
+   Report("serialize (DynBuf)", start, iterations);
+
+   /* Both serializers must produce the same bytes. */
+   VERIFY(DynBuf_GetSize(&db) == packetLen &&
+          memcmp(DynBuf_Get(&db), packet, packetLen) == 0);
+   DynBuf_Destroy(&db);
+
+   for (type = DECODE_HEAP; type <= DECODE_ARENA_BORROW; type++) {
+      DataMap map;
+
+      start = Hostinfo_SystemTimerNS();
+      for (i = 0; i < iterations; i++) {
+         ErrorCode res;
+
+         if (type == DECODE_HEAP) {
+            res = DataMap_Deserialize(packet, packetLen, &map);
+         } else {
+            res = DataMap_DeserializeArena(packet, packetLen,
+                                           type == DECODE_ARENA_BORROW, &map);
+         }
+         VERIFY(res == DMERR_SUCCESS);
+         if (i == 0) {
+            VerifyMap(bm, &map);
+         }
+         DataMap_Destroy(&map);
+      }
+      Report(decodeNames[type], start, iterations);
+   }
+
+   free(packet);
+}
+
+
+int
+main(int argc,     // IN:
+     char **argv)  // IN:
+{
+   uint32 iterations = (argc > 1) ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+   BenchMap maps[3];
+   int i;
+
+   if (iterations == 0) {
+      fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+      return 1;
+   }
+
+   memset(maps, 0, sizeof maps);
+   BuildMaps(maps);
+
+   for (i = 0; i < ARRAYSIZE(maps); i++) {
+      BenchMapRun(&maps[i], iterations);
+      DataMap_Destroy(&maps[i].map);
+   }
+
+   return 0;
+}
@@ -0,0 +1,515 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * cabBench.c --
+ *
+ *   Benchmark for extracting a customization cabinet with the libDeployPkg
+ *   mspack wrapper. Writes a synthetic MSZIP cabinet with the given number
+ *   of folders, files per folder and file size, then extracts it with one
+ *   thread and with one thread per CPU, and checks the extracted files.
+ *   Then does the same with a cabinet where every folder holds files of the
+ *   same names, which must be extracted as sequentially: the last one wins.
+ *
+ *   The cabinet is generated here rather than with a cab tool, so that the
+ *   benchmark has no dependency besides libmspack. Its MSZIP frames hold a
+ *   single fixed Huffman deflate block made of literals only: the data
+ *   bytes are all below 144, so every literal is an 8-bit code. This does
+ *   not compress, but it is valid MSZIP and costs libmspack the same
+ *   decoding work per output byte as real data.
+ *
+ *   Usage: vmware-testdeploypkg-bench [folders] [files per folder] [bytes]
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mspackWrapper.h"
+
+#define DEFAULT_FOLDERS        8
+#define DEFAULT_FILES          16
+#define DEFAULT_FILE_SIZE      (256 * 1024)
+
+#define CAB_HEADER_SIZE        36
+#define CAB_FOLDER_SIZE        8
+#define CAB_FILE_SIZE          16
+#define CAB_DATA_SIZE          8
+#define CAB_NAME_SIZE          32
+#define CAB_COMP_MSZIP         1
+#define MSZIP_FRAME_SIZE       32768
+
+/* Bits of a deflate stream, least significant bit first. */
+typedef struct BitWriter {
+   unsigned char *out;
+   size_t pos;
+   unsigned int bits;
+   unsigned int numBits;
+} BitWriter;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Fail --
+ *
+ *      Print an error and exit.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+Fail(const char *fmt,  // IN:
+     ...)
+{
+   va_list args;
+
+   va_start(args, fmt);
+   vfprintf(stderr, fmt, args);
+   va_end(args);
+   exit(1);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchLog --
+ *
+ *      Logger for the mspack wrapper: only errors and warnings are shown.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchLog(int level,           // IN:
+         const char *fmtstr,  // IN:
+         ...)
+{
+   va_list args;
+
+   if (level == log_warning || level == log_error) {
+      va_start(args, fmtstr);
+      vfprintf(stderr, fmtstr, args);
+      va_end(args);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FileByte --
+ *
+ *      Contents of the synthetic files: byte 'offset' of file 'file'.
+ *      Always below 144, see the top of the file.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static unsigned char
+FileByte(unsigned int file,    // IN:
+         unsigned int offset)  // IN:
+{
+   return (unsigned char)((offset * 31 + offset / 509 + file * 7) % 144);
+}
+
+
+static void
+Put16(unsigned char *p,  // OUT:
+      unsigned int v)    // IN:
+{
+   p[0] = v & 0xff;
+   p[1] = (v >> 8) & 0xff;
+}
+
+
+static void
+Put32(unsigned char *p,  // OUT:
+      unsigned int v)    // IN:
+{
+   Put16(p, v & 0xffff);
+   Put16(p + 2, v >> 16);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * PutBits --
+ *
+ *      Append 'count' bits of a deflate stream. Huffman codes are sent most
+ *      significant bit first, so callers pass them one bit at a time.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+PutBits(BitWriter *w,        // IN/OUT:
+        unsigned int value,  // IN:
+        unsigned int count)  // IN:
+{
+   w->bits |= value << w->numBits;
+   w->numBits += count;
+   while (w->numBits >= 8) {
+      w->out[w->pos++] = w->bits & 0xff;
+      w->bits >>= 8;
+      w->numBits -= 8;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * EncodeFrame --
+ *
+ *      Encode one MSZIP frame: the "CK" signature followed by a final fixed
+ *      Huffman deflate block holding 'len' literals.
+ *
+ * Results:
+ *      Size of the frame. 'out' must hold len + 8 bytes.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static size_t
+EncodeFrame(const unsigned char *data,  // IN:
+            size_t len,                 // IN:
+            unsigned char *out)         // OUT:
+{
+   BitWriter w = { out, 0, 0, 0 };
+   size_t i;
+   int bit;
+
+   out[w.pos++] = 'C';
+   out[w.pos++] = 'K';
+   PutBits(&w, 1, 1);   // BFINAL
+   PutBits(&w, 1, 2);   // BTYPE: fixed Huffman codes
+
+   for (i = 0; i < len; i++) {
+      unsigned int code = 0x30 + data[i];
+
+      for (bit = 7; bit >= 0; bit--) {
+         PutBits(&w, (code >> bit) & 1, 1);
+      }
+   }
+   PutBits(&w, 0, 7);   // end of block, code 256
+   if (w.numBits > 0) {
+      PutBits(&w, 0, 8 - w.numBits);
+   }
+   return w.pos;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * WriteCabinet --
+ *
+ *      Write the synthetic cabinet: 'numFolders' MSZIP folders of
+ *      'filesPerFolder' files of 'fileSize' bytes each, named
+ *      "dirF/fileN" where F is the folder, or "dir/fileN" in every folder
+ *      if 'sameNames'.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Creates the file, exits on error.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+WriteCabinet(const char *path,             // IN:
+             unsigned int numFolders,      // IN:
+             unsigned int filesPerFolder,  // IN:
+             unsigned int fileSize,        // IN:
+             int sameNames)                // IN:
+{
+   unsigned int numFiles = numFolders * filesPerFolder;
+   size_t folderSize = (size_t)filesPerFolder * fileSize;
+   unsigned int framesPerFolder =
+      (folderSize + MSZIP_FRAME_SIZE - 1) / MSZIP_FRAME_SIZE;
+   size_t filesOffset = CAB_HEADER_SIZE + numFolders * CAB_FOLDER_SIZE;
+   size_t dataOffset;
+   size_t headerSize;
+   unsigned char *header;
+   unsigned char *data = malloc(folderSize);
+   unsigned char *frame = malloc(CAB_DATA_SIZE + MSZIP_FRAME_SIZE + 8);
+   unsigned char *p;
+   unsigned int f;
+   unsigned int i;
+   FILE *cab;
+
+   if (data == NULL || frame == NULL) {
+      Fail("Out of memory\n");
+   }
+   if (numFiles > 0xffff || numFolders > 0xffff || framesPerFolder > 0xffff) {
+      Fail("Cabinet too big\n");
+   }
+
+   /*
+    * Header, folder and file entries. The data blocks of folder f start at
+    * a position that depends only on the sizes, since every frame of a
+    * folder but the last holds exactly MSZIP_FRAME_SIZE bytes.
+    */
+   headerSize = filesOffset + numFiles * (CAB_FILE_SIZE + CAB_NAME_SIZE);
+   header = calloc(1, headerSize);
+   if (header == NULL) {
+      Fail("Out of memory\n");
+   }
+
+   p = header + filesOffset;
+   for (f = 0; f < numFolders; f++) {
+      for (i = 0; i < filesPerFolder; i++) {
+         Put32(p, fileSize);
+         Put32(p + 4, i * fileSize);
+         Put16(p + 8, f);
+         Put16(p + 10, 0x4a21);   // date: 2017-01-01
+         Put16(p + 12, 0);        // time
+         Put16(p + 14, 0x20);     // attributes: archive
+         p += CAB_FILE_SIZE;
+         if (sameNames) {
+            p += sprintf((char *)p, "dir/file%u", i) + 1;
+         } else {
+            p += sprintf((char *)p, "dir%u/file%u", f, i) + 1;
+         }
+      }
+   }
+   dataOffset = p - header;
+
+   memcpy(header, "MSCF", 4);
+   Put32(header + 16, filesOffset);
+   header[24] = 3;               // version 1.3
+   header[25] = 1;
+   Put16(header + 26, numFolders);
+   Put16(header + 28, numFiles);
+   Put16(header + 32, 1234);     // set id
+
+   cab = fopen(path, "wb");
+   if (cab == NULL) {
+      Fail("Cannot create %s\n", path);
+   }
+   if (fseek(cab, dataOffset, SEEK_SET) != 0) {
+      Fail("Cannot seek in %s\n", path);
+   }
+
+   /* Data blocks, folder by folder; checksums are optional (0). */
+   for (f = 0; f < numFolders; f++) {
+      size_t done;
+
+      Put32(header + CAB_HEADER_SIZE + f * CAB_FOLDER_SIZE, ftell(cab));
+      Put16(header + CAB_HEADER_SIZE + f * CAB_FOLDER_SIZE + 4,
+            framesPerFolder);
+      Put16(header + CAB_HEADER_SIZE + f * CAB_FOLDER_SIZE + 6,
+            CAB_COMP_MSZIP);
+
+      for (i = 0; i < folderSize; i++) {
+         data[i] = FileByte(f * filesPerFolder + i / fileSize, i % fileSize);
+      }
+      for (done = 0; done < folderSize; done += MSZIP_FRAME_SIZE) {
+         size_t len = folderSize - done;
+         size_t compLen;
+
+         if (len > MSZIP_FRAME_SIZE) {
+            len = MSZIP_FRAME_SIZE;
+         }
+         compLen = EncodeFrame(data + done, len, frame + CAB_DATA_SIZE);
+         Put32(frame, 0);
+         Put16(frame + 4, compLen);
+         Put16(frame + 6, len);
+         if (fwrite(frame, CAB_DATA_SIZE + compLen, 1, cab) != 1) {
+            Fail("Cannot write %s\n", path);
+         }
+      }
+   }
+
+   Put32(header + 8, ftell(cab));
+   if (fseek(cab, 0, SEEK_SET) != 0 ||
+       fwrite(header, dataOffset, 1, cab) != 1 ||
+       fclose(cab) != 0) {
+      Fail("Cannot write %s\n", path);
+   }
+
+   free(header);
+   free(frame);
+   free(data);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VerifyFiles --
+ *
+ *      Check the files extracted into 'dir'. With 'sameNames', those of
+ *      the last folder must have overwritten the others.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Exits if a file is missing or wrong.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VerifyFiles(const char *dir,              // IN:
+            unsigned int numFolders,      // IN:
+            unsigned int filesPerFolder,  // IN:
+            unsigned int fileSize,        // IN:
+            int sameNames)                // IN:
+{
+   unsigned char *buf = malloc(fileSize + 1);
+   char path[1024];
+   unsigned int f;
+   unsigned int i;
+   unsigned int j;
+
+   if (buf == NULL) {
+      Fail("Out of memory\n");
+   }
+
+   for (f = sameNames ? numFolders - 1 : 0; f < numFolders; f++) {
+      for (i = 0; i < filesPerFolder; i++) {
+         unsigned int file = f * filesPerFolder + i;
+         FILE *in;
+
+         if (sameNames) {
+            snprintf(path, sizeof path, "%s/dir/file%u", dir, i);
+         } else {
+            snprintf(path, sizeof path, "%s/dir%u/file%u", dir, f, i);
+         }
+         in = fopen(path, "rb");
+         if (in == NULL) {
+            Fail("Missing %s\n", path);
+         }
+         if (fread(buf, 1, fileSize + 1, in) != fileSize) {
+            Fail("Wrong size: %s\n", path);
+         }
+         fclose(in);
+         for (j = 0; j < fileSize; j++) {
+            if (buf[j] != FileByte(file, j)) {
+               Fail("Wrong contents at offset %u: %s\n", j, path);
+            }
+         }
+      }
+   }
+
+   free(buf);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RunOne --
+ *
+ *      Extract the cabinet into a new directory under 'base' with at most
+ *      'threads' threads (0 for one per CPU), verify and print the time.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+RunOne(const char *label,            // IN:
+       const char *base,             // IN:
+       const char *cab,              // IN:
+       unsigned int threads,         // IN:
+       unsigned int numFolders,      // IN:
+       unsigned int filesPerFolder,  // IN:
+       unsigned int fileSize,        // IN:
+       int sameNames)                // IN:
+{
+   char dir[1024];
+   struct timespec start;
+   struct timespec end;
+   unsigned int error;
+   double ms;
+   double mb = (double)numFolders * filesPerFolder * fileSize / 1e6;
+
+   snprintf(dir, sizeof dir, "%s/%s", base, label);
+
+   MspackWrapper_SetMaxThreads(threads);
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   error = ExpandAllFilesInCab(cab, dir);
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   if (error != LINUXCAB_SUCCESS) {
+      Fail("Extraction failed: %s\n", GetLinuxCabErrorMsg(error));
+   }
+
+   VerifyFiles(dir, numFolders, filesPerFolder, fileSize, sameNames);
+
+   ms = (end.tv_sec - start.tv_sec) * 1e3 +
+        (end.tv_nsec - start.tv_nsec) / 1e6;
+   printf("%-16s %10.3f ms %10.1f MB/s\n", label, ms,
+          ms > 0 ? mb * 1e3 / ms : 0.0);
+}
+
+
+int
+main(int argc,     // IN:
+     char **argv)  // IN:
+{
+   int numFolders = (argc > 1) ? atoi(argv[1]) : DEFAULT_FOLDERS;
+   int filesPerFolder = (argc > 2) ? atoi(argv[2]) : DEFAULT_FILES;
+   int fileSize = (argc > 3) ? atoi(argv[3]) : DEFAULT_FILE_SIZE;
+   char base[] = "/tmp/vmware-testdeploypkg-XXXXXX";
+   char cab[sizeof base + 16];
+   char cleanup[sizeof base + 16];
+
+   if (numFolders <= 0 || filesPerFolder <= 0 || fileSize <= 0) {
+      fprintf(stderr, "Usage: %s [folders] [files per folder] [bytes]\n",
+              argv[0]);
+      return 1;
+   }
+
+   MspackWrapper_SetLogger(BenchLog);
+   if (SelfTestMspack() != LINUXCAB_SUCCESS) {
+      Fail("mspack self test failed\n");
+   }
+
+   if (mkdtemp(base) == NULL) {
+      Fail("Cannot create a scratch directory\n");
+   }
+   snprintf(cab, sizeof cab, "%s/bench.cab", base);
+   WriteCabinet(cab, numFolders, filesPerFolder, fileSize, 0);
+
+   printf("%d folders of %d files of %d bytes, %ld CPUs\n", numFolders,
+          filesPerFolder, fileSize, sysconf(_SC_NPROCESSORS_ONLN));
+   RunOne("sequential", base, cab, 1, numFolders, filesPerFolder, fileSize,
+          0);
+   RunOne("parallel", base, cab, 0, numFolders, filesPerFolder, fileSize, 0);
+
+   snprintf(cab, sizeof cab, "%s/same.cab", base);
+   WriteCabinet(cab, numFolders, filesPerFolder, fileSize, 1);
+   RunOne("same names", base, cab, 0, numFolders, filesPerFolder, fileSize,
+          1);
+
+   snprintf(cleanup, sizeof cleanup, "rm -rf %s", base);
+   if (system(cleanup) != 0) {
+      fprintf(stderr, "Cannot remove %s\n", base);
+   }
+   return 0;
+}
@@ -0,0 +1,199 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @dndCPTransportLoopback.cpp --
+ *
+ * Loopback implementation of the dndCPTransport interface, for testing.
+ */
+
+#include "dndCPTransportLoopback.hpp"
+#include "rpcBase.h"
+
+extern "C" {
+   #include <stdlib.h>
+   #include <string.h>
+   #include "util.h"
+}
+
+
+/**
+ * Constructor.
+ */
+
+DnDCPTransportLoopback::DnDCPTransportLoopback(void)
+   : mPeer(NULL),
+     mPacketsSent(0),
+     mBytesSent(0)
+{
+   for (int i = 0; i < TRANSPORT_INTERFACE_MAX; i++) {
+      mRpcList[i] = NULL;
+   }
+   DblLnkLst_Init(&mQueue);
+}
+
+
+/**
+ * Destructor. Drops the packets not delivered yet.
+ */
+
+DnDCPTransportLoopback::~DnDCPTransportLoopback(void)
+{
+   while (DblLnkLst_IsLinked(&mQueue)) {
+      LoopbackPacket *packet =
+         DblLnkLst_Container(mQueue.next, LoopbackPacket, l);
+
+      DblLnkLst_Unlink1(&packet->l);
+      free(packet);
+   }
+}
+
+
+/**
+ * Connect this transport to another one, in both directions.
+ *
+ * @param[in] peer the other end of the loopback.
+ */
+
+void
+DnDCPTransportLoopback::Connect(DnDCPTransportLoopback *peer)
+{
+   ASSERT(peer);
+   mPeer = peer;
+   peer->mPeer = this;
+}
+
+
+/**
+ * Deliver the packets that were queued for this side before the call.
+ * Packets sent while delivering them wait for the next iteration on the
+ * receiving side.
+ */
+
+void
+DnDCPTransportLoopback::IterateLoop(void)
+{
+   DblLnkLst_Links batch;
+
+   DblLnkLst_Init(&batch);
+   DblLnkLst_Swap(&batch, &mQueue);
+
+   while (DblLnkLst_IsLinked(&batch)) {
+      LoopbackPacket *packet =
+         DblLnkLst_Container(batch.next, LoopbackPacket, l);
+      RpcBase *rpc = mRpcList[packet->type];
+
+      DblLnkLst_Unlink1(&packet->l);
+      if (rpc) {
+         rpc->OnRecvPacket(DEFAULT_CONNECTION_ID, packet->data, packet->size);
+      }
+      free(packet);
+   }
+}
+
+
+/**
+ * Register a rpc for an interface type.
+ *
+ * @param[in] rpc the rpc object.
+ * @param[in] type interface type.
+ *
+ * @return true on success, false if the type is invalid or taken.
+ */
+
+bool
+DnDCPTransportLoopback::RegisterRpc(RpcBase *rpc,
+                                    TransportInterfaceType type)
+{
+   if (type < 0 || type >= TRANSPORT_INTERFACE_MAX || mRpcList[type]) {
+      return false;
+   }
+   mRpcList[type] = rpc;
+   return true;
+}
+
+
+/**
+ * Unregister the rpc of an interface type.
+ *
+ * @param[in] type interface type.
+ *
+ * @return true on success, false if the type is invalid or not registered.
+ */
+
+bool
+DnDCPTransportLoopback::UnregisterRpc(TransportInterfaceType type)
+{
+   if (type < 0 || type >= TRANSPORT_INTERFACE_MAX || !mRpcList[type]) {
+      return false;
+   }
+   mRpcList[type] = NULL;
+   return true;
+}
+
+
+/**
+ * Send a packet to the other end.
+ *
+ * @param[in] destId destination address id (ignored).
+ * @param[in] type interface type.
+ * @param[in] msg the packet.
+ * @param[in] length packet size.
+ *
+ * @return true on success, false if not connected.
+ */
+
+bool
+DnDCPTransportLoopback::SendPacket(uint32 destId,
+                                   TransportInterfaceType type,
+                                   const uint8 *msg,
+                                   size_t length)
+{
+   if (!mPeer || type < 0 || type >= TRANSPORT_INTERFACE_MAX) {
+      return false;
+   }
+
+   mPeer->Queue(type, msg, length);
+   mPacketsSent++;
+   mBytesSent += length;
+   return true;
+}
+
+
+/**
+ * Add a copy of a packet to the delivery queue.
+ *
+ * @param[in] type interface type.
+ * @param[in] msg the packet.
+ * @param[in] length packet size.
+ */
+
+void
+DnDCPTransportLoopback::Queue(TransportInterfaceType type,
+                              const uint8 *msg,
+                              size_t length)
+{
+   LoopbackPacket *packet =
+      (LoopbackPacket *)Util_SafeMalloc(sizeof *packet + length);
+
+   DblLnkLst_Init(&packet->l);
+   packet->type = type;
+   packet->size = length;
+   memcpy(packet->data, msg, length);
+   DblLnkLst_LinkLast(&mQueue, &packet->l);
+}
@@ -0,0 +1,80 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @dndCPTransportLoopback.hpp --
+ *
+ * Loopback implementation of the dndCPTransport interface, for testing.
+ * Two transports are connected to each other; packets sent on one are
+ * queued, and delivered to the rpc registered for the same interface type
+ * on the other by the next IterateLoop() of the receiving side. Each
+ * iteration thus stands for one trip across the channel.
+ */
+
+#ifndef DND_CP_TRANSPORT_LOOPBACK_HPP
+#define DND_CP_TRANSPORT_LOOPBACK_HPP
+
+#include "dndCPTransport.h"
+
+extern "C" {
+   #include "dbllnklst.h"
+}
+
+typedef struct LoopbackPacket {
+   DblLnkLst_Links l;
+   TransportInterfaceType type;
+   size_t size;
+   uint8 data[1];
+} LoopbackPacket;
+
+
+class DnDCPTransportLoopback
+   : public DnDCPTransport
+{
+public:
+   DnDCPTransportLoopback(void);
+   virtual ~DnDCPTransportLoopback(void);
+
+   void Connect(DnDCPTransportLoopback *peer);
+   virtual void IterateLoop(void);
+   virtual bool RegisterRpc(RpcBase *rpc,
+                            TransportInterfaceType type);
+   virtual bool UnregisterRpc(TransportInterfaceType type);
+
+   virtual bool SendPacket(uint32 destId,
+                           TransportInterfaceType type,
+                           const uint8 *msg,
+                           size_t length);
+
+   bool IsIdle(void) { return !DblLnkLst_IsLinked(&mQueue); }
+   uint64 GetPacketsSent(void) { return mPacketsSent; }
+   uint64 GetBytesSent(void) { return mBytesSent; }
+
+private:
+   void Queue(TransportInterfaceType type,
+              const uint8 *msg,
+              size_t length);
+
+   DnDCPTransportLoopback *mPeer;
+   RpcBase *mRpcList[TRANSPORT_INTERFACE_MAX];
+   DblLnkLst_Links mQueue;
+   uint64 mPacketsSent;
+   uint64 mBytesSent;
+};
+
+#endif // DND_CP_TRANSPORT_LOOPBACK_HPP
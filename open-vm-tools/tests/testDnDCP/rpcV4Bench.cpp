@@ -0,0 +1,283 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * rpcV4Bench.cpp --
+ *
+ *   Benchmark for sending a big DnD/CP version 4 message between two
+ *   RpcV4Util objects over a loopback transport. Each side pings the
+ *   other to negotiate the packet window, then one side sends a message
+ *   and the other checks what it received.
+ *
+ *   Every delivery on the loopback stands for one trip across the channel,
+ *   so the number of trips times the one-way latency gives the time the
+ *   transfer would take on a real channel, where latency dominates.
+ *
+ *   Usage: vmware-testdndcp-bench [bytes] [one-way latency in us]
+ */
+
+#include "dndCPTransportLoopback.hpp"
+#include "rpcV4Util.hpp"
+
+extern "C" {
+   #include <stdio.h>
+   #include <stdlib.h>
+   #include <string.h>
+   #include "vmware.h"
+   #include "hostinfo.h"
+   #include "util.h"
+}
+
+#define DEFAULT_LATENCY_US     200
+#define BENCH_TYPE             TRANSPORT_GUEST_CONTROLLER_CP
+#define BENCH_CAPS             (DND_CP_CAP_VALID | DND_CP_CAP_CP)
+
+
+/*
+ * One end of the loopback: forwards packets between the transport and its
+ * RpcV4Util, answers pings, and keeps the last clipboard it received.
+ */
+
+class BenchRpc
+   : public RpcBase
+{
+public:
+   BenchRpc(DnDCPTransport *transport,
+            uint32 msgSrc,
+            uint32 window);
+   virtual ~BenchRpc(void);
+
+   virtual void OnRecvPacket(uint32 srcId,
+                             const uint8 *packet,
+                             size_t packetSize);
+   virtual bool SendPacket(uint32 destId,
+                           const uint8 *packet,
+                           size_t length);
+   virtual void HandleMsg(RpcParams *params,
+                          const uint8 *binary,
+                          uint32 binarySize);
+
+   RpcV4Util mUtil;
+   uint8 *mReceived;
+   uint32 mReceivedSize;
+
+private:
+   DnDCPTransport *mTransport;
+};
+
+
+BenchRpc::BenchRpc(DnDCPTransport *transport,
+                   uint32 msgSrc,
+                   uint32 window)
+   : mReceived(NULL),
+     mReceivedSize(0),
+     mTransport(transport)
+{
+   mUtil.Init(this, DND_CP_MSG_TYPE_CP, msgSrc);
+   mUtil.SetPacketWindow(window);
+   VERIFY(mTransport->RegisterRpc(this, BENCH_TYPE));
+}
+
+
+BenchRpc::~BenchRpc(void)
+{
+   mTransport->UnregisterRpc(BENCH_TYPE);
+   free(mReceived);
+}
+
+
+void
+BenchRpc::OnRecvPacket(uint32 srcId,
+                       const uint8 *packet,
+                       size_t packetSize)
+{
+   mUtil.OnRecvPacket(srcId, packet, packetSize);
+}
+
+
+bool
+BenchRpc::SendPacket(uint32 destId,
+                     const uint8 *packet,
+                     size_t length)
+{
+   return mTransport->SendPacket(destId, BENCH_TYPE, packet, length);
+}
+
+
+void
+BenchRpc::HandleMsg(RpcParams *params,
+                    const uint8 *binary,
+                    uint32 binarySize)
+{
+   switch (params->cmd) {
+   case DNDCP_CMD_PING:
+      mUtil.SendPingReplyMsg(params->addrId, BENCH_CAPS);
+      break;
+   case CP_CMD_SEND_CLIPBOARD:
+      free(mReceived);
+      mReceived = (uint8 *)Util_SafeMalloc(binarySize);
+      memcpy(mReceived, binary, binarySize);
+      mReceivedSize = binarySize;
+      break;
+   default:
+      break;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RunLoop --
+ *
+ *      Deliver packets in both directions until there are none left.
+ *
+ * Results:
+ *      Number of one-way trips it took.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+RunLoop(DnDCPTransportLoopback *a,  // IN:
+        DnDCPTransportLoopback *b)  // IN:
+{
+   uint64 trips = 0;
+
+   while (!a->IsIdle() || !b->IsIdle()) {
+      if (!b->IsIdle()) {
+         b->IterateLoop();
+         trips++;
+      }
+      if (!a->IsIdle()) {
+         a->IterateLoop();
+         trips++;
+      }
+   }
+
+   return trips;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RunOne --
+ *
+ *      Negotiate, send one message of 'size' bytes from the guest side to
+ *      the host side, check it arrived intact and print the statistics.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Exits if the message is not received correctly.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+RunOne(const char *label,          // IN:
+       uint32 guestWindow,         // IN:
+       uint32 hostWindow,          // IN:
+       uint32 expectedWindow,      // IN:
+       const uint8 *binary,        // IN:
+       uint32 size,                // IN:
+       uint32 latencyUs)           // IN:
+{
+   DnDCPTransportLoopback guestTransport;
+   DnDCPTransportLoopback hostTransport;
+   BenchRpc guest(&guestTransport, DND_CP_MSG_SRC_GUEST, guestWindow);
+   BenchRpc host(&hostTransport, DND_CP_MSG_SRC_HOST, hostWindow);
+   RpcParams params;
+   VmTimeType start;
+   uint64 trips;
+   double elapsedMs;
+   double simulatedMs;
+
+   guestTransport.Connect(&hostTransport);
+
+   VERIFY(guest.mUtil.SendPingMsg(DEFAULT_CONNECTION_ID, BENCH_CAPS));
+   RunLoop(&guestTransport, &hostTransport);
+   VERIFY(guest.mUtil.GetPacketWindow() == expectedWindow);
+   VERIFY(host.mUtil.GetPacketWindow() == expectedWindow);
+
+   memset(&params, 0, sizeof params);
+   params.addrId = DEFAULT_CONNECTION_ID;
+   params.cmd = CP_CMD_SEND_CLIPBOARD;
+   params.sessionId = 1;
+
+   start = Hostinfo_SystemTimerNS();
+   VERIFY(guest.mUtil.SendMsg(&params, binary, size));
+   trips = RunLoop(&guestTransport, &hostTransport);
+   elapsedMs = (Hostinfo_SystemTimerNS() - start) / 1e6;
+
+   VERIFY(host.mReceivedSize == size);
+   VERIFY(memcmp(host.mReceived, binary, size) == 0);
+
+   simulatedMs = trips * latencyUs / 1e3;
+   printf("%-20s %6u %8" FMT64 "u %8" FMT64 "u %8" FMT64 "u "
+          "%10.3f %10.3f %10.1f\n",
+          label, expectedWindow,
+          guestTransport.GetPacketsSent() - 1,
+          hostTransport.GetPacketsSent() - 1,
+          trips, elapsedMs, simulatedMs,
+          simulatedMs > 0 ? size / 1e3 / simulatedMs : 0.0);
+}
+
+
+int
+main(int argc,     // IN:
+     char **argv)  // IN:
+{
+   uint32 size = (argc > 1) ? atoi(argv[1]) : DND_CP_MSG_MAX_BINARY_SIZE_V4;
+   uint32 latencyUs = (argc > 2) ? atoi(argv[2]) : DEFAULT_LATENCY_US;
+   uint8 *binary;
+   uint32 i;
+
+   if (size == 0 || size > DND_CP_MSG_MAX_BINARY_SIZE_V4) {
+      fprintf(stderr, "Usage: %s [bytes (at most %u)] [latency us]\n",
+              argv[0], DND_CP_MSG_MAX_BINARY_SIZE_V4);
+      return 1;
+   }
+
+   binary = (uint8 *)Util_SafeMalloc(size);
+   for (i = 0; i < size; i++) {
+      binary[i] = (uint8)(i * 7 + i / 251);
+   }
+
+   printf("%u bytes, %u us one-way latency\n", size, latencyUs);
+   printf("%-20s %6s %8s %8s %8s %10s %10s %10s\n",
+          "mode", "window", "packets", "acks", "trips", "cpu ms",
+          "link ms", "MB/s");
+
+   RunOne("stop-and-wait", 0, 0, 1, binary, size, latencyUs);
+   RunOne("legacy peer", DND_CP_PACKET_WINDOW_V4, 0, 1, binary, size,
+          latencyUs);
+   RunOne("windowed", 4, 4, 4, binary, size, latencyUs);
+   RunOne("windowed", DND_CP_PACKET_WINDOW_V4, DND_CP_PACKET_WINDOW_MAX_V4,
+          DND_CP_PACKET_WINDOW_V4, binary, size, latencyUs);
+   RunOne("windowed", DND_CP_PACKET_WINDOW_MAX_V4, DND_CP_PACKET_WINDOW_MAX_V4,
+          DND_CP_PACKET_WINDOW_MAX_V4, binary, size, latencyUs);
+
+   free(binary);
+   return 0;
+}
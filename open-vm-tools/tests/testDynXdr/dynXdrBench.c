@@ -0,0 +1,322 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * dynXdrBench.c --
+ *
+ *   Allocations and time it takes to build and encode the nic info the
+ *   guestInfo plugin sends, as a GuestNicProto. By default 16 NICs (the
+ *   NICINFO_MAX_NICS the protocol allows) of 512 addresses each.
+ *
+ *   - build: the NicInfoV3, with XDRUTIL_ARRAYAPPEND and with
+ *     XDRUTIL_ARRAYAPPEND_GEOMETRIC;
+ *   - encode: the "SetGuestInfo" request, each time in a new DynXdr
+ *     stream (DynXdr_Create), in one sized upfront (DynXdr_SizeOf and
+ *     DynXdr_CreateSized), and in a buffer kept from one encode to the
+ *     next (DynXdr_CreateWithBuf).
+ *
+ *   Fails if the encodings differ.
+ *
+ *   Usage: vmware-testdynxdr-bench [nics [ips]]
+ *
+ *   Counts allocations by interposing malloc, calloc and realloc, so
+ *   needs glibc.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "vm_basic_types.h"
+#include "vm_basic_defs.h"
+#include "dynxdr.h"
+#include "guestInfo.h"
+#include "vmxrpc.h"
+#include "xdrutil.h"
+
+#define ROUNDS          200
+#define PREAMBLE        GUEST_INFO_COMMAND "  3 "  // INFO_IPADDRESS_V3
+
+typedef enum Method {
+   METHOD_CREATE,
+   METHOD_SIZED,
+   METHOD_REUSED,
+} Method;
+
+static const char *methods[] = { "create", "sized", "reused" };
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static uint64 numAllocs;
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * malloc --
+ * calloc --
+ * realloc --
+ *
+ *    Count the allocations.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+void *
+malloc(size_t size)  // IN:
+{
+   numAllocs++;
+   return __libc_malloc(size);
+}
+
+
+void *
+calloc(size_t nmemb,  // IN:
+       size_t size)   // IN:
+{
+   numAllocs++;
+   return __libc_calloc(nmemb, size);
+}
+
+
+void *
+realloc(void *ptr,    // IN:
+        size_t size)  // IN:
+{
+   numAllocs++;
+   return __libc_realloc(ptr, size);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Now --
+ *
+ *    Reads the monotonic clock.
+ *
+ * Results:
+ *    The time in seconds.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static double
+Now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * BuildNicInfo --
+ *
+ *    Builds nic info as GuestInfoAddNicEntry and GuestInfoAddIpAddress do,
+ *    appending the NICs and the addresses one at a time.
+ *
+ * Results:
+ *    The nic info, free with VMX_XDR_FREE.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static NicInfoV3 *
+BuildNicInfo(u_int numNics,     // IN:
+             u_int numIps,      // IN:
+             Bool geometric)    // IN:
+{
+   NicInfoV3 *nicInfo = calloc(1, sizeof *nicInfo);
+   u_int i;
+   u_int j;
+
+   for (i = 0; i < numNics; i++) {
+      GuestNicV3 *nic;
+      char mac[NICINFO_MAC_LEN];
+
+      nic = geometric ? XDRUTIL_ARRAYAPPEND_GEOMETRIC(nicInfo, nics, 1) :
+                        XDRUTIL_ARRAYAPPEND(nicInfo, nics, 1);
+      snprintf(mac, sizeof mac, "00:50:56:00:%02x:%02x", i >> 8, i & 0xff);
+      nic->macAddress = strdup(mac);
+
+      for (j = 0; j < numIps; j++) {
+         IpAddressEntry *ip;
+         uint8 addr[4] = { 10, i, j >> 8, j & 0xff };
+
+         ip = geometric ? XDRUTIL_ARRAYAPPEND_GEOMETRIC(nic, ips, 1) :
+                          XDRUTIL_ARRAYAPPEND(nic, ips, 1);
+         ip->ipAddressAddr.ipAddressAddrType = IAT_IPV4;
+         XDRUTIL_OPAQUE(&ip->ipAddressAddr.ipAddressAddr, addr, sizeof addr);
+         ip->ipAddressPrefixLength = 16;
+         ip->ipAddressStatus = malloc(sizeof *ip->ipAddressStatus);
+         *ip->ipAddressStatus = IAS_PREFERRED;
+      }
+   }
+
+   return nicInfo;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Encode --
+ *
+ *    Encodes the request as GuestInfoSendNicInfoXdr does, with a method.
+ *
+ * Results:
+ *    The encoding, in "buf", or NULL on failure.
+ *
+ * Side effects:
+ *    Sets the size of "buf".
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void *
+Encode(Method method,           // IN:
+       GuestNicProto *message,  // IN:
+       DynBuf *buf)             // IN/OUT: the encoding, or kept buffer
+{
+   XDR xdrs;
+   XDR *stream;
+   Bool ok;
+
+   switch (method) {
+   case METHOD_CREATE:
+      stream = DynXdr_Create(&xdrs);
+      break;
+   case METHOD_SIZED:
+      stream = DynXdr_CreateSized(&xdrs, strlen(PREAMBLE) +
+                                  DynXdr_SizeOf(xdr_GuestNicProto, message));
+      break;
+   default:
+      DynBuf_SetSize(buf, 0);
+      stream = DynXdr_CreateWithBuf(&xdrs, buf);
+      break;
+   }
+   if (stream == NULL) {
+      return NULL;
+   }
+
+   ok = DynXdr_AppendRaw(&xdrs, PREAMBLE, strlen(PREAMBLE)) &&
+        xdr_GuestNicProto(&xdrs, message);
+
+   if (method != METHOD_REUSED) {
+      /* Keep the stream's own buffer in "buf", in place of the last one. */
+      DynBuf_Destroy(buf);
+      DynBuf_Attach(buf, xdr_getpos(&xdrs), DynXdr_Get(&xdrs));
+   }
+   DynXdr_Destroy(&xdrs, FALSE);
+
+   return ok ? DynBuf_Get(buf) : NULL;
+}
+
+
+int
+main(int argc,     // IN:
+     char **argv)  // IN:
+{
+   u_int numNics = argc > 1 ? strtoul(argv[1], NULL, 0) : NICINFO_MAX_NICS;
+   u_int numIps = argc > 2 ? strtoul(argv[2], NULL, 0) : 512;
+   GuestNicProto message;
+   DynBuf reference;
+   Method method;
+   int failures = 0;
+   int geometric;
+
+   DynBuf_Init(&reference);
+
+   printf("%-10s %-9s %10s %12s %10s\n", "step", "method", "bytes",
+          "allocs", "us");
+
+   for (geometric = 0; geometric <= 1; geometric++) {
+      uint64 allocs = numAllocs;
+      double start = Now();
+      NicInfoV3 *nicInfo = BuildNicInfo(numNics, numIps, geometric);
+
+      printf("%-10s %-9s %10s %12llu %10.0f\n", "build",
+             geometric ? "geometric" : "append", "-",
+             (unsigned long long)(numAllocs - allocs),
+             (Now() - start) * 1e6);
+      VMX_XDR_FREE(xdr_NicInfoV3, nicInfo);
+      free(nicInfo);
+   }
+
+   message.ver = NIC_INFO_V3;
+   message.GuestNicProto_u.nicInfoV3 = BuildNicInfo(numNics, numIps, TRUE);
+
+   if (Encode(METHOD_CREATE, &message, &reference) == NULL) {
+      fprintf(stderr, "FAIL: cannot encode %u NICs of %u addresses\n",
+              numNics, numIps);
+      return 1;
+   }
+
+   for (method = METHOD_CREATE; method <= METHOD_REUSED; method++) {
+      DynBuf buf;
+      uint64 allocs;
+      double start;
+      int i;
+
+      DynBuf_Init(&buf);
+
+      /* The first encode is the one the kept buffer grows in. */
+      Encode(method, &message, &buf);
+
+      allocs = numAllocs;
+      start = Now();
+      for (i = 0; i < ROUNDS; i++) {
+         if (Encode(method, &message, &buf) == NULL ||
+             DynBuf_GetSize(&buf) != DynBuf_GetSize(&reference) ||
+             memcmp(DynBuf_Get(&buf), DynBuf_Get(&reference),
+                    DynBuf_GetSize(&buf)) != 0) {
+            fprintf(stderr, "FAIL %s: encoding differs\n", methods[method]);
+            failures++;
+            break;
+         }
+      }
+
+      printf("%-10s %-9s %10u %12.1f %10.1f\n", "encode", methods[method],
+             (unsigned)DynBuf_GetSize(&buf),
+             (double)(numAllocs - allocs) / ROUNDS,
+             (Now() - start) * 1e6 / ROUNDS);
+
+      DynBuf_Destroy(&buf);
+   }
+
+   VMX_XDR_FREE(xdr_NicInfoV3, message.GuestNicProto_u.nicInfoV3);
+   free(message.GuestNicProto_u.nicInfoV3);
+   DynBuf_Destroy(&reference);
+
+   printf("%s\n", failures == 0 ? "PASSED" : "FAILED");
+   return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,418 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * fileLoggerTest.c --
+ *
+ *   The async file logger of glibUtils, built with a batch window of
+ *   FILE_LOGGER_BATCH_MS (2s, see Makefile.am) so that the writer waking
+ *   early is told apart from the window running out:
+ *
+ *   - wrap-around: several times the queue size, in order, none dropped;
+ *   - overflow: what doesn't fit while suspended is dropped and counted,
+ *     and nothing is written until resumed;
+ *   - half-full wake: a backlog under half the queue waits for the batch
+ *     window, half the queue is written right away;
+ *   - fork and exit: a child logs synchronously and exits, the messages
+ *     queued by the parent at fork time are written once, by the parent.
+ *
+ *   Usage: vmware-testfilelogger
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "glibUtils.h"
+
+#define QUEUE_SIZE      1024      // FILE_LOGGER_QUEUE_SIZE of fileLogger.c
+
+static char gDir[] = "/tmp/fileLoggerTestXXXXXX";
+static int gFailures;
+
+#define CHECK(cond, ...)                                 \
+   do {                                                  \
+      if (!(cond)) {                                     \
+         fprintf(stderr, "FAIL %s: ", __FUNCTION__);     \
+         fprintf(stderr, __VA_ARGS__);                   \
+         fprintf(stderr, "\n");                          \
+         gFailures++;                                    \
+      }                                                  \
+   } while (0)
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * NewLogger --
+ *
+ *    Creates an async logger to a new file.
+ *
+ * Results:
+ *    The logger; its file path in "path".
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static GlibLogger *
+NewLogger(const char *name,  // IN:
+          char *path,        // OUT:
+          size_t pathSize)   // IN:
+{
+   snprintf(path, pathSize, "%s/%s.log", gDir, name);
+
+   return GlibUtils_CreateFileLogger(path, TRUE, 10, 0, TRUE);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Log --
+ *
+ *    Logs "<tag> <i>" for i in [first, first + count).
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+Log(GlibLogger *logger,  // IN:
+    const char *tag,     // IN:
+    int first,           // IN:
+    int count)           // IN:
+{
+   char msg[64];
+   int i;
+
+   for (i = first; i < first + count; i++) {
+      snprintf(msg, sizeof msg, "%s %d\n", tag, i);
+      logger->logfn("test", G_LOG_LEVEL_MESSAGE, msg, logger);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Drain --
+ *
+ *    Writes out what the logger has queued, as VMTools_SuspendLogIO does,
+ *    and lets it write again.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+Drain(GlibLogger *logger)  // IN:
+{
+   logger->suspend(logger, TRUE);
+   logger->suspend(logger, FALSE);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * ReadLog --
+ *
+ *    Reads a log file.
+ *
+ * Results:
+ *    Its contents, NUL terminated, to free with free(); empty if missing.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static char *
+ReadLog(const char *path)  // IN:
+{
+   FILE *fp = fopen(path, "r");
+   char *buf = NULL;
+   size_t len = 0;
+   size_t size = 0;
+   size_t n;
+
+   do {
+      if (len + 4096 + 1 > size) {
+         size = 2 * size + 4096 + 1;
+         buf = realloc(buf, size);
+      }
+      n = fp != NULL ? fread(buf + len, 1, size - len - 1, fp) : 0;
+      len += n;
+   } while (n > 0);
+   buf[len] = '\0';
+
+   if (fp != NULL) {
+      fclose(fp);
+   }
+
+   return buf;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * CountLines --
+ *
+ *    Counts the lines "<tag> <i>" of a log, for i in [first, first + count),
+ *    checking each is there once and in order.
+ *
+ * Results:
+ *    The number of lines found, or -1 if one is repeated or out of order.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static int
+CountLines(const char *log,  // IN:
+           const char *tag,  // IN:
+           int first,        // IN:
+           int count)        // IN:
+{
+   const char *last = log;
+   int found = 0;
+   int i;
+
+   for (i = first; i < first + count; i++) {
+      char line[64];
+      const char *p;
+      size_t len;
+
+      len = snprintf(line, sizeof line, "%s %d\n", tag, i);
+      p = strstr(log, line);
+      if (p == NULL) {
+         continue;
+      }
+      if (p < last || (p != log && p[-1] != '\n') ||
+          strstr(p + len, line) != NULL) {
+         return -1;
+      }
+      last = p + len;
+      found++;
+   }
+
+   return found;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * WaitForLines --
+ *
+ *    Waits up to "ms" for "count" lines "<tag> <i>" to be in a log.
+ *
+ * Results:
+ *    The number of lines found.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static int
+WaitForLines(const char *path,  // IN:
+             const char *tag,   // IN:
+             int count,         // IN:
+             int ms)            // IN:
+{
+   int found;
+
+   for (;;) {
+      char *log = ReadLog(path);
+
+      found = CountLines(log, tag, 0, count);
+      free(log);
+      if (found == count || ms <= 0) {
+         return found;
+      }
+      usleep(10 * 1000);
+      ms -= 10;
+   }
+}
+
+
+static void
+TestWrapAround(void)
+{
+   char path[256];
+   GlibLogger *logger = NewLogger("wrap", path, sizeof path);
+   char *log;
+   int round;
+
+   /* Under half the queue at a time, so the writer can't fall behind. */
+   for (round = 0; round < 6; round++) {
+      Log(logger, "wrap", round * 500, 500);
+      Drain(logger);
+   }
+
+   log = ReadLog(path);
+   CHECK(CountLines(log, "wrap", 0, 3000) == 3000, "messages lost");
+   CHECK(strstr(log, "dropped") == NULL, "messages dropped");
+   free(log);
+
+   logger->dtor(logger);
+}
+
+
+static void
+TestOverflow(void)
+{
+   char path[256];
+   GlibLogger *logger = NewLogger("overflow", path, sizeof path);
+   char *log;
+
+   logger->suspend(logger, TRUE);
+   Log(logger, "overflow", 0, QUEUE_SIZE + 76);
+   usleep(100 * 1000);
+
+   log = ReadLog(path);
+   CHECK(log[0] == '\0', "written while suspended");
+   free(log);
+
+   Drain(logger);
+   log = ReadLog(path);
+   CHECK(CountLines(log, "overflow", 0, QUEUE_SIZE) == QUEUE_SIZE,
+         "queued messages lost");
+   CHECK(CountLines(log, "overflow", QUEUE_SIZE, 76) == 0,
+         "messages past a full queue written");
+   CHECK(strstr(log, "[dropped 76 log messages: queue full]\n") != NULL,
+         "dropped messages not counted");
+   free(log);
+
+   logger->dtor(logger);
+}
+
+
+static void
+TestHalfFullWake(void)
+{
+   char path[256];
+   GlibLogger *logger = NewLogger("wake", path, sizeof path);
+
+   /* Not from the start of the queue, to not confuse position and backlog. */
+   Log(logger, "start", 0, 100);
+   Drain(logger);
+
+   Log(logger, "wake", 0, QUEUE_SIZE / 2 - 1);
+   CHECK(WaitForLines(path, "wake", QUEUE_SIZE / 2 - 1, 300) == 0,
+         "writer didn't wait for the batch window");
+
+   Log(logger, "wake", QUEUE_SIZE / 2 - 1, 1);
+   CHECK(WaitForLines(path, "wake", QUEUE_SIZE / 2, 1000) == QUEUE_SIZE / 2,
+         "writer not woken at half the queue");
+
+   logger->dtor(logger);
+}
+
+
+static void
+TestForkExit(void)
+{
+   char path[256];
+   GlibLogger *logger = NewLogger("fork", path, sizeof path);
+   char *log;
+   int status;
+   pid_t pid;
+
+   /* Have the file open, and something queued, when forking. */
+   Log(logger, "parent", 0, 1);
+   Drain(logger);
+   Log(logger, "parent", 1, 9);
+
+   fflush(NULL);
+   pid = fork();
+   if (pid == 0) {
+      /* Die rather than hang if the logger deadlocks. */
+      alarm(10);
+      Log(logger, "child", 0, 3);
+      exit(0);
+   }
+
+   CHECK(pid > 0, "fork failed");
+   CHECK(waitpid(pid, &status, 0) == pid &&
+         WIFEXITED(status) && WEXITSTATUS(status) == 0,
+         "child didn't exit cleanly");
+
+   log = ReadLog(path);
+   CHECK(CountLines(log, "child", 0, 3) == 3,
+         "child's messages not written synchronously");
+   CHECK(CountLines(log, "parent", 1, 9) <= 0,
+         "parent's queued messages written by the child");
+   free(log);
+
+   logger->dtor(logger);
+
+   log = ReadLog(path);
+   CHECK(CountLines(log, "parent", 0, 10) == 10,
+         "parent's messages lost or repeated");
+   free(log);
+}
+
+
+int
+main(int argc,     // IN:
+     char **argv)  // IN:
+{
+   if (mkdtemp(gDir) == NULL) {
+      fprintf(stderr, "FAIL: cannot create %s\n", gDir);
+      return 1;
+   }
+
+   TestWrapAround();
+   TestOverflow();
+   TestHalfFullWake();
+   TestForkExit();
+
+   if (gFailures == 0) {
+      char cmd[sizeof gDir + 16];
+
+      snprintf(cmd, sizeof cmd, "rm -rf %s", gDir);
+      if (system(cmd) != 0) {
+         fprintf(stderr, "cannot remove %s\n", gDir);
+      }
+   }
+
+   printf("%s\n", gFailures == 0 ? "PASSED" : "FAILED");
+   return gFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,270 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hashTableBench.c --
+ *
+ *   Insert and lookup rates of the hash tables, on file paths and on
+ *   page aligned addresses, across table sizes. Each set is run on a table
+ *   of INITIAL_BUCKETS buckets with the legacy hash, with the stronger hash
+ *   (HASH_FLAG_STRONGHASH), and growing (HASH_FLAG_RESIZE). Reports:
+ *
+ *   - insert, hit, miss: millions of inserts, successful and failed
+ *     lookups per second;
+ *   - buckets, used: buckets in the end, and how many are not empty;
+ *   - chain: longest chain;
+ *   - probes: average number of keys compared by a successful lookup.
+ *
+ *   Usage: vmware-testhashtable-bench [keys]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "vm_basic_types.h"
+#include "vm_basic_defs.h"
+#include "hashTable.h"
+
+#define INITIAL_BUCKETS 256
+#define MEASURE         0.2             // seconds of lookups per measure
+
+typedef enum KeySet {
+   KEYS_PATH,
+   KEYS_INT,
+} KeySet;
+
+static const char *keySets[] = { "path", "int" };
+
+static const size_t sizes[] = {
+   1 << 10, 16 << 10, 128 << 10,
+};
+
+static const struct {
+   const char *name;
+   int flags;
+} configs[] = {
+   { "legacy", 0 },
+   { "strong", HASH_FLAG_STRONGHASH },
+   { "resize", HASH_FLAG_RESIZE },
+};
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Now --
+ *
+ *    Reads the monotonic clock.
+ *
+ * Results:
+ *    The time in seconds.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static double
+Now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * MakeKeys --
+ *
+ *    Generates keys of a set: paths in a tree of directories, as the HGFS
+ *    server and the file caches see them, or addresses 4KB apart, as the
+ *    lock and object tables see them. The keys past count are not
+ *    inserted, for the failed lookups.
+ *
+ * Results:
+ *    An array of 2 * count keys.
+ *
+ * Side effects:
+ *    Allocates the keys.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static const void **
+MakeKeys(KeySet set,    // IN:
+         size_t count)  // IN:
+{
+   const void **keys = malloc(2 * count * sizeof *keys);
+   size_t i;
+
+   for (i = 0; i < 2 * count; i++) {
+      if (set == KEYS_PATH) {
+         char *path = malloc(80);
+
+         snprintf(path, 80, "/home/user/src/project%u/module%u/file%u.c",
+                  (unsigned)(i / 4096), (unsigned)(i / 64 % 64),
+                  (unsigned)i);
+         keys[i] = path;
+      } else {
+         keys[i] = (const void *)(CONST64U(0x7f0000000000) + (i << 12));
+      }
+   }
+
+   return keys;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Lookups --
+ *
+ *    Looks up keys in turn, for MEASURE seconds.
+ *
+ * Results:
+ *    Millions of lookups per second, 0 if some lookups did not return
+ *    expected.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static double
+Lookups(const HashTable *ht,  // IN:
+        const void **keys,    // IN:
+        size_t count,         // IN:
+        Bool expected)        // IN: whether the keys are in the table
+{
+   double start = Now();
+   double elapsed;
+   size_t lookups = 0;
+   Bool ok = TRUE;
+
+   do {
+      size_t i;
+
+      for (i = 0; i < 256; i++) {
+         ok &= HashTable_Lookup(ht, keys[lookups++ % count], NULL) ==
+               expected;
+      }
+      elapsed = Now() - start;
+   } while (elapsed < MEASURE);
+
+   return ok ? lookups / elapsed / 1e6 : 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Run --
+ *
+ *    Inserts count keys in a table, then looks up the inserted keys and
+ *    the other ones.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Prints the measures.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+Run(KeySet set,           // IN:
+    const void **keys,    // IN:
+    size_t count,         // IN:
+    int config)           // IN:
+{
+   int keyType = set == KEYS_PATH ? HASH_STRING_KEY : HASH_INT_KEY;
+   HashTable *ht = HashTable_Alloc(INITIAL_BUCKETS,
+                                   keyType | configs[config].flags, NULL);
+   HashTableStats stats;
+   double insert;
+   double hit;
+   double miss;
+   double start;
+   size_t i;
+
+   start = Now();
+   for (i = 0; i < count; i++) {
+      HashTable_Insert(ht, keys[i], NULL);
+   }
+   insert = count / (Now() - start) / 1e6;
+
+   hit = Lookups(ht, keys, count, TRUE);
+   miss = Lookups(ht, keys + count, count, FALSE);
+
+   HashTable_GetStats(ht, &stats);
+   printf("%-5s %-8u %-7s %8.2f %8.2f %8.2f %8u %8u %6u %7.2f\n",
+          keySets[set], (unsigned)count, configs[config].name, insert, hit,
+          miss, (unsigned)stats.numBuckets, (unsigned)stats.usedBuckets,
+          (unsigned)stats.maxChain, (double)stats.probes / count);
+
+   HashTable_Free(ht);
+}
+
+
+int
+main(int argc,     // IN:
+     char **argv)  // IN:
+{
+   KeySet set;
+   int i;
+
+   printf("%-5s %-8s %-7s %8s %8s %8s %8s %8s %6s %7s\n", "keys", "count",
+          "table", "insert", "hit", "miss", "buckets", "used", "chain",
+          "probes");
+
+   for (set = KEYS_PATH; set <= KEYS_INT; set++) {
+      for (i = 0; i < ARRAYSIZE(sizes); i++) {
+         const void **keys;
+         int config;
+         size_t j;
+
+         if (argc > 1 && strtoul(argv[1], NULL, 0) != sizes[i]) {
+            continue;
+         }
+
+         keys = MakeKeys(set, sizes[i]);
+
+         for (config = 0; config < ARRAYSIZE(configs); config++) {
+            Run(set, keys, sizes[i], config);
+         }
+
+         if (set == KEYS_PATH) {
+            for (j = 0; j < 2 * sizes[i]; j++) {
+               free((void *)keys[j]);
+            }
+         }
+         free(keys);
+      }
+   }
+
+   return 0;
+}
@@ -0,0 +1,381 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hashTableTest.c --
+ *
+ *   Conformance test of the hash tables: for each key type, with the
+ *   legacy hash, the stronger hash and incremental resizing, inserts,
+ *   looks up, replaces and deletes keys from a small table, checking each
+ *   result against what the keys should map to as the table grows. Then
+ *   inserts the same keys from several threads into an atomic resizable
+ *   table.
+ *
+ *   Usage: vmware-testhashtable
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vm_basic_types.h"
+#include "vm_basic_defs.h"
+#include "hashTable.h"
+
+#define NUM_KEYS        4096
+#define NUM_THREADS     4
+
+#define CHECK(cond) \
+   do {                                                                   \
+      if (!(cond)) {                                                      \
+         fprintf(stderr, "FAIL %s: line %d: %s\n", name, __LINE__, #cond); \
+         failures++;                                                      \
+      }                                                                   \
+   } while (0)
+
+static const int keyTypes[] = {
+   HASH_STRING_KEY, HASH_ISTRING_KEY, HASH_INT_KEY,
+};
+
+static const int flags[] = {
+   0,
+   HASH_FLAG_STRONGHASH,
+   HASH_FLAG_RESIZE,
+   HASH_FLAG_RESIZE | HASH_FLAG_COPYKEY,
+};
+
+static char *strings[NUM_KEYS];
+static char *upperStrings[NUM_KEYS];
+static int failures;
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Key --
+ *
+ *    The i-th key of a table of a type: a path for strings, or a pointer
+ *    sized integer with only the high bits set for integers, which the
+ *    legacy hash does not mix.
+ *
+ * Results:
+ *    The key.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static const void *
+Key(int keyType,  // IN:
+    int i,        // IN:
+    Bool upper)   // IN: upper case string
+{
+   if (keyType == HASH_INT_KEY) {
+      return (const void *)(((uintptr_t)i + 1) << 12);
+   }
+
+   return upper ? upperStrings[i] : strings[i];
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Value --
+ *
+ *    The value of the i-th key.
+ *
+ * Results:
+ *    The value.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void *
+Value(int i)  // IN:
+{
+   return (void *)((uintptr_t)i * 2 + 1);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * CountEntry --
+ *
+ *    HashTable_ForEach callback: counts the entries and checks their
+ *    values.
+ *
+ * Results:
+ *    0.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static int
+CountEntry(const char *key,   // IN:
+           void *value,       // IN:
+           void *clientData)  // IN/OUT:
+{
+   size_t *count = clientData;
+
+   if (((uintptr_t)value & 1) != 0) {
+      (*count)++;
+   }
+
+   return 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * TestTable --
+ *
+ *    Runs the conformance test on a table of a type.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Increments failures.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+TestTable(int keyType)  // IN: type and flags
+{
+   HashTable *ht = HashTable_Alloc(4, keyType, NULL);
+   int type = keyType & HASH_TYPE_MASK;
+   HashTableStats stats;
+   const void **keys;
+   size_t numKeys;
+   size_t count = 0;
+   char name[32];
+   void *value;
+   int i;
+
+   snprintf(name, sizeof name, "type %d flags 0x%x", type,
+            keyType & HASH_FLAG_MASK);
+
+   for (i = 0; i < NUM_KEYS; i++) {
+      CHECK(HashTable_Insert(ht, Key(type, i, FALSE), Value(i)));
+   }
+   CHECK(HashTable_GetNumElements(ht) == NUM_KEYS);
+
+   for (i = 0; i < NUM_KEYS; i++) {
+      value = NULL;
+      CHECK(HashTable_Lookup(ht, Key(type, i, FALSE), &value) &&
+            value == Value(i));
+      if (type == HASH_ISTRING_KEY) {
+         CHECK(HashTable_Lookup(ht, Key(type, i, TRUE), NULL));
+      } else if (type == HASH_STRING_KEY) {
+         CHECK(!HashTable_Lookup(ht, Key(type, i, TRUE), NULL));
+      }
+      CHECK(!HashTable_Insert(ht, Key(type, i, FALSE), NULL));
+   }
+   CHECK(!HashTable_Lookup(ht, type == HASH_INT_KEY ? (void *)1 : "/nope",
+                           NULL));
+
+   HashTable_GetStats(ht, &stats);
+   CHECK(stats.numElements == NUM_KEYS);
+   if ((keyType & HASH_FLAG_RESIZE) != 0) {
+      CHECK(stats.numBuckets >= NUM_KEYS / 2);
+   } else {
+      CHECK(stats.numBuckets == 4);
+   }
+
+   /* Delete the odd keys, replace the values of the even ones. */
+   for (i = 1; i < NUM_KEYS; i += 2) {
+      CHECK(HashTable_Delete(ht, Key(type, i, FALSE)));
+      CHECK(!HashTable_Delete(ht, Key(type, i, FALSE)));
+   }
+   for (i = 0; i < NUM_KEYS; i += 2) {
+      CHECK(HashTable_ReplaceIfEqual(ht, Key(type, i, FALSE), Value(i),
+                                     Value(i + 1)));
+      CHECK(!HashTable_ReplaceIfEqual(ht, Key(type, i, FALSE), Value(i),
+                                      Value(i)));
+   }
+   CHECK(HashTable_GetNumElements(ht) == NUM_KEYS / 2);
+
+   for (i = 0; i < NUM_KEYS; i++) {
+      value = NULL;
+      if (i % 2 == 0) {
+         CHECK(HashTable_Lookup(ht, Key(type, i, FALSE), &value) &&
+               value == Value(i + 1));
+      } else {
+         CHECK(!HashTable_Lookup(ht, Key(type, i, FALSE), &value));
+      }
+   }
+
+   HashTable_ForEach(ht, CountEntry, &count);
+   CHECK(count == NUM_KEYS / 2);
+   HashTable_KeyArray(ht, &keys, &numKeys);
+   CHECK(numKeys == NUM_KEYS / 2);
+   free(keys);
+
+   HashTable_Clear(ht);
+   CHECK(HashTable_GetNumElements(ht) == 0);
+   CHECK(!HashTable_Lookup(ht, Key(type, 0, FALSE), NULL));
+   CHECK(HashTable_Insert(ht, Key(type, 0, FALSE), Value(0)));
+   CHECK(HashTable_Lookup(ht, Key(type, 0, FALSE), NULL));
+
+   HashTable_Free(ht);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * InsertThread --
+ *
+ *    Inserts all the keys, starting from a different one in each thread.
+ *
+ * Results:
+ *    The number of keys the thread inserted first.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void *
+InsertThread(void *arg)  // IN: the table
+{
+   static Atomic_uint32 nextThread;
+   HashTable *ht = arg;
+   int start = Atomic_ReadInc32(&nextThread) * (NUM_KEYS / NUM_THREADS);
+   uintptr_t inserted = 0;
+   int i;
+
+   for (i = 0; i < NUM_KEYS; i++) {
+      int k = (start + i) % NUM_KEYS;
+
+      if (HashTable_Insert(ht, strings[k], Value(k))) {
+         inserted++;
+      }
+   }
+
+   return (void *)inserted;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * TestAtomic --
+ *
+ *    Inserts the keys from NUM_THREADS threads at once into an atomic
+ *    resizable table.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Increments failures.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+TestAtomic(void)
+{
+   HashTable *ht = HashTable_Alloc(64, HASH_STRING_KEY | HASH_FLAG_ATOMIC |
+                                   HASH_FLAG_RESIZE, NULL);
+   const char *name = "atomic";
+   pthread_t threads[NUM_THREADS];
+   uintptr_t inserted = 0;
+   HashTableStats stats;
+   int i;
+
+   for (i = 0; i < NUM_THREADS; i++) {
+      pthread_create(&threads[i], NULL, InsertThread, ht);
+   }
+   for (i = 0; i < NUM_THREADS; i++) {
+      void *n;
+
+      pthread_join(threads[i], &n);
+      inserted += (uintptr_t)n;
+   }
+   CHECK(inserted == NUM_KEYS);
+
+   for (i = 0; i < NUM_KEYS; i++) {
+      void *value = NULL;
+
+      CHECK(HashTable_Lookup(ht, strings[i], &value) && value == Value(i));
+   }
+
+   HashTable_GetStats(ht, &stats);
+   CHECK(stats.numElements == NUM_KEYS);
+   CHECK(stats.numBuckets >= NUM_KEYS / 2);
+
+   HashTable_FreeUnsafe(ht);
+}
+
+
+int
+main(int argc,     // IN:
+     char **argv)  // IN:
+{
+   int i;
+   int j;
+
+   for (i = 0; i < NUM_KEYS; i++) {
+      char *s;
+
+      strings[i] = malloc(64);
+      snprintf(strings[i], 64, "/usr/share/doc/package%d/file%d.txt",
+               i / 16, i);
+      upperStrings[i] = strdup(strings[i]);
+      for (s = upperStrings[i]; *s != '\0'; s++) {
+         if (*s >= 'a' && *s <= 'z') {
+            *s += 'A' - 'a';
+         }
+      }
+   }
+
+   for (i = 0; i < ARRAYSIZE(keyTypes); i++) {
+      for (j = 0; j < ARRAYSIZE(flags); j++) {
+         if (keyTypes[i] == HASH_INT_KEY &&
+             (flags[j] & HASH_FLAG_COPYKEY) != 0) {
+            continue;
+         }
+         TestTable(keyTypes[i] | flags[j]);
+      }
+   }
+   TestAtomic();
+
+   for (i = 0; i < NUM_KEYS; i++) {
+      free(strings[i]);
+      free(upperStrings[i]);
+   }
+
+   printf("%s\n", failures == 0 ? "PASSED" : "FAILED");
+   return failures == 0 ? 0 : 1;
+}
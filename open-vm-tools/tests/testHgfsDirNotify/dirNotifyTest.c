@@ -0,0 +1,467 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * dirNotifyTest.c --
+ *
+ *   Test for the inotify based HGFS directory change notification. Shares a
+ *   temporary directory, subscribes to it, changes files in it and checks
+ *   the notifications that are delivered: their names, their events, that
+ *   a burst of changes to a file gives a single notification, and that they
+ *   are delivered from the main loop.
+ *
+ *   Usage: vmware-testhgfsnotify
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <glib.h>
+
+#include "vmware.h"
+#include "str.h"
+#include "util.h"
+#include "hgfsProto.h"
+#include "hgfsServer.h"
+#include "hgfsDirNotify.h"
+
+#define WAIT_MS         2000
+#define MAX_EVENTS      256
+#define DEEP_LEVELS     500
+
+#define NOTIFY_ALL      (HGFS_NOTIFY_NAME | HGFS_NOTIFY_CREATE_FILE |        \
+                         HGFS_NOTIFY_CREATE_DIR | HGFS_NOTIFY_DELETE_FILE |  \
+                         HGFS_NOTIFY_DELETE_DIR | HGFS_NOTIFY_MODIFY |       \
+                         HGFS_NOTIFY_SIZE | HGFS_NOTIFY_OLD_FILE_NAME |      \
+                         HGFS_NOTIFY_NEW_FILE_NAME | HGFS_NOTIFY_EVENTS_DROPPED)
+
+typedef struct TestEvent {
+   HgfsSubscriberHandle subscriber;
+   char *name;
+   uint32 mask;
+} TestEvent;
+
+static pthread_mutex_t gLock = PTHREAD_MUTEX_INITIALIZER;
+static TestEvent gEvents[MAX_EVENTS];
+static int gNumEvents;
+static int gFailures;
+static pthread_t gMainThread;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TestEventCb --
+ *
+ *      Notification callback: records the notification.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+TestEventCb(HgfsSharedFolderHandle sharedFolder,   // IN:
+            HgfsSubscriberHandle subscriber,       // IN:
+            char *name,                            // IN:
+            uint32 mask,                           // IN:
+            struct HgfsSessionInfo *session)       // IN:
+{
+   if (!pthread_equal(pthread_self(), gMainThread)) {
+      printf("FAIL %-24s %s\n", "main loop delivery", name ? name : "");
+      gFailures++;
+   }
+
+   pthread_mutex_lock(&gLock);
+   if (gNumEvents < MAX_EVENTS) {
+      gEvents[gNumEvents].subscriber = subscriber;
+      gEvents[gNumEvents].name = (name != NULL) ? Util_SafeStrdup(name) : NULL;
+      gEvents[gNumEvents].mask = mask;
+      gNumEvents++;
+   }
+   pthread_mutex_unlock(&gLock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RunMainLoop --
+ *
+ *      Runs the main loop, which delivers the notifications, for a while.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+RunMainLoop(int ms) // IN:
+{
+   for (; ms > 0; ms -= 10) {
+      while (g_main_context_iteration(NULL, FALSE)) {
+      }
+      usleep(10 * 1000);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ResetEvents --
+ *
+ *      Forgets the recorded notifications.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+ResetEvents(void)
+{
+   int i;
+
+   pthread_mutex_lock(&gLock);
+   for (i = 0; i < gNumEvents; i++) {
+      free(gEvents[i].name);
+   }
+   gNumEvents = 0;
+   pthread_mutex_unlock(&gLock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CountEvents --
+ *
+ *      Counts the notifications of a subscriber for a name that have all
+ *      the given events.
+ *
+ * Results:
+ *      Number of notifications.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+CountEvents(HgfsSubscriberHandle subscriber, // IN:
+            const char *name,                // IN:
+            uint32 mask)                     // IN:
+{
+   int count = 0;
+   int i;
+
+   pthread_mutex_lock(&gLock);
+   for (i = 0; i < gNumEvents; i++) {
+      if (gEvents[i].subscriber == subscriber &&
+          gEvents[i].name != NULL && strcmp(gEvents[i].name, name) == 0 &&
+          (gEvents[i].mask & mask) == mask) {
+         count++;
+      }
+   }
+   pthread_mutex_unlock(&gLock);
+   return count;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Expect --
+ *
+ *      Waits for a notification of a subscriber for a name with the given
+ *      events, and checks how many notifications were delivered for it.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Counts a failure if the notification doesn't come, or comes more
+ *      than once.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+Expect(const char *test,                // IN:
+       HgfsSubscriberHandle subscriber, // IN:
+       const char *name,                // IN:
+       uint32 mask)                     // IN:
+{
+   int waited;
+   int count = 0;
+   int total;
+
+   for (waited = 0; waited < WAIT_MS; waited += 10) {
+      if ((count = CountEvents(subscriber, name, mask)) > 0) {
+         break;
+      }
+      RunMainLoop(10);
+   }
+
+   /* Coalescing must leave one notification per name. */
+   RunMainLoop(200);
+   total = CountEvents(subscriber, name, 0);
+
+   if (count == 0 || total != 1) {
+      printf("FAIL %-24s %s: %d notifications, %d with %#x\n", test, name,
+             total, count, mask);
+      gFailures++;
+   } else {
+      printf("ok   %-24s %s\n", test, name);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ExpectNone --
+ *
+ *      Checks that a subscriber got no notification for a name.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Counts a failure if it did.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+ExpectNone(const char *test,                // IN:
+           HgfsSubscriberHandle subscriber, // IN:
+           const char *name)                // IN:
+{
+   int count;
+
+   RunMainLoop(300);
+   count = CountEvents(subscriber, name, 0);
+   if (count != 0) {
+      printf("FAIL %-24s %s: %d unexpected notifications\n", test, name,
+             count);
+      gFailures++;
+   } else {
+      printf("ok   %-24s %s\n", test, name);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * WriteFile --
+ *
+ *      Creates a file and writes it in small pieces, to cause a burst of
+ *      events.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Exits on failure.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+WriteFile(const char *path,  // IN:
+          int writes)        // IN:
+{
+   int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+   int i;
+
+   VERIFY(fd >= 0);
+   for (i = 0; i < writes; i++) {
+      VERIFY(write(fd, "0123456789", 10) == 10);
+   }
+   close(fd);
+}
+
+
+int
+main(int argc,     // IN:
+     char **argv)  // IN:
+{
+   char root[] = "/tmp/hgfsnotifyXXXXXX";
+   HgfsSharedFolderHandle share;
+   HgfsSubscriberHandle all;
+   HgfsSubscriberHandle names;
+   HgfsSubscriberHandle inner;
+   HgfsSubscriberHandle deep;
+   char *path;
+   char *path2;
+   char *path3;
+   char *deepName;
+   int i;
+
+   VERIFY(mkdtemp(root) != NULL);
+   gMainThread = pthread_self();
+
+   if (HgfsNotify_Init() != HGFS_ERROR_SUCCESS) {
+      fprintf(stderr, "inotify is not available\n");
+      rmdir(root);
+      return 77;
+   }
+
+   share = HgfsNotify_AddSharedFolder(root, "share");
+   VERIFY(share != HGFS_INVALID_FOLDER_HANDLE);
+
+   /* A recursive subscriber for everything, one for names in the root. */
+   all = HgfsNotify_AddSubscriber(share, "", NOTIFY_ALL, TRUE, TestEventCb,
+                                  NULL);
+   names = HgfsNotify_AddSubscriber(share, "", HGFS_NOTIFY_NAME |
+                                    HGFS_NOTIFY_CREATE_FILE |
+                                    HGFS_NOTIFY_CREATE_DIR, FALSE,
+                                    TestEventCb, NULL);
+   VERIFY(all != HGFS_INVALID_SUBSCRIBER_HANDLE);
+   VERIFY(names != HGFS_INVALID_SUBSCRIBER_HANDLE);
+
+   path = Str_SafeAsprintf(NULL, "%s/a.txt", root);
+   WriteFile(path, 100);
+   Expect("create and write", all, "a.txt",
+          HGFS_NOTIFY_CREATE_FILE | HGFS_NOTIFY_MODIFY);
+   Expect("filter", names, "a.txt", HGFS_NOTIFY_CREATE_FILE);
+   ResetEvents();
+
+   WriteFile(path, 100);
+   Expect("rewrite", all, "a.txt", HGFS_NOTIFY_MODIFY | HGFS_NOTIFY_SIZE);
+   ExpectNone("filtered out", names, "a.txt");
+   ResetEvents();
+
+   path2 = Str_SafeAsprintf(NULL, "%s/b.txt", root);
+   VERIFY(rename(path, path2) == 0);
+   Expect("rename old", all, "a.txt", HGFS_NOTIFY_OLD_FILE_NAME);
+   Expect("rename new", all, "b.txt", HGFS_NOTIFY_NEW_FILE_NAME);
+   ResetEvents();
+   free(path);
+
+   path = Str_SafeAsprintf(NULL, "%s/dir", root);
+   VERIFY(mkdir(path, 0755) == 0);
+   Expect("mkdir", all, "dir", HGFS_NOTIFY_CREATE_DIR);
+   free(path);
+   ResetEvents();
+
+   path = Str_SafeAsprintf(NULL, "%s/dir/c.txt", root);
+   WriteFile(path, 1);
+   Expect("recursive", all, "dir/c.txt", HGFS_NOTIFY_CREATE_FILE);
+   ExpectNone("not recursive", names, "dir/c.txt");
+   ResetEvents();
+
+   VERIFY(unlink(path) == 0);
+   Expect("unlink in dir", all, "dir/c.txt", HGFS_NOTIFY_DELETE_FILE);
+   free(path);
+   ResetEvents();
+
+   VERIFY(unlink(path2) == 0);
+   Expect("unlink", all, "b.txt", HGFS_NOTIFY_DELETE_FILE);
+   free(path2);
+   ResetEvents();
+
+   VERIFY(HgfsNotify_RemoveSubscriber(all));
+   path = Str_SafeAsprintf(NULL, "%s/dir", root);
+   VERIFY(rmdir(path) == 0);
+   ExpectNone("removed subscriber", all, "dir");
+   free(path);
+   ResetEvents();
+
+   /*
+    * The watch of a renamed directory follows it, even with no recursive
+    * subscriber above to watch it again under the new name.
+    */
+   path = Str_SafeAsprintf(NULL, "%s/dir3", root);
+   path3 = Str_SafeAsprintf(NULL, "%s/dir4", root);
+   VERIFY(mkdir(path, 0755) == 0);
+   inner = HgfsNotify_AddSubscriber(share, "dir3", NOTIFY_ALL, FALSE,
+                                    TestEventCb, NULL);
+   VERIFY(inner != HGFS_INVALID_SUBSCRIBER_HANDLE);
+   VERIFY(rename(path, path3) == 0);
+   RunMainLoop(200);
+   ResetEvents();
+   free(path);
+
+   path = Str_SafeAsprintf(NULL, "%s/dir4/d.txt", root);
+   WriteFile(path, 1);
+   Expect("renamed dir", inner, "dir4/d.txt", HGFS_NOTIFY_CREATE_FILE);
+   VERIFY(unlink(path) == 0);
+   VERIFY(HgfsNotify_RemoveSubscriber(inner));
+   VERIFY(rmdir(path3) == 0);
+   free(path3);
+   free(path);
+   ResetEvents();
+
+   /* A tree deeper than a recursive walk should go. */
+   path = Str_SafeAsprintf(NULL, "%s/deep", root);
+   VERIFY(mkdir(path, 0755) == 0);
+   for (i = 0; i < DEEP_LEVELS; i++) {
+      path2 = Str_SafeAsprintf(NULL, "%s/d", path);
+      VERIFY(mkdir(path2, 0755) == 0);
+      free(path);
+      path = path2;
+   }
+   deep = HgfsNotify_AddSubscriber(share, "deep", NOTIFY_ALL, TRUE,
+                                   TestEventCb, NULL);
+   VERIFY(deep != HGFS_INVALID_SUBSCRIBER_HANDLE);
+
+   path2 = Str_SafeAsprintf(NULL, "%s/f.txt", path);
+   WriteFile(path2, 1);
+   deepName = Util_SafeStrdup(path2 + strlen(root) + 1);
+   Expect("deep tree", deep, deepName, HGFS_NOTIFY_CREATE_FILE);
+   VERIFY(unlink(path2) == 0);
+   free(path2);
+   free(deepName);
+
+   VERIFY(HgfsNotify_RemoveSubscriber(deep));
+   for (i = 0; i <= DEEP_LEVELS; i++) {
+      VERIFY(rmdir(path) == 0);
+      *strrchr(path, '/') = '\0';
+   }
+   free(path);
+   ResetEvents();
+
+   VERIFY(HgfsNotify_RemoveSharedFolder(share));
+   HgfsNotify_Exit();
+   ResetEvents();
+   rmdir(root);
+
+   printf("%s\n", gFailures == 0 ? "PASSED" : "FAILED");
+   return gFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,811 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+ *
+ *********************************************************/
+
+/*
+ * oplockTest.c --
+ *
+ *   Stress test for the lease based HGFS oplocks on Linux. Takes leases on
+ *   temporary files the way the server does for a client, then has a second
+ *   process open them, which makes the kernel break the leases. A simulated
+ *   client acknowledges the breaks it is sent after a delay, or not at all.
+ *   The breaks are sent from a main loop thread, as in the service.
+ *
+ *   Checks what each lease is downgraded to, and measures how long the
+ *   second process is blocked in open(): the break latency. Also closes a
+ *   session while its breaks are in progress, and checks that the session
+ *   is torn down once, after its leases are gone.
+ *
+ *   Usage: vmware-testhgfsoplock [files] [opener threads]
+ */
+
+#define _GNU_SOURCE // for F_SETLEASE, F_GETLEASE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <glib.h>
+
+#include "vmware.h"
+#include "str.h"
+#include "util.h"
+#include "hgfsServerInt.h"
+#include "hgfsServerOplock.h"
+#include "hgfsServerOplockInt.h"
+
+#define ACK_DELAY_MS       20
+#define LATE_NODE_MS       30
+#define HANDLE_BASE        1000
+#define MAX_FILES          1024
+#define DEFAULT_FILES      64
+#define DEFAULT_THREADS    8
+
+typedef enum {
+   CLIENT_ACK,          // Acknowledge breaks after ACK_DELAY_MS
+   CLIENT_SILENT,       // Never acknowledge
+   CLIENT_UNREACHABLE,  // Breaks cannot be sent
+} ClientMode;
+
+typedef struct PendingBreak {
+   HgfsHandle handle;
+   HgfsLockType lock;
+   uint64 due;
+} PendingBreak;
+
+static pthread_mutex_t gLock = PTHREAD_MUTEX_INITIALIZER;
+static ClientMode gClientMode;
+static PendingBreak gPending[MAX_FILES];
+static int gNumPending;
+static int gNumBreaksSent;
+static HgfsLockType gNodeLock[MAX_FILES + HANDLE_BASE];
+static Bool gStop;
+static int gFailures;
+static pthread_t gMainThread;
+static int gWrongThread;     // Breaks sent from another thread
+static int gRevived;         // Sessions referenced again at refcount 0
+static int gTeardowns;
+static HgfsSessionInfo *gExitSession;
+static fileDesc *gExitFds;
+static int gNumExitFds;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * NowMS --
+ *
+ *      Reads the monotonic clock.
+ *
+ * Results:
+ *      Time in milliseconds.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+NowMS(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TeardownSession --
+ *
+ *      What the server does when the last reference on a session is
+ *      dropped: closes its files, telling the lease code first.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Frees the session that RunSessionExitCase() closes.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+TeardownSession(HgfsSessionInfo *session)  // IN:
+{
+   int i;
+
+   pthread_mutex_lock(&gLock);
+   gTeardowns++;
+   pthread_mutex_unlock(&gLock);
+
+   if (session != gExitSession) {
+      return;
+   }
+   for (i = 0; i < gNumExitFds; i++) {
+      HgfsPlatformOplockRemoveNode(gExitFds[i]);
+      close(gExitFds[i]);
+   }
+   gExitSession = NULL;
+   free(session);
+}
+
+
+/*
+ * The parts of the server the lease code calls. Sessions are counted as in
+ * the server, the handle of a file is its fd plus HANDLE_BASE.
+ */
+
+Bool
+HgfsIsServerLockAllowed(HgfsSessionInfo *session)  // IN:
+{
+   return TRUE;
+}
+
+
+void
+HgfsServerSessionGet(HgfsSessionInfo *session)     // IN:
+{
+   if (Atomic_ReadInc32(&session->refCount) == 0) {
+      pthread_mutex_lock(&gLock);
+      gRevived++;
+      pthread_mutex_unlock(&gLock);
+   }
+}
+
+
+void
+HgfsServerSessionPut(HgfsSessionInfo *session)     // IN:
+{
+   if (Atomic_ReadDec32(&session->refCount) == 1) {
+      TeardownSession(session);
+   }
+}
+
+
+Bool
+HgfsUpdateNodeServerLock(fileDesc fd,                // IN:
+                         HgfsSessionInfo *session,   // IN:
+                         HgfsLockType serverLock)    // IN:
+{
+   pthread_mutex_lock(&gLock);
+   gNodeLock[fd] = serverLock;
+   pthread_mutex_unlock(&gLock);
+   return TRUE;
+}
+
+
+Bool
+HgfsServerOplockBreak(HgfsSessionInfo *session,  // IN:
+                      HgfsHandle handle,         // IN:
+                      HgfsLockType newLock)      // IN:
+{
+   Bool sent = TRUE;
+
+   pthread_mutex_lock(&gLock);
+   if (!pthread_equal(pthread_self(), gMainThread)) {
+      gWrongThread++;
+   }
+   if (gClientMode == CLIENT_UNREACHABLE) {
+      sent = FALSE;
+   } else {
+      gNumBreaksSent++;
+      if (gClientMode == CLIENT_ACK) {
+         VERIFY(gNumPending < MAX_FILES);
+         gPending[gNumPending].handle = handle;
+         gPending[gNumPending].lock = newLock;
+         gPending[gNumPending].due = NowMS() + ACK_DELAY_MS;
+         gNumPending++;
+      }
+   }
+   pthread_mutex_unlock(&gLock);
+
+   return sent;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ClientThread --
+ *
+ *      The simulated client: acknowledges the breaks that are due, with the
+ *      lock asked for, as the server's handler for the reply would.
+ *
+ * Results:
+ *      NULL.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void *
+ClientThread(void *data)  // IN: unused
+{
+   for (;;) {
+      PendingBreak due[MAX_FILES];
+      int numDue = 0;
+      uint64 now = NowMS();
+      int i;
+
+      pthread_mutex_lock(&gLock);
+      if (gStop) {
+         pthread_mutex_unlock(&gLock);
+         break;
+      }
+      for (i = 0; i < gNumPending; ) {
+         if (gPending[i].due <= now) {
+            due[numDue++] = gPending[i];
+            gPending[i] = gPending[--gNumPending];
+         } else {
+            i++;
+         }
+      }
+      pthread_mutex_unlock(&gLock);
+
+      for (i = 0; i < numDue; i++) {
+         fileDesc fd = due[i].handle - HANDLE_BASE;
+         HgfsLockType newLock = HgfsAckOplockBreak(fd, due[i].lock);
+
+         HgfsUpdateNodeServerLock(fd, NULL, newLock);
+      }
+      usleep(1000);
+   }
+
+   return NULL;
+}
+
+
+/*
+ * Opens files from a second process, from several threads at once.
+ */
+
+typedef struct Opener {
+   char **paths;
+   int flags;
+   int first;
+   int step;
+   int count;
+   uint32 *latencyMs;
+} Opener;
+
+
+static void *
+OpenerThread(void *data)  // IN: Opener
+{
+   Opener *opener = data;
+   int i;
+
+   for (i = opener->first; i < opener->count; i += opener->step) {
+      uint64 start = NowMS();
+      int fd = open(opener->paths[i], opener->flags);
+
+      opener->latencyMs[i] = (uint32)(NowMS() - start);
+      if (fd >= 0) {
+         close(fd);
+      }
+   }
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * OpenFromChild --
+ *
+ *      Forks a process that opens the files with the given flags from
+ *      numThreads threads, and collects how long each open() took.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Exits on failure.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+OpenFromChild(char **paths,        // IN:
+              int count,           // IN:
+              int flags,           // IN: open() flags
+              int numThreads,      // IN:
+              uint32 *latencyMs)   // OUT: per file
+{
+   int fds[2];
+   pid_t pid;
+   int status;
+   size_t len = count * sizeof *latencyMs;
+   size_t done = 0;
+
+   VERIFY(pipe(fds) == 0);
+   pid = fork();
+   VERIFY(pid >= 0);
+
+   if (pid == 0) {
+      pthread_t threads[64];
+      Opener openers[64];
+      int i;
+
+      close(fds[0]);
+      numThreads = MIN(MIN(numThreads, count), ARRAYSIZE(threads));
+      for (i = 0; i < numThreads; i++) {
+         openers[i].paths = paths;
+         openers[i].flags = flags;
+         openers[i].first = i;
+         openers[i].step = numThreads;
+         openers[i].count = count;
+         openers[i].latencyMs = latencyMs;
+         VERIFY(pthread_create(&threads[i], NULL, OpenerThread,
+                               &openers[i]) == 0);
+      }
+      for (i = 0; i < numThreads; i++) {
+         pthread_join(threads[i], NULL);
+      }
+      _exit(write(fds[1], latencyMs, len) == len ? 0 : 1);
+   }
+
+   close(fds[1]);
+   while (done < len) {
+      ssize_t n = read(fds[0], (char *)latencyMs + done, len - done);
+
+      VERIFY(n > 0);
+      done += n;
+   }
+   close(fds[0]);
+   VERIFY(waitpid(pid, &status, 0) == pid);
+   VERIFY(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+
+/*
+ * Caches the nodes of the leased files a while after the opens started.
+ */
+
+typedef struct LateNodes {
+   fileDesc *fds;
+   int count;
+} LateNodes;
+
+
+static void *
+AddNodesLater(void *data)  // IN: LateNodes
+{
+   LateNodes *late = data;
+   int i;
+
+   usleep(LATE_NODE_MS * 1000);
+   for (i = 0; i < late->count; i++) {
+      HgfsPlatformOplockAddNode(late->fds[i], late->fds[i] + HANDLE_BASE);
+   }
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RunCase --
+ *
+ *      Leases the files, has a second process open them and checks the
+ *      outcome.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Counts a failure if a check fails.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+RunCase(const char *label,         // IN:
+        HgfsSessionInfo *session,  // IN:
+        char **paths,              // IN:
+        int count,                 // IN:
+        int numThreads,            // IN:
+        ClientMode mode,           // IN:
+        HgfsLockType lock,         // IN: lease to take
+        int openFlags,             // IN: how the second process opens
+        Bool lateNode,             // IN: cache the nodes after the opens
+        HgfsLockType expectedLock, // IN: lease after the break
+        uint32 minMs,              // IN: expected break latency
+        uint32 maxMs)              // IN:
+{
+   fileDesc fds[MAX_FILES];
+   uint32 latencyMs[MAX_FILES];
+   uint64 totalMs = 0;
+   uint32 worstMs = 0;
+   uint32 bestMs = ~0U;
+   int bad = 0;
+   int sent;
+   int i;
+
+   pthread_mutex_lock(&gLock);
+   gClientMode = mode;
+   gNumBreaksSent = 0;
+   pthread_mutex_unlock(&gLock);
+
+   for (i = 0; i < count; i++) {
+      HgfsLockType serverLock = lock;
+
+      fds[i] = open(paths[i], O_RDONLY);
+      VERIFY(fds[i] >= 0 && fds[i] < MAX_FILES + HANDLE_BASE);
+      VERIFY(HgfsAcquireServerLock(fds[i], session, &serverLock));
+      VERIFY(serverLock == (lock == HGFS_LOCK_OPPORTUNISTIC ?
+                            HGFS_LOCK_EXCLUSIVE : lock));
+      gNodeLock[fds[i]] = serverLock;
+      if (!lateNode) {
+         HgfsPlatformOplockAddNode(fds[i], fds[i] + HANDLE_BASE);
+      }
+   }
+
+   if (lateNode) {
+      /*
+       * The first opens wait for the nodes to be cached, before their breaks
+       * can be sent.
+       */
+      LateNodes late = { fds, count };
+      pthread_t adder;
+
+      VERIFY(pthread_create(&adder, NULL, AddNodesLater, &late) == 0);
+      OpenFromChild(paths, count, openFlags, numThreads, latencyMs);
+      pthread_join(adder, NULL);
+   } else {
+      OpenFromChild(paths, count, openFlags, numThreads, latencyMs);
+   }
+
+   /* Let the acknowledgement of the last break be processed. */
+   usleep(10 * 1000);
+
+   pthread_mutex_lock(&gLock);
+   sent = gNumBreaksSent;
+   for (i = 0; i < count; i++) {
+      int kernelLease = fcntl(fds[i], F_GETLEASE);
+      HgfsLockType leased = kernelLease == F_RDLCK ? HGFS_LOCK_SHARED :
+                            kernelLease == F_WRLCK ? HGFS_LOCK_EXCLUSIVE :
+                            HGFS_LOCK_NONE;
+
+      if (leased != expectedLock || gNodeLock[fds[i]] != expectedLock ||
+          latencyMs[i] < minMs || latencyMs[i] > maxMs) {
+         if (bad++ == 0) {
+            printf("     %s: file %d lease %d node %d, %u ms\n", label, i,
+                   leased, gNodeLock[fds[i]], latencyMs[i]);
+         }
+      }
+      totalMs += latencyMs[i];
+      worstMs = MAX(worstMs, latencyMs[i]);
+      bestMs = MIN(bestMs, latencyMs[i]);
+   }
+   pthread_mutex_unlock(&gLock);
+
+   if (mode != CLIENT_UNREACHABLE && sent != count) {
+      printf("     %s: %d breaks sent for %d files\n", label, sent, count);
+      bad++;
+   }
+
+   printf("%s %-26s %5d %7d %7u %7"FMT64"u %7u\n", bad == 0 ? "ok  " : "FAIL",
+          label, count, sent, bestMs, totalMs / count, worstMs);
+   gFailures += bad != 0;
+
+   for (i = 0; i < count; i++) {
+      HgfsPlatformOplockRemoveNode(fds[i]);
+      close(fds[i]);
+   }
+}
+
+
+/*
+ * Opens the files from a second process while the session is closed.
+ */
+
+typedef struct ExitOpener {
+   char **paths;
+   int count;
+   int numThreads;
+   uint32 *latencyMs;
+} ExitOpener;
+
+
+static void *
+ExitOpenerThread(void *data)  // IN: ExitOpener
+{
+   ExitOpener *opener = data;
+
+   OpenFromChild(opener->paths, opener->count, O_WRONLY, opener->numThreads,
+                 opener->latencyMs);
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RunSessionExitCase --
+ *
+ *      Leases the files for a session whose client never acknowledges a
+ *      break, has a second process open them, and closes the session the way
+ *      the transport does once the first breaks are sent.
+ *
+ *      The blocked opens must proceed right away rather than wait for the
+ *      timeout, the closed session must get no new lease, and it must be
+ *      torn down once, when its last lease and pending break are gone.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Counts a failure if a check fails.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+RunSessionExitCase(char **paths,     // IN:
+                   int count,        // IN:
+                   int numThreads,   // IN:
+                   uint32 maxMs)     // IN: expected break latency
+{
+   const char *label = "session exits during break";
+   HgfsSessionInfo *session = Util_SafeCalloc(1, sizeof *session);
+   fileDesc fds[MAX_FILES];
+   uint32 latencyMs[MAX_FILES];
+   ExitOpener opener = { paths, count, numThreads, latencyMs };
+   HgfsLockType serverLock;
+   uint64 totalMs = 0;
+   uint32 worstMs = 0;
+   uint32 bestMs = ~0U;
+   uint64 deadline;
+   pthread_t openerThread;
+   char *extraPath;
+   fileDesc extraFd;
+   int bad = 0;
+   int sent;
+   int i;
+
+   /* The reference of the transport's session list. */
+   session->flags = HGFS_SESSION_OPLOCK_ENABLED;
+   session->state = HGFS_SESSION_STATE_OPEN;
+   Atomic_Write32(&session->refCount, 1);
+
+   pthread_mutex_lock(&gLock);
+   gClientMode = CLIENT_SILENT;
+   gNumBreaksSent = 0;
+   gTeardowns = 0;
+   pthread_mutex_unlock(&gLock);
+
+   for (i = 0; i < count; i++) {
+      serverLock = HGFS_LOCK_EXCLUSIVE;
+      fds[i] = open(paths[i], O_RDONLY);
+      VERIFY(fds[i] >= 0 && fds[i] < MAX_FILES + HANDLE_BASE);
+      VERIFY(HgfsAcquireServerLock(fds[i], session, &serverLock));
+      HgfsPlatformOplockAddNode(fds[i], fds[i] + HANDLE_BASE);
+   }
+   gExitSession = session;
+   gExitFds = fds;
+   gNumExitFds = count;
+
+   VERIFY(pthread_create(&openerThread, NULL, ExitOpenerThread,
+                         &opener) == 0);
+
+   deadline = NowMS() + HGFS_OPLOCK_BREAK_TIMEOUT_MS / 2;
+   do {
+      usleep(1000);
+      pthread_mutex_lock(&gLock);
+      sent = gNumBreaksSent;
+      pthread_mutex_unlock(&gLock);
+   } while (sent < MIN(numThreads, count) && NowMS() < deadline);
+
+   /* What HgfsServerTransportRemoveSessionFromList() does. */
+   session->state = HGFS_SESSION_STATE_CLOSED;
+   HgfsPlatformOplockRemoveSession(session);
+
+   extraPath = Str_SafeAsprintf(NULL, "%s.extra", paths[0]);
+   extraFd = open(extraPath, O_CREAT | O_RDONLY, 0644);
+   VERIFY(extraFd >= 0);
+   serverLock = HGFS_LOCK_EXCLUSIVE;
+   if (HgfsAcquireServerLock(extraFd, session, &serverLock) ||
+       fcntl(extraFd, F_GETLEASE) != F_UNLCK) {
+      printf("     %s: closed session got a lease\n", label);
+      bad++;
+   }
+   close(extraFd);
+   unlink(extraPath);
+   free(extraPath);
+
+   for (i = 0; i < count; i++) {
+      if (fcntl(fds[i], F_GETLEASE) != F_UNLCK) {
+         if (bad++ == 0) {
+            printf("     %s: file %d still leased\n", label, i);
+         }
+      }
+   }
+
+   HgfsServerSessionPut(session);
+   pthread_join(openerThread, NULL);
+
+   /* The pending breaks hold the session until the main loop drops them. */
+   deadline = NowMS() + HGFS_OPLOCK_BREAK_TIMEOUT_MS;
+   for (;;) {
+      int teardowns;
+
+      pthread_mutex_lock(&gLock);
+      teardowns = gTeardowns;
+      pthread_mutex_unlock(&gLock);
+      if (teardowns > 0 || NowMS() >= deadline) {
+         break;
+      }
+      usleep(1000);
+   }
+
+   pthread_mutex_lock(&gLock);
+   if (gTeardowns != 1 || gRevived != 0 || gExitSession != NULL) {
+      printf("     %s: %d teardowns, %d revivals\n", label, gTeardowns,
+             gRevived);
+      bad++;
+   }
+   for (i = 0; i < count; i++) {
+      if (latencyMs[i] > maxMs && bad++ == 0) {
+         printf("     %s: file %d, %u ms\n", label, i, latencyMs[i]);
+      }
+      totalMs += latencyMs[i];
+      worstMs = MAX(worstMs, latencyMs[i]);
+      bestMs = MIN(bestMs, latencyMs[i]);
+   }
+   pthread_mutex_unlock(&gLock);
+
+   if (sent == 0) {
+      printf("     %s: no break sent\n", label);
+      bad++;
+   }
+
+   printf("%s %-26s %5d %7d %7u %7"FMT64"u %7u\n", bad == 0 ? "ok  " : "FAIL",
+          label, count, sent, bestMs, totalMs / count, worstMs);
+   gFailures += bad != 0;
+}
+
+
+/*
+ * Runs the main loop that the breaks are sent from.
+ */
+
+static void *
+MainLoopThread(void *data)  // IN: GMainLoop
+{
+   g_main_loop_run(data);
+   return NULL;
+}
+
+
+int
+main(int argc,     // IN:
+     char **argv)  // IN:
+{
+   char root[] = "/tmp/hgfsoplockXXXXXX";
+   int count = (argc > 1) ? atoi(argv[1]) : DEFAULT_FILES;
+   int numThreads = (argc > 2) ? atoi(argv[2]) : DEFAULT_THREADS;
+   uint32 slack = 3 * ACK_DELAY_MS;
+   HgfsSessionInfo session;
+   GMainLoop *loop;
+   pthread_t client;
+   char **paths;
+   int fd;
+   int i;
+
+   if (count <= 0 || count > MAX_FILES / 2 || numThreads <= 0) {
+      fprintf(stderr, "Usage: %s [files (at most %d)] [threads]\n", argv[0],
+              MAX_FILES / 2);
+      return 1;
+   }
+
+   VERIFY(mkdtemp(root) != NULL);
+   paths = Util_SafeCalloc(count, sizeof *paths);
+   for (i = 0; i < count; i++) {
+      paths[i] = Str_SafeAsprintf(NULL, "%s/f%d", root, i);
+      fd = open(paths[i], O_CREAT | O_WRONLY, 0644);
+      VERIFY(fd >= 0);
+      close(fd);
+   }
+
+   fd = open(paths[0], O_RDONLY);
+   if (fcntl(fd, F_SETLEASE, F_WRLCK) != 0) {
+      fprintf(stderr, "File leases are not supported here: %s\n",
+              strerror(errno));
+      close(fd);
+      for (i = 0; i < count; i++) {
+         unlink(paths[i]);
+      }
+      rmdir(root);
+      return 77;
+   }
+   fcntl(fd, F_SETLEASE, F_UNLCK);
+   close(fd);
+
+   VERIFY(HgfsPlatformOplockInit());
+   memset(&session, 0, sizeof session);
+   session.flags = HGFS_SESSION_OPLOCK_ENABLED;
+   session.state = HGFS_SESSION_STATE_OPEN;
+   Atomic_Write32(&session.refCount, 1);
+   loop = g_main_loop_new(NULL, FALSE);
+   VERIFY(pthread_create(&gMainThread, NULL, MainLoopThread, loop) == 0);
+   VERIFY(pthread_create(&client, NULL, ClientThread, NULL) == 0);
+
+   printf("%d files, %d opener threads, acks after %d ms, timeout %d ms\n",
+          count, numThreads, ACK_DELAY_MS, HGFS_OPLOCK_BREAK_TIMEOUT_MS);
+   printf("%-31s %5s %7s %7s %7s %7s\n", "case", "files", "breaks",
+          "min ms", "avg ms", "max ms");
+
+   RunCase("read downgrades", &session, paths, count, numThreads, CLIENT_ACK,
+           HGFS_LOCK_EXCLUSIVE, O_RDONLY, FALSE, HGFS_LOCK_SHARED,
+           ACK_DELAY_MS, ACK_DELAY_MS + slack);
+   RunCase("write breaks", &session, paths, count, numThreads, CLIENT_ACK,
+           HGFS_LOCK_OPPORTUNISTIC, O_WRONLY, FALSE, HGFS_LOCK_NONE,
+           ACK_DELAY_MS, ACK_DELAY_MS + slack);
+   RunCase("write breaks read lease", &session, paths, count, numThreads,
+           CLIENT_ACK, HGFS_LOCK_SHARED, O_WRONLY, FALSE, HGFS_LOCK_NONE,
+           ACK_DELAY_MS, ACK_DELAY_MS + slack);
+   RunCase("break before node cached", &session, paths, count, numThreads,
+           CLIENT_ACK, HGFS_LOCK_EXCLUSIVE, O_WRONLY, TRUE, HGFS_LOCK_NONE,
+           ACK_DELAY_MS, LATE_NODE_MS + ACK_DELAY_MS + slack);
+   RunCase("client unreachable", &session, paths, count, numThreads,
+           CLIENT_UNREACHABLE, HGFS_LOCK_EXCLUSIVE, O_WRONLY, FALSE,
+           HGFS_LOCK_NONE, 0, slack);
+   RunCase("client never acks", &session, paths, count, numThreads,
+           CLIENT_SILENT, HGFS_LOCK_EXCLUSIVE, O_WRONLY, FALSE,
+           HGFS_LOCK_NONE, HGFS_OPLOCK_BREAK_TIMEOUT_MS,
+           HGFS_OPLOCK_BREAK_TIMEOUT_MS + slack);
+   RunSessionExitCase(paths, count, numThreads, slack);
+
+   pthread_mutex_lock(&gLock);
+   gStop = TRUE;
+   pthread_mutex_unlock(&gLock);
+   pthread_join(client, NULL);
+   HgfsPlatformOplockDestroy();
+   g_main_loop_quit(loop);
+   pthread_join(gMainThread, NULL);
+   g_main_loop_unref(loop);
+
+   if (gWrongThread != 0 || Atomic_Read32(&session.refCount) != 1) {
+      printf("FAIL %d breaks sent outside the main loop, %u session "
+             "references left\n", gWrongThread,
+             Atomic_Read32(&session.refCount) - 1);
+      gFailures++;
+   }
+
+   for (i = 0; i < count; i++) {
+      unlink(paths[i]);
+      free(paths[i]);
+   }
+   free(paths);
+   rmdir(root);
+
+   printf("%s\n", gFailures == 0 ? "PASSED" : "FAILED");
+   return gFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,259 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * lockBench.c --
+ *
+ *   Microbenchmark for the MXUser locks. Runs the same short critical
+ *   section against each lock variant (plain and adaptive exclusive locks,
+ *   plain and reader-biased read-write locks) with a configurable number of
+ *   threads and reader ratio, and reports throughput for comparison.
+ *
+ *   Usage: vmware-testlock-bench [threads] [iterations] [read percent]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "vmware.h"
+#include "hostinfo.h"
+#include "util.h"
+#include "userlock.h"
+
+#define DEFAULT_THREADS        8
+#define DEFAULT_ITERATIONS     200000
+#define DEFAULT_READ_PERCENT   95
+#define CRITICAL_SECTION_WORK  32
+
+typedef enum {
+   BENCH_EXCL,
+   BENCH_EXCL_ADAPTIVE,
+   BENCH_RW,
+   BENCH_RW_BIASED,
+} BenchType;
+
+static const char *benchNames[] = {
+   "exclusive",
+   "exclusive (adaptive spin)",
+   "read-write",
+   "read-write (reader biased)",
+};
+
+typedef struct {
+   BenchType        type;
+   MXUserExclLock  *exclLock;
+   MXUserRWLock    *rwLock;
+   uint32           iterations;
+   uint32           readPercent;
+   volatile uint64  shared[CRITICAL_SECTION_WORK];
+} BenchState;
+
+typedef struct {
+   BenchState  *state;
+   uint32       seed;
+} BenchThread;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchCriticalSection --
+ *
+ *      A short critical section: touch (read or update) a small table.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Updates the shared table when not reading.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchCriticalSection(BenchState *state,  // IN/OUT:
+                     Bool forRead)       // IN:
+{
+   uint32 i;
+   uint64 sum = 0;
+
+   for (i = 0; i < CRITICAL_SECTION_WORK; i++) {
+      if (forRead) {
+         sum += state->shared[i];
+      } else {
+         state->shared[i]++;
+      }
+   }
+
+   (void) sum;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchThreadMain --
+ *
+ *      Benchmark thread body.
+ *
+ * Results:
+ *      NULL.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void *
+BenchThreadMain(void *data)  // IN:
+{
+   BenchThread *thread = data;
+   BenchState *state = thread->state;
+   uint32 i;
+
+   for (i = 0; i < state->iterations; i++) {
+      Bool forRead = (rand_r(&thread->seed) % 100) < state->readPercent;
+
+      switch (state->type) {
+      case BENCH_EXCL:
+      case BENCH_EXCL_ADAPTIVE:
+         MXUser_AcquireExclLock(state->exclLock);
+         BenchCriticalSection(state, forRead);
+         MXUser_ReleaseExclLock(state->exclLock);
+         break;
+
+      case BENCH_RW:
+      case BENCH_RW_BIASED:
+         if (forRead) {
+            MXUser_AcquireForRead(state->rwLock);
+         } else {
+            MXUser_AcquireForWrite(state->rwLock);
+         }
+         BenchCriticalSection(state, forRead);
+         MXUser_ReleaseRWLock(state->rwLock);
+         break;
+      }
+   }
+
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchRun --
+ *
+ *      Run one lock variant and print its throughput.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Creates and destroys threads and locks.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchRun(BenchType type,       // IN:
+         uint32 numThreads,    // IN:
+         uint32 iterations,    // IN:
+         uint32 readPercent)   // IN:
+{
+   uint32 i;
+   double secs;
+   VmTimeType start;
+   BenchState state = { 0 };
+   pthread_t *tids = Util_SafeCalloc(numThreads, sizeof *tids);
+   BenchThread *threads = Util_SafeCalloc(numThreads, sizeof *threads);
+
+   state.type = type;
+   state.iterations = iterations;
+   state.readPercent = readPercent;
+
+   switch (type) {
+   case BENCH_EXCL:
+      state.exclLock = MXUser_CreateExclLock("benchExcl", RANK_UNRANKED);
+      break;
+   case BENCH_EXCL_ADAPTIVE:
+      state.exclLock = MXUser_CreateExclLockEx("benchExclAdaptive",
+                                               RANK_UNRANKED,
+                                               MXUSER_FLAG_ADAPTIVE_SPIN);
+      break;
+   case BENCH_RW:
+      state.rwLock = MXUser_CreateRWLock("benchRW", RANK_UNRANKED);
+      break;
+   case BENCH_RW_BIASED:
+      state.rwLock = MXUser_CreateRWLockEx("benchRWBiased", RANK_UNRANKED,
+                                           MXUSER_FLAG_READER_BIASED);
+      break;
+   }
+
+   start = Hostinfo_SystemTimerNS();
+
+   for (i = 0; i < numThreads; i++) {
+      threads[i].state = &state;
+      threads[i].seed = i + 1;
+      if (pthread_create(&tids[i], NULL, BenchThreadMain, &threads[i]) != 0) {
+         Panic("%s: pthread_create failed\n", __FUNCTION__);
+      }
+   }
+
+   for (i = 0; i < numThreads; i++) {
+      pthread_join(tids[i], NULL);
+   }
+
+   secs = (Hostinfo_SystemTimerNS() - start) / 1e9;
+
+   printf("%-28s %3u threads %10.0f ops/s %8.1f ns/op\n", benchNames[type],
+          numThreads, (double) numThreads * iterations / secs,
+          secs * 1e9 / ((double) numThreads * iterations));
+
+   MXUser_DestroyExclLock(state.exclLock);
+   MXUser_DestroyRWLock(state.rwLock);
+   free(threads);
+   free(tids);
+}
+
+
+int
+main(int argc,     // IN:
+     char **argv)  // IN:
+{
+   uint32 numThreads = (argc > 1) ? atoi(argv[1]) : DEFAULT_THREADS;
+   uint32 iterations = (argc > 2) ? atoi(argv[2]) : DEFAULT_ITERATIONS;
+   uint32 readPercent = (argc > 3) ? atoi(argv[3]) : DEFAULT_READ_PERCENT;
+   BenchType type;
+
+   if (numThreads == 0 || iterations == 0 || readPercent > 100) {
+      fprintf(stderr, "Usage: %s [threads] [iterations] [read percent]\n",
+              argv[0]);
+      return 1;
+   }
+
+   printf("%u iterations per thread, %u%% reads\n", iterations, readPercent);
+
+   for (type = BENCH_EXCL; type <= BENCH_RW_BIASED; type++) {
+      BenchRun(type, numThreads, iterations, readPercent);
+   }
+
+   return 0;
+}
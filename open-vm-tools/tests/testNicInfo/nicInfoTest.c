@@ -0,0 +1,525 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * nicInfoTest.c --
+ *
+ *   Test of the interface inventory of the nic info library. A mocked
+ *   enumerator feeds it fake interface sets, as libdnet would enumerate
+ *   them on a container host: hundreds of cali and veth interfaces before
+ *   the uplinks. Checks which NICs, addresses and routes are reported, and
+ *   the dropped counts, with the default rules and with configured ones.
+ *
+ *   Usage: vmware-testnicinfo
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <netinet/in.h>
+
+#include "vm_basic_types.h"
+#include "vm_basic_defs.h"
+#include "nicInfoInt.h"
+#include "xdrutil.h"
+
+#define CHECK(cond) \
+   do {                                                                   \
+      if (!(cond)) {                                                      \
+         fprintf(stderr, "FAIL %s: line %d: %s\n", name, __LINE__, #cond); \
+         failures++;                                                      \
+      }                                                                   \
+   } while (0)
+
+/*
+ * A set of count interfaces named prefix0, prefix1, ..., each with numIps
+ * IPv6 addresses, the first reported twice if dupFirst.
+ */
+typedef struct FakeNics {
+   const char *prefix;
+   u_int count;
+   u_int numIps;
+   Bool dupFirst;
+} FakeNics;
+
+/* A container host: the uplinks come last. */
+static const FakeNics containerHost[] = {
+   { "cali",   200, 0, FALSE },
+   { "veth",   100, 1, FALSE },
+   { "eth",    1,   2, TRUE },
+   { "ens",    2,   1, FALSE },
+   { "docker", 1,   1, FALSE },
+};
+
+#define NUM_CONTAINER_NICS (200 + 100 + 1 + 2 + 1)
+
+static int failures;
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * FakeMac --
+ *
+ *    The MAC address of the i-th interface of the set-th set.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+FakeMac(u_int set,                        // IN:
+        u_int i,                          // IN:
+        char macAddress[NICINFO_MAC_LEN])  // OUT:
+{
+   snprintf(macAddress, NICINFO_MAC_LEN, "02:00:00:%02x:%02x:%02x",
+            (uint8)set, (uint8)(i >> 8), (uint8)i);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Enumerate --
+ *
+ *    Mocked enumerator: records the interface sets in an inventory, in
+ *    order, as ReadInterfaceDetails does.
+ *
+ * Results:
+ *    The inventory.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static NicInventory *
+Enumerate(const FakeNics *sets,  // IN:
+          u_int numSets)         // IN:
+{
+   NicInventory *inv = GuestInfoInventoryNew();
+   u_int set;
+
+   for (set = 0; set < numSets; set++) {
+      u_int i;
+
+      for (i = 0; i < sets[set].count; i++) {
+         char ifName[32];
+         char macAddress[NICINFO_MAC_LEN];
+         u_int j;
+
+         snprintf(ifName, sizeof ifName, "%s%u", sets[set].prefix, i);
+         FakeMac(set, i, macAddress);
+         GuestInfoInventoryAddNic(inv, ifName, macAddress);
+
+         for (j = 0; j < sets[set].numIps; j++) {
+            struct sockaddr_in6 sin6;
+
+            memset(&sin6, 0, sizeof sin6);
+            sin6.sin6_family = AF_INET6;
+            sin6.sin6_addr.s6_addr[0] = 0xfd;
+            sin6.sin6_addr.s6_addr[11] = set;
+            sin6.sin6_addr.s6_addr[12] = i >> 8;
+            sin6.sin6_addr.s6_addr[13] = i;
+            sin6.sin6_addr.s6_addr[14] = j >> 8;
+            sin6.sin6_addr.s6_addr[15] = j;
+            GuestInfoInventoryAddAddress(inv, ifName,
+                                         (struct sockaddr *)&sin6, 64);
+            if (j == 0 && sets[set].dupFirst) {
+               GuestInfoInventoryAddAddress(inv, ifName,
+                                            (struct sockaddr *)&sin6, 64);
+            }
+         }
+      }
+   }
+
+   return inv;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Collect --
+ *
+ *    Enumerates the interface sets, and reports them in a NicInfoV3.
+ *
+ * Results:
+ *    The NicInfoV3, free with GuestInfo_FreeNicInfo, and its dropped counts.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static NicInfoV3 *
+Collect(const FakeNics *sets,     // IN:
+        u_int numSets,            // IN:
+        NicInfoDropped *dropped)  // OUT:
+{
+   NicInfoV3 *nicInfo = calloc(1, sizeof *nicInfo);
+   NicInventory *inv = Enumerate(sets, numSets);
+
+   GuestInfoInventoryFinish(inv, nicInfo);
+   *dropped = *GuestInfoInventoryGetDropped(inv);
+   GuestInfoInventoryLogDropped(inv);
+   GuestInfoInventoryFree(inv);
+
+   return nicInfo;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * IsNic --
+ *
+ *    Tells whether the i-th reported NIC is an interface of a set.
+ *
+ * Results:
+ *    TRUE if so.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+IsNic(const NicInfoV3 *nicInfo,  // IN:
+      u_int i,                   // IN:
+      u_int set,                 // IN:
+      u_int nic)                 // IN:
+{
+   char macAddress[NICINFO_MAC_LEN];
+
+   FakeMac(set, nic, macAddress);
+
+   return i < nicInfo->nics.nics_len &&
+          strcmp(nicInfo->nics.nics_val[i].macAddress, macAddress) == 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * TestDefaultRules --
+ *
+ *    With the default rules, the uplinks of a container host are reported
+ *    first, then the container interfaces that have addresses.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Increments failures.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+TestDefaultRules(void)
+{
+   const char *name = "default rules";
+   NicInfoDropped dropped;
+   NicInfoV3 *nicInfo;
+   u_int i;
+
+   GuestInfo_SetNicRules(NULL, NULL, NULL);
+   nicInfo = Collect(containerHost, ARRAYSIZE(containerHost), &dropped);
+
+   CHECK(nicInfo->nics.nics_len == NICINFO_MAX_NICS);
+   CHECK(IsNic(nicInfo, 0, 2, 0));      // eth0
+   CHECK(IsNic(nicInfo, 1, 3, 0));      // ens0
+   CHECK(IsNic(nicInfo, 2, 3, 1));      // ens1
+   for (i = 3; i < NICINFO_MAX_NICS; i++) {
+      CHECK(IsNic(nicInfo, i, 1, i - 3));  // veth, not the bare cali
+   }
+
+   /* eth0 reported its first address twice. */
+   CHECK(nicInfo->nics.nics_val[0].ips.ips_len == 2);
+   CHECK(dropped.duplicateIps == 1);
+
+   CHECK(dropped.excludedNics == 0);
+   CHECK(dropped.nics == NUM_CONTAINER_NICS - NICINFO_MAX_NICS);
+   CHECK(dropped.ips == 0);
+
+   GuestInfo_FreeNicInfo(nicInfo);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * TestRules --
+ *
+ *    Primary and exclude rules, with stray blanks and empty patterns.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Increments failures.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+TestRules(void)
+{
+   const char *name = "rules";
+   NicInfoDropped dropped;
+   NicInfoV3 *nicInfo;
+   u_int i;
+
+   GuestInfo_SetNicRules(" ens1 ,, ", NULL, "veth*, docker*");
+   nicInfo = Collect(containerHost, ARRAYSIZE(containerHost), &dropped);
+
+   CHECK(nicInfo->nics.nics_len == NICINFO_MAX_NICS);
+   CHECK(IsNic(nicInfo, 0, 3, 1));      // ens1
+   CHECK(IsNic(nicInfo, 1, 2, 0));      // eth0
+   CHECK(IsNic(nicInfo, 2, 3, 0));      // ens0
+   for (i = 3; i < NICINFO_MAX_NICS; i++) {
+      CHECK(IsNic(nicInfo, i, 0, i - 3));  // cali, veth are excluded
+   }
+
+   CHECK(dropped.excludedNics == 101);
+   CHECK(dropped.nics == 200 - (NICINFO_MAX_NICS - 3));
+
+   GuestInfo_FreeNicInfo(nicInfo);
+
+   /* Without low priority rules, the enumeration order decides. */
+   name = "no low priority rules";
+   GuestInfo_SetNicRules(NULL, "", NULL);
+   nicInfo = Collect(containerHost, ARRAYSIZE(containerHost), &dropped);
+
+   for (i = 0; i < NICINFO_MAX_NICS; i++) {
+      CHECK(IsNic(nicInfo, i, 1, i));      // veth, with addresses
+   }
+   CHECK(dropped.nics == NUM_CONTAINER_NICS - NICINFO_MAX_NICS);
+
+   GuestInfo_FreeNicInfo(nicInfo);
+   GuestInfo_SetNicRules(NULL, NULL, NULL);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * TestOsOrder --
+ *
+ *    NICs that all fit are reported in the enumeration order, unless primary
+ *    or low priority rules are configured. Exclude rules only drop NICs.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Increments failures.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+TestOsOrder(void)
+{
+   static const FakeNics fewNics[] = {
+      { "veth", 2, 1, FALSE },
+      { "eth",  1, 1, FALSE },
+      { "cali", 1, 0, FALSE },
+      { "ens",  1, 1, FALSE },
+   };
+   const char *name = "os order";
+   NicInfoDropped dropped;
+   NicInfoV3 *nicInfo;
+
+   GuestInfo_SetNicRules(NULL, NULL, NULL);
+   nicInfo = Collect(fewNics, ARRAYSIZE(fewNics), &dropped);
+   CHECK(nicInfo->nics.nics_len == 5);
+   CHECK(IsNic(nicInfo, 0, 0, 0));      // veth0
+   CHECK(IsNic(nicInfo, 1, 0, 1));      // veth1
+   CHECK(IsNic(nicInfo, 2, 1, 0));      // eth0
+   CHECK(IsNic(nicInfo, 3, 2, 0));      // cali0
+   CHECK(IsNic(nicInfo, 4, 3, 0));      // ens0
+   GuestInfo_FreeNicInfo(nicInfo);
+
+   name = "os order, excluded nics";
+   GuestInfo_SetNicRules(NULL, NULL, "cali*");
+   nicInfo = Collect(fewNics, ARRAYSIZE(fewNics), &dropped);
+   CHECK(nicInfo->nics.nics_len == 4);
+   CHECK(IsNic(nicInfo, 0, 0, 0));      // veth0
+   CHECK(IsNic(nicInfo, 1, 0, 1));      // veth1
+   CHECK(IsNic(nicInfo, 2, 1, 0));      // eth0
+   CHECK(IsNic(nicInfo, 3, 3, 0));      // ens0
+   CHECK(dropped.excludedNics == 1);
+   GuestInfo_FreeNicInfo(nicInfo);
+
+   name = "configured order";
+   GuestInfo_SetNicRules("ens*", NULL, NULL);
+   nicInfo = Collect(fewNics, ARRAYSIZE(fewNics), &dropped);
+   CHECK(nicInfo->nics.nics_len == 5);
+   CHECK(IsNic(nicInfo, 0, 3, 0));      // ens0
+   CHECK(IsNic(nicInfo, 1, 1, 0));      // eth0
+   CHECK(IsNic(nicInfo, 2, 0, 0));      // veth0
+   CHECK(IsNic(nicInfo, 3, 0, 1));      // veth1
+   CHECK(IsNic(nicInfo, 4, 2, 0));      // cali0, no address
+   GuestInfo_FreeNicInfo(nicInfo);
+
+   GuestInfo_SetNicRules(NULL, NULL, NULL);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * TestAddresses --
+ *
+ *    The address limit, and the inventory refusing duplicate interfaces
+ *    and addresses of unknown ones.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Increments failures.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+TestAddresses(void)
+{
+   static const FakeNics manyIps[] = {
+      { "eth", 2, NICINFO_MAX_IPS + 10, FALSE },
+   };
+   const char *name = "addresses";
+   NicInventory *inv = GuestInfoInventoryNew();
+   struct sockaddr_in sin;
+   NicInfoDropped dropped;
+   NicInfoV3 *nicInfo;
+
+   memset(&sin, 0, sizeof sin);
+   sin.sin_family = AF_INET;
+   sin.sin_addr.s_addr = htonl(0x0a000001);
+
+   CHECK(GuestInfoInventoryAddNic(inv, "eth0", "02:00:00:00:00:00"));
+   CHECK(!GuestInfoInventoryAddNic(inv, "eth0", "02:00:00:00:00:01"));
+   CHECK(GuestInfoInventoryAddAddress(inv, "eth0", (struct sockaddr *)&sin,
+                                      8));
+   CHECK(!GuestInfoInventoryAddAddress(inv, "eth0", (struct sockaddr *)&sin,
+                                       24));
+   CHECK(!GuestInfoInventoryAddAddress(inv, "eth1", (struct sockaddr *)&sin,
+                                       8));
+   CHECK(GuestInfoInventoryGetDropped(inv)->duplicateIps == 1);
+   GuestInfoInventoryFree(inv);
+
+   nicInfo = Collect(manyIps, ARRAYSIZE(manyIps), &dropped);
+   CHECK(nicInfo->nics.nics_len == 2);
+   CHECK(nicInfo->nics.nics_val[0].ips.ips_len == NICINFO_MAX_IPS);
+   CHECK(nicInfo->nics.nics_val[1].ips.ips_len == NICINFO_MAX_IPS);
+   CHECK(dropped.ips == 20);
+   CHECK(dropped.nics == 0);
+   GuestInfo_FreeNicInfo(nicInfo);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * TestRoutes --
+ *
+ *    Routes past the limit: the default route and the routes of the best
+ *    ranked NICs are kept, in order.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Increments failures.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+TestRoutes(void)
+{
+   const char *name = "routes";
+   u_int numRoutes = NICINFO_MAX_ROUTES + 50;
+   NicInfoV3 *nicInfo = calloc(1, sizeof *nicInfo);
+   NicInventory *inv = GuestInfoInventoryNew();
+   u_int i;
+
+   for (i = 0; i < numRoutes; i++) {
+      InetCidrRouteEntry *icre = XDRUTIL_ARRAYAPPEND_GEOMETRIC(nicInfo,
+                                                               routes, 1);
+      struct sockaddr_in sin;
+
+      memset(&sin, 0, sizeof sin);
+      sin.sin_family = AF_INET;
+      sin.sin_addr.s_addr = htonl(0x0a000000 + (i << 8));
+
+      GuestInfoSockaddrToTypedIpAddress((struct sockaddr *)&sin,
+                                        &icre->inetCidrRouteDest);
+      icre->inetCidrRoutePfxLen = i == numRoutes - 1 ? 0 : 24;
+      icre->inetCidrRouteIfIndex = i % 3;
+      icre->inetCidrRouteMetric = i;
+   }
+
+   GuestInfoInventoryLimitRoutes(inv, nicInfo);
+
+   CHECK(nicInfo->routes.routes_len == NICINFO_MAX_ROUTES);
+   CHECK(GuestInfoInventoryGetDropped(inv)->routes == 50);
+   CHECK(nicInfo->routes.routes_val[0].inetCidrRoutePfxLen == 0);
+   for (i = 1; i < NICINFO_MAX_ROUTES; i++) {
+      InetCidrRouteEntry *prev = &nicInfo->routes.routes_val[i - 1];
+      InetCidrRouteEntry *icre = &nicInfo->routes.routes_val[i];
+
+      CHECK(icre->inetCidrRouteIfIndex < 2);
+      CHECK(i == 1 ||
+            prev->inetCidrRouteIfIndex < icre->inetCidrRouteIfIndex ||
+            prev->inetCidrRouteMetric < icre->inetCidrRouteMetric);
+   }
+
+   /* The routes array can still grow. */
+   CHECK(XDRUTIL_ARRAYAPPEND_GEOMETRIC(nicInfo, routes, 30) != NULL);
+
+   GuestInfoInventoryFree(inv);
+   GuestInfo_FreeNicInfo(nicInfo);
+}
+
+
+int
+main(int argc,     // IN:
+     char **argv)  // IN:
+{
+   TestDefaultRules();
+   TestRules();
+   TestOsOrder();
+   TestAddresses();
+   TestRoutes();
+
+   printf("%s\n", failures == 0 ? "PASSED" : "FAILED");
+   return failures == 0 ? 0 : 1;
+}
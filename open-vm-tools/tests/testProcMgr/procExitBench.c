@@ -0,0 +1,176 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * procExitBench.c --
+ *
+ *   Latency benchmark for noticing the exit of a ProcMgr_ExecAsync() child
+ *   from a GLib main loop, the way the VIX plugin runs guest programs. Runs
+ *   a short program back to back, waiting for each run to be reaped either
+ *   by polling on a 1 second timer (the old VIX behaviour) or with
+ *   VMTools_NewProcExitSource(), and reports the time per run.
+ *
+ *   Usage: vmware-testprocmgr-bench [runs] [timer runs] [command]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "vmware.h"
+#include "hostinfo.h"
+#include "procMgr.h"
+#include "vmware/tools/utils.h"
+
+#define DEFAULT_RUNS           200
+#define DEFAULT_TIMER_RUNS     5
+#define DEFAULT_COMMAND        "/bin/true"
+#define POLL_INTERVAL_MS       1000
+
+typedef struct BenchRun {
+   GMainLoop          *loop;
+   ProcMgr_AsyncProc  *proc;
+   Bool                useTimer;
+} BenchRun;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchProcDone --
+ *
+ *      Source callback: if the child has exited, reap it and stop the loop.
+ *
+ * Results:
+ *      TRUE to keep polling (timer mode only), FALSE otherwise.
+ *
+ * Side effects:
+ *      Quits the main loop once the child is reaped.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+BenchProcDone(gpointer data)  // IN:
+{
+   BenchRun *run = data;
+   int exitCode;
+
+   if (ProcMgr_IsAsyncProcRunning(run->proc)) {
+      if (run->useTimer) {
+         return TRUE;
+      }
+      fprintf(stderr, "Exit source fired while the child was running\n");
+      exit(1);
+   }
+
+   if (ProcMgr_GetExitCode(run->proc, &exitCode) != 0 || exitCode != 0) {
+      fprintf(stderr, "Child failed (exit code %d)\n", exitCode);
+      exit(1);
+   }
+
+   g_main_loop_quit(run->loop);
+
+   return FALSE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchRunAll --
+ *
+ *      Run the command 'runs' times back to back and print the mean time
+ *      from start to reap.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Runs the command.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchRunAll(const char *cmd,   // IN:
+            uint32 runs,       // IN:
+            Bool useTimer)     // IN:
+{
+   BenchRun run;
+   VmTimeType start;
+   double secs;
+   uint32 i;
+
+   run.loop = g_main_loop_new(NULL, FALSE);
+   run.useTimer = useTimer;
+
+   start = Hostinfo_SystemTimerNS();
+
+   for (i = 0; i < runs; i++) {
+      GSource *src;
+
+      run.proc = ProcMgr_ExecAsync(cmd, NULL);
+      if (run.proc == NULL) {
+         fprintf(stderr, "Failed to run '%s'\n", cmd);
+         exit(1);
+      }
+
+      if (useTimer) {
+         src = g_timeout_source_new(POLL_INTERVAL_MS);
+      } else {
+         src = VMTools_NewProcExitSource(run.proc);
+      }
+      g_source_set_callback(src, BenchProcDone, &run, NULL);
+      g_source_attach(src, NULL);
+      g_source_unref(src);
+
+      g_main_loop_run(run.loop);
+      ProcMgr_Free(run.proc);
+   }
+
+   secs = (Hostinfo_SystemTimerNS() - start) / 1e9;
+
+   printf("%-12s %5u runs %10.3f ms/run\n",
+          useTimer ? "timer poll" : "exit source", runs, secs * 1e3 / runs);
+
+   g_main_loop_unref(run.loop);
+}
+
+
+int
+main(int argc,     // IN:
+     char **argv)  // IN:
+{
+   uint32 runs = (argc > 1) ? atoi(argv[1]) : DEFAULT_RUNS;
+   uint32 timerRuns = (argc > 2) ? atoi(argv[2]) : DEFAULT_TIMER_RUNS;
+   const char *cmd = (argc > 3) ? argv[3] : DEFAULT_COMMAND;
+
+   if (runs == 0) {
+      fprintf(stderr, "Usage: %s [runs] [timer runs] [command]\n", argv[0]);
+      return 1;
+   }
+
+   printf("%s\n", cmd);
+
+   if (timerRuns > 0) {
+      BenchRunAll(cmd, timerRuns, TRUE);
+   }
+   BenchRunAll(cmd, runs, FALSE);
+
+   return 0;
+}
@@ -0,0 +1,369 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * rmqProxyBench.c --
+ *
+ *   Throughput benchmark for the grabbitmqProxy data tunnel framing. A
+ *   local echo peer, standing in for the VMX proxy, reflects every packet
+ *   back over a socketpair. Each chunk is framed and the echoed packet
+ *   decoded either the DataMap way (build, serialize, deserialize a map)
+ *   or with the header template and in place parser the plugin uses. The
+ *   echoed payload is checked against what was sent.
+ *
+ *   Usage: vmware-testrmqproxy-bench [chunk size] [total MB]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "vmware.h"
+#include "hostinfo.h"
+#include "util.h"
+#include "rabbitmqProxyFraming.h"
+
+#define DEFAULT_CHUNK_SIZE   (64 * 1024)
+#define DEFAULT_TOTAL_MB     256
+#define BENCH_VERSION        "1.0"
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FullRead --
+ *
+ *      Read exactly 'len' bytes.
+ *
+ * Results:
+ *      TRUE on success, FALSE on EOF or error.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+FullRead(int fd,       // IN:
+         void *buf,    // OUT:
+         size_t len)   // IN:
+{
+   char *p = buf;
+
+   while (len > 0) {
+      ssize_t n = read(fd, p, len);
+
+      if (n <= 0) {
+         return FALSE;
+      }
+      p += n;
+      len -= n;
+   }
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FullWrite --
+ *
+ *      Write exactly 'len' bytes.
+ *
+ * Results:
+ *      TRUE on success, FALSE on error.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+FullWrite(int fd,            // IN:
+          const void *buf,   // IN:
+          size_t len)        // IN:
+{
+   const char *p = buf;
+
+   while (len > 0) {
+      ssize_t n = write(fd, p, len);
+
+      if (n <= 0) {
+         return FALSE;
+      }
+      p += n;
+      len -= n;
+   }
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RecvPacket --
+ *
+ *      Receive one length prefixed packet into a growable buffer.
+ *
+ * Results:
+ *      Packet length (including the prefix), or -1 on EOF or error.
+ *
+ * Side effects:
+ *      May reallocate *buf.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+RecvPacket(int fd,          // IN:
+           char **buf,      // IN/OUT:
+           int *bufLen)     // IN/OUT:
+{
+   uint32 netLen;
+   int len;
+
+   if (!FullRead(fd, &netLen, sizeof netLen)) {
+      return -1;
+   }
+
+   len = ntohl(netLen) + sizeof netLen;
+   if (len > *bufLen) {
+      *buf = Util_SafeRealloc(*buf, len);
+      *bufLen = len;
+   }
+
+   memcpy(*buf, &netLen, sizeof netLen);
+
+   return FullRead(fd, *buf + sizeof netLen, len - sizeof netLen) ? len : -1;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * EchoPeer --
+ *
+ *      The stand-in VMX proxy: echo every packet back unchanged.
+ *
+ * Results:
+ *      NULL.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void *
+EchoPeer(void *data)  // IN:
+{
+   int fd = (int)(intptr_t)data;
+   char *buf = NULL;
+   int bufLen = 0;
+   int len;
+
+   while ((len = RecvPacket(fd, &buf, &bufLen)) > 0) {
+      if (!FullWrite(fd, buf, len)) {
+         break;
+      }
+   }
+
+   free(buf);
+   close(fd);
+
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * EncodeDataMap --
+ *
+ *      Frame a chunk the way the plugin used to: build a DataMap with copies
+ *      of the version and payload, then serialize it.
+ *
+ * Results:
+ *      Allocated packet; length in *packetLen.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static char *
+EncodeDataMap(const char *chunk,   // IN:
+              int len,             // IN:
+              uint32 *packetLen)   // OUT:
+{
+   DataMap map;
+   char *packet = NULL;
+   char *payload = Util_SafeMalloc(len);
+
+   memcpy(payload, chunk, len);
+
+   VERIFY(DataMap_Create(&map) == DMERR_SUCCESS);
+   VERIFY(DataMap_SetInt64(&map, RMQPROXYDM_FLD_COMMAND, COMMAND_DATA,
+                           TRUE) == DMERR_SUCCESS);
+   VERIFY(DataMap_SetString(&map, RMQPROXYDM_FLD_GUEST_VER_ID,
+                            Util_SafeStrdup(BENCH_VERSION), -1,
+                            TRUE) == DMERR_SUCCESS);
+   VERIFY(DataMap_SetString(&map, RMQPROXYDM_FLD_PAYLOAD, payload, len,
+                            TRUE) == DMERR_SUCCESS);
+   VERIFY(DataMap_Serialize(&map, &packet, packetLen) == DMERR_SUCCESS);
+   DataMap_Destroy(&map);
+
+   return packet;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BenchRun --
+ *
+ *      Push 'total' bytes through the echo peer in 'chunkSize' chunks and
+ *      report the throughput.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Exits on a data mismatch.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+BenchRun(Bool fastPath,       // IN:
+         int chunkSize,       // IN:
+         uint64 total)        // IN:
+{
+   int fds[2];
+   pthread_t peer;
+   RmqProxyDataHeader hdr;
+   char *chunk;
+   char *recvBuf = NULL;
+   int recvBufLen = 0;
+   uint64 sent = 0;
+   VmTimeType start;
+   double secs;
+   int i;
+
+   VERIFY(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+   VERIFY(pthread_create(&peer, NULL, EchoPeer,
+                         (void *)(intptr_t)fds[1]) == 0);
+
+   RmqProxy_InitDataHeader(&hdr, BENCH_VERSION);
+
+   /* As in the plugin, the chunk sits after room for the header. */
+   chunk = Util_SafeMalloc(hdr.len + chunkSize);
+   for (i = 0; i < chunkSize; i++) {
+      chunk[hdr.len + i] = (char)(i * 7);
+   }
+
+   start = Hostinfo_SystemTimerNS();
+
+   while (sent < total) {
+      int packetLen;
+      const char *payload;
+      int32 payloadLen;
+      int64 cmd;
+
+      if (fastPath) {
+         RmqProxy_FillDataHeader(&hdr, chunk, chunkSize);
+         VERIFY(FullWrite(fds[0], chunk, hdr.len + chunkSize));
+      } else {
+         uint32 len;
+         char *packet = EncodeDataMap(chunk + hdr.len, chunkSize, &len);
+
+         VERIFY(FullWrite(fds[0], packet, len));
+         free(packet);
+      }
+
+      packetLen = RecvPacket(fds[0], &recvBuf, &recvBufLen);
+      VERIFY(packetLen > 0);
+
+      if (fastPath) {
+         VERIFY(RmqProxy_ParsePacket(recvBuf, packetLen, &cmd, &payload,
+                                     &payloadLen) == DMERR_SUCCESS);
+         VERIFY(cmd == COMMAND_DATA);
+         VERIFY(payloadLen == chunkSize &&
+                memcmp(payload, chunk + hdr.len, chunkSize) == 0);
+      } else {
+         DataMap map;
+         char *str;
+         char *copy;
+
+         VERIFY(DataMap_Deserialize(recvBuf, packetLen,
+                                    &map) == DMERR_SUCCESS);
+         VERIFY(DataMap_GetInt64(&map, RMQPROXYDM_FLD_COMMAND,
+                                 &cmd) == DMERR_SUCCESS);
+         VERIFY(cmd == COMMAND_DATA);
+         VERIFY(DataMap_GetString(&map, RMQPROXYDM_FLD_PAYLOAD, &str,
+                                  &payloadLen) == DMERR_SUCCESS);
+         copy = Util_SafeMalloc(payloadLen);
+         memcpy(copy, str, payloadLen);
+         VERIFY(payloadLen == chunkSize &&
+                memcmp(copy, chunk + hdr.len, chunkSize) == 0);
+         free(copy);
+         DataMap_Destroy(&map);
+      }
+
+      sent += chunkSize;
+   }
+
+   secs = (Hostinfo_SystemTimerNS() - start) / 1e9;
+
+   printf("%-10s %7d byte chunks: %8.1f MB/s\n",
+          fastPath ? "template" : "dataMap", chunkSize,
+          sent / secs / (1024 * 1024));
+
+   close(fds[0]);
+   pthread_join(peer, NULL);
+   free(recvBuf);
+   free(chunk);
+}
+
+
+int
+main(int argc,     // IN:
+     char **argv)  // IN:
+{
+   int chunkSize = (argc > 1) ? atoi(argv[1]) : DEFAULT_CHUNK_SIZE;
+   uint64 totalMB = (argc > 2) ? atoi(argv[2]) : DEFAULT_TOTAL_MB;
+
+   if (chunkSize <= 0 || totalMB == 0) {
+      fprintf(stderr, "Usage: %s [chunk size] [total MB]\n", argv[0]);
+      return 1;
+   }
+
+   BenchRun(FALSE, chunkSize, totalMB * 1024 * 1024);
+   BenchRun(TRUE, chunkSize, totalMB * 1024 * 1024);
+
+   return 0;
+}
@@ -0,0 +1,173 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file testStartup.c
+ *
+ * A debug plugin that measures how long the service takes to answer its
+ * first RPCs: it sends "Capabilities_Register", then optionally an RPC
+ * handled by one of the plugins, and prints how long after the plugin was
+ * loaded each was answered, and how long each took to handle.
+ *
+ * The debug channel polls the plugin every 100 ms, so the first RPC is sent
+ * at least 100 ms after the service set up the channel, which happens once
+ * the plugins are loaded.
+ *
+ * Environment:
+ *    TEST_STARTUP_LAZY       Set to 1 to load plugins lazily.
+ *    TEST_STARTUP_MANIFEST   Path of the plugin manifest (default: a file
+ *                            in the temporary directory).
+ *    TEST_STARTUP_RPC        A plugin RPC to send after the capabilities,
+ *                            e.g. "vmbackup.getTimeline".
+ *
+ * Run with "vmtoolsd -n vmsvc -b <path to this plugin>", twice when loading
+ * lazily: the first run records the manifest the second one uses.
+ */
+
+#define G_LOG_DOMAIN "testStartup"
+#include <stdio.h>
+#include <stdlib.h>
+#include <glib-object.h>
+#include <CUnit/CUnit.h>
+
+#include "hostinfo.h"
+#include "util.h"
+#include "vmware/tools/rpcdebug.h"
+
+#define TEST_CAPREG        "Capabilities_Register"
+
+typedef enum {
+   TEST_STEP_CAPS,
+   TEST_STEP_RPC,
+   TEST_STEP_FINISHED,
+} TestStep;
+
+static TestStep gStep = TEST_STEP_CAPS;
+static const char *gRpc = NULL;
+static VmTimeType gLoaded;
+static const char *gSentRpc;
+static VmTimeType gSent;
+
+
+/**
+ * Prints how long an RPC took to be answered.
+ *
+ * @param[in]  data     RPC request data.
+ * @param[in]  ret      Return value from RPC handler.
+ *
+ * @return @a ret.
+ */
+
+static gboolean
+TestValidateTime(RpcInData *data,
+                 gboolean ret)
+{
+   VmTimeType now = Hostinfo_SystemTimerUS();
+
+   if (!ret) {
+      g_warning("%s failed: %s\n", gSentRpc, data->result);
+   }
+   CU_ASSERT(ret);
+
+   printf("%-24s answered %10.3f ms after load, handled in %10.3f ms\n",
+          gSentRpc, (now - gLoaded) / 1000.0, (now - gSent) / 1000.0);
+   return ret;
+}
+
+
+/**
+ * Sends the RPCs to be timed.
+ *
+ * @param[in]  rpcdata     Data for the injected RPC request data.
+ *
+ * @return TRUE if sending messages, FALSE if no more messages to be sent.
+ */
+
+static gboolean
+TestSendNext(RpcDebugMsgMapping *rpcdata)
+{
+   switch (gStep) {
+   case TEST_STEP_CAPS:
+      rpcdata->message = TEST_CAPREG;
+      rpcdata->messageLen = sizeof TEST_CAPREG;
+      gStep = (gRpc != NULL) ? TEST_STEP_RPC : TEST_STEP_FINISHED;
+      break;
+
+   case TEST_STEP_RPC:
+      rpcdata->message = (char *) gRpc;
+      rpcdata->messageLen = strlen(gRpc) + 1;
+      gStep = TEST_STEP_FINISHED;
+      break;
+
+   default:
+      return FALSE;
+   }
+
+   rpcdata->validateFn = TestValidateTime;
+   gSentRpc = rpcdata->message;
+   gSent = Hostinfo_SystemTimerUS();
+   return TRUE;
+}
+
+
+/**
+ * Returns the debug plugin's registration data, and configures how the
+ * service loads its plugins.
+ *
+ * @param[in]  ctx      The application context.
+ *
+ * @return The application data.
+ */
+
+TOOLS_MODULE_EXPORT RpcDebugPlugin *
+RpcDebugOnLoad(ToolsAppCtx *ctx)
+{
+   static RpcDebugPlugin regData = {
+      NULL,
+      NULL,
+      TestSendNext,
+      NULL,
+      NULL,
+   };
+   const char *lazy = getenv("TEST_STARTUP_LAZY");
+   const char *manifest = getenv("TEST_STARTUP_MANIFEST");
+   gchar *path = NULL;
+
+   gLoaded = Hostinfo_SystemTimerUS();
+   gRpc = getenv("TEST_STARTUP_RPC");
+
+   if (manifest == NULL) {
+      path = g_build_filename(g_get_tmp_dir(), "testStartup.manifest", NULL);
+      manifest = path;
+   }
+
+   if (ctx->config == NULL) {
+      ctx->config = g_key_file_new();
+   }
+   g_key_file_set_boolean(ctx->config, ctx->name, "plugins.lazyLoad",
+                          lazy != NULL && strcmp(lazy, "1") == 0);
+   g_key_file_set_string(ctx->config, ctx->name, "plugins.manifest", manifest);
+   g_free(path);
+
+   printf("Plugins loaded %s, manifest %s\n",
+          g_key_file_get_boolean(ctx->config, ctx->name, "plugins.lazyLoad",
+                                 NULL) ? "lazily" : "eagerly",
+          manifest);
+
+   return &regData;
+}
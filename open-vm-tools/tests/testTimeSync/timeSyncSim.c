@@ -0,0 +1,544 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * timeSyncSim.c --
+ *
+ *   Userspace implementation of the platform functions of the time sync
+ *   plugin (timeSync.h) on top of a virtual clock.
+ *
+ *   The guest clock runs at the rate of real time, plus its frequency
+ *   error, plus the corrections of the slew and of the PLL. The slew and
+ *   the PLL model what slewLinux.c and pllLinux.c get from adjtimex(): the
+ *   slew sets the tick length, in steps of 100ppm within 10%; the PLL has
+ *   a frequency, set directly or nudged by each offset update, and slews
+ *   1/64th of the last offset every second (time constant 4).
+ *
+ *   The host time source returns real time, with noise, occasional
+ *   outliers, and reads after which the vCPU does not run for a while.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "timeSyncSim.h"
+
+#define SIM_TICK_NOMINAL        10000   // us, at USER_HZ 100
+#define SIM_TICK_MIN            9000
+#define SIM_TICK_MAX            11000
+#define SIM_PLL_SHIFT           6       // SHIFT_PLL + time constant
+#define SIM_PLL_MAX_PPM         500.0
+#define SIM_PLL_MAX_OFFSET      500000
+#define SIM_PLL_MAX_INTERVAL    128.0   // s, 2^(SHIFT_PLL + 1 + constant)
+#define SIM_READ_US             5       // cost of a backdoor call
+#define SIM_START               (1483228800.0 * US_PER_SEC)
+
+SimClock simClock;
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * SimRandom --
+ *
+ *    Pseudo random number generator (xorshift), so that runs repeat.
+ *
+ * Results:
+ *    A number in [0, 1).
+ *
+ * Side effects:
+ *    Advances the seed.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static double
+SimRandom(void)
+{
+   uint32 x = simClock.seed;
+
+   x ^= x << 13;
+   x ^= x >> 17;
+   x ^= x << 5;
+   simClock.seed = x;
+   return x / 4294967296.0;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * SimGaussian --
+ *
+ *    Normally distributed noise (Box-Muller).
+ *
+ * Results:
+ *    A number with mean 0 and standard deviation 1.
+ *
+ * Side effects:
+ *    Advances the seed.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static double
+SimGaussian(void)
+{
+   double u = 1.0 - SimRandom();
+   double v = SimRandom();
+
+   return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * SimClampFrequency --
+ *
+ *    Keeps a PLL frequency within what the kernel accepts.
+ *
+ * Results:
+ *    The frequency, in ppm.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static double
+SimClampFrequency(double ppm)  // IN:
+{
+   return MAX(MIN(ppm, SIM_PLL_MAX_PPM), -SIM_PLL_MAX_PPM);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Sim_Init --
+ *
+ *    Starts a virtual clock, with the guest offset from real time.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Resets simClock.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+void
+Sim_Init(const SimClockConfig *config,  // IN:
+         double offset,                 // IN: guest - real, us
+         uint32 seed)                   // IN: non zero
+{
+   memset(&simClock, 0, sizeof simClock);
+   simClock.config = *config;
+   simClock.now = SIM_START;
+   simClock.guest = SIM_START + offset;
+   simClock.drift = config->drift;
+   simClock.tick = SIM_TICK_NOMINAL;
+   simClock.seed = seed;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Sim_Advance --
+ *
+ *    Lets real time pass, and the guest clock with it. The PLL slews its
+ *    offset at each second of real time, and the drift wanders.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Advances the clocks.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+void
+Sim_Advance(double us)  // IN:
+{
+   while (us > 0) {
+      double toSecond = US_PER_SEC - fmod(simClock.now, US_PER_SEC);
+      double step = MIN(us, toSecond);
+      double rate = 1.0 + (simClock.drift + simClock.pllFrequency) / 1e6 +
+                    (double)(simClock.tick - SIM_TICK_NOMINAL) /
+                    SIM_TICK_NOMINAL;
+
+      simClock.guest += step * rate;
+      simClock.now += step;
+      us -= step;
+
+      if (step == toSecond) {
+         double chunk = ldexp(simClock.pllOffset, -SIM_PLL_SHIFT);
+
+         simClock.guest += chunk;
+         simClock.pllOffset -= chunk;
+         simClock.drift += SimGaussian() * simClock.config.wander / 60.0;
+      }
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Sim_StepGuest --
+ *
+ *    Steps the guest clock, as when the guest was not running for a while.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+void
+Sim_StepGuest(double us)  // IN:
+{
+   simClock.guest += us;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Sim_SetDrift --
+ *
+ *    Changes the frequency error of the guest clock, as when moving to
+ *    another host.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+void
+Sim_SetDrift(double ppm)  // IN:
+{
+   simClock.drift = ppm;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Sim_Offset --
+ *
+ *    The true error of the guest clock.
+ *
+ * Results:
+ *    Guest time - real time, in us.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+double
+Sim_Offset(void)
+{
+   return simClock.guest - simClock.now;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * TimeSync_ReadHost --
+ *
+ *    Reads the host time: real time, with noise and the odd outlier.
+ *    The vCPU may then not run for a while.
+ *
+ * Results:
+ *    TRUE.
+ *
+ * Side effects:
+ *    Advances the clocks.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+Bool
+TimeSync_ReadHost(int64 *host,                // OUT:
+                  int64 *apparentError,       // OUT:
+                  Bool *apparentErrorValid,   // OUT:
+                  int64 *maxTimeError)        // OUT:
+{
+   double noise = SimGaussian() * simClock.config.jitter;
+
+   Sim_Advance(SIM_READ_US);
+   if (SimRandom() < simClock.config.outlierRate) {
+      noise += (2.0 * SimRandom() - 1.0) * simClock.config.outlier;
+   }
+
+   *host = (int64)(simClock.now + noise);
+   *apparentError = 0;
+   *apparentErrorValid = TRUE;
+   *maxTimeError = simClock.config.maxTimeError;
+   simClock.reads++;
+
+   if (SimRandom() < simClock.config.preemptRate) {
+      Sim_Advance(SimRandom() * simClock.config.preempt);
+   }
+
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * TimeSync_StopCatchup --
+ *
+ *    Nothing to catch up: the virtual clock has no apparent time error.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+void
+TimeSync_StopCatchup(void)
+{
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * TimeSync_GetCurrentTime --
+ *
+ *    Reads the guest clock.
+ *
+ * Results:
+ *    TRUE.
+ *
+ * Side effects:
+ *    Advances the clocks by a microsecond.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+Bool
+TimeSync_GetCurrentTime(int64 *now)  // OUT:
+{
+   Sim_Advance(1);
+   *now = (int64)simClock.guest;
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * TimeSync_AddToCurrentTime --
+ *
+ *    Steps the guest clock.
+ *
+ * Results:
+ *    TRUE.
+ *
+ * Side effects:
+ *    Counts the step.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+Bool
+TimeSync_AddToCurrentTime(int64 delta)  // IN:
+{
+   simClock.guest += delta;
+   simClock.steps++;
+   if (delta < 0) {
+      simClock.backwardSteps++;
+   }
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * TimeSync_Slew --
+ *
+ *    Sets the tick length so that delta is corrected over timeSyncPeriod,
+ *    and reports how much of the previous correction is left, as
+ *    slewLinux.c does.
+ *
+ * Results:
+ *    TRUE.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+Bool
+TimeSync_Slew(int64 delta,           // IN:
+              int64 timeSyncPeriod,  // IN:
+              int64 *remaining)      // OUT:
+{
+   int64 now;
+
+   TimeSync_GetCurrentTime(&now);
+
+   if (simClock.slewStart != 0) {
+      int64 ticksElapsed = (now - simClock.slewStart) / simClock.tick;
+
+      *remaining = simClock.slewDelta -
+                   ticksElapsed * (simClock.tick - SIM_TICK_NOMINAL);
+   }
+
+   simClock.tick = (timeSyncPeriod + delta) /
+                   ((timeSyncPeriod / US_PER_SEC) * 100);
+   simClock.tick = MAX(MIN(simClock.tick, SIM_TICK_MAX), SIM_TICK_MIN);
+   simClock.slewStart = now;
+   simClock.slewDelta = delta;
+
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * TimeSync_DisableTimeSlew --
+ *
+ *    Sets the tick length back to nominal.
+ *
+ * Results:
+ *    TRUE.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+Bool
+TimeSync_DisableTimeSlew(void)
+{
+   simClock.tick = SIM_TICK_NOMINAL;
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * TimeSync_PLLSupported --
+ *
+ *    The virtual clock has a PLL, as Linux does.
+ *
+ * Results:
+ *    TRUE.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+Bool
+TimeSync_PLLSupported(void)
+{
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * TimeSync_PLLSetFrequency --
+ *
+ *    Sets the frequency of the PLL.
+ *
+ * Results:
+ *    TRUE.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+Bool
+TimeSync_PLLSetFrequency(int64 ppmCorrection)  // IN: ppm << 16
+{
+   simClock.pllFrequency = SimClampFrequency(ppmCorrection / 65536.0);
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * TimeSync_PLLUpdate --
+ *
+ *    Gives the PLL a new offset to slew. Like the kernel, it also corrects
+ *    its frequency by the offset times the time since the last update (up
+ *    to 128s), divided by 2^16.
+ *
+ * Results:
+ *    TRUE.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+Bool
+TimeSync_PLLUpdate(int64 offset)  // IN:
+{
+   offset = MAX(MIN(offset, SIM_PLL_MAX_OFFSET), -SIM_PLL_MAX_OFFSET);
+
+   if (simClock.pllLastUpdate != 0) {
+      double secs = (simClock.now - simClock.pllLastUpdate) / US_PER_SEC;
+
+      /* The kernel caps the interval, to keep the loop stable. */
+      secs = MIN(secs, SIM_PLL_MAX_INTERVAL);
+      simClock.pllFrequency =
+         SimClampFrequency(simClock.pllFrequency + offset * secs / 65536.0);
+   }
+   simClock.pllLastUpdate = simClock.now;
+   simClock.pllOffset = offset;
+
+   return TRUE;
+}
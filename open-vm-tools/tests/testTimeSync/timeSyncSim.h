@@ -0,0 +1,73 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * timeSyncSim.h --
+ *
+ *   Virtual clock for the time sync discipline (timeSyncDiscipline.c): a
+ *   guest clock that drifts against real time, a host time source with
+ *   noise, and the Linux slew and PLL backends on top of them.
+ */
+
+#ifndef _TIMESYNC_SIM_H_
+#define _TIMESYNC_SIM_H_
+
+#include "timeSync.h"
+
+typedef struct SimClockConfig {
+   double drift;            // frequency error of the guest clock, ppm
+   double wander;           // random walk of the drift, ppm per hour
+   double jitter;           // noise on each host time read, us (stddev)
+   double outlierRate;      // share of host reads that are off ...
+   double outlier;          // ... by up to this much, us
+   double preemptRate;      // share of reads after which the vCPU is
+   double preempt;          // descheduled for up to this long, us
+   int64 maxTimeError;      // as set on the host, us
+} SimClockConfig;
+
+typedef struct SimClock {
+   SimClockConfig config;
+
+   double now;              // real time, us
+   double guest;            // guest clock, us
+   double drift;            // current frequency error, ppm
+
+   int64 tick;              // tick length set by the slew, us
+   int64 slewStart;         // guest time the slew was set, 0 if none
+   int64 slewDelta;         // correction requested by the slew
+
+   double pllOffset;        // offset the PLL has still to correct, us
+   double pllFrequency;     // ppm
+   double pllLastUpdate;    // real time, us, 0 if none
+
+   uint32 seed;
+
+   uint64 reads;            // host time reads
+   uint64 steps;            // guest clock steps ...
+   uint64 backwardSteps;    // ... of which backwards
+} SimClock;
+
+extern SimClock simClock;
+
+void Sim_Init(const SimClockConfig *config, double offset, uint32 seed);
+void Sim_Advance(double us);
+void Sim_StepGuest(double us);
+void Sim_SetDrift(double ppm);
+double Sim_Offset(void);
+
+#endif /* _TIMESYNC_SIM_H_ */
@@ -0,0 +1,240 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * timeSyncTest.c --
+ *
+ *   Replays clock scenarios against the periodic time sync, with the slew
+ *   and the filtered disciplines, on a virtual clock. For each run,
+ *   reports:
+ *
+ *   - converge: seconds from the last disturbance until the guest clock
+ *     stays within CONVERGED_US of real time, '-' if it does not;
+ *   - max, rms: largest and root mean square error over the last hour;
+ *   - steps: how many times the guest clock was stepped.
+ *
+ *   Fails if the filtered discipline does not converge, or if the guest
+ *   clock is ever stepped backwards.
+ *
+ *   Usage: vmware-testtimesync [scenario]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "vm_basic_defs.h"
+#include "timeSyncSim.h"
+
+#define PERIOD          60              // s, as TIMESYNC_TIME
+#define CONVERGED_US    1000
+#define LAST_HOUR       3600
+#define MAX_EVENTS      4
+#define SEED            0x2545f491
+
+typedef enum EventType {
+   EVENT_NONE,
+   EVENT_STEP,                  // the guest clock jumps, us
+   EVENT_DRIFT,                 // the frequency error changes, ppm
+} EventType;
+
+typedef struct Event {
+   uint32 time;                 // s
+   EventType type;
+   double value;
+} Event;
+
+typedef struct Scenario {
+   const char *name;
+   uint32 duration;             // s
+   double offset;               // initial error of the guest clock, us
+   SimClockConfig config;
+   Event events[MAX_EVENTS];
+} Scenario;
+
+typedef struct Result {
+   int converge;
+   double max;
+   double rms;
+   uint64 steps;
+   uint64 backwardSteps;
+} Result;
+
+static const Scenario scenarios[] = {
+   /* A steady frequency error. */
+   { "drift", 6 * 3600, 0,
+     { .drift = 120, .maxTimeError = US_PER_SEC } },
+   /* The guest starts ahead: the error can only be slewed. */
+   { "ahead", 6 * 3600, 400000,
+     { .drift = -40, .maxTimeError = US_PER_SEC } },
+   /* Noisy host time, with outliers of up to 20ms on 10% of the reads. */
+   { "noisy", 6 * 3600, 0,
+     { .drift = 60, .jitter = 300, .outlierRate = 0.1, .outlier = 20000,
+       .maxTimeError = US_PER_SEC } },
+   /* The vCPU is descheduled for up to 50ms after 10% of the reads. */
+   { "preempt", 6 * 3600, 0,
+     { .drift = 60, .preemptRate = 0.1, .preempt = 50000,
+       .maxTimeError = US_PER_SEC } },
+   /* The frequency error wanders by 10ppm an hour. */
+   { "wander", 6 * 3600, 0,
+     { .drift = 30, .wander = 10, .maxTimeError = US_PER_SEC } },
+   /* The guest falls 3s behind, then moves to a host with another error. */
+   { "events", 8 * 3600, 0,
+     { .drift = 50, .jitter = 100, .maxTimeError = US_PER_SEC },
+     { { 2 * 3600, EVENT_STEP, -3 * US_PER_SEC },
+       { 4 * 3600, EVENT_DRIFT, -150 } } },
+};
+
+static const char *disciplines[] = { "slew", "filtered" };
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * RunScenario --
+ *
+ *    Runs a scenario with a discipline: the time sync loop starts with the
+ *    scenario and syncs every PERIOD seconds, with slew correction on, as
+ *    vmtoolsd does with the defaults.
+ *
+ * Results:
+ *    The measures of the run.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+RunScenario(const Scenario *scenario,       // IN:
+            TimeSyncDiscipline discipline,  // IN:
+            Result *result)                 // OUT:
+{
+   TimeSyncData data;
+   uint32 disturbed = 0;
+   uint32 converged = 0;
+   uint32 lastHour = scenario->duration - LAST_HOUR;
+   double maxLastHour = 0;
+   double sumSquares = 0;
+   int event = 0;
+   uint32 t;
+
+   memset(&data, 0, sizeof data);
+   data.slewCorrection = TRUE;
+   data.slewPercentCorrection = 50;
+   data.timeSyncPeriod = PERIOD;
+   data.state = TIMESYNC_RUNNING;
+   data.slewState = TimeSyncUncalibrated;
+   data.discipline = discipline;
+
+   Sim_Init(&scenario->config, scenario->offset, SEED);
+
+   /* As TimeSyncStartLoop. */
+   TimeSyncResetSlew(&data);
+
+   for (t = 0; t < scenario->duration; t++) {
+      double offset;
+
+      if (event < MAX_EVENTS && scenario->events[event].type != EVENT_NONE &&
+          scenario->events[event].time == t) {
+         if (scenario->events[event].type == EVENT_STEP) {
+            Sim_StepGuest(scenario->events[event].value);
+         } else {
+            Sim_SetDrift(scenario->events[event].value);
+         }
+         disturbed = t;
+         event++;
+      }
+
+      if (t % PERIOD == 0) {
+         TimeSyncDoSync(data.slewCorrection, FALSE, FALSE, &data);
+      }
+
+      Sim_Advance(US_PER_SEC);
+      offset = fabs(Sim_Offset());
+
+      if (offset >= CONVERGED_US) {
+         converged = t + 1;
+      } else if (converged < disturbed) {
+         converged = disturbed;
+      }
+
+      if (t >= lastHour) {
+         maxLastHour = MAX(maxLastHour, offset);
+         sumSquares += offset * offset;
+      }
+   }
+
+   result->converge = converged < scenario->duration ?
+                      (int)(converged - disturbed) : -1;
+   result->max = maxLastHour;
+   result->rms = sqrt(sumSquares / LAST_HOUR);
+   result->steps = simClock.steps;
+   result->backwardSteps = simClock.backwardSteps;
+}
+
+
+int
+main(int argc,     // IN:
+     char **argv)  // IN:
+{
+   int failures = 0;
+   int i;
+
+   printf("%-8s %-9s %9s %9s %9s %6s\n", "scenario", "disc.", "converge",
+          "max (ms)", "rms (ms)", "steps");
+
+   for (i = 0; i < ARRAYSIZE(scenarios); i++) {
+      TimeSyncDiscipline discipline;
+
+      if (argc > 1 && strcmp(argv[1], scenarios[i].name) != 0) {
+         continue;
+      }
+
+      for (discipline = TIMESYNC_DISCIPLINE_SLEW;
+           discipline <= TIMESYNC_DISCIPLINE_FILTERED;
+           discipline++) {
+         Result r;
+         char converge[16];
+
+         RunScenario(&scenarios[i], discipline, &r);
+
+         if (r.converge >= 0) {
+            snprintf(converge, sizeof converge, "%d", r.converge);
+         } else {
+            snprintf(converge, sizeof converge, "-");
+         }
+         printf("%-8s %-9s %9s %9.3f %9.3f %6llu\n", scenarios[i].name,
+                disciplines[discipline], converge, r.max / 1000.0,
+                r.rms / 1000.0, (unsigned long long)r.steps);
+
+         if (r.backwardSteps != 0) {
+            fprintf(stderr, "FAIL %s: stepped backwards\n", scenarios[i].name);
+            failures++;
+         }
+         if (discipline == TIMESYNC_DISCIPLINE_FILTERED && r.converge < 0) {
+            fprintf(stderr, "FAIL %s: did not converge\n", scenarios[i].name);
+            failures++;
+         }
+      }
+   }
+
+   printf("%s\n", failures == 0 ? "PASSED" : "FAILED");
+   return failures == 0 ? 0 : 1;
+}
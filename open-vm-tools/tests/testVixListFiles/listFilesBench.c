@@ -0,0 +1,442 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * listFilesBench.c --
+ *
+ *   Benchmark for paging through a large directory the way VIX ListFiles
+ *   does. Fills a scratch directory with files, a few subdirectories and
+ *   symlinks, then fetches it page by page:
+ *
+ *   - the old way, which lists the whole directory for every page and
+ *     stats each returned entry by path several times;
+ *   - with a VixToolsDirCursor, which lists the directory once and only
+ *     stats the entries of each page.
+ *
+ *   Both must return every entry exactly once, the cursor sorted by name
+ *   after "." and "..". A second run with a pattern checks that the cursor
+ *   returns exactly the matching names.
+ *
+ *   Usage: vmware-testvixlistfiles-bench [files] [page size]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "vmware.h"
+#include "hostinfo.h"
+#include "util.h"
+#include "str.h"
+#include "file.h"
+#include "posix.h"
+#include "vixToolsInt.h"
+
+#define DEFAULT_FILES          20000
+#define DEFAULT_PAGE_SIZE      100
+#define BENCH_PATTERN          "7[0-9]$"
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MakeDirectory --
+ *
+ *      Create the scratch directory: 'numFiles' entries, one in a hundred
+ *      a subdirectory and one in a hundred a symlink.
+ *
+ * Results:
+ *      Allocated path of the directory.
+ *
+ * Side effects:
+ *      Creates files.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static char *
+MakeDirectory(int numFiles)  // IN:
+{
+   char *dir = Util_SafeStrdup("/tmp/vmware-testvixlistfiles-XXXXXX");
+   int i;
+
+   VERIFY(mkdtemp(dir) != NULL);
+
+   for (i = 0; i < numFiles; i++) {
+      char *path = Str_SafeAsprintf(NULL, "%s/entry-%06d", dir, i);
+
+      if (i % 100 == 1) {
+         VERIFY(mkdir(path, 0755) == 0);
+      } else if (i % 100 == 2) {
+         VERIFY(symlink("entry-000000", path) == 0);
+      } else {
+         int fd = open(path, O_CREAT | O_WRONLY, 0644);
+
+         VERIFY(fd != -1);
+         VERIFY(write(fd, path, i % 512) == i % 512);
+         close(fd);
+      }
+      free(path);
+   }
+
+   return dir;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RemoveDirectory --
+ *
+ *      Remove the scratch directory.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Deletes files.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+RemoveDirectory(const char *dir)  // IN:
+{
+   VERIFY(File_DeleteDirectoryTree(dir));
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * StatByPath --
+ *
+ *      What the old ListFiles did to report one entry: a symlink check for
+ *      the size estimate, then the type checks, the size and a stat.
+ *
+ * Results:
+ *      The size reported for the entry.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int64
+StatByPath(const char *path)  // IN:
+{
+   struct stat statbuf;
+   int64 size = 0;
+
+   (void) File_IsSymLink(path);
+
+   if (!File_IsSymLink(path) && !File_IsDirectory(path) && File_IsFile(path)) {
+      size = File_GetSize(path);
+   }
+   (void) Posix_Stat(path, &statbuf);
+
+   return size;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * PageOld --
+ *
+ *      Fetch one page the old way.
+ *
+ * Results:
+ *      Number of entries returned; their names are appended to 'seen'.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+PageOld(const char *dir,        // IN:
+        int index,              // IN:
+        int pageSize,           // IN:
+        GPtrArray *seen)        // IN/OUT:
+{
+   char **names;
+   int numNames = File_ListDirectory(dir, &names);
+   int count = 0;
+   int i;
+
+   VERIFY(numNames >= 0);
+
+   /* "." and ".." come first. */
+   for (i = index; i < numNames + 2 && count < pageSize; i++, count++) {
+      const char *name = (i == 0) ? "." : (i == 1) ? ".." : names[i - 2];
+      char *path = Str_SafeAsprintf(NULL, "%s/%s", dir, name);
+
+      StatByPath(path);
+      g_ptr_array_add(seen, Util_SafeStrdup(name));
+      free(path);
+   }
+
+   Util_FreeStringList(names, numNames);
+
+   return count;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * PageCursor --
+ *
+ *      Fetch one page from a cursor.
+ *
+ * Results:
+ *      Number of entries returned; their names are appended to 'seen'.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+PageCursor(VixToolsDirCursor *cursor,   // IN:
+           const char *dir,             // IN:
+           uint32 match,                // IN:
+           int pageSize,                // IN:
+           GPtrArray *seen)             // IN/OUT:
+{
+   uint32 numMatches = VixToolsDirCursorNumMatches(cursor);
+   int count = 0;
+
+   VERIFY(VixToolsDirCursorIsCurrent(cursor, dir));
+
+   for (; match < numMatches && count < pageSize; match++, count++) {
+      VixToolsFileInfo info;
+
+      VixToolsDirCursorGetInfo(cursor, match, &info);
+      free(info.symlinkTarget);
+      g_ptr_array_add(seen, VixToolsDirCursorGetName(cursor, match));
+   }
+
+   return count;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CompareNames --
+ *
+ *      qsort comparator for a GPtrArray of names.
+ *
+ * Results:
+ *      strcmp() of the names.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+CompareNames(gconstpointer a,  // IN:
+             gconstpointer b)  // IN:
+{
+   return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VerifySame --
+ *
+ *      Check that two listings have the same names, each exactly once.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Sorts both arrays. Exits on a mismatch.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VerifySame(GPtrArray *a,  // IN:
+           GPtrArray *b)  // IN:
+{
+   guint i;
+
+   g_ptr_array_sort(a, CompareNames);
+   g_ptr_array_sort(b, CompareNames);
+
+   VERIFY(a->len == b->len);
+   for (i = 0; i < a->len; i++) {
+      VERIFY(strcmp(a->pdata[i], b->pdata[i]) == 0);
+      VERIFY(i == 0 || strcmp(a->pdata[i - 1], a->pdata[i]) != 0);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VerifySorted --
+ *
+ *      Check that a cursor listing has "." and ".." first, then the other
+ *      names in order.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Exits if not.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VerifySorted(GPtrArray *names)  // IN:
+{
+   guint i;
+
+   VERIFY(names->len >= 2);
+   VERIFY(strcmp(names->pdata[0], ".") == 0);
+   VERIFY(strcmp(names->pdata[1], "..") == 0);
+   for (i = 3; i < names->len; i++) {
+      VERIFY(strcmp(names->pdata[i - 1], names->pdata[i]) < 0);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FreeNames --
+ *
+ *      Free a GPtrArray of names.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+FreeNames(GPtrArray *names)  // IN:
+{
+   g_ptr_array_foreach(names, (GFunc) free, NULL);
+   g_ptr_array_free(names, TRUE);
+}
+
+
+int
+main(int argc,     // IN:
+     char **argv)  // IN:
+{
+   int numFiles = (argc > 1) ? atoi(argv[1]) : DEFAULT_FILES;
+   int pageSize = (argc > 2) ? atoi(argv[2]) : DEFAULT_PAGE_SIZE;
+   GPtrArray *oldNames = g_ptr_array_new();
+   GPtrArray *newNames = g_ptr_array_new();
+   GPtrArray *expected = g_ptr_array_new();
+   VixToolsDirCursor *cursor;
+   GRegex *regex;
+   VmTimeType start;
+   char *dir;
+   int pages;
+   int index;
+   int n;
+   guint i;
+
+   if (numFiles <= 0 || pageSize <= 0) {
+      fprintf(stderr, "Usage: %s [files] [page size]\n", argv[0]);
+      return 1;
+   }
+
+   dir = MakeDirectory(numFiles);
+   printf("%d entries, %d per page\n", numFiles + 2, pageSize);
+
+   start = Hostinfo_SystemTimerNS();
+   for (index = 0, pages = 0;
+        (n = PageOld(dir, index, pageSize, oldNames)) > 0;
+        index += n, pages++) {
+   }
+   printf("%-24s %5d pages %10.3f ms\n", "list per page", pages,
+          (Hostinfo_SystemTimerNS() - start) / 1e6);
+
+   start = Hostinfo_SystemTimerNS();
+   cursor = VixToolsNewDirCursor(dir, NULL);
+   VERIFY(cursor != NULL);
+   for (index = 0, pages = 0;
+        (n = PageCursor(cursor, dir, VixToolsDirCursorSeek(cursor, index),
+                        pageSize, newNames)) > 0;
+        index += n, pages++) {
+   }
+   VixToolsDestroyDirCursor(cursor);
+   printf("%-24s %5d pages %10.3f ms\n", "cursor", pages,
+          (Hostinfo_SystemTimerNS() - start) / 1e6);
+
+   VERIFY(oldNames->len == numFiles + 2);
+   VerifySorted(newNames);
+   VerifySame(oldNames, newNames);
+
+   /*
+    * With a pattern: the cursor must return just the matching names.
+    */
+   regex = g_regex_new(BENCH_PATTERN, 0, 0, NULL);
+   VERIFY(regex != NULL);
+   for (i = 0; i < oldNames->len; i++) {
+      if (g_regex_match(regex, oldNames->pdata[i], 0, NULL)) {
+         g_ptr_array_add(expected, Util_SafeStrdup(oldNames->pdata[i]));
+      }
+   }
+   FreeNames(newNames);
+   newNames = g_ptr_array_new();
+
+   start = Hostinfo_SystemTimerNS();
+   cursor = VixToolsNewDirCursor(dir, regex);
+   VERIFY(cursor != NULL);
+   for (index = 0, pages = 0;
+        (n = PageCursor(cursor, dir, index, pageSize, newNames)) > 0;
+        index += n, pages++) {
+   }
+   VixToolsDestroyDirCursor(cursor);
+   printf("%-24s %5d pages %10.3f ms (%u matches)\n", "cursor, " BENCH_PATTERN,
+          pages, (Hostinfo_SystemTimerNS() - start) / 1e6, expected->len);
+
+   VerifySame(expected, newNames);
+
+   g_regex_unref(regex);
+   FreeNames(expected);
+   FreeNames(newNames);
+   FreeNames(oldNames);
+   RemoveDirectory(dir);
+   free(dir);
+
+   return 0;
+}
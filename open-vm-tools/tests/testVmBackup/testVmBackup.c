@@ -0,0 +1,422 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file testVmBackup.c
+ *
+ * A debug plugin that drives the vmbackup plugin through two quiesce
+ * operations with the null sync provider, playing the part of the VMX: it
+ * starts an operation, waits for the guest to ask for the snapshot, says the
+ * snapshot is done, and waits for the operation to finish.
+ *
+ * The first operation runs with the default configuration: its timeline must
+ * be returned by the "vmbackup.getTimeline" RPC, saved in the local file and
+ * printed by "vmware-toolbox-cmd backup timeline", and must not be sent to
+ * the host. The second one turns on vmbackup.publishTimeline and
+ * vmbackup.reportTimeline: its timeline must be published in the guest
+ * variable and sent as a backup event.
+ *
+ * Run with "vmtoolsd -n vmsvc -b <path to this plugin>".
+ */
+
+#define G_LOG_DOMAIN "testVmBackup"
+#include <stdio.h>
+#include <string.h>
+#include <glib-object.h>
+#include <CUnit/CUnit.h>
+
+#include "util.h"
+#include "vmware/guestrpc/vmbackup.h"
+#include "vmware/tools/rpcdebug.h"
+
+/* How long to wait for the operation, in polls of the debug channel. */
+#define TEST_MAX_POLLS     600
+
+#define TEST_START         VMBACKUP_PROTOCOL_START " 0"
+#define TEST_TIMELINE_FILE VMTOOLSD_STATE_DIR "/" VMBACKUP_TIMELINE_FILE
+#define TEST_PUBLISH       "info-set " VMBACKUP_GUESTINFO_TIMELINE " "
+
+typedef enum {
+   TEST_STEP_START,
+   TEST_STEP_WAIT_COMMIT,
+   TEST_STEP_WAIT_DONE,
+   TEST_STEP_TIMELINE,
+   TEST_STEP_TOOLBOX,
+   TEST_STEP_FINISHED,
+} TestStep;
+
+static ToolsAppCtx *gCtx;
+static TestStep gStep = TEST_STEP_START;
+static guint gOp = 0;
+static guint gPolls = 0;
+static gboolean gGotCommit = FALSE;
+static gboolean gGotTimelineEvent = FALSE;
+static gboolean gGotDone = FALSE;
+static gboolean gGotPublished = FALSE;
+static gboolean gCheckedTimeline = FALSE;
+static gboolean gCheckedToolbox = FALSE;
+
+
+/**
+ * Checks a timeline: every entry is well formed and belongs to the given
+ * operation, entries are in the order their phases ended, and the phases of
+ * a successful quiesce operation are all there.
+ *
+ * @param[in]  timeline    The timeline.
+ * @param[in]  sep         Separator between entries.
+ * @param[in]  op          Expected operation number.
+ */
+
+static void
+TestCheckTimeline(const char *timeline,
+                  const char *sep,
+                  guint op)
+{
+   static const char *phases[] = {
+      "start", "freeze", "frozen", "thaw", "event", "done"
+   };
+   gboolean seen[ARRAYSIZE(phases)] = { FALSE, };
+   gchar **entries = g_strsplit(timeline, sep, 0);
+   gchar **entry;
+   guint64 lastEnd = 0;
+   size_t i;
+
+   for (entry = entries; *entry != NULL; entry++) {
+      guint entryOp;
+      guint offMs, offUs, durMs, durUs;
+      char phase[32];
+      guint64 end;
+
+      g_debug("timeline: %s\n", *entry);
+      CU_ASSERT_EQUAL(sscanf(*entry, "%u %u.%u %u.%u %31s", &entryOp,
+                             &offMs, &offUs, &durMs, &durUs, phase), 6);
+      CU_ASSERT_EQUAL(entryOp, op);
+
+      /* Entries are added when their phase ends. */
+      end = (guint64) offMs * 1000 + offUs + (guint64) durMs * 1000 + durUs;
+      CU_ASSERT(end >= lastEnd);
+      lastEnd = end;
+
+      for (i = 0; i < ARRAYSIZE(phases); i++) {
+         seen[i] |= strcmp(phase, phases[i]) == 0;
+      }
+   }
+
+   for (i = 0; i < ARRAYSIZE(phases); i++) {
+      if (!seen[i]) {
+         g_warning("Phase '%s' missing from the timeline.\n", phases[i]);
+      }
+      CU_ASSERT(seen[i]);
+   }
+
+   g_strfreev(entries);
+}
+
+
+/**
+ * Validates the response of an RPC that should have succeeded.
+ *
+ * @param[in]  data     RPC request data.
+ * @param[in]  ret      Return value from RPC handler.
+ *
+ * @return @a ret.
+ */
+
+static gboolean
+TestValidateOk(RpcInData *data,
+               gboolean ret)
+{
+   if (!ret) {
+      g_warning("%s failed: %s\n", data->name, data->result);
+   }
+   CU_ASSERT(ret);
+   return ret;
+}
+
+
+/**
+ * Validates the response of "vmbackup.getTimeline".
+ *
+ * @param[in]  data     RPC request data.
+ * @param[in]  ret      Return value from RPC handler.
+ *
+ * @return @a ret.
+ */
+
+static gboolean
+TestValidateTimeline(RpcInData *data,
+                     gboolean ret)
+{
+   CU_ASSERT(ret);
+   RPCDEBUG_ASSERT(data->result != NULL, FALSE);
+
+   /* Only the first operation has run. */
+   TestCheckTimeline(data->result, "\n", 1);
+   gCheckedTimeline = TRUE;
+   return ret;
+}
+
+
+/**
+ * Handles the backup events sent by the vmbackup plugin.
+ *
+ * @param[in]  data        Incoming data.
+ * @param[in]  dataLen     Size of incoming data.
+ * @param[out] result      Result sent back to the application.
+ * @param[out] resultLen   Length of result.
+ *
+ * @return TRUE.
+ */
+
+static gboolean
+TestReceiveEvent(char *data,
+                 size_t dataLen,
+                 char **result,
+                 size_t *resultLen)
+{
+   char *event = data + sizeof VMBACKUP_PROTOCOL_EVENT_SET;
+   char *desc;
+
+   g_debug("Received backup event: %s\n", event);
+
+   if (g_str_has_prefix(event, VMBACKUP_EVENT_SNAPSHOT_COMMIT " ")) {
+      gGotCommit = TRUE;
+   } else if (g_str_has_prefix(event, VMBACKUP_EVENT_TIMELINE " ")) {
+      /* Sent before "done"; skip the event code. */
+      CU_ASSERT(!gGotDone);
+      CU_ASSERT_EQUAL(gOp, 2);
+      desc = strchr(event + sizeof VMBACKUP_EVENT_TIMELINE, ' ');
+      RPCDEBUG_ASSERT(desc != NULL, FALSE);
+      TestCheckTimeline(desc + 1, "; ", gOp);
+      gGotTimelineEvent = TRUE;
+   } else if (g_str_has_prefix(event, VMBACKUP_EVENT_REQUESTOR_DONE " ")) {
+      gGotDone = TRUE;
+   } else if (g_str_has_prefix(event, VMBACKUP_EVENT_REQUESTOR_ERROR " ") ||
+              g_str_has_prefix(event, VMBACKUP_EVENT_REQUESTOR_ABORT " ")) {
+      CU_FAIL("Quiesce operation failed.");
+   }
+
+   RpcDebug_SetResult("", result, resultLen);
+   return TRUE;
+}
+
+
+/**
+ * Handles "info-set" messages; checks the published timeline.
+ *
+ * @param[in]  data        Incoming data.
+ * @param[in]  dataLen     Size of incoming data.
+ * @param[out] result      Result sent back to the application.
+ * @param[out] resultLen   Length of result.
+ *
+ * @return TRUE.
+ */
+
+static gboolean
+TestReceiveInfoSet(char *data,
+                   size_t dataLen,
+                   char **result,
+                   size_t *resultLen)
+{
+   if (g_str_has_prefix(data, TEST_PUBLISH)) {
+      CU_ASSERT_EQUAL(gOp, 2);
+      TestCheckTimeline(data + strlen(TEST_PUBLISH), "\n", gOp);
+      gGotPublished = TRUE;
+   }
+   RpcDebug_SetResult("", result, resultLen);
+   return TRUE;
+}
+
+
+/**
+ * Checks the timeline of the first operation, run with the default
+ * configuration: it was not sent to the host, it was saved in the local
+ * file, and "vmware-toolbox-cmd backup timeline" prints it. Then turns on
+ * publishing and reporting the timeline for the second operation.
+ */
+
+static void
+TestCheckToolbox(void)
+{
+   gchar *argv[] = { TEST_TOOLBOX_CMD, "backup", "timeline", NULL };
+   gchar *saved = NULL;
+   gchar *out = NULL;
+   gchar *timeline;
+   gint status = -1;
+
+   CU_ASSERT(!gGotPublished);
+   CU_ASSERT(!gGotTimelineEvent);
+
+   if (g_file_get_contents(TEST_TIMELINE_FILE, &saved, NULL, NULL)) {
+      TestCheckTimeline(saved, "\n", 1);
+   } else {
+      CU_FAIL("Timeline not saved in " TEST_TIMELINE_FILE ".");
+   }
+
+   if (g_spawn_sync(NULL, argv, NULL, G_SPAWN_STDERR_TO_DEV_NULL, NULL, NULL,
+                    &out, NULL, &status, NULL)) {
+      CU_ASSERT_EQUAL(status, 0);
+
+      /* Skip the header line. */
+      timeline = strchr(out, '\n');
+      CU_ASSERT(timeline != NULL);
+      if (timeline != NULL) {
+         timeline = g_strchomp(timeline + 1);
+         if (saved != NULL) {
+            CU_ASSERT_STRING_EQUAL(timeline, g_strchomp(saved));
+         }
+         TestCheckTimeline(timeline, "\n", 1);
+         gCheckedToolbox = TRUE;
+      }
+   } else {
+      CU_FAIL("Cannot run " TEST_TOOLBOX_CMD ".");
+   }
+
+   g_free(out);
+   g_free(saved);
+
+   g_key_file_set_boolean(gCtx->config, "vmbackup", "reportTimeline", TRUE);
+   g_key_file_set_boolean(gCtx->config, "vmbackup", "publishTimeline", TRUE);
+}
+
+
+/**
+ * Sends the next message to the vmbackup plugin, once the events that the
+ * current step waits for have arrived.
+ *
+ * @param[in]  rpcdata     Data for the injected RPC request data.
+ *
+ * @return TRUE if sending messages, FALSE if no more messages to be sent.
+ */
+
+static gboolean
+TestSendNext(RpcDebugMsgMapping *rpcdata)
+{
+   if (++gPolls > TEST_MAX_POLLS) {
+      CU_FAIL("Timed out waiting for the quiesce operation.");
+      return FALSE;
+   }
+
+   switch (gStep) {
+   case TEST_STEP_START:
+      gOp++;
+      gGotCommit = FALSE;
+      gGotDone = FALSE;
+      rpcdata->message = TEST_START;
+      rpcdata->messageLen = sizeof TEST_START;
+      rpcdata->validateFn = TestValidateOk;
+      gStep = TEST_STEP_WAIT_COMMIT;
+      break;
+
+   case TEST_STEP_WAIT_COMMIT:
+      if (gGotCommit) {
+         rpcdata->message = VMBACKUP_PROTOCOL_SNAPSHOT_DONE;
+         rpcdata->messageLen = sizeof VMBACKUP_PROTOCOL_SNAPSHOT_DONE;
+         rpcdata->validateFn = TestValidateOk;
+         gStep = TEST_STEP_WAIT_DONE;
+      }
+      break;
+
+   case TEST_STEP_WAIT_DONE:
+      if (gGotDone) {
+         gStep = gOp == 1 ? TEST_STEP_TIMELINE : TEST_STEP_FINISHED;
+      }
+      break;
+
+   case TEST_STEP_TIMELINE:
+      rpcdata->message = VMBACKUP_PROTOCOL_GET_TIMELINE;
+      rpcdata->messageLen = sizeof VMBACKUP_PROTOCOL_GET_TIMELINE;
+      rpcdata->validateFn = TestValidateTimeline;
+      gStep = TEST_STEP_TOOLBOX;
+      break;
+
+   case TEST_STEP_TOOLBOX:
+      TestCheckToolbox();
+      gStep = TEST_STEP_START;
+      break;
+
+   default:
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Checks that all the expected messages were seen.
+ *
+ * @param[in]  ctx      The application context.
+ * @param[in]  plugin   Plugin data.
+ */
+
+static void
+TestShutdown(ToolsAppCtx *ctx,
+             RpcDebugPlugin *plugin)
+{
+   CU_ASSERT_EQUAL(gOp, 2);
+   CU_ASSERT(gGotCommit);
+   CU_ASSERT(gGotTimelineEvent);
+   CU_ASSERT(gGotDone);
+   CU_ASSERT(gGotPublished);
+   CU_ASSERT(gCheckedTimeline);
+   CU_ASSERT(gCheckedToolbox);
+}
+
+
+/**
+ * Returns the debug plugin's registration data. Configures the vmbackup
+ * plugin to use the null provider and skip the freeze / thaw scripts; the
+ * timeline settings are left to their defaults for the first operation.
+ *
+ * @param[in]  ctx      The application context.
+ *
+ * @return The application data.
+ */
+
+TOOLS_MODULE_EXPORT RpcDebugPlugin *
+RpcDebugOnLoad(ToolsAppCtx *ctx)
+{
+   static RpcDebugRecvMapping recvFns[] = {
+      { VMBACKUP_PROTOCOL_EVENT_SET, TestReceiveEvent, NULL, 0 },
+      { "info-set", TestReceiveInfoSet, NULL, 0 },
+      { NULL, NULL }
+   };
+   static ToolsPluginData pluginData = {
+      "testVmBackup",
+      NULL,
+      NULL,
+      NULL,
+   };
+   static RpcDebugPlugin regData = {
+      recvFns,
+      NULL,
+      TestSendNext,
+      TestShutdown,
+      &pluginData,
+   };
+
+   if (ctx->config == NULL) {
+      ctx->config = g_key_file_new();
+   }
+   g_key_file_set_boolean(ctx->config, "vmbackup", "enableSyncDriver", FALSE);
+   g_key_file_set_boolean(ctx->config, "vmbackup", "execScripts", FALSE);
+   gCtx = ctx;
+
+   return &regData;
+}
@@ -0,0 +1,315 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * blockBench.c --
+ *
+ *   Stress benchmark for the vmblock block table, as built into
+ *   vmblock-fuse. Adds N blocks, then has M reader threads look up files
+ *   the way every access to the file system does, while blocks are added
+ *   and removed. Also checks that the block semantics hold: duplicate and
+ *   foreign blocks are refused, and waiters are released by the removal
+ *   of their block.
+ *
+ *   Usage: vmware-testvmblock-bench [blocks] [readers]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "os.h"
+#include "block.h"
+
+#define DEFAULT_BLOCKS     10000
+#define DEFAULT_READERS    4
+#define READ_SECONDS       2
+#define NUM_WAITERS        16
+
+int LOGLEVEL_THRESHOLD = 0;
+
+static char **blockNames;
+static char **otherNames;
+static int numBlocks;
+static volatile int stopReaders;
+static int failures;
+
+#define CHECK(cond)                                                     \
+   do {                                                                 \
+      if (!(cond)) {                                                    \
+         fprintf(stderr, "FAIL line %d: %s\n", __LINE__, #cond);        \
+         failures++;                                                    \
+      }                                                                 \
+   } while (0)
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * NowUs --
+ *
+ *    Reads the monotonic clock.
+ *
+ * Results:
+ *    Time in microseconds.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static double
+NowUs(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * MakeName --
+ *
+ *    Builds a path like the ones DnD blocks: many files under one staging
+ *    directory.
+ *
+ * Results:
+ *    The name, to be freed by the caller.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static char *
+MakeName(const char *kind,  // IN:
+         int i)             // IN:
+{
+   char *name = malloc(OS_PATH_MAX);
+
+   snprintf(name, OS_PATH_MAX, "/tmp/VMwareDnD/a1b2c3d4/%s/file-%06d.dat",
+            kind, i);
+   return name;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * ReaderThread --
+ *
+ *    Looks up files that are not blocked, as vmblock-fuse does for each
+ *    access to a file, until told to stop.
+ *
+ * Results:
+ *    Number of lookups done, cast to a pointer.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void *
+ReaderThread(void *data)  // IN: reader index
+{
+   unsigned int seed = (unsigned int)(uintptr_t)data;
+   uintptr_t lookups = 0;
+
+   while (!stopReaders) {
+      int i = rand_r(&seed) % numBlocks;
+
+      /* Returns right away: the file is not blocked. */
+      BlockWaitOnFile(otherNames[i], NULL);
+      lookups++;
+   }
+
+   return (void *)lookups;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * WaiterThread --
+ *
+ *    Waits on a blocked file.
+ *
+ * Results:
+ *    NULL.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void *
+WaiterThread(void *data)  // IN: file to wait on
+{
+   BlockWaitOnFile(data, NULL);
+   return NULL;
+}
+
+
+int
+main(int argc,     // IN:
+     char **argv)  // IN:
+{
+   int numReaders = (argc > 2) ? atoi(argv[2]) : DEFAULT_READERS;
+   char *blocker = "bench";
+   char *otherBlocker = "other";
+   pthread_t *readers;
+   pthread_t waiters[NUM_WAITERS];
+   uint64 lookups = 0;
+   uint64 churn = 0;
+   double start;
+   double addUs;
+   double lookupUs;
+   double removeUs;
+   double elapsedUs;
+   BlockHandle cookie;
+   int i;
+
+   numBlocks = (argc > 1) ? atoi(argv[1]) : DEFAULT_BLOCKS;
+   if (numBlocks <= 0 || numReaders <= 0) {
+      fprintf(stderr, "Usage: %s [blocks] [readers]\n", argv[0]);
+      return 1;
+   }
+
+   CHECK(BlockInit() == 0);
+
+   blockNames = malloc(numBlocks * sizeof *blockNames);
+   otherNames = malloc(numBlocks * sizeof *otherNames);
+   for (i = 0; i < numBlocks; i++) {
+      blockNames[i] = MakeName("blocked", i);
+      otherNames[i] = MakeName("free", i);
+   }
+
+   /* Add N blocks. */
+   start = NowUs();
+   for (i = 0; i < numBlocks; i++) {
+      CHECK(BlockAddFileBlock(blockNames[i], blocker) == 0);
+   }
+   addUs = NowUs() - start;
+
+   /* Semantics: one block per file, only its blocker can remove it. */
+   CHECK(BlockAddFileBlock(blockNames[0], otherBlocker) == OS_EEXIST);
+   CHECK(BlockRemoveFileBlock(blockNames[0], otherBlocker) == OS_ENOENT);
+   CHECK(BlockRemoveFileBlock(otherNames[0], blocker) == OS_ENOENT);
+   CHECK(BlockLookup(blockNames[0], otherBlocker) == NULL);
+   CHECK(BlockLookup(otherNames[0], OS_UNKNOWN_BLOCKER) == NULL);
+
+   /*
+    * Look up files that are not blocked: what vmblock-fuse does on almost
+    * every access, and what used to walk every block.
+    */
+   start = NowUs();
+   for (i = 0; i < numBlocks; i++) {
+      CHECK(BlockLookup(otherNames[i], OS_UNKNOWN_BLOCKER) == NULL);
+   }
+   lookupUs = NowUs() - start;
+
+   /* A lookup that finds the block holds it until the wait is done. */
+   cookie = BlockLookup(blockNames[0], blocker);
+   CHECK(cookie != NULL);
+   CHECK(BlockRemoveFileBlock(blockNames[0], blocker) == 0);
+   CHECK(BlockWaitOnFile(blockNames[0], cookie) == 0);
+   CHECK(BlockAddFileBlock(blockNames[0], blocker) == 0);
+
+   /* Waiters on a block are all released when it is removed. */
+   for (i = 0; i < NUM_WAITERS; i++) {
+      CHECK(pthread_create(&waiters[i], NULL, WaiterThread,
+                           blockNames[i % 2]) == 0);
+   }
+   usleep(50 * 1000);
+   CHECK(BlockRemoveFileBlock(blockNames[0], blocker) == 0);
+   CHECK(BlockRemoveFileBlock(blockNames[1], blocker) == 0);
+   for (i = 0; i < NUM_WAITERS; i++) {
+      pthread_join(waiters[i], NULL);
+   }
+   CHECK(BlockAddFileBlock(blockNames[0], blocker) == 0);
+   CHECK(BlockAddFileBlock(blockNames[1], blocker) == 0);
+
+   /* M readers while blocks come and go. */
+   readers = malloc(numReaders * sizeof *readers);
+   stopReaders = 0;
+   for (i = 0; i < numReaders; i++) {
+      CHECK(pthread_create(&readers[i], NULL, ReaderThread,
+                           (void *)(uintptr_t)(i + 1)) == 0);
+   }
+   start = NowUs();
+   while ((elapsedUs = NowUs() - start) < READ_SECONDS * 1e6) {
+      int j = churn % numBlocks;
+
+      CHECK(BlockRemoveFileBlock(blockNames[j], blocker) == 0);
+      CHECK(BlockAddFileBlock(blockNames[j], blocker) == 0);
+      churn++;
+   }
+   stopReaders = 1;
+   for (i = 0; i < numReaders; i++) {
+      void *count;
+
+      pthread_join(readers[i], &count);
+      lookups += (uintptr_t)count;
+   }
+
+   /* Remove the N blocks. */
+   start = NowUs();
+   for (i = 0; i < numBlocks; i++) {
+      CHECK(BlockRemoveFileBlock(blockNames[i], blocker) == 0);
+   }
+   removeUs = NowUs() - start;
+   CHECK(BlockRemoveAllBlocks(OS_UNKNOWN_BLOCKER) == 0);
+
+   /* BlockRemoveAllBlocks only removes the blocks of its blocker. */
+   CHECK(BlockAddFileBlock(blockNames[0], blocker) == 0);
+   CHECK(BlockAddFileBlock(blockNames[1], otherBlocker) == 0);
+   CHECK(BlockRemoveAllBlocks(blocker) == 1);
+   CHECK(BlockRemoveAllBlocks(OS_UNKNOWN_BLOCKER) == 1);
+
+   BlockCleanup();
+
+   printf("%d blocks, %d readers\n", numBlocks, numReaders);
+   printf("add            %10.3f us/block\n", addUs / numBlocks);
+   printf("lookup miss    %10.3f us/file\n", lookupUs / numBlocks);
+   printf("remove         %10.3f us/block\n", removeUs / numBlocks);
+   printf("reader lookups %10.0f /s (%.0f /s per reader)\n",
+          lookups / (elapsedUs / 1e6),
+          lookups / (elapsedUs / 1e6) / numReaders);
+   printf("remove + add   %10.0f /s alongside the readers\n",
+          churn / (elapsedUs / 1e6));
+
+   for (i = 0; i < numBlocks; i++) {
+      free(blockNames[i]);
+      free(otherNames[i]);
+   }
+   free(blockNames);
+   free(otherNames);
+   free(readers);
+
+   printf("%s\n", failures == 0 ? "PASSED" : "FAILED");
+   return failures == 0 ? 0 : 1;
+}
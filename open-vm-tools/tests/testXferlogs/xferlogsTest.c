@@ -0,0 +1,568 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * xferlogsTest.c --
+ *
+ *   Round trips of log transfers through the file transport, extracted
+ *   with XferLogs_Extract as "vmware-xferlogs dec" does. Version 2: a text
+ *   log, deflated, and random data named as a tarball, sent as is. Checks
+ *   the extracted file is the same, that a line logged twice is skipped,
+ *   and that a lost or corrupted line fails the transfer. Prints the time
+ *   each way, and the lines a version 1 transfer would have taken. Then
+ *   a log holding version 1 and 2 transfers, and one of an unknown
+ *   version, is extracted, to check each file goes to its own output.
+ *
+ *   Usage: vmware-testxferlogs [megabytes]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#include "vm_basic_types.h"
+#include "vm_basic_defs.h"
+#include "xferlogsInt.h"
+
+#define V1_LINE_DATA    57     // BUF_BASE64_SIZE of xferlogs.c
+
+typedef enum Mangle {
+   MANGLE_NONE,
+   MANGLE_REPEAT,
+   MANGLE_DROP,
+   MANGLE_CORRUPT,
+} Mangle;
+
+static const char *mangles[] = { "none", "repeat", "drop", "corrupt" };
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Now --
+ *
+ *    Reads the monotonic clock.
+ *
+ * Results:
+ *    The time in seconds.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static double
+Now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * WriteInput --
+ *
+ *    Writes a file of about "size" bytes: lines as a guest log has them,
+ *    or random bytes.
+ *
+ * Results:
+ *    TRUE on success.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+WriteInput(const char *path,  // IN:
+           size_t size,       // IN:
+           Bool random)       // IN:
+{
+   static const char *msgs[] = {
+      "vmsvc[1234]: [ message] [vmsvc] Guest info updated",
+      "kernel: [ 12.345678] e1000: eth0 NIC Link is Up 1000 Mbps",
+      "systemd[1]: Started Session 42 of user root.",
+      "sshd[4321]: Accepted publickey for root from 10.0.0.1 port 22",
+   };
+   FILE *fp = fopen(path, "wb");
+   size_t written = 0;
+   unsigned int i = 0;
+
+   if (fp == NULL) {
+      return FALSE;
+   }
+
+   srand(size);
+   while (written < size) {
+      int n;
+
+      if (random) {
+         putc(rand() & 0xff, fp);
+         n = 1;
+      } else {
+         n = fprintf(fp, "Oct 18 12:%02u:%02u host %s %u\n", i / 60 % 60,
+                     i % 60, msgs[rand() % ARRAYSIZE(msgs)], rand());
+      }
+      written += n;
+      i++;
+   }
+
+   return fclose(fp) == 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * MangleLog --
+ *
+ *    Copies a log with one transfer in it, mangling one of its lines.
+ *
+ * Results:
+ *    TRUE on success.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+MangleLog(const char *logPath,  // IN:
+          const char *outPath,  // IN:
+          Mangle mangle)        // IN:
+{
+   FILE *fp = fopen(logPath, "r");
+   FILE *outfp = fopen(outPath, "w");
+   char buf[XFER_LINE_SIZE];
+   int lineNum = 0;
+   Bool ok = fp != NULL && outfp != NULL;
+
+   while (ok && fgets(buf, sizeof buf, fp)) {
+      /* Mangle the third line of data, not to be the first or last. */
+      if (strstr(buf, LOG_GUEST_MARK) != NULL &&
+          strstr(buf, LOG_START_MARK) == NULL &&
+          strstr(buf, LOG_END_MARK) == NULL &&
+          lineNum++ == 2) {
+         if (mangle == MANGLE_DROP) {
+            continue;
+         } else if (mangle == MANGLE_REPEAT) {
+            fputs(buf, outfp);
+         } else if (mangle == MANGLE_CORRUPT) {
+            char *c = buf + strlen(buf) / 2;
+
+            *c = *c == 'A' ? 'B' : 'A';
+         }
+      }
+      fputs(buf, outfp);
+   }
+
+   if (outfp != NULL && fclose(outfp) != 0) {
+      ok = FALSE;
+   }
+   if (fp != NULL) {
+      fclose(fp);
+   }
+
+   return ok;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * ExtractedPath --
+ *
+ *    Finds the file XferLogs_Extract wrote for a transfer in the current
+ *    directory: "vm-support-<n>-<time>.<ext>".
+ *
+ * Results:
+ *    TRUE if found, with its name in "path".
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+ExtractedPath(int n,             // IN: number of the transfer in the log
+              const char *ext,   // IN: extension the file should have
+              char *path,        // OUT:
+              size_t pathSize)   // IN:
+{
+   DIR *dir = opendir(".");
+   struct dirent *entry;
+   char prefix[32];
+   Bool found = FALSE;
+
+   if (dir == NULL) {
+      return FALSE;
+   }
+
+   snprintf(prefix, sizeof prefix, "vm-support-%d-", n);
+   while (!found && (entry = readdir(dir)) != NULL) {
+      const char *dot = strchr(entry->d_name + strlen(prefix), '.');
+
+      if (strncmp(entry->d_name, prefix, strlen(prefix)) == 0 &&
+          dot != NULL && strcmp(dot + 1, ext) == 0) {
+         snprintf(path, pathSize, "%s", entry->d_name);
+         found = TRUE;
+      }
+   }
+   closedir(dir);
+
+   return found;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * RemoveExtracted --
+ *
+ *    Removes the files XferLogs_Extract wrote in the current directory.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+RemoveExtracted(void)
+{
+   DIR *dir = opendir(".");
+   struct dirent *entry;
+
+   if (dir == NULL) {
+      return;
+   }
+   while ((entry = readdir(dir)) != NULL) {
+      if (strncmp(entry->d_name, "vm-support-", 11) == 0) {
+         unlink(entry->d_name);
+      }
+   }
+   closedir(dir);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * SameFiles --
+ *
+ *    Compares two files.
+ *
+ * Results:
+ *    TRUE if they are the same.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+SameFiles(const char *path1,  // IN:
+          const char *path2)  // IN:
+{
+   FILE *fp1 = fopen(path1, "rb");
+   FILE *fp2 = fopen(path2, "rb");
+   Bool same = fp1 != NULL && fp2 != NULL;
+
+   while (same) {
+      int c = getc(fp1);
+
+      same = c == getc(fp2);
+      if (c == EOF) {
+         break;
+      }
+   }
+
+   if (fp1 != NULL) {
+      fclose(fp1);
+   }
+   if (fp2 != NULL) {
+      fclose(fp2);
+   }
+
+   return same;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * RoundTrip --
+ *
+ *    Sends a file to a log as a version 2 transfer, and extracts it back,
+ *    once with each way to mangle the transfer. Runs in the directory the
+ *    files are extracted to.
+ *
+ * Results:
+ *    The number of failures.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static int
+RoundTrip(const char *dir,    // IN:
+          const char *name,   // IN:
+          const char *ext,    // IN: extension of the extracted file
+          size_t size,        // IN:
+          Bool random)        // IN:
+{
+   char inPath[256];
+   char logPath[256];
+   char mangledPath[256];
+   char outPath[256];
+   XferTransport *xport;
+   FILE *fp;
+   uint64 lines;
+   uint64 bytes;
+   double start;
+   double xmitTime;
+   Mangle mangle;
+   int failures = 0;
+
+   snprintf(inPath, sizeof inPath, "%s/%s", dir, name);
+   snprintf(logPath, sizeof logPath, "%s/vmware.log", dir);
+   snprintf(mangledPath, sizeof mangledPath, "%s/mangled.log", dir);
+
+   if (!WriteInput(inPath, size, random) ||
+       (fp = fopen(inPath, "rb")) == NULL ||
+       (xport = XferTransport_OpenFile(logPath)) == NULL) {
+      fprintf(stderr, "FAIL %s: cannot set up the transfer\n", name);
+      return 1;
+   }
+
+   start = Now();
+   if (!XferV2_Xmit(xport, inPath, fp)) {
+      fprintf(stderr, "FAIL %s: transfer failed\n", name);
+      failures++;
+   }
+   xmitTime = Now() - start;
+   lines = xport->lines;
+   bytes = xport->bytes;
+   XferTransport_Close(xport);
+   fclose(fp);
+
+   for (mangle = MANGLE_NONE; mangle <= MANGLE_CORRUPT; mangle++) {
+      Bool whole;
+      int numWhole;
+
+      /* Too short to mangle: the marks, and less than three chunks. */
+      if (mangle != MANGLE_NONE && lines < 5) {
+         break;
+      }
+      if (!MangleLog(logPath, mangledPath, mangle)) {
+         fprintf(stderr, "FAIL %s: %s: cannot write the log\n", name,
+                 mangles[mangle]);
+         failures++;
+         continue;
+      }
+
+      start = Now();
+      numWhole = XferLogs_Extract(mangledPath);
+      whole = numWhole == 1;
+
+      if (mangle == MANGLE_NONE) {
+         printf("%-12s %10u %10.1f %10.1f %10llu %10llu %12u\n", name,
+                (unsigned)size, size / xmitTime / 1e6,
+                size / (Now() - start) / 1e6,
+                (unsigned long long)lines, (unsigned long long)bytes,
+                (unsigned)((size + V1_LINE_DATA - 1) / V1_LINE_DATA + 2));
+      }
+
+      if (numWhole < 0 || numWhole > 1 ||
+          whole != (mangle <= MANGLE_REPEAT) ||
+          (whole && (!ExtractedPath(0, ext, outPath, sizeof outPath) ||
+                     !SameFiles(inPath, outPath)))) {
+         fprintf(stderr, "FAIL %s: %s: %s\n", name, mangles[mangle],
+                 whole ? "extracted file differs" : "transfer lost");
+         failures++;
+      }
+      RemoveExtracted();
+   }
+
+   unlink(inPath);
+   unlink(logPath);
+   unlink(mangledPath);
+
+   return failures;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * MixedLog --
+ *
+ *    Sends files to one log in both versions, with a transfer of an
+ *    unknown version among them, and extracts them back. Runs in the
+ *    directory the files are extracted to.
+ *
+ * Results:
+ *    The number of failures.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static int
+MixedLog(const char *dir)  // IN:
+{
+   static const struct {
+      const char *name;
+      int version;
+      const char *ext;     // extension of the extracted file, NULL if none
+   } xfers[] = {
+      { "first.log",      LOG_VERSION,       "log"    },
+      { "support.tar.gz", LOG_VERSION_2,     "tar.gz" },
+      { "first.log",      LOG_VERSION_2,     "log"    },
+      { "future.log",     LOG_VERSION_2 + 1, NULL     },
+      { "last.zip",       LOG_VERSION,       "zip"    },
+   };
+   char logPath[256];
+   XferTransport *xport;
+   unsigned int i;
+   int expected = 0;
+   int numWhole;
+   int failures = 0;
+
+   snprintf(logPath, sizeof logPath, "%s/vmware.log", dir);
+   if (!WriteInput("first.log", 100000, FALSE) ||
+       !WriteInput("support.tar.gz", 30000, TRUE) ||
+       !WriteInput("last.zip", 1000, TRUE) ||
+       (xport = XferTransport_OpenFile(logPath)) == NULL) {
+      fprintf(stderr, "FAIL mixed: cannot set up the transfers\n");
+      return 1;
+   }
+
+   for (i = 0; i < ARRAYSIZE(xfers); i++) {
+      FILE *fp;
+      Bool sent;
+
+      if (xfers[i].ext == NULL) {
+         XferTransport_Printf(xport, "%s: %s: ver - %d zlib", LOG_START_MARK,
+                              xfers[i].name, xfers[i].version);
+         XferTransport_Printf(xport, ">0 00000000 AAAA");
+         XferTransport_Printf(xport, LOG_END_MARK);
+         continue;
+      }
+
+      if ((fp = fopen(xfers[i].name, "rb")) == NULL) {
+         fprintf(stderr, "FAIL mixed: cannot read %s\n", xfers[i].name);
+         failures++;
+         continue;
+      }
+      sent = xfers[i].version == LOG_VERSION ?
+             XferV1_Xmit(xport, xfers[i].name, fp) :
+             XferV2_Xmit(xport, xfers[i].name, fp);
+      fclose(fp);
+      if (!sent) {
+         fprintf(stderr, "FAIL mixed: transfer of %s failed\n",
+                 xfers[i].name);
+         failures++;
+      }
+      expected++;
+   }
+   XferTransport_Close(xport);
+
+   numWhole = XferLogs_Extract(logPath);
+   if (numWhole != expected) {
+      fprintf(stderr, "FAIL mixed: %d of %d files extracted whole\n",
+              numWhole, expected);
+      failures++;
+   }
+
+   for (i = 0; i < ARRAYSIZE(xfers); i++) {
+      char outPath[256];
+
+      if (xfers[i].ext == NULL) {
+         if (ExtractedPath(i, "log", outPath, sizeof outPath)) {
+            fprintf(stderr, "FAIL mixed: version %d extracted to %s\n",
+                    xfers[i].version, outPath);
+            failures++;
+         }
+      } else if (!ExtractedPath(i, xfers[i].ext, outPath, sizeof outPath) ||
+                 !SameFiles(xfers[i].name, outPath)) {
+         fprintf(stderr, "FAIL mixed: %s, version %d: extracted file "
+                 "differs\n", xfers[i].name, xfers[i].version);
+         failures++;
+      }
+   }
+
+   RemoveExtracted();
+   unlink("first.log");
+   unlink("support.tar.gz");
+   unlink("last.zip");
+   unlink(logPath);
+
+   return failures;
+}
+
+
+int
+main(int argc,     // IN:
+     char **argv)  // IN:
+{
+   size_t size = (argc > 1 ? strtoul(argv[1], NULL, 0) : 8) << 20;
+   char dir[] = "/tmp/xferlogsTestXXXXXX";
+   int failures = 0;
+
+   if (mkdtemp(dir) == NULL || chdir(dir) != 0) {
+      fprintf(stderr, "FAIL: cannot create %s\n", dir);
+      return 1;
+   }
+
+   printf("%-12s %10s %10s %10s %10s %10s %12s\n", "file", "bytes",
+          "xmit MB/s", "extr MB/s", "lines", "log bytes", "v1 lines");
+
+   failures += RoundTrip(dir, "guest.log", "log", size, FALSE);
+   failures += RoundTrip(dir, "support.tar.gz", "tar.gz", size / 4, TRUE);
+   failures += RoundTrip(dir, "empty.log", "log", 0, FALSE);
+   failures += MixedLog(dir);
+
+   if (chdir("/") != 0 || rmdir(dir) != 0) {
+      fprintf(stderr, "FAIL: cannot remove %s\n", dir);
+      failures++;
+   }
+
+   printf("%s\n", failures == 0 ? "PASSED" : "FAILED");
+   return failures == 0 ? 0 : 1;
+}
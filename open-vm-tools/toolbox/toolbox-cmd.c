@@ -99,6 +99,7 @@ ToolboxCmdHelp(const char *progName,
  */
 static CmdTable commands[] = {
    { "timesync",  TimeSync_Command, TRUE,    FALSE,   TimeSync_Help},
+   { "backup",    Backup_Command,   TRUE,    FALSE,   Backup_Help},
    { "script",    Script_Command,   FALSE,   TRUE,    Script_Help},
 #if !defined(USERWORLD)
    { "disk",      Disk_Command,     TRUE,    TRUE,    Disk_Help},
@@ -298,6 +299,7 @@ ToolboxCmdHelp(const char *progName,   // IN
                           "Use '-q' option to suppress stdout output.\n"
                           "Most commands take a subcommand.\n\n"
                           "Available commands:\n"
+                          "   backup\n"
                           "   config\n"
                           "   device\n"
                           "   disk (not available on all operating systems)\n"
@@ -122,6 +122,7 @@ ToolsCmd_SendRPC(const char *rpc,
    void name##_Help(const char *progName, \
                     const char *cmd);
 
+DECLARE_COMMAND(Backup);
 DECLARE_COMMAND(Device);
 DECLARE_COMMAND(Disk);
 DECLARE_COMMAND(Script);
@@ -0,0 +1,212 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * toolboxcmd-backup.c --
+ *
+ *     Quiesced backup (vmbackup) operations for toolbox-cmd.
+ */
+
+#include "toolboxCmdInt.h"
+#include "guestApp.h"
+#include "vmware/guestrpc/vmbackup.h"
+#include "vmware/tools/i18n.h"
+#include "vmware/tools/utils.h"
+
+#define BACKUP_PUBLISHED_TIMELINE_CMD "info-get " VMBACKUP_GUESTINFO_TIMELINE
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BackupTimelinePath --
+ *
+ *      Gets the file where the vmbackup plugin of the tools service saves
+ *      the timeline of the last quiesce operation: vmbackup.timelineFile
+ *      in tools.conf, or VMBACKUP_TIMELINE_FILE in the service's state
+ *      directory.
+ *
+ * Results:
+ *      The path, to free with g_free().
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gchar *
+BackupTimelinePath(void)
+{
+   GKeyFile *conf = NULL;
+   gchar *path = NULL;
+   gchar *dir;
+
+   VMTools_LoadConfig(NULL, G_KEY_FILE_NONE, &conf, NULL);
+   if (conf != NULL) {
+      path = VMTools_ConfigGetString(conf, "vmbackup",
+                                     VMBACKUP_CONF_TIMELINE_FILE, NULL);
+      g_key_file_free(conf);
+   }
+   if (path != NULL) {
+      return path;
+   }
+
+#if defined(OPEN_VM_TOOLS)
+   dir = g_strdup(VMTOOLSD_STATE_DIR);
+#else
+   {
+      char *confPath = GuestApp_GetConfPath();
+      dir = g_strdup(confPath);
+      vm_free(confPath);
+   }
+#endif
+
+   path = g_build_filename(dir, VMBACKUP_TIMELINE_FILE, NULL);
+   g_free(dir);
+   return path;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * BackupShowTimeline --
+ *
+ *      Prints the timeline of the last quiesce operation, from the file
+ *      where the vmbackup plugin of the tools service saves it when the
+ *      operation finishes. If there is no such file, prints the one the
+ *      plugin publishes in a guest variable when vmbackup.publishTimeline
+ *      is on.
+ *
+ * Results:
+ *      EXIT_SUCCESS on success.
+ *      EX_UNAVAILABLE if no timeline is available.
+ *
+ * Side effects:
+ *      Prints to stderr on error.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+BackupShowTimeline(void)
+{
+   gchar *path = BackupTimelinePath();
+   gchar *saved = NULL;
+   char *result = NULL;
+   size_t resultLen = 0;
+   int ret = EXIT_SUCCESS;
+
+   if (g_file_get_contents(path, &saved, NULL, NULL) && *saved != '\0') {
+      ToolsCmd_Print("%s\n%s\n",
+                     SU_(backup.timeline.header,
+                         "op offset(ms) duration(ms) phase detail"),
+                     saved);
+   } else if (ToolsCmd_SendRPC(BACKUP_PUBLISHED_TIMELINE_CMD,
+                               sizeof BACKUP_PUBLISHED_TIMELINE_CMD - 1,
+                               &result, &resultLen) && resultLen > 0) {
+      ToolsCmd_Print("%s\n%s\n",
+                     SU_(backup.timeline.header,
+                         "op offset(ms) duration(ms) phase detail"),
+                     result);
+   } else {
+      ToolsCmd_PrintErr("%s",
+                        SU_(backup.timeline.unavailable,
+                            "No quiesce operation has been recorded.\n"));
+      ret = EX_UNAVAILABLE;
+   }
+
+   free(result);
+   g_free(saved);
+   g_free(path);
+   return ret;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Backup_Command --
+ *
+ *      Handle and parse backup commands.
+ *
+ * Results:
+ *      Returns EXIT_SUCCESS on success.
+ *      Returns the appropriate exit codes on errors.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+Backup_Command(char **argv,      // IN: Command line arguments
+               int argc,         // IN: Length of command line arguments
+               gboolean quiet)   // IN
+{
+   const char *subcommand;
+
+   if (optind >= argc) {
+      ToolsCmd_MissingEntityError(argv[0],
+                                  SU_(arg.subcommand, "subcommand"));
+      return EX_USAGE;
+   }
+
+   subcommand = argv[optind];
+
+   if (toolbox_strcmp(subcommand, "timeline") == 0) {
+      return BackupShowTimeline();
+   }
+
+   ToolsCmd_UnknownEntityError(argv[0],
+                               SU_(arg.subcommand, "subcommand"),
+                               subcommand);
+   return EX_USAGE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Backup_Help --
+ *
+ *      Prints the help for the backup command.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+Backup_Help(const char *progName, // IN: The name of the program obtained from argv[0]
+            const char *cmd)      // IN
+{
+   g_print(SU_(help.backup,
+               "%s: quiesced snapshot operations\n"
+               "Usage: %s %s <subcommand>\n\n"
+               "Subcommands:\n"
+               "   timeline: print how long each phase of the last quiesce "
+               "operation took\n"),
+           cmd, progName, cmd);
+}
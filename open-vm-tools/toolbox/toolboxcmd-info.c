@@ -113,6 +113,7 @@ InfoUpdateNetwork(void)
    NicInfoV3 *info = NULL;
    GuestNicProto msg = { 0 };
    GuestInfoType type = INFO_IPADDRESS_V3;
+   GKeyFile *conf = NULL;
 
 #ifdef _WIN32
    DWORD dwRet = NetUtil_LoadIpHlpApiDll();
@@ -122,6 +123,13 @@ InfoUpdateNetwork(void)
    }
 #endif
 
+   /* Report the NICs vmtoolsd would, as configured in tools.conf. */
+   VMTools_LoadConfig(NULL, G_KEY_FILE_NONE, &conf, NULL);
+   GuestInfo_SetNicRulesFromConfig(conf);
+   if (conf != NULL) {
+      g_key_file_free(conf);
+   }
+
    if (!GuestInfo_GetNicInfo(&info)) {
       g_warning("Failed to get nic info\n");
       ret = EXIT_FAILURE;
@@ -38,6 +38,23 @@
 #include <glib/gstdio.h>
 #include "certverify.h"
 
+/*
+ * X509_up_ref() is new in OpenSSL 1.1.
+ */
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+#define X509_up_ref(x)  CRYPTO_add(&(x)->references, 1, CRYPTO_LOCK_X509)
+#endif
+
+/*
+ * Parsed X509 objects for the certs we've seen, keyed by their PEM text.
+ * The trusted certs come from the alias store and the untrusted ones from
+ * the same few SAML issuers, so the same certs get parsed for every token.
+ * The cache holds a reference to each X509; users take their own.
+ */
+#define CERTVERIFY_X509_CACHE_MAX   128
+
+static GHashTable *x509Cache = NULL;
+
 VGAuthError CertVerify_CheckSignature(VGAuthHashAlg hash,
                                       EVP_PKEY *publicKey,
                                       size_t dataLen,
@@ -379,6 +396,70 @@ done:
 }
 
 
+/*
+ ******************************************************************************
+ * CertVerifyGetX509 --                                                  */ /**
+ *
+ * Returns the X509 object for a pemCert string, from the cache if it has
+ * been parsed before.
+ *
+ * @param[in]  pemCert      The certificate in PEM format.
+ *
+ * @return an X509 object containing the cert.  Caller must X509_free() it.
+ *
+ ******************************************************************************
+ */
+
+static X509 *
+CertVerifyGetX509(const char *pemCert)
+{
+   X509 *x509Cert;
+
+   if (NULL == x509Cache) {
+      x509Cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                        (GDestroyNotify) X509_free);
+   }
+
+   x509Cert = g_hash_table_lookup(x509Cache, pemCert);
+   if (NULL != x509Cert) {
+      X509_up_ref(x509Cert);
+      return x509Cert;
+   }
+
+   x509Cert = CertStringToX509(pemCert);
+   if (NULL != x509Cert) {
+      if (g_hash_table_size(x509Cache) >= CERTVERIFY_X509_CACHE_MAX) {
+         g_hash_table_remove_all(x509Cache);
+      }
+      X509_up_ref(x509Cert);
+      g_hash_table_insert(x509Cache, g_strdup(pemCert), x509Cert);
+   }
+
+   return x509Cert;
+}
+
+
+/*
+ ******************************************************************************
+ * CertVerify_FlushCache --                                              */ /**
+ *
+ * @brief Drops all the cached X509 objects.
+ *
+ * Called when the alias store or the preferences change, so certs that are
+ * no longer in use aren't kept around.
+ *
+ ******************************************************************************
+ */
+
+void
+CertVerify_FlushCache(void)
+{
+   if (NULL != x509Cache) {
+      g_hash_table_remove_all(x509Cache);
+   }
+}
+
+
 /*
  ******************************************************************************
  * CertVerifyX509ToString --                                             */ /**
@@ -555,7 +636,7 @@ PEMChainToStack(int numCerts,
       }
 
       for (i = 0; i < numCerts; i++) {
-         x509Cert = CertStringToX509(pemCerts[i]);
+         x509Cert = CertVerifyGetX509(pemCerts[i]);
          if (NULL == x509Cert) {
             err = VGAUTH_E_INVALID_CERTIFICATE;
             g_warning("%s: failed to convert PEM cert to X509\n", __FUNCTION__);
@@ -625,7 +706,7 @@ CertVerify_CertChain(const char *pemLeafCert,
    /*
     * Turn the leaf cert into an x509 object.
     */
-   leafCert = CertStringToX509(pemLeafCert);
+   leafCert = CertVerifyGetX509(pemLeafCert);
    if (NULL == leafCert) {
       err = VGAUTH_E_INVALID_CERTIFICATE;
       g_warning("%s: failed to convert PEM cert to X509\n", __FUNCTION__);
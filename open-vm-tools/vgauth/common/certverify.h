@@ -51,6 +51,8 @@ enum {
 
 void CertVerify_Init(void);
 
+void CertVerify_FlushCache(void);
+
 gboolean CertVerify_IsWellFormedPEMCert(const char *pemCert);
 
 VGAuthError CertVerify_CertChain(const char *pemLeafCert,
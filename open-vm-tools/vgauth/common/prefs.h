@@ -134,8 +134,12 @@ msgCatalog = /etc/vmware-tools/vgauth/messages
 #define VGAUTH_PREF_SAML_SCHEMA_DIR        "samlSchemaDir"
 /** The location of the idstore */
 #define VGAUTH_PREF_ALIASSTORE_DIR         "aliasStoreDir"
+/** Whether parsed alias store files are cached in memory. */
+#define VGAUTH_PREF_ALIASSTORE_CACHE       "aliasStoreCache"
 /** The number of seconds slack allowed in either direction in SAML token date checks. */
 #define VGAUTH_PREF_CLOCK_SKEW_SECS        "clockSkewAdjustment"
+/** Maximum number of verified SAML tokens kept in memory.  0 disables it. */
+#define VGAUTH_PREF_SAML_TOKEN_CACHE_SIZE  "samlTokenCacheSize"
 
 /** Ticket group name. */
 #define VGAUTH_PREF_GROUP_NAME_TICKET      "ticket"
@@ -190,5 +194,7 @@ msgCatalog = /etc/vmware-tools/vgauth/messages
 
 #define VGAUTH_PREF_DEFAULT_CLOCK_SKEW_SECS (300)
 
+#define VGAUTH_PREF_DEFAULT_SAML_TOKEN_CACHE_SIZE 256
+
 #endif // _PREFS_H_
 
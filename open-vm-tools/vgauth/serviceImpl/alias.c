@@ -36,6 +36,9 @@
 #else
 #include <unistd.h>
 #endif
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
 
 #include "serviceInt.h"
 #include "certverify.h"
@@ -1835,6 +1838,620 @@ cleanup:
    return VGAUTH_E_OK;
 }
 
+/*
+ * In-memory cache of the parsed alias store.
+ *
+ * SAML token validation looks up the alias store on every login, so the
+ * parsed per-user alias files and the mapping file are kept in memory
+ * rather than re-read and re-parsed for each request.
+ *
+ * On Linux an inotify watch on the store directory drops an entry as soon
+ * as its file changes.  Without inotify (other platforms, a failed watch or
+ * an overflowed event queue) every entry is revalidated against a stamp of
+ * its file (inode, size, mtime and ctime, so that ownership and permission
+ * changes are noticed too) taken before it was parsed.
+ *
+ * Callers always get their own copy of the cached lists.
+ */
+
+#define ALIASSTORE_CACHE_MAX_USERS     256
+
+typedef struct AliasFileStamp {
+   gboolean exists;
+   guint64 dev;
+   guint64 ino;
+   gint64 size;
+   gint64 mtime;
+   gint64 ctime;
+} AliasFileStamp;
+
+typedef struct AliasCacheEntry {
+   AliasFileStamp stamp;
+   int num;
+   ServiceAlias *aList;
+} AliasCacheEntry;
+
+static gboolean aliasCacheEnabled = FALSE;
+static GHashTable *aliasCache = NULL;     // alias file name -> entry
+static gboolean mappedCacheValid = FALSE;
+static AliasFileStamp mappedCacheStamp;
+static int mappedCacheNum = 0;
+static ServiceMappedAlias *mappedCacheList = NULL;
+#ifdef __linux__
+static int aliasCacheInotifyFd = -1;
+#endif
+
+
+/*
+ ******************************************************************************
+ * AliasCacheGetStamp --                                                 */ /**
+ *
+ * Records the identity and change times of an alias store file.
+ *
+ * @param[in]   fileName     The file.
+ * @param[out]  stamp        The stamp; exists is FALSE if the file is missing.
+ *
+ ******************************************************************************
+ */
+
+static void
+AliasCacheGetStamp(const gchar *fileName,
+                   AliasFileStamp *stamp)
+{
+   struct stat stbuf;  // XXX docs say GStatBuf, but what we have
+
+   memset(stamp, 0, sizeof *stamp);
+
+#ifdef _WIN32
+   if (g_stat(fileName, &stbuf) != 0) {
+#else
+   if (g_lstat(fileName, &stbuf) != 0) {
+#endif
+      return;
+   }
+
+   stamp->exists = TRUE;
+   stamp->dev = stbuf.st_dev;
+   stamp->ino = stbuf.st_ino;
+   stamp->size = stbuf.st_size;
+#ifdef __linux__
+   stamp->mtime = stbuf.st_mtim.tv_sec * G_GINT64_CONSTANT(1000000000) +
+                  stbuf.st_mtim.tv_nsec;
+   stamp->ctime = stbuf.st_ctim.tv_sec * G_GINT64_CONSTANT(1000000000) +
+                  stbuf.st_ctim.tv_nsec;
+#else
+   stamp->mtime = stbuf.st_mtime;
+   stamp->ctime = stbuf.st_ctime;
+#endif
+}
+
+
+/*
+ ******************************************************************************
+ * AliasCacheIsStampCurrent --                                           */ /**
+ *
+ * Checks whether a cached file is known to be unchanged.  With a working
+ * inotify watch a change would have already dropped the entry, so the file
+ * is only stat'ed when falling back on stamps.
+ *
+ * @param[in]   fileName     The file.
+ * @param[in]   stamp        The stamp recorded when the file was parsed.
+ *
+ * @return TRUE if the cached contents can be used.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+AliasCacheIsStampCurrent(const gchar *fileName,
+                         const AliasFileStamp *stamp)
+{
+   AliasFileStamp cur;
+
+#ifdef __linux__
+   if (aliasCacheInotifyFd >= 0) {
+      return TRUE;
+   }
+#endif
+
+   AliasCacheGetStamp(fileName, &cur);
+
+   return cur.exists == stamp->exists &&
+          cur.dev == stamp->dev &&
+          cur.ino == stamp->ino &&
+          cur.size == stamp->size &&
+          cur.mtime == stamp->mtime &&
+          cur.ctime == stamp->ctime;
+}
+
+
+/*
+ ******************************************************************************
+ * AliasCacheFreeEntry --                                                */ /**
+ *
+ * Frees a cache entry.  Used as the GHashTable value destroy function.
+ *
+ * @param[in]   data         The AliasCacheEntry.
+ *
+ ******************************************************************************
+ */
+
+static void
+AliasCacheFreeEntry(gpointer data)
+{
+   AliasCacheEntry *entry = data;
+
+   ServiceAliasFreeAliasList(entry->num, entry->aList);
+   g_free(entry);
+}
+
+
+/*
+ ******************************************************************************
+ * AliasCacheInvalidateMapped --                                         */ /**
+ *
+ * Drops the cached mapping file.
+ *
+ ******************************************************************************
+ */
+
+static void
+AliasCacheInvalidateMapped(void)
+{
+   ServiceAliasFreeMappedAliasList(mappedCacheNum, mappedCacheList);
+   mappedCacheNum = 0;
+   mappedCacheList = NULL;
+   mappedCacheValid = FALSE;
+}
+
+
+/*
+ ******************************************************************************
+ * AliasCacheInvalidateAll --                                            */ /**
+ *
+ * Drops everything in the cache.
+ *
+ ******************************************************************************
+ */
+
+static void
+AliasCacheInvalidateAll(void)
+{
+   if (aliasCache != NULL) {
+      g_hash_table_remove_all(aliasCache);
+   }
+   AliasCacheInvalidateMapped();
+}
+
+
+#ifdef __linux__
+/*
+ ******************************************************************************
+ * AliasCacheProcessEvents --                                            */ /**
+ *
+ * Drains the pending inotify events for the alias store directory and
+ * drops the cache entries of any file they name.  If the queue overflowed
+ * or the directory itself went away, everything is dropped and the cache
+ * falls back on stamps.
+ *
+ ******************************************************************************
+ */
+
+static void
+AliasCacheProcessEvents(void)
+{
+   char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+   ssize_t len;
+
+   if (aliasCacheInotifyFd < 0) {
+      return;
+   }
+
+   while ((len = read(aliasCacheInotifyFd, buf, sizeof buf)) > 0) {
+      char *p;
+
+      for (p = buf; p < buf + len;
+           p += sizeof(struct inotify_event) +
+                ((struct inotify_event *)p)->len) {
+         struct inotify_event *ev = (struct inotify_event *)p;
+
+         if (ev->mask & (IN_Q_OVERFLOW | IN_IGNORED |
+                         IN_DELETE_SELF | IN_MOVE_SELF)) {
+            Warning("%s: lost track of alias store changes (0x%x), "
+                    "validating by file stamps\n", __FUNCTION__, ev->mask);
+            close(aliasCacheInotifyFd);
+            aliasCacheInotifyFd = -1;
+            AliasCacheInvalidateAll();
+            return;
+         }
+
+         if (ev->len == 0) {
+            continue;
+         }
+
+         if (g_strcmp0(ev->name, ALIASSTORE_MAPFILE_NAME) == 0) {
+            AliasCacheInvalidateMapped();
+         } else {
+            gchar *fileName = g_strdup_printf("%s"DIRSEP"%s",
+                                              aliasStoreRootDir, ev->name);
+
+            g_hash_table_remove(aliasCache, fileName);
+            g_free(fileName);
+         }
+      }
+   }
+}
+#endif
+
+
+/*
+ ******************************************************************************
+ * AliasCacheInit --                                                     */ /**
+ *
+ * Sets up the alias store cache, unless disabled by preference.  Must be
+ * called once the store directory exists.
+ *
+ ******************************************************************************
+ */
+
+static void
+AliasCacheInit(void)
+{
+   aliasCacheEnabled = Pref_GetBool(gPrefs,
+                                    VGAUTH_PREF_ALIASSTORE_CACHE,
+                                    VGAUTH_PREF_GROUP_NAME_SERVICE,
+                                    TRUE);
+   if (!aliasCacheEnabled) {
+      Log("%s: alias store cache disabled\n", __FUNCTION__);
+      return;
+   }
+
+   aliasCache = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                      g_free, AliasCacheFreeEntry);
+
+#ifdef __linux__
+   aliasCacheInotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+   if (aliasCacheInotifyFd >= 0 &&
+       inotify_add_watch(aliasCacheInotifyFd, aliasStoreRootDir,
+                         IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+                         IN_MODIFY | IN_MOVED_FROM | IN_MOVED_TO |
+                         IN_DELETE_SELF | IN_MOVE_SELF | IN_DONT_FOLLOW |
+                         IN_ONLYDIR) < 0) {
+      close(aliasCacheInotifyFd);
+      aliasCacheInotifyFd = -1;
+   }
+   if (aliasCacheInotifyFd < 0) {
+      Warning("%s: unable to watch '%s' (%d), validating by file stamps\n",
+              __FUNCTION__, aliasStoreRootDir, errno);
+   }
+#endif
+}
+
+
+/*
+ ******************************************************************************
+ * AliasCopyAliasList --                                                 */ /**
+ *
+ * Deep copies a list of ServiceAlias.
+ *
+ * @param[in]   num          The size of the list.
+ * @param[in]   aList        The list.
+ *
+ * @return The copy.  The caller should call ServiceAliasFreeAliasList().
+ *
+ ******************************************************************************
+ */
+
+static ServiceAlias *
+AliasCopyAliasList(int num,
+                   const ServiceAlias *aList)
+{
+   ServiceAlias *copy = g_new0(ServiceAlias, num);
+   int i;
+   int j;
+
+   for (i = 0; i < num; i++) {
+      copy[i].pemCert = g_strdup(aList[i].pemCert);
+      copy[i].num = aList[i].num;
+      copy[i].infos = g_new0(ServiceAliasInfo, aList[i].num);
+      for (j = 0; j < aList[i].num; j++) {
+         ServiceAliasCopyAliasInfoContents(&(aList[i].infos[j]),
+                                           &(copy[i].infos[j]));
+      }
+   }
+
+   return copy;
+}
+
+
+/*
+ ******************************************************************************
+ * AliasCopyMappedList --                                                */ /**
+ *
+ * Deep copies a list of ServiceMappedAlias.
+ *
+ * @param[in]   num          The size of the list.
+ * @param[in]   maList       The list.
+ *
+ * @return The copy.  The caller should call ServiceAliasFreeMappedAliasList().
+ *
+ ******************************************************************************
+ */
+
+static ServiceMappedAlias *
+AliasCopyMappedList(int num,
+                    const ServiceMappedAlias *maList)
+{
+   ServiceMappedAlias *copy = g_new0(ServiceMappedAlias, num);
+   int i;
+   int j;
+
+   for (i = 0; i < num; i++) {
+      copy[i].pemCert = g_strdup(maList[i].pemCert);
+      copy[i].userName = g_strdup(maList[i].userName);
+      copy[i].num = maList[i].num;
+      copy[i].subjects = g_new0(ServiceSubject, maList[i].num);
+      for (j = 0; j < maList[i].num; j++) {
+         copy[i].subjects[j].type = maList[i].subjects[j].type;
+         copy[i].subjects[j].name = g_strdup(maList[i].subjects[j].name);
+      }
+   }
+
+   return copy;
+}
+
+
+/*
+ ******************************************************************************
+ * AliasCacheStoreAliases --                                             */ /**
+ *
+ * Caches a copy of a user's aliases.
+ *
+ * @param[in]   aliasFilename  The user's alias file; the cache key.
+ * @param[in]   stamp          The file stamp the aliases correspond to.
+ * @param[in]   num            The number of aliases.
+ * @param[in]   aList          The aliases.
+ *
+ ******************************************************************************
+ */
+
+static void
+AliasCacheStoreAliases(const gchar *aliasFilename,
+                       const AliasFileStamp *stamp,
+                       int num,
+                       const ServiceAlias *aList)
+{
+   AliasCacheEntry *entry;
+
+   if (g_hash_table_size(aliasCache) >= ALIASSTORE_CACHE_MAX_USERS) {
+      g_hash_table_remove_all(aliasCache);
+   }
+
+   entry = g_new0(AliasCacheEntry, 1);
+   entry->stamp = *stamp;
+   entry->num = num;
+   entry->aList = AliasCopyAliasList(num, aList);
+
+   g_hash_table_replace(aliasCache, g_strdup(aliasFilename), entry);
+}
+
+
+/*
+ ******************************************************************************
+ * AliasCacheStoreMapped --                                              */ /**
+ *
+ * Caches a copy of the mapping file contents.
+ *
+ * @param[in]   stamp          The file stamp the list corresponds to.
+ * @param[in]   num            The number of entries.
+ * @param[in]   maList         The entries.
+ *
+ ******************************************************************************
+ */
+
+static void
+AliasCacheStoreMapped(const AliasFileStamp *stamp,
+                      int num,
+                      const ServiceMappedAlias *maList)
+{
+   AliasCacheInvalidateMapped();
+
+   mappedCacheStamp = *stamp;
+   mappedCacheNum = num;
+   mappedCacheList = AliasCopyMappedList(num, maList);
+   mappedCacheValid = TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * AliasCacheLoadAliases --                                              */ /**
+ *
+ * Cached version of AliasLoadAliases().
+ *
+ * @param[in]   userName        The user whose store is to be loaded.
+ * @param[out]  num             The number of certs read.
+ * @param[out]  aList           The Aliases read.  The caller should
+ *                              call ServiceAliasFreeAliasList() when done.
+ *
+ * @return VGAUTH_E_OK on success, VGAuthError on failure
+ *
+ ******************************************************************************
+ */
+
+static VGAuthError
+AliasCacheLoadAliases(const gchar *userName,
+                      int *num,
+                      ServiceAlias **aList)
+{
+   VGAuthError err;
+   AliasCacheEntry *entry;
+   AliasFileStamp stamp;
+   gchar *aliasFilename;
+
+   if (!aliasCacheEnabled) {
+      return AliasLoadAliases(userName, num, aList);
+   }
+
+#ifdef __linux__
+   AliasCacheProcessEvents();
+#endif
+
+   aliasFilename = ServiceUserNameToAliasStoreFileName(userName);
+
+   entry = g_hash_table_lookup(aliasCache, aliasFilename);
+   if (entry != NULL &&
+       AliasCacheIsStampCurrent(aliasFilename, &entry->stamp)) {
+      *num = entry->num;
+      *aList = AliasCopyAliasList(entry->num, entry->aList);
+      g_free(aliasFilename);
+      return VGAUTH_E_OK;
+   }
+
+   /*
+    * Stamp before parsing, so a change made while parsing is noticed
+    * the next time around.
+    */
+   AliasCacheGetStamp(aliasFilename, &stamp);
+   err = AliasLoadAliases(userName, num, aList);
+   if (err == VGAUTH_E_OK) {
+      AliasCacheStoreAliases(aliasFilename, &stamp, *num, *aList);
+   } else {
+      g_hash_table_remove(aliasCache, aliasFilename);
+   }
+
+   g_free(aliasFilename);
+   return err;
+}
+
+
+/*
+ ******************************************************************************
+ * AliasCacheLoadMapped --                                               */ /**
+ *
+ * Cached version of AliasLoadMapped().
+ *
+ * @param[out]  num             The number of entries read.
+ * @param[out]  maList          The ServiceMappedAliases read.  The caller
+ *                              should call ServiceAliasFreeMappedAliasList()
+ *                              when done.
+ *
+ * @return VGAUTH_E_OK on success, VGAuthError on failure
+ *
+ ******************************************************************************
+ */
+
+static VGAuthError
+AliasCacheLoadMapped(int *num,
+                     ServiceMappedAlias **maList)
+{
+   VGAuthError err;
+   AliasFileStamp stamp;
+   gchar *mapFilename;
+
+   if (!aliasCacheEnabled) {
+      return AliasLoadMapped(num, maList);
+   }
+
+#ifdef __linux__
+   AliasCacheProcessEvents();
+#endif
+
+   mapFilename = g_strdup_printf("%s"DIRSEP"%s",
+                                 aliasStoreRootDir,
+                                 ALIASSTORE_MAPFILE_NAME);
+
+   if (mappedCacheValid &&
+       AliasCacheIsStampCurrent(mapFilename, &mappedCacheStamp)) {
+      *num = mappedCacheNum;
+      *maList = AliasCopyMappedList(mappedCacheNum, mappedCacheList);
+      g_free(mapFilename);
+      return VGAUTH_E_OK;
+   }
+
+   AliasCacheGetStamp(mapFilename, &stamp);
+   err = AliasLoadMapped(num, maList);
+   if (err == VGAUTH_E_OK) {
+      AliasCacheStoreMapped(&stamp, *num, *maList);
+   } else {
+      AliasCacheInvalidateMapped();
+   }
+
+   g_free(mapFilename);
+   return err;
+}
+
+
+/*
+ ******************************************************************************
+ * AliasCacheUpdateAfterSave --                                          */ /**
+ *
+ * Called once AliasSaveAliasesAndMapped() has finished with the store.
+ * On success the cache is switched over to the lists that were just
+ * written; on failure whatever may have changed is dropped.
+ *
+ * The events our own writes generated are drained first, so they don't
+ * immediately throw away what is cached here.
+ *
+ * @param[in]   err             The result of the save.
+ * @param[in]   userName        The user whose store was written.
+ * @param[in]   num             The number of Aliases written.
+ * @param[in]   aList           The Aliases written.
+ * @param[in]   updateMap       True if the mapfile was written too.
+ * @param[in]   numMapped       The number of mapfile entries.
+ * @param[in]   maList          The mapfile entries.
+ *
+ ******************************************************************************
+ */
+
+static void
+AliasCacheUpdateAfterSave(VGAuthError err,
+                          const gchar *userName,
+                          int num,
+                          const ServiceAlias *aList,
+                          gboolean updateMap,
+                          int numMapped,
+                          const ServiceMappedAlias *maList)
+{
+   gchar *aliasFilename;
+   gchar *mapFilename;
+   AliasFileStamp stamp;
+
+   if (!aliasCacheEnabled) {
+      return;
+   }
+
+#ifdef __linux__
+   AliasCacheProcessEvents();
+#endif
+
+   aliasFilename = ServiceUserNameToAliasStoreFileName(userName);
+   mapFilename = g_strdup_printf("%s"DIRSEP"%s",
+                                 aliasStoreRootDir,
+                                 ALIASSTORE_MAPFILE_NAME);
+
+   if (err != VGAUTH_E_OK) {
+      g_hash_table_remove(aliasCache, aliasFilename);
+      if (updateMap) {
+         AliasCacheInvalidateMapped();
+      }
+      goto done;
+   }
+
+   AliasCacheGetStamp(aliasFilename, &stamp);
+   AliasCacheStoreAliases(aliasFilename, &stamp, num, aList);
+
+   if (updateMap) {
+      AliasCacheGetStamp(mapFilename, &stamp);
+      AliasCacheStoreMapped(&stamp, numMapped, maList);
+   }
+
+done:
+   g_free(aliasFilename);
+   g_free(mapFilename);
+}
+
+
 /*
  ******************************************************************************
  * AliasSafeRenameFiles --                                               */ /**
@@ -2346,6 +2963,14 @@ cleanup:
    }
 
 done:
+   AliasCacheUpdateAfterSave(err, userName, num, aList,
+                             updateMap, numMapped, maList);
+   /*
+    * Certs may have been dropped from the store; don't keep them parsed.
+    */
+   if (VGAUTH_E_OK == err) {
+      CertVerify_FlushCache();
+   }
    g_free(tmpAliasFilename);
    g_free(tmpMapFilename);
    return err;
@@ -2559,7 +3184,7 @@ ServiceAliasAddAlias(const gchar *reqUserName,
    /*
     * Load any that already exist.
     */
-   err = AliasLoadAliases(userName, &num, &aList);
+   err = AliasCacheLoadAliases(userName, &num, &aList);
    if (VGAUTH_E_OK != err) {
       return err;
    }
@@ -2619,7 +3244,7 @@ ServiceAliasAddAlias(const gchar *reqUserName,
 
 check_map:
    if (addMapped) {
-      err = AliasLoadMapped(&numMapped, &maList);
+      err = AliasCacheLoadMapped(&numMapped, &maList);
 
       /*
        * Do a dup check -- be sure the cert/subject combo
@@ -2792,7 +3417,7 @@ ServiceAliasRemoveAlias(const gchar *reqUserName,
    /*
     * Load user's store.
     */
-   err = AliasLoadAliases(userName, &numIds, &aList);
+   err = AliasCacheLoadAliases(userName, &numIds, &aList);
    if (VGAUTH_E_OK != err) {
       return err;
    }
@@ -2866,7 +3491,7 @@ ServiceAliasRemoveAlias(const gchar *reqUserName,
    /*
     * Now clear out any mapped alias.  This may fail to find a match.
     */
-   err = AliasLoadMapped(&numMapped, &maList);
+   err = AliasCacheLoadMapped(&numMapped, &maList);
    if (VGAUTH_E_OK != err) {
       goto done;
    }
@@ -3003,7 +3628,7 @@ ServiceAliasQueryAliases(const gchar *userName,
    }
 #endif
 
-   err = AliasLoadAliases(userName, num, aList);
+   err = AliasCacheLoadAliases(userName, num, aList);
    if (VGAUTH_E_OK != err) {
       Warning("%s: failed to load Aliases for '%s'\n", __FUNCTION__, userName);
    }
@@ -3035,7 +3660,7 @@ ServiceAliasQueryMappedAliases(int *num,
    *num = 0;
    *maList = NULL;
 
-   err = AliasLoadMapped(num, maList);
+   err = AliasCacheLoadMapped(num, maList);
    if (VGAUTH_E_OK != err) {
       Warning("%s: failed to load mapped aliases\n", __FUNCTION__);
    }
@@ -3389,5 +4014,7 @@ ServiceAliasInitAliasStore(void)
       return VGAUTH_E_FAIL;
    }
 
+   AliasCacheInit();
+
    return err;
 }
@@ -52,6 +52,24 @@ static xmlSchemaValidCtxtPtr gSchemaValidateCtx = NULL;
 #define CATALOG_FILENAME            "catalog.xml"
 #define SAML_SCHEMA_FILENAME        "saml-schema-assertion-2.0.xsd"
 
+/*
+ * Tokens that have already passed VerifySAMLToken(), keyed by the SHA-256
+ * digest of the token text.  An entry is only good until the earliest
+ * NotOnOrAfter in the token (plus the allowed clock skew); tokens without
+ * one, or marked OneTimeUse, are never cached.  The cert chain is still
+ * checked against the alias store on every use, so alias changes take
+ * effect immediately.
+ */
+typedef struct SAMLTokenCacheEntry {
+   gchar *subject;
+   int numCerts;
+   gchar **certChain;      // NULL-terminated
+   glong expires;          // seconds since the epoch
+} SAMLTokenCacheEntry;
+
+static GHashTable *gTokenCache = NULL;
+static int gTokenCacheSize = VGAUTH_PREF_DEFAULT_SAML_TOKEN_CACHE_SIZE;
+
 
 /*
  ******************************************************************************
@@ -293,6 +311,181 @@ LoadPrefs(void)
                                       VGAUTH_PREF_DEFAULT_CLOCK_SKEW_SECS);
     Log("%s: Allowing %d of clock skew for SAML date validation\n",
         __FUNCTION__, gClockSkewAdjustment);
+   gTokenCacheSize = Pref_GetInt(gPrefs, VGAUTH_PREF_SAML_TOKEN_CACHE_SIZE,
+                                 VGAUTH_PREF_GROUP_NAME_SERVICE,
+                                 VGAUTH_PREF_DEFAULT_SAML_TOKEN_CACHE_SIZE);
+}
+
+
+/*
+ ******************************************************************************
+ * TokenCacheFreeEntry --                                                */ /**
+ *
+ * Frees a token cache entry.
+ *
+ * @param[in]  data     The SAMLTokenCacheEntry to free.
+ *
+ ******************************************************************************
+ */
+
+static void
+TokenCacheFreeEntry(gpointer data)
+{
+   SAMLTokenCacheEntry *entry = data;
+
+   g_free(entry->subject);
+   g_strfreev(entry->certChain);
+   g_free(entry);
+}
+
+
+/*
+ ******************************************************************************
+ * TokenCacheIsExpired --                                                */ /**
+ *
+ * GHRFunc for dropping expired token cache entries.
+ *
+ * @param[in]  key      The token digest (unused).
+ * @param[in]  value    The SAMLTokenCacheEntry.
+ * @param[in]  data     Pointer to the current time.
+ *
+ * @return TRUE if the entry has expired.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+TokenCacheIsExpired(gpointer key,
+                    gpointer value,
+                    gpointer data)
+{
+   SAMLTokenCacheEntry *entry = value;
+
+   return entry->expires < *(glong *) data;
+}
+
+
+/*
+ ******************************************************************************
+ * TokenCacheFlush --                                                    */ /**
+ *
+ * Drops every entry in the token cache.
+ *
+ ******************************************************************************
+ */
+
+static void
+TokenCacheFlush(void)
+{
+   if (NULL != gTokenCache) {
+      g_hash_table_remove_all(gTokenCache);
+   }
+}
+
+
+/*
+ ******************************************************************************
+ * TokenCacheLookup --                                                   */ /**
+ *
+ * Looks up a token that has previously been verified.
+ *
+ * @param[in]  digest    Digest of the token text.
+ * @param[out] subject   Subject of SAML token,  Caller must g_free().
+ * @param[out] numCerts  Number of certs in the token.
+ * @param[out] certChain Certs in the token. Caller should g_free() array and
+ *                       contents.
+ *
+ * @return TRUE if the token was found and has not expired.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+TokenCacheLookup(const gchar *digest,
+                 gchar **subject,
+                 int *numCerts,
+                 gchar ***certChain)
+{
+   SAMLTokenCacheEntry *entry;
+   GTimeVal now;
+
+   if (NULL == gTokenCache) {
+      return FALSE;
+   }
+
+   entry = g_hash_table_lookup(gTokenCache, digest);
+   if (NULL == entry) {
+      return FALSE;
+   }
+
+   g_get_current_time(&now);
+   if (entry->expires < now.tv_sec) {
+      g_hash_table_remove(gTokenCache, digest);
+      return FALSE;
+   }
+
+   if (NULL != subject) {
+      *subject = g_strdup(entry->subject);
+   }
+   *numCerts = entry->numCerts;
+   *certChain = g_strdupv(entry->certChain);
+
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * TokenCacheInsert --                                                   */ /**
+ *
+ * Remembers a verified token.  When the cache is full, expired entries
+ * are dropped first, and if that doesn't make room the cache is emptied.
+ *
+ * @param[in]  digest    Digest of the token text.
+ * @param[in]  subject   Subject of the SAML token.
+ * @param[in]  numCerts  Number of certs in the token.
+ * @param[in]  certChain Certs in the token.
+ * @param[in]  expires   When the token stops being valid, or 0 if it
+ *                       must not be cached.
+ *
+ ******************************************************************************
+ */
+
+static void
+TokenCacheInsert(const gchar *digest,
+                 const gchar *subject,
+                 int numCerts,
+                 gchar **certChain,
+                 glong expires)
+{
+   SAMLTokenCacheEntry *entry;
+   GTimeVal now;
+   int i;
+
+   if ((NULL == gTokenCache) || (gTokenCacheSize <= 0) || (0 == expires)) {
+      return;
+   }
+
+   if (g_hash_table_size(gTokenCache) >= (guint) gTokenCacheSize) {
+      g_get_current_time(&now);
+      g_hash_table_foreach_remove(gTokenCache, TokenCacheIsExpired,
+                                  &now.tv_sec);
+      if (g_hash_table_size(gTokenCache) >= (guint) gTokenCacheSize) {
+         g_debug("%s: token cache full, flushing\n", __FUNCTION__);
+         g_hash_table_remove_all(gTokenCache);
+      }
+   }
+
+   entry = g_malloc0(sizeof *entry);
+   entry->subject = g_strdup(subject);
+   entry->numCerts = numCerts;
+   entry->certChain = g_new0(gchar *, numCerts + 1);
+   for (i = 0; i < numCerts; i++) {
+      entry->certChain[i] = g_strdup(certChain[i]);
+   }
+   entry->expires = expires;
+
+   g_hash_table_replace(gTokenCache, g_strdup(digest), entry);
 }
 
 
@@ -399,6 +592,9 @@ SAML_Init(void)
     */
    LoadPrefs();
 
+   gTokenCache = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                       g_free, TokenCacheFreeEntry);
+
    Log("%s: Using xmlsec1 for XML signature support\n", __FUNCTION__);
 
    return VGAUTH_E_OK;
@@ -417,6 +613,10 @@ SAML_Init(void)
 void
 SAML_Shutdown()
 {
+   if (NULL != gTokenCache) {
+      g_hash_table_destroy(gTokenCache);
+      gTokenCache = NULL;
+   }
    FreeSchemas();
    xmlSecCryptoShutdown();
    xmlSecCryptoAppShutdown();
@@ -449,6 +649,12 @@ SAML_Reload()
    FreeSchemas();
    LoadPrefs();
    LoadCatalogAndSchema();
+
+   /*
+    * The clock skew or the schemas may have changed, so anything we've
+    * already accepted has to be checked again.
+    */
+   TokenCacheFlush();
 }
 
 
@@ -1270,6 +1476,95 @@ done:
 }
 
 
+/*
+ ******************************************************************************
+ * GetEarlierTimeAttr --                                                 */ /**
+ *
+ * Parses a timestamp attribute and keeps it if it's earlier than the
+ * one found so far.
+ *
+ * @param[in]     node      The node containing the attribute.
+ * @param[in]     attrName  The name of the attribute.
+ * @param[in,out] earliest  Earliest time seen so far, 0 if none.
+ *
+ ******************************************************************************
+ */
+
+static void
+GetEarlierTimeAttr(const xmlNodePtr node,
+                   const gchar *attrName,
+                   glong *earliest)
+{
+   xmlChar *timeAttr;
+   GTimeVal attrTime;
+
+   timeAttr = FindAttrValue(node, attrName);
+   if ((NULL != timeAttr) && (0 != *timeAttr) &&
+       g_time_val_from_iso8601(timeAttr, &attrTime)) {
+      if ((0 == *earliest) || (attrTime.tv_sec < *earliest)) {
+         *earliest = attrTime.tv_sec;
+      }
+   }
+   xmlFree(timeAttr);
+}
+
+
+/*
+ ******************************************************************************
+ * GetTokenExpiry --                                                     */ /**
+ *
+ * Works out how long a verified token can be trusted without being
+ * verified again: up to the earliest NotOnOrAfter on the Conditions or
+ * any SubjectConfirmationData, plus the allowed clock skew.
+ *
+ * @param[in]  doc  The parsed and verified SAML token.
+ *
+ * @return The expiry time in seconds since the epoch, or 0 if the token
+ *         has no expiry or asks not to be cached (OneTimeUse).
+ *
+ ******************************************************************************
+ */
+
+static glong
+GetTokenExpiry(xmlDocPtr doc)
+{
+   xmlNodePtr root = xmlDocGetRootElement(doc);
+   xmlNodePtr node;
+   xmlNodePtr child;
+   glong expires = 0;
+
+   node = FindNodeByName(root, "Conditions");
+   if (NULL != node) {
+      if (FindNodeByName(node, "OneTimeUse") != NULL) {
+         return 0;
+      }
+      GetEarlierTimeAttr(node, "NotOnOrAfter", &expires);
+   }
+
+   node = FindNodeByName(root, "Subject");
+   if (NULL != node) {
+      for (child = node->children; child != NULL; child = child->next) {
+         xmlNodePtr subjConfirmData;
+
+         if ((child->type != XML_ELEMENT_NODE) ||
+             !xmlStrEqual(child->name, "SubjectConfirmation")) {
+            continue;
+         }
+         subjConfirmData = FindNodeByName(child, "SubjectConfirmationData");
+         if (NULL != subjConfirmData) {
+            GetEarlierTimeAttr(subjConfirmData, "NotOnOrAfter", &expires);
+         }
+      }
+   }
+
+   if (0 != expires) {
+      expires += gClockSkewAdjustment;
+   }
+
+   return expires;
+}
+
+
 /*
  ******************************************************************************
  * VerifySAMLToken --                                                    */ /**
@@ -1282,6 +1577,8 @@ done:
  * @param[out] numCerts  Number of certs in the token.
  * @param[out] certChain Certs in the token. Caller should g_free() array and
  *                       contents.
+ * @param[out] expires   How long the result can be cached, see
+ *                       GetTokenExpiry().
  *
  * @return matching TRUE on success.
  *
@@ -1292,7 +1589,8 @@ static gboolean
 VerifySAMLToken(const gchar *token,
                 gchar **subject,
                 int *numCerts,
-                gchar ***certChain)
+                gchar ***certChain,
+                glong *expires)
 {
    xmlDocPtr doc = NULL;
    int retCode = FALSE;
@@ -1348,6 +1646,7 @@ VerifySAMLToken(const gchar *token,
       goto done;
    }
 
+   *expires = GetTokenExpiry(doc);
    retCode = TRUE;
 done:
 #if PARSE_WITH_OPTIONS
@@ -1367,6 +1666,60 @@ done:
 }
 
 
+/*
+ ******************************************************************************
+ * VerifySAMLTokenCached --                                              */ /**
+ *
+ * Wrapper for VerifySAMLToken() that skips the parse and signature check
+ * for a token that has already been verified and hasn't expired.
+ *
+ * @param[in]  token     Text of SAML token.
+ * @param[out] subject   Subject of SAML token,  Caller must g_free().
+ * @param[out] numCerts  Number of certs in the token.
+ * @param[out] certChain Certs in the token. Caller should g_free() array and
+ *                       contents.
+ *
+ * @return TRUE on success.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+VerifySAMLTokenCached(const gchar *token,
+                      gchar **subject,
+                      int *numCerts,
+                      gchar ***certChain)
+{
+   gchar *digest = NULL;
+   gchar *subj = NULL;
+   glong expires = 0;
+   gboolean bRet;
+
+   if ((NULL != gTokenCache) && (gTokenCacheSize > 0)) {
+      digest = g_compute_checksum_for_string(G_CHECKSUM_SHA256, token, -1);
+      if (TokenCacheLookup(digest, subject, numCerts, certChain)) {
+         g_debug("%s: using cached verification of token\n", __FUNCTION__);
+         g_free(digest);
+         return TRUE;
+      }
+   }
+
+   bRet = VerifySAMLToken(token, &subj, numCerts, certChain, &expires);
+   if (bRet && (NULL != digest)) {
+      TokenCacheInsert(digest, subj, *numCerts, *certChain, expires);
+   }
+
+   if (NULL != subject) {
+      *subject = subj;
+   } else {
+      g_free(subj);
+   }
+   g_free(digest);
+
+   return bRet;
+}
+
+
 /*
  ******************************************************************************
  * SAML_VerifyBearerToken --                                             */ /**
@@ -1400,10 +1753,10 @@ SAML_VerifyBearerToken(const char *xmlText,
    gchar **certChain = NULL;
    int num = 0;
 
-   ret = VerifySAMLToken(xmlText,
-                         subjNameOut,
-                         &num,
-                         &certChain);
+   ret = VerifySAMLTokenCached(xmlText,
+                               subjNameOut,
+                               &num,
+                               &certChain);
 
    // clean up -- this code doesn't look at the chain
    FreeCertArray(num, certChain);
@@ -1451,10 +1804,10 @@ SAML_VerifyBearerTokenAndChain(const char *xmlText,
    *subjNameOut = NULL;
    *verifyAi = NULL;
 
-   bRet = VerifySAMLToken(xmlText,
-                          subjNameOut,
-                          &num,
-                          &certChain);
+   bRet = VerifySAMLTokenCached(xmlText,
+                                subjNameOut,
+                                &num,
+                                &certChain);
 
    if (FALSE == bRet) {
       return VGAUTH_E_AUTHENTICATION_DENIED;
@@ -26,6 +26,7 @@
 #include "serviceInt.h"
 #include "VGAuthProto.h"
 #include "VGAuthUtil.h"
+#include "certverify.h"
 #ifdef _WIN32
 #include "winUtil.h"
 #endif
@@ -773,6 +774,7 @@ Service_ReloadPrefs(void)
    ServiceInitTicketPrefs();
    ServiceInitListenConnectionPrefs();
    SAML_Reload();
+   CertVerify_FlushCache();
 }
 
 
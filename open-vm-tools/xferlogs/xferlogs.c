@@ -35,6 +35,10 @@
  *      Aug 24 18:48:10: vcpu-0| Guest: >Mi4K
  *      Aug 24 18:48:10: vcpu-0| Guest: >Logfile Ends
  *
+ *      "enc2" does a version 2 transfer, compressed and in larger chunks,
+ *      see xferlogsInt.h. Both can go to a file, rather than the vmx log,
+ *      to extract or benchmark a transfer offline.
+ *
  */
 
 #include <stdio.h>
@@ -42,94 +46,52 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
-#include <time.h>
 
 #include "vmware.h"
 #include "vmsupport.h"
 #include "debug.h"
 #include "rpcvmx.h"
 #include "rpcout.h"
-#include "base64.h"
-#include "str.h"
 #include "strutil.h"
+#include "xferlogsInt.h"
 
 #include "xferlogs_version.h"
 #include "vm_version.h"
 #include "embed_version.h"
 VM_EMBED_VERSION(XFERLOGS_VERSION_STRING);
 
-/*
- * "The resultant base64-encoded data exceeds the original in length by the
- * ratio 4:3, and typically appears to consist of seemingly random characters.
- * As newlines, represented by a CR+LF pair, are inserted in the encoded data
- * every 76 characters, the actual length of the encoded data is approximately
- * 136.8% of the original." - Base64 Wiki
- * And just so that it produces 80 char output.
- */
-
-#define BUF_BASE64_SIZE        57
-#define BUF_OUT_SIZE           256
-#define LOG_GUEST_MARK         "Guest: >"
-#define LOG_START_MARK         ">Logfile Begins "
-#define LOG_END_MARK           ">Logfile Ends "
-
-typedef enum {
-   NOT_IN_GUEST_LOGGING,
-   IN_GUEST_LOGGING
-} extractMode;
-
-#define LOG_VERSION            1
-
-
 /*
  *--------------------------------------------------------------------------
  *
  * xmitFile --
  *
- *       This function transfers a file using the rpc channel in base64
- *       encoding to the vmx logs.
+ *       This function transfers a file using the transport in base64
+ *       encoding, to the vmx logs by default.
  *
  * Results:
  *       None.
  *
  * Side effects:
- *       The program would exit if an error occurs in Base64_Encode.
+ *       The program would exit if the file cannot be read.
  *       Output is added to the vmx log file.
  *
  *--------------------------------------------------------------------------
  */
 
 static void
-xmitFile(char *filename) //IN : file to be transmitted.
+xmitFile(XferTransport *xport, //IN : where the file goes.
+         char *filename)       //IN : file to be transmitted.
 {
    FILE *fp;
-   size_t readLen;
-   char buf[BUF_BASE64_SIZE];
-
-   /*
-    * We have a unique identifier saying that this is guest dumping the
-    * output of logs and not any other logging information from the guest.
-    */
-   char base64B[BUF_BASE64_SIZE * 2] = ">";
-   char *base64Buf = base64B + 1;
 
    if (!(fp = fopen(filename, "rb"))) {
       Warning("Unable to open file %s with errno %d\n", filename, errno);
       exit(-1);
    }
 
-   //XXX the format below is hardcoded and used by extractFile
-   RpcVMX_Log("%s: %s: ver - %d", LOG_START_MARK, filename, LOG_VERSION);
-   while ((readLen = fread(buf, 1, sizeof buf, fp)) > 0 ) {
-      if (Base64_Encode(buf, readLen, base64Buf, sizeof base64B - 1, NULL)) {
-         RpcVMX_Log("%s", base64B);
-      } else {
-         Warning("Error in Base64_Encode\n");
-         goto exit;
-      }
+   if (!XferV1_Xmit(xport, filename, fp)) {
+      Warning("Transfer of %s failed\n", filename);
    }
-exit:
-   RpcVMX_Log(LOG_END_MARK);
    fclose(fp);
 }
 
@@ -137,142 +99,52 @@ exit:
 /*
  *--------------------------------------------------------------------------
  *
- * extractFile --
+ * xmitFileV2 --
  *
- *       This function iterates through the vmx log file and for every
- *       line which has a "Guest: >" writes the unencoded base64 output to
- *       a file, depending on the state machine.
+ *       This function transfers a file using the transport in the version 2
+ *       format, see XferV2_Xmit.
  *
  * Results:
- *       None
+ *       None.
  *
  * Side effects:
- *       The program would exit if unable to read the input file.
- *       A series of decoded output files are created.
+ *       The program would exit if the file cannot be read, or the build has
+ *       no zlib.
+ *       Output is added to the vmx log file.
+ *
  *--------------------------------------------------------------------------
  */
 
 static void
-extractFile(char *filename) //IN: vmx log filename e.g. vmware.log
+xmitFileV2(XferTransport *xport, //IN : where the file goes.
+           char *filename)       //IN : file to be transmitted.
 {
+#ifdef HAVE_ZLIB
    FILE *fp;
-   FILE *outfp = NULL;
-   char buf[BUF_OUT_SIZE];
-   uint8 base64Out[BUF_OUT_SIZE];
-   size_t lenOut;
-   char fname[256];
-   char *ptrStr, *logInpFilename, *ver;
-   int version;
-   int filenu = 0; // output file enumerator
-   DEBUG_ONLY(extractMode state = NOT_IN_GUEST_LOGGING);
 
-
-   if (!(fp = fopen(filename, "rt"))) {
-      Warning("Error opening file %s, errno %d - %s \n",
-              filename, errno, strerror(errno));
+   if (!(fp = fopen(filename, "rb"))) {
+      Warning("Unable to open file %s with errno %d\n", filename, errno);
       exit(-1);
    }
 
-   while (fgets(buf, sizeof buf, fp)) {
-
-      /*
-       * The state machine determines when to open, write and close a file.
-       */
-      if (strstr(buf, LOG_GUEST_MARK)) {
-         if (strstr(buf, LOG_START_MARK)) { //open a new output file.
-            const char *ext;
-            char tstamp[32];
-            time_t now;
-
-            ASSERT(outfp == NULL);
-            ASSERT(state == NOT_IN_GUEST_LOGGING);
-            DEBUG_ONLY(state = IN_GUEST_LOGGING);
-
-            /*
-             * read the input filename, which was the filename written by the
-             * guest.
-             */
-            logInpFilename = strstr(buf, LOG_START_MARK);
-            logInpFilename += sizeof LOG_START_MARK;
-            ptrStr = strstr(logInpFilename, ": ver ");
-            if (ptrStr == NULL) {
-               fprintf(stderr, "Invalid start log mark.");
-               break;
-            }
-            *ptrStr = '\0';
-
-            /*
-             * Ignore the filename in the log, for obvious security reasons
-             * and create a new filename consiting of time and enumerator.
-             * Try to maintain the same extension reported by the guest,
-             * though, if it's in the white list.
-             */
-            if (StrUtil_EndsWith(logInpFilename, ".zip")) {
-               ext = "zip";
-            } else if (StrUtil_EndsWith(logInpFilename, ".tar.gz")) {
-               ext = "tar.gz";
-            } else {
-               /* Something else we don't expect from out vm-support scripts. */
-               ext = "log";
-            }
-
-            time(&now);
-            strftime(tstamp, sizeof tstamp, "%Y-%m-%d-%H-%M", localtime(&now));
-            Str_Sprintf(fname, sizeof fname, "vm-support-%d-%s.%s",
-                        filenu++, tstamp, ext);
-
-            /*
-             * Read the version information, if they dont match just warn
-             * and leave the outfp null, so we do process the input file, but
-             * dont write anything.
-             */
-            ptrStr++;
-            ver = strstr(ptrStr, "ver - ");
-            if (!ver) {
-               Warning("No version information detected\n");
-            } else {
-               ver = ver + sizeof "ver - " - 1;
-               version = strtol(ver, NULL, 0);
-               if (version != LOG_VERSION) {
-                  Warning("input version %d doesnt match the\
-                          version of this binary %d", version, LOG_VERSION);
-               } else {
-                  printf("reading file %s to %s \n", logInpFilename, fname);
-                  if (!(outfp = fopen(fname, "wb"))) {
-                     Warning("Error opening file %s\n", fname);
-                  }
-               }
-            }
-         } else if (strstr(buf, LOG_END_MARK)) { // close the output file.
-            ASSERT(state == IN_GUEST_LOGGING);
-            DEBUG_ONLY(state = NOT_IN_GUEST_LOGGING);
-            fclose(outfp);
-            outfp = NULL;
-         } else { // write to the output file
-            ASSERT(state == IN_GUEST_LOGGING);
-            if (outfp) {
-               ptrStr = strstr(buf, LOG_GUEST_MARK);
-               ptrStr += sizeof LOG_GUEST_MARK - 1;
-               if (Base64_Decode(ptrStr, base64Out, BUF_OUT_SIZE, &lenOut)) {
-                  if (fwrite(base64Out, 1, lenOut, outfp) != lenOut) {
-                     Warning("Error writing output\n");
-                  }
-               } else {
-                  Warning("Error decoding output %s\n", ptrStr);
-               }
-            }
-         }
-      }
+   if (!XferV2_Xmit(xport, filename, fp)) {
+      Warning("Transfer of %s failed\n", filename);
    }
    fclose(fp);
+#else
+   Warning("Version %d transfers need zlib, this binary has none\n",
+           LOG_VERSION_2);
+   exit(-1);
+#endif
 }
 
 
 static void
 usage(void)
 {
-   Warning("xferlogs <options> <filename>\n");
-   Warning("options - enc/dec\n");
+   Warning("xferlogs <options> <filename> [<output>]\n");
+   Warning("options - enc/enc2/dec/upd\n");
+   Warning("enc and enc2 write to <output>, if given, not to the vmx log\n");
 }
 
 
@@ -281,15 +153,28 @@ main(int argc,
      char *argv[])
 {
    int status;
-   if (argc != 3) {
+   if (argc != 3 && !(argc == 4 && !strncmp(argv[1], "enc", 3))) {
       usage();
       return -1;
    }
 
    if (!strncmp(argv[1], "enc", 3)) {
-      xmitFile(argv[2]);
+      XferTransport *xport = argc == 4 ? XferTransport_OpenFile(argv[3]) :
+                                         XferTransport_OpenRpc();
+
+      if (xport == NULL) {
+         return -1;
+      }
+      if (!strcmp(argv[1], "enc2")) {
+         xmitFileV2(xport, argv[2]);
+      } else {
+         xmitFile(xport, argv[2]);
+      }
+      XferTransport_Close(xport);
    } else if(!strncmp(argv[1], "dec", 3)) {
-      extractFile(argv[2]);
+      if (XferLogs_Extract(argv[2]) < 0) {
+         exit(-1);
+      }
    } else if(!strncmp(argv[1], "upd", 3)) {
       if (StrUtil_StrToInt(&status, argv[2])) {
          RpcOut_sendOne(NULL, NULL, RPC_VMSUPPORT_STATUS " %d", status);
@@ -302,4 +187,3 @@ main(int argc,
    }
    return 0;
 }
-
@@ -0,0 +1,238 @@
+/*********************************************************
+ * Copyright (C) 2006-2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * xferlogsExtract.c --
+ *
+ *      Extraction of the files the guest transferred to a vmx log, in
+ *      either version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "vmware.h"
+#include "debug.h"
+#include "base64.h"
+#include "str.h"
+#include "strutil.h"
+#include "xferlogsInt.h"
+
+#define BUF_OUT_SIZE           256
+
+typedef enum {
+   NOT_IN_GUEST_LOGGING,
+   IN_GUEST_LOGGING
+} extractMode;
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * XferLogs_Extract --
+ *
+ *       This function iterates through the vmx log file and for every
+ *       line which has a "Guest: >" writes the unencoded base64 output to
+ *       a file, depending on the state machine. Version 2 transfers go
+ *       through an XferV2Decoder.
+ *
+ * Results:
+ *       The number of files extracted whole, or -1 if unable to read the
+ *       input file.
+ *
+ * Side effects:
+ *       A series of decoded output files are created in the current
+ *       directory.
+ *--------------------------------------------------------------------------
+ */
+
+int
+XferLogs_Extract(const char *filename) //IN: vmx log filename e.g. vmware.log
+{
+   FILE *fp;
+   FILE *outfp = NULL;
+   char buf[XFER_LINE_SIZE];
+   uint8 base64Out[BUF_OUT_SIZE];
+   size_t lenOut;
+   char fname[256];
+   char *ptrStr, *logInpFilename, *ver;
+   int version;
+   int filenu = 0; // output file enumerator
+   int numWhole = 0;
+   Bool ok = FALSE; // nothing went wrong in the current v1 transfer
+#ifdef HAVE_ZLIB
+   XferV2Decoder *dec = NULL;
+#endif
+   DEBUG_ONLY(extractMode state = NOT_IN_GUEST_LOGGING);
+
+
+   if (!(fp = fopen(filename, "rt"))) {
+      Warning("Error opening file %s, errno %d - %s \n",
+              filename, errno, strerror(errno));
+      return -1;
+   }
+
+   while (fgets(buf, sizeof buf, fp)) {
+
+      /*
+       * The state machine determines when to open, write and close a file.
+       */
+      if (strstr(buf, LOG_GUEST_MARK)) {
+         if (strstr(buf, LOG_START_MARK)) { //open a new output file.
+            const char *ext;
+            char tstamp[32];
+            time_t now;
+
+            ASSERT(outfp == NULL);
+            ASSERT(state == NOT_IN_GUEST_LOGGING);
+            DEBUG_ONLY(state = IN_GUEST_LOGGING);
+
+            /*
+             * read the input filename, which was the filename written by the
+             * guest.
+             */
+            logInpFilename = strstr(buf, LOG_START_MARK);
+            logInpFilename += sizeof LOG_START_MARK;
+            ptrStr = strstr(logInpFilename, ": ver ");
+            if (ptrStr == NULL) {
+               fprintf(stderr, "Invalid start log mark.");
+               break;
+            }
+            *ptrStr = '\0';
+
+            /*
+             * Ignore the filename in the log, for obvious security reasons
+             * and create a new filename consiting of time and enumerator.
+             * Try to maintain the same extension reported by the guest,
+             * though, if it's in the white list.
+             */
+            if (StrUtil_EndsWith(logInpFilename, ".zip")) {
+               ext = "zip";
+            } else if (StrUtil_EndsWith(logInpFilename, ".tar.gz")) {
+               ext = "tar.gz";
+            } else {
+               /* Something else we don't expect from out vm-support scripts. */
+               ext = "log";
+            }
+
+            time(&now);
+            strftime(tstamp, sizeof tstamp, "%Y-%m-%d-%H-%M", localtime(&now));
+            Str_Sprintf(fname, sizeof fname, "vm-support-%d-%s.%s",
+                        filenu++, tstamp, ext);
+
+            /*
+             * Read the version information, if they dont match just warn
+             * and leave the outfp null, so we do process the input file, but
+             * dont write anything.
+             */
+            ptrStr++;
+            ver = strstr(ptrStr, "ver - ");
+            if (!ver) {
+               Warning("No version information detected\n");
+            } else {
+               char *codec;
+
+               ver = ver + sizeof "ver - " - 1;
+               version = strtol(ver, &codec, 0);
+               if (version == LOG_VERSION) {
+                  printf("reading file %s to %s \n", logInpFilename, fname);
+                  if (!(outfp = fopen(fname, "wb"))) {
+                     Warning("Error opening file %s\n", fname);
+                  }
+                  ok = TRUE;
+#ifdef HAVE_ZLIB
+               } else if (version == LOG_VERSION_2) {
+                  printf("reading file %s to %s \n", logInpFilename, fname);
+                  if (!(outfp = fopen(fname, "wb"))) {
+                     Warning("Error opening file %s\n", fname);
+                  } else if (!(dec = XferV2_DecoderNew(codec +
+                                                       strspn(codec, " "),
+                                                       outfp))) {
+                     fclose(outfp);
+                     outfp = NULL;
+                  }
+#endif
+               } else {
+                  Warning("input version %d doesnt match the\
+                          version of this binary %d", version, LOG_VERSION);
+               }
+            }
+         } else if (strstr(buf, LOG_END_MARK)) { // close the output file.
+            ASSERT(state == IN_GUEST_LOGGING);
+            DEBUG_ONLY(state = NOT_IN_GUEST_LOGGING);
+#ifdef HAVE_ZLIB
+            if (dec) {
+               ok = XferV2_DecoderFinish(dec, buf);
+               if (!ok) {
+                  Warning("File %s is incomplete\n", fname);
+               }
+               dec = NULL;
+            }
+#endif
+            if (outfp) {
+               if (fclose(outfp) != 0) {
+                  Warning("Error writing output\n");
+                  ok = FALSE;
+               }
+               outfp = NULL;
+               if (ok) {
+                  numWhole++;
+               }
+            }
+            ok = FALSE;
+         } else { // write to the output file
+            ASSERT(state == IN_GUEST_LOGGING);
+#ifdef HAVE_ZLIB
+            if (dec) {
+               ptrStr = strstr(buf, LOG_GUEST_MARK);
+               ptrStr += sizeof LOG_GUEST_MARK - 1;
+               XferV2_DecodeLine(dec, ptrStr);
+            } else
+#endif
+            if (outfp) {
+               ptrStr = strstr(buf, LOG_GUEST_MARK);
+               ptrStr += sizeof LOG_GUEST_MARK - 1;
+               if (Base64_Decode(ptrStr, base64Out, BUF_OUT_SIZE, &lenOut)) {
+                  if (fwrite(base64Out, 1, lenOut, outfp) != lenOut) {
+                     Warning("Error writing output\n");
+                     ok = FALSE;
+                  }
+               } else {
+                  Warning("Error decoding output %s\n", ptrStr);
+                  ok = FALSE;
+               }
+            }
+         }
+      }
+   }
+#ifdef HAVE_ZLIB
+   if (dec) {
+      XferV2_DecoderFinish(dec, "");
+   }
+#endif
+   if (outfp) {
+      Warning("File %s is incomplete\n", fname);
+      fclose(outfp);
+   }
+   fclose(fp);
+
+   return numWhole;
+}
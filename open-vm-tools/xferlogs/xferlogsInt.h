@@ -0,0 +1,105 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * xferlogsInt.h --
+ *
+ *      Transports and version 2 format of the log transfering utility.
+ */
+
+#ifndef _XFERLOGS_INT_H_
+#define _XFERLOGS_INT_H_
+
+#include <stdio.h>
+
+#include "vm_basic_types.h"
+
+#define LOG_GUEST_MARK         "Guest: >"
+#define LOG_START_MARK         ">Logfile Begins "
+#define LOG_END_MARK           ">Logfile Ends "
+
+#define LOG_VERSION            1
+#define LOG_VERSION_2          2
+
+/*
+ * Longest line a transfer sends, and XferLogs_Extract reads: a vmx log
+ * line of RPCVMX_MAX_LOG_LEN bytes, with its time stamp and thread name.
+ */
+#define XFER_LINE_SIZE         4096
+
+/*
+ * Where the lines of a transfer go: the vmx log, over one RpcOut channel
+ * kept open for the whole transfer, or a local file laid out as the vmx
+ * log would be, for XferLogs_Extract to read back.
+ */
+
+typedef struct XferTransport XferTransport;
+
+struct XferTransport {
+   /* Sends a line of at most RPCVMX_MAX_LOG_LEN bytes. */
+   Bool (*send)(XferTransport *xport, const char *line, size_t len);
+   void (*close)(XferTransport *xport);
+   uint64 lines;
+   uint64 bytes;
+};
+
+XferTransport *XferTransport_OpenRpc(void);
+XferTransport *XferTransport_OpenFile(const char *filename);
+Bool XferTransport_Printf(XferTransport *xport, const char *fmt, ...)
+   PRINTF_DECL(2, 3);
+void XferTransport_Close(XferTransport *xport);
+
+/*
+ * Version 1: the file goes Base64 encoded, 57 bytes of it on each line.
+ */
+
+Bool XferV1_Xmit(XferTransport *xport, const char *filename, FILE *fp);
+
+/*
+ * Extracts the transfers of either version in a vmx log, to files named
+ * after the time in the current directory.
+ */
+
+int XferLogs_Extract(const char *filename);
+
+#ifdef HAVE_ZLIB
+/*
+ * Version 2: the file goes compressed with zlib (or as is when already
+ * compressed), in chunks of XFER_V2_CHUNK bytes, each on a line with its
+ * sequence number and CRC-32:
+ *
+ *    >Logfile Begins : /tmp/vm-support.tar.gz: ver - 2 raw
+ *    >0 1c291ca3 H4sIAAAAAAAAA+y9...
+ *    >1 a7e4b0f1 0m3cNLTx8a9e9z0b...
+ *    >Logfile Ends : chunks 2 size 2040 crc 5d0ab3c1
+ *
+ * The end mark has the size and CRC-32 of the file.
+ */
+
+#define XFER_V2_CHUNK          1024
+
+typedef struct XferV2Decoder XferV2Decoder;
+
+Bool XferV2_Xmit(XferTransport *xport, const char *filename, FILE *fp);
+
+XferV2Decoder *XferV2_DecoderNew(const char *codec, FILE *outfp);
+Bool XferV2_DecodeLine(XferV2Decoder *dec, const char *line);
+Bool XferV2_DecoderFinish(XferV2Decoder *dec, const char *endMark);
+#endif
+
+#endif /* _XFERLOGS_INT_H_ */
@@ -0,0 +1,325 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * xferlogsTransport.c --
+ *
+ *      Transports of the log transfering utility: the vmx log, or a local
+ *      file.
+ */
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "vmware.h"
+#include "debug.h"
+#include "rpcout.h"
+#include "rpcvmx.h"
+#include "str.h"
+#include "util.h"
+#include "xferlogsInt.h"
+
+typedef struct XferRpcTransport {
+   XferTransport xport;
+   RpcOut *out;
+   char buf[sizeof "log " + RPCVMX_MAX_LOG_LEN];
+} XferRpcTransport;
+
+typedef struct XferFileTransport {
+   XferTransport xport;
+   FILE *fp;
+} XferFileTransport;
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * XferRpcSend --
+ *
+ *       Sends a line to the vmx log with the "log" command, on the channel
+ *       of the transport. If the channel fails, as when the VM was suspended
+ *       meanwhile, opens it again and resends the line once.
+ *
+ * Results:
+ *       TRUE if the vmx logged the line.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static Bool
+XferRpcSend(XferTransport *xport,  // IN:
+            const char *line,      // IN:
+            size_t len)            // IN:
+{
+   XferRpcTransport *rpc = (XferRpcTransport *)xport;
+   size_t reqLen = sizeof "log " - 1 + len;
+   const char *reply;
+   size_t repLen;
+   Bool status;
+   int attempt;
+
+   ASSERT(len <= RPCVMX_MAX_LOG_LEN);
+   memcpy(rpc->buf + sizeof "log " - 1, line, len);
+
+   for (attempt = 0; attempt < 2; attempt++) {
+      if (RpcOut_send(rpc->out, rpc->buf, reqLen, &status, &reply, &repLen)) {
+         return status;
+      }
+
+      Debug("%s: %s\n", __FUNCTION__, reply);
+      RpcOut_stop(rpc->out);
+      if (!RpcOut_start(rpc->out)) {
+         break;
+      }
+   }
+
+   return FALSE;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * XferRpcClose --
+ *
+ *       Closes the channel of the transport, and frees it.
+ *
+ * Results:
+ *       None.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+XferRpcClose(XferTransport *xport)  // IN:
+{
+   XferRpcTransport *rpc = (XferRpcTransport *)xport;
+
+   RpcOut_stop(rpc->out);
+   RpcOut_Destruct(rpc->out);
+   free(rpc);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * XferTransport_OpenRpc --
+ *
+ *       Opens a transport to the vmx log, on a channel kept open until the
+ *       transport is closed: each line is one round trip rather than the
+ *       open, send and close of RpcVMX_Log.
+ *
+ * Results:
+ *       The transport, NULL if the channel cannot be opened.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+XferTransport *
+XferTransport_OpenRpc(void)
+{
+   XferRpcTransport *rpc = Util_SafeCalloc(1, sizeof *rpc);
+
+   rpc->out = RpcOut_Construct();
+   if (rpc->out == NULL || !RpcOut_start(rpc->out)) {
+      Warning("Unable to open the RPC channel\n");
+      RpcOut_Destruct(rpc->out);
+      free(rpc);
+      return NULL;
+   }
+
+   memcpy(rpc->buf, "log ", sizeof "log " - 1);
+   rpc->xport.send = XferRpcSend;
+   rpc->xport.close = XferRpcClose;
+
+   return &rpc->xport;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * XferFileSend --
+ *
+ *       Appends a line to the file, as the vmx would log it.
+ *
+ * Results:
+ *       TRUE on success.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static Bool
+XferFileSend(XferTransport *xport,  // IN:
+             const char *line,      // IN:
+             size_t len)            // IN:
+{
+   XferFileTransport *file = (XferFileTransport *)xport;
+
+   ASSERT(len <= RPCVMX_MAX_LOG_LEN);
+
+   return fputs("xferlogs| Guest: ", file->fp) != EOF &&
+          fwrite(line, 1, len, file->fp) == len &&
+          putc('\n', file->fp) != EOF;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * XferFileClose --
+ *
+ *       Closes the file of the transport, and frees it.
+ *
+ * Results:
+ *       None.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+XferFileClose(XferTransport *xport)  // IN:
+{
+   XferFileTransport *file = (XferFileTransport *)xport;
+
+   if (fclose(file->fp) != 0) {
+      Warning("Error writing output, errno %d\n", errno);
+   }
+   free(file);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * XferTransport_OpenFile --
+ *
+ *       Opens a transport writing to a local file rather than to the vmx
+ *       log, to extract or benchmark transfers offline.
+ *
+ * Results:
+ *       The transport, NULL if the file cannot be created.
+ *
+ * Side effects:
+ *       Creates or truncates the file.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+XferTransport *
+XferTransport_OpenFile(const char *filename)  // IN:
+{
+   XferFileTransport *file;
+   FILE *fp = fopen(filename, "w");
+
+   if (fp == NULL) {
+      Warning("Unable to open file %s with errno %d\n", filename, errno);
+      return NULL;
+   }
+
+   file = Util_SafeCalloc(1, sizeof *file);
+   file->fp = fp;
+   file->xport.send = XferFileSend;
+   file->xport.close = XferFileClose;
+
+   return &file->xport;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * XferTransport_Printf --
+ *
+ *       Sends a formatted line, truncated to RPCVMX_MAX_LOG_LEN bytes, and
+ *       counts it.
+ *
+ * Results:
+ *       TRUE on success.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+Bool
+XferTransport_Printf(XferTransport *xport,  // IN:
+                     const char *fmt,       // IN:
+                     ...)                   // IN:
+{
+   char line[RPCVMX_MAX_LOG_LEN + 1];
+   va_list args;
+   int len;
+
+   va_start(args, fmt);
+   len = Str_Vsnprintf(line, sizeof line, fmt, args);
+   va_end(args);
+
+   if (len < 0) {
+      len = RPCVMX_MAX_LOG_LEN;
+   }
+
+   xport->lines++;
+   xport->bytes += len;
+
+   return xport->send(xport, line, len);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * XferTransport_Close --
+ *
+ *       Closes a transport.
+ *
+ * Results:
+ *       None.
+ *
+ * Side effects:
+ *       Frees the transport.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+XferTransport_Close(XferTransport *xport)  // IN:
+{
+   if (xport != NULL) {
+      xport->close(xport);
+   }
+}
@@ -0,0 +1,97 @@
+/*********************************************************
+ * Copyright (C) 2006-2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * xferlogsV1.c --
+ *
+ *      Version 1 of the log transfer: the file goes Base64 encoded, 57
+ *      bytes of it on each line, so that a line of the vmx log is 80
+ *      characters. See xferlogs.c for an example.
+ */
+
+#include <stdio.h>
+
+#include "vmware.h"
+#include "base64.h"
+#include "xferlogsInt.h"
+
+/*
+ * "The resultant base64-encoded data exceeds the original in length by the
+ * ratio 4:3, and typically appears to consist of seemingly random characters.
+ * As newlines, represented by a CR+LF pair, are inserted in the encoded data
+ * every 76 characters, the actual length of the encoded data is approximately
+ * 136.8% of the original." - Base64 Wiki
+ * And just so that it produces 80 char output.
+ */
+
+#define BUF_BASE64_SIZE        57
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * XferV1_Xmit --
+ *
+ *       This function transfers a file using the transport in base64
+ *       encoding.
+ *
+ * Results:
+ *       TRUE if the whole file was sent.
+ *
+ * Side effects:
+ *       Output is added to the transport.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+Bool
+XferV1_Xmit(XferTransport *xport,  // IN: where the file goes.
+            const char *filename,  // IN: name the file is sent under.
+            FILE *fp)              // IN: file to be transmitted.
+{
+   size_t readLen;
+   char buf[BUF_BASE64_SIZE];
+   Bool ok = TRUE;
+
+   /*
+    * We have a unique identifier saying that this is guest dumping the
+    * output of logs and not any other logging information from the guest.
+    */
+   char base64B[BUF_BASE64_SIZE * 2] = ">";
+   char *base64Buf = base64B + 1;
+
+   //XXX the format below is hardcoded and used by XferLogs_Extract
+   XferTransport_Printf(xport, "%s: %s: ver - %d", LOG_START_MARK, filename,
+                        LOG_VERSION);
+   while ((readLen = fread(buf, 1, sizeof buf, fp)) > 0 ) {
+      if (Base64_Encode(buf, readLen, base64Buf, sizeof base64B - 1, NULL)) {
+         XferTransport_Printf(xport, "%s", base64B);
+      } else {
+         Warning("Error in Base64_Encode\n");
+         ok = FALSE;
+         break;
+      }
+   }
+   if (ferror(fp)) {
+      Warning("Error reading %s\n", filename);
+      ok = FALSE;
+   }
+   XferTransport_Printf(xport, LOG_END_MARK);
+
+   return ok;
+}
@@ -0,0 +1,463 @@
+/*********************************************************
+ * Copyright (C) 2017 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * xferlogsV2.c --
+ *
+ *      Version 2 of the log transfer: the file is deflated with zlib, unless
+ *      it is already compressed, and goes in chunks of XFER_V2_CHUNK bytes
+ *      rather than the 57 bytes of a version 1 line. Each chunk has a
+ *      sequence number, for XferLogs_Extract to tell a lost or repeated
+ *      line, and a CRC-32. See xferlogsInt.h for the format.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <zlib.h>
+
+#include "vmware.h"
+#include "debug.h"
+#include "base64.h"
+#include "str.h"
+#include "strutil.h"
+#include "util.h"
+#include "xferlogsInt.h"
+
+#define XFER_V2_CODEC_ZLIB     "zlib"
+#define XFER_V2_CODEC_RAW      "raw"
+#define XFER_V2_READ_SIZE      (64 * 1024)
+
+struct XferV2Decoder {
+   Bool raw;          // Chunks are the file as is, not deflated.
+   Bool failed;
+   Bool streamEnd;    // inflate reached the end of the deflate stream.
+   z_stream zs;
+   FILE *outfp;       // NULL to check the transfer, but write nothing.
+   uint32 nextSeq;
+   uLong crc;         // CRC-32 of the file so far.
+   uint64 size;
+};
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * XferV2IsCompressed --
+ *
+ *       Tells from its extension whether a file is compressed already, as
+ *       the tarball of vm-support is, so deflating it again is wasted work.
+ *
+ * Results:
+ *       TRUE if compressed.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static Bool
+XferV2IsCompressed(const char *filename)  // IN:
+{
+   static const char *exts[] = { ".gz", ".tgz", ".zip", ".bz2", ".xz" };
+   size_t i;
+
+   for (i = 0; i < ARRAYSIZE(exts); i++) {
+      if (StrUtil_EndsWith(filename, exts[i])) {
+         return TRUE;
+      }
+   }
+
+   return FALSE;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * XferV2SendChunk --
+ *
+ *       Sends a chunk, Base64 encoded, with its sequence number and CRC-32.
+ *
+ * Results:
+ *       TRUE on success.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static Bool
+XferV2SendChunk(XferTransport *xport,  // IN:
+                uint32 seq,            // IN:
+                const uint8 *chunk,    // IN:
+                size_t len)            // IN:
+{
+   char base64[((XFER_V2_CHUNK + 2) / 3) * 4 + 1];
+
+   if (!Base64_Encode(chunk, len, base64, sizeof base64, NULL)) {
+      Warning("Error in Base64_Encode\n");
+      return FALSE;
+   }
+
+   return XferTransport_Printf(xport, ">%u %08x %s", seq,
+                               (uint32)crc32(0, chunk, len), base64);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * XferV2_Xmit --
+ *
+ *       Transfers a file in the version 2 format: reads it in blocks of
+ *       XFER_V2_READ_SIZE bytes, deflates them, and sends the output as
+ *       soon as it fills a chunk.
+ *
+ * Results:
+ *       TRUE if the whole file was sent.
+ *
+ * Side effects:
+ *       On failure, the end mark has no size and CRC-32, for
+ *       XferLogs_Extract to discard the file.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+Bool
+XferV2_Xmit(XferTransport *xport,  // IN:
+            const char *filename,  // IN: name in the start mark
+            FILE *fp)              // IN:
+{
+   Bool raw = XferV2IsCompressed(filename);
+   uint8 *in = Util_SafeMalloc(XFER_V2_READ_SIZE);
+   uint8 chunk[XFER_V2_CHUNK];
+   z_stream zs;
+   uLong crc = crc32(0, NULL, 0);
+   uint64 size = 0;
+   uint32 seq = 0;
+   Bool ok = TRUE;
+   Bool eof = FALSE;
+
+   memset(&zs, 0, sizeof zs);
+   if (!raw && deflateInit(&zs, Z_DEFAULT_COMPRESSION) != Z_OK) {
+      Warning("Error in deflateInit\n");
+      free(in);
+      return FALSE;
+   }
+
+   //XXX the format below is hardcoded and used by XferLogs_Extract
+   ok = XferTransport_Printf(xport, "%s: %s: ver - %d %s", LOG_START_MARK,
+                             filename, LOG_VERSION_2,
+                             raw ? XFER_V2_CODEC_RAW : XFER_V2_CODEC_ZLIB);
+
+   zs.next_out = chunk;
+   zs.avail_out = sizeof chunk;
+
+   while (ok && !eof) {
+      size_t readLen = fread(in, 1, XFER_V2_READ_SIZE, fp);
+
+      if (readLen < XFER_V2_READ_SIZE) {
+         if (ferror(fp)) {
+            Warning("Error reading %s, errno %d\n", filename, errno);
+            ok = FALSE;
+            break;
+         }
+         eof = TRUE;
+      }
+      crc = crc32(crc, in, readLen);
+      size += readLen;
+
+      if (raw) {
+         size_t off = 0;
+
+         while (ok && off < readLen) {
+            size_t n = MIN(zs.avail_out, readLen - off);
+
+            memcpy(zs.next_out, in + off, n);
+            zs.next_out += n;
+            zs.avail_out -= n;
+            off += n;
+            if (zs.avail_out == 0) {
+               ok = XferV2SendChunk(xport, seq++, chunk, sizeof chunk);
+               zs.next_out = chunk;
+               zs.avail_out = sizeof chunk;
+            }
+         }
+      } else {
+         int flush = eof ? Z_FINISH : Z_NO_FLUSH;
+         int ret;
+
+         zs.next_in = in;
+         zs.avail_in = readLen;
+         do {
+            ret = deflate(&zs, flush);
+            ASSERT(ret != Z_STREAM_ERROR);
+            if (zs.avail_out == 0) {
+               ok = XferV2SendChunk(xport, seq++, chunk, sizeof chunk);
+               zs.next_out = chunk;
+               zs.avail_out = sizeof chunk;
+            }
+         } while (ok && (zs.avail_in > 0 ||
+                         (flush == Z_FINISH && ret != Z_STREAM_END)));
+      }
+   }
+
+   /* The last, partial, chunk. */
+   if (ok && zs.avail_out < sizeof chunk) {
+      ok = XferV2SendChunk(xport, seq++, chunk, sizeof chunk - zs.avail_out);
+   }
+
+   if (ok) {
+      ok = XferTransport_Printf(xport, "%s: chunks %u size %"FMT64"u crc %08x",
+                                LOG_END_MARK, seq, size, (uint32)crc);
+   } else {
+      XferTransport_Printf(xport, "%s", LOG_END_MARK);
+   }
+
+   if (!raw) {
+      deflateEnd(&zs);
+   }
+   free(in);
+
+   return ok;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * XferV2_DecoderNew --
+ *
+ *       Creates a decoder for a transfer, given the codec of its start mark.
+ *
+ * Results:
+ *       The decoder, NULL if the codec is unknown.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+XferV2Decoder *
+XferV2_DecoderNew(const char *codec,  // IN: "zlib" or "raw"
+                  FILE *outfp)        // IN: NULL to only check the transfer
+{
+   XferV2Decoder *dec = Util_SafeCalloc(1, sizeof *dec);
+
+   if (strncmp(codec, XFER_V2_CODEC_RAW, sizeof XFER_V2_CODEC_RAW - 1) == 0) {
+      dec->raw = TRUE;
+   } else if (strncmp(codec, XFER_V2_CODEC_ZLIB,
+                      sizeof XFER_V2_CODEC_ZLIB - 1) != 0 ||
+              inflateInit(&dec->zs) != Z_OK) {
+      Warning("Unsupported codec %s\n", codec);
+      free(dec);
+      return NULL;
+   }
+
+   dec->outfp = outfp;
+   dec->crc = crc32(0, NULL, 0);
+
+   return dec;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * XferV2Write --
+ *
+ *       Writes decoded bytes of the file, and accounts for them.
+ *
+ * Results:
+ *       TRUE on success.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static Bool
+XferV2Write(XferV2Decoder *dec,  // IN/OUT:
+            const uint8 *data,   // IN:
+            size_t len)          // IN:
+{
+   dec->crc = crc32(dec->crc, data, len);
+   dec->size += len;
+
+   if (dec->outfp != NULL && fwrite(data, 1, len, dec->outfp) != len) {
+      Warning("Error writing output\n");
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * XferV2_DecodeLine --
+ *
+ *       Decodes a line of the transfer, what follows LOG_GUEST_MARK. Lines
+ *       repeated, as the vmx may log them twice when the guest resends
+ *       after a reset of the channel, are skipped.
+ *
+ * Results:
+ *       FALSE if the line is invalid, or out of sequence: the file is lost,
+ *       and the next lines are ignored.
+ *
+ * Side effects:
+ *       Writes to the output file.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+Bool
+XferV2_DecodeLine(XferV2Decoder *dec,  // IN/OUT:
+                  const char *line)    // IN:
+{
+   uint8 chunk[XFER_V2_CHUNK + 3];
+   uint8 out[4 * XFER_V2_CHUNK];
+   unsigned long seq;
+   unsigned long crc;
+   size_t len;
+   char *end;
+
+   if (dec->failed) {
+      return FALSE;
+   }
+
+   seq = strtoul(line, &end, 10);
+   if (end == line || *end != ' ') {
+      Warning("Invalid line %s\n", line);
+      goto fail;
+   }
+   line = end + 1;
+   crc = strtoul(line, &end, 16);
+   if (end == line || *end != ' ') {
+      Warning("Invalid line %s\n", line);
+      goto fail;
+   }
+
+   if (seq < dec->nextSeq) {
+      return TRUE;
+   }
+   if (seq > dec->nextSeq) {
+      Warning("Chunks %u to %lu are missing\n", dec->nextSeq, seq - 1);
+      goto fail;
+   }
+
+   if (!Base64_Decode(end + 1, chunk, sizeof chunk, &len) ||
+       len > XFER_V2_CHUNK) {
+      Warning("Error decoding chunk %lu\n", seq);
+      goto fail;
+   }
+   if (crc32(0, chunk, len) != crc) {
+      Warning("Chunk %lu is corrupted\n", seq);
+      goto fail;
+   }
+   dec->nextSeq++;
+
+   if (dec->raw) {
+      if (!XferV2Write(dec, chunk, len)) {
+         goto fail;
+      }
+      return TRUE;
+   }
+
+   dec->zs.next_in = chunk;
+   dec->zs.avail_in = len;
+   while (dec->zs.avail_in > 0 && !dec->streamEnd) {
+      int ret;
+
+      dec->zs.next_out = out;
+      dec->zs.avail_out = sizeof out;
+      ret = inflate(&dec->zs, Z_NO_FLUSH);
+      if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+         Warning("Error inflating chunk %lu: %d\n", seq, ret);
+         goto fail;
+      }
+      dec->streamEnd = ret == Z_STREAM_END;
+      if (!XferV2Write(dec, out, sizeof out - dec->zs.avail_out)) {
+         goto fail;
+      }
+   }
+
+   return TRUE;
+
+fail:
+   dec->failed = TRUE;
+   return FALSE;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * XferV2_DecoderFinish --
+ *
+ *       Checks the transfer against its end mark: the number of chunks, and
+ *       the size and CRC-32 of the file. Frees the decoder.
+ *
+ * Results:
+ *       TRUE if the file is whole.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+Bool
+XferV2_DecoderFinish(XferV2Decoder *dec,   // IN:
+                     const char *endMark)  // IN: the end mark line
+{
+   const char *counts = strstr(endMark, "chunks ");
+   unsigned int chunks;
+   uint64 size;
+   unsigned int crc;
+   Bool ok = !dec->failed;
+
+   if (ok && (counts == NULL ||
+              sscanf(counts, "chunks %u size %"FMT64"u crc %x",
+                     &chunks, &size, &crc) != 3)) {
+      Warning("The guest did not send the whole file\n");
+      ok = FALSE;
+   }
+   if (ok && chunks != dec->nextSeq) {
+      Warning("Chunks %u to %u are missing\n", dec->nextSeq, chunks - 1);
+      ok = FALSE;
+   }
+   if (ok && (size != dec->size || crc != (uint32)dec->crc ||
+              (!dec->raw && !dec->streamEnd))) {
+      Warning("Size or CRC-32 of the file do not match\n");
+      ok = FALSE;
+   }
+
+   if (!dec->raw) {
+      inflateEnd(&dec->zs);
+   }
+   free(dec);
+
+   return ok;
+}